@@ -170,8 +170,36 @@ mdi {
   DEFINES += ENABLE_MDI
 }
 
+# Filtered exact arithmetic for the CGAL pipeline: qmake CONFIG+=fast-csg
+# Results stay exact; see the NT3 notes in src/cgal.h for the trade-offs
+fast-csg {
+  DEFINES += FAST_CSG_LAZY_KERNEL
+}
+
+# Per-thread slab allocation for CGAL's tiny Nef records:
+# qmake CONFIG+=scalable-alloc (see CGAL_ALLOCATOR in src/cgal.h)
+scalable-alloc {
+  DEFINES += SCALABLE_NEF_ALLOCATOR
+}
+
 DEFINES += USE_PROGRESSWIDGET
 
+# Headless command-line build for render farms: qmake CONFIG+=headless
+# Compiles the geometry pipeline against the NULLGL stubs in
+# src/NULLGL.cc - no GL, GLEW, OpenCSG or Qt GUI is linked - and the
+# binary refuses png outputs up front (see openscad.cc). The source
+# selection mirrors the NULLGL regression build in tests/CMakeLists.txt;
+# the GUI files themselves are dropped further down, after the full
+# lists have been assembled.
+headless {
+  message("Building headless (NULLGL) binary: openscad-headless")
+  TARGET = openscad-headless
+  DEFINES += NULLGL
+  DEFINES -= USE_PROGRESSWIDGET
+  CONFIG -= opencsg glew
+  QT -= gui opengl
+}
+
 include(common.pri)
 
 # mingw has to come after other items so OBJECT_DIRS will work properly
@@ -200,6 +228,7 @@ HEADERS += src/typedefs.h \
            src/version_check.h \
            src/ProgressWidget.h \
            src/parsersettings.h \
+           src/statcache.h \
            src/renderer.h \
            src/rendersettings.h \
            src/ThrownTogetherRenderer.h \
@@ -208,6 +237,7 @@ HEADERS += src/typedefs.h \
            src/QGLView.h \
            src/GLView.h \
            src/MainWindow.h \
+           src/csgworker.h \
            src/Preferences.h \
            src/OpenCSGWarningDialog.h \
            src/AboutDialog.h \
@@ -215,6 +245,8 @@ HEADERS += src/typedefs.h \
            src/builtin.h \
            src/calc.h \
            src/context.h \
+           src/evalarena.h \
+           src/nodearena.h \
            src/modcontext.h \
            src/evalcontext.h \
            src/csgterm.h \
@@ -244,11 +276,18 @@ HEADERS += src/typedefs.h \
            src/openscad.h \
            src/handle_dep.h \
            src/Geometry.h \
+           src/GeometryInstances.h \
            src/Polygon2d.h \
            src/clipper-utils.h \
            src/polyset-utils.h \
+           src/scan-utils.h \
            src/polyset.h \
+           src/filebacked.h \
+           src/Reindexer.h \
            src/printutils.h \
+           src/profiler.h \
+           src/cacheadvisor.h \
+           src/memorypressure.h \
            src/fileutils.h \
            src/value.h \
            src/progress.h \
@@ -258,9 +297,18 @@ HEADERS += src/typedefs.h \
            src/traverser.h \
            src/nodecache.h \
            src/nodedumper.h \
+           src/nodehasher.h \
            src/ModuleCache.h \
+           src/ModuleSerializer.h \
            src/GeometryCache.h \
+           src/voxelizer.h \
+           src/renderstaging.h \
+           src/slaballocator.h \
+           src/workerpool.h \
+           src/CacheGovernor.h \
            src/GeometryEvaluator.h \
+           src/import-prefetch.h \
+           src/import-async.h \
            src/CSGTermEvaluator.h \
            src/Tree.h \
 	   src/DrawingCallback.h \
@@ -299,15 +347,20 @@ SOURCES += src/version_check.cc \
            src/feature.cc \
            src/node.cc \
            src/context.cc \
+           src/evalarena.cc \
+           src/nodearena.cc \
            src/modcontext.cc \
            src/evalcontext.cc \
            src/csgterm.cc \
            src/csgtermnormalizer.cc \
            src/Geometry.cc \
+           src/GeometryInstances.cc \
            src/Polygon2d.cc \
            src/clipper-utils.cc \
            src/polyset-utils.cc \
+           src/scan-utils.cc \
            src/polyset.cc \
+           src/filebacked.cc \
            src/csgops.cc \
            src/transform.cc \
            src/color.cc \
@@ -324,18 +377,30 @@ SOURCES += src/version_check.cc \
            src/linearextrude.cc \
            src/rotateextrude.cc \
            src/printutils.cc \
+           src/profiler.cc \
+           src/cacheadvisor.cc \
+           src/memorypressure.cc \
            src/fileutils.cc \
            src/progress.cc \
            src/parsersettings.cc \
+           src/statcache.cc \
            src/stl-utils.cc \
            src/boost-utils.cc \
            src/PlatformUtils.cc \
            \
            src/nodedumper.cc \
+           src/nodehasher.cc \
            src/traverser.cc \
            src/GeometryEvaluator.cc \
+           src/import-prefetch.cc \
+           src/import-async.cc \
            src/ModuleCache.cc \
+           src/ModuleSerializer.cc \
            src/GeometryCache.cc \
+           src/voxelizer.cc \
+           src/renderstaging.cc \
+           src/workerpool.cc \
+           src/CacheGovernor.cc \
            src/Tree.cc \
 	   src/DrawingCallback.cc \
 	   src/FreetypeRenderer.cc \
@@ -367,6 +432,7 @@ SOURCES += src/version_check.cc \
            \
            src/openscad.cc \
            src/mainwin.cc \
+           src/csgworker.cc \
 	   src/FontListDialog.cc
 
 # ClipperLib
@@ -395,7 +461,6 @@ cgal {
 HEADERS += src/cgal.h \
            src/cgalfwd.h \
            src/cgalutils.h \
-           src/Reindexer.h \
            src/CGALCache.h \
            src/CGALRenderer.h \
            src/CGAL_Nef_polyhedron.h \
@@ -427,6 +492,43 @@ win* {
   SOURCES += src/PlatformUtils-win.cc
 }
 
+headless {
+  RESOURCES =
+  FORMS =
+  HEADERS -= src/ProgressWidget.h \
+             src/QGLView.h \
+             src/MainWindow.h \
+             src/csgworker.h \
+             src/Preferences.h \
+             src/OpenCSGWarningDialog.h \
+             src/AboutDialog.h \
+             src/FontListDialog.h \
+             src/highlighter.h \
+             src/editor.h \
+             src/AutoUpdater.h \
+             src/cgalworker.h
+  SOURCES -= src/ProgressWidget.cc \
+             src/highlighter.cc \
+             src/Preferences.cc \
+             src/OpenCSGWarningDialog.cc \
+             src/editor.cc \
+             src/GLView.cc \
+             src/QGLView.cc \
+             src/AutoUpdater.cc \
+             src/ThrownTogetherRenderer.cc \
+             src/fbo.cc \
+             src/system-gl.cc \
+             src/mainwin.cc \
+             src/csgworker.cc \
+             src/FontListDialog.cc \
+             src/CGALRenderer.cc \
+             src/cgalworker.cc \
+             src/OffscreenContextGLX.cc \
+             src/OffscreenContextWGL.cc
+  SOURCES += src/NULLGL.cc \
+             src/OffscreenContextNULL.cc
+}
+
 isEmpty(PREFIX):PREFIX = /usr/local
 
 target.path = $$PREFIX/bin/
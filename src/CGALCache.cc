@@ -1,25 +1,267 @@
 #include "CGALCache.h"
 #include "printutils.h"
 #include "CGAL_Nef_polyhedron.h"
+#include "cgal.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include "lodepng.h"
+#include <boost/filesystem.hpp>
+#include <boost/uuid/sha1.hpp>
+#include <boost/format.hpp>
+namespace fs = boost::filesystem;
 
 CGALCache *CGALCache::inst = NULL;
 
-CGALCache::CGALCache(size_t limit) : cache(limit)
+CGALCache::CGALCache(size_t limit) : cache(limit), coldcache(limit), diskwriter_running(false)
+{
+	// Nef serializations are extremely redundant text and deflate by an
+	// order of magnitude, so demoting evictees into the compressed tier
+	// effectively multiplies the cache budget.
+	this->cache.setEvictionHandler(&CGALCache::demote, this);
+	// The persistent tier survives across processes and makes batch renders
+	// sharing library parts dramatically cheaper. It's opt-in via the
+	// environment since the on-disk blobs are only pruned manually.
+	const char *cachedir = getenv("OPENSCAD_CACHE_DIR");
+	if (cachedir && cachedir[0]) setDiskCachePath(cachedir);
+}
+
+void CGALCache::setDiskCachePath(const std::string &path)
+{
+	boost::system::error_code ec;
+	fs::create_directories(fs::path(path), ec);
+	if (ec) {
+		PRINTB("WARNING: Unable to create cache directory %s, disabling disk cache", path);
+		return;
+	}
+	this->diskcachepath = path;
+}
+
+/*!
+	Returns the on-disk filename for the given cache id; ids are full
+	NodeDumper strings and can reach megabytes, so they're condensed to a
+	strong hash first.
+*/
+std::string CGALCache::diskCacheFile(const std::string &id) const
+{
+	boost::uuids::detail::sha1 sha;
+	sha.process_bytes(id.data(), id.size());
+	unsigned int digest[5];
+	sha.get_digest(digest);
+	std::string hash;
+	for (int i=0;i<5;i++) hash += str(boost::format("%08x") % digest[i]);
+	// The two kernel builds serialize coordinates differently, so they
+	// must not read each other's files (see NT3 in cgal.h)
+#ifdef FAST_CSG_LAZY_KERNEL
+	return this->diskcachepath + "/" + hash + ".nef3l";
+#else
+	return this->diskcachepath + "/" + hash + ".nef3";
+#endif
+}
+
+bool CGALCache::containsOnDisk(const std::string &id) const
+{
+	if (this->diskcachepath.empty()) return false;
+	boost::system::error_code ec;
+	return fs::exists(fs::path(diskCacheFile(id)), ec);
+}
+
+shared_ptr<const CGAL_Nef_polyhedron> CGALCache::loadFromDisk(const std::string &id) const
+{
+	const std::string filename = diskCacheFile(id);
+	std::ifstream stream(filename.c_str());
+	if (!stream.good()) return shared_ptr<const CGAL_Nef_polyhedron>();
+
+	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+	shared_ptr<const CGAL_Nef_polyhedron> N;
+	try {
+		CGAL_Nef_polyhedron3 *p3 = new CGAL_Nef_polyhedron3;
+		stream >> *p3;
+		if (stream.fail()) {
+			delete p3;
+			PRINTB("WARNING: Corrupt disk cache entry, removing: %s", filename);
+			boost::system::error_code ec;
+			fs::remove(fs::path(filename), ec);
+		}
+		else {
+			N.reset(new CGAL_Nef_polyhedron(p3));
+		}
+	}
+	catch (const CGAL::Failure_exception &e) {
+		PRINTB("CGAL error in CGALCache::loadFromDisk: %s", e.what());
+	}
+	CGAL::set_error_behaviour(old_behaviour);
+	return N;
+}
+
+/*!
+	Queues the entry for the disk tier and returns immediately; the writer
+	thread picks it up. The queue is bounded - when the writer can't keep
+	up (e.g. a slow shared filesystem) new entries are dropped rather than
+	stalling evaluation or growing without limit.
+*/
+void CGALCache::saveToDisk(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N)
+{
+	if (this->diskcachepath.empty() || !N || N->isEmpty()) return;
+
+	boost::mutex::scoped_lock lock(this->diskqueue_mutex);
+	if (this->diskqueue.size() >= 16) {
+#ifdef DEBUG
+		PRINTB("CGAL Disk cache write-behind queue full, dropping: %s", id.substr(0, 40));
+#endif
+		return;
+	}
+	this->diskqueue.push_back(diskwrite_t(id, N));
+	if (!this->diskwriter_running) {
+		this->diskwriter_running = true;
+		this->diskwriter = boost::thread(&CGALCache::diskWriterLoop, this);
+	}
+	this->diskqueue_cond.notify_one();
+}
+
+void CGALCache::diskWriterLoop()
+{
+	for (;;) {
+		diskwrite_t entry;
+		{
+			boost::mutex::scoped_lock lock(this->diskqueue_mutex);
+			while (this->diskqueue.empty()) this->diskqueue_cond.wait(lock);
+			entry = this->diskqueue.front();
+			this->diskqueue.pop_front();
+		}
+		writeDiskEntry(entry.first, entry.second);
+	}
+}
+
+void CGALCache::writeDiskEntry(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N) const
 {
+	const std::string filename = diskCacheFile(id);
+	boost::system::error_code ec;
+	if (fs::exists(fs::path(filename), ec)) return;
+
+	// Write to a temporary file and rename to keep concurrent readers -
+	// other processes, or other hosts when the directory is on shared
+	// storage - from seeing partially written entries.
+	const std::string tmpfile = filename + "." + fs::unique_path("%%%%%%%%").string() + ".tmp";
+	std::ofstream stream(tmpfile.c_str(), std::ios::trunc);
+	if (!stream.good()) {
+		PRINTB("WARNING: Unable to write disk cache entry: %s", tmpfile);
+		return;
+	}
+	stream << *N->p3;
+	stream.close();
+	fs::rename(fs::path(tmpfile), fs::path(filename), ec);
+	if (ec) fs::remove(fs::path(tmpfile), ec);
+}
+
+/*!
+	Eviction hook for the hot tier; compresses the outgoing Nef into
+	coldcache. Runs with the evicting shard's lock held, but only ever
+	touches the separate cold tier.
+*/
+void CGALCache::demote(const std::string &id, cache_entry *entry, void *userdata)
+{
+	CGALCache *self = static_cast<CGALCache *>(userdata);
+	if (entry->N) self->saveToColdCache(id, entry->N);
+}
+
+void CGALCache::saveToColdCache(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N)
+{
+	if (N->isEmpty()) return;
+
+	std::stringstream stream;
+	stream << *N->p3;
+	const std::string &plain = stream.str();
+
+	unsigned char *deflated = NULL;
+	size_t deflatedsize = 0;
+	unsigned error = lodepng_zlib_compress(&deflated, &deflatedsize,
+																				 reinterpret_cast<const unsigned char *>(plain.data()),
+																				 plain.size(), &lodepng_default_compress_settings);
+	if (error) {
+		free(deflated);
+		return;
+	}
+#ifdef DEBUG
+	PRINTB("CGAL Cache demote: %s (%d -> %d bytes)", id.substr(0, 40) % plain.size() % deflatedsize);
+#endif
+	this->coldcache.insert(id, new std::string(reinterpret_cast<char *>(deflated), deflatedsize),
+												 deflatedsize);
+	free(deflated);
+}
+
+shared_ptr<const CGAL_Nef_polyhedron> CGALCache::loadFromColdCache(const std::string &id) const
+{
+	shared_ptr<const CGAL_Nef_polyhedron> N;
+	std::string blob;
+	if (!this->coldcache.fetch(id, blob)) return N;
+
+	unsigned char *inflated = NULL;
+	size_t inflatedsize = 0;
+	unsigned error = lodepng_zlib_decompress(&inflated, &inflatedsize,
+																					 reinterpret_cast<const unsigned char *>(blob.data()),
+																					 blob.size(), &lodepng_default_decompress_settings);
+	if (error) {
+		free(inflated);
+		const_cast<CGALCache*>(this)->coldcache.remove(id);
+		return N;
+	}
+
+	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+	try {
+		std::stringstream stream(std::string(reinterpret_cast<char *>(inflated), inflatedsize));
+		CGAL_Nef_polyhedron3 *p3 = new CGAL_Nef_polyhedron3;
+		stream >> *p3;
+		if (stream.fail()) {
+			delete p3;
+			const_cast<CGALCache*>(this)->coldcache.remove(id);
+		}
+		else {
+			N.reset(new CGAL_Nef_polyhedron(p3));
+		}
+	}
+	catch (const CGAL::Failure_exception &e) {
+		PRINTB("CGAL error in CGALCache::loadFromColdCache: %s", e.what());
+	}
+	CGAL::set_error_behaviour(old_behaviour);
+	free(inflated);
+	return N;
+}
+
+bool CGALCache::contains(const std::string &id) const
+{
+	if (this->cache.contains(id)) return true;
+	if (this->coldcache.contains(id)) return true;
+	return containsOnDisk(id);
 }
 
 shared_ptr<const CGAL_Nef_polyhedron> CGALCache::get(const std::string &id) const
 {
-	const shared_ptr<const CGAL_Nef_polyhedron> &N = this->cache[id]->N;
+	cache_entry entry;
+	if (this->cache.fetch(id, entry)) {
+#ifdef DEBUG
+		PRINTB("CGAL Cache hit: %s (%d bytes)", id.substr(0, 40) % (entry.N ? entry.N->memsize() : 0));
+#endif
+		return entry.N;
+	}
+	shared_ptr<const CGAL_Nef_polyhedron> N = loadFromColdCache(id);
+	if (!N) N = loadFromDisk(id);
 #ifdef DEBUG
-	PRINTB("CGAL Cache hit: %s (%d bytes)", id.substr(0, 40) % (N ? N->memsize() : 0));
+	PRINTB("CGAL Disk cache hit: %s (%d bytes)", id.substr(0, 40) % (N ? N->memsize() : 0));
 #endif
+	// Promote to the in-memory tier so repeated lookups stay cheap
+	if (N) {
+		const_cast<CGALCache*>(this)->cache.insert(id, new cache_entry(N), N->memsize());
+	}
 	return N;
 }
 
 bool CGALCache::insert(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N)
 {
 	bool inserted = this->cache.insert(id, new cache_entry(N), N ? N->memsize() : 0);
+	CacheGovernor::instance()->checkPressure();
+	saveToDisk(id, N);
 #ifdef DEBUG
 	if (inserted) PRINTB("CGAL Cache insert: %s (%d bytes)", id.substr(0, 40) % (N ? N->memsize() : 0));
 	else PRINTB("CGAL Cache insert failed: %s (%d bytes)", id.substr(0, 40) % (N ? N->memsize() : 0));
@@ -27,6 +269,20 @@ bool CGALCache::insert(const std::string &id, const shared_ptr<const CGAL_Nef_po
 	return inserted;
 }
 
+size_t CGALCache::totalSize() const
+{
+	return this->cache.totalCost() + this->coldcache.totalCost();
+}
+
+void CGALCache::shrinkTo(size_t bytes)
+{
+	// Shrinking the hot tier demotes into the cold tier, so trim the cold
+	// tier to whatever budget the hot tier leaves unused.
+	this->cache.shrink(bytes / 2);
+	size_t hot = this->cache.totalCost();
+	this->coldcache.shrink(bytes > hot ? bytes - hot : 0);
+}
+
 size_t CGALCache::maxSize() const
 {
 	return this->cache.maxCost();
@@ -39,17 +295,23 @@ void CGALCache::setMaxSize(size_t limit)
 
 void CGALCache::clear()
 {
-	cache.clear();
+	// clear() drops entries outright, without demoting; only cost
+	// trimming goes through the eviction handler
+	this->cache.clear();
+	this->coldcache.clear();
 }
 
 void CGALCache::print()
 {
 	PRINTB("CGAL Polyhedrons in cache: %d", this->cache.size());
 	PRINTB("CGAL cache size in bytes: %d", this->cache.totalCost());
+	if (this->cache.pinnedCost()) PRINTB("CGAL cache pinned bytes: %d", this->cache.pinnedCost());
+	PRINTB("CGAL compressed polyhedrons in cache: %d", this->coldcache.size());
+	PRINTB("CGAL compressed cache size in bytes: %d", this->coldcache.totalCost());
 }
 
 CGALCache::cache_entry::cache_entry(const shared_ptr<const CGAL_Nef_polyhedron> &N)
 	: N(N)
 {
-	if (print_messages_stack.size() > 0) this->msg = print_messages_stack.back();
+	if (print_messages_stack().size() > 0) this->msg = print_messages_stack().back();
 }
@@ -2,33 +2,96 @@
 
 #include "cache.h"
 #include "memory.h"
+#include "CacheGovernor.h"
+
+#include <list>
+#include <utility>
+#include <boost/thread.hpp>
 
 /*!
 */
-class CGALCache
+class CGALCache : public CacheGovernor::Client
 {
-public:	
+public:
 	CGALCache(size_t limit = 100*1024*1024);
 
-	static CGALCache *instance() { if (!inst) inst = new CGALCache; return inst; }
+	static CGALCache *instance()
+	{
+		if (!inst) {
+			inst = new CGALCache;
+			// Nefs are expensive to recompute - evict them last
+			CacheGovernor::instance()->registerCache(inst, 1);
+		}
+		return inst;
+	}
 
-	bool contains(const std::string &id) const { return this->cache.contains(id); }
+	bool contains(const std::string &id) const;
 	shared_ptr<const class CGAL_Nef_polyhedron> get(const std::string &id) const;
 	bool insert(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N);
+	/*!
+		Enables the persistent tier rooted at the given directory (also
+		reachable via OPENSCAD_CACHE_DIR). With --checkpoint this is the
+		crash-resume state of a long render: every completed Nef lands
+		here, and a rerun picks them up as disk cache hits.
+	*/
+	void setDiskCachePath(const std::string &path);
+	//! Exempts the entry from eviction (and thus demotion); see Cache::pin()
+	void pin(const std::string &id) { this->cache.pin(id); }
+	//! Entries in the hot in-memory tier
+	size_t size() const { return this->cache.size(); }
 	size_t maxSize() const;
 	void setMaxSize(size_t limit);
 	void clear();
 	void print();
 
+	virtual size_t totalSize() const;
+	virtual void shrinkTo(size_t bytes);
+
 private:
+	static void demote(const std::string &id, struct cache_entry *entry, void *userdata);
+	shared_ptr<const CGAL_Nef_polyhedron> loadFromColdCache(const std::string &id) const;
+	void saveToColdCache(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N);
+	bool containsOnDisk(const std::string &id) const;
+	shared_ptr<const CGAL_Nef_polyhedron> loadFromDisk(const std::string &id) const;
+	void saveToDisk(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N);
+	void writeDiskEntry(const std::string &id, const shared_ptr<const CGAL_Nef_polyhedron> &N) const;
+	void diskWriterLoop();
+	std::string diskCacheFile(const std::string &id) const;
+
 	static CGALCache *inst;
 
+	// Directory for the persistent cache tier, empty if disabled. Pointing
+	// OPENSCAD_CACHE_DIR at shared storage makes the tier fleet-wide: the
+	// atomic publish in writeDiskEntry() keeps concurrent hosts consistent.
+	std::string diskcachepath;
+
+	// Write-behind queue for the disk tier: serializing a large Nef can
+	// take seconds (more over a network filesystem), so inserts only
+	// enqueue and a lazily started writer thread does the actual I/O.
+	// Entries still queued at process exit are lost, which only costs a
+	// future cache miss.
+	typedef std::pair<std::string, shared_ptr<const CGAL_Nef_polyhedron> > diskwrite_t;
+	std::list<diskwrite_t> diskqueue;
+	boost::mutex diskqueue_mutex;
+	boost::condition_variable diskqueue_cond;
+	bool diskwriter_running;
+	boost::thread diskwriter;
+
 	struct cache_entry {
 		shared_ptr<const CGAL_Nef_polyhedron> N;
 		std::string msg;
+		cache_entry() { }
 		cache_entry(const shared_ptr<const CGAL_Nef_polyhedron> &N);
 		~cache_entry() { }
 	};
 
-	Cache<std::string, cache_entry> cache;
+	// Internally synchronized; evaluation may query and fill the cache
+	// from multiple worker threads
+	ShardedCache<std::string, cache_entry> cache;
+
+	// Compressed second tier: Nefs evicted from the hot tier are
+	// serialized and deflated here instead of being dropped, so the same
+	// memory budget holds several times more geometry at the price of a
+	// decompress+parse on re-hit. See demote().
+	ShardedCache<std::string, std::string> coldcache;
 };
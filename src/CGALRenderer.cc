@@ -39,18 +39,26 @@
 #include "cgal.h"
 
 //#include "Preferences.h"
+#include "renderstaging.h"
+#include <boost/foreach.hpp>
 
 CGALRenderer::CGALRenderer(shared_ptr<const class Geometry> geom)
 {
+	this->geom = geom;
 	if (shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(geom)) {
 		this->polyset = ps;
 	}
 	else if (shared_ptr<const Polygon2d> poly = dynamic_pointer_cast<const Polygon2d>(geom)) {
-		this->polyset.reset(poly->tessellate());
+		this->polyset = poly->tessellated();
 	}
 	else if (shared_ptr<const CGAL_Nef_polyhedron> new_N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom)) {
 		assert(new_N->getDimension() == 3);
 		if (!new_N->isEmpty()) {
+			// Reuse the OpenGL-ready conversion memoized on the Nef: when the
+			// Nef itself came out of CGALCache unchanged, rebuilding the
+			// renderer shouldn't redo the minutes-long conversion
+			this->polyhedron = new_N->displayPolyhedron();
+			if (this->polyhedron) return;
 			this->polyhedron.reset(new Polyhedron());
 			// FIXME: Make independent of Preferences
 			// this->polyhedron->setColor(Polyhedron::CGAL_NEF3_MARKED_FACET_COLOR,
@@ -64,6 +72,7 @@ CGALRenderer::CGALRenderer(shared_ptr<const class Geometry> geom)
 			
 			CGAL::OGL::Nef3_Converter<CGAL_Nef_polyhedron3>::convert_to_OGLPolyhedron(*new_N->p3, this->polyhedron.get());
 			this->polyhedron->init();
+			new_N->setDisplayPolyhedron(this->polyhedron);
 		}
 	}
 }
@@ -72,19 +81,84 @@ CGALRenderer::~CGALRenderer()
 {
 }
 
+StagedCGALRenderer::StagedCGALRenderer() : synced_generation(0)
+{
+}
+
+StagedCGALRenderer::~StagedCGALRenderer()
+{
+}
+
+bool StagedCGALRenderer::update()
+{
+	RenderStagingList *staging = RenderStagingList::instance();
+	if (staging->generation() == this->synced_generation) return false;
+	this->synced_generation = staging->generation();
+
+	std::map<std::string, shared_ptr<const Geometry> > snapshot;
+	staging->snapshot(snapshot);
+
+	// Retire superseded entries, then convert arrivals. Conversion runs
+	// on the GUI thread, but only once per staged subtree and while the
+	// worker keeps rendering; Nef results reuse the conversion memoized
+	// on the polyhedron (see the CGALRenderer constructor).
+	for (std::map<std::string, shared_ptr<CGALRenderer> >::iterator it = this->items.begin();
+			 it != this->items.end();) {
+		if (snapshot.find(it->first) == snapshot.end()) this->items.erase(it++);
+		else ++it;
+	}
+	typedef std::pair<const std::string, shared_ptr<const Geometry> > SnapshotEntry;
+	BOOST_FOREACH(const SnapshotEntry &entry, snapshot) {
+		shared_ptr<CGALRenderer> &item = this->items[entry.first];
+		if (!item) item.reset(new CGALRenderer(entry.second));
+	}
+	return true;
+}
+
+void StagedCGALRenderer::draw(bool showfaces, bool showedges) const
+{
+	this->drawstats = DrawStatistics();
+	typedef std::pair<const std::string, shared_ptr<CGALRenderer> > Item;
+	BOOST_FOREACH(const Item &item, this->items) {
+		item.second->draw(showfaces, showedges);
+		this->drawstats.triangles += item.second->getDrawStatistics().triangles;
+		this->drawstats.drawcalls += item.second->getDrawStatistics().drawcalls;
+	}
+}
+
 void CGALRenderer::draw(bool showfaces, bool showedges) const
 {
-	if (this->polyset) {
-		if (this->polyset->getDimension() == 2) {
+	this->drawstats = DrawStatistics();
+	resetColorState();
+
+	// lod-preview: when the result carries a decimation chain (see
+	// cgalworker.cc), swap in the coarsest level that still fills the
+	// object's on-screen footprint
+	shared_ptr<const PolySet> ps = this->polyset;
+	if (this->geom && this->geom->getCoarserLOD()) {
+		ScreenProjection screenproj;
+		screenproj.load();
+		shared_ptr<const Geometry> level =
+			selectLOD(this->geom, screenproj.diameter(this->geom->getBoundingBox()));
+		if (level != this->geom) {
+			shared_ptr<const PolySet> coarse = dynamic_pointer_cast<const PolySet>(level);
+			if (coarse) ps = coarse;
+		}
+	}
+
+	if (ps) {
+		this->drawstats.drawcalls++;
+		this->drawstats.triangles = countTriangles(ps);
+		if (ps->getDimension() == 2) {
 			// Draw 2D polygons
 			glDisable(GL_LIGHTING);
 // FIXME:		const QColor &col = Preferences::inst()->color(Preferences::CGAL_FACE_2D_COLOR);
 			glColor3f(0.0f, 0.75f, 0.60f);
 
-			for (size_t i=0; i < this->polyset->polygons.size(); i++) {
+			for (size_t i=0; i < ps->polygons.size(); i++) {
 				glBegin(GL_POLYGON);
-				for (size_t j=0; j < this->polyset->polygons[i].size(); j++) {
-					const Vector3d &p = this->polyset->polygons[i][j];
+				for (size_t j=0; j < ps->polygons[i].size(); j++) {
+					const Vector3d &p = ps->polygons[i][j];
 					glVertex3d(p[0], p[1], -0.1);
 				}
 				glEnd();
@@ -96,14 +170,14 @@ void CGALRenderer::draw(bool showfaces, bool showedges) const
 			glLineWidth(2);
 // FIXME:		const QColor &col2 = Preferences::inst()->color(Preferences::CGAL_EDGE_2D_COLOR);
 			glColor3f(1.0f, 0.0f, 0.0f);
-			this->polyset->render_edges(CSGMODE_NONE);
+			ps->render_edges(CSGMODE_NONE);
 			glEnable(GL_DEPTH_TEST);
 		}
 		else {
 			// Draw 3D polygons
 			const Color4f c(-1,-1,-1,-1);	
 			setColor(COLORMODE_MATERIAL, c.data(), NULL);
-			this->polyset->render_surface(CSGMODE_NORMAL, Transform3d::Identity(), NULL);
+			ps->render_surface(CSGMODE_NORMAL, Transform3d::Identity(), NULL);
 		}
 	}
 	else if (this->polyhedron) {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "renderer.h"
+#include <map>
+#include <string>
 
 class CGALRenderer : public Renderer
 {
@@ -12,4 +14,25 @@ public:
 public:
 	shared_ptr<class Polyhedron> polyhedron;
 	shared_ptr<const class PolySet> polyset;
+	//! Original geometry, kept to walk its decimation chain (lod-preview)
+	shared_ptr<const class Geometry> geom;
+};
+
+/*!
+	Draws whatever the RenderStagingList currently holds: one CGALRenderer
+	per staged subtree, created as results arrive so the user watches a
+	long render assemble in the viewport (see renderstaging.h).
+*/
+class StagedCGALRenderer : public Renderer
+{
+public:
+	StagedCGALRenderer();
+	~StagedCGALRenderer();
+	//! Syncs with the staging list; returns true when anything changed
+	bool update();
+	void draw(bool showfaces, bool showedges) const;
+
+private:
+	size_t synced_generation;
+	std::map<std::string, shared_ptr<CGALRenderer> > items;
 };
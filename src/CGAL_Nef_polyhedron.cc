@@ -13,65 +13,112 @@ CGAL_Nef_polyhedron::CGAL_Nef_polyhedron(CGAL_Nef_polyhedron3 *p)
 CGAL_Nef_polyhedron& CGAL_Nef_polyhedron::operator+=(const CGAL_Nef_polyhedron &other)
 {
 	(*this->p3) += (*other.p3);
+	this->cached_polyset.reset();
+	this->display_polyhedron.reset();
+	this->invalidateBoundingBox();
 	return *this;
 }
 
 CGAL_Nef_polyhedron& CGAL_Nef_polyhedron::operator*=(const CGAL_Nef_polyhedron &other)
 {
 	(*this->p3) *= (*other.p3);
+	this->cached_polyset.reset();
+	this->display_polyhedron.reset();
+	this->invalidateBoundingBox();
 	return *this;
 }
 
 CGAL_Nef_polyhedron& CGAL_Nef_polyhedron::operator-=(const CGAL_Nef_polyhedron &other)
 {
 	(*this->p3) -= (*other.p3);
+	this->cached_polyset.reset();
+	this->display_polyhedron.reset();
+	this->invalidateBoundingBox();
 	return *this;
 }
 
 CGAL_Nef_polyhedron &CGAL_Nef_polyhedron::minkowski(const CGAL_Nef_polyhedron &other)
 {
 	(*this->p3) = CGAL::minkowski_sum_3(*this->p3, *other.p3);
+	this->cached_polyset.reset();
+	this->display_polyhedron.reset();
+	this->invalidateBoundingBox();
 	return *this;
 }
 
+static size_t gmpq_bytes(const CGAL::Gmpq &q)
+{
+	return mpz_size(mpq_numref(q.mpq())) * sizeof(mp_limb_t) +
+		mpz_size(mpq_denref(q.mpq())) * sizeof(mp_limb_t);
+}
+
+#ifdef FAST_CSG_LAZY_KERNEL
+/*!
+	Under the lazy kernel a coordinate is an interval plus a deferred
+	expression DAG; asking for the exact Gmpq here would force the very
+	evaluation the kernel exists to avoid, on every cache insert. Use a
+	flat per-coordinate estimate instead - cache budgets care about the
+	order of magnitude, not the limb count.
+*/
+static size_t gmpq_bytes(const NT3 &)
+{
+	return sizeof(NT3) + 48;
+}
+#endif
+
 size_t CGAL_Nef_polyhedron::memsize() const
 {
 	if (this->isEmpty()) return 0;
 
 	size_t memsize = sizeof(CGAL_Nef_polyhedron);
 	memsize += this->p3->bytes();
+	if (this->cached_polyset) memsize += this->cached_polyset->memsize();
+
+	// bytes() only counts the fixed-size part of the halfedge data
+	// structure; the exact coordinates live in GMP allocations it can't
+	// see, and after a few booleans those dominate. Walk the vertices
+	// and facets and add the actual limb counts.
+	for (CGAL_Nef_polyhedron3::Vertex_const_iterator v = this->p3->vertices_begin();
+			 v != this->p3->vertices_end(); ++v) {
+		const CGAL_Point_3 &p = v->point();
+		memsize += gmpq_bytes(p.x()) + gmpq_bytes(p.y()) + gmpq_bytes(p.z());
+	}
+	for (CGAL_Nef_polyhedron3::Halffacet_const_iterator f = this->p3->halffacets_begin();
+			 f != this->p3->halffacets_end(); ++f) {
+		const CGAL_Nef_polyhedron3::Plane_3 &pl = f->plane();
+		memsize += gmpq_bytes(pl.a()) + gmpq_bytes(pl.b()) + gmpq_bytes(pl.c()) + gmpq_bytes(pl.d());
+	}
 	return memsize;
 }
 
 /*!
 	Creates a new PolySet and initializes it with the data from this polyhedron
 
+	Goes directly from the Nef facet cycles to float vertices. The old
+	route through convert_to_Polyhedron() materialized a complete
+	exact-kernel halfedge copy - roughly doubling peak memory right when
+	a finished boolean result is at its largest - only to round it to
+	doubles and discard it.
+
 	Note: Can return NULL if an error occurred
 */
 PolySet *CGAL_Nef_polyhedron::convertToPolyset() const
 {
 	if (this->isEmpty()) return new PolySet(3);
-	PolySet *ps = NULL;
-	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
-	ps = new PolySet(3);
+	PolySet *ps = new PolySet(3);
 	ps->setConvexity(this->convexity);
+	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
 	bool err = true;
 	std::string errmsg("");
-	CGAL_Polyhedron P;
 	try {
-		// Cast away constness: 
-		// convert_to_Polyhedron() wasn't const in earlier versions of CGAL.
-		CGAL_Nef_polyhedron3 *nonconst_nef3 = const_cast<CGAL_Nef_polyhedron3*>(this->p3.get());
-		err = nefworkaround::convert_to_Polyhedron<CGAL_Kernel3>( *(nonconst_nef3), P );
-		//this->p3->convert_to_Polyhedron(P);
+		err = createPolySetFromNefPolyhedron3(*this->p3, *ps);
 	}
 	catch (const CGAL::Failure_exception &e) {
 		err = true;
 		errmsg = std::string(e.what());
 	}
-	if (!err) err = createPolySetFromPolyhedron(P, *ps);
 	if (err) {
-		PRINT("ERROR: CGAL NefPolyhedron->Polyhedron conversion failed.");
+		PRINT("ERROR: CGAL NefPolyhedron->PolySet conversion failed.");
 		if (errmsg!="") PRINTB("ERROR: %s",errmsg);
 		delete ps; ps = NULL;
 	}
@@ -79,6 +126,39 @@ PolySet *CGAL_Nef_polyhedron::convertToPolyset() const
 	return ps;
 }
 
+/*!
+	Memoized mesh view of this polyhedron. The first call triangulates the
+	Nef via convertToPolyset() and keeps the result alongside it (counted
+	by memsize()), so the renderer and every exporter share one
+	conversion. Can return NULL if the conversion failed.
+*/
+/*!
+	The exact bounds rounded to doubles - good enough for culling and
+	resize scaling. The base class caches the result, so the vertex walk
+	inside CGALUtils::boundingBox() happens once per boolean result.
+*/
+BoundingBox CGAL_Nef_polyhedron::computeBoundingBox() const
+{
+	BoundingBox bbox;
+	if (this->isEmpty()) return bbox;
+	CGAL_Iso_cuboid_3 cuboid = CGALUtils::boundingBox(*this->p3);
+	bbox.extend(Vector3d(CGAL::to_double(cuboid.xmin()),
+											 CGAL::to_double(cuboid.ymin()),
+											 CGAL::to_double(cuboid.zmin())));
+	bbox.extend(Vector3d(CGAL::to_double(cuboid.xmax()),
+											 CGAL::to_double(cuboid.ymax()),
+											 CGAL::to_double(cuboid.zmax())));
+	return bbox;
+}
+
+shared_ptr<const PolySet> CGAL_Nef_polyhedron::polySet() const
+{
+	if (!this->cached_polyset) {
+		this->cached_polyset.reset(this->convertToPolyset());
+	}
+	return this->cached_polyset;
+}
+
 /*!
 	Deep copy
 */
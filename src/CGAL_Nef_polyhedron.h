@@ -13,20 +13,35 @@ public:
 	~CGAL_Nef_polyhedron() {}
 
 	virtual size_t memsize() const;
-	// FIXME: Implement, but we probably want a high-resolution BBox..
-	virtual BoundingBox getBoundingBox() const { assert(false && "not implemented"); }
+	// Exact bounds rounded to doubles; walks every vertex, but the
+	// Geometry base caches the result until the next boolean
+	virtual BoundingBox computeBoundingBox() const;
 	virtual std::string dump() const;
 	virtual unsigned int getDimension() const { return 3; }
   // Empty means it is a geometric node which has zero area/volume
 	virtual bool isEmpty() const { return !p3; }
 
-	void reset() { p3.reset(); }
+	void reset() { p3.reset(); cached_polyset.reset(); display_polyhedron.reset(); this->invalidateBoundingBox(); }
 	CGAL_Nef_polyhedron &operator+=(const CGAL_Nef_polyhedron &other);
 	CGAL_Nef_polyhedron &operator*=(const CGAL_Nef_polyhedron &other);
 	CGAL_Nef_polyhedron &operator-=(const CGAL_Nef_polyhedron &other);
 	CGAL_Nef_polyhedron &minkowski(const CGAL_Nef_polyhedron &other);
-	CGAL_Nef_polyhedron *copy() const;
+	virtual CGAL_Nef_polyhedron *copy() const;
 	class PolySet *convertToPolyset() const;
+	shared_ptr<const PolySet> polySet() const;
+	// Memoized OpenGL-ready conversion built by CGALRenderer; stored here
+	// so it rides along with the Nef in CGALCache and survives renderer
+	// rebuilds. Invalidated by every mutating operation.
+	shared_ptr<class Polyhedron> displayPolyhedron() const { return this->display_polyhedron; }
+	void setDisplayPolyhedron(const shared_ptr<class Polyhedron> &p) const { this->display_polyhedron = p; }
 	void transform( const Transform3d &matrix );
 	shared_ptr<CGAL_Nef_polyhedron3> p3;
+
+private:
+	// Memoized result of polySet(). Triangulating a large Nef takes
+	// minutes, and render-then-export workflows used to redo it per
+	// consumer. Invalidated by every mutating operation.
+	mutable shared_ptr<const PolySet> cached_polyset;
+	// See displayPolyhedron()
+	mutable shared_ptr<class Polyhedron> display_polyhedron;
 };
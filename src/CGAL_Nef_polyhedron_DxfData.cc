@@ -55,6 +55,9 @@ void CGAL_Nef_polyhedron::transform( const Transform3d &matrix )
 				matrix(1,0), matrix(1,1), matrix(1,2), matrix(1,3),
 				matrix(2,0), matrix(2,1), matrix(2,2), matrix(2,3), matrix(3,3));
 			this->p3->transform(t);
+			this->cached_polyset.reset();
+			this->display_polyhedron.reset();
+			this->invalidateBoundingBox();
 		}
 	}
 }
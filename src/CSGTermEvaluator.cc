@@ -4,13 +4,19 @@
 #include "csgterm.h"
 #include "module.h"
 #include "csgnode.h"
+#include "linearextrudenode.h"
 #include "transformnode.h"
 #include "colornode.h"
 #include "rendernode.h"
 #include "cgaladvnode.h"
 #include "printutils.h"
+#include "profiler.h"
+#include "Tree.h"
 #include "GeometryEvaluator.h"
+#include "GeometryInstances.h"
 #include "polyset.h"
+#include "Polygon2d.h"
+#include "feature.h"
 
 #include <string>
 #include <map>
@@ -28,12 +34,13 @@
 	with OpenCSG.
 */
 
-shared_ptr<CSGTerm> CSGTermEvaluator::evaluateCSGTerm(const AbstractNode &node, 
-																					 std::vector<shared_ptr<CSGTerm> > &highlights, 
+shared_ptr<CSGTerm> CSGTermEvaluator::evaluateCSGTerm(const AbstractNode &node,
+																					 std::vector<shared_ptr<CSGTerm> > &highlights,
 																					 std::vector<shared_ptr<CSGTerm> > &background)
 {
+	ProfileScope profile("evaluate csg terms");
 	Traverser evaluate(*this, node, Traverser::PRE_AND_POSTFIX);
-	evaluate.execute();
+	evaluate.execute(&this->tree.getFlattening());
 	highlights = this->highlights;
 	background = this->background;
 	return this->stored_term[node.index()];
@@ -48,16 +55,13 @@ void CSGTermEvaluator::applyToChildren(const AbstractNode &node, CSGTermEvaluato
 		if (t2 && !t1) {
 			t1 = t2;
 		} else if (t2 && t1) {
-			if (op == CSGT_UNION) {
-				t1 = CSGTerm::createCSGTerm(CSGTerm::TYPE_UNION, t1, t2);
-			} else if (op == CSGT_DIFFERENCE) {
-				t1 = CSGTerm::createCSGTerm(CSGTerm::TYPE_DIFFERENCE, t1, t2);
-			} else if (op == CSGT_INTERSECTION) {
-				t1 = CSGTerm::createCSGTerm(CSGTerm::TYPE_INTERSECTION, t1, t2);
-			}
+			t1 = combineTerms(op, t1, t2);
 		}
 	}
 	if (t1 && node.modinst->isHighlight()) {
+		// The term might be hash-cons-shared with other occurrences of the
+		// same subtree; flag a private copy so they don't turn highlighted too
+		t1.reset(new CSGTerm(*t1));
 		t1->flag = CSGTerm::FLAG_HIGHLIGHT;
 		this->highlights.push_back(t1);
 	}
@@ -95,7 +99,25 @@ static shared_ptr<CSGTerm> evaluate_csg_term_from_geometry(const State &state,
 {
 	std::stringstream stream;
 	stream << node.name() << node.index();
-	shared_ptr<CSGTerm> t(new CSGTerm(geom, state.matrix(), state.color(), stream.str()));
+	shared_ptr<CSGTerm> t;
+	shared_ptr<const GeometryInstances> instances = dynamic_pointer_cast<const GeometryInstances>(geom);
+	if (instances) {
+		// Emit one term per placed copy, all sharing the prototype mesh; the
+		// union happens at draw time and the merged polyset is never built
+		int i = 0;
+		BOOST_FOREACH(const Transform3d &m, instances->getTransforms()) {
+			std::stringstream instancestream;
+			instancestream << stream.str() << "[" << i++ << "]";
+			shared_ptr<CSGTerm> instanceterm(new CSGTerm(instances->getPrototype(),
+																									 state.matrix() * m, state.color(),
+																									 instancestream.str()));
+			if (t) t = CSGTerm::createCSGTerm(CSGTerm::TYPE_UNION, t, instanceterm);
+			else t = instanceterm;
+		}
+	}
+	else {
+		t.reset(new CSGTerm(geom, state.matrix(), state.color(), stream.str()));
+	}
 	if (modinst->isHighlight()) {
 		t->flag = CSGTerm::FLAG_HIGHLIGHT;
 		highlights.push_back(t);
@@ -107,14 +129,67 @@ static shared_ptr<CSGTerm> evaluate_csg_term_from_geometry(const State &state,
 	return t;
 }
 
+/*!
+	Builds the hash-cons key for the term evaluated from a node: the node's
+	cache id plus the state which gets baked into the term (transform and
+	color). Returns an empty key for highlight/background nodes since
+	evaluating those has side effects and their terms must stay private.
+*/
+std::string CSGTermEvaluator::termCacheKey(const AbstractNode &node, const State &state) const
+{
+	if (node.modinst->isHighlight() || node.modinst->isBackground()) return std::string();
+	std::string key = this->tree.getIdString(node);
+	key.append(reinterpret_cast<const char *>(state.matrix().data()), 16 * sizeof(double));
+	key.append(reinterpret_cast<const char *>(state.color().data()), 4 * sizeof(float));
+	return key;
+}
+
+/*!
+	Evaluates a leaf term for the given node, hash-consed: repeated
+	occurrences of the same subtree at the same transform and color all
+	share one CSGTerm, so downstream normalization and chain import see a
+	DAG instead of duplicated trees.
+*/
+shared_ptr<CSGTerm> CSGTermEvaluator::evaluateGeometryTerm(const State &state, const AbstractNode &node)
+{
+	std::string key = termCacheKey(node, state);
+	if (!key.empty()) {
+		std::map<std::string, shared_ptr<CSGTerm> >::const_iterator iter = this->leafcache.find(key);
+		if (iter != this->leafcache.end()) return iter->second;
+	}
+	shared_ptr<const Geometry> geom = this->geomevaluator->evaluateGeometry(node, false);
+	shared_ptr<CSGTerm> t = evaluate_csg_term_from_geometry(state, this->highlights, this->background,
+																													geom, node.modinst, node);
+	if (!key.empty() && t) this->leafcache[key] = t;
+	return t;
+}
+
+/*!
+	Hash-consed counterpart of CSGTerm::createCSGTerm(): combining the same
+	two shared operands with the same operation yields the same term object.
+*/
+shared_ptr<CSGTerm> CSGTermEvaluator::combineTerms(CSGTermEvaluator::CsgOp op,
+																									 const shared_ptr<CSGTerm> &t1, const shared_ptr<CSGTerm> &t2)
+{
+	CSGTerm::type_e type = CSGTerm::TYPE_UNION;
+	if (op == CSGT_DIFFERENCE) type = CSGTerm::TYPE_DIFFERENCE;
+	else if (op == CSGT_INTERSECTION) type = CSGTerm::TYPE_INTERSECTION;
+
+	OpCacheKey key(type, std::make_pair(t1.get(), t2.get()));
+	std::map<OpCacheKey, shared_ptr<CSGTerm> >::const_iterator iter = this->opcache.find(key);
+	if (iter != this->opcache.end()) return iter->second;
+
+	shared_ptr<CSGTerm> t = CSGTerm::createCSGTerm(type, t1, t2);
+	this->opcache[key] = t;
+	return t;
+}
+
 Response CSGTermEvaluator::visit(State &state, const AbstractPolyNode &node)
 {
 	if (state.isPostfix()) {
 		shared_ptr<CSGTerm> t1;
 		if (this->geomevaluator) {
-			shared_ptr<const Geometry> geom = this->geomevaluator->evaluateGeometry(node, false);
-			t1 = evaluate_csg_term_from_geometry(state, this->highlights, this->background, 
-																					 geom, node.modinst, node);
+			t1 = evaluateGeometryTerm(state, node);
 			node.progress_report();
 		}
 		this->stored_term[node.index()] = t1;
@@ -146,6 +221,84 @@ Response CSGTermEvaluator::visit(State &state, const CsgNode &node)
 	return ContinueTraversal;
 }
 
+/*!
+	Builds the draft-preview term for one boolean operand under a
+	linear_extrude: plain union/difference/intersection subtrees are
+	decomposed recursively and everything else - ultimately the 2D leaves -
+	is evaluated to its exact Polygon2d and extruded on its own. The
+	boolean then runs image-space in the OpenCSG chain instead of through
+	Clipper.
+*/
+shared_ptr<CSGTerm> CSGTermEvaluator::draftExtrudeTerm(const State &state, const LinearExtrudeNode &extrudenode,
+																											 const AbstractNode &subnode)
+{
+	const CsgNode *csgnode = dynamic_cast<const CsgNode *>(&subnode);
+	if (csgnode && !subnode.modinst->isHighlight() && !subnode.modinst->isBackground()) {
+		CsgOp op = CSGT_UNION;
+		switch (csgnode->type) {
+		case OPENSCAD_UNION: op = CSGT_UNION; break;
+		case OPENSCAD_DIFFERENCE: op = CSGT_DIFFERENCE; break;
+		case OPENSCAD_INTERSECTION: op = CSGT_INTERSECTION; break;
+		default: assert(false);
+		}
+		shared_ptr<CSGTerm> t1;
+		BOOST_FOREACH(const AbstractNode *chnode, subnode.getChildren()) {
+			shared_ptr<CSGTerm> t2 = draftExtrudeTerm(state, extrudenode, *chnode);
+			if (t2 && !t1) t1 = t2;
+			else if (t2 && t1) t1 = combineTerms(op, t1, t2);
+		}
+		return t1;
+	}
+
+	shared_ptr<CSGTerm> t;
+	shared_ptr<const Geometry> geom = this->geomevaluator->evaluateGeometry(subnode, false);
+	shared_ptr<const Polygon2d> polygons = dynamic_pointer_cast<const Polygon2d>(geom);
+	if (!polygons || polygons->isEmpty()) return t;
+	shared_ptr<const Geometry> extruded(GeometryEvaluator::extrudePolygon(extrudenode, *polygons));
+	if (!extruded) return t;
+	std::stringstream stream;
+	stream << extrudenode.name() << extrudenode.index() << "/" << subnode.name() << subnode.index();
+	t.reset(new CSGTerm(extruded, state.matrix(), state.color(), stream.str()));
+	return t;
+}
+
+Response CSGTermEvaluator::visit(State &state, const LinearExtrudeNode &node)
+{
+	if (Feature::ExperimentalDraftPreview.is_enabled() && this->geomevaluator &&
+			node.filename.empty() && !node.getChildren().empty()) {
+		if (state.isPrefix()) {
+			// Deferred traversal (see addToParent()): we consume the 2D subtree
+			// ourselves, so prune it. The boolean structure is kept as CSGTerm
+			// operations over individually extruded operands instead of being
+			// collapsed by Clipper before extrusion; with twist or scale the
+			// composite is approximate
+			shared_ptr<CSGTerm> t1;
+			BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+				if (chnode->modinst->isBackground()) continue;
+				shared_ptr<CSGTerm> t2 = draftExtrudeTerm(state, node, *chnode);
+				if (t2 && !t1) t1 = t2;
+				else if (t2 && t1) t1 = combineTerms(CSGT_UNION, t1, t2);
+			}
+			node.progress_report();
+			if (t1 && node.modinst->isHighlight()) {
+				t1.reset(new CSGTerm(*t1));
+				t1->flag = CSGTerm::FLAG_HIGHLIGHT;
+				this->highlights.push_back(t1);
+			}
+			if (t1 && node.modinst->isBackground()) {
+				this->background.push_back(t1);
+				t1.reset();
+			}
+			this->stored_term[node.index()] = t1;
+			addToParent(state, node);
+			return PruneTraversal;
+		}
+		// Postfix of a pruned prefix: everything was done above
+		return ContinueTraversal;
+	}
+	return visit(state, (const AbstractPolyNode &)node);
+}
+
 Response CSGTermEvaluator::visit(State &state, const TransformNode &node)
 {
 	if (state.isPrefix()) {
@@ -175,11 +328,8 @@ Response CSGTermEvaluator::visit(State &state, const RenderNode &node)
 {
 	if (state.isPostfix()) {
 		shared_ptr<CSGTerm> t1;
-		shared_ptr<const Geometry> geom;
 		if (this->geomevaluator) {
-			geom = this->geomevaluator->evaluateGeometry(node, false);
-			t1 = evaluate_csg_term_from_geometry(state, this->highlights, this->background, 
-																					 geom, node.modinst, node);
+			t1 = evaluateGeometryTerm(state, node);
 			node.progress_report();
 		}
 		this->stored_term[node.index()] = t1;
@@ -193,11 +343,8 @@ Response CSGTermEvaluator::visit(State &state, const CgaladvNode &node)
 	if (state.isPostfix()) {
 		shared_ptr<CSGTerm> t1;
     // FIXME: Calling evaluator directly since we're not a PolyNode. Generalize this.
-		shared_ptr<const Geometry> geom;
 		if (this->geomevaluator) {
-			geom = this->geomevaluator->evaluateGeometry(node, false);
-			t1 = evaluate_csg_term_from_geometry(state, this->highlights, this->background, 
-																					 geom, node.modinst, node);
+			t1 = evaluateGeometryTerm(state, node);
 			node.progress_report();
 		}
 		this->stored_term[node.index()] = t1;
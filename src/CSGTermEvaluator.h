@@ -19,6 +19,7 @@ public:
  	virtual Response visit(State &state, const class AbstractIntersectionNode &node);
  	virtual Response visit(State &state, const class AbstractPolyNode &node);
  	virtual Response visit(State &state, const class CsgNode &node);
+ 	virtual Response visit(State &state, const class LinearExtrudeNode &node);
  	virtual Response visit(State &state, const class TransformNode &node);
 	virtual Response visit(State &state, const class ColorNode &node);
  	virtual Response visit(State &state, const class RenderNode &node);
@@ -32,11 +33,26 @@ private:
 	enum CsgOp {CSGT_UNION, CSGT_INTERSECTION, CSGT_DIFFERENCE, CSGT_MINKOWSKI};
   void addToParent(const State &state, const AbstractNode &node);
 	void applyToChildren(const AbstractNode &node, CSGTermEvaluator::CsgOp op);
+	std::string termCacheKey(const AbstractNode &node, const State &state) const;
+	shared_ptr<CSGTerm> evaluateGeometryTerm(const State &state, const AbstractNode &node);
+	shared_ptr<CSGTerm> draftExtrudeTerm(const State &state, const class LinearExtrudeNode &extrudenode,
+																			 const AbstractNode &subnode);
+	shared_ptr<CSGTerm> combineTerms(CSGTermEvaluator::CsgOp op,
+																	 const shared_ptr<CSGTerm> &t1, const shared_ptr<CSGTerm> &t2);
 
   const AbstractNode *root;
   typedef std::list<const AbstractNode *> ChildList;
 	std::map<int, ChildList> visitedchildren;
 
+	// Hash-cons tables: identical repeated subtrees share one CSGTerm DAG
+	// node instead of being rebuilt, so the normalizer and renderer only
+	// process them once. Leaf terms are keyed by node cache id plus the
+	// evaluation state baked into the term; operations by their operand
+	// identities.
+	std::map<std::string, shared_ptr<CSGTerm> > leafcache;
+	typedef std::pair<int, std::pair<const CSGTerm *, const CSGTerm *> > OpCacheKey;
+	std::map<OpCacheKey, shared_ptr<CSGTerm> > opcache;
+
 public:
 	std::map<int, shared_ptr<CSGTerm> > stored_term; // The term evaluated from each node index
 
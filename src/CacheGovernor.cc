@@ -0,0 +1,63 @@
+#include "CacheGovernor.h"
+#include "printutils.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <boost/foreach.hpp>
+
+CacheGovernor *CacheGovernor::inst = NULL;
+
+CacheGovernor::CacheGovernor() : budgetbytes(0)
+{
+	const char *env = getenv("OPENSCAD_CACHE_BUDGET_MB");
+	if (env && env[0]) {
+		this->budgetbytes = strtoul(env, NULL, 10) * 1024UL * 1024UL;
+	}
+}
+
+void CacheGovernor::registerCache(Client *client, int priority)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->clients.push_back(std::make_pair(priority, client));
+	std::sort(this->clients.begin(), this->clients.end());
+}
+
+void CacheGovernor::addPressureCallback(pressure_callback_t callback)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->callbacks.push_back(callback);
+}
+
+size_t CacheGovernor::totalSize() const
+{
+	size_t total = 0;
+	for (size_t i = 0; i < this->clients.size(); i++) {
+		total += this->clients[i].second->totalSize();
+	}
+	return total;
+}
+
+void CacheGovernor::checkPressure()
+{
+	if (this->budgetbytes == 0) return;
+
+	boost::mutex::scoped_lock lock(this->mutex);
+	size_t total = totalSize();
+	if (total <= this->budgetbytes) return;
+
+	for (size_t i = 0; i < this->clients.size(); i++) {
+		Client *client = this->clients[i].second;
+		size_t size = client->totalSize();
+		size_t excess = total - this->budgetbytes;
+		client->shrinkTo(size > excess ? size - excess : 0);
+		total = totalSize();
+		if (total <= this->budgetbytes) break;
+	}
+
+#ifdef DEBUG
+	PRINTB("Cache budget pressure: %d of %d bytes after eviction", total % this->budgetbytes);
+#endif
+	BOOST_FOREACH(pressure_callback_t callback, this->callbacks) {
+		callback(total, this->budgetbytes);
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <utility>
+
+#include <boost/thread/mutex.hpp>
+
+/*!
+	Shared memory ceiling across the geometry caches. The individual
+	caches keep their own limits; the governor adds a global budget on
+	their combined size and, when it is exceeded, sheds entries from
+	cheap-to-recompute caches (tessellated PolySets) before expensive
+	ones (Nef polyhedra). The budget comes from OPENSCAD_CACHE_BUDGET_MB
+	or setBudget(); 0 (the default) disables the governor.
+*/
+class CacheGovernor
+{
+public:
+	//! Interface the participating caches implement
+	class Client
+	{
+	public:
+		virtual ~Client() { }
+		virtual size_t totalSize() const = 0;
+		virtual void shrinkTo(size_t bytes) = 0;
+	};
+
+	typedef void (*pressure_callback_t)(size_t totalbytes, size_t budgetbytes);
+
+	static CacheGovernor *instance() { if (!inst) inst = new CacheGovernor; return inst; }
+
+	//! Lower priorities are evicted first
+	void registerCache(Client *client, int priority);
+	//! Callbacks run after every pressure event, with the size after eviction
+	void addPressureCallback(pressure_callback_t callback);
+
+	size_t budget() const { return this->budgetbytes; }
+	void setBudget(size_t bytes) { this->budgetbytes = bytes; }
+	size_t totalSize() const;
+
+	//! Called by the caches after inserting; evicts until under budget
+	void checkPressure();
+
+private:
+	CacheGovernor();
+
+	static CacheGovernor *inst;
+
+	size_t budgetbytes;
+	std::vector<std::pair<int, Client *> > clients; // sorted by priority
+	std::vector<pressure_callback_t> callbacks;
+	boost::mutex mutex;
+};
@@ -31,6 +31,7 @@
 #include <boost/algorithm/string.hpp>
 
 #include "FontCache.h"
+#include "Polygon2d.h"
 #include "parsersettings.h"
 extern std::vector<std::string> librarypath;
 
@@ -77,9 +78,27 @@ std::string FontInfo::get_file() const
 
 FontCache * FontCache::self = NULL;
 
+/*!
+	Construction is deliberately free of fontconfig/freetype work; the
+	font scan happens in init() on the first call that needs it. Pure
+	geometry renders never pay for it, and renders using text() lean on
+	fontconfig's own mtime-validated on-disk cache for the system dirs.
+*/
 FontCache::FontCache()
 {
+	initialized = false;
 	init_ok = false;
+	config = NULL;
+	library = NULL;
+	shaping_use_counter = 0;
+}
+
+void FontCache::init()
+{
+	if (initialized) {
+		return;
+	}
+	initialized = true;
 
 	config = FcInitLoadConfigAndFonts();
 	if(!config) {
@@ -128,6 +147,7 @@ FontCache * FontCache::instance()
 }
 
 void FontCache::register_font_file(std::string path) {
+	init();
 	if (!FcConfigAppFontAddFile(config, reinterpret_cast<const FcChar8 *>(path.c_str()))) {
 		PRINTB("Can't register font '%s'", path);
 	}
@@ -143,6 +163,7 @@ void FontCache::add_font_dir(std::string path) {
 }
 
 FontInfoList * FontCache::list_fonts() {
+	init();
 	FcObjectSet *object_set = FcObjectSetBuild (FC_FAMILY, FC_STYLE, FC_FILE, (char *)0);
 	FcPattern *pattern = FcPatternCreate();
 	init_pattern(pattern);
@@ -174,12 +195,77 @@ FontInfoList * FontCache::list_fonts() {
 
 bool FontCache::is_init_ok()
 {
+	init();
 	return init_ok;
 }
 
 void FontCache::clear()
 {
 	cache.clear();
+	for (glyph_cache_t::iterator it = glyph_cache.begin();it != glyph_cache.end();it++) {
+		delete (*it).second;
+	}
+	glyph_cache.clear();
+	for (shaping_cache_t::iterator it = shaping_cache.begin();it != shaping_cache.end();it++) {
+		delete (*it).second.first;
+	}
+	shaping_cache.clear();
+	for (hb_font_cache_t::iterator it = hb_fonts.begin();it != hb_fonts.end();it++) {
+		hb_font_destroy((*it).second);
+	}
+	hb_fonts.clear();
+}
+
+const Polygon2d *FontCache::get_glyph_outline(const std::string &key)
+{
+	glyph_cache_t::iterator it = glyph_cache.find(key);
+	return (it == glyph_cache.end()) ? NULL : (*it).second;
+}
+
+void FontCache::insert_glyph_outline(const std::string &key, const Polygon2d &polygon)
+{
+	if (glyph_cache.size() >= MAX_NR_OF_GLYPH_ENTRIES) return;
+	if (glyph_cache.find(key) != glyph_cache.end()) return;
+	glyph_cache[key] = new Polygon2d(polygon);
+}
+
+const FontCache::ShapedRun *FontCache::get_shaped_run(const std::string &key)
+{
+	shaping_cache_t::iterator it = shaping_cache.find(key);
+	if (it == shaping_cache.end()) {
+		return NULL;
+	}
+	(*it).second.second = ++shaping_use_counter;
+	return (*it).second.first;
+}
+
+void FontCache::insert_shaped_run(const std::string &key, const ShapedRun &run)
+{
+	if (shaping_cache.find(key) != shaping_cache.end()) return;
+	if (shaping_cache.size() >= MAX_NR_OF_SHAPING_ENTRIES) {
+		// Evict the least recently used run, same scheme as check_cleanup()
+		shaping_cache_t::iterator pos = shaping_cache.begin();
+		for (shaping_cache_t::iterator it = shaping_cache.begin();it != shaping_cache.end();it++) {
+			if ((*pos).second.second > (*it).second.second) {
+				pos = it;
+			}
+		}
+		delete (*pos).second.first;
+		shaping_cache.erase(pos);
+	}
+	shaping_cache[key] = std::make_pair(new ShapedRun(run), ++shaping_use_counter);
+}
+
+hb_font_t *FontCache::get_hb_font(FT_Face face, long size)
+{
+	hb_font_cache_t::key_type key(face, size);
+	hb_font_cache_t::iterator it = hb_fonts.find(key);
+	if (it != hb_fonts.end()) {
+		return (*it).second;
+	}
+	hb_font_t *hb_font = hb_ft_font_create(face, NULL);
+	hb_fonts[key] = hb_font;
+	return hb_font;
 }
 
 void FontCache::dump_cache(std::string info)
@@ -203,12 +289,24 @@ void FontCache::check_cleanup()
 			pos = it;
 		}
 	}
+	for (hb_font_cache_t::iterator it = hb_fonts.begin();it != hb_fonts.end();) {
+		if ((*it).first.first == (*pos).second.first) {
+			hb_font_destroy((*it).second);
+			hb_fonts.erase(it++);
+		} else {
+			it++;
+		}
+	}
 	FT_Done_Face((*pos).second.first);
 	cache.erase(pos);
 }
 
 FT_Face FontCache::get_font(std::string font)
 {
+	init();
+	if (!init_ok) {
+		return NULL;
+	}
 	FT_Face face;
 	cache_t::iterator it = cache.find(font);
 	if (it == cache.end()) {
@@ -61,7 +61,9 @@ typedef std::vector<FontInfo> FontInfoList;
 class FontCache {
 public:
     const static unsigned int MAX_NR_OF_CACHE_ENTRIES = 3;
-    
+    const static unsigned int MAX_NR_OF_GLYPH_ENTRIES = 10000;
+    const static unsigned int MAX_NR_OF_SHAPING_ENTRIES = 1000;
+
     FontCache();
     virtual ~FontCache();
 
@@ -70,7 +72,30 @@ public:
     void register_font_file(std::string path);
     void clear();
     FontInfoList * list_fonts();
-    
+
+    // Glyph outlines at the origin, keyed by font/size/glyph index/$fn;
+    // see FreetypeRenderer::render()
+    const class Polygon2d *get_glyph_outline(const std::string &key);
+    void insert_glyph_outline(const std::string &key, const class Polygon2d &polygon);
+
+    // One hb_shape() result - the resolved direction plus glyph indices
+    // and placements (26.6 units as reported by HarfBuzz) - keyed by
+    // font/size/direction/script/language/text; see FreetypeRenderer::render()
+    struct ShapedGlyph {
+        unsigned int codepoint;
+        int x_offset, y_offset, x_advance, y_advance;
+    };
+    struct ShapedRun {
+        hb_direction_t direction;
+        std::vector<ShapedGlyph> glyphs;
+    };
+    const ShapedRun *get_shaped_run(const std::string &key);
+    void insert_shaped_run(const std::string &key, const ShapedRun &run);
+
+    // Pooled hb_font_t per face and char size; hb_ft_font_create() reads
+    // the face's size at creation, so call with the size already set
+    hb_font_t *get_hb_font(FT_Face face, long size);
+
     static FontCache * instance();
 private:
     typedef std::pair<FT_Face, time_t> cache_entry_t;
@@ -78,11 +103,21 @@ private:
 
     static FontCache *self;
     
+    typedef std::map<std::string, const class Polygon2d *> glyph_cache_t;
+    typedef std::map<std::string, std::pair<const ShapedRun *, unsigned long> > shaping_cache_t;
+    typedef std::map<std::pair<FT_Face, long>, hb_font_t *> hb_font_cache_t;
+
+    bool initialized;
     bool init_ok;
     cache_t cache;
+    glyph_cache_t glyph_cache;
+    shaping_cache_t shaping_cache;
+    unsigned long shaping_use_counter;
+    hb_font_cache_t hb_fonts;
     FcConfig *config;
     FT_Library library;
 
+    void init();
     void check_cleanup();
     void dump_cache(std::string info);
     
@@ -30,6 +30,8 @@
 
 #include <fontconfig/fontconfig.h>
 
+#include <boost/format.hpp>
+
 #include "printutils.h"
 
 #include "FontCache.h"
@@ -124,8 +126,7 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 {
 	FT_Face face;
 	FT_Error error;
-	DrawingCallback callback(params.fn);
-	
+
 	FontCache *cache = FontCache::instance();
 	if (!cache->is_init_ok()) {
 		return std::vector<const Geometry *>();
@@ -142,18 +143,58 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 		return std::vector<const Geometry *>();
 	}
 	
-	hb_font_t *hb_ft_font = hb_ft_font_create(face, NULL);
-
-	hb_buffer_t *hb_buf = hb_buffer_create();
-	hb_buffer_set_direction(hb_buf, hb_direction_from_string(params.direction.c_str(), -1));
-	hb_buffer_set_script(hb_buf, hb_script_from_string(params.script.c_str(), -1));
-	hb_buffer_set_language(hb_buf, hb_language_from_string(params.language.c_str(), -1));
-	hb_buffer_add_utf8(hb_buf, params.text.c_str(), strlen(params.text.c_str()), 0, strlen(params.text.c_str()));
-	hb_shape(hb_ft_font, hb_buf, NULL, 0);
-	
-	unsigned int glyph_count;
-        hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(hb_buf, &glyph_count);
-        hb_glyph_position_t *glyph_pos = hb_buffer_get_glyph_positions(hb_buf, &glyph_count);	
+	// Shaping the same string at the same settings is pure repetition,
+	// so the result is memoized in FontCache; the hb_font is pooled per
+	// face and size, and buffers only exist for the duration of a miss.
+	std::string shape_key = str(boost::format("%s/%f/%s/%s/%s/%s")
+															% params.font % params.size
+															% params.direction % params.script
+															% params.language % params.text);
+	FontCache::ShapedRun run;
+	const FontCache::ShapedRun *shaped = cache->get_shaped_run(shape_key);
+	if (!shaped) {
+		hb_font_t *hb_ft_font = cache->get_hb_font(face, params.size * scale);
+
+		hb_buffer_t *hb_buf = hb_buffer_create();
+		hb_buffer_set_direction(hb_buf, hb_direction_from_string(params.direction.c_str(), -1));
+		hb_buffer_set_script(hb_buf, hb_script_from_string(params.script.c_str(), -1));
+		hb_buffer_set_language(hb_buf, hb_language_from_string(params.language.c_str(), -1));
+		hb_buffer_add_utf8(hb_buf, params.text.c_str(), strlen(params.text.c_str()), 0, strlen(params.text.c_str()));
+		hb_shape(hb_ft_font, hb_buf, NULL, 0);
+
+		unsigned int shaped_count;
+		hb_glyph_info_t *shaped_info = hb_buffer_get_glyph_infos(hb_buf, &shaped_count);
+		hb_glyph_position_t *shaped_pos = hb_buffer_get_glyph_positions(hb_buf, &shaped_count);
+
+		run.direction = hb_buffer_get_direction(hb_buf);
+		for (unsigned int idx = 0;idx < shaped_count;idx++) {
+			FontCache::ShapedGlyph g;
+			g.codepoint = shaped_info[idx].codepoint;
+			g.x_offset = shaped_pos[idx].x_offset;
+			g.y_offset = shaped_pos[idx].y_offset;
+			g.x_advance = shaped_pos[idx].x_advance;
+			g.y_advance = shaped_pos[idx].y_advance;
+			run.glyphs.push_back(g);
+		}
+		hb_buffer_destroy(hb_buf);
+
+		cache->insert_shaped_run(shape_key, run);
+		// Valid even when the cache hit its size cap
+		shaped = &run;
+	}
+
+	unsigned int glyph_count = shaped->glyphs.size();
+	std::vector<hb_glyph_info_t> glyph_infos(glyph_count);
+	std::vector<hb_glyph_position_t> glyph_positions(glyph_count);
+	for (unsigned int idx = 0;idx < glyph_count;idx++) {
+		glyph_infos[idx].codepoint = shaped->glyphs[idx].codepoint;
+		glyph_positions[idx].x_offset = shaped->glyphs[idx].x_offset;
+		glyph_positions[idx].y_offset = shaped->glyphs[idx].y_offset;
+		glyph_positions[idx].x_advance = shaped->glyphs[idx].x_advance;
+		glyph_positions[idx].y_advance = shaped->glyphs[idx].y_advance;
+	}
+	hb_glyph_info_t *glyph_info = glyph_count ? &glyph_infos[0] : NULL;
+	hb_glyph_position_t *glyph_pos = glyph_count ? &glyph_positions[0] : NULL;
 	
 	GlyphArray glyph_array;
 	for (unsigned int idx = 0;idx < glyph_count;idx++) {
@@ -181,7 +222,7 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 		FT_BBox bbox;
 		FT_Glyph_Get_CBox(glyph->get_glyph(), FT_GLYPH_BBOX_GRIDFIT, &bbox);
 		
-		if (HB_DIRECTION_IS_HORIZONTAL(hb_buffer_get_direction(hb_buf))) {
+		if (HB_DIRECTION_IS_HORIZONTAL(shaped->direction)) {
 			double asc = std::max(0.0, bbox.yMax / 64.0 / 16.0);
 			double desc = std::max(0.0, -bbox.yMin / 64.0 / 16.0);
 			width += glyph->get_x_advance() * params.spacing;
@@ -197,22 +238,50 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 	double x_offset = calc_x_offset(params.halign, width);
 	double y_offset = calc_y_offset(params.valign, ascend, descend);
 
+	std::vector<const Geometry *> result;
+	double advance_x = 0, advance_y = 0;
 	for (GlyphArray::iterator it = glyph_array.begin();it != glyph_array.end();it++) {
 		const GlyphData *glyph = (*it);
-		
-		callback.start_glyph();
-		callback.set_glyph_offset(x_offset + glyph->get_x_offset(), y_offset + glyph->get_y_offset());
-		FT_Outline outline = reinterpret_cast<FT_OutlineGlyph>(glyph->get_glyph())->outline;
-		FT_Outline_Decompose(&outline, &funcs, &callback);
-
-		double adv_x  = glyph->get_x_advance() * params.spacing;
-		double adv_y  = glyph->get_y_advance() * params.spacing;
-		callback.add_glyph_advance(adv_x, adv_y);
-		callback.finish_glyph();
+
+		// Repeated characters share one tessellation: the outline is
+		// decomposed at the origin once per (font, size, glyph, $fn) and
+		// cached in FontCache, placement is just a translate of a copy.
+		std::string key = str(boost::format("%s/%f/%u/%lu")
+													% params.font % params.size
+													% glyph_info[glyph->get_idx()].codepoint % params.fn);
+		Polygon2d decomposed;
+		const Polygon2d *cached = cache->get_glyph_outline(key);
+		if (!cached) {
+			DrawingCallback callback(params.fn);
+			callback.start_glyph();
+			FT_Outline outline = reinterpret_cast<FT_OutlineGlyph>(glyph->get_glyph())->outline;
+			FT_Outline_Decompose(&outline, &funcs, &callback);
+			callback.finish_glyph();
+
+			// Blank glyphs (e.g. spaces) are cached as empty polygons
+			std::vector<const Geometry *> outlines = callback.get_result();
+			if (!outlines.empty()) {
+				const Polygon2d *p = dynamic_cast<const Polygon2d *>(outlines[0]);
+				if (p) decomposed = *p;
+				for (size_t i = 0; i < outlines.size(); i++) delete outlines[i];
+			}
+			cache->insert_glyph_outline(key, decomposed);
+			// Valid even when the cache hit its size cap
+			cached = &decomposed;
+		}
+
+		if (cached && !cached->isEmpty()) {
+			Polygon2d *placed = new Polygon2d(*cached);
+			Transform2d translate(Transform2d::Identity());
+			translate.translate(Vector2d(x_offset + glyph->get_x_offset() + advance_x,
+																	 y_offset + glyph->get_y_offset() + advance_y));
+			placed->transform(translate);
+			result.push_back(placed);
+		}
+
+		advance_x += glyph->get_x_advance() * params.spacing;
+		advance_y += glyph->get_y_advance() * params.spacing;
 	}
 
-	hb_buffer_destroy(hb_buf);
-        hb_font_destroy(hb_ft_font);
-	
-	return callback.get_result();
+	return result;
 }
@@ -20,6 +20,7 @@ GLView::GLView()
   showfaces = true;
   showaxes = false;
   showcrosshairs = false;
+  showhud = false;
   renderer = NULL;
   cam = Camera();
   far_far_away = RenderSettings::inst()->far_gl_clip_limit;
@@ -67,6 +67,7 @@ public:
 	bool showfaces;
 	bool showedges;
 	bool showcrosshairs;
+	bool showhud;
 
 #ifdef ENABLE_OPENCSG
 	GLint shaderinfo[11];
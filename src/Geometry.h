@@ -13,18 +13,49 @@ public:
   typedef std::pair<const class AbstractNode *, shared_ptr<const Geometry> > ChildItem;
   typedef std::list<ChildItem> ChildList;
 
-	Geometry() : convexity(1) {}
+	Geometry() : convexity(1), bbox_valid(false) {}
 	virtual ~Geometry() {}
 
 	virtual size_t memsize() const = 0;
-	virtual BoundingBox getBoundingBox() const = 0;
+	/*! Returns the bounds, computed on the first call and cached until
+	    the next mutation (mutators call invalidateBoundingBox()) */
+	BoundingBox getBoundingBox() const {
+		if (!this->bbox_valid) {
+			this->cached_bbox = this->computeBoundingBox();
+			this->bbox_valid = true;
+		}
+		return this->cached_bbox;
+	}
 	virtual std::string dump() const = 0;
+	/*! Strong hash of the geometric payload (vertex/index data), the
+	    same for equal content regardless of which subtree produced it.
+	    GeometryCache uses it to share one object between entries with
+	    identical content; an empty string opts out of deduplication,
+	    which is the default. */
+	virtual std::string contentHash() const { return std::string(); }
 	virtual unsigned int getDimension() const = 0;
 	virtual bool isEmpty() const = 0;
+	/*! Returns a deep copy owned by the caller */
+	virtual Geometry *copy() const = 0;
 
 	unsigned int getConvexity() const { return convexity; }
 	void setConvexity(int c) { this->convexity = c; }
 
+	// Optional chain of ever coarser tessellations of the same shape,
+	// attached by the curved primitives when lod-preview is enabled.
+	// The preview renderers may draw a coarser level when the object is
+	// small on screen; everything else ignores the chain.
+	const shared_ptr<const Geometry> &getCoarserLOD() const { return lod_coarser; }
+	void setCoarserLOD(const shared_ptr<const Geometry> &geom) { this->lod_coarser = geom; }
+
 protected:
+	virtual BoundingBox computeBoundingBox() const = 0;
+	void invalidateBoundingBox() { this->bbox_valid = false; }
+
 	int convexity;
+	shared_ptr<const Geometry> lod_coarser;
+
+private:
+	mutable BoundingBox cached_bbox;
+	mutable bool bbox_valid;
 };
@@ -12,26 +12,72 @@ GeometryCache *GeometryCache::inst = NULL;
 
 shared_ptr<const Geometry> GeometryCache::get(const std::string &id) const
 {
-	const shared_ptr<const Geometry> &geom = this->cache[id]->geom;
+	cache_entry entry;
+	// Copied out under the shard lock; a concurrent insert may have
+	// evicted the entry between the caller's contains() and here
+	if (!this->cache.fetch(id, entry)) return shared_ptr<const Geometry>();
 #ifdef DEBUG
-	PRINTB("Geometry Cache hit: %s (%d bytes)", id.substr(0, 40) % (geom ? geom->memsize() : 0));
+	PRINTB("Geometry Cache hit: %s (%d bytes)", id.substr(0, 40) % (entry.geom ? entry.geom->memsize() : 0));
 #endif
-	return geom;
+	return entry.geom;
 }
 
 bool GeometryCache::insert(const std::string &id, const shared_ptr<const Geometry> &geom)
 {
-	bool inserted = this->cache.insert(id, new cache_entry(geom), geom ? geom->memsize() : 0);
+	bool shared = false;
+	shared_ptr<const Geometry> stored = geom ? deduplicate(geom, shared) : geom;
+	// A deduplicated entry only references an object another entry
+	// already paid for, so it costs the budget next to nothing
+	size_t cost = 0;
+	if (stored) cost = shared ? sizeof(cache_entry) : stored->memsize();
+	bool inserted = this->cache.insert(id, new cache_entry(stored), cost);
+	CacheGovernor::instance()->checkPressure();
 #ifdef DEBUG
-	assert(!dynamic_cast<const CGAL_Nef_polyhedron*>(geom.get()));
+	assert(!dynamic_cast<const CGAL_Nef_polyhedron*>(stored.get()));
 	if (inserted) PRINTB("Geometry Cache insert: %s (%d bytes)", 
-                         id.substr(0, 40) % (geom ? geom->memsize() : 0));
+                         id.substr(0, 40) % cost);
 	else PRINTB("Geometry Cache insert failed: %s (%d bytes)",
-                id.substr(0, 40) % (geom ? geom->memsize() : 0));
+                id.substr(0, 40) % cost);
 #endif
 	return inserted;
 }
 
+/*!
+	Two subtrees producing bit-identical geometry (repeated library calls,
+	symmetric assemblies) get positionally different ids, so they used to
+	occupy two full copies. The content-hash registry maps each payload
+	hash to a weakly-held live geometry; an insert whose content already
+	exists shares that object instead of keeping its own copy. The first
+	entry carries the full byte cost - if it is evicted while sharers
+	remain, the object stays alive through their shared_ptrs, which
+	under-counts the budget a little but never double-frees or copies.
+*/
+shared_ptr<const Geometry> GeometryCache::deduplicate(const shared_ptr<const Geometry> &geom, bool &shared)
+{
+	std::string hash = geom->contentHash();
+	if (hash.empty()) return geom;
+
+	boost::mutex::scoped_lock lock(this->dedup_mutex);
+	// Sweep dead references once the registry clearly outgrows the cache
+	if (this->dedup.size() > 2 * this->cache.size() + 64) {
+		std::map<std::string, boost::weak_ptr<const Geometry> >::iterator it = this->dedup.begin();
+		while (it != this->dedup.end()) {
+			if (it->second.expired()) this->dedup.erase(it++);
+			else ++it;
+		}
+	}
+	std::map<std::string, boost::weak_ptr<const Geometry> >::iterator found = this->dedup.find(hash);
+	if (found != this->dedup.end()) {
+		shared_ptr<const Geometry> existing = found->second.lock();
+		if (existing) {
+			shared = true;
+			return existing;
+		}
+	}
+	this->dedup[hash] = boost::weak_ptr<const Geometry>(geom);
+	return geom;
+}
+
 size_t GeometryCache::maxSize() const
 {
 	return this->cache.maxCost();
@@ -46,10 +92,11 @@ void GeometryCache::print()
 {
 	PRINTB("Geometries in cache: %d", this->cache.size());
 	PRINTB("Geometry cache size in bytes: %d", this->cache.totalCost());
+	if (this->cache.pinnedCost()) PRINTB("Geometry cache pinned bytes: %d", this->cache.pinnedCost());
 }
 
 GeometryCache::cache_entry::cache_entry(const shared_ptr<const Geometry> &geom)
 	: geom(geom)
 {
-	if (print_messages_stack.size() > 0) this->msg = print_messages_stack.back();
+	if (print_messages_stack().size() > 0) this->msg = print_messages_stack().back();
 }
@@ -3,31 +3,58 @@
 #include "cache.h"
 #include "memory.h"
 #include "Geometry.h"
+#include "CacheGovernor.h"
+#include <map>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
-class GeometryCache
+class GeometryCache : public CacheGovernor::Client
 {
-public:	
+public:
 	GeometryCache(size_t memorylimit = 100*1024*1024) : cache(memorylimit) {}
 
-	static GeometryCache *instance() { if (!inst) inst = new GeometryCache; return inst; }
+	static GeometryCache *instance()
+	{
+		if (!inst) {
+			inst = new GeometryCache;
+			// PolySets are cheap to re-tessellate - evict them first
+			CacheGovernor::instance()->registerCache(inst, 0);
+		}
+		return inst;
+	}
 
 	bool contains(const std::string &id) const { return this->cache.contains(id); }
 	shared_ptr<const class Geometry> get(const std::string &id) const;
 	bool insert(const std::string &id, const shared_ptr<const Geometry> &geom);
+	//! Exempts the entry from eviction; see Cache::pin()
+	void pin(const std::string &id) { this->cache.pin(id); }
+	size_t size() const { return this->cache.size(); }
 	size_t maxSize() const;
 	void setMaxSize(size_t limit);
 	void clear() { cache.clear(); }
 	void print();
 
+	virtual size_t totalSize() const { return this->cache.totalCost(); }
+	virtual void shrinkTo(size_t bytes) { this->cache.shrink(bytes); }
+
 private:
 	static GeometryCache *inst;
 
+	//! Returns an existing geometry with equal content, if one is alive
+	shared_ptr<const Geometry> deduplicate(const shared_ptr<const Geometry> &geom, bool &shared);
+
 	struct cache_entry {
 		shared_ptr<const class Geometry> geom;
 		std::string msg;
+		cache_entry() { }
 		cache_entry(const shared_ptr<const Geometry> &geom);
 		~cache_entry() { }
 	};
 
-	Cache<std::string, cache_entry> cache;
+	ShardedCache<std::string, cache_entry> cache;
+
+	// Content-hash -> live geometry; lets entries with equal payload under
+	// different ids share one object (see deduplicate())
+	std::map<std::string, boost::weak_ptr<const Geometry> > dedup;
+	mutable boost::mutex dedup_mutex;
 };
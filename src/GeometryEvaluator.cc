@@ -15,38 +15,58 @@
 #include "projectionnode.h"
 #include "textnode.h"
 #include "CGAL_Nef_polyhedron.h"
+#include "GeometryInstances.h"
 #include "cgalutils.h"
 #include "rendernode.h"
+#include "renderstaging.h"
+#include "workerpool.h"
+#include "voxelizer.h"
 #include "clipper-utils.h"
+#include "import-prefetch.h"
+#include "import-async.h"
+#include "importnode.h"
 #include "polyset-utils.h"
 #include "polyset.h"
 #include "calc.h"
+#include "grid.h"
 #include "printutils.h"
+#include "profiler.h"
+#include "cacheadvisor.h"
+#include "memorypressure.h"
 #include "svg.h"
 #include "calc.h"
 #include "dxfdata.h"
+#include "feature.h"
+#include "progress.h"
 
 #include <algorithm>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/thread.hpp>
+#include <boost/uuid/sha1.hpp>
 
 #include <CGAL/convex_hull_2.h>
 #include <CGAL/Point_2.h>
 
+static shared_ptr<const Geometry> expand_instances(const shared_ptr<const Geometry> &geom);
+
 GeometryEvaluator::GeometryEvaluator(const class Tree &tree):
-	tree(tree)
+	tree(tree), import_prefetcher(NULL), import_proxies(false)
 {
 }
 
 /*!
 	Set allownef to false to force the result to _not_ be a Nef polyhedron
 */
-shared_ptr<const Geometry> GeometryEvaluator::evaluateGeometry(const AbstractNode &node, 
+shared_ptr<const Geometry> GeometryEvaluator::evaluateGeometry(const AbstractNode &node,
 																															 bool allownef)
 {
-	if (!GeometryCache::instance()->contains(this->tree.getIdString(node))) {
+	ProfileScope profile("evaluate geometry");
+	if (!GeometryCache::instance()->contains(this->tree.getIdHash(node))) {
 		shared_ptr<const CGAL_Nef_polyhedron> N;
-		if (CGALCache::instance()->contains(this->tree.getIdString(node))) {
-			N = CGALCache::instance()->get(this->tree.getIdString(node));
+		if (CGALCache::instance()->contains(this->tree.getIdHash(node))) {
+			N = CGALCache::instance()->get(this->tree.getIdHash(node));
 		}
 
 		// If not found in any caches, we need to evaluate the geometry
@@ -54,23 +74,49 @@ shared_ptr<const Geometry> GeometryEvaluator::evaluateGeometry(const AbstractNod
 			this->root = N;
 		}	
     else {
+			// Imports are evaluation-order independent, so their I/O and
+			// parsing can run on workers while the traversal below computes
+			// everything else; results are picked up through the caches
+			ImportPrefetcher prefetcher(this->tree);
+			// With async imports on, prefetching would reintroduce the wait
+			// it exists to hide: the prefetcher's destructor joins its
+			// workers before this call can return
+			if (Feature::ExperimentalImportPrefetch.is_enabled() && !this->import_proxies) {
+				prefetcher.start(node);
+				this->import_prefetcher = &prefetcher;
+			}
 			Traverser trav(*this, node, Traverser::PRE_AND_POSTFIX);
-			trav.execute();
+			trav.execute(&this->tree.getFlattening());
+			this->import_prefetcher = NULL;
 		}
 
 		if (!allownef) {
 			if (shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(this->root)) {
-				this->root.reset(N->convertToPolyset());
+				this->root = N->polySet();
 				smartCacheInsert(node, this->root);
 			}
 		}
+		else {
+			// Preview terms (allownef=false) can draw instance sets straight from
+			// the shared prototype; everyone else expects concrete geometry
+			this->root = expand_instances(this->root);
+		}
 		return this->root;
 	}
-	return GeometryCache::instance()->get(this->tree.getIdString(node));
+	shared_ptr<const Geometry> geom = GeometryCache::instance()->get(this->tree.getIdHash(node));
+	if (allownef) geom = expand_instances(geom);
+	return geom;
 }
 
 GeometryEvaluator::ResultObject GeometryEvaluator::applyToChildren(const AbstractNode &node, OpenSCADOperator op)
 {
+	// The per-node-type section collects where the evaluation time goes;
+	// each application counts only its own operation since the children were
+	// timed by their own postfix passes.
+	ProfileScope profile(Profiler::enabled() ? "evaluate/" + node.name() : std::string());
+	ModuleTimer modtimer(Profiler::moduleAttributionEnabled() && node.modinst ?
+											 node.modinst->name() : std::string(), true);
+	AdvisorScope advisorscope(node);
 	unsigned int dim = 0;
 	BOOST_FOREACH(const Geometry::ChildItem &item, this->visitedchildren[node.index()]) {
 		if (item.second) {
@@ -81,21 +127,207 @@ GeometryEvaluator::ResultObject GeometryEvaluator::applyToChildren(const Abstrac
 			}
 		}
 	}
-	if (dim == 2) return ResultObject(applyToChildren2D(node, op));
-	else if (dim == 3) return applyToChildren3D(node, op);
+	try {
+		MemoryPressure::check();
+		if (dim == 2) {
+			Polygon2d *polygons = applyToChildren2D(node, op);
+			if (Profiler::enabled() && polygons) profile.setBytes(polygons->memsize());
+			return ResultObject(polygons);
+		}
+		else if (dim == 3) {
+			ResultObject res = applyToChildren3D(node, op);
+			if (Profiler::enabled() && res.constptr()) profile.setBytes(res.constptr()->memsize());
+			return res;
+		}
+	}
+	catch (const MemoryPressureException &e) {
+		// The subtree becomes empty; its siblings keep their cached results,
+		// so a rerun with a larger budget fills in only this hole
+		PRINTB("ERROR: Memory budget: dropping subtree of %s(): %s.", node.name() % e.what());
+	}
 	return ResultObject();
 }
 
+/*!
+	Returns the axis-aligned bounding box of a 3D child geometry, empty
+	for empty geometry.
+*/
+static BoundingBox bounding_box_3D(const shared_ptr<const Geometry> &geom)
+{
+	BoundingBox bbox;
+	shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom);
+	if (N) {
+		if (!N->isEmpty()) {
+			CGAL_Iso_cuboid_3 cuboid = CGALUtils::boundingBox(*N->p3);
+			bbox.extend(Vector3d(CGAL::to_double(cuboid.min_coord(0)),
+													 CGAL::to_double(cuboid.min_coord(1)),
+													 CGAL::to_double(cuboid.min_coord(2))));
+			bbox.extend(Vector3d(CGAL::to_double(cuboid.max_coord(0)),
+													 CGAL::to_double(cuboid.max_coord(1)),
+													 CGAL::to_double(cuboid.max_coord(2))));
+		}
+	}
+	else if (geom) {
+		// PolySets and symbolic instance sets both answer this directly
+		bbox = geom->getBoundingBox();
+	}
+	return bbox;
+}
+
+/*!
+	If geom is a symbolic instance set, flattens it into a plain mesh;
+	otherwise returns geom unchanged. Call before handing geometry to
+	consumers which need merged topology.
+*/
+static shared_ptr<const Geometry> expand_instances(const shared_ptr<const Geometry> &geom)
+{
+	shared_ptr<const GeometryInstances> instances = dynamic_pointer_cast<const GeometryInstances>(geom);
+	if (instances) return shared_ptr<const Geometry>(instances->expandToPolySet());
+	return geom;
+}
+
+/*!
+	If all given children are instance sets sharing one prototype mesh,
+	returns their symbolic union: the same prototype with the concatenated
+	transform lists. Returns NULL if the children are anything else.
+*/
+static shared_ptr<const Geometry> coalesce_instances(const Geometry::ChildList &children)
+{
+	shared_ptr<const GeometryInstances> first =
+		dynamic_pointer_cast<const GeometryInstances>(children.front().second);
+	if (!first) return shared_ptr<const Geometry>();
+
+	GeometryInstances *merged = NULL;
+	Geometry::ChildList::const_iterator chiter = children.begin();
+	for (chiter++; chiter != children.end(); chiter++) {
+		shared_ptr<const GeometryInstances> instances =
+			dynamic_pointer_cast<const GeometryInstances>(chiter->second);
+		if (!instances || instances->getPrototype() != first->getPrototype()) {
+			delete merged;
+			return shared_ptr<const Geometry>();
+		}
+		if (!merged) merged = new GeometryInstances(*first);
+		BOOST_FOREACH(const Transform3d &t, instances->getTransforms()) {
+			merged->addInstance(t);
+		}
+	}
+	if (merged) return shared_ptr<const Geometry>(merged);
+	return first; // Single child is a union noop
+}
+
 /*!
 	Applies the operator to all child nodes of the given node.
-	
+
 	May return NULL or any 3D Geometry object (can be either PolySet or CGAL_Nef_polyhedron)
 */
+/*!
+	Returns the concatenation of the children's meshes as one PolySet
+	with multiple shells if their bounding boxes are provably pairwise
+	disjoint, NULL otherwise. Only plain PolySet operands qualify: a Nef
+	or instanced operand means some upstream step wanted real topology,
+	and converting it here would just move the cost around.
+*/
+static PolySet *applyDisjointUnion(const Geometry::ChildList &children)
+{
+	std::vector<BoundingBox> bboxes;
+	BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+		if (!dynamic_pointer_cast<const PolySet>(item.second)) return NULL;
+		bboxes.push_back(bounding_box_3D(item.second));
+	}
+	for (size_t i = 0; i < bboxes.size(); i++) {
+		for (size_t j = i + 1; j < bboxes.size(); j++) {
+			if (!bboxes[i].intersection(bboxes[j]).isEmpty()) return NULL;
+		}
+	}
+
+	PolySet *ps = new PolySet(3);
+	BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+		ps->append(*dynamic_pointer_cast<const PolySet>(item.second));
+		if (item.second->getConvexity() > ps->getConvexity()) ps->setConvexity(item.second->getConvexity());
+		item.first->progress_report();
+	}
+	return ps;
+}
+
 GeometryEvaluator::ResultObject GeometryEvaluator::applyToChildren3D(const AbstractNode &node, OpenSCADOperator op)
 {
 	Geometry::ChildList children = collectChildren3D(node);
 	if (children.size() == 0) return ResultObject();
 
+	// Bounding-box pre-pass: operands whose boxes can't overlap won't
+	// affect the result, so we don't have to pay for full CGAL booleans on
+	// them. Typical case: hundreds of localized holes subtracted from a
+	// large plate, where most subtrahends miss each other entirely.
+	if (op == OPENSCAD_DIFFERENCE && children.size() > 1) {
+		BoundingBox minuend = bounding_box_3D(children.front().second);
+		Geometry::ChildList filtered;
+		filtered.push_back(children.front());
+		Geometry::ChildList::const_iterator chiter = children.begin();
+		for (chiter++; chiter != children.end(); chiter++) {
+			if (!minuend.intersection(bounding_box_3D(chiter->second)).isEmpty()) {
+				filtered.push_back(*chiter);
+			}
+			else {
+				chiter->first->progress_report();
+			}
+		}
+		children = filtered;
+	}
+	else if (op == OPENSCAD_INTERSECTION && children.size() > 1) {
+		BoundingBox common = bounding_box_3D(children.front().second);
+		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+			common = common.intersection(bounding_box_3D(item.second));
+		}
+		if (common.isEmpty()) {
+			BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+				item.first->progress_report();
+			}
+			return ResultObject(new CGAL_Nef_polyhedron);
+		}
+		// Pre-clip operands that dwarf the result's envelope: everything
+		// outside the common box is dead weight in every boolean of the
+		// chain, and intersecting with the 6-facet box sheds it far more
+		// cheaply than intersecting with the operand that imposed the
+		// bound. Typical case: cross-sectioning a large model with a thin
+		// slab. The margin absorbs the double rounding of the boxes, which
+		// can only make the clip box larger and thus stays correct.
+		const double PRECLIP_VOLUME_RATIO = 8;
+		BoundingBox clipbox;
+		Vector3d margin = (common.max() - common.min()) * 1e-6 + Vector3d(GRID_FINE, GRID_FINE, GRID_FINE);
+		clipbox.extend(common.min() - margin);
+		clipbox.extend(common.max() + margin);
+		BOOST_FOREACH(Geometry::ChildItem &item, children) {
+			BoundingBox opbox = bounding_box_3D(item.second);
+			if (opbox.volume() <= PRECLIP_VOLUME_RATIO * clipbox.volume()) continue;
+			shared_ptr<const Geometry> clipped = CGALUtils::clipToBoundingBox(item.second, clipbox);
+			if (clipped) item.second = clipped;
+		}
+	}
+
+	// Lazy union: when every operand's bounding box is pairwise disjoint
+	// the union is a topological no-op, so the meshes are concatenated
+	// into one multi-shell PolySet and the Nef union - the dominant cost
+	// on build-plate layouts of independent parts - is skipped entirely.
+	// STL/AMF consumers accept the disjoint shells as-is.
+	if (op == OPENSCAD_UNION && children.size() > 1 &&
+			Feature::ExperimentalLazyUnion.is_enabled()) {
+		PolySet *ps = applyDisjointUnion(children);
+		if (ps) return ResultObject(ps);
+	}
+
+	if (Feature::ExperimentalGeometryInstancing.is_enabled()) {
+		if (op == OPENSCAD_UNION) {
+			// A union over copies of one prototype stays symbolic; whether the
+			// copies ever get merged for real is up to the consumer
+			shared_ptr<const Geometry> merged = coalesce_instances(children);
+			if (merged) return ResultObject(merged);
+		}
+		// The operations below need real, merged topology
+		BOOST_FOREACH(Geometry::ChildItem &item, children) {
+			item.second = expand_instances(item.second);
+		}
+	}
+
 	if (op == OPENSCAD_HULL) {
 		PolySet *ps = new PolySet(3);
 
@@ -110,8 +342,50 @@ GeometryEvaluator::ResultObject GeometryEvaluator::applyToChildren3D(const Abstr
 	// Only one child -> this is a noop
 	if (children.size() == 1) return ResultObject(children.front().second);
 
+	// Every remaining operand is consumed as a Nef, so promote them
+	// through CGALCache keyed by their nodes. That shares conversions
+	// across recompiles - failed ones included: a conversion that threw
+	// leaves its empty Nef cached under the operand's key, so a model
+	// with one bad imported mesh skips straight to the fallback on the
+	// next recompile instead of repeating the doomed conversion and its
+	// exception unwind.
+	bool allnef = true;
+	BOOST_FOREACH(Geometry::ChildItem &item, children) {
+		if (dynamic_pointer_cast<const CGAL_Nef_polyhedron>(item.second)) continue;
+		const std::string &key = this->tree.getIdHash(*item.first);
+		shared_ptr<const CGAL_Nef_polyhedron> chN;
+		if (CGALCache::instance()->contains(key)) chN = CGALCache::instance()->get(key);
+		if (chN) item.second = chN;
+		else allnef = false;
+	}
+	if (!allnef) {
+		std::vector<shared_ptr<const CGAL_Nef_polyhedron> > nefs = CGALUtils::convertChildrenToNefs(children);
+		size_t chidx = 0;
+		BOOST_FOREACH(Geometry::ChildItem &item, children) {
+			shared_ptr<const CGAL_Nef_polyhedron> chN = nefs[chidx++];
+			if (!chN || dynamic_pointer_cast<const CGAL_Nef_polyhedron>(item.second)) continue;
+			const std::string &key = this->tree.getIdHash(*item.first);
+			if (!CGALCache::instance()->contains(key)) CGALCache::instance()->insert(key, chN);
+			item.second = chN;
+		}
+	}
+
 	CGAL_Nef_polyhedron *N = new CGAL_Nef_polyhedron;
-	CGALUtils::applyOperator(children, *N, op);
+	// Watermarks around the boolean: if this operation drives the process
+	// to a new memory peak, --profile-mem blames this subtree
+	if (Profiler::memProfileEnabled() && Profiler::sampleMemory("before " + node.name())) {
+		Profiler::setPeakContext(this->tree.getIdString(node));
+	}
+	if (op == OPENSCAD_UNION && children.size() > 2 &&
+			Feature::ExperimentalParallelUnion.is_enabled()) {
+		CGALUtils::applyUnionParallel(children, *N);
+	}
+	else {
+		CGALUtils::applyOperator(children, *N, op);
+	}
+	if (Profiler::memProfileEnabled() && Profiler::sampleMemory("after " + node.name())) {
+		Profiler::setPeakContext(this->tree.getIdString(node));
+	}
 	return ResultObject(N);
 }
 
@@ -256,7 +530,18 @@ std::vector<const class Polygon2d *> GeometryEvaluator::collectChildren2D(const
 void GeometryEvaluator::smartCacheInsert(const AbstractNode &node, 
 																				 const shared_ptr<const Geometry> &geom)
 {
-	const std::string &key = this->tree.getIdString(node);
+	const std::string &key = this->tree.getIdHash(node);
+
+	// Geometry built at degraded tessellation must not shadow the full
+	// quality result under the same hash - and under memory pressure
+	// growing the caches is the wrong direction anyway
+	if (MemoryPressure::degraded()) return;
+
+	// An async-import placeholder must never shadow the real mesh
+	if (Feature::ExperimentalAsyncImport.is_enabled() &&
+			AsyncImportLoader::isProxy(geom.get())) {
+		return;
+	}
 
 	shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom);
 	if (N) {
@@ -269,18 +554,37 @@ void GeometryEvaluator::smartCacheInsert(const AbstractNode &node,
 			}
 		}
 	}
+
+	// During a full render, stage finished 3D subtrees for the viewport,
+	// retiring the child entries this geometry now contains; see
+	// renderstaging.h. No-op unless CGALWorker opened the staging list.
+	if (geom && geom->getDimension() == 3 && RenderStagingList::instance()->isActive()) {
+		std::vector<std::string> childkeys;
+		BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+			childkeys.push_back(this->tree.getIdHash(*chnode));
+		}
+		RenderStagingList::instance()->publish(key, childkeys, geom);
+	}
+
+	// render() exists to cache deliberately; pin its result so LRU churn
+	// from large previews can't silently discard a multi-minute recompute
+	const RenderNode *rendernode = dynamic_cast<const RenderNode *>(&node);
+	if (rendernode && rendernode->pin) {
+		if (N) CGALCache::instance()->pin(key);
+		else GeometryCache::instance()->pin(key);
+	}
 }
 
 bool GeometryEvaluator::isSmartCached(const AbstractNode &node)
 {
-	const std::string &key = this->tree.getIdString(node);
+	const std::string &key = this->tree.getIdHash(node);
 	return (GeometryCache::instance()->contains(key) ||
 					CGALCache::instance()->contains(key));
 }
 
 shared_ptr<const Geometry> GeometryEvaluator::smartCacheGet(const AbstractNode &node, bool preferNef)
 {
-	const std::string &key = this->tree.getIdString(node);
+	const std::string &key = this->tree.getIdHash(node);
 	shared_ptr<const Geometry> geom;
 	bool hasgeom = GeometryCache::instance()->contains(key);
 	bool hascgal = CGALCache::instance()->contains(key);
@@ -320,8 +624,112 @@ Geometry::ChildList GeometryEvaluator::collectChildren3D(const AbstractNode &nod
 	return children;
 }
 
+// Fan-out of the incremental 2D union merge tree and the child count
+// below which one flat Clipper sweep beats maintaining the tree
+#define INCREMENTAL_UNION2D_FANOUT 16
+#define INCREMENTAL_UNION2D_MIN_CHILDREN 32
+
 /*!
-	
+	Cache key for one group of the union merge tree: a digest over the
+	members' own cache keys, so the group key survives a recompile
+	exactly when every member is unchanged.
+*/
+static std::string union2dGroupKey(const std::vector<std::string> &memberkeys,
+																	 size_t begin, size_t end)
+{
+	boost::uuids::detail::sha1 sha;
+	sha.process_bytes("union2d{", 8);
+	for (size_t i = begin; i < end; i++) {
+		sha.process_bytes(memberkeys[i].data(), memberkeys[i].size());
+	}
+	sha.process_bytes("}", 1);
+	unsigned int digest[5];
+	sha.get_digest(digest);
+	std::string hash;
+	for (int i=0;i<5;i++) hash += str(boost::format("%08x") % digest[i]);
+	return hash;
+}
+
+/*!
+	Union of the node's 2D children, maintained incrementally across
+	recompiles. Large child lists are reduced through a fixed-fanout
+	merge tree whose intermediate results are persisted in the
+	GeometryCache under union2dGroupKey(); since Clipper unions are
+	computed in integer space, grouping doesn't change the result.
+	Editing one leaf then re-unions only the groups on the path from
+	that leaf to the root - O(fanout * depth) elements - instead of
+	every sibling. The first compile pays for the extra tree levels,
+	which add roughly 1/(fanout-1) of the leaf-level work.
+*/
+Polygon2d *GeometryEvaluator::applyUnion2DIncremental(const AbstractNode &node)
+{
+	// Collect (cache key, polygon) per child, with the same filtering
+	// and cache insertion as collectChildren2D()
+	std::vector<std::string> keys;
+	std::vector<shared_ptr<const Polygon2d> > polys;
+	BOOST_FOREACH(const Geometry::ChildItem &item, this->visitedchildren[node.index()]) {
+		const AbstractNode *chnode = item.first;
+		const shared_ptr<const Geometry> &chgeom = item.second;
+		// FIXME: Don't use deep access to modinst members
+		if (chnode->modinst->isBackground()) continue;
+		smartCacheInsert(*chnode, chgeom);
+		if (!chgeom) continue;
+		if (chgeom->getDimension() != 2) {
+			PRINT("WARNING: Ignoring 3D child object for 2D operation");
+			continue;
+		}
+		shared_ptr<const Polygon2d> polygons = dynamic_pointer_cast<const Polygon2d>(chgeom);
+		assert(polygons);
+		keys.push_back(this->tree.getIdHash(*chnode));
+		polys.push_back(polygons);
+	}
+
+	if (polys.empty()) return NULL;
+	if (polys.size() == 1) return new Polygon2d(*polys[0]); // Copy
+
+	if (polys.size() < INCREMENTAL_UNION2D_MIN_CHILDREN) {
+		std::vector<const Polygon2d *> raw;
+		BOOST_FOREACH(const shared_ptr<const Polygon2d> &p, polys) raw.push_back(p.get());
+		return ClipperUtils::apply(raw, ClipperLib::ctUnion);
+	}
+
+	while (polys.size() > 1) {
+		std::vector<std::string> nextkeys;
+		std::vector<shared_ptr<const Polygon2d> > nextpolys;
+		for (size_t begin = 0; begin < polys.size(); begin += INCREMENTAL_UNION2D_FANOUT) {
+			size_t end = std::min(polys.size(), begin + (size_t)INCREMENTAL_UNION2D_FANOUT);
+			if (end - begin == 1) {
+				// A lone tail member rides up to the next level unchanged
+				nextkeys.push_back(keys[begin]);
+				nextpolys.push_back(polys[begin]);
+				continue;
+			}
+			const std::string key = union2dGroupKey(keys, begin, end);
+			shared_ptr<const Polygon2d> merged;
+			if (GeometryCache::instance()->contains(key)) {
+				merged = dynamic_pointer_cast<const Polygon2d>(GeometryCache::instance()->get(key));
+			}
+			if (!merged) {
+				std::vector<const Polygon2d *> group;
+				for (size_t i = begin; i < end; i++) group.push_back(polys[i].get());
+				merged.reset(ClipperUtils::apply(group, ClipperLib::ctUnion));
+				// NULL means the union came out empty; an empty polygon is a
+				// valid (and cacheable) intermediate result
+				if (!merged) merged.reset(new Polygon2d());
+				GeometryCache::instance()->insert(key, merged);
+			}
+			nextkeys.push_back(key);
+			nextpolys.push_back(merged);
+		}
+		keys.swap(nextkeys);
+		polys.swap(nextpolys);
+	}
+	if (polys[0]->isEmpty()) return NULL;
+	return new Polygon2d(*polys[0]); // Copy; the caller owns its result
+}
+
+/*!
+
 */
 Polygon2d *GeometryEvaluator::applyToChildren2D(const AbstractNode &node, OpenSCADOperator op)
 {
@@ -331,6 +739,9 @@ Polygon2d *GeometryEvaluator::applyToChildren2D(const AbstractNode &node, OpenSC
 	else if (op == OPENSCAD_HULL) {
 		return applyHull2D(node);
 	}
+	else if (op == OPENSCAD_UNION) {
+		return applyUnion2DIncremental(node);
+	}
 
 	std::vector<const Polygon2d *> children = collectChildren2D(node);
 
@@ -405,20 +816,74 @@ Response GeometryEvaluator::visit(State &state, const AbstractNode &node)
 	return ContinueTraversal;
 }
 
+/*!
+	Returns node's single OffsetNode child if the two offsets compose
+	exactly: both must use round joins and deltas of the same sign, so
+	the pair equals one offset by the summed delta (a Minkowski sum with
+	a disc of the summed radius). Opposite signs (morphological
+	open/close) and miter/square joins don't compose, and children
+	tagged with a modifier are handled elsewhere in the pipeline.
+*/
+static const OffsetNode *offsetChainTail(const OffsetNode &node)
+{
+	if (node.join_type != ClipperLib::jtRound) return NULL;
+	if (node.getChildren().size() != 1) return NULL;
+	const OffsetNode *child = dynamic_cast<const OffsetNode *>(node.getChildren()[0]);
+	if (!child) return NULL;
+	if (child->join_type != ClipperLib::jtRound) return NULL;
+	if (child->delta * node.delta <= 0) return NULL;
+	if (child->fn != node.fn || child->fs != node.fs || child->fa != node.fa) return NULL;
+	if (child->modinst &&
+			(child->modinst->isBackground() || child->modinst->isHighlight() || child->modinst->isRoot())) {
+		return NULL;
+	}
+	return child;
+}
+
 Response GeometryEvaluator::visit(State &state, const OffsetNode &node)
 {
 	if (state.isPrefix() && isSmartCached(node)) return PruneTraversal;
+	if (state.isPrefix() && offsetChainTail(node)) {
+		// Part of an offset chain; the children are evaluated by the
+		// postfix pass below using the summed delta
+		return PruneTraversal;
+	}
 	if (state.isPostfix()) {
 		shared_ptr<const Geometry> geom;
 		if (!isSmartCached(node)) {
+			// Fuse chains of composable single-child offset nodes into one
+			// Clipper execution, so an offset stack grows the outlines once
+			// instead of rebuilding the polygon per level
+			double delta = node.delta;
+			const OffsetNode *tail = &node;
+			while (const OffsetNode *next = offsetChainTail(*tail)) {
+				delta += next->delta;
+				tail = next;
+			}
+			if (tail != &node) {
+				// The chain was pruned in the prefix pass; evaluate the tail's
+				// children here so applyToChildren2D() below finds them
+				BOOST_FOREACH(const AbstractNode *chnode, tail->getChildren()) {
+					shared_ptr<const Geometry> chgeom;
+					if (isSmartCached(*chnode)) {
+						chgeom = smartCacheGet(*chnode);
+					}
+					else {
+						Traverser trav(*this, *chnode, Traverser::PRE_AND_POSTFIX);
+						trav.execute(&this->tree.getFlattening());
+						chgeom = this->root;
+					}
+					this->visitedchildren[node.index()].push_back(std::make_pair(chnode, chgeom));
+				}
+			}
 			const Geometry *geometry = applyToChildren2D(node, OPENSCAD_UNION);
 			if (geometry) {
 				const Polygon2d *polygon = dynamic_cast<const Polygon2d*>(geometry);
 				// ClipperLib documentation: The formula for the number of steps in a full
 				// circular arc is ... Pi / acos(1 - arc_tolerance / abs(delta))
 				double n = Calc::get_fragments_from_r(10, node.fn, node.fs, node.fa);
-				double arc_tolerance = std::abs(node.delta) * (1 - cos(M_PI / n));
-				const Polygon2d *result = ClipperUtils::applyOffset(*polygon, node.delta, node.join_type, node.miter_limit, arc_tolerance);
+				double arc_tolerance = std::abs(delta) * (1 - cos(M_PI / n));
+				const Polygon2d *result = ClipperUtils::applyOffset(*polygon, delta, node.join_type, node.miter_limit, arc_tolerance);
 				assert(result);
 				geom.reset(result);
 				delete geometry;
@@ -444,21 +909,15 @@ Response GeometryEvaluator::visit(State &state, const RenderNode &node)
 			ResultObject res = applyToChildren(node, OPENSCAD_UNION);
 
 			geom = res.constptr();
-			if (shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(geom)) {
-				// If we got a const object, make a copy
-				shared_ptr<PolySet> newps;
-				if (res.isConst()) newps.reset(new PolySet(*ps));
-				else newps = dynamic_pointer_cast<PolySet>(res.ptr());
-				newps->setConvexity(node.convexity);
-				geom = newps;
-			}
-			else if (shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom)) {
-				// If we got a const object, make a copy
-				shared_ptr<CGAL_Nef_polyhedron> newN;
-				if (res.isConst()) newN.reset(N->copy());
-				else newN = dynamic_pointer_cast<CGAL_Nef_polyhedron>(res.ptr());
-				newN->setConvexity(node.convexity);
-				geom = newN;
+			if (dynamic_pointer_cast<const PolySet>(geom) ||
+					dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom) ||
+					dynamic_pointer_cast<const GeometryInstances>(geom)) {
+				// Copy-on-write: drop our reference first so a uniquely
+				// owned result is mutated in place instead of copied
+				geom.reset();
+				shared_ptr<Geometry> mutgeom = res.mutableptr();
+				mutgeom->setConvexity(node.convexity);
+				geom = mutgeom;
 			}
 		}
 		else {
@@ -469,6 +928,26 @@ Response GeometryEvaluator::visit(State &state, const RenderNode &node)
 	return ContinueTraversal;
 }
 
+/*!
+	voxel_render() re-evaluates its whole subtree on the occupancy grid
+	engine (see voxelizer.h), so the children are never visited by this
+	traversal.
+*/
+Response GeometryEvaluator::visit(State &state, const VoxelRenderNode &node)
+{
+	if (state.isPrefix()) {
+		shared_ptr<const Geometry> geom;
+		if (!isSmartCached(node)) {
+			ProfileScope profile(Profiler::enabled() ? "evaluate/" + node.name() : std::string());
+			geom = VoxelEvaluator(this->tree, node.resolution).evaluate(node);
+			if (Profiler::enabled() && geom) profile.setBytes(geom->memsize());
+		}
+		else geom = smartCacheGet(node);
+		addToParent(state, node, geom);
+	}
+	return PruneTraversal;
+}
+
 /*!
 	Leaf nodes can create their own geometry, so let them do that
 
@@ -480,15 +959,41 @@ Response GeometryEvaluator::visit(State &state, const LeafNode &node)
 	if (state.isPrefix()) {
 		shared_ptr<const Geometry> geom;
 		if (!isSmartCached(node)) {
-			const Geometry *geometry = node.createGeometry();
-			if (const Polygon2d *polygon = dynamic_cast<const Polygon2d*>(geometry)) {
-				if (!polygon->isSanitized()) {
-					Polygon2d *p = ClipperUtils::sanitize(*polygon);
-					delete geometry;
-					geometry = p;
+			// async-import: hand the preview a placeholder instead of
+			// blocking on a file that is still loading; the caches pick up
+			// the real mesh when its background load lands. DXF is excluded
+			// like in the persistent import cache - 2D parsing is cheap
+			if (this->import_proxies) {
+				const ImportNode *import = dynamic_cast<const ImportNode *>(&node);
+				if (import && import->type != TYPE_DXF) {
+					geom = AsyncImportLoader::instance()->proxyFor(*import, this->tree.getIdHash(node));
 				}
 			}
-            geom.reset(geometry);
+			// A prefetched import may still be in flight; fetch() waits for
+			// its worker instead of duplicating the work here
+			if (!geom && this->import_prefetcher) geom = this->import_prefetcher->fetch(node);
+			if (!geom) {
+				ProfileScope profile(Profiler::enabled() ? "evaluate/" + node.name() : std::string());
+				ModuleTimer modtimer(Profiler::moduleAttributionEnabled() && node.modinst ?
+														 node.modinst->name() : std::string(), true);
+				AdvisorScope advisorscope(node);
+				try {
+					MemoryPressure::check();
+					const Geometry *geometry = node.createGeometry();
+					if (const Polygon2d *polygon = dynamic_cast<const Polygon2d*>(geometry)) {
+						if (!polygon->isSanitized()) {
+							Polygon2d *p = ClipperUtils::sanitize(*polygon);
+							delete geometry;
+							geometry = p;
+						}
+					}
+					geom.reset(geometry);
+				}
+				catch (const MemoryPressureException &e) {
+					PRINTB("ERROR: Memory budget: dropping %s(): %s.", node.name() % e.what());
+				}
+				if (Profiler::enabled() && geom) profile.setBytes(geom->memsize());
+			}
 		}
 		else geom = smartCacheGet(node);
 		addToParent(state, node, geom);
@@ -510,7 +1015,7 @@ Response GeometryEvaluator::visit(State &state, const TextNode &node)
 			}
 			geom.reset(ClipperUtils::apply(polygonlist, ClipperLib::ctUnion));
 		}
-		else geom = GeometryCache::instance()->get(this->tree.getIdString(node));
+		else geom = GeometryCache::instance()->get(this->tree.getIdHash(node));
 		addToParent(state, node, geom);
 	}
 	return PruneTraversal;
@@ -529,7 +1034,13 @@ Response GeometryEvaluator::visit(State &state, const CsgNode &node)
 	if (state.isPostfix()) {
 		shared_ptr<const Geometry> geom;
 		if (!isSmartCached(node)) {
+			// A $timeout in scope tightens the evaluation deadline for this
+			// subtree; on abort the ProgressCancelException unwinds the whole
+			// render, with everything completed so far already cached
+			double enclosing_deadline = 0;
+			if (node.timeout > 0) enclosing_deadline = progress_tighten_deadline(node.timeout);
 			geom = applyToChildren(node, node.type).constptr();
+			if (node.timeout > 0) progress_restore_deadline(enclosing_deadline);
 		}
 		else {
 			geom = smartCacheGet(node);
@@ -546,55 +1057,118 @@ Response GeometryEvaluator::visit(State &state, const CsgNode &node)
 	  o Union all children
 	  o Perform transform
  */			
+/*!
+	Returns node's single TransformNode child if node's matrix can be fused
+	with it, i.e. the child isn't tagged with any modifier which is handled
+	elsewhere in the pipeline.
+*/
+static const TransformNode *transformChainTail(const AbstractNode &node)
+{
+	if (node.getChildren().size() != 1) return NULL;
+	const TransformNode *child = dynamic_cast<const TransformNode *>(node.getChildren()[0]);
+	if (!child) return NULL;
+	if (child->modinst &&
+			(child->modinst->isBackground() || child->modinst->isHighlight() || child->modinst->isRoot())) {
+		return NULL;
+	}
+	return child;
+}
+
 Response GeometryEvaluator::visit(State &state, const TransformNode &node)
 {
 	if (state.isPrefix() && isSmartCached(node)) return PruneTraversal;
+	if (state.isPrefix() && transformChainTail(node)) {
+		// Part of a transform chain; the children are evaluated by the
+		// postfix pass below using the fused matrix
+		return PruneTraversal;
+	}
 	if (state.isPostfix()) {
 		shared_ptr<const class Geometry> geom;
 		if (!isSmartCached(node)) {
-			if (matrix_contains_infinity(node.matrix) || matrix_contains_nan(node.matrix)) {
+			// Fuse chains of single-child transform nodes into one matrix, so
+			// a deep translate/rotate/scale stack walks the vertices once
+			// instead of copying and re-walking them per level
+			Transform3d matrix = node.matrix;
+			const TransformNode *tail = &node;
+			while (const TransformNode *next = transformChainTail(*tail)) {
+				matrix = matrix * next->matrix;
+				tail = next;
+			}
+			if (matrix_contains_infinity(matrix) || matrix_contains_nan(matrix)) {
 				// due to the way parse/eval works we can't currently distinguish between NaN and Inf
 				PRINT("Warning: Transformation matrix contains Not-a-Number and/or Infinity - removing object.");
 			}
 			else {
+				if (tail != &node) {
+					// The chain was pruned in the prefix pass; evaluate the tail's
+					// children here so applyToChildren() below finds them
+					BOOST_FOREACH(const AbstractNode *chnode, tail->getChildren()) {
+						shared_ptr<const Geometry> chgeom;
+						if (isSmartCached(*chnode)) {
+							chgeom = smartCacheGet(*chnode);
+						}
+						else {
+							Traverser trav(*this, *chnode, Traverser::PRE_AND_POSTFIX);
+							trav.execute(&this->tree.getFlattening());
+							chgeom = this->root;
+						}
+						this->visitedchildren[node.index()].push_back(std::make_pair(chnode, chgeom));
+					}
+				}
 				// First union all children
 				ResultObject res = applyToChildren(node, OPENSCAD_UNION);
 				if ((geom = res.constptr())) {
 					if (geom->getDimension() == 2) {
-						shared_ptr<const Polygon2d> polygons = dynamic_pointer_cast<const Polygon2d>(geom);
-						assert(polygons);
-						
-						// If we got a const object, make a copy
-						shared_ptr<Polygon2d> newpoly;
-						if (res.isConst()) newpoly.reset(new Polygon2d(*polygons));
-						else newpoly = dynamic_pointer_cast<Polygon2d>(res.ptr());
-						
+						assert(dynamic_pointer_cast<const Polygon2d>(geom));
+
+						// Copy-on-write: drop our reference first so a uniquely
+						// owned result is mutated in place instead of copied
+						geom.reset();
+						shared_ptr<Polygon2d> newpoly = dynamic_pointer_cast<Polygon2d>(res.mutableptr());
+
 						Transform2d mat2;
-						mat2.matrix() << 
-							node.matrix(0,0), node.matrix(0,1), node.matrix(0,3),
-							node.matrix(1,0), node.matrix(1,1), node.matrix(1,3),
-							node.matrix(3,0), node.matrix(3,1), node.matrix(3,3);
+						mat2.matrix() <<
+							matrix(0,0), matrix(0,1), matrix(0,3),
+							matrix(1,0), matrix(1,1), matrix(1,3),
+							matrix(3,0), matrix(3,1), matrix(3,3);
 						newpoly->transform(mat2);
 						geom = newpoly;
 					}
 					else if (geom->getDimension() == 3) {
 						shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(geom);
+						shared_ptr<const GeometryInstances> instances = dynamic_pointer_cast<const GeometryInstances>(geom);
 						if (ps) {
-							// If we got a const object, make a copy
-							shared_ptr<PolySet> newps;
-							if (res.isConst()) newps.reset(new PolySet(*ps));
-							else newps = dynamic_pointer_cast<PolySet>(res.ptr());
-							newps->transform(node.matrix);
-							geom = newps;
+							if (Feature::ExperimentalGeometryInstancing.is_enabled() &&
+									res.isConst() && !ps->isEmpty()) {
+								// The mesh is shared (typically via the geometry cache), so
+								// place it by reference instead of copying the vertex set
+								geom.reset(new GeometryInstances(ps, matrix));
+							}
+							else {
+								// Copy-on-write: drop our references first so a uniquely
+								// owned result is mutated in place instead of copied
+								ps.reset();
+								geom.reset();
+								shared_ptr<PolySet> newps = dynamic_pointer_cast<PolySet>(res.mutableptr());
+								newps->transform(matrix);
+								geom = newps;
+							}
+						}
+						else if (instances) {
+							// Copy-on-write as above; the prototype mesh stays
+							// shared either way
+							instances.reset();
+							geom.reset();
+							shared_ptr<GeometryInstances> newinst = dynamic_pointer_cast<GeometryInstances>(res.mutableptr());
+							newinst->transform(matrix);
+							geom = newinst;
 						}
 						else {
-							shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom);
-							assert(N);
-							// If we got a const object, make a copy
-							shared_ptr<CGAL_Nef_polyhedron> newN;
-							if (res.isConst()) newN.reset(N->copy());
-							else newN = dynamic_pointer_cast<CGAL_Nef_polyhedron>(res.ptr());
-							newN->transform(node.matrix);
+							assert(dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom));
+							// Copy-on-write as above
+							geom.reset();
+							shared_ptr<CGAL_Nef_polyhedron> newN = dynamic_pointer_cast<CGAL_Nef_polyhedron>(res.mutableptr());
+							newN->transform(matrix);
 							geom = newN;
 						}
 					}
@@ -665,14 +1239,45 @@ static void add_slice(PolySet *ps, const Polygon2d &poly,
 	}
 }
 
+// Minimum number of twist slices before spawning worker threads pays off
+#define PARALLEL_EXTRUDE_MIN_SLICES 64
+
+/*!
+	Builds the twist slices [first, last> into the given polyset. Each
+	worker thread of the parallel extrude runs one instance of this on its
+	own output polyset; the slices are independent of each other.
+*/
+static void add_slices_range(PolySet *ps, const Polygon2d *poly, const LinearExtrudeNode *node,
+														 double h1, double h2, size_t slices,
+														 size_t first, size_t last)
+{
+	for (size_t j = first; j < last; j++) {
+		double rot1 = node->twist*j / slices;
+		double rot2 = node->twist*(j+1) / slices;
+		double height1 = h1 + (h2-h1)*j / slices;
+		double height2 = h1 + (h2-h1)*(j+1) / slices;
+		Vector2d scale1(1 - (1-node->scale_x)*j / slices,
+										1 - (1-node->scale_y)*j / slices);
+		Vector2d scale2(1 - (1-node->scale_x)*(j+1) / slices,
+										1 - (1-node->scale_y)*(j+1) / slices);
+		add_slice(ps, *poly, rot1, rot2, height1, height2, scale1, scale2);
+	}
+}
+
 /*!
 	Input to extrude should be sanitized. This means non-intersecting, correct winding order
 	etc., the input coming from a library like Clipper.
 */
-static Geometry *extrudePolygon(const LinearExtrudeNode &node, const Polygon2d &poly)
+Geometry *GeometryEvaluator::extrudePolygon(const LinearExtrudeNode &node, const Polygon2d &poly)
 {
 	PolySet *ps = new PolySet(3);
-	ps->setConvexity(node.convexity);
+	// Users habitually over-specify convexity, and every unit is an extra
+	// OpenCSG pass; the profile itself gives a tighter bound (plus one
+	// fold per quarter turn of twist), so only keep the user's value when
+	// it's the smaller of the two.
+	int convexity = poly.estimatedConvexity() + (int)(fabs(node.twist) / 90);
+	if (node.convexity > 0 && node.convexity < convexity) convexity = node.convexity;
+	ps->setConvexity(convexity);
 	if (node.height <= 0) return ps;
 
 	double h1, h2;
@@ -685,38 +1290,75 @@ static Geometry *extrudePolygon(const LinearExtrudeNode &node, const Polygon2d &
 		h2 = node.height;
 	}
 
-	PolySet *ps_bottom = poly.tessellate(); // bottom
-	
+	shared_ptr<const PolySet> ps_tess = poly.tessellated(); // memoized
+
 	// Flip vertex ordering for bottom polygon
-	BOOST_FOREACH(PolySet::Polygon &p, ps_bottom->polygons) {
-		std::reverse(p.begin(), p.end());
+	BOOST_FOREACH(const PolySet::Polygon &p, ps_tess->polygons) {
+		ps->append_poly(p.size());
+		BOOST_REVERSE_FOREACH(const Vector3d &v, p) {
+			ps->append_vertex(v[0], v[1], h1);
+		}
 	}
-	translate_PolySet(*ps_bottom, Vector3d(0,0,h1));
-
-	ps->append(*ps_bottom);
-	delete ps_bottom;
-	if (node.scale_x > 0 || node.scale_y > 0) {
+	if (node.scale_x > 0 && node.scale_y > 0) {
+		// An invertible affine map keeps a triangulation valid, so the top
+		// is the cached bottom triangulation pushed through the scale/twist
+		// transform instead of a second CGAL run
+		Eigen::Affine2d trans(Eigen::Scaling(node.scale_x, node.scale_y) *
+													 Eigen::Rotation2D<double>(-node.twist*M_PI/180));
+		BOOST_FOREACH(const PolySet::Polygon &p, ps_tess->polygons) {
+			ps->append_poly(p.size());
+			BOOST_FOREACH(const Vector3d &v, p) {
+				Vector2d t = trans * Vector2d(v[0], v[1]);
+				ps->append_vertex(t[0], t[1], h2);
+			}
+		}
+	}
+	else if (node.scale_x > 0 || node.scale_y > 0) {
+		// One scale factor is zero: the top collapses to a line, so let
+		// the triangulator deal with the degenerate polygon as before
 		Polygon2d top_poly(poly);
 		Eigen::Affine2d trans(Eigen::Scaling(node.scale_x, node.scale_y) *
 													 Eigen::Rotation2D<double>(-node.twist*M_PI/180));
 		top_poly.transform(trans); // top
 		PolySet *ps_top = top_poly.tessellate();
 		translate_PolySet(*ps_top, Vector3d(0,0,h2));
-		ps->append(*ps_top);
+		ps->splice(*ps_top);
 		delete ps_top;
 	}
     size_t slices = node.has_twist ? node.slices : 1;
 
-	for (unsigned int j = 0; j < slices; j++) {
-		double rot1 = node.twist*j / slices;
-		double rot2 = node.twist*(j+1) / slices;
-		double height1 = h1 + (h2-h1)*j / slices;
-		double height2 = h1 + (h2-h1)*(j+1) / slices;
-		Vector2d scale1(1 - (1-node.scale_x)*j / slices,
-										1 - (1-node.scale_y)*j / slices);
-		Vector2d scale2(1 - (1-node.scale_x)*(j+1) / slices,
-										1 - (1-node.scale_y)*(j+1) / slices);
-		add_slice(ps, poly, rot1, rot2, height1, height2, scale1, scale2);
+	// Each slice adds up to two triangles per outline edge; reserve the
+	// full capacity up front so the polygon vector doesn't regrow while
+	// the slices are appended
+	size_t edges = 0;
+	BOOST_FOREACH(const Outline2d &o, poly.outlines()) edges += o.vertices.size();
+	ps->polygons.reserve(ps->polygons.size() + 2 * edges * slices);
+
+	size_t numthreads = WorkerPool::numThreads();
+	if (Feature::ExperimentalParallelCSG.is_enabled() &&
+			numthreads >= 2 && slices >= PARALLEL_EXTRUDE_MIN_SLICES) {
+		// Slices are independent, so they are built into per-worker
+		// polysets and concatenated in order, keeping the output identical
+		// to the serial loop
+		size_t chunksize = (slices + numthreads - 1) / numthreads;
+		std::vector<PolySet *> partials;
+		WorkerPool::TaskGroup tasks;
+		for (size_t first = 0; first < slices; first += chunksize) {
+			size_t last = std::min(first + chunksize, slices);
+			PolySet *partial = new PolySet(3);
+			partial->polygons.reserve(2 * edges * (last - first));
+			partials.push_back(partial);
+			tasks.run(boost::bind(add_slices_range, partial, &poly, &node,
+														h1, h2, slices, first, last));
+		}
+		tasks.wait();
+		BOOST_FOREACH(PolySet *partial, partials) {
+			ps->splice(*partial);
+			delete partial;
+		}
+	}
+	else {
+		add_slices_range(ps, &poly, &node, h1, h2, slices, 0, slices);
 	}
 
 	return ps;
@@ -761,11 +1403,11 @@ Response GeometryEvaluator::visit(State &state, const LinearExtrudeNode &node)
 	return ContinueTraversal;
 }
 
-static void fill_ring(std::vector<Vector3d> &ring, const Outline2d &o, double a)
+static void fill_ring(std::vector<Vector3d> &ring, const Outline2d &o, double sina, double cosa)
 {
 	for (unsigned int i=0;i<o.vertices.size();i++) {
-		ring[i][0] = o.vertices[i][0] * sin(a);
-		ring[i][1] = o.vertices[i][0] * cos(a);
+		ring[i][0] = o.vertices[i][0] * sina;
+		ring[i][1] = o.vertices[i][0] * cosa;
 		ring[i][2] = o.vertices[i][1];
 	}
 }
@@ -791,7 +1433,11 @@ static void fill_ring(std::vector<Vector3d> &ring, const Outline2d &o, double a)
 static Geometry *rotatePolygon(const RotateExtrudeNode &node, const Polygon2d &poly)
 {
 	PolySet *ps = new PolySet(3);
-	ps->setConvexity(node.convexity);
+	// A ray can cross each profile layer on the near and the far side of
+	// the axis, so the bound is twice the profile's; see extrudePolygon()
+	int convexity = 2 * poly.estimatedConvexity();
+	if (node.convexity > 0 && node.convexity < convexity) convexity = node.convexity;
+	ps->setConvexity(convexity);
 
 	BOOST_FOREACH(const Outline2d &o, poly.outlines()) {
 		double min_x = 0;
@@ -812,10 +1458,14 @@ static Geometry *rotatePolygon(const RotateExtrudeNode &node, const Polygon2d &p
 		rings[0].resize(o.vertices.size());
 		rings[1].resize(o.vertices.size());
 
-		fill_ring(rings[0], o, -M_PI/2); // first ring
+		// The fragment angles start on the X axis; the shared trig ring is
+		// keyed by fragment count and offset, so repeated extrusions with
+		// the same tessellation reuse the same sin/cos table
+		const Calc::TrigRing &tring = Calc::trig_ring(fragments, -M_PI/2);
+		fill_ring(rings[0], o, tring[0].second, tring[0].first); // first ring
 		for (int j = 0; j < fragments; j++) {
-			double a = ((j+1)%fragments*2*M_PI) / fragments - M_PI/2; // start on the X axis
-			fill_ring(rings[(j+1)%2], o, a);
+			const std::pair<double, double> &a = tring[(j+1)%fragments];
+			fill_ring(rings[(j+1)%2], o, a.second, a.first);
 
 			for (size_t i=0;i<o.vertices.size();i++) {
 				ps->append_poly();
@@ -929,10 +1579,14 @@ Response GeometryEvaluator::visit(State &state, const ProjectionNode &node)
 #if 1
 					// project chgeom -> polygon2d
 					shared_ptr<const PolySet> chPS = dynamic_pointer_cast<const PolySet>(chgeom);
+					if (!chPS) {
+						shared_ptr<const GeometryInstances> chInst = dynamic_pointer_cast<const GeometryInstances>(chgeom);
+						if (chInst) chPS.reset(chInst->expandToPolySet());
+					}
 					if (!chPS) {
 						shared_ptr<const CGAL_Nef_polyhedron> chN = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(chgeom);
 						if (chN) {
-							chPS.reset(chN->convertToPolyset());
+							chPS = chN->polySet();
 						}
 					}
 					if (chPS) poly = PolysetUtils::project(*chPS);
@@ -941,10 +1595,9 @@ Response GeometryEvaluator::visit(State &state, const ProjectionNode &node)
 					if (poly) {
 						ClipperLib::Paths result = ClipperUtils::fromPolygon2d(*poly);
 						// Using NonZero ensures that we don't create holes from polygons sharing
-						// edges since we're unioning a mesh
-						result = ClipperUtils::process(result, 
-																					 ClipperLib::ctUnion, 
-																					 ClipperLib::pftNonZero);
+						// edges since we're unioning a mesh; big meshes are reduced in
+						// parallel batches
+						result = ClipperUtils::unionProjected(result);
 						// Add correctly winded polygons to the main clipper
 						sumclipper.AddPaths(result, ClipperLib::ptSubject, true);
 					}
@@ -956,7 +1609,7 @@ Response GeometryEvaluator::visit(State &state, const ProjectionNode &node)
 				if (sumresult.Total() > 0) geom.reset(ClipperUtils::toPolygon2d(sumresult));
 			}
 			else {
-				shared_ptr<const Geometry> newgeom = applyToChildren3D(node, OPENSCAD_UNION).constptr();
+				shared_ptr<const Geometry> newgeom = expand_instances(applyToChildren3D(node, OPENSCAD_UNION).constptr());
 				if (newgeom) {
 					shared_ptr<const CGAL_Nef_polyhedron> Nptr = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(newgeom);
 					if (!Nptr) {
@@ -1004,44 +1657,69 @@ Response GeometryEvaluator::visit(State &state, const CgaladvNode &node)
 				ResultObject res = applyToChildren(node, OPENSCAD_UNION);
 				geom = res.constptr();
 
-				shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(res.constptr());
-				if (N) {
-					// If we got a const object, make a copy
-					shared_ptr<CGAL_Nef_polyhedron> newN;
-					if (res.isConst()) newN.reset(N->copy());
-					else newN = dynamic_pointer_cast<CGAL_Nef_polyhedron>(res.ptr());
+				if (dynamic_pointer_cast<const CGAL_Nef_polyhedron>(res.constptr())) {
+					// Copy-on-write: drop our reference first so a uniquely
+					// owned result is mutated in place instead of copied
+					geom.reset();
+					shared_ptr<CGAL_Nef_polyhedron> newN = dynamic_pointer_cast<CGAL_Nef_polyhedron>(res.mutableptr());
 					applyResize3D(*newN, node.newsize, node.autosize);
 					geom = newN;
 				}
 				else {
-					shared_ptr<const Polygon2d> poly = dynamic_pointer_cast<const Polygon2d>(res.constptr());
-					if (poly) {
-						// If we got a const object, make a copy
-						shared_ptr<Polygon2d> newpoly;
-						if (res.isConst()) newpoly.reset(new Polygon2d(*poly));
-						else newpoly = dynamic_pointer_cast<Polygon2d>(res.ptr());
+					if (dynamic_pointer_cast<const Polygon2d>(res.constptr())) {
+						// Copy-on-write as above
+						geom.reset();
+						shared_ptr<Polygon2d> newpoly = dynamic_pointer_cast<Polygon2d>(res.mutableptr());
 
 						newpoly->resize(Vector2d(node.newsize[0], node.newsize[1]),
 														Eigen::Matrix<bool,2,1>(node.autosize[0], node.autosize[1]));
+						geom = newpoly;
 					}
 					else {
-						shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(res.constptr());
-						if (ps) {
-							// If we got a const object, make a copy
-							shared_ptr<PolySet> newps;
-							if (res.isConst()) newps.reset(new PolySet(*ps));
-							else newps = dynamic_pointer_cast<PolySet>(res.ptr());
+						if (dynamic_pointer_cast<const PolySet>(res.constptr())) {
+							// Copy-on-write as above
+							geom.reset();
+							shared_ptr<PolySet> newps = dynamic_pointer_cast<PolySet>(res.mutableptr());
 
 							newps->resize(node.newsize, node.autosize);
 							geom = newps;
 						}
 						else {
-							assert(false);
+							if (dynamic_pointer_cast<const GeometryInstances>(res.constptr())) {
+								// Copy-on-write as above; a linear rescale folds into the
+								// instance transforms, so the copies stay symbolic
+								geom.reset();
+								shared_ptr<GeometryInstances> newinst = dynamic_pointer_cast<GeometryInstances>(res.mutableptr());
+								newinst->resize(node.newsize, node.autosize);
+								geom = newinst;
+							}
+							else {
+								assert(false);
+							}
 						}
 					}
 				}
 				break;
 			}
+			case SUBDIV: {
+				ResultObject res = applyToChildren(node, OPENSCAD_UNION);
+				shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(res.constptr());
+				shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(res.constptr());
+				shared_ptr<const GeometryInstances> inst = dynamic_pointer_cast<const GeometryInstances>(res.constptr());
+				if (N) {
+					if (!N->isEmpty()) ps = N->polySet();
+				}
+				else if (inst) {
+					ps.reset(inst->expandToPolySet());
+				}
+				if (ps && !ps->isEmpty()) {
+					PolySet *subdivided = new PolySet(3);
+					PolysetUtils::subdivide(*ps, *subdivided, node.subdiv_type, node.level);
+					subdivided->setConvexity(node.convexity);
+					geom.reset(subdivided);
+				}
+				break;
+			}
 			default:
 				assert(false && "not implemented");
 			}
@@ -29,11 +29,17 @@ public:
 	virtual Response visit(State &state, const CgaladvNode &node);
 	virtual Response visit(State &state, const ProjectionNode &node);
 	virtual Response visit(State &state, const RenderNode &node);
+	virtual Response visit(State &state, const VoxelRenderNode &node);
 	virtual Response visit(State &state, const TextNode &node);
 	virtual Response visit(State &state, const OffsetNode &node);
 
 	const Tree &getTree() const { return this->tree; }
 
+	// async-import: substitute placeholders for imports still loading in
+	// the background instead of blocking on them. Preview only; the full
+	// render path must keep exact geometry (see visit(LeafNode))
+	void setImportProxies(bool enable) { this->import_proxies = enable; }
+
 private:
 	class ResultObject {
 	public:
@@ -44,7 +50,24 @@ private:
 		ResultObject(shared_ptr<Geometry> &g) : is_const(false), pointer(g) {}
 		bool isConst() const { return is_const; }
 		shared_ptr<Geometry> ptr() { assert(!is_const); return pointer; }
-		shared_ptr<const Geometry> constptr() const { 
+		/*!
+			Returns the result opened for mutation. A non-const result is
+			handed out directly. A const result is stolen when this
+			ResultObject holds the only reference to it - the caller must
+			drop its own references first - and deep-copied through
+			Geometry::copy() only when it is genuinely shared, e.g. with
+			the geometry cache or a sibling list.
+		*/
+		shared_ptr<Geometry> mutableptr() {
+			if (is_const) {
+				if (const_pointer.unique()) pointer = const_pointer_cast<Geometry>(const_pointer);
+				else pointer.reset(const_pointer->copy());
+				const_pointer.reset();
+				is_const = false;
+			}
+			return pointer;
+		}
+		shared_ptr<const Geometry> constptr() const {
 			return is_const ? const_pointer : static_pointer_cast<const Geometry>(pointer);
 		}
 	private:
@@ -62,14 +85,26 @@ private:
 	Polygon2d *applyHull2D(const AbstractNode &node);
 	Geometry *applyHull3D(const AbstractNode &node);
 	void applyResize3D(class CGAL_Nef_polyhedron &N, const Vector3d &newsize, const Eigen::Matrix<bool,3,1> &autosize);
+	Polygon2d *applyUnion2DIncremental(const AbstractNode &node);
 	Polygon2d *applyToChildren2D(const AbstractNode &node, OpenSCADOperator op);
 	ResultObject applyToChildren3D(const AbstractNode &node, OpenSCADOperator op);
 	ResultObject applyToChildren(const AbstractNode &node, OpenSCADOperator op);
 	void addToParent(const State &state, const AbstractNode &node, const shared_ptr<const Geometry> &geom);
 
+public:
+	// Also used by the draft-preview path in CSGTermEvaluator to extrude
+	// 2D leaves individually
+	static class Geometry *extrudePolygon(const class LinearExtrudeNode &node, const class Polygon2d &poly);
+
+private:
+
 	std::map<int, Geometry::ChildList> visitedchildren;
 	const Tree &tree;
 	shared_ptr<const Geometry> root;
+	// Set for the duration of evaluateGeometry()'s traversal when the
+	// import-prefetch feature is on; see visit(LeafNode)
+	class ImportPrefetcher *import_prefetcher;
+	bool import_proxies;
 
 public:
 };
@@ -0,0 +1,94 @@
+#include "GeometryInstances.h"
+#include "polyset.h"
+
+#include <sstream>
+#include <boost/foreach.hpp>
+
+GeometryInstances::GeometryInstances(const shared_ptr<const PolySet> &prototype,
+																		 const Transform3d &matrix)
+	: prototype(prototype)
+{
+	this->transforms.push_back(matrix);
+	this->convexity = prototype->getConvexity();
+}
+
+size_t GeometryInstances::memsize() const
+{
+	// The prototype is shared, but attribute its size to each holder rather
+	// than pretend the instance set is free.
+	return sizeof(GeometryInstances) +
+		this->prototype->memsize() +
+		this->transforms.capacity() * sizeof(Transform3d);
+}
+
+BoundingBox GeometryInstances::computeBoundingBox() const
+{
+	BoundingBox bbox;
+	const BoundingBox protobox = this->prototype->getBoundingBox();
+	if (protobox.isNull()) return bbox;
+	BOOST_FOREACH(const Transform3d &t, this->transforms) {
+		bbox.extend(t * protobox);
+	}
+	return bbox;
+}
+
+std::string GeometryInstances::dump() const
+{
+	std::stringstream out;
+	out << "GeometryInstances: " << this->transforms.size() << " instances of\n"
+			<< this->prototype->dump();
+	return out.str();
+}
+
+bool GeometryInstances::isEmpty() const
+{
+	return this->transforms.empty() || this->prototype->isEmpty();
+}
+
+void GeometryInstances::transform(const Transform3d &matrix)
+{
+	this->invalidateBoundingBox();
+	BOOST_FOREACH(Transform3d &t, this->transforms) {
+		t = matrix * t;
+	}
+}
+
+void GeometryInstances::resize(Vector3d newsize, const Eigen::Matrix<bool,3,1> &autosize)
+{
+	// Mirrors PolySet::resize(): measure the merged bounding box, derive
+	// per-axis scales with the same autosize rules, and fold the scale
+	// into the instance transforms
+	BoundingBox bbox = this->getBoundingBox();
+
+	int maxdim = 0;
+	for (int i=1;i<3;i++) if (newsize[i] > newsize[maxdim]) maxdim = i;
+
+	Vector3d scale(1,1,1);
+	for (int i=0;i<3;i++) if (newsize[i] > 0) scale[i] = newsize[i] / bbox.sizes()[i];
+
+	double autoscale = scale[maxdim];
+	Vector3d newscale;
+	for (int i=0;i<3;i++) newscale[i] = !autosize[i] || (newsize[i] > 0) ? scale[i] : autoscale;
+
+	Transform3d t;
+	t.matrix() <<
+		newscale[0], 0, 0, 0,
+		0, newscale[1], 0, 0,
+		0, 0, newscale[2], 0,
+		0, 0, 0, 1;
+
+	transform(t);
+}
+
+PolySet *GeometryInstances::expandToPolySet() const
+{
+	PolySet *ps = new PolySet(3);
+	ps->setConvexity(this->convexity);
+	ps->reserve(this->transforms.size() * this->prototype->numPolygons());
+	BOOST_FOREACH(const Transform3d &t, this->transforms) {
+		PolySet placed(*this->prototype);
+		placed.transform(t);
+		ps->splice(placed);
+	}
+	return ps;
+}
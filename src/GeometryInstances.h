@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Geometry.h"
+#include "linalg.h"
+#include "memory.h"
+
+#include <vector>
+#include <Eigen/StdVector>
+
+/*!
+	Represents N placed copies of a shared prototype mesh without
+	materializing the copies: one shared_ptr to the prototype PolySet plus
+	one transform per instance.
+
+	Designs which stamp the same part many times (screws, teeth, pins)
+	would otherwise carry a full transformed vertex set per copy through
+	every union on the way up the tree. The instance set is kept symbolic
+	as long as the consumer only needs to draw, bound, or linearly rescale
+	the geometry, and is expanded to a plain PolySet the moment an
+	operation requires merged topology (CGAL booleans, projection,
+	export).
+*/
+class GeometryInstances : public Geometry
+{
+public:
+	typedef std::vector<Transform3d, Eigen::aligned_allocator<Transform3d> > TransformList;
+
+	GeometryInstances(const shared_ptr<const class PolySet> &prototype, const Transform3d &matrix);
+
+	virtual size_t memsize() const;
+	virtual BoundingBox computeBoundingBox() const;
+	virtual std::string dump() const;
+	virtual unsigned int getDimension() const { return 3; }
+	virtual bool isEmpty() const;
+	// Copies the transform list; the prototype mesh stays shared
+	virtual GeometryInstances *copy() const { return new GeometryInstances(*this); }
+
+	const shared_ptr<const PolySet> &getPrototype() const { return this->prototype; }
+	const TransformList &getTransforms() const { return this->transforms; }
+	void addInstance(const Transform3d &matrix) {
+		this->invalidateBoundingBox();
+		this->transforms.push_back(matrix);
+	}
+	void transform(const Transform3d &matrix);
+	/*! Same semantics as PolySet::resize(), applied to the instance
+	    transforms; the prototype mesh is untouched */
+	void resize(Vector3d newsize, const Eigen::Matrix<bool,3,1> &autosize);
+
+	/*! Flattens the instance set into one mesh holding all placed copies */
+	class PolySet *expandToPolySet() const;
+
+private:
+	shared_ptr<const PolySet> prototype;
+	TransformList transforms;
+};
@@ -7,7 +7,9 @@
 #include "module.h"
 #include "Tree.h"
 #include "memory.h"
+#include <deque>
 #include <vector>
+#include <QElapsedTimer>
 #include <QMutex>
 #include <QSet>
 
@@ -34,13 +36,30 @@ public:
 
 	QTimer *autoReloadTimer;
 	std::string autoReloadId;
+	std::string autoReloadHash;
 	QTimer *waitAfterReloadTimer;
+	QTimer *consoleFlushTimer;
+	// Polls for background import() loads landing; see checkImportArrivals()
+	QTimer *importArrivalTimer;
+	size_t import_generation;
+
+	// Wall-clock cost of the last few real compiles, used to scale the
+	// auto-reload idle threshold (see adjustAutoReloadInterval())
+	QElapsedTimer compileElapsed;
+	bool compileTimingActive;
+	std::deque<qint64> compileDurations;
 
 	ModuleContext top_ctx;
 	FileModule *root_module;      // Result of parsing
 	ModuleInstantiation root_inst;    // Top level instance
 	AbstractNode *absolute_root_node; // Result of tree evaluation
 	AbstractNode *root_node;          // Root if the root modifier (!) is used
+	// The previous compile's tree, kept alive until the worker has
+	// hashed the new one against lastCompiledTreeHash; see compileDone()
+	AbstractNode *prev_absolute_root_node;
+	AbstractNode *prev_root_node;
+	std::string lastCompiledTreeHash; // id hash of the last compiled tree
+	bool treeUnchanged; // set by the worker when the new tree hashes like the last
 	Tree tree;
 
 	shared_ptr<class CSGTerm> root_raw_term;           // Result of CSG term rendering
@@ -49,9 +68,15 @@ public:
 #ifdef ENABLE_CGAL
 	shared_ptr<const class Geometry> root_geom;
 	class CGALRenderer *cgalRenderer;
+	// Draws finished subtrees while a full render runs; see renderstaging.h
+	class StagedCGALRenderer *stagedRenderer;
+	class QTimer *stagingTimer;
 #endif
 #ifdef ENABLE_OPENCSG
 	class OpenCSGRenderer *opencsgRenderer;
+	// Display lists carried across a recompile until the next renderer
+	// adopts them (see OpenCSGRenderer::retainLists())
+	class OpenCSGLists *retainedCSGLists;
 #endif
 	class ThrownTogetherRenderer *thrownTogetherRenderer;
 
@@ -69,6 +94,9 @@ public:
 	MainWindow(const QString &filename);
 	~MainWindow();
 
+	//! Entry point for CSGWorker: runs on its thread, must not touch widgets
+	void instantiateAndCompileCSG(bool csgterms);
+
 protected:
 	void closeEvent(QCloseEvent *event);
 
@@ -91,10 +119,20 @@ private:
 	void compileTopLevelDocument();
 	void compile(bool reload, bool forcedone = false);
 	void compileCSG(bool procevents);
+	void adjustAutoReloadInterval();
+	void stashPreviousTree();
+	void discardPreviousCompile();
+	void restoreUnchangedTree();
+	void instantiateRootNode();
+	void compileCSGTerms();
 	bool maybeSave();
 	bool checkEditorModified();
 	QString dumpCSGTree(AbstractNode *root);
 	static void consoleOutput(const std::string &msg, void *userdata);
+	QMutex consoleMutex;
+	QStringList consolePending;
+	unsigned int consoleDropped;
+	bool consoleFlushScheduled;
 	void loadViewSettings();
 	void loadDesignSettings();
 	void saveBackup();
@@ -107,6 +145,8 @@ private:
   class FontListDialog *font_list_dialog;
 
 private slots:
+	void scheduleConsoleFlush();
+	void flushConsole();
 	void actionUpdateCheck();
 	void actionNew();
 	void actionOpen();
@@ -120,8 +160,8 @@ private slots:
 	void actionReload();
 	void actionShowLibraryFolder();
 
-	void instantiateRoot();
 	void compileDone(bool didchange);
+	void csgWorkerDone();
 	void compileEnded();
 
 private slots:
@@ -147,10 +187,12 @@ private slots:
 	void actionRenderPreview();
 	void csgRender();
 	void csgReloadRender();
+	void checkImportArrivals();
 #ifdef ENABLE_CGAL
 	void actionRender();
 	void actionRenderDone(shared_ptr<const class Geometry>);
 	void cgalRender();
+	void updateStagedRender();
 #endif
 	void actionCheckValidity();
 	void actionDisplayAST();
@@ -190,6 +232,7 @@ public slots:
 	void viewModeShowEdges();
 	void viewModeShowAxes();
 	void viewModeShowCrosshairs();
+	void viewModeShowHud();
 	void viewModeAnimate();
 	void viewAngleTop();
 	void viewAngleBottom();
@@ -227,6 +270,7 @@ private:
 	class QTemporaryFile *tempFile;
 	class ProgressWidget *progresswidget;
 	class CGALWorker *cgalworker;
+	class CSGWorker *csgworker;
 	QMutex consolemutex;
 
 signals:
@@ -1,7 +1,11 @@
 #include "ModuleCache.h"
 #include "module.h"
+#include "ModuleSerializer.h"
+#include "feature.h"
 #include "printutils.h"
 #include "openscad.h"
+#include "statcache.h"
+#include "fileutils.h"
 
 #include "boosty.h"
 #include <boost/format.hpp>
@@ -47,7 +51,7 @@ bool ModuleCache::evaluate(const std::string &filename, FileModule *&module)
 	// Create cache ID
 	struct stat st;
 	memset(&st, 0, sizeof(struct stat));
-	bool valid = (stat(filename.c_str(), &st) == 0);
+	bool valid = (StatCache::stat(filename, st) == 0);
 
 	// If file isn't there, just return and let the cache retain the old module
 	if (!valid) return false;
@@ -63,16 +67,27 @@ bool ModuleCache::evaluate(const std::string &filename, FileModule *&module)
 	}
   
 	bool shouldCompile = true;
+	std::string content_hash; // computed only when the cheap ID mismatches
 	if (found) {
 		// Files should only be recompiled if the cache ID changed
 		if (entry.cache_id == cache_id) {
 			shouldCompile = false;
-			// Recompile if includes changed
-			if (lib_mod && lib_mod->includesChanged()) {
-				lib_mod = NULL;
-				shouldCompile = true;
+		}
+		else {
+			// The mtime/size ID is only a pre-filter: build systems and git
+			// touch library files without changing a byte, so confirm
+			// against the content hash before throwing the module away
+			content_hash = hash_file_contents(filename);
+			if (!content_hash.empty() && content_hash == entry.content_hash) {
+				entry.cache_id = cache_id; // adopt the new timestamp
+				shouldCompile = false;
 			}
 		}
+		if (!shouldCompile && lib_mod && lib_mod->includesChanged()) {
+			// Recompile if includes changed
+			lib_mod = NULL;
+			shouldCompile = true;
+		}
 	}
 
 #ifdef DEBUG
@@ -80,8 +95,9 @@ bool ModuleCache::evaluate(const std::string &filename, FileModule *&module)
 	//if (!shouldCompile) PRINTB("Using cached library: %s (%p)", filename % lib_mod);
 #endif
 
-	// If cache lookup failed (non-existing or old timestamp), compile module
+	// If cache lookup failed (non-existing or changed content), compile module
 	if (shouldCompile) {
+		if (content_hash.empty()) content_hash = hash_file_contents(filename);
 #ifdef DEBUG
 		if (found) {
 			PRINTB("Recompiling cached library: %s (%s)", filename % cache_id);
@@ -91,32 +107,55 @@ bool ModuleCache::evaluate(const std::string &filename, FileModule *&module)
 		}
 #endif
 
-		std::stringstream textbuf;
-		{
-			std::ifstream ifs(filename.c_str());
-			if (!ifs.is_open()) {
-				PRINTB("WARNING: Can't open library file '%s'\n", filename);
-				return false;
+		// Try the on-disk compiled form first; a hit skips lexing and
+		// parsing entirely. The serializer validates mtime/size, includes
+		// and commandline_commands itself and returns NULL on any mismatch.
+		FileModule *disk_mod = NULL;
+		if (Feature::ExperimentalModuleCache.is_enabled()) {
+			disk_mod = ModuleSerializer::load(filename, cache_id);
+		}
+
+		if (disk_mod) {
+			PRINTDB("Loaded library from module cache: %s (%s)", filename % cache_id);
+			if (lib_mod) delete lib_mod;
+			lib_mod = disk_mod;
+			entry.module = lib_mod;
+			entry.cache_id = cache_id;
+			entry.content_hash = content_hash;
+		}
+		else {
+			std::stringstream textbuf;
+			{
+				std::ifstream ifs(filename.c_str());
+				if (!ifs.is_open()) {
+					PRINTB("WARNING: Can't open library file '%s'\n", filename);
+					return false;
+				}
+				textbuf << ifs.rdbuf();
+			}
+			textbuf << "\n" << commandline_commands;
+
+			print_messages_push();
+
+			FileModule *oldmodule = lib_mod;
+
+			std::string pathname = boosty::stringy(fs::path(filename).parent_path());
+			lib_mod = dynamic_cast<FileModule*>(parse(textbuf.str().c_str(), pathname.c_str(), false));
+			PRINTB_NOCACHE("  compiled module: %p", lib_mod);
+
+			// We defer deletion so we can ensure that the new module won't
+			// have the same address as the old
+			if (oldmodule) delete oldmodule;
+			entry.module = lib_mod;
+			entry.cache_id = cache_id;
+			entry.content_hash = content_hash;
+
+			print_messages_pop();
+
+			if (lib_mod && Feature::ExperimentalModuleCache.is_enabled()) {
+				ModuleSerializer::save(lib_mod, filename, cache_id);
 			}
-			textbuf << ifs.rdbuf();
 		}
-		textbuf << "\n" << commandline_commands;
-		
-		print_messages_push();
-		
-		FileModule *oldmodule = lib_mod;
-		
-		std::string pathname = boosty::stringy(fs::path(filename).parent_path());
-		lib_mod = dynamic_cast<FileModule*>(parse(textbuf.str().c_str(), pathname.c_str(), false));
-		PRINTB_NOCACHE("  compiled module: %p", lib_mod);
-		
-		// We defer deletion so we can ensure that the new module won't
-		// have the same address as the old
-		if (oldmodule) delete oldmodule;
-		entry.module = lib_mod;
-		entry.cache_id = cache_id;
-		
-		print_messages_pop();
 	}
 	
 	module = lib_mod;
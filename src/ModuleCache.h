@@ -25,6 +25,9 @@ private:
 	struct cache_entry {
 		class FileModule *module;
 		std::string cache_id;
+		//! Content hash; consulted when cache_id moves, since a touch
+		//! without a byte change shouldn't force a recompile
+		std::string content_hash;
 	};
 	boost::unordered_map<std::string, cache_entry> entries;
 };
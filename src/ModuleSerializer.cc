@@ -0,0 +1,452 @@
+#include "ModuleSerializer.h"
+#include "module.h"
+#include "expression.h"
+#include "function.h"
+#include "value.h"
+#include "printutils.h"
+#include "openscad.h"
+#include "PlatformUtils.h"
+#include "boosty.h"
+
+#include <fstream>
+#include <sstream>
+#include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+/*
+	The format is a straight binary dump of the AST the parser builds:
+	length-prefixed strings, fixed-width integers and doubles in native
+	byte order. The cache is per-machine and regenerated on any mismatch,
+	so there is no need for a portable encoding - only for strict
+	validation, which the header fields and the version number provide.
+*/
+
+namespace {
+
+	const boost::uint32_t SERIALIZER_MAGIC = 0x4D435341; // "ASCM"
+	const boost::uint32_t SERIALIZER_VERSION = 1;
+
+	// Thrown on truncated or malformed cache files and on ASTs containing
+	// elements the format doesn't cover; both just turn into a cache miss.
+	struct SerializeError { };
+
+	void write_u8(std::ostream &out, boost::uint8_t v) {
+		out.write(reinterpret_cast<const char *>(&v), sizeof(v));
+	}
+
+	void write_u32(std::ostream &out, boost::uint32_t v) {
+		out.write(reinterpret_cast<const char *>(&v), sizeof(v));
+	}
+
+	void write_i64(std::ostream &out, boost::int64_t v) {
+		out.write(reinterpret_cast<const char *>(&v), sizeof(v));
+	}
+
+	void write_double(std::ostream &out, double v) {
+		out.write(reinterpret_cast<const char *>(&v), sizeof(v));
+	}
+
+	void write_string(std::ostream &out, const std::string &s) {
+		write_u32(out, s.size());
+		out.write(s.data(), s.size());
+	}
+
+	boost::uint8_t read_u8(std::istream &in) {
+		boost::uint8_t v;
+		in.read(reinterpret_cast<char *>(&v), sizeof(v));
+		if (!in.good()) throw SerializeError();
+		return v;
+	}
+
+	boost::uint32_t read_u32(std::istream &in) {
+		boost::uint32_t v;
+		in.read(reinterpret_cast<char *>(&v), sizeof(v));
+		if (!in.good()) throw SerializeError();
+		return v;
+	}
+
+	boost::int64_t read_i64(std::istream &in) {
+		boost::int64_t v;
+		in.read(reinterpret_cast<char *>(&v), sizeof(v));
+		if (!in.good()) throw SerializeError();
+		return v;
+	}
+
+	double read_double(std::istream &in) {
+		double v;
+		in.read(reinterpret_cast<char *>(&v), sizeof(v));
+		if (!in.good()) throw SerializeError();
+		return v;
+	}
+
+	std::string read_string(std::istream &in) {
+		boost::uint32_t len = read_u32(in);
+		std::string s(len, '\0');
+		if (len > 0) in.read(&s[0], len);
+		if (!in.good()) throw SerializeError();
+		return s;
+	}
+
+	void write_value(std::ostream &out, const Value &v)
+	{
+		write_u8(out, v.type());
+		switch (v.type()) {
+		case Value::UNDEFINED:
+			break;
+		case Value::BOOL:
+			write_u8(out, v.toBool() ? 1 : 0);
+			break;
+		case Value::NUMBER:
+			write_double(out, v.toDouble());
+			break;
+		case Value::STRING:
+			write_string(out, v.toString());
+			break;
+		case Value::VECTOR: {
+			const Value::VectorType &vec = v.toVector();
+			write_u32(out, vec.size());
+			BOOST_FOREACH(const Value &item, vec) write_value(out, item);
+			break;
+		}
+		case Value::RANGE: {
+			const Value::RangeType &range = v.toRange();
+			write_double(out, range.begin_value());
+			write_double(out, range.step_value());
+			write_double(out, range.end_value());
+			break;
+		}
+		default:
+			throw SerializeError();
+		}
+	}
+
+	Value read_value(std::istream &in)
+	{
+		switch (read_u8(in)) {
+		case Value::UNDEFINED:
+			return Value();
+		case Value::BOOL:
+			return Value(read_u8(in) != 0);
+		case Value::NUMBER:
+			return Value(read_double(in));
+		case Value::STRING:
+			return Value(read_string(in));
+		case Value::VECTOR: {
+			Value::VectorType vec;
+			boost::uint32_t count = read_u32(in);
+			vec.reserve(count);
+			for (boost::uint32_t i = 0; i < count; i++) vec.push_back(read_value(in));
+			return Value(vec);
+		}
+		case Value::RANGE: {
+			double begin = read_double(in);
+			double step = read_double(in);
+			double end = read_double(in);
+			return Value(Value::RangeType(begin, step, end));
+		}
+		default:
+			throw SerializeError();
+		}
+	}
+
+	void write_expression(std::ostream &out, const Expression *expr);
+	Expression *read_expression(std::istream &in);
+
+	void write_assignments(std::ostream &out, const AssignmentList &args)
+	{
+		write_u32(out, args.size());
+		BOOST_FOREACH(const Assignment &arg, args) {
+			write_string(out, arg.first);
+			write_expression(out, arg.second.get());
+		}
+	}
+
+	AssignmentList read_assignments(std::istream &in)
+	{
+		AssignmentList args;
+		boost::uint32_t count = read_u32(in);
+		args.reserve(count);
+		for (boost::uint32_t i = 0; i < count; i++) {
+			std::string name = read_string(in);
+			args.push_back(Assignment(name, boost::shared_ptr<Expression>(read_expression(in))));
+		}
+		return args;
+	}
+
+	void write_expression(std::ostream &out, const Expression *expr)
+	{
+		write_u8(out, expr ? 1 : 0);
+		if (!expr) return;
+		write_string(out, expr->type);
+		write_string(out, expr->var_name);
+		write_string(out, expr->call_funcname);
+		write_value(out, expr->const_value);
+		write_assignments(out, expr->call_arguments);
+		write_u32(out, expr->children.size());
+		BOOST_FOREACH(const Expression *child, expr->children) {
+			write_expression(out, child);
+		}
+	}
+
+	Expression *read_expression(std::istream &in)
+	{
+		if (read_u8(in) == 0) return NULL;
+		Expression *expr = new Expression();
+		try {
+			expr->type = read_string(in);
+			expr->var_name = read_string(in);
+			expr->call_funcname = read_string(in);
+			expr->const_value = read_value(in);
+			expr->call_arguments = read_assignments(in);
+			boost::uint32_t count = read_u32(in);
+			expr->children.reserve(count);
+			for (boost::uint32_t i = 0; i < count; i++) {
+				expr->children.push_back(read_expression(in));
+			}
+		} catch (...) {
+			delete expr;
+			throw;
+		}
+		return expr;
+	}
+
+	void write_scope(std::ostream &out, const LocalScope &scope);
+	void read_scope(std::istream &in, LocalScope &scope);
+
+	void write_instantiation(std::ostream &out, const ModuleInstantiation *inst)
+	{
+		const IfElseModuleInstantiation *ifelse =
+			dynamic_cast<const IfElseModuleInstantiation *>(inst);
+		write_u8(out, ifelse ? 1 : 0);
+		write_string(out, inst->name());
+		write_string(out, inst->path());
+		write_u8(out, inst->isRoot() ? 1 : 0);
+		write_u8(out, inst->isHighlight() ? 1 : 0);
+		write_u8(out, inst->isBackground() ? 1 : 0);
+		write_assignments(out, inst->arguments);
+		write_scope(out, inst->scope);
+		if (ifelse) write_scope(out, ifelse->else_scope);
+	}
+
+	ModuleInstantiation *read_instantiation(std::istream &in)
+	{
+		bool has_else = read_u8(in) != 0;
+		std::string name = read_string(in);
+		IfElseModuleInstantiation *ifelse = NULL;
+		ModuleInstantiation *inst;
+		if (has_else) {
+			inst = ifelse = new IfElseModuleInstantiation();
+		} else {
+			inst = new ModuleInstantiation(name);
+		}
+		try {
+			inst->setPath(read_string(in));
+			inst->tag_root = read_u8(in) != 0;
+			inst->tag_highlight = read_u8(in) != 0;
+			inst->tag_background = read_u8(in) != 0;
+			inst->arguments = read_assignments(in);
+			read_scope(in, inst->scope);
+			if (ifelse) read_scope(in, ifelse->else_scope);
+		} catch (...) {
+			delete inst;
+			throw;
+		}
+		return inst;
+	}
+
+	void write_scope(std::ostream &out, const LocalScope &scope)
+	{
+		write_assignments(out, scope.assignments);
+
+		write_u32(out, scope.children.size());
+		BOOST_FOREACH(const ModuleInstantiation *inst, scope.children) {
+			write_instantiation(out, inst);
+		}
+
+		// Only user-defined functions and modules appear in parsed scopes;
+		// builtins live in their own global tables. Anything else means the
+		// format doesn't cover this AST, so the cache entry isn't written.
+		write_u32(out, scope.functions.size());
+		BOOST_FOREACH(const LocalScope::FunctionContainer::value_type &f, scope.functions) {
+			const Function *func = dynamic_cast<const Function *>(f.second);
+			if (!func) throw SerializeError();
+			write_string(out, f.first);
+			write_string(out, func->name);
+			write_assignments(out, func->definition_arguments);
+			write_expression(out, func->expr);
+		}
+
+		write_u32(out, scope.modules.size());
+		BOOST_FOREACH(const LocalScope::AbstractModuleContainer::value_type &m, scope.modules) {
+			const Module *mod = dynamic_cast<const Module *>(m.second);
+			if (!mod || dynamic_cast<const FileModule *>(mod)) throw SerializeError();
+			write_string(out, m.first);
+			write_assignments(out, mod->definition_arguments);
+			write_scope(out, mod->scope);
+		}
+	}
+
+	void read_scope(std::istream &in, LocalScope &scope)
+	{
+		scope.assignments = read_assignments(in);
+
+		boost::uint32_t count = read_u32(in);
+		for (boost::uint32_t i = 0; i < count; i++) {
+			scope.addChild(read_instantiation(in));
+		}
+
+		count = read_u32(in);
+		for (boost::uint32_t i = 0; i < count; i++) {
+			std::string mapname = read_string(in);
+			Function *func = new Function();
+			scope.functions[mapname] = func;
+			func->name = read_string(in);
+			func->definition_arguments = read_assignments(in);
+			func->expr = read_expression(in);
+		}
+
+		count = read_u32(in);
+		for (boost::uint32_t i = 0; i < count; i++) {
+			std::string mapname = read_string(in);
+			Module *mod = new Module();
+			scope.modules[mapname] = mod;
+			mod->definition_arguments = read_assignments(in);
+			read_scope(in, mod->scope);
+		}
+	}
+
+	std::string cache_file_path(const std::string &filename)
+	{
+		std::string dir = PlatformUtils::moduleCachePath();
+		if (dir.empty()) return "";
+		// Hash collisions are handled by storing the full filename in the
+		// header and verifying it on load.
+		std::stringstream name;
+		name << std::hex << boost::hash<std::string>()(filename) << ".ast";
+		return boosty::stringy(fs::path(dir) / name.str());
+	}
+}
+
+/*!
+	Loads the cached compiled form of \a filename, or returns NULL if
+	there is none or it is out of date in any way (source, includes or
+	commandline_commands changed, older format version, truncation).
+*/
+FileModule *ModuleSerializer::load(const std::string &filename, const std::string &cache_id)
+{
+	std::string path = cache_file_path(filename);
+	if (path.empty()) return NULL;
+	std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+	if (!in.is_open()) return NULL;
+
+	FileModule *module = NULL;
+	try {
+		if (read_u32(in) != SERIALIZER_MAGIC) return NULL;
+		if (read_u32(in) != SERIALIZER_VERSION) return NULL;
+		if (read_string(in) != filename) return NULL;
+		if (read_string(in) != cache_id) return NULL;
+		if (read_string(in) != commandline_commands) return NULL;
+
+		module = new FileModule();
+		module->setModulePath(read_string(in));
+
+		boost::uint32_t count = read_u32(in);
+		for (boost::uint32_t i = 0; i < count; i++) {
+			module->usedlibs.insert(read_string(in));
+		}
+
+		count = read_u32(in);
+		for (boost::uint32_t i = 0; i < count; i++) {
+			std::string localpath = read_string(in);
+			FileModule::IncludeFile inc;
+			inc.filename = read_string(in);
+			inc.valid = read_u8(in) != 0;
+			inc.mtime = read_i64(in);
+			module->includes[localpath] = inc;
+		}
+
+		module->definition_arguments = read_assignments(in);
+		read_scope(in, module->scope);
+	} catch (const SerializeError &) {
+		PRINTDB("Ignoring malformed module cache file %s", path);
+		delete module;
+		return NULL;
+	}
+
+	// Included files were inlined when the cached AST was parsed; any
+	// include modified since then invalidates it.
+	if (module->includesChanged()) {
+		delete module;
+		return NULL;
+	}
+	return module;
+}
+
+/*!
+	Writes the compiled form of \a filename. The file is staged under a
+	unique name and atomically renamed into place, so concurrent processes
+	never read a half-written entry. Returns false if nothing was written.
+*/
+bool ModuleSerializer::save(const FileModule *module, const std::string &filename, const std::string &cache_id)
+{
+	if (!module) return false;
+	if (!PlatformUtils::createModuleCachePath()) return false;
+	std::string path = cache_file_path(filename);
+	if (path.empty()) return false;
+
+	fs::path tmppath;
+	try {
+		tmppath = fs::unique_path(path + ".tmp-%%%%%%%%");
+	} catch (const fs::filesystem_error &) {
+		return false;
+	}
+
+	bool ok = false;
+	{
+		std::ofstream out(tmppath.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) return false;
+		try {
+			write_u32(out, SERIALIZER_MAGIC);
+			write_u32(out, SERIALIZER_VERSION);
+			write_string(out, filename);
+			write_string(out, cache_id);
+			write_string(out, commandline_commands);
+
+			write_string(out, module->modulePath());
+
+			write_u32(out, module->usedlibs.size());
+			BOOST_FOREACH(const std::string &lib, module->usedlibs) {
+				write_string(out, lib);
+			}
+
+			write_u32(out, module->includes.size());
+			BOOST_FOREACH(const FileModule::IncludeContainer::value_type &item, module->includes) {
+				write_string(out, item.first);
+				write_string(out, item.second.filename);
+				write_u8(out, item.second.valid ? 1 : 0);
+				write_i64(out, item.second.mtime);
+			}
+
+			write_assignments(out, module->definition_arguments);
+			write_scope(out, module->scope);
+			ok = out.good();
+		} catch (const SerializeError &) {
+			ok = false;
+		}
+	}
+
+	try {
+		if (ok) {
+			fs::rename(tmppath, fs::path(path));
+		} else {
+			fs::remove(tmppath);
+		}
+	} catch (const fs::filesystem_error &) {
+		ok = false;
+	}
+	return ok;
+}
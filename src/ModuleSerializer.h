@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+/*!
+	Binary on-disk form of a compiled FileModule, so repeated command line
+	runs can skip lexing and parsing of unchanged libraries entirely.
+
+	A cache file stores the source filename, its cache ID (mtime + size),
+	the commandline_commands it was parsed with and the mtimes of all
+	included files, followed by the serialized AST (scopes, assignments,
+	expressions, functions and modules). load() returns NULL unless every
+	one of these still matches, in which case the caller reparses and
+	overwrites the entry with save().
+*/
+class ModuleSerializer
+{
+public:
+	static class FileModule *load(const std::string &filename, const std::string &cache_id);
+	static bool save(const class FileModule *module, const std::string &filename, const std::string &cache_id);
+};
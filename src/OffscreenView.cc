@@ -6,17 +6,25 @@
 #include <cstdlib>
 #include <sstream>
 #include "printutils.h"
+#include "imageutils.h"
+#include <vector>
 
 OffscreenView::OffscreenView(size_t width, size_t height)
 {
   this->ctx = create_offscreen_context(width, height);
   if ( this->ctx == NULL ) throw -1;
+  this->pbos[0] = this->pbos[1] = 0;
+  this->pbo_pending[0] = this->pbo_pending[1] = false;
+  this->next_pbo = 0;
   GLView::initializeGL();
   GLView::resizeGL(width, height);
 }
 
 OffscreenView::~OffscreenView()
 {
+  for (int i = 0; i < 2; i++) {
+    if (this->pbos[i]) glDeleteBuffers(1, &this->pbos[i]);
+  }
   teardown_offscreen_context(this->ctx);
 }
 
@@ -37,6 +45,61 @@ bool OffscreenView::save(std::ostream &output)
   return save_framebuffer(this->ctx, output);
 }
 
+bool OffscreenView::capture(std::vector<unsigned char> &pixels) const
+{
+  const int samplesPerPixel = 4; // R, G, B and A
+  std::vector<unsigned char> raw(this->width * this->height * samplesPerPixel);
+  glReadPixels(0, 0, this->width, this->height, GL_RGBA, GL_UNSIGNED_BYTE, &raw[0]);
+  // Images read from OpenGL buffers are upside-down
+  pixels.resize(raw.size());
+  flip_image(&raw[0], &pixels[0], samplesPerPixel, this->width, this->height);
+  return true;
+}
+
+bool OffscreenView::captureAsync()
+{
+  if (!GLEW_VERSION_2_1 && !GLEW_ARB_pixel_buffer_object) return false;
+  if (this->pbo_pending[0] && this->pbo_pending[1]) return false; // retrieve first
+
+  const size_t slot = this->next_pbo;
+  if (!this->pbos[slot]) glGenBuffers(1, &this->pbos[slot]);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pbos[slot]);
+  glBufferData(GL_PIXEL_PACK_BUFFER, this->width * this->height * 4, NULL, GL_STREAM_READ);
+  // With a pack buffer bound this returns as soon as the transfer is
+  // queued; the GPU writes the pixels while the caller renders on
+  glReadPixels(0, 0, this->width, this->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  this->pbo_pending[slot] = true;
+  this->next_pbo = (slot + 1) % 2;
+  return true;
+}
+
+bool OffscreenView::retrieveCapture(std::vector<unsigned char> &pixels)
+{
+  // With both slots in flight the oldest is the one the next capture
+  // would overwrite; with one, it is the last slot captured into
+  size_t slot;
+  if (this->pbo_pending[this->next_pbo]) slot = this->next_pbo;
+  else if (this->pbo_pending[(this->next_pbo + 1) % 2]) slot = (this->next_pbo + 1) % 2;
+  else return false;
+
+  bool ok = false;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pbos[slot]);
+  const unsigned char *raw =
+    static_cast<const unsigned char *>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+  if (raw) {
+    const int samplesPerPixel = 4; // R, G, B and A
+    // Images read from OpenGL buffers are upside-down
+    pixels.resize(this->width * this->height * samplesPerPixel);
+    flip_image(raw, &pixels[0], samplesPerPixel, this->width, this->height);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    ok = true;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  this->pbo_pending[slot] = false;
+  return ok;
+}
+
 std::string OffscreenView::getRendererInfo() const
 {
   std::stringstream out;
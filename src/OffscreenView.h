@@ -4,6 +4,7 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <string>
+#include <vector>
 #ifndef _MSC_VER
 #include <stdint.h>
 #endif
@@ -17,6 +18,20 @@ public:
 	OffscreenView(size_t width, size_t height);
 	~OffscreenView();
 	bool save(std::ostream &output);
+	//! Reads back the framebuffer as top-down RGBA rows without encoding
+	//! it, so a worker thread can run the PNG compression
+	bool capture(std::vector<unsigned char> &pixels) const;
+	/*!
+		Starts an asynchronous readback of the framebuffer into a pixel
+		buffer object and returns without waiting for the GPU, so the next
+		frame can render while this one is still in flight. Up to two
+		readbacks ride in flight at a time. Returns false when PBOs are
+		unavailable; callers fall back to the synchronous capture().
+	*/
+	bool captureAsync();
+	//! Maps the oldest in-flight readback into pixels (top-down RGBA
+	//! rows, like capture()). Returns false when none is in flight.
+	bool retrieveCapture(std::vector<unsigned char> &pixels);
 	OffscreenContext *ctx;
 
 	// overrides
@@ -25,4 +40,10 @@ public:
 #ifdef ENABLE_OPENCSG
 	void display_opencsg_warning();
 #endif
+
+private:
+	//! Double-buffered readback state; see captureAsync()
+	unsigned int pbos[2];
+	bool pbo_pending[2];
+	size_t next_pbo;
 };
@@ -29,6 +29,8 @@
 #include "polyset.h"
 #include "csgterm.h"
 #include "stl-utils.h"
+#include "feature.h"
+#include <string.h>
 #ifdef ENABLE_OPENCSG
 #  include <opencsg.h>
 #endif
@@ -37,14 +39,15 @@ class OpenCSGPrim : public OpenCSG::Primitive
 {
 public:
 	OpenCSGPrim(OpenCSG::Operation operation, unsigned int convexity) :
-			OpenCSG::Primitive(operation, convexity) { }
-	shared_ptr<const Geometry> geom;
-	Transform3d m;
+			OpenCSG::Primitive(operation, convexity), renderer(NULL), obj(NULL) { }
+	const OpenCSGRenderer *renderer;
+	const CSGChainObject *obj;
+	shared_ptr<const Geometry> geom; // LOD level selected for this frame
 	Renderer::csgmode_e csgmode;
 	virtual void render() {
 		glPushMatrix();
-		glMultMatrixd(m.data());
-		Renderer::render_surface(geom, csgmode, m);
+		glMultMatrixd(obj->matrix.data());
+		renderer->renderCachedSurface(*obj, csgmode, geom);
 		glPopMatrix();
 	}
 };
@@ -54,10 +57,133 @@ OpenCSGRenderer::OpenCSGRenderer(CSGChain *root_chain, CSGChain *highlights_chai
 	: root_chain(root_chain), highlights_chain(highlights_chain), 
 		background_chain(background_chain), shaderinfo(shaderinfo)
 {
+	this->occlusion_view_valid = false;
+}
+
+OpenCSGRenderer::~OpenCSGRenderer()
+{
+	for (geomlist_cache_t::iterator it = this->geomlists.begin();it != this->geomlists.end();it++) {
+		glDeleteLists((*it).second, 1);
+	}
+	for (occlusion_cache_t::iterator it = this->occlusion.begin(); it != this->occlusion.end(); it++) {
+		if ((*it).second.query) glDeleteQueries(1, &(*it).second.query);
+	}
+}
+
+OpenCSGLists::~OpenCSGLists()
+{
+	for (size_t i = 0; i < this->lists.size(); i++) {
+		glDeleteLists(this->lists[i].id, 1);
+	}
+}
+
+/*!
+	Harvests the compiled display lists so they can outlive this
+	renderer. Must be called while the chains are still alive, since the
+	cache keys point into them; afterwards the renderer no longer owns
+	any lists.
+*/
+OpenCSGLists *OpenCSGRenderer::retainLists()
+{
+	// Map each chain object back to what a list needs for re-matching
+	std::map<const void *, const CSGChainObject *> objs;
+	CSGChain *chains[3] = { this->root_chain, this->highlights_chain, this->background_chain };
+	for (int c = 0; c < 3; c++) {
+		if (!chains[c]) continue;
+		for (size_t i = 0; i < chains[c]->objects.size(); i++) {
+			objs[&chains[c]->objects[i]] = &chains[c]->objects[i];
+		}
+	}
+
+	OpenCSGLists *retained = new OpenCSGLists;
+	for (geomlist_cache_t::iterator it = this->geomlists.begin(); it != this->geomlists.end(); it++) {
+		std::map<const void *, const CSGChainObject *>::iterator objit = objs.find((*it).first.first.first);
+		if (objit == objs.end()) {
+			glDeleteLists((*it).second, 1);
+			continue;
+		}
+		OpenCSGLists::RetainedList entry;
+		entry.geom = (*objit).second->geom;
+		entry.matrix = (*objit).second->matrix;
+		entry.drawn = (*it).first.first.second;
+		entry.csgmode = (*it).first.second;
+		entry.id = (*it).second;
+		retained->lists.push_back(entry);
+	}
+	this->geomlists.clear();
+	return retained;
+}
+
+/*!
+	Diffs the retained lists against this renderer's chains by shared
+	geometry identity and transform and re-attaches every match, so an
+	incremental edit recompiles display lists only for the products it
+	actually changed. Unchanged subtrees keep their geometry objects
+	through GeometryCache, which is what makes pointer identity work as
+	the diff key. Whatever isn't matched is freed.
+*/
+void OpenCSGRenderer::adoptLists(OpenCSGLists *retained)
+{
+	typedef std::multimap<const void *, OpenCSGLists::RetainedList> bygeom_t;
+	bygeom_t bygeom;
+	for (size_t i = 0; i < retained->lists.size(); i++) {
+		bygeom.insert(std::make_pair(retained->lists[i].geom.get(), retained->lists[i]));
+	}
+	retained->lists.clear();
+
+	CSGChain *chains[3] = { this->root_chain, this->highlights_chain, this->background_chain };
+	for (int c = 0; c < 3; c++) {
+		if (!chains[c]) continue;
+		for (size_t i = 0; i < chains[c]->objects.size(); i++) {
+			const CSGChainObject &obj = chains[c]->objects[i];
+			std::pair<bygeom_t::iterator, bygeom_t::iterator> range = bygeom.equal_range(obj.geom.get());
+			for (bygeom_t::iterator it = range.first; it != range.second;) {
+				const OpenCSGLists::RetainedList &entry = (*it).second;
+				if (memcmp(entry.matrix.data(), obj.matrix.data(), 16*sizeof(double)) == 0) {
+					geomlist_cache_t::key_type key(std::make_pair((const void *)&obj, entry.drawn), entry.csgmode);
+					this->geomlists[key] = entry.id;
+					bygeom.erase(it++);
+				}
+				else ++it;
+			}
+		}
+	}
+
+	for (bygeom_t::iterator it = bygeom.begin(); it != bygeom.end(); it++) {
+		glDeleteLists((*it).second.id, 1);
+	}
+}
+
+/*!
+	Issues the geometry of one chain object, compiling it into a display
+	list on first use so subsequent frames replay the compiled geometry
+	instead of re-tessellating and re-submitting every vertex. Only used
+	for the fixed-function paths; the edge shader path takes per-frame
+	uniforms and must not be baked into a list.
+*/
+void OpenCSGRenderer::renderCachedSurface(const CSGChainObject &obj, csgmode_e csgmode,
+																					const shared_ptr<const Geometry> &geom) const
+{
+	geomlist_cache_t::key_type key(std::make_pair(&obj, (const void *)geom.get()), csgmode);
+	geomlist_cache_t::iterator it = this->geomlists.find(key);
+	if (it != this->geomlists.end()) {
+		glCallList((*it).second);
+		return;
+	}
+
+	GLuint id = glGenLists(1);
+	if (id) glNewList(id, GL_COMPILE_AND_EXECUTE);
+	render_surface(geom, csgmode, obj.matrix);
+	if (id) {
+		glEndList();
+		this->geomlists[key] = id;
+	}
 }
 
 void OpenCSGRenderer::draw(bool /*showfaces*/, bool showedges) const
 {
+	this->drawstats = DrawStatistics();
+	resetColorState();
 	if (this->root_chain) {
 		GLint *shaderinfo = this->shaderinfo;
 		if (!shaderinfo[0]) shaderinfo = NULL;
@@ -71,79 +197,258 @@ void OpenCSGRenderer::draw(bool /*showfaces*/, bool showedges) const
 	}
 }
 
-void OpenCSGRenderer::renderCSGChain(CSGChain *chain, GLint *shaderinfo, 
+namespace {
+	// One shaded chain object with its resolved state; see the grouping
+	// pass in renderCSGChain()
+	struct ShadeEntry {
+		size_t index;
+		Renderer::csgmode_e csgmode;
+		Renderer::ColorMode colormode;
+		unsigned long long sortkey;
+	};
+
+	bool shade_entry_less(const ShadeEntry &a, const ShadeEntry &b)
+	{
+		return a.sortkey < b.sortkey;
+	}
+
+	// Issues the six faces of a bounding box; only used inside occlusion
+	// queries, so winding and normals don't matter
+	void render_bbox(const BoundingBox &bbox)
+	{
+		double x1 = bbox.min()[0], y1 = bbox.min()[1], z1 = bbox.min()[2];
+		double x2 = bbox.max()[0], y2 = bbox.max()[1], z2 = bbox.max()[2];
+		glBegin(GL_QUADS);
+		glVertex3d(x1,y1,z1); glVertex3d(x2,y1,z1); glVertex3d(x2,y2,z1); glVertex3d(x1,y2,z1);
+		glVertex3d(x1,y1,z2); glVertex3d(x2,y1,z2); glVertex3d(x2,y2,z2); glVertex3d(x1,y2,z2);
+		glVertex3d(x1,y1,z1); glVertex3d(x2,y1,z1); glVertex3d(x2,y1,z2); glVertex3d(x1,y1,z2);
+		glVertex3d(x1,y2,z1); glVertex3d(x2,y2,z1); glVertex3d(x2,y2,z2); glVertex3d(x1,y2,z2);
+		glVertex3d(x1,y1,z1); glVertex3d(x1,y2,z1); glVertex3d(x1,y2,z2); glVertex3d(x1,y1,z2);
+		glVertex3d(x2,y1,z1); glVertex3d(x2,y2,z1); glVertex3d(x2,y2,z2); glVertex3d(x2,y1,z2);
+		glEnd();
+	}
+}
+
+void OpenCSGRenderer::renderCSGChain(CSGChain *chain, GLint *shaderinfo,
 																		 bool highlight, bool background) const
 {
-	std::vector<OpenCSG::Primitive*> primitives;
-	size_t j = 0;
-	for (size_t i = 0;; i++) {
-		bool last = i == chain->objects.size();
-		const CSGChainObject &i_obj = last ? chain->objects[i-1] : chain->objects[i];
-		if (last || i_obj.type == CSGTerm::TYPE_UNION) {
-			if (j+1 != i) {
-				 OpenCSG::render(primitives);
-				glDepthFunc(GL_EQUAL);
+	// Cull whole union products against the view frustum. The visible
+	// result of a product is contained in the bounding box of its first
+	// (unioned) object - intersections and differences only shrink it -
+	// so if that box is off-screen the entire product is.
+	// Unloaded projection measures everything as infinitely large, so
+	// selectLOD() then always keeps the full-detail geometry
+	ScreenProjection screenproj;
+	if (Feature::ExperimentalLodPreview.is_enabled()) screenproj.load();
+
+	std::vector<bool> culled(chain->objects.size(), false);
+	if (Feature::ExperimentalFrustumCulling.is_enabled()) {
+		Frustum frustum;
+		frustum.load();
+		bool cull = false;
+		for (size_t i = 0; i < chain->objects.size(); i++) {
+			const CSGChainObject &obj = chain->objects[i];
+			if (i == 0 || obj.type == CSGTerm::TYPE_UNION) {
+				cull = !frustum.intersects(obj.getBoundingBox());
 			}
-			if (shaderinfo) glUseProgram(shaderinfo[0]);
-			for (; j < i; j++) {
-				const CSGChainObject &j_obj = chain->objects[j];
-				const Color4f &c = j_obj.color;
-				glPushMatrix();
-				glMultMatrixd(j_obj.matrix.data());
-				csgmode_e csgmode = j_obj.type == CSGTerm::TYPE_DIFFERENCE ? CSGMODE_DIFFERENCE : CSGMODE_NORMAL;
-				ColorMode colormode = COLORMODE_NONE;
-				if (background) {
-					if (j_obj.flag & CSGTerm::FLAG_HIGHLIGHT) {
-						colormode = COLORMODE_HIGHLIGHT;
-					}
-					else {
-						colormode = COLORMODE_BACKGROUND;
-					}
-					csgmode = csgmode_e(csgmode + 10);
-				} else if (j_obj.type == CSGTerm::TYPE_DIFFERENCE) {
-					if (j_obj.flag & CSGTerm::FLAG_HIGHLIGHT) {
-						colormode = COLORMODE_HIGHLIGHT;
-						csgmode = csgmode_e(csgmode + 20);
-					}
-					else {
-						colormode = COLORMODE_CUTOUT;
-					}
-				} else {
-					if (j_obj.flag & CSGTerm::FLAG_HIGHLIGHT) {
-						colormode = COLORMODE_HIGHLIGHT;
-						csgmode = csgmode_e(csgmode + 20);
-					 }
-					else {
-						colormode = COLORMODE_MATERIAL;
-					}
-				}
+			culled[i] = cull;
+		}
+	}
 
-				setColor(colormode, c.data(), shaderinfo);
+	// Split the chain into its union products: a product starts at the
+	// first object and at every TYPE_UNION object after it
+	std::vector<std::pair<size_t, size_t> > products; // [begin, end)
+	size_t begin = 0;
+	for (size_t i = 1; i <= chain->objects.size(); i++) {
+		if (i == chain->objects.size() || chain->objects[i].type == CSGTerm::TYPE_UNION) {
+			products.push_back(std::make_pair(begin, i));
+			begin = i;
+		}
+	}
 
-				render_surface(j_obj.geom, csgmode, j_obj.matrix, shaderinfo);
-				glPopMatrix();
+	// Submit opaque products front-to-back so early depth rejection
+	// kills the fragments of occluded products before they're shaded;
+	// dense scenes are fill-bound and most fragments lose the depth
+	// test. The depth key is the eye-space z of the bounding-box
+	// centroid of the product's first (unioned) object, read against the
+	// current modelview like Frustum::load() reads the frusta. The
+	// sort is stable so equally-deep products keep chain order.
+	// Background products are drawn transparent, so their order is left
+	// alone rather than front-to-back (the worst order for blending).
+	if (!background && products.size() > 1) {
+		GLdouble mv[16];
+		glGetDoublev(GL_MODELVIEW_MATRIX, mv);
+		std::vector<std::pair<double, std::pair<size_t, size_t> > > sorted;
+		sorted.reserve(products.size());
+		for (size_t p = 0; p < products.size(); p++) {
+			Vector3d c = chain->objects[products[p].first].getBoundingBox().center();
+			double depth = -(mv[2]*c[0] + mv[6]*c[1] + mv[10]*c[2] + mv[14]);
+			sorted.push_back(std::make_pair(depth, products[p]));
+		}
+		std::stable_sort(sorted.begin(), sorted.end());
+		for (size_t p = 0; p < sorted.size(); p++) products[p] = sorted[p].second;
+	}
+
+	// Cull products that passed no depth samples last frame. Whole
+	// products, not single objects: an object of a product may be
+	// invisible in the composed result yet still needed to compose it.
+	// The bounding box of each product's first (unioned) object is
+	// rendered into an occlusion query after the frame is composed below,
+	// and the result is harvested here, a frame later, so the CPU never
+	// waits on the GPU. A product is only skipped while the view matrices
+	// are unchanged since its query was issued - any camera movement
+	// conservatively redraws everything - and a hidden product keeps
+	// getting its cheap box query every frame, so it reappears one frame
+	// after becoming visible. Only the opaque main chain participates:
+	// background products blend and highlights must stay visible.
+	bool use_occlusion = Feature::ExperimentalOcclusionCulling.is_enabled() &&
+		!highlight && !background && GLEW_VERSION_1_5;
+	bool view_static = false;
+	if (use_occlusion) {
+		double view[32];
+		glGetDoublev(GL_PROJECTION_MATRIX, view);
+		glGetDoublev(GL_MODELVIEW_MATRIX, view + 16);
+		view_static = this->occlusion_view_valid &&
+			memcmp(view, this->occlusion_view, sizeof(view)) == 0;
+		memcpy(this->occlusion_view, view, sizeof(view));
+		this->occlusion_view_valid = true;
+	}
+
+	for (size_t p = 0; p < products.size(); p++) {
+		size_t prod_begin = products[p].first;
+		size_t prod_end = products[p].second;
+
+		if (use_occlusion) {
+			ProductOcclusion &state = this->occlusion[&chain->objects[prod_begin]];
+			if (state.query_pending) {
+				GLuint available = 0;
+				glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+				if (available) {
+					GLuint samples = 0;
+					glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &samples);
+					state.hidden = samples == 0;
+					state.query_pending = false;
+				}
 			}
-			if (shaderinfo) glUseProgram(0);
-			for (unsigned int k = 0; k < primitives.size(); k++) {
-				delete primitives[k];
+			if (view_static && state.hidden) {
+				this->drawstats.occluded_products++;
+				continue;
 			}
-			glDepthFunc(GL_LEQUAL);
-			primitives.clear();
 		}
 
-		if (last) break;
-
-		if (i_obj.geom) {
+		std::vector<OpenCSG::Primitive*> primitives;
+		for (size_t i = prod_begin; i < prod_end; i++) {
+			const CSGChainObject &i_obj = chain->objects[i];
+			if (!i_obj.geom || culled[i]) continue;
 			OpenCSGPrim *prim = new OpenCSGPrim(i_obj.type == CSGTerm::TYPE_DIFFERENCE ?
 																					OpenCSG::Subtraction : OpenCSG::Intersection, i_obj.geom->getConvexity());
-			
-			prim->geom = i_obj.geom;
-			prim->m = i_obj.matrix;
+
+			prim->renderer = this;
+			prim->obj = &i_obj;
+			prim->geom = selectLOD(i_obj.geom, screenproj.diameter(i_obj.getBoundingBox()));
 			prim->csgmode = i_obj.type == CSGTerm::TYPE_DIFFERENCE ? CSGMODE_DIFFERENCE : CSGMODE_NORMAL;
 			if (highlight) prim->csgmode = csgmode_e(prim->csgmode + 20);
 			else if (background) prim->csgmode = csgmode_e(prim->csgmode + 10);
 			primitives.push_back(prim);
 		}
+
+		if (prod_end - prod_begin > 1 && !primitives.empty()) {
+			OpenCSG::render(primitives);
+			glDepthFunc(GL_EQUAL);
+			this->drawstats.opencsg_passes++;
+		}
+		if (shaderinfo) glUseProgram(shaderinfo[0]);
+
+		// Resolve the shading state of the product's objects first and
+		// submit them grouped by it. The product was depth-composited
+		// above and shades under GL_EQUAL, so the order within it is
+		// free; grouping turns repeated colors into setColor() no-ops.
+		// Background products blend and keep chain order.
+		std::vector<ShadeEntry> shades;
+		shades.reserve(prod_end - prod_begin);
+		for (size_t j = prod_begin; j < prod_end; j++) {
+			const CSGChainObject &j_obj = chain->objects[j];
+			if (culled[j]) continue;
+			ShadeEntry e;
+			e.index = j;
+			e.csgmode = j_obj.type == CSGTerm::TYPE_DIFFERENCE ? CSGMODE_DIFFERENCE : CSGMODE_NORMAL;
+			e.colormode = COLORMODE_NONE;
+			if (background) {
+				if (j_obj.flag & CSGTerm::FLAG_HIGHLIGHT) {
+					e.colormode = COLORMODE_HIGHLIGHT;
+				}
+				else {
+					e.colormode = COLORMODE_BACKGROUND;
+				}
+				e.csgmode = csgmode_e(e.csgmode + 10);
+			} else if (j_obj.type == CSGTerm::TYPE_DIFFERENCE) {
+				if (j_obj.flag & CSGTerm::FLAG_HIGHLIGHT) {
+					e.colormode = COLORMODE_HIGHLIGHT;
+					e.csgmode = csgmode_e(e.csgmode + 20);
+				}
+				else {
+					e.colormode = COLORMODE_CUTOUT;
+				}
+			} else {
+				if (j_obj.flag & CSGTerm::FLAG_HIGHLIGHT) {
+					e.colormode = COLORMODE_HIGHLIGHT;
+					e.csgmode = csgmode_e(e.csgmode + 20);
+				 }
+				else {
+					e.colormode = COLORMODE_MATERIAL;
+				}
+			}
+			unsigned rgba = 0;
+			for (int comp = 0; comp < 4; comp++) {
+				float v = j_obj.color[comp] < 0 ? 1.0f : j_obj.color[comp];
+				rgba = (rgba << 8) | (unsigned)(v * 255.0f + 0.5f);
+			}
+			e.sortkey = ((unsigned long long)e.colormode << 40) |
+									((unsigned long long)e.csgmode << 32) | rgba;
+			shades.push_back(e);
+		}
+		if (!background && shades.size() > 1) {
+			std::stable_sort(shades.begin(), shades.end(), shade_entry_less);
+		}
+
+		for (size_t k = 0; k < shades.size(); k++) {
+			const ShadeEntry &e = shades[k];
+			const CSGChainObject &j_obj = chain->objects[e.index];
+			glPushMatrix();
+			glMultMatrixd(j_obj.matrix.data());
+
+			setColor(e.colormode, j_obj.color.data(), shaderinfo);
+
+			shared_ptr<const Geometry> geom =
+				selectLOD(j_obj.geom, screenproj.diameter(j_obj.getBoundingBox()));
+			if (shaderinfo) render_surface(geom, e.csgmode, j_obj.matrix, shaderinfo);
+			else renderCachedSurface(j_obj, e.csgmode, geom);
+			this->drawstats.drawcalls++;
+			this->drawstats.triangles += countTriangles(geom);
+			glPopMatrix();
+		}
+		if (shaderinfo) glUseProgram(0);
+		std::for_each(primitives.begin(), primitives.end(), del_fun<OpenCSG::Primitive>());
+		glDepthFunc(GL_LEQUAL);
+	}
+
+	// Issue the box queries against the depth buffer just composed.
+	// Visible products test their own surfaces, whose box fronts pass
+	// under GL_LEQUAL, so they can only go hidden behind other geometry.
+	if (use_occlusion) {
+		glDepthMask(GL_FALSE);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		for (size_t p = 0; p < products.size(); p++) {
+			ProductOcclusion &state = this->occlusion[&chain->objects[products[p].first]];
+			if (state.query_pending) continue; // last frame's result not in yet
+			if (!state.query) glGenQueries(1, &state.query);
+			if (!state.query) continue;
+			glBeginQuery(GL_SAMPLES_PASSED, state.query);
+			render_bbox(chain->objects[products[p].first].getBoundingBox());
+			glEndQuery(GL_SAMPLES_PASSED);
+			state.query_pending = true;
+		}
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_TRUE);
 	}
-	std::for_each(primitives.begin(), primitives.end(), del_fun<OpenCSG::Primitive>());
 }
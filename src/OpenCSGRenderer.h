@@ -2,16 +2,74 @@
 
 #include "renderer.h"
 #include "system-gl.h"
+#include <map>
+#include <utility>
+#include <vector>
+
+/*!
+	Display lists harvested from a renderer that is about to be torn
+	down, waiting to be re-attached to its successor. Owns the GL list
+	ids; whatever has not been adopted when this is destroyed is freed.
+*/
+class OpenCSGLists
+{
+public:
+	~OpenCSGLists();
+
+	struct RetainedList {
+		shared_ptr<const class Geometry> geom; // keeps the drawn LOD level alive
+		Transform3d matrix;
+		const void *drawn; // LOD level the list was compiled from
+		int csgmode;
+		GLuint id;
+	};
+	std::vector<RetainedList> lists;
+};
 
 class OpenCSGRenderer : public Renderer
 {
 public:
-	OpenCSGRenderer(class CSGChain *root_chain, CSGChain *highlights_chain, 
+	OpenCSGRenderer(class CSGChain *root_chain, CSGChain *highlights_chain,
 									CSGChain *background_chain, GLint *shaderinfo);
+	virtual ~OpenCSGRenderer();
 	void draw(bool showfaces, bool showedges) const;
+
+	//! Harvests the compiled display lists before the chains are deleted
+	OpenCSGLists *retainLists();
+	//! Re-attaches retained lists to matching objects in this renderer's chains
+	void adoptLists(OpenCSGLists *retained);
 private:
-	void renderCSGChain(class CSGChain *chain, GLint *shaderinfo, 
+	void renderCSGChain(class CSGChain *chain, GLint *shaderinfo,
 											bool highlight, bool background) const;
+	void renderCachedSurface(const class CSGChainObject &obj, csgmode_e csgmode,
+													 const shared_ptr<const class Geometry> &geom) const;
+
+	friend class OpenCSGPrim;
+
+	// Geometry submissions compiled into display lists, keyed by chain
+	// object, the geometry actually drawn (which varies per frame under
+	// lod-preview) and csgmode. The renderer is rebuilt together with
+	// its chains, so the cache never outlives the geometry it refers to.
+	typedef std::map<std::pair<std::pair<const void *, const void *>, int>, GLuint> geomlist_cache_t;
+	mutable geomlist_cache_t geomlists;
+
+	// Occlusion-query culling state per union product, keyed by the
+	// product's first chain object (see occlusion-culling in
+	// renderCSGChain()). Queries are issued on the product bounding box
+	// after a frame is composed and harvested the next frame, so no
+	// frame ever waits on the GPU.
+	struct ProductOcclusion {
+		ProductOcclusion() : query(0), query_pending(false), hidden(false) {}
+		GLuint query;
+		bool query_pending;
+		bool hidden;
+	};
+	typedef std::map<const void *, ProductOcclusion> occlusion_cache_t;
+	mutable occlusion_cache_t occlusion;
+	// Projection and modelview the pending queries were issued under;
+	// hidden results are only trusted while the view still matches
+	mutable double occlusion_view[32];
+	mutable bool occlusion_view_valid;
 
 	CSGChain *root_chain;
 	CSGChain *highlights_chain;
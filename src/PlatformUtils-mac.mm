@@ -10,3 +10,15 @@ std::string PlatformUtils::documentsPath()
 {
   return std::string([[NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) lastObject] UTF8String]);
 }
+
+#include <mach/mach.h>
+
+size_t PlatformUtils::residentMemory()
+{
+	struct task_basic_info info;
+	mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS) {
+		return info.resident_size;
+	}
+	return 0;
+}
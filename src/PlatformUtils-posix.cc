@@ -1,6 +1,10 @@
 #include "PlatformUtils.h"
 #include "boosty.h"
 
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
 std::string PlatformUtils::pathSeparatorChar()
 {
 	return ":";
@@ -18,3 +22,20 @@ std::string PlatformUtils::documentsPath()
 		return "";
 	}
 }
+
+size_t PlatformUtils::residentMemory()
+{
+#if defined(__linux__)
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f) {
+		unsigned long size = 0, resident = 0;
+		int fields = fscanf(f, "%lu %lu", &size, &resident);
+		fclose(f);
+		if (fields == 2) return resident * (size_t)sysconf(_SC_PAGESIZE);
+	}
+#endif
+	// BSDs: no statm; the peak from getrusage still locates watermarks
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) return (size_t)usage.ru_maxrss * 1024;
+	return 0;
+}
@@ -73,3 +73,14 @@ std::string PlatformUtils::documentsPath()
 	}
 	return retval;
 }
+
+#include <psapi.h>
+
+size_t PlatformUtils::residentMemory()
+{
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return pmc.WorkingSetSize;
+	}
+	return 0;
+}
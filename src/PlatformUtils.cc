@@ -61,6 +61,40 @@ std::string PlatformUtils::backupPath()
 	return boosty::stringy( path );
 }
 
+std::string PlatformUtils::moduleCachePath()
+{
+	fs::path path;
+	try {
+		std::string pathstr = PlatformUtils::documentsPath();
+		if (pathstr=="") return "";
+		path = boosty::canonical(fs::path( pathstr ));
+		if (path.empty()) return "";
+		path /= "OpenSCAD";
+		path /= "cache";
+	} catch (const fs::filesystem_error& ex) {
+		PRINTB("ERROR: %s",ex.what());
+	}
+	return boosty::stringy( path );
+}
+
+bool PlatformUtils::createModuleCachePath()
+{
+	std::string path = PlatformUtils::moduleCachePath();
+	if (path.empty()) return false;
+	bool OK = false;
+	try {
+		if (!fs::exists(fs::path(path))) {
+			OK = fs::create_directories( path );
+		}
+		else {
+			OK = true;
+		}
+	} catch (const fs::filesystem_error& ex) {
+		PRINTB("ERROR: %s",ex.what());
+	}
+	return OK;
+}
+
 bool PlatformUtils::createBackupPath()
 {
 	std::string path = PlatformUtils::backupPath();
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 namespace PlatformUtils {
@@ -9,8 +10,17 @@ namespace PlatformUtils {
 	bool createLibraryPath();
 	std::string backupPath();
 	bool createBackupPath();
+	std::string moduleCachePath();
+	bool createModuleCachePath();
 	std::string info();
-        
+
+	/**
+	 * The process' current resident set size in bytes, or the peak
+	 * when the platform only reports that; 0 when unavailable.
+	 * Used by the --profile-mem telemetry.
+	 */
+	size_t residentMemory();
+
         /**
          * Single character separating path specifications in a list
          * (e.g. OPENSCADPATH). On Windows that's ';' and on most other
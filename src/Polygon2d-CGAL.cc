@@ -137,3 +137,15 @@ PolySet *Polygon2d::tessellate() const
 	}
 	return polyset;
 }
+
+/*!
+	Memoized variant of tessellate() for read-only consumers. The
+	triangulation is kept on the polygon until its outlines change, so
+	preview recompiles and double consumers like linear_extrude
+	triangulate each 2D shape only once.
+*/
+shared_ptr<const PolySet> Polygon2d::tessellated() const
+{
+	if (!this->cached_polyset) this->cached_polyset.reset(this->tessellate());
+	return this->cached_polyset;
+}
@@ -1,6 +1,8 @@
 #include "Polygon2d.h"
 #include "printutils.h"
 #include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/uuid/sha1.hpp>
 
 /*!
 	Class for holding 2D geometry.
@@ -24,7 +26,7 @@ size_t Polygon2d::memsize() const
 	return mem;
 }
 
-BoundingBox Polygon2d::getBoundingBox() const
+BoundingBox Polygon2d::computeBoundingBox() const
 {
 	BoundingBox bbox;
 	BOOST_FOREACH(const Outline2d &o, this->outlines()) {
@@ -35,6 +37,28 @@ BoundingBox Polygon2d::getBoundingBox() const
 	return bbox;
 }
 
+/*!
+	SHA1 over the outline vertices and winding flags; see
+	Geometry::contentHash().
+*/
+std::string Polygon2d::contentHash() const
+{
+	boost::uuids::detail::sha1 sha;
+	sha.process_bytes(&this->convexity, sizeof(this->convexity));
+	sha.process_bytes(&this->sanitized, sizeof(this->sanitized));
+	BOOST_FOREACH(const Outline2d &o, this->theoutlines) {
+		size_t n = o.vertices.size();
+		sha.process_bytes(&n, sizeof(n));
+		sha.process_bytes(&o.positive, sizeof(o.positive));
+		if (n) sha.process_bytes(&o.vertices[0], n * sizeof(Vector2d));
+	}
+	unsigned int digest[5];
+	sha.get_digest(digest);
+	std::string hash = "p2d-";
+	for (int i=0;i<5;i++) hash += str(boost::format("%08x") % digest[i]);
+	return hash;
+}
+
 std::string Polygon2d::dump() const
 {
 	std::stringstream out;
@@ -55,11 +79,18 @@ bool Polygon2d::isEmpty() const
 
 void Polygon2d::transform(const Transform2d &mat)
 {
+	this->clipper_cache.reset();
+	this->cached_polyset.reset();
+	this->invalidateBoundingBox();
 	if (mat.matrix().determinant() == 0) {
 		PRINT("Warning: Scaling a 2D object with 0 - removing object");
 		this->theoutlines.clear();
 		return;
 	}
+	// Mirroring reverses the winding that "sanitized" vouches for, so
+	// such polygons go back through cleanup before the next boolean;
+	// orientation-preserving transforms keep the guarantee
+	if (mat.matrix().determinant() < 0) this->sanitized = false;
 	BOOST_FOREACH(Outline2d &o, this->theoutlines) {
 		BOOST_FOREACH(Vector2d &v, o.vertices) {
 			v = mat * v;
@@ -92,3 +123,38 @@ void Polygon2d::resize(Vector2d newsize, const Eigen::Matrix<bool,2,1> &autosize
 	this->transform(t);
 }
 
+
+/*!
+	Upper bound on the depth complexity of an extrusion of this polygon,
+	in OpenCSG's convexity terms: the largest number of front-facing
+	surfaces a ray can see. A convex outline contributes one layer;
+	every two reflex vertices can fold the boundary into at most one
+	more layer, and each hole can split a crossing in two. The bound is
+	meant to replace cargo-culted convexity=10 on convex or nearly
+	convex parts, where every extra unit is a wasted Goldfeather pass.
+*/
+int Polygon2d::estimatedConvexity() const
+{
+	int convexity = 0;
+	int reflex = 0;
+	int holes = 0;
+	BOOST_FOREACH(const Outline2d &o, this->theoutlines) {
+		if (!o.positive) {
+			holes++;
+			continue;
+		}
+		convexity++;
+		size_t n = o.vertices.size();
+		if (n < 4) continue; // a triangle can't be reflex
+		for (size_t i = 0; i < n; i++) {
+			const Vector2d &prev = o.vertices[(i + n - 1) % n];
+			const Vector2d &cur = o.vertices[i];
+			const Vector2d &next = o.vertices[(i + 1) % n];
+			Vector2d d1 = cur - prev;
+			Vector2d d2 = next - cur;
+			if (d1[0]*d2[1] - d1[1]*d2[0] < 0) reflex++;
+		}
+	}
+	convexity += reflex / 2 + holes;
+	return convexity > 0 ? convexity : 1;
+}
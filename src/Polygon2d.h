@@ -15,23 +15,54 @@ class Polygon2d : public Geometry
 public:
 	Polygon2d() : sanitized(false) {}
 	virtual size_t memsize() const;
-	virtual BoundingBox getBoundingBox() const;
+	virtual BoundingBox computeBoundingBox() const;
 	virtual std::string dump() const;
+	virtual std::string contentHash() const;
 	virtual unsigned int getDimension() const { return 2; }
 	virtual bool isEmpty() const;
+	virtual Polygon2d *copy() const { return new Polygon2d(*this); }
 
-	void addOutline(const Outline2d &outline) { this->theoutlines.push_back(outline); }
+	void addOutline(const Outline2d &outline) {
+		this->clipper_cache.reset();
+		this->cached_polyset.reset();
+		this->invalidateBoundingBox();
+		// A hand-added outline voids any cleanliness guarantee; builders
+		// producing sanitized output re-set the flag when they're done
+		this->sanitized = false;
+		this->theoutlines.push_back(outline);
+	}
 	class PolySet *tessellate() const;
+	shared_ptr<const class PolySet> tessellated() const;
 
 	typedef std::vector<Outline2d> Outlines2d;
 	const Outlines2d &outlines() const { return theoutlines; }
 
+	int estimatedConvexity() const;
+
 	void transform(const Transform2d &mat);
 	void resize(Vector2d newsize, const Eigen::Matrix<bool,2,1> &autosize);
 
 	bool isSanitized() const { return this->sanitized; }
-	void setSanitized(bool s) { this->sanitized = s; }
+	// The cached Clipper paths encode the sanitized flag (orientation
+	// handling differs), so flipping it drops them too
+	void setSanitized(bool s) {
+		if (s != this->sanitized) this->clipper_cache.reset();
+		this->sanitized = s;
+	}
+
+	const shared_ptr<const class CachedClipperPaths> &clipperCache() const { return clipper_cache; }
+	void setClipperCache(const shared_ptr<const class CachedClipperPaths> &cache) const {
+		this->clipper_cache = cache;
+	}
 private:
 	Outlines2d theoutlines;
 	bool sanitized;
+	// Memoized integer-space representation, attached by
+	// ClipperUtils::fromPolygon2d() and toPolygon2d() so a polygon
+	// participating in many 2D booleans is scaled only once; dropped by
+	// every mutation
+	mutable shared_ptr<const class CachedClipperPaths> clipper_cache;
+	// Memoized result of tessellated(); triangulation runs a full CGAL
+	// constrained Delaunay pass, so it is kept until the outlines change
+	mutable shared_ptr<const class PolySet> cached_polyset;
 };
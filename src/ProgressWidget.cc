@@ -46,3 +46,24 @@ int ProgressWidget::value() const
 {
 	return this->progressBar->value();
 }
+
+/*!
+	Shows the predicted time remaining inside the bar. Negative means no
+	estimate is available (typically the very first run, before any
+	per-node cost history exists) and leaves the plain percent format.
+*/
+void ProgressWidget::setEta(int seconds)
+{
+	if (seconds < 0) return;
+	QString eta;
+	if (seconds >= 3600) {
+		eta = QString("%1h%2m").arg(seconds / 3600).arg((seconds % 3600) / 60);
+	}
+	else if (seconds >= 60) {
+		eta = QString("%1m%2s").arg(seconds / 60).arg(seconds % 60);
+	}
+	else {
+		eta = QString("%1s").arg(seconds);
+	}
+	this->progressBar->setFormat(QString("%p% (about ") + eta + " left)");
+}
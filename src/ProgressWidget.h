@@ -16,6 +16,7 @@ public:
 public slots:
 	void setRange(int minimum, int maximum);
 	void setValue(int progress);
+	void setEta(int seconds);
 	int value() const;
 	void cancel();
 
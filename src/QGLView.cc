@@ -27,6 +27,10 @@
 #include "QGLView.h"
 #include "Preferences.h"
 #include "renderer.h"
+#include "GeometryCache.h"
+#ifdef ENABLE_CGAL
+#include "CGALCache.h"
+#endif
 
 #include <QApplication>
 #include <QWheelEvent>
@@ -44,6 +48,7 @@
 
 #include "mathc99.h"
 #include <stdio.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #ifdef ENABLE_OPENCSG
 #  include <opencsg.h>
@@ -68,6 +73,8 @@ void QGLView::init()
 
   this->mouse_drag_active = false;
   this->statusLabel = NULL;
+  this->update_pending = false;
+  this->interaction_renderer = NULL;
 
   setMouseTracking(true);
 
@@ -144,6 +151,27 @@ void QGLView::display_opencsg_warning_dialog()
 }
 #endif
 
+/*!
+	Coalesces camera-driven redraws: a burst of mouse events queues at
+	most one repaint per display frame instead of one per event, so
+	orbiting a heavy scene doesn't flood the GUI thread with redundant
+	full redraws.
+*/
+void QGLView::scheduleUpdate()
+{
+  if (update_pending) return;
+  update_pending = true;
+  QTimer::singleShot(16, this, SLOT(coalescedUpdate()));
+}
+
+void QGLView::coalescedUpdate()
+{
+  // Cleared before drawing so events arriving mid-paint schedule the
+  // next frame rather than getting lost
+  update_pending = false;
+  updateGL();
+}
+
 void QGLView::resizeGL(int w, int h)
 {
   GLView::resizeGL(w,h);
@@ -152,7 +180,18 @@ void QGLView::resizeGL(int w, int h)
 
 void QGLView::paintGL()
 {
+  // Degraded-interaction mode: while the button is down draw the cheap
+  // stand-in renderer; the release event repaints in full quality
+  Renderer *saved_renderer = this->renderer;
+  if (mouse_drag_active && this->interaction_renderer) {
+    this->renderer = this->interaction_renderer;
+  }
+  boost::posix_time::ptime drawstart = boost::posix_time::microsec_clock::universal_time();
   GLView::gimbalCamPaintGL();
+  double frame_ms =
+    (boost::posix_time::microsec_clock::universal_time() - drawstart).total_microseconds() / 1e3;
+  if (showhud) paintHud(frame_ms);
+  this->renderer = saved_renderer;
 
   if (statusLabel) {
     QString msg;
@@ -170,10 +209,53 @@ void QGLView::paintGL()
   if (running_under_wine) swapBuffers();
 }
 
+/*!
+	Draws the performance HUD in the top-left corner: time spent in the
+	renderer for this frame, the work it submitted, and the state of the
+	geometry caches feeding it. The overlay is drawn as plain bitmap
+	text inside the same frame it describes, so the numbers always match
+	the picture on screen and the HUD itself costs next to nothing.
+*/
+void QGLView::paintHud(double frame_ms)
+{
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  qglColor(Qt::black);
+
+  QString line;
+  line.sprintf("frame: %.1f ms", frame_ms);
+  if (this->renderer) {
+    const Renderer::DrawStatistics &stats = this->renderer->getDrawStatistics();
+    QString counters;
+    counters.sprintf("  triangles: %lu  draw calls: %lu",
+                     (unsigned long)stats.triangles, (unsigned long)stats.drawcalls);
+    line += counters;
+    if (stats.opencsg_passes) {
+      counters.sprintf("  opencsg passes: %lu", (unsigned long)stats.opencsg_passes);
+      line += counters;
+    }
+  }
+  renderText(10, 15, line);
+
+  line.sprintf("geometry cache: %lu entries, %lu KB",
+               (unsigned long)GeometryCache::instance()->size(),
+               (unsigned long)(GeometryCache::instance()->totalSize() / 1024));
+#ifdef ENABLE_CGAL
+  QString cgal;
+  cgal.sprintf("  cgal cache: %lu entries, %lu KB",
+               (unsigned long)CGALCache::instance()->size(),
+               (unsigned long)(CGALCache::instance()->totalSize() / 1024));
+  line += cgal;
+#endif
+  renderText(10, 30, line);
+
+  glEnable(GL_DEPTH_TEST);
+}
+
 void QGLView::wheelEvent(QWheelEvent *event)
 {
   cam.viewer_distance *= pow(0.9, event->delta() / 120.0);
-  updateGL();
+  scheduleUpdate();
 }
 
 void QGLView::mousePressEvent(QMouseEvent *event)
@@ -260,7 +342,7 @@ void QGLView::mouseMoveEvent(QMouseEvent *event)
       cam.object_trans.z() += tm(2,3);
       }
     }
-    updateGL();
+    scheduleUpdate();
     emit doAnimateUpdate();
   }
   last_mouse = this_mouse;
@@ -270,6 +352,8 @@ void QGLView::mouseReleaseEvent(QMouseEvent*)
 {
   mouse_drag_active = false;
   releaseMouse();
+  // Swap the degraded interaction frame for a full-quality one
+  if (this->interaction_renderer) updateGL();
 }
 
 bool QGLView::save(const char *filename)
@@ -16,6 +16,7 @@ class QGLView : public QGLWidget, public GLView
 	Q_PROPERTY(bool showEdges READ showEdges WRITE setShowEdges);
 	Q_PROPERTY(bool showAxes READ showAxes WRITE setShowAxes);
 	Q_PROPERTY(bool showCrosshairs READ showCrosshairs WRITE setShowCrosshairs);
+	Q_PROPERTY(bool showHud READ showHud WRITE setShowHud);
 	Q_PROPERTY(bool orthoMode READ orthoMode WRITE setOrthoMode);
 
 public:
@@ -33,6 +34,8 @@ public:
 	void setShowAxes(bool enabled) { this->showaxes = enabled; }
 	bool showCrosshairs() const { return this->showcrosshairs; }
 	void setShowCrosshairs(bool enabled) { this->showcrosshairs = enabled; }
+	bool showHud() const { return this->showhud; }
+	void setShowHud(bool enabled) { this->showhud = enabled; }
 	bool orthoMode() const { return (this->cam.projection == Camera::ORTHOGONAL); }
 	void setOrthoMode(bool enabled) {
 		if (enabled) this->cam.projection = Camera::ORTHOGONAL;
@@ -45,6 +48,10 @@ public:
 	bool save(const char *filename);
 	void resetView();
 
+	//! Cheap stand-in renderer drawn while a mouse drag is in flight;
+	//! the regular renderer takes over again on button release
+	void setInteractionRenderer(Renderer *r) { this->interaction_renderer = r; }
+
 public slots:
 	void ZoomIn(void);
 	void ZoomOut(void);
@@ -57,6 +64,10 @@ private:
 
 	bool mouse_drag_active;
 	QPoint last_mouse;
+	bool update_pending;
+	Renderer *interaction_renderer;
+
+	void scheduleUpdate();
 
 	void wheelEvent(QWheelEvent *event);
 	void mousePressEvent(QMouseEvent *event);
@@ -67,11 +78,15 @@ private:
 	void resizeGL(int w, int h);
 
 	void paintGL();
+	void paintHud(double frame_ms);
 	void normalizeAngle(GLdouble& angle);
 
 #ifdef ENABLE_OPENCSG
 	void display_opencsg_warning();
+#endif
 private slots:
+	void coalescedUpdate();
+#ifdef ENABLE_OPENCSG
 	void display_opencsg_warning_dialog();
 #endif
 
@@ -27,11 +27,14 @@
 #include "ThrownTogetherRenderer.h"
 #include "polyset.h"
 #include "csgterm.h"
+#include "feature.h"
 
 #include "system-gl.h"
 
 #include <boost/unordered_map.hpp>
 #include <boost/foreach.hpp>
+#include <algorithm>
+#include <vector>
 
 ThrownTogetherRenderer::ThrownTogetherRenderer(CSGChain *root_chain, 
 																							 CSGChain *highlights_chain,
@@ -43,14 +46,24 @@ ThrownTogetherRenderer::ThrownTogetherRenderer(CSGChain *root_chain,
 
 void ThrownTogetherRenderer::draw(bool /*showfaces*/, bool showedges) const
 {
+	this->drawstats = DrawStatistics();
+	resetColorState();
 	if (this->root_chain) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
-		renderCSGChain(this->root_chain, false, false, showedges, false);
-		glCullFace(GL_FRONT);
-		glColor3ub(255, 0, 255);
-		renderCSGChain(this->root_chain, false, false, showedges, true);
+		// One two-sided pass instead of the old front/back pass pair:
+		// two-sided lighting draws back faces with the back material, which
+		// is pinned to the traditional magenta so inside-out geometry is
+		// still flagged, while every chain element is walked - and its
+		// shared vertex buffer bound - only once. glColor keeps driving the
+		// front material only, so per-object colors don't clobber the
+		// magenta (color-material tracks front and back by default).
+		static const GLfloat back_magenta[4] = {1.0f, 0.0f, 1.0f, 1.0f};
 		glDisable(GL_CULL_FACE);
+		glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+		glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+		glMaterialfv(GL_BACK, GL_AMBIENT_AND_DIFFUSE, back_magenta);
+		renderCSGChain(this->root_chain, false, false, showedges, false);
+		glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_FALSE);
+		glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
 	}
 	if (this->background_chain)
 	 	renderCSGChain(this->background_chain, false, true, showedges, false);
@@ -58,68 +71,141 @@ void ThrownTogetherRenderer::draw(bool /*showfaces*/, bool showedges) const
 	 	renderCSGChain(this->highlights_chain, true, false, showedges, false);
 }
 
+namespace {
+	// One visible chain object with its resolved draw state; filled and
+	// then submitted grouped by sortkey in renderCSGChain()
+	struct ChainEntry {
+		size_t index;
+		Renderer::csgmode_e csgmode;
+		Renderer::ColorMode colormode;
+		Renderer::ColorMode edge_colormode;
+		unsigned long long sortkey;
+	};
+
+	bool chain_entry_less(const ChainEntry &a, const ChainEntry &b)
+	{
+		return a.sortkey < b.sortkey;
+	}
+}
+
 void ThrownTogetherRenderer::renderCSGChain(CSGChain *chain, bool highlight,
 																						bool background, bool showedges, 
 																						bool fberror) const
 {
 	glDepthFunc(GL_LEQUAL);
+	Frustum frustum;
+	if (Feature::ExperimentalFrustumCulling.is_enabled()) frustum.load();
+	// Unloaded projection measures everything as infinitely large, so
+	// selectLOD() then always keeps the full-detail geometry
+	ScreenProjection screenproj;
+	if (Feature::ExperimentalLodPreview.is_enabled()) screenproj.load();
+
+	// Resolve every visible object's draw state first, then submit the
+	// objects grouped by that state: on colorful scenes with thousands
+	// of chain elements the per-object color churn costs more than the
+	// triangles, and within a group all but the first submission turn
+	// into no-ops in setColor(). Only the opaque main pass is reordered;
+	// the highlight and background passes blend, so they keep chain
+	// order. Highlighted objects sort behind the opaque modes by enum
+	// order, which also keeps their blending last.
+	std::vector<ChainEntry> entries;
+	entries.reserve(chain->objects.size());
+
 	boost::unordered_map<std::pair<const Geometry*,const Transform3d*>,int> geomVisitMark;
-	BOOST_FOREACH(const CSGChainObject &obj, chain->objects) {
+	for (size_t i = 0; i < chain->objects.size(); i++) {
+		const CSGChainObject &obj = chain->objects[i];
 		if (geomVisitMark[std::make_pair(obj.geom.get(), &obj.matrix)]++ > 0)
 			continue;
-		const Transform3d &m = obj.matrix;
-		const Color4f &c = obj.color;
-		glPushMatrix();
-		glMultMatrixd(m.data());
-		csgmode_e csgmode  = obj.type == CSGTerm::TYPE_DIFFERENCE ? CSGMODE_DIFFERENCE : CSGMODE_NORMAL;
-		ColorMode colormode = COLORMODE_NONE;
-		ColorMode edge_colormode = COLORMODE_NONE;
+		// Objects are drawn independently here, so off-screen ones can
+		// simply be skipped
+		if (!frustum.intersects(obj.getBoundingBox()))
+			continue;
+
+		ChainEntry e;
+		e.index = i;
+		e.csgmode = obj.type == CSGTerm::TYPE_DIFFERENCE ? CSGMODE_DIFFERENCE : CSGMODE_NORMAL;
+		e.colormode = COLORMODE_NONE;
+		e.edge_colormode = COLORMODE_NONE;
 
 		if (highlight) {
-			csgmode = csgmode_e(csgmode + 20);
-			colormode = COLORMODE_HIGHLIGHT;
-			edge_colormode = COLORMODE_HIGHLIGHT_EDGES;
+			e.csgmode = csgmode_e(e.csgmode + 20);
+			e.colormode = COLORMODE_HIGHLIGHT;
+			e.edge_colormode = COLORMODE_HIGHLIGHT_EDGES;
 		} else if (background) {
 			if (obj.flag & CSGTerm::FLAG_HIGHLIGHT) {
-				colormode = COLORMODE_HIGHLIGHT;
+				e.colormode = COLORMODE_HIGHLIGHT;
 			}
 			else {
-				colormode = COLORMODE_BACKGROUND;
+				e.colormode = COLORMODE_BACKGROUND;
 			}
-			csgmode = csgmode_e(csgmode + 10);
-			edge_colormode = COLORMODE_BACKGROUND_EDGES;
+			e.csgmode = csgmode_e(e.csgmode + 10);
+			e.edge_colormode = COLORMODE_BACKGROUND_EDGES;
 		} else if (fberror) {
-			if (highlight) csgmode = csgmode_e(csgmode + 20);
-			else if (background) csgmode = csgmode_e(csgmode + 10);
-			else csgmode = csgmode_e(csgmode);
+			if (highlight) e.csgmode = csgmode_e(e.csgmode + 20);
+			else if (background) e.csgmode = csgmode_e(e.csgmode + 10);
+			else e.csgmode = csgmode_e(e.csgmode);
 		} else if (obj.type == CSGTerm::TYPE_DIFFERENCE) {
 			if (obj.flag & CSGTerm::FLAG_HIGHLIGHT) {
-				colormode = COLORMODE_HIGHLIGHT;
-				csgmode = csgmode_e(csgmode + 20);
+				e.colormode = COLORMODE_HIGHLIGHT;
+				e.csgmode = csgmode_e(e.csgmode + 20);
 			}
 			else {
-				colormode = COLORMODE_CUTOUT;
+				e.colormode = COLORMODE_CUTOUT;
 			}
-			edge_colormode = COLORMODE_CUTOUT_EDGES;
+			e.edge_colormode = COLORMODE_CUTOUT_EDGES;
 		} else {
 			if (obj.flag & CSGTerm::FLAG_HIGHLIGHT) {
-				colormode = COLORMODE_HIGHLIGHT;
-				csgmode = csgmode_e(csgmode + 20);
+				e.colormode = COLORMODE_HIGHLIGHT;
+				e.csgmode = csgmode_e(e.csgmode + 20);
 			}
 			else {
-				colormode = COLORMODE_MATERIAL;
+				e.colormode = COLORMODE_MATERIAL;
 			}
-			edge_colormode = COLORMODE_MATERIAL_EDGES;
+			e.edge_colormode = COLORMODE_MATERIAL_EDGES;
 		}
-		
-		setColor(colormode, c.data());
-		render_surface(obj.geom, csgmode, m);
-		if (showedges) {
-			// FIXME? glColor4f((c[0]+1)/2, (c[1]+1)/2, (c[2]+1)/2, 1.0);
-			setColor(edge_colormode);
-			render_edges(obj.geom, csgmode);
+
+		// Group by color mode, then CSG mode, then the packed object
+		// color. Unset components pack like full intensity; a collision
+		// only costs a redundant setColor(), which compares exact values.
+		unsigned rgba = 0;
+		for (int comp = 0; comp < 4; comp++) {
+			float v = obj.color[comp] < 0 ? 1.0f : obj.color[comp];
+			rgba = (rgba << 8) | (unsigned)(v * 255.0f + 0.5f);
 		}
+		e.sortkey = ((unsigned long long)e.colormode << 40) |
+								((unsigned long long)e.csgmode << 32) | rgba;
+		entries.push_back(e);
+	}
 
+	if (!highlight && !background && !fberror && entries.size() > 1) {
+		std::stable_sort(entries.begin(), entries.end(), chain_entry_less);
+	}
+
+	BOOST_FOREACH(const ChainEntry &e, entries) {
+		const CSGChainObject &obj = chain->objects[e.index];
+		const Transform3d &m = obj.matrix;
+		glPushMatrix();
+		glMultMatrixd(m.data());
+		shared_ptr<const Geometry> geom =
+			selectLOD(obj.geom, screenproj.diameter(obj.getBoundingBox()));
+		this->drawstats.drawcalls++;
+		this->drawstats.triangles += countTriangles(geom);
+		setColor(e.colormode, obj.color.data());
+		render_surface(geom, e.csgmode, m);
 		glPopMatrix();
 	}
+
+	// Edges in a second sweep so the surface groups stay contiguous and
+	// the few edge colors batch up likewise
+	if (showedges) {
+		BOOST_FOREACH(const ChainEntry &e, entries) {
+			const CSGChainObject &obj = chain->objects[e.index];
+			glPushMatrix();
+			glMultMatrixd(obj.matrix.data());
+			// FIXME? glColor4f((c[0]+1)/2, (c[1]+1)/2, (c[2]+1)/2, 1.0);
+			setColor(e.edge_colormode);
+			render_edges(selectLOD(obj.geom, screenproj.diameter(obj.getBoundingBox())), e.csgmode);
+			glPopMatrix();
+		}
+	}
 }
@@ -1,5 +1,7 @@
 #include "Tree.h"
 #include "nodedumper.h"
+#include "nodehasher.h"
+#include "traverser.h"
 
 #include <assert.h>
 #include <algorithm>
@@ -8,6 +10,8 @@ Tree::~Tree()
 {
 	this->nodecache.clear();
 	this->nodeidcache.clear();
+	this->nodehashcache.clear();
+	delete this->flattening;
 }
 
 /*!
@@ -22,7 +26,7 @@ const std::string &Tree::getString(const AbstractNode &node) const
 		this->nodeidcache.clear();
 		NodeDumper dumper(this->nodecache, false);
 		Traverser trav(dumper, *this->root_node, Traverser::PRE_AND_POSTFIX);
-		trav.execute();
+		trav.execute(&getFlattening());
 		assert(this->nodecache.contains(*this->root_node) &&
 					 "NodeDumper failed to create a cache");
 	}
@@ -53,11 +57,45 @@ const std::string &Tree::getIdString(const AbstractNode &node) const
 	return this->nodeidcache[node];
 }
 
+/*!
+	Returns the cached content hash of the subtree rooted by \a node.
+	If node is not cached, the cache will be rebuilt.
+
+	Unlike getIdString(), the hash has a fixed size independent of the
+	subtree, and computing it never materializes a textual dump, so it's the
+	preferred cache key for large designs.
+*/
+const std::string &Tree::getIdHash(const AbstractNode &node) const
+{
+	assert(this->root_node);
+	if (!this->nodehashcache.contains(node)) {
+		NodeHasher hasher(this->nodehashcache);
+		Traverser trav(hasher, *this->root_node, Traverser::PRE_AND_POSTFIX);
+		trav.execute(&getFlattening());
+		assert(this->nodehashcache.contains(*this->root_node) &&
+					 "NodeHasher failed to create a cache");
+	}
+	return this->nodehashcache[node];
+}
+
+const NodeFlattening &Tree::getFlattening() const
+{
+	assert(this->root_node);
+	if (!this->flattening) this->flattening = new NodeFlattening;
+	if (this->flattening->root() != this->root_node) {
+		this->flattening->build(*this->root_node);
+	}
+	return *this->flattening;
+}
+
 /*!
 	Sets a new root. Will clear the existing cache.
  */
 void Tree::setRoot(const AbstractNode *root)
 {
-	this->root_node = root; 
+	this->root_node = root;
 	this->nodecache.clear();
+	this->nodehashcache.clear();
+	delete this->flattening;
+	this->flattening = NULL;
 }
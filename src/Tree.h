@@ -11,7 +11,7 @@
 class Tree
 {
 public:
-	Tree(const AbstractNode *root = NULL) : root_node(root) {}
+	Tree(const AbstractNode *root = NULL) : root_node(root), flattening(NULL) {}
 	~Tree();
 
 	void setRoot(const AbstractNode *root);
@@ -19,9 +19,15 @@ public:
 
 	const std::string &getString(const AbstractNode &node) const;
 	const std::string &getIdString(const AbstractNode &node) const;
+	const std::string &getIdHash(const AbstractNode &node) const;
+
+	//! Returns the tree linearized for traversal, built lazily once per root
+	const class NodeFlattening &getFlattening() const;
 
 private:
 	const AbstractNode *root_node;
   mutable NodeCache nodecache;
   mutable NodeCache nodeidcache;
+  mutable NodeCache nodehashcache;
+	mutable NodeFlattening *flattening;
 };
@@ -86,8 +86,9 @@ void Builtins::initialize()
 
 std::string Builtins::isDeprecated(const std::string &name)
 {
-	if (this->deprecations.find(name) != this->deprecations.end()) {
-		return this->deprecations[name];
+	boost::unordered_map<std::string, std::string>::const_iterator it = this->deprecations.find(name);
+	if (it != this->deprecations.end()) {
+		return it->second;
 	}
 	return std::string();
 }
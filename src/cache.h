@@ -46,16 +46,18 @@
 
 #include <boost/unordered_map.hpp>
 #include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
 #include "printutils.h"
 
 template <class Key, class T>
 class Cache
 {
 	struct Node {
-		inline Node() : keyPtr(0) {}
+		inline Node() : keyPtr(0), pinned(false) {}
 		inline Node(T *data, int cost)
-			: keyPtr(0), t(data), c(cost), p(0), n(0) {}
-		const Key *keyPtr; T *t; int c; Node *p,*n;
+			: keyPtr(0), t(data), c(cost), p(0), n(0), pinned(false) {}
+		const Key *keyPtr; T *t; int c; Node *p,*n; bool pinned;
 	};
 	typedef typename boost::unordered_map<Key, Node> map_type;
 	typedef typename map_type::iterator iterator_type;
@@ -64,7 +66,9 @@ class Cache
 	boost::unordered_map<Key, Node> hash;
 	Node *f, *l;
 	void *unused;
-	int mx, total;
+	int mx, total, pinnedtotal;
+	void (*evict_f)(const Key &, T *, void *);
+	void *evict_ud;
 
 	inline void unlink(Node &n) {
 		if (n.p) n.p->n = n.n;
@@ -72,6 +76,7 @@ class Cache
 		if (l == &n) l = n.p;
 		if (f == &n) f = n.n;
 		total -= n.c;
+		if (n.pinned) pinnedtotal -= n.c;
 		T *obj = n.t;
 		hash.erase(*n.keyPtr);
 		delete obj;
@@ -95,7 +100,7 @@ class Cache
 
 public:
 	inline explicit Cache(int maxCost = 100)
-		: f(0), l(0), unused(0), mx(maxCost), total(0) { }
+		: f(0), l(0), unused(0), mx(maxCost), total(0), pinnedtotal(0), evict_f(0), evict_ud(0) { }
 	inline ~Cache() { clear(); }
 
 	inline int maxCost() const { return mx; }
@@ -107,7 +112,7 @@ public:
 
 	void clear() {
 		while (f) { delete f->t; f = f->n; }
-		hash.clear(); l = 0; total = 0;
+		hash.clear(); l = 0; total = 0; pinnedtotal = 0;
 	}
 
 	bool insert(const Key &key, T *object, int cost = 1);
@@ -118,6 +123,34 @@ public:
 	bool remove(const Key &key);
 	T *take(const Key &key);
 
+	//! Evict LRU entries until the total cost is at most m, without
+	//! changing the configured maximum
+	void shrink(int m) { trim(m); }
+
+	/*!
+		Pins the entry: trimming passes over it, so deliberately cached
+		results (render() subtrees) survive preview churn and memory
+		pressure. Pinned cost still counts against the budget - pinning
+		more than the maximum means unpinned entries get no cache at all -
+		and is reported separately via pinnedCost(). Explicit remove() and
+		clear() still drop pinned entries.
+	*/
+	bool pin(const Key &key) {
+		iterator_type i = hash.find(key);
+		if (i == hash.end()) return false;
+		Node &n = i->second;
+		if (!n.pinned) { n.pinned = true; pinnedtotal += n.c; }
+		return true;
+	}
+	inline int pinnedCost() const { return pinnedtotal; }
+
+	typedef void (*EvictionHandler)(const Key &key, T *object, void *userdata);
+	//! The handler is invoked for entries evicted by cost trimming (not
+	//! for explicit remove/replace), right before the entry is deleted.
+	//! It must not reenter this cache. Typical use: demoting the object
+	//! to a compressed tier instead of losing it outright.
+	void setEvictionHandler(EvictionHandler f, void *userdata) { evict_f = f; evict_ud = userdata; }
+
 private:
 	void trim(int m);
 };
@@ -172,13 +205,164 @@ bool Cache<Key,T>::insert(const Key &akey, T *aobject, int acost)
 template <class Key, class T>
 void Cache<Key,T>::trim(int m)
 {
+	// Pinned entries are exempt: they're skipped on the walk and their
+	// cost is excluded from the target, so the loop terminates even when
+	// pinned cost alone exceeds m
 	Node *n = l;
-	while (n && total > m) {
+	while (n && total - pinnedtotal > m) {
 		Node *u = n;
 		n = n->p;
+		if (u->pinned) continue;
 #ifdef DEBUG
 		PRINTB("Trimming cache: %1% (%2% bytes)", *u->keyPtr % u->c);
 #endif
+		if (evict_f) evict_f(*u->keyPtr, u->t, evict_ud);
 		unlink(*u);
 	}
 }
+
+/*!
+	Internally synchronized cache for concurrent evaluators: the key
+	space is sharded over independently locked Cache segments, so
+	lookups and inserts for different keys rarely contend. The public
+	surface mirrors Cache, except that lookups go through fetch() -
+	under concurrent eviction a pointer into the cache could be deleted
+	before the caller dereferences it, so the entry is copied out while
+	the shard lock is held.
+
+	Each shard is allowed the full cost budget so a single large entry
+	is never rejected just for exceeding 1/N of it; the combined budget
+	is enforced after inserts by trimming every shard proportionally.
+*/
+template <class Key, class T>
+class ShardedCache
+{
+	enum { NumShards = 16 };
+
+	struct Shard {
+		boost::mutex mutex;
+		Cache<Key, T> cache;
+	};
+
+	mutable Shard shards[NumShards];
+	int mx;
+
+	inline Shard &shard(const Key &key) const {
+		return shards[boost::hash<Key>()(key) % NumShards];
+	}
+
+	//! Locks one shard at a time; the total may momentarily overshoot
+	//! while other threads insert, which their own trim then corrects
+	void trimTo(int m) {
+		int total = totalCost();
+		if (total <= m) return;
+		for (int i = 0; i < NumShards; i++) {
+			boost::mutex::scoped_lock lock(shards[i].mutex);
+			long long target = (long long)shards[i].cache.totalCost() * m / total;
+			shards[i].cache.shrink((int)target);
+		}
+	}
+
+public:
+	inline explicit ShardedCache(int maxCost = 100) : mx(maxCost) {
+		for (int i = 0; i < NumShards; i++) shards[i].cache.setMaxCost(maxCost);
+	}
+
+	inline int maxCost() const { return mx; }
+	void setMaxCost(int m) {
+		mx = m;
+		for (int i = 0; i < NumShards; i++) {
+			boost::mutex::scoped_lock lock(shards[i].mutex);
+			shards[i].cache.setMaxCost(m);
+		}
+		trimTo(m);
+	}
+	int totalCost() const {
+		int total = 0;
+		for (int i = 0; i < NumShards; i++) {
+			boost::mutex::scoped_lock lock(shards[i].mutex);
+			total += shards[i].cache.totalCost();
+		}
+		return total;
+	}
+
+	int size() const {
+		int count = 0;
+		for (int i = 0; i < NumShards; i++) {
+			boost::mutex::scoped_lock lock(shards[i].mutex);
+			count += shards[i].cache.size();
+		}
+		return count;
+	}
+	bool empty() const { return size() == 0; }
+
+	void clear() {
+		for (int i = 0; i < NumShards; i++) {
+			boost::mutex::scoped_lock lock(shards[i].mutex);
+			shards[i].cache.clear();
+		}
+	}
+
+	bool insert(const Key &key, T *object, int cost = 1) {
+		bool inserted;
+		{
+			Shard &s = shard(key);
+			boost::mutex::scoped_lock lock(s.mutex);
+			inserted = s.cache.insert(key, object, cost);
+		}
+		if (inserted) trimTo(mx);
+		return inserted;
+	}
+
+	bool contains(const Key &key) const {
+		Shard &s = shard(key);
+		boost::mutex::scoped_lock lock(s.mutex);
+		return s.cache.contains(key);
+	}
+
+	//! Relinks the entry to the front of its shard's LRU chain and
+	//! copies it to out; returns false on a miss
+	bool fetch(const Key &key, T &out) const {
+		Shard &s = shard(key);
+		boost::mutex::scoped_lock lock(s.mutex);
+		T *t = s.cache.object(key);
+		if (!t) return false;
+		out = *t;
+		return true;
+	}
+
+	bool remove(const Key &key) {
+		Shard &s = shard(key);
+		boost::mutex::scoped_lock lock(s.mutex);
+		return s.cache.remove(key);
+	}
+
+	//! See Cache::pin()
+	bool pin(const Key &key) {
+		Shard &s = shard(key);
+		boost::mutex::scoped_lock lock(s.mutex);
+		return s.cache.pin(key);
+	}
+
+	int pinnedCost() const {
+		int total = 0;
+		for (int i = 0; i < NumShards; i++) {
+			boost::mutex::scoped_lock lock(shards[i].mutex);
+			total += shards[i].cache.pinnedCost();
+		}
+		return total;
+	}
+
+	//! See Cache::setEvictionHandler(). The handler runs with the
+	//! evicting shard's lock held, so it must not touch this cache.
+	void setEvictionHandler(typename Cache<Key, T>::EvictionHandler f, void *userdata) {
+		for (int i = 0; i < NumShards; i++) {
+			boost::mutex::scoped_lock lock(shards[i].mutex);
+			shards[i].cache.setEvictionHandler(f, userdata);
+		}
+	}
+
+	//! Evict LRU entries until the total cost is at most m, without
+	//! changing the configured maximum
+	void shrink(int m) { trimTo(m); }
+};
@@ -0,0 +1,197 @@
+#include "cacheadvisor.h"
+#include "Tree.h"
+#include "traverser.h"
+#include "node.h"
+#include "rendernode.h"
+#include "module.h"
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+
+#include <boost/format.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+// Subtrees cheaper than this are never suggested
+#define ADVISOR_MIN_SECONDS 0.5
+// At most this many suggestions per report, costliest first
+#define ADVISOR_MAX_SUGGESTIONS 5
+// History entries not seen for this many compiles are dropped
+#define ADVISOR_HISTORY_COMPILES 16
+
+namespace {
+
+	struct SubtreeRecord {
+		SubtreeRecord() : seconds(0.0), compiles_seen(0), last_compile(0) {}
+		double seconds;       // costliest evaluation observed (cache hits are ~0)
+		size_t compiles_seen;
+		size_t last_compile;
+	};
+
+	typedef boost::unordered_map<std::string, SubtreeRecord> history_map_t;
+	history_map_t history;
+	// Own (not subtree) evaluation seconds per node index, current compile
+	std::map<size_t, double> selftimes;
+	size_t compiles = 0;
+	boost::mutex advisor_mutex;
+
+	double now()
+	{
+		static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+		return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() / 1e6;
+	}
+
+	struct Suggestion {
+		double seconds;
+		size_t compiles_seen;
+		const AbstractNode *node;
+	};
+
+	bool orderBySuggestionSeconds(const Suggestion &a, const Suggestion &b)
+	{
+		return a.seconds > b.seconds;
+	}
+}
+
+bool CacheAdvisor::is_enabled = false;
+
+CacheAdvisor *CacheAdvisor::instance()
+{
+	static CacheAdvisor *advisor = new CacheAdvisor();
+	return advisor;
+}
+
+void CacheAdvisor::startCompile()
+{
+	boost::mutex::scoped_lock lock(advisor_mutex);
+	selftimes.clear();
+}
+
+void CacheAdvisor::recordEvaluation(const AbstractNode &node, double seconds)
+{
+	boost::mutex::scoped_lock lock(advisor_mutex);
+	// A node can be evaluated more than once per compile (preview leaf
+	// evaluation, then the full render); the costliest run is its cost
+	double &slot = selftimes[node.index()];
+	if (seconds > slot) slot = seconds;
+}
+
+std::string CacheAdvisor::finishCompile(const Tree &tree)
+{
+	if (!tree.root()) return std::string();
+
+	boost::mutex::scoped_lock lock(advisor_mutex);
+	compiles++;
+
+	// Subtree cost per node: the flattening walks children before their
+	// parent's postfix, so a running-sum stack folds self times upward
+	const NodeFlattening &flat = tree.getFlattening();
+	std::map<size_t, double> subtreetimes;
+	std::vector<double> sums;
+	sums.push_back(0.0);
+	for (size_t i = 0; i < flat.entries.size(); i++) {
+		const NodeFlattening::Entry &e = flat.entries[i];
+		if (!e.postfix) {
+			std::map<size_t, double>::const_iterator it = selftimes.find(e.node->index());
+			sums.push_back(it != selftimes.end() ? it->second : 0.0);
+		}
+		else {
+			double sum = sums.back();
+			sums.pop_back();
+			sums.back() += sum;
+			subtreetimes[e.node->index()] = sum;
+		}
+	}
+
+	// Fold this compile into the hash history
+	for (size_t i = 0; i < flat.entries.size(); i++) {
+		const NodeFlattening::Entry &e = flat.entries[i];
+		if (e.postfix) continue;
+		SubtreeRecord &rec = history[tree.getIdHash(*e.node)];
+		if (rec.last_compile != compiles) {
+			rec.compiles_seen++;
+			rec.last_compile = compiles;
+		}
+		double seconds = subtreetimes[e.node->index()];
+		if (seconds > rec.seconds) rec.seconds = seconds;
+	}
+
+	// A suggestion is a maximal subtree that is expensive, has survived
+	// more compiles than its parent (the design churns around it, so an
+	// in-memory cache hit is not guaranteed to outlive the session), and
+	// is not already pinned by a render()
+	std::vector<Suggestion> suggestions;
+	for (size_t i = 0; i < flat.entries.size(); ) {
+		const NodeFlattening::Entry &e = flat.entries[i];
+		if (e.postfix) {
+			i++;
+			continue;
+		}
+		if (dynamic_cast<const RenderNode *>(e.node)) {
+			i = e.skip; // already pinned; nothing below can do better
+			continue;
+		}
+		const SubtreeRecord &rec = history[tree.getIdHash(*e.node)];
+		bool stable = rec.compiles_seen >= 2 || compiles < 2;
+		bool under_churn = !e.parent || compiles < 2 ||
+			history[tree.getIdHash(*e.parent)].compiles_seen < rec.compiles_seen;
+		if (stable && under_churn && rec.seconds >= ADVISOR_MIN_SECONDS) {
+			Suggestion s;
+			s.seconds = rec.seconds;
+			s.compiles_seen = rec.compiles_seen;
+			s.node = e.node;
+			suggestions.push_back(s);
+			i = e.skip; // report the maximal subtree, not its pieces
+			continue;
+		}
+		i++;
+	}
+
+	// Age out hashes of subtrees that no longer exist
+	for (history_map_t::iterator it = history.begin(); it != history.end(); ) {
+		if (compiles - it->second.last_compile > ADVISOR_HISTORY_COMPILES) {
+			it = history.erase(it);
+		}
+		else ++it;
+	}
+	selftimes.clear();
+
+	if (suggestions.empty()) return std::string();
+	std::sort(suggestions.begin(), suggestions.end(), orderBySuggestionSeconds);
+	if (suggestions.size() > ADVISOR_MAX_SUGGESTIONS) {
+		suggestions.resize(ADVISOR_MAX_SUGGESTIONS);
+	}
+
+	std::stringstream s;
+	s << "Suggested render() placements (expensive stable subtrees):";
+	for (size_t i = 0; i < suggestions.size(); i++) {
+		const Suggestion &sug = suggestions[i];
+		const ModuleInstantiation *modinst = sug.node->modinst;
+		std::string what = modinst && !modinst->name().empty() ? modinst->name() : sug.node->name();
+		std::string where = "unknown location";
+		if (modinst && !modinst->path().empty()) {
+			where = modinst->path();
+			if (modinst->line() > 0) where += str(boost::format(":%d") % modinst->line());
+		}
+		s << str(boost::format("\n  %6.1fs  %s() at %s") % sug.seconds % what % where);
+		if (compiles >= 2) {
+			s << str(boost::format(", unchanged for %d of %d compiles") % sug.compiles_seen % compiles);
+		}
+	}
+	return s.str();
+}
+
+AdvisorScope::AdvisorScope(const AbstractNode &node)
+	: node(node), starttime(CacheAdvisor::enabled() ? now() : -1.0)
+{
+}
+
+AdvisorScope::~AdvisorScope()
+{
+	if (this->starttime >= 0) {
+		CacheAdvisor::instance()->recordEvaluation(this->node, now() - this->starttime);
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+
+/*!
+	Profile-guided render() placement advisor.
+
+	render() placement is the main manual performance lever and is
+	usually guessed. The advisor turns the guess into a measurement: each
+	full geometry evaluation attributes every node's own cost to its
+	subtree, and across recompiles the id hashes show which subtrees stay
+	identical while the design around them is edited. finishCompile()
+	then reports the maximal subtrees that are expensive, stable over
+	recent compiles, and sitting under a churning parent - exactly the
+	spots where a render() (or a cached library module) pays for itself.
+
+	Collection costs one clock sample per evaluated node and is enabled
+	unconditionally by the GUI, which prints the report after every full
+	render; the command line enables it behind --advise-render.
+	Process-lifetime singleton like the geometry caches.
+*/
+class CacheAdvisor
+{
+public:
+	static CacheAdvisor *instance();
+
+	static void enable() { is_enabled = true; }
+	static bool enabled() { return is_enabled; }
+
+	//! Forgets the per-node times of the previous compile's tree
+	void startCompile();
+	//! Attributes one node's own evaluation time to the current compile
+	void recordEvaluation(const class AbstractNode &node, double seconds);
+	/*!
+		Folds the finished evaluation into the cross-compile history and
+		renders the suggestions; empty when there is nothing worth pinning.
+	*/
+	std::string finishCompile(const class Tree &tree);
+
+private:
+	CacheAdvisor() {}
+
+	static bool is_enabled;
+};
+
+/*!
+	RAII token attributing one timed stretch of evaluation to a node;
+	mirrors ProfileScope/ModuleTimer.
+*/
+class AdvisorScope
+{
+public:
+	AdvisorScope(const class AbstractNode &node);
+	~AdvisorScope();
+
+private:
+	const class AbstractNode &node;
+	double starttime;
+};
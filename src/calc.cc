@@ -26,6 +26,10 @@
 
 #include "calc.h"
 #include "grid.h"
+#include "memorypressure.h"
+
+#include <map>
+#include <boost/thread.hpp>
 
 /*!
 	Returns the number of subdivision of a whole circle, given radius and
@@ -34,7 +38,42 @@
 int Calc::get_fragments_from_r(double r, double fn, double fs, double fa)
 {
 	if (r < GRID_FINE) return 3;
-	if (fn > 0.0) return (int)(fn >= 3 ? fn : 3);
-	return (int)ceil(fmax(fmin(360.0 / fa, r*2*M_PI / fs), 5));
+	int fragments;
+	if (fn > 0.0) fragments = (int)(fn >= 3 ? fn : 3);
+	else fragments = (int)ceil(fmax(fmin(360.0 / fa, r*2*M_PI / fs), 5));
+
+	// Under memory pressure the remaining curved surfaces are built
+	// coarser; see MemoryPressure
+	double scale = MemoryPressure::fragmentScale();
+	if (scale < 1.0) fragments = (int)fmax(3, floor(fragments * scale));
+	return fragments;
+}
+
+/*!
+	Returns the (cos, sin) pairs for the fragment angles of a full circle,
+	i.e. for 2*M_PI*i/fragments + offset. Models instantiate the same
+	fragment counts over and over (spheres, cylinders, circles and
+	rotate_extrude rings with the same $fn/$fs/$fa), so the rings are
+	memoized process-wide. Entries are never evicted, which keeps the
+	returned references valid for the lifetime of the process; a ring is
+	just two doubles per fragment.
+*/
+const Calc::TrigRing &Calc::trig_ring(int fragments, double offset)
+{
+	typedef std::map<std::pair<int, double>, TrigRing> RingMap;
+	static RingMap rings;
+	static boost::mutex ringmutex;
+
+	boost::lock_guard<boost::mutex> lock(ringmutex);
+	RingMap::iterator iter = rings.find(std::make_pair(fragments, offset));
+	if (iter != rings.end()) return iter->second;
+
+	TrigRing &ring = rings[std::make_pair(fragments, offset)];
+	ring.resize(fragments);
+	for (int i = 0; i < fragments; i++) {
+		double phi = (M_PI*2*i) / fragments + offset;
+		ring[i] = std::make_pair(cos(phi), sin(phi));
+	}
+	return ring;
 }
 
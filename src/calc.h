@@ -1,5 +1,12 @@
 #pragma once
 
+#include <utility>
+#include <vector>
+
 namespace Calc {
 	int get_fragments_from_r(double r, double fn, double fs, double fa);
+
+	// (cos, sin) for each fragment angle around a full circle
+	typedef std::vector<std::pair<double, double> > TrigRing;
+	const TrigRing &trig_ring(int fragments, double offset = 0.0);
 }
@@ -140,7 +140,7 @@ std::string CgaladvNode::name() const
 	return "internal_error";
 }
 
-std::string CgaladvNode::toString() const
+std::string CgaladvNode::computeString() const
 {
 	std::stringstream stream;
 
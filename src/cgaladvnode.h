@@ -23,8 +23,9 @@ public:
         virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const;
+	virtual AbstractNode *cloneNode() const { return new CgaladvNode(*this); }
 
 	Value path;
 	std::string subdiv_type;
@@ -3,79 +3,314 @@
 #include "cgalutils.h"
 #include "polyset.h"
 #include "printutils.h"
+#include "workerpool.h"
+#include "profiler.h"
 #include "Polygon2d.h"
 #include "polyset-utils.h"
 #include "grid.h"
 #include "node.h"
+#include "feature.h"
 
 #include "cgal.h"
 #include <CGAL/convex_hull_3.h>
+#include <CGAL/convex_decomposition_3.h>
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include "svg.h"
 #include "Reindexer.h"
 
 #include <map>
+#include <set>
+#include <limits>
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 namespace CGALUtils {
 
-	bool applyHull(const Geometry::ChildList &children, PolySet &result)
-	{
-		typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
-		// Collect point cloud
-		std::set<K::Point_3> points;
+	typedef CGAL::Exact_predicates_inexact_constructions_kernel HullKernel;
 
-		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
-			const shared_ptr<const Geometry> &chgeom = item.second;
-			const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron *>(chgeom.get());
-			if (N) {
-				for (CGAL_Nef_polyhedron3::Vertex_const_iterator i = N->p3->vertices_begin(); i != N->p3->vertices_end(); ++i) {
-					points.insert(K::Point_3(to_double(i->point()[0]),to_double(i->point()[1]),to_double(i->point()[2])));
-				}
-			} else {
-				const PolySet *ps = dynamic_cast<const PolySet *>(chgeom.get());
-				if (ps) {
-					BOOST_FOREACH(const PolySet::Polygon &p, ps->polygons) {
-						BOOST_FOREACH(const Vector3d &v, p) {
-							points.insert(K::Point_3(v[0], v[1], v[2]));
-						}
+	//! Appends every vertex of the child geometry to out
+	static void gather_hull_points(const Geometry *chgeom, std::vector<HullKernel::Point_3> &out)
+	{
+		const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron *>(chgeom);
+		if (N) {
+			for (CGAL_Nef_polyhedron3::Vertex_const_iterator i = N->p3->vertices_begin(); i != N->p3->vertices_end(); ++i) {
+				out.push_back(HullKernel::Point_3(to_double(i->point()[0]),to_double(i->point()[1]),to_double(i->point()[2])));
+			}
+		} else {
+			const PolySet *ps = dynamic_cast<const PolySet *>(chgeom);
+			if (ps) {
+				ps->ensureLoaded(); // a spilled set has no boxed polygons to walk
+				BOOST_FOREACH(const PolySet::Polygon &p, ps->polygons) {
+					BOOST_FOREACH(const Vector3d &v, p) {
+						out.push_back(HullKernel::Point_3(v[0], v[1], v[2]));
 					}
 				}
 			}
 		}
+	}
+
+	static void gather_hull_range(const std::vector<const Geometry *> *geoms,
+																std::vector<std::vector<HullKernel::Point_3> > *points,
+																size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++) gather_hull_points((*geoms)[i], (*points)[i]);
+	}
+
+	// Below this many points the exact hull is cheap enough that
+	// prefiltering is pure overhead
+	#define HULL_PREFILTER_MIN_POINTS 10000
+
+	/*!
+		Conservative interior-point prefilter (Akl-Toussaint style): find
+		the extreme input points along 26 directions, build their small
+		hull, and discard every point strictly inside all of its facet
+		planes - such points are provably interior to the final hull too.
+		Plane-side predicates are exact, so the surviving set yields the
+		identical hull; dense imported meshes typically shed well over 90%
+		of their vertices here before convex_hull_3 sees them.
+	*/
+	static void prefilter_hull_points(std::vector<HullKernel::Point_3> &points)
+	{
+		if (points.size() < HULL_PREFILTER_MIN_POINTS) return;
+
+		std::vector<HullKernel::Point_3> extremes;
+		for (int dx = -1; dx <= 1; dx++)
+		for (int dy = -1; dy <= 1; dy++)
+		for (int dz = -1; dz <= 1; dz++) {
+			if (!dx && !dy && !dz) continue;
+			size_t best = 0;
+			double bestdot = -std::numeric_limits<double>::max();
+			for (size_t i = 0; i < points.size(); i++) {
+				double dot = dx*points[i].x() + dy*points[i].y() + dz*points[i].z();
+				if (dot > bestdot) { bestdot = dot; best = i; }
+			}
+			extremes.push_back(points[best]);
+		}
+
+		CGAL::Polyhedron_3<HullKernel> inner;
+		try {
+			CGAL::convex_hull_3(extremes.begin(), extremes.end(), inner);
+		}
+		catch (...) {
+			return; // degenerate candidate set; filter nothing
+		}
+		if (inner.size_of_facets() < 4) return;
+
+		std::vector<HullKernel::Plane_3> planes;
+		for (CGAL::Polyhedron_3<HullKernel>::Facet_const_iterator f = inner.facets_begin(); f != inner.facets_end(); ++f) {
+			CGAL::Polyhedron_3<HullKernel>::Halfedge_const_handle h = f->halfedge();
+			planes.push_back(HullKernel::Plane_3(h->vertex()->point(),
+																					 h->next()->vertex()->point(),
+																					 h->next()->next()->vertex()->point()));
+		}
+
+		std::vector<HullKernel::Point_3> kept;
+		kept.reserve(points.size() / 4);
+		BOOST_FOREACH(const HullKernel::Point_3 &p, points) {
+			bool interior = true;
+			BOOST_FOREACH(const HullKernel::Plane_3 &plane, planes) {
+				if (plane.oriented_side(p) != CGAL::ON_NEGATIVE_SIDE) {
+					interior = false;
+					break;
+				}
+			}
+			if (!interior) kept.push_back(p);
+		}
+#ifdef DEBUG
+		PRINTB("Hull prefilter: %d of %d points kept", kept.size() % points.size());
+#endif
+		points.swap(kept);
+	}
+
+	bool applyHull(const Geometry::ChildList &children, PolySet &result)
+	{
+		// Collect each child's point cloud; independent children gather on
+		// worker threads when parallel evaluation is enabled (mirrors
+		// convertChildrenToNefs())
+		std::vector<const Geometry *> geoms;
+		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+			geoms.push_back(item.second.get());
+		}
+		std::vector<std::vector<HullKernel::Point_3> > chpoints(geoms.size());
+
+		size_t numthreads = WorkerPool::numThreads();
+		if (Feature::ExperimentalParallelCSG.is_enabled() && geoms.size() > 1 && numthreads > 1) {
+			size_t usethreads = std::min(numthreads, geoms.size());
+			WorkerPool::TaskGroup tasks;
+			for (size_t t = 0; t < usethreads; t++) {
+				size_t first = geoms.size() * t / usethreads;
+				size_t last = geoms.size() * (t+1) / usethreads;
+				tasks.run(boost::bind(gather_hull_range, &geoms, &chpoints, first, last));
+			}
+			tasks.wait();
+		}
+		else {
+			gather_hull_range(&geoms, &chpoints, 0, geoms.size());
+		}
+
+		std::vector<HullKernel::Point_3> allpoints;
+		BOOST_FOREACH(const std::vector<HullKernel::Point_3> &chp, chpoints) {
+			allpoints.insert(allpoints.end(), chp.begin(), chp.end());
+		}
+
+		prefilter_hull_points(allpoints);
+
+		// Dedupe; repeated vertices are common across shared child edges
+		std::set<HullKernel::Point_3> points(allpoints.begin(), allpoints.end());
 
 		if (points.size() <= 3) return false;
 
 		// Apply hull
-		if (points.size() >= 4) {
-			CGAL::Polyhedron_3<K> r;
-			CGAL::convex_hull_3(points.begin(), points.end(), r);
-			if (!createPolySetFromPolyhedron(r, result))
-				return true;
-			return false;
-		} else {
-			return false;
-		}
+		CGAL::Polyhedron_3<HullKernel> r;
+		CGAL::convex_hull_3(points.begin(), points.end(), r);
+		if (!createPolySetFromPolyhedron(r, result))
+			return true;
+		return false;
 	}
 	
+	/*!
+		Converts the PolySet operands in the given slot range to Nef
+		polyhedra. Slices of the slot range are handed to worker threads by
+		convertChildrenToNefs().
+	*/
+	static void convert_operand_range(const std::vector<const PolySet *> *polysets,
+																		std::vector<shared_ptr<const CGAL_Nef_polyhedron> > *nefs,
+																		size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++) {
+			if ((*polysets)[i]) (*nefs)[i].reset(createNefPolyhedronFromGeometry(*(*polysets)[i]));
+		}
+	}
+
+/*!
+	Returns the Nef polyhedron form of each child, converting PolySet
+	children as needed. Since sibling operands are independent of each
+	other, the conversions run on worker threads when the parallel-csg
+	feature is enabled; this is typically the dominant cost of evaluating
+	difference and intersection nodes with preview-cached children.
+*/
+	std::vector<shared_ptr<const CGAL_Nef_polyhedron> > convertChildrenToNefs(const Geometry::ChildList &children)
+	{
+		std::vector<const PolySet *> polysets;
+		std::vector<shared_ptr<const CGAL_Nef_polyhedron> > nefs;
+		size_t numconversions = 0;
+		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+			const shared_ptr<const Geometry> &chgeom = item.second;
+			shared_ptr<const CGAL_Nef_polyhedron> chN =
+				dynamic_pointer_cast<const CGAL_Nef_polyhedron>(chgeom);
+			const PolySet *chps = chN ? NULL : dynamic_cast<const PolySet*>(chgeom.get());
+			if (chps) numconversions++;
+			polysets.push_back(chps);
+			nefs.push_back(chN);
+		}
+
+		size_t numthreads = WorkerPool::numThreads();
+		if (Feature::ExperimentalParallelCSG.is_enabled() && numconversions > 1 && numthreads > 1) {
+			size_t usethreads = std::min(numthreads, numconversions);
+			WorkerPool::TaskGroup tasks;
+			for (size_t t = 0; t < usethreads; t++) {
+				size_t first = nefs.size() * t / usethreads;
+				size_t last = nefs.size() * (t+1) / usethreads;
+				tasks.run(boost::bind(convert_operand_range, &polysets, &nefs, first, last));
+			}
+			tasks.wait();
+		}
+		else {
+			convert_operand_range(&polysets, &nefs, 0, nefs.size());
+		}
+		return nefs;
+	}
+
+	static const char *profileSectionName(OpenSCADOperator op)
+	{
+		switch (op) {
+		case OPENSCAD_UNION: return "cgal/union";
+		case OPENSCAD_INTERSECTION: return "cgal/intersection";
+		case OPENSCAD_DIFFERENCE: return "cgal/difference";
+		case OPENSCAD_MINKOWSKI: return "cgal/minkowski";
+		default: return "cgal/unknown";
+		}
+	}
+
+	static size_t operandBytes(const Geometry::ChildList &children)
+	{
+		size_t bytes = 0;
+		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+			if (item.second) bytes += item.second->memsize();
+		}
+		return bytes;
+	}
+
+	static void applyMinkowskiDecomposed(CGAL_Nef_polyhedron &target, const CGAL_Nef_polyhedron &src);
+
+	/*!
+		Claims a child as a mutable boolean operand. When the child list
+		held the only reference, the operand dies right after the boolean
+		anyway, so the accumulator adopts its halfedge structure instead
+		of deep-copying it - multi-GB intermediates rejected by the caches
+		used to be copied wholesale just to be mutated once and dropped.
+		A cached or otherwise shared child is still deep-copied.
+
+		unique must be the uniqueness of the child list's own reference,
+		sampled before any local aliases of it were created.
+	*/
+	static CGAL_Nef_polyhedron *claimOperand(const shared_ptr<const CGAL_Nef_polyhedron> &chN, bool unique)
+	{
+		if (unique) {
+			CGAL_Nef_polyhedron *N = new CGAL_Nef_polyhedron();
+			N->p3 = chN->p3;
+			return N;
+		}
+		return chN->copy();
+	}
+
 /*!
 	Applies op to all children and stores the result in dest.
 	The child list should be guaranteed to contain non-NULL 3D or empty Geometry objects
 */
 	void applyOperator(const Geometry::ChildList &children, CGAL_Nef_polyhedron &dest, OpenSCADOperator op)
 	{
+		ProfileScope profile(profileSectionName(op));
+		if (Profiler::enabled()) profile.setBytes(operandBytes(children));
+
 		// Speeds up n-ary union operations significantly
 		CGAL::Nef_nary_union_3<CGAL_Nef_polyhedron3> nary_union;
 		int nary_union_num_inserted = 0;
 		CGAL_Nef_polyhedron *N = NULL;
 
+		// For unions every operand is needed, so they're all promoted to Nef
+		// upfront (in parallel if enabled). For the other operators operands
+		// are promoted lazily below; once the accumulator is empty the
+		// remaining operands can't affect the result and Nef construction -
+		// the dominant cost - is skipped for them entirely.
+		std::vector<shared_ptr<const CGAL_Nef_polyhedron> > chNs;
+		if (op == OPENSCAD_UNION) chNs = convertChildrenToNefs(children);
+
+		size_t chidx = 0;
 		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
 			const shared_ptr<const Geometry> &chgeom = item.second;
-			shared_ptr<const CGAL_Nef_polyhedron> chN = 
-				dynamic_pointer_cast<const CGAL_Nef_polyhedron>(chgeom);
-			if (!chN) {
-				const PolySet *chps = dynamic_cast<const PolySet*>(chgeom.get());
-				if (chps) chN.reset(createNefPolyhedronFromGeometry(*chps));
+			bool unique = chgeom.unique(); // sampled before chN aliases it
+
+			if (N && N->isEmpty() && op != OPENSCAD_UNION) {
+				// empty op <something> => empty
+				item.first->progress_report();
+				continue;
+			}
+
+			shared_ptr<const CGAL_Nef_polyhedron> chN;
+			if (op == OPENSCAD_UNION) {
+				chN = chNs[chidx++];
+			}
+			else {
+				chN = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(chgeom);
+				if (!chN) {
+					const PolySet *chps = dynamic_cast<const PolySet*>(chgeom.get());
+					if (chps) {
+						chN.reset(createNefPolyhedronFromGeometry(*chps));
+						unique = true; // freshly converted, nobody else holds it
+					}
+				}
 			}
 
 			if (op == OPENSCAD_UNION) {
@@ -96,7 +331,7 @@ namespace CGALUtils {
 			}
 			// Initialize N with first expected geometric object
 			if (!N) {
-				N = chN->copy();
+				N = claimOperand(chN, unique);
 				continue;
 			}
 
@@ -105,9 +340,6 @@ namespace CGALUtils {
 				if (op == OPENSCAD_INTERSECTION) *N = *chN;
 				continue;
 			}
-            
-            // empty op <something> => empty
-            if (N->isEmpty()) continue;
 
 			CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
 			try {
@@ -119,7 +351,8 @@ namespace CGALUtils {
 					*N -= *chN;
 					break;
 				case OPENSCAD_MINKOWSKI:
-					N->minkowski(*chN);
+					if (Feature::ExperimentalFastMinkowski.is_enabled()) applyMinkowskiDecomposed(*N, *chN);
+					else N->minkowski(*chN);
 					break;
 				default:
 					PRINTB("ERROR: Unsupported CGAL operator: %d", op);
@@ -152,6 +385,228 @@ namespace CGALUtils {
 		if (N) dest = *N;
 	}
 
+	/*!
+		Unions the pairs [2i, 2i+1] of the given reduction level in place,
+		storing each result in slot 2i. Slices of the pair range are handed
+		to worker threads by applyUnionParallel().
+	*/
+	static void union_pair_range(std::vector<shared_ptr<CGAL_Nef_polyhedron> > *operands,
+															 size_t firstpair, size_t lastpair)
+	{
+		for (size_t i = firstpair; i < lastpair; i++) {
+			shared_ptr<CGAL_Nef_polyhedron> &a = (*operands)[2*i];
+			shared_ptr<CGAL_Nef_polyhedron> &b = (*operands)[2*i+1];
+			try {
+				*a += *b;
+			}
+			catch (const CGAL::Failure_exception &e) {
+				PRINTB("CGAL error in CGALUtils::applyUnionParallel: %s", e.what());
+				// Errors can result in corrupt polyhedrons; keep the left operand
+			}
+			b.reset();
+		}
+	}
+
+/*!
+	Reduces the operands to a single polyhedron (left in slot 0) by pairing
+	them into a balanced binary tree and evaluating independent pairs on
+	worker threads. Union of two operands of similar size is much cheaper
+	than accumulating into one huge polyhedron, and the pairs within each
+	reduction level are independent of each other.
+
+	The caller must have set CGAL's error behaviour to THROW_EXCEPTION.
+*/
+	static void unionBalanced(std::vector<shared_ptr<CGAL_Nef_polyhedron> > &operands)
+	{
+		size_t numthreads = WorkerPool::numThreads();
+
+		while (operands.size() > 1) {
+			size_t numpairs = operands.size() / 2;
+			size_t usethreads = std::min(numthreads, numpairs);
+			if (usethreads <= 1) {
+				union_pair_range(&operands, 0, numpairs);
+			}
+			else {
+				WorkerPool::TaskGroup tasks;
+				for (size_t t = 0; t < usethreads; t++) {
+					size_t firstpair = numpairs * t / usethreads;
+					size_t lastpair = numpairs * (t+1) / usethreads;
+					tasks.run(boost::bind(union_pair_range, &operands, firstpair, lastpair));
+				}
+				tasks.wait();
+			}
+			// Compact the surviving operands; an unpaired trailing operand sits
+			// on an even slot and is carried over to the next level as-is.
+			std::vector<shared_ptr<CGAL_Nef_polyhedron> > next;
+			for (size_t i = 0; i < operands.size(); i += 2) next.push_back(operands[i]);
+			operands.swap(next);
+		}
+	}
+
+/*!
+	Unions all children by reducing them as a balanced binary tree on
+	worker threads, see unionBalanced().
+
+	The child list should be guaranteed to contain non-NULL 3D or empty Geometry objects
+*/
+	void applyUnionParallel(const Geometry::ChildList &children, CGAL_Nef_polyhedron &dest)
+	{
+		ProfileScope profile("cgal/union-parallel");
+		if (Profiler::enabled()) profile.setBytes(operandBytes(children));
+
+		std::vector<shared_ptr<CGAL_Nef_polyhedron> > operands;
+		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+			const shared_ptr<const Geometry> &chgeom = item.second;
+			bool unique = chgeom.unique(); // sampled before chN aliases it
+			shared_ptr<const CGAL_Nef_polyhedron> chN =
+				dynamic_pointer_cast<const CGAL_Nef_polyhedron>(chgeom);
+			if (!chN) {
+				const PolySet *chps = dynamic_cast<const PolySet*>(chgeom.get());
+				if (chps) {
+					chN.reset(createNefPolyhedronFromGeometry(*chps));
+					unique = true; // freshly converted, nobody else holds it
+				}
+			}
+			// The reduction mutates every operand in place, so each one is
+			// claimed - adopted when uniquely owned, deep-copied when shared
+			if (chN && !chN->isEmpty()) {
+				operands.push_back(shared_ptr<CGAL_Nef_polyhedron>(claimOperand(chN, unique)));
+			}
+			item.first->progress_report();
+		}
+		if (operands.empty()) return;
+
+		// NB! CGAL's error behaviour is a global setting, so it must be
+		// switched before the workers start and restored after they're done.
+		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+		unionBalanced(operands);
+		CGAL::set_error_behaviour(old_behaviour);
+
+		dest = *operands.front();
+	}
+
+	typedef std::vector<CGAL_Point_3> PointList;
+
+	/*!
+		Splits the Nef into convex cells and collects the vertex points of
+		each cell. The decomposition adds no volume, so summing the cells
+		pairwise reproduces the exact Minkowski sum.
+	*/
+	static void collectConvexParts(const CGAL_Nef_polyhedron3 &N, std::vector<PointList> &parts)
+	{
+		CGAL_Nef_polyhedron3 decomposed = N;
+		CGAL::convex_decomposition_3(decomposed);
+		CGAL_Nef_polyhedron3::Volume_const_iterator vi;
+		CGAL_forall_volumes(vi, decomposed) {
+			if (!vi->mark()) continue; // the unmarked outer volume
+			CGAL_Polyhedron P;
+			decomposed.convert_inner_shell_to_polyhedron(vi->shells_begin(), P);
+			parts.push_back(PointList());
+			PointList &points = parts.back();
+			points.reserve(P.size_of_vertices());
+			for (CGAL_Polyhedron::Vertex_const_iterator pvi = P.vertices_begin();
+					 pvi != P.vertices_end(); ++pvi) {
+				points.push_back(pvi->point());
+			}
+		}
+	}
+
+	/*!
+		Computes the Minkowski sums of the convex part pairs [first, last>:
+		the sum of two convex cells is just the hull of their pairwise vertex
+		sums. Each worker thread of applyMinkowskiDecomposed() runs one
+		instance of this; a pair that fails leaves a NULL slot behind.
+	*/
+	static void minkowski_pair_range(const std::vector<PointList> *aparts,
+																	 const std::vector<PointList> *bparts,
+																	 std::vector<shared_ptr<CGAL_Nef_polyhedron> > *results,
+																	 size_t first, size_t last)
+	{
+		for (size_t idx = first; idx < last; idx++) {
+			const PointList &a = (*aparts)[idx / bparts->size()];
+			const PointList &b = (*bparts)[idx % bparts->size()];
+			try {
+				PointList sums;
+				sums.reserve(a.size() * b.size());
+				for (size_t i = 0; i < a.size(); i++) {
+					for (size_t j = 0; j < b.size(); j++) {
+						sums.push_back(a[i] + (b[j] - CGAL::ORIGIN));
+					}
+				}
+				CGAL_Polyhedron hull;
+				CGAL::convex_hull_3(sums.begin(), sums.end(), hull);
+				(*results)[idx].reset(new CGAL_Nef_polyhedron(new CGAL_Nef_polyhedron3(hull)));
+			}
+			catch (const CGAL::Failure_exception &e) {
+				PRINTB("CGAL error in CGALUtils::applyMinkowskiDecomposed: %s", e.what());
+			}
+		}
+	}
+
+	/*!
+		Minkowski sum by convex decomposition: both operands are split into
+		convex cells, the cells are summed pairwise (a cheap hull of vertex
+		sums, spread across worker threads) and the partial sums are unioned
+		with the balanced-tree reducer. Arithmetic stays on the exact kernel
+		throughout, so the result volume equals minkowski_sum_3's; for
+		non-convex operands this is orders of magnitude faster. Falls back
+		to the plain sum if the decomposition fails.
+	*/
+	static void applyMinkowskiDecomposed(CGAL_Nef_polyhedron &target, const CGAL_Nef_polyhedron &src)
+	{
+		ProfileScope profile("cgal/minkowski-decomposed");
+
+		std::vector<PointList> aparts, bparts;
+		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+		try {
+			collectConvexParts(*target.p3, aparts);
+			collectConvexParts(*src.p3, bparts);
+		}
+		catch (const CGAL::Failure_exception &e) {
+			PRINTB("CGAL error in CGALUtils::applyMinkowskiDecomposed: %s", e.what());
+			aparts.clear();
+			bparts.clear();
+		}
+
+		if (aparts.empty() || bparts.empty()) {
+			CGAL::set_error_behaviour(old_behaviour);
+			target.minkowski(src);
+			return;
+		}
+
+		size_t numpairs = aparts.size() * bparts.size();
+		std::vector<shared_ptr<CGAL_Nef_polyhedron> > results(numpairs);
+		size_t numthreads = std::min(WorkerPool::numThreads(), numpairs);
+		if (numthreads <= 1) {
+			minkowski_pair_range(&aparts, &bparts, &results, 0, numpairs);
+		}
+		else {
+			WorkerPool::TaskGroup tasks;
+			for (size_t t = 0; t < numthreads; t++) {
+				size_t firstpair = numpairs * t / numthreads;
+				size_t lastpair = numpairs * (t+1) / numthreads;
+				tasks.run(boost::bind(minkowski_pair_range, &aparts, &bparts,
+															&results, firstpair, lastpair));
+			}
+			tasks.wait();
+		}
+
+		std::vector<shared_ptr<CGAL_Nef_polyhedron> > operands;
+		BOOST_FOREACH(const shared_ptr<CGAL_Nef_polyhedron> &result, results) {
+			if (result && !result->isEmpty()) operands.push_back(result);
+		}
+
+		if (operands.empty()) {
+			CGAL::set_error_behaviour(old_behaviour);
+			target.minkowski(src);
+			return;
+		}
+
+		unionBalanced(operands);
+		CGAL::set_error_behaviour(old_behaviour);
+		target = *operands.front();
+	}
+
 /*!
 	Modifies target by applying op to target and src:
 	target = target [op] src
@@ -185,7 +640,8 @@ namespace CGALUtils {
 				target -= src;
 				break;
 			case OPENSCAD_MINKOWSKI:
-				target.minkowski(src);
+				if (Feature::ExperimentalFastMinkowski.is_enabled()) applyMinkowskiDecomposed(target, src);
+				else target.minkowski(src);
 				break;
 			default:
 				PRINTB("ERROR: Unsupported CGAL operator: %d", op);
@@ -317,10 +773,9 @@ namespace CGALUtils {
 		}
 		// In projection mode all the triangles are projected manually into the XY plane
 		else {
-			PolySet *ps3 = N.convertToPolyset();
+			shared_ptr<const PolySet> ps3 = N.polySet();
 			if (!ps3) return poly;
 			poly = PolysetUtils::project(*ps3);
-			delete ps3;
 		}
 		return poly;
 	}
@@ -337,6 +792,154 @@ namespace CGALUtils {
 		return result;
 	}
 
+/*!
+	Returns geom intersected with the axis-aligned box, NULL when geom
+	isn't a mesh or the clip fails. The box is a 6-facet convex Nef, so
+	this is far cheaper than intersecting with an arbitrary operand of
+	the same extent, and every later boolean in the chain works on the
+	clipped, much smaller result. See the intersection pre-clip in
+	GeometryEvaluator::applyToChildren3D().
+*/
+	shared_ptr<const Geometry> clipToBoundingBox(const shared_ptr<const Geometry> &geom, const BoundingBox &box)
+	{
+		shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom);
+		CGAL_Nef_polyhedron *clipped = NULL;
+		if (N) {
+			if (!N->isEmpty()) clipped = N->copy();
+		}
+		else {
+			const PolySet *ps = dynamic_cast<const PolySet *>(geom.get());
+			if (ps) clipped = createNefPolyhedronFromGeometry(*ps);
+		}
+		if (!clipped) return shared_ptr<const Geometry>();
+
+		double x1 = box.min()[0], y1 = box.min()[1], z1 = box.min()[2];
+		double x2 = box.max()[0], y2 = box.max()[1], z2 = box.max()[2];
+		PolySet boxps(3);
+
+		boxps.append_poly(); // top
+		boxps.append_vertex(x1, y1, z2);
+		boxps.append_vertex(x2, y1, z2);
+		boxps.append_vertex(x2, y2, z2);
+		boxps.append_vertex(x1, y2, z2);
+
+		boxps.append_poly(); // bottom
+		boxps.append_vertex(x1, y2, z1);
+		boxps.append_vertex(x2, y2, z1);
+		boxps.append_vertex(x2, y1, z1);
+		boxps.append_vertex(x1, y1, z1);
+
+		boxps.append_poly(); // side1
+		boxps.append_vertex(x1, y1, z1);
+		boxps.append_vertex(x2, y1, z1);
+		boxps.append_vertex(x2, y1, z2);
+		boxps.append_vertex(x1, y1, z2);
+
+		boxps.append_poly(); // side2
+		boxps.append_vertex(x2, y1, z1);
+		boxps.append_vertex(x2, y2, z1);
+		boxps.append_vertex(x2, y2, z2);
+		boxps.append_vertex(x2, y1, z2);
+
+		boxps.append_poly(); // side3
+		boxps.append_vertex(x2, y2, z1);
+		boxps.append_vertex(x1, y2, z1);
+		boxps.append_vertex(x1, y2, z2);
+		boxps.append_vertex(x2, y2, z2);
+
+		boxps.append_poly(); // side4
+		boxps.append_vertex(x1, y2, z1);
+		boxps.append_vertex(x1, y1, z1);
+		boxps.append_vertex(x1, y1, z2);
+		boxps.append_vertex(x1, y2, z2);
+
+		shared_ptr<CGAL_Nef_polyhedron> boxN(createNefPolyhedronFromGeometry(boxps));
+
+		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+		try {
+			*clipped *= *boxN;
+		}
+		catch (const CGAL::Failure_exception &e) {
+			PRINTB("CGAL error in CGALUtils::clipToBoundingBox: %s", e.what());
+			delete clipped;
+			clipped = NULL;
+		}
+		CGAL::set_error_behaviour(old_behaviour);
+		return shared_ptr<const Geometry>(clipped);
+	}
+
+	// Magic/version line opening every serialized Nef frame
+	static const char *NEF3_FRAME_MAGIC = "OpenSCAD-NEF3 1";
+
+/*!
+	Writes N to stream as one self-delimiting frame, preserving CGAL's
+	exact coordinates: the magic/version line, a decimal payload length
+	line, then exactly that many bytes of CGAL Nef_polyhedron_3 stream
+	data. Frames can be concatenated and skipped without parsing the
+	payload, so a farm scheduler can ship subtree results between
+	processes and combine them with applyOperator(). Returns false on a
+	write error.
+*/
+	bool serializeNefPolyhedron(const CGAL_Nef_polyhedron &N, std::ostream &stream)
+	{
+		std::ostringstream payload;
+		if (!N.isEmpty()) payload << *N.p3;
+		const std::string buf = payload.str();
+		stream << NEF3_FRAME_MAGIC << "\n" << buf.size() << "\n";
+		if (!buf.empty()) stream.write(buf.data(), buf.size());
+		return stream.good() != 0;
+	}
+
+/*!
+	Reads one frame written by serializeNefPolyhedron() and returns the
+	reconstructed polyhedron, or NULL if the stream doesn't hold a valid
+	frame. A zero-length payload round-trips the empty polyhedron.
+*/
+	CGAL_Nef_polyhedron *deserializeNefPolyhedron(std::istream &stream)
+	{
+		std::string magic;
+		std::getline(stream, magic);
+		if (magic != NEF3_FRAME_MAGIC) {
+			PRINT("WARNING: Stream does not start with a serialized Nef polyhedron frame");
+			return NULL;
+		}
+		size_t length = 0;
+		stream >> length;
+		stream.get(); // the newline terminating the length line
+		if (!stream.good()) {
+			PRINT("WARNING: Corrupt Nef polyhedron frame header");
+			return NULL;
+		}
+		if (length == 0) return new CGAL_Nef_polyhedron();
+
+		std::vector<char> buf(length);
+		stream.read(&buf[0], length);
+		if (stream.fail()) {
+			PRINT("WARNING: Truncated Nef polyhedron frame");
+			return NULL;
+		}
+
+		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+		CGAL_Nef_polyhedron *N = NULL;
+		try {
+			std::istringstream payload(std::string(&buf[0], length));
+			CGAL_Nef_polyhedron3 *p3 = new CGAL_Nef_polyhedron3;
+			payload >> *p3;
+			if (payload.fail()) {
+				delete p3;
+				PRINT("WARNING: Corrupt Nef polyhedron frame payload");
+			}
+			else {
+				N = new CGAL_Nef_polyhedron(p3);
+			}
+		}
+		catch (const CGAL::Failure_exception &e) {
+			PRINTB("CGAL error in CGALUtils::deserializeNefPolyhedron: %s", e.what());
+		}
+		CGAL::set_error_behaviour(old_behaviour);
+		return N;
+	}
+
 };
 
 template <typename Polyhedron>
@@ -809,7 +1412,13 @@ bool tessellate_3d_face_with_holes( std::vector<CGAL_Polygon_3> &polygons, std::
 	formats) do not allow for holes in their faces. The function documents 
 	the method used to deal with this
 */
-bool createPolySetFromNefPolyhedron3(const CGAL_Nef_polyhedron3 &N, PolySet &ps)
+/*!
+	Walks the Nef halffacets and triangulates them one facet at a time,
+	handing each triangle to the callback. Nothing is accumulated, so
+	streaming consumers (the STL exporter in particular) stay at O(1)
+	geometry memory regardless of model size.
+*/
+bool CGALUtils::streamNefTriangles(const CGAL_Nef_polyhedron3 &N, TriangleCallback emit, void *userdata)
 {
 	bool err = false;
 	CGAL_Nef_polyhedron3::Halffacet_const_iterator hfaceti;
@@ -843,29 +1452,36 @@ bool createPolySetFromNefPolyhedron3(const CGAL_Nef_polyhedron3 &N, PolySet &ps)
 				PRINT("WARNING: triangle doesn't have 3 points. skipping");
 				continue;
 			}
-			ps.append_poly();
+			Vector3d v[3];
 			for (size_t j=0;j<3;j++) {
-				double x1,y1,z1;
-				x1 = CGAL::to_double( triangles[i][j].x() );
-				y1 = CGAL::to_double( triangles[i][j].y() );
-				z1 = CGAL::to_double( triangles[i][j].z() );
-				ps.append_vertex(x1,y1,z1);
+				v[j] << CGAL::to_double( triangles[i][j].x() ),
+					CGAL::to_double( triangles[i][j].y() ),
+					CGAL::to_double( triangles[i][j].z() );
 			}
+			emit(v[0], v[1], v[2], userdata);
 		}
 	}
 	return err;
 }
 
-#undef GEN_SURFACE_DEBUG
+static void append_triangle_to_polyset(const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, void *userdata)
+{
+	PolySet *ps = static_cast<PolySet *>(userdata);
+	ps->append_poly();
+	ps->append_vertex(p0[0], p0[1], p0[2]);
+	ps->append_vertex(p1[0], p1[1], p1[2]);
+	ps->append_vertex(p2[0], p2[1], p2[2]);
+}
 
-namespace Eigen {
-	size_t hash_value(Vector3d const &v) {
-		size_t seed = 0;
-		for (int i=0;i<3;i++) boost::hash_combine(seed, v[i]);
-		return seed;
-	}
+bool createPolySetFromNefPolyhedron3(const CGAL_Nef_polyhedron3 &N, PolySet &ps)
+{
+	bool err = CGALUtils::streamNefTriangles(N, &append_triangle_to_polyset, &ps);
+	if (!err) ps.maybeSpillToDisk();
+	return err;
 }
 
+#undef GEN_SURFACE_DEBUG
+
 class CGAL_Build_PolySet : public CGAL::Modifier_base<CGAL_HDS>
 {
 public:
@@ -1102,6 +1718,8 @@ void ZRemover::visit( CGAL_Nef_polyhedron3::Halffacet_const_handle hfacet )
 
 static CGAL_Nef_polyhedron *createNefPolyhedronFromPolySet(const PolySet &ps)
 {
+	ps.ensureLoaded(); // the CGAL builder walks the boxed polygons
+
 	if (ps.isEmpty()) return new CGAL_Nef_polyhedron();
 	assert(ps.getDimension() == 3);
 
@@ -1144,7 +1762,7 @@ static CGAL_Nef_polyhedron *createNefPolyhedronFromPolySet(const PolySet &ps)
 
 static CGAL_Nef_polyhedron *createNefPolyhedronFromPolygon2d(const Polygon2d &polygon)
 {
-	shared_ptr<PolySet> ps(polygon.tessellate());
+	shared_ptr<const PolySet> ps = polygon.tessellated();
 	return createNefPolyhedronFromPolySet(*ps);
 }
 
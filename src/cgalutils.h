@@ -8,9 +8,26 @@
 namespace CGALUtils {
 	bool applyHull(const Geometry::ChildList &children, PolySet &P);
 	void applyOperator(const Geometry::ChildList &children, CGAL_Nef_polyhedron &dest, OpenSCADOperator op);
+	void applyUnionParallel(const Geometry::ChildList &children, CGAL_Nef_polyhedron &dest);
+	// One Nef per child, converting PolySet children (in parallel when
+	// enabled); already-Nef children are passed through
+	std::vector<shared_ptr<const CGAL_Nef_polyhedron> > convertChildrenToNefs(const Geometry::ChildList &children);
 	void applyBinaryOperator(CGAL_Nef_polyhedron &target, const CGAL_Nef_polyhedron &src, OpenSCADOperator op);
 	Polygon2d *project(const CGAL_Nef_polyhedron &N, bool cut);
 	CGAL_Iso_cuboid_3 boundingBox(const CGAL_Nef_polyhedron3 &N);
+	shared_ptr<const Geometry> clipToBoundingBox(const shared_ptr<const Geometry> &geom, const BoundingBox &box);
+
+	//! Receives one triangle at a time from streamNefTriangles()
+	typedef void (*TriangleCallback)(const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, void *userdata);
+	// Triangulates the Nef facet by facet and streams the triangles to
+	// the callback without materializing them; backs the streaming STL
+	// export and the Nef->PolySet conversion
+	bool streamNefTriangles(const CGAL_Nef_polyhedron3 &N, TriangleCallback emit, void *userdata);
+
+	// Exact, framed Nef handoff between processes (see cgalutils.cc);
+	// also behind the .nef3 export suffix
+	bool serializeNefPolyhedron(const CGAL_Nef_polyhedron &N, std::ostream &stream);
+	CGAL_Nef_polyhedron *deserializeNefPolyhedron(std::istream &stream);
 };
 
 CGAL_Nef_polyhedron *createNefPolyhedronFromGeometry(const class Geometry &geom);
@@ -5,6 +5,58 @@
 #include "GeometryEvaluator.h"
 #include "progress.h"
 #include "printutils.h"
+#include "renderstaging.h"
+#include "feature.h"
+#include "polyset.h"
+#include "polyset-utils.h"
+#include "CGAL_Nef_polyhedron.h"
+
+// Cell size of the first decimation level, as a fraction of the bounding
+// box diagonal; each further level doubles the cell, quartering the
+// triangle count to match selectLOD()'s thresholds (see renderer.cc)
+#define LOD_DECIMATE_CELLS 256
+#define LOD_DECIMATE_MIN_FACES 10000
+#define LOD_DECIMATE_MAX_LEVELS 6
+
+// lod-preview: hang ever coarser display meshes behind the exact render
+// result, mirroring what the curved primitives do for preview geometry
+// (see primitives.cc). The chain is advisory display state attached
+// before the result is announced to the GUI, so nothing can be reading
+// it yet; exact data is untouched and exports never see the chain.
+static void attach_display_lods(const shared_ptr<const Geometry> &root_geom)
+{
+	if (root_geom->getDimension() != 3 || root_geom->getCoarserLOD()) return;
+
+	shared_ptr<const PolySet> base = dynamic_pointer_cast<const PolySet>(root_geom);
+	if (!base) {
+		const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron *>(root_geom.get());
+		if (!N || N->isEmpty()) return;
+		base.reset(N->convertToPolyset());
+	}
+	if (!base || base->isEmpty() || base->numPolygons() < LOD_DECIMATE_MIN_FACES) return;
+
+	BoundingBox bbox = root_geom->getBoundingBox();
+	double diagonal = (bbox.max() - bbox.min()).norm();
+	if (!(diagonal > 0)) return;
+
+	double cell = diagonal / LOD_DECIMATE_CELLS;
+	size_t previous = base->numPolygons();
+	Geometry *attach_to = const_cast<Geometry *>(root_geom.get());
+	for (int level = 0; level < LOD_DECIMATE_MAX_LEVELS; level++, cell *= 2) {
+		PolySet *coarse = new PolySet(3);
+		PolysetUtils::decimate(*base, *coarse, cell);
+		size_t count = coarse->numPolygons();
+		// Stop once a level stops paying for itself
+		if (count == 0 || count * 4 > previous * 3) {
+			delete coarse;
+			break;
+		}
+		coarse->setConvexity(root_geom->getConvexity());
+		attach_to->setCoarserLOD(shared_ptr<const Geometry>(coarse));
+		attach_to = coarse;
+		previous = count;
+	}
+}
 
 CGALWorker::CGALWorker()
 {
@@ -28,6 +80,8 @@ void CGALWorker::start(const Tree &tree)
 void CGALWorker::work()
 {
 	shared_ptr<const Geometry> root_geom;
+	bool staging = Feature::ExperimentalProgressiveRender.is_enabled();
+	if (staging) RenderStagingList::instance()->begin();
 	try {
 		GeometryEvaluator evaluator(*this->tree);
 		root_geom = evaluator.evaluateGeometry(*this->tree->root(), true);
@@ -35,6 +89,11 @@ void CGALWorker::work()
 	catch (const ProgressCancelException &e) {
 		PRINT("Rendering cancelled.");
 	}
+	if (staging) RenderStagingList::instance()->end();
+
+	if (root_geom && Feature::ExperimentalLodPreview.is_enabled()) {
+		attach_display_lods(root_geom);
+	}
 
 	emit done(root_geom);
 	thread->quit();
@@ -1,8 +1,61 @@
 #include "clipper-utils.h"
+#include "feature.h"
+#include "workerpool.h"
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 
 namespace ClipperUtils {
 
+	/*!
+		Per-thread pool of reusable Clipper engines. Constructing an engine
+		per operation rebuilds its internal edge storage from scratch, which
+		dominates the cost of the tens of thousands of small 2D ops a
+		sheet-nesting model performs; leasing a cleared engine keeps one
+		instance - and its warmed allocations - hot across a sequence of
+		operations. The pool is thread-local so the parallel union workers
+		each reuse their own engines without locking, and a scoped lease
+		keeps nested uses on separate instances.
+	*/
+	namespace {
+		void delete_engine_pool(std::vector<ClipperLib::Clipper *> *pool)
+		{
+			for (size_t i = 0; i < pool->size(); i++) delete (*pool)[i];
+			delete pool;
+		}
+
+		boost::thread_specific_ptr<std::vector<ClipperLib::Clipper *> > engine_pool_tss(delete_engine_pool);
+		boost::thread_specific_ptr<ClipperLib::ClipperOffset> offset_engine_tss;
+
+		class ClipperLease {
+		public:
+			ClipperLease() {
+				std::vector<ClipperLib::Clipper *> *pool = engine_pool_tss.get();
+				if (!pool) {
+					pool = new std::vector<ClipperLib::Clipper *>();
+					engine_pool_tss.reset(pool);
+				}
+				if (pool->empty()) {
+					this->engine = new ClipperLib::Clipper();
+				}
+				else {
+					this->engine = pool->back();
+					pool->pop_back();
+				}
+			}
+			~ClipperLease() {
+				this->engine->Clear();
+				std::vector<ClipperLib::Clipper *> *pool = engine_pool_tss.get();
+				// Two engines cover the deepest nesting (merge over workers);
+				// anything beyond that is returned to the allocator
+				if (pool && pool->size() < 2) pool->push_back(this->engine);
+				else delete this->engine;
+			}
+			ClipperLib::Clipper &get() { return *this->engine; }
+		private:
+			ClipperLib::Clipper *engine;
+		};
+	}
+
 	ClipperLib::Path fromOutline2d(const Outline2d &outline, bool keep_orientation) {
 		ClipperLib::Path p;
 		BOOST_FOREACH(const Vector2d &v, outline.vertices) {
@@ -16,20 +69,28 @@ namespace ClipperUtils {
 	}
 
 	ClipperLib::Paths fromPolygon2d(const Polygon2d &poly) {
-		ClipperLib::Paths result;
+		shared_ptr<const CachedClipperPaths> cached = poly.clipperCache();
+		if (cached) return cached->paths;
+
+		shared_ptr<CachedClipperPaths> entry(new CachedClipperPaths);
 		BOOST_FOREACH(const Outline2d &outline, poly.outlines()) {
-			result.push_back(fromOutline2d(outline, poly.isSanitized() ? true : false));
+			entry->paths.push_back(fromOutline2d(outline, poly.isSanitized() ? true : false));
 		}
-		return result;
+		poly.setClipperCache(entry);
+		return entry->paths;
 	}
 
 	Polygon2d *sanitize(const Polygon2d &poly) {
+		// Clipper-produced polygons are clean by construction; don't pay
+		// for another union round-trip just to confirm it
+		if (poly.isSanitized()) return new Polygon2d(poly);
 		return toPolygon2d(sanitize(ClipperUtils::fromPolygon2d(poly)));
 	}
 
 	ClipperLib::PolyTree sanitize(const ClipperLib::Paths &paths) {
 		ClipperLib::PolyTree result;
-		ClipperLib::Clipper clipper;
+		ClipperLease lease;
+		ClipperLib::Clipper &clipper = lease.get();
 		clipper.AddPaths(paths, ClipperLib::ptSubject, true);
 		clipper.Execute(ClipperLib::ctUnion, result, ClipperLib::pftEvenOdd);
 		return result;
@@ -45,6 +106,7 @@ namespace ClipperUtils {
 		const double CLEANING_DISTANCE = 0.001 * CLIPPER_SCALE;
 
 		Polygon2d *result = new Polygon2d;
+		shared_ptr<CachedClipperPaths> entry(new CachedClipperPaths);
 		const ClipperLib::PolyNode *node = poly.GetFirst();
 		while (node) {
 			Outline2d outline;
@@ -60,11 +122,16 @@ namespace ClipperUtils {
 					outline.vertices.push_back(v);
 				}
 				result->addOutline(outline);
+				entry->paths.push_back(cleaned_path);
 			}
 
 			node = node->GetNext();
 		}
 		result->setSanitized(true);
+		// The cleaned paths are exactly the integer representation of the
+		// outlines just built, so chained Clipper operations can pick them
+		// up without rescaling
+		result->setClipperCache(entry);
 		return result;
 	}
 
@@ -73,16 +140,112 @@ namespace ClipperUtils {
 														ClipperLib::PolyFillType polytype)
 	{
 		ClipperLib::Paths result;
-		ClipperLib::Clipper clipper;
+		ClipperLease lease;
+		ClipperLib::Clipper &clipper = lease.get();
 		clipper.AddPaths(polygons, ClipperLib::ptSubject, true);
 		clipper.Execute(cliptype, result, polytype);
 		return result;
 	}
 
+	/*!
+		Unions the subpaths [first, last> of one large path set on a private
+		Clipper engine; each worker of unionProjected() runs one batch.
+	*/
+	static void union_subpaths_range(const ClipperLib::Paths *paths,
+																	 size_t first, size_t last, ClipperLib::Paths *result)
+	{
+		ClipperLease lease;
+		ClipperLib::Clipper &clipper = lease.get();
+		for (size_t i = first; i < last; i++) {
+			clipper.AddPath((*paths)[i], ClipperLib::ptSubject, true);
+		}
+		clipper.Execute(ClipperLib::ctUnion, *result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+	}
+
+	/*!
+		Unions the projected facets of one mesh into a set of outlines.
+		Projections turn every facet into a subject path, so big models are
+		reduced in parallel batches before the final merge; NonZero filling
+		keeps shared mesh edges from opening up into holes.
+	*/
+	ClipperLib::Paths unionProjected(const ClipperLib::Paths &triangles)
+	{
+		if (Feature::ExperimentalParallelUnion.is_enabled() && triangles.size() > 256) {
+			size_t numthreads = std::min(WorkerPool::numThreads(),
+																	 triangles.size() / 128);
+			if (numthreads > 1) {
+				std::vector<ClipperLib::Paths> partials(numthreads);
+				WorkerPool::TaskGroup tasks;
+				for (size_t t = 0; t < numthreads; t++) {
+					size_t first = triangles.size() * t / numthreads;
+					size_t last = triangles.size() * (t+1) / numthreads;
+					tasks.run(boost::bind(union_subpaths_range, &triangles,
+																first, last, &partials[t]));
+				}
+				tasks.wait();
+
+				ClipperLease lease;
+				ClipperLib::Clipper &clipper = lease.get();
+				BOOST_FOREACH(const ClipperLib::Paths &paths, partials) {
+					clipper.AddPaths(paths, ClipperLib::ptSubject, true);
+				}
+				ClipperLib::Paths result;
+				clipper.Execute(ClipperLib::ctUnion, result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+				return result;
+			}
+		}
+		return process(triangles, ClipperLib::ctUnion, ClipperLib::pftNonZero);
+	}
+
+	/*!
+		Unions the operands [first, last> into a single Paths result.
+		Each worker thread of the parallel union runs one instance of this
+		on its own Clipper engine; Clipper executions share no state.
+	*/
+	static void union_paths_range(const std::vector<ClipperLib::Paths> *pathsvector,
+																size_t first, size_t last, ClipperLib::Paths *result)
+	{
+		ClipperLease lease;
+		ClipperLib::Clipper &clipper = lease.get();
+		for (size_t i = first; i < last; i++) {
+			clipper.AddPaths((*pathsvector)[i], ClipperLib::ptSubject, true);
+		}
+		clipper.Execute(ClipperLib::ctUnion, *result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+	}
+
 	Polygon2d *apply(const std::vector<ClipperLib::Paths> &pathsvector,
 									 ClipperLib::ClipType clipType)
 	{
-		ClipperLib::Clipper clipper;
+		ClipperLease lease;
+		ClipperLib::Clipper &clipper = lease.get();
+
+		// Large unions are reduced in parallel: each worker unions a chunk
+		// of the operands, then the partial results are merged with one
+		// final execution.
+		if (clipType == ClipperLib::ctUnion && pathsvector.size() > 8 &&
+				Feature::ExperimentalParallelUnion.is_enabled()) {
+			size_t numthreads = std::min(WorkerPool::numThreads(),
+																	 pathsvector.size() / 4);
+			if (numthreads > 1) {
+				std::vector<ClipperLib::Paths> partials(numthreads);
+				WorkerPool::TaskGroup tasks;
+				for (size_t t = 0; t < numthreads; t++) {
+					size_t first = pathsvector.size() * t / numthreads;
+					size_t last = pathsvector.size() * (t+1) / numthreads;
+					tasks.run(boost::bind(union_paths_range, &pathsvector,
+																first, last, &partials[t]));
+				}
+				tasks.wait();
+
+				BOOST_FOREACH(const ClipperLib::Paths &paths, partials) {
+					clipper.AddPaths(paths, ClipperLib::ptSubject, true);
+				}
+				ClipperLib::PolyTree sumresult;
+				clipper.Execute(ClipperLib::ctUnion, sumresult, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+				if (sumresult.Total() == 0) return NULL;
+				return ClipperUtils::toPolygon2d(sumresult);
+			}
+		}
 
 		if (clipType == ClipperLib::ctIntersection && pathsvector.size() > 2) {
 			// intersection operations must be split into a sequence of binary operations
@@ -199,7 +362,8 @@ namespace ClipperUtils {
 	{
 		if (polygons.size() == 1) return new Polygon2d(*polygons[0]); // Just copy
 
-		ClipperLib::Clipper c;
+		ClipperLease lease;
+		ClipperLib::Clipper &c = lease.get();
 		ClipperLib::Paths lhs = ClipperUtils::fromPolygon2d(*polygons[0]);
 
 		for (size_t i=1; i<polygons.size(); i++) {
@@ -235,7 +399,17 @@ namespace ClipperUtils {
 	}
 
 	Polygon2d *applyOffset(const Polygon2d& poly, double offset, ClipperLib::JoinType joinType, double miter_limit, double arc_tolerance) {
-		ClipperLib::ClipperOffset co(miter_limit, arc_tolerance * CLIPPER_SCALE);
+		// The offsetter is reused the same way; its join parameters are
+		// plain public fields, reset per call
+		ClipperLib::ClipperOffset *co_engine = offset_engine_tss.get();
+		if (!co_engine) {
+			co_engine = new ClipperLib::ClipperOffset();
+			offset_engine_tss.reset(co_engine);
+		}
+		ClipperLib::ClipperOffset &co = *co_engine;
+		co.Clear();
+		co.MiterLimit = miter_limit;
+		co.ArcTolerance = arc_tolerance * CLIPPER_SCALE;
 		co.AddPaths(fromPolygon2d(poly), joinType, ClipperLib::etClosedPolygon);
 		ClipperLib::PolyTree result;
 		co.Execute(result, offset * CLIPPER_SCALE);
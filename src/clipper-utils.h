@@ -3,6 +3,20 @@
 #include "polyclipping/clipper.hpp"
 #include "Polygon2d.h"
 
+/*!
+	Holds the integer-space Clipper representation of a Polygon2d.
+	Attached to the polygon by ClipperUtils::fromPolygon2d() and
+	toPolygon2d() so that a polygon participating in many 2D booleans
+	(e.g. nested difference chains) pays for the double<->IntPoint
+	scaling only once. Entries are immutable; mutating the polygon
+	simply drops its reference.
+*/
+class CachedClipperPaths
+{
+public:
+	ClipperLib::Paths paths;
+};
+
 namespace ClipperUtils {
 
 	static const unsigned int CLIPPER_SCALE = 2 << 17;
@@ -12,8 +26,9 @@ namespace ClipperUtils {
 	ClipperLib::PolyTree sanitize(const ClipperLib::Paths &paths);
 	Polygon2d *sanitize(const Polygon2d &poly);
 	Polygon2d *toPolygon2d(const ClipperLib::PolyTree &poly);
-	ClipperLib::Paths process(const ClipperLib::Paths &polygons, 
+	ClipperLib::Paths process(const ClipperLib::Paths &polygons,
 														ClipperLib::ClipType, ClipperLib::PolyFillType);
+	ClipperLib::Paths unionProjected(const ClipperLib::Paths &triangles);
 	Polygon2d *applyOffset(const Polygon2d& poly, double offset, ClipperLib::JoinType joinType, double miter_limit, double arc_tolerance);
 	Polygon2d *applyMinkowski(const std::vector<const Polygon2d*> &polygons);
 	Polygon2d *apply(const std::vector<const Polygon2d*> &polygons, ClipperLib::ClipType);
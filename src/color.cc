@@ -93,7 +93,7 @@ AbstractNode *ColorModule::instantiate(const Context *ctx, const ModuleInstantia
 	return node;
 }
 
-std::string ColorNode::toString() const
+std::string ColorNode::computeString() const
 {
 	std::stringstream stream;
 
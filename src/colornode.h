@@ -11,8 +11,9 @@ public:
   virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const;
+	virtual AbstractNode *cloneNode() const { return new ColorNode(*this); }
 
 	Color4f color;
 };
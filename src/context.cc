@@ -36,7 +36,79 @@
 namespace fs = boost::filesystem;
 #include "boosty.h"
 
-// $children is not a config_variable. config_variables have dynamic scope, 
+ValueMap::ValueMap(const ValueMap &other)
+	: entries(other.entries), index(NULL)
+{
+	if (other.index) build_index();
+}
+
+ValueMap &ValueMap::operator=(const ValueMap &other)
+{
+	if (this != &other) {
+		this->entries = other.entries;
+		delete this->index;
+		this->index = NULL;
+		if (other.index) build_index();
+	}
+	return *this;
+}
+
+ValueMap::~ValueMap()
+{
+	delete this->index;
+}
+
+void ValueMap::build_index()
+{
+	this->index = new IndexMap;
+	for (size_t i = 0; i < this->entries.size(); i++) {
+		(*this->index)[this->entries[i].first] = i;
+	}
+}
+
+ValueMap::const_iterator ValueMap::find(const std::string &name) const
+{
+	if (this->index) {
+		IndexMap::const_iterator it = this->index->find(name);
+		return it == this->index->end() ? end() : begin() + it->second;
+	}
+	for (const_iterator it = this->entries.begin(); it != this->entries.end(); it++) {
+		if (it->first == name) return it;
+	}
+	return end();
+}
+
+Value &ValueMap::operator[](const std::string &name)
+{
+	if (this->index) {
+		IndexMap::const_iterator it = this->index->find(name);
+		if (it != this->index->end()) return this->entries[it->second].second;
+	}
+	else {
+		for (size_t i = 0; i < this->entries.size(); i++) {
+			if (this->entries[i].first == name) return this->entries[i].second;
+		}
+	}
+	this->entries.push_back(value_type(name, Value()));
+	if (this->index) (*this->index)[name] = this->entries.size() - 1;
+	else if (this->entries.size() > SPILL_THRESHOLD) build_index();
+	return this->entries.back().second;
+}
+
+int SpecialSnapshot::index(const std::string &name)
+{
+	if (name.size() == 2) return name[0] == '$' && name[1] == 't' ? T : -1;
+	if (name.size() == 3 && name[0] == '$' && name[1] == 'f') {
+		switch (name[2]) {
+		case 'n': return FN;
+		case 's': return FS;
+		case 'a': return FA;
+		}
+	}
+	return -1;
+}
+
+// $children is not a config_variable. config_variables have dynamic scope,
 // meaning they are passed down the call chain implicitly.
 // $children is simply misnamed and shouldn't have included the '$'.
 static bool is_config_variable(const std::string &name) {
@@ -49,7 +121,7 @@ static bool is_config_variable(const std::string &name) {
 	created, and all children will share the root parent's stack.
 */
 Context::Context(const Context *parent)
-	: parent(parent)
+	: parent(parent), owns_stack(parent == NULL)
 {
 	if (parent) {
 		assert(parent->ctx_stack && "Parent context stack was null!");
@@ -60,6 +132,25 @@ Context::Context(const Context *parent)
 		this->ctx_stack = new Stack;
 	}
 
+	// The stack top, not the lexical parent, is the dynamically
+	// enclosing scope the special-variable walk would consult first
+	if (!this->ctx_stack->empty()) this->specials = this->ctx_stack->back()->specials;
+	this->ctx_stack->push_back(this);
+}
+
+/*!
+	Creates a context whose stack is a private copy of the parent's
+	instead of being shared with it. Used for contexts living on worker
+	threads (see parallel-for in control.cc), where pushing onto the
+	shared stack would race; the parent chain itself is only read.
+*/
+Context::Context(const Context *parent, DetachedTag)
+	: parent(parent), owns_stack(true)
+{
+	assert(parent && parent->ctx_stack && "Parent context stack was null!");
+	this->ctx_stack = new Stack(*parent->ctx_stack);
+	this->document_path = parent->document_path;
+	if (!this->ctx_stack->empty()) this->specials = this->ctx_stack->back()->specials;
 	this->ctx_stack->push_back(this);
 }
 
@@ -67,7 +158,7 @@ Context::~Context()
 {
 	assert(this->ctx_stack && "Context stack was null at destruction!");
 	this->ctx_stack->pop_back();
-	if (!parent) delete this->ctx_stack;
+	if (this->owns_stack) delete this->ctx_stack;
 }
 
 /*!
@@ -78,7 +169,17 @@ void Context::setVariables(const AssignmentList &args,
 													 const EvalContext *evalctx)
 {
 	BOOST_FOREACH(const Assignment &arg, args) {
-		set_variable(arg.first, arg.second ? arg.second->evaluate(this->parent) : Value());
+		if (arg.second) {
+			// Constant defaults - the bulk of library module parameters -
+			// fold once per Expression (owned by the Module, so once per
+			// ModuleCache lifetime) and are cloned from the folded Value
+			// instead of being re-interpreted per instantiation.
+			const Value *constval = arg.second->constValue();
+			set_variable(arg.first, constval ? *constval : arg.second->evaluate(this->parent));
+		}
+		else {
+			set_variable(arg.first, Value());
+		}
 	}
 
 	if (evalctx) {
@@ -97,7 +198,11 @@ void Context::setVariables(const AssignmentList &args,
 
 void Context::set_variable(const std::string &name, const Value &value)
 {
-	if (is_config_variable(name)) this->config_variables[name] = value;
+	if (is_config_variable(name)) {
+		this->config_variables[name] = value;
+		int si = SpecialSnapshot::index(name);
+		if (si >= 0) this->specials.values[si] = value;
+	}
 	else this->variables[name] = value;
 }
 
@@ -118,6 +223,8 @@ Value Context::lookup_variable(const std::string &name, bool silent) const
 		return Value();
 	}
 	if (is_config_variable(name)) {
+		int si = SpecialSnapshot::index(name);
+		if (si >= 0) return this->specials.values[si];
 		for (int i = this->ctx_stack->size()-1; i >= 0; i--) {
 			const ValueMap &confvars = ctx_stack->at(i)->config_variables;
 			if (confvars.find(name) != confvars.end())
@@ -136,6 +243,36 @@ Value Context::lookup_variable(const std::string &name, bool silent) const
 	return Value();
 }
 
+/*!
+	Like lookup_variable(), but returns a pointer to the Value stored in
+	the scope tables - NULL when the name is unbound - instead of a copy.
+	Lets hot paths like vector indexing read a variable in place; the
+	pointer is only valid until the owning context is mutated or
+	destroyed, so callers must not hold it across evaluation.
+*/
+const Value *Context::lookup_variable_ref(const std::string &name) const
+{
+	if (!this->ctx_stack) return NULL;
+	if (is_config_variable(name)) {
+		int si = SpecialSnapshot::index(name);
+		if (si >= 0) return &this->specials.values[si];
+		for (int i = this->ctx_stack->size()-1; i >= 0; i--) {
+			const ValueMap &confvars = ctx_stack->at(i)->config_variables;
+			ValueMap::const_iterator it = confvars.find(name);
+			if (it != confvars.end()) return &it->second;
+		}
+		return NULL;
+	}
+	if (!this->parent) {
+		ValueMap::const_iterator it = this->constants.find(name);
+		if (it != this->constants.end()) return &it->second;
+	}
+	ValueMap::const_iterator it = this->variables.find(name);
+	if (it != this->variables.end()) return &it->second;
+	if (this->parent) return this->parent->lookup_variable_ref(name);
+	return NULL;
+}
+
 bool Context::has_local_variable(const std::string &name) const
 {
 	if (is_config_variable(name))
@@ -145,10 +282,27 @@ bool Context::has_local_variable(const std::string &name) const
 	return variables.find(name) != variables.end();
 }
 
-Value Context::evaluate_function(const std::string &name, const EvalContext *evalctx) const
+/*!
+	Copies every special variable visible from this context into dest,
+	with the nearest binding winning, mirroring the stack walk in
+	lookup_variable(). Gives Module::instantiate a complete picture of
+	the dynamic $-variable environment for its memoization key.
+*/
+void Context::collectConfigVariables(std::map<std::string, Value> &dest) const
+{
+	if (!this->ctx_stack) return;
+	for (size_t i = 0; i < this->ctx_stack->size(); i++) {
+		const ValueMap &confvars = this->ctx_stack->at(i)->config_variables;
+		BOOST_FOREACH(const ValueMap::value_type &v, confvars) {
+			dest[v.first] = v.second;
+		}
+	}
+}
+
+Value Context::evaluate_function(const HashedName &name, const EvalContext *evalctx) const
 {
 	if (this->parent) return this->parent->evaluate_function(name, evalctx);
-	PRINTB("WARNING: Ignoring unknown function '%s'.", name);
+	PRINTB("WARNING: Ignoring unknown function '%s'.", name.name());
 	return Value();
 }
 
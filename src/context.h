@@ -2,19 +2,116 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
 #include "value.h"
 #include "typedefs.h"
+#include "evalarena.h"
+
+/*!
+	An identifier bundled with its precomputed hash. Call names are fixed
+	at parse time, so the hash is computed once per AST node and reused
+	by every scope level during resolution, instead of rehashing the
+	string in each container lookup. Hashing matches the default
+	boost::hash<std::string> of the scope containers, which accept a
+	HashedName as a compatible key through the functors below.
+*/
+class HashedName
+{
+public:
+	HashedName(const std::string &name)
+		: name_ptr(&name), name_hash(boost::hash<std::string>()(name)) {}
+	HashedName(const std::string &name, std::size_t hash)
+		: name_ptr(&name), name_hash(hash) {}
+	const std::string &name() const { return *this->name_ptr; }
+	std::size_t hash() const { return this->name_hash; }
+private:
+	const std::string *name_ptr; // not owned; must outlive the resolution
+	std::size_t name_hash;
+};
+
+struct HashedNameHash {
+	std::size_t operator()(const HashedName &k) const { return k.hash(); }
+};
+
+struct HashedNameEqual {
+	bool operator()(const HashedName &a, const std::string &b) const { return a.name() == b; }
+	bool operator()(const std::string &a, const HashedName &b) const { return a == b.name(); }
+};
+
+/*!
+	Variable table for Context scopes. The vast majority of contexts hold
+	fewer than eight bindings, where a hash map spends its time
+	allocating bucket arrays and hashing names; entries are therefore
+	kept in a flat arena-backed vector (see evalarena.h) scanned
+	linearly, and only tables that outgrow the scan threshold get a hash
+	index built over the same entries. Iterators follow vector rules:
+	stable across lookups, invalidated by inserts.
+*/
+class ValueMap
+{
+public:
+	typedef std::pair<std::string, Value> value_type;
+private:
+	typedef std::vector<value_type, ArenaAlloc<value_type> > EntryList;
+	typedef boost::unordered_map<std::string, size_t,
+															 boost::hash<std::string>, std::equal_to<std::string>,
+															 ArenaAlloc<std::pair<const std::string, size_t> > > IndexMap;
+public:
+	typedef EntryList::const_iterator const_iterator;
+
+	ValueMap() : index(NULL) {}
+	ValueMap(const ValueMap &other);
+	ValueMap &operator=(const ValueMap &other);
+	~ValueMap();
+
+	const_iterator begin() const { return this->entries.begin(); }
+	const_iterator end() const { return this->entries.end(); }
+
+	const_iterator find(const std::string &name) const;
+	Value &operator[](const std::string &name);
+
+private:
+	void build_index();
+
+	// Number of entries up to which the linear scan beats hashing
+	static const size_t SPILL_THRESHOLD = 8;
+
+	EntryList entries;
+	IndexMap *index; // NULL until the table outgrows the threshold
+};
+
+/*!
+	Packed snapshot of the high-traffic special variables. Special
+	($-prefixed) variables resolve by walking the dynamic context stack,
+	which every primitive, extrusion and offset node pays per variable for
+	$fn/$fa/$fs (and the animation path for $t) - millions of hash lookups
+	on tessellation-heavy models. These four are instead resolved once per
+	scope: the snapshot is copied from the enclosing scope on context
+	entry and patched in place by set_variable(), so each lookup is a
+	constant-time field read. All other $-variables still take the walk.
+*/
+class SpecialSnapshot
+{
+public:
+	enum { FN, FS, FA, T, NUM_SPECIAL };
+	//! Index of a snapshotted name, or -1 for every other name
+	static int index(const std::string &name);
+	Value values[NUM_SPECIAL];
+};
 
 class Context
 {
 public:
 	typedef std::vector<const Context*> Stack;
+	enum DetachedTag { Detached };
 	Context(const Context *parent = NULL);
+	Context(const Context *parent, DetachedTag);
 	virtual ~Context();
 
 	const Context *getParent() const { return this->parent; }
-	virtual Value evaluate_function(const std::string &name, const class EvalContext *evalctx) const;
+	virtual Value evaluate_function(const HashedName &name, const class EvalContext *evalctx) const;
 	virtual class AbstractNode *instantiate_module(const class ModuleInstantiation &inst, const EvalContext *evalctx) const;
 
 	void setVariables(const AssignmentList &args,
@@ -24,7 +121,9 @@ public:
 	void set_constant(const std::string &name, const Value &value);
 
 	Value lookup_variable(const std::string &name, bool silent = false) const;
+	const Value *lookup_variable_ref(const std::string &name) const;
 	bool has_local_variable(const std::string &name) const;
+	void collectConfigVariables(std::map<std::string, Value> &dest) const;
 
 	void setDocumentPath(const std::string &path) { this->document_path = path; }
 	const std::string &documentPath() const { return this->document_path; }
@@ -35,11 +134,12 @@ public:
 protected:
 	const Context *parent;
 	Stack *ctx_stack;
+	bool owns_stack;
 
-	typedef boost::unordered_map<std::string, Value> ValueMap;
 	ValueMap constants;
 	ValueMap variables;
 	ValueMap config_variables;
+	SpecialSnapshot specials;
 
 	std::string document_path; // FIXME: This is a remnant only needed by dxfdim
 
@@ -31,8 +31,12 @@
 #include "modcontext.h"
 #include "builtin.h"
 #include "printutils.h"
+#include "workerpool.h"
+#include "feature.h"
 #include <sstream>
 #include "mathc99.h"
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 
 #define foreach BOOST_FOREACH
@@ -57,9 +61,13 @@ public: // methods
 
 	virtual AbstractNode *instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const;
 
-	static void for_eval(AbstractNode &node, const ModuleInstantiation &inst, size_t l, 
+	static void for_eval(AbstractNode &node, const ModuleInstantiation &inst, size_t l,
 						 const Context *ctx, const EvalContext *evalctx);
 
+	static bool for_eval_parallel(AbstractNode &node, const ModuleInstantiation &inst,
+								  const std::string &it_name, const Value &it_values,
+								  const Context *ctx);
+
 	static const EvalContext* getLastModuleCtx(const EvalContext *evalctx);
 	
 	static AbstractNode* getChild(const Value& value, const EvalContext* modulectx);
@@ -69,15 +77,96 @@ private: // data
 
 }; // class ControlModule
 
-void ControlModule::for_eval(AbstractNode &node, const ModuleInstantiation &inst, size_t l, 
+// Minimum number of iterations before spawning worker threads pays off
+#define PARALLEL_FOR_MIN_ITERATIONS 64
+
+/*!
+	Instantiates the loop body for values[first..last-1] into
+	per-iteration node lists. Runs on a worker thread; the parent
+	context chain is only read.
+*/
+static void for_instantiate_range(const ModuleInstantiation *inst, const std::string *it_name,
+								  const std::vector<Value> *values, size_t first, size_t last,
+								  const Context *ctx,
+								  std::vector<std::vector<AbstractNode*> > *results)
+{
+	for (size_t i = first; i < last; i++) {
+		Context c(ctx, Context::Detached);
+		c.set_variable(*it_name, (*values)[i]);
+		(*results)[i] = inst->instantiateChildren(&c);
+	}
+}
+
+/*!
+	Instantiates the iterations of the innermost loop variable on worker
+	threads and splices the resulting nodes in loop order. Returns false
+	when the iterable isn't worth (or isn't safe) parallelizing, in
+	which case the caller falls back to the sequential path.
+*/
+bool ControlModule::for_eval_parallel(AbstractNode &node, const ModuleInstantiation &inst,
+									  const std::string &it_name, const Value &it_values,
+									  const Context *ctx)
+{
+	std::vector<Value> values;
+	if (it_values.type() == Value::RANGE) {
+		const Value::RangeType &range = it_values.toRange();
+		// Leave the too-many-elements warning to the sequential path
+		if (range.nbsteps() >= 10000) return false;
+		for (Value::RangeType::iterator it = range.begin();it != range.end();it++) {
+			values.push_back(Value(*it));
+		}
+	}
+	else if (it_values.type() == Value::VECTOR) {
+		values.assign(it_values.toVector().begin(), it_values.toVector().end());
+	}
+	else {
+		return false;
+	}
+
+	size_t numthreads = WorkerPool::numThreads();
+	if (numthreads < 2 || values.size() < PARALLEL_FOR_MIN_ITERATIONS) return false;
+
+	std::vector<std::vector<AbstractNode*> > results(values.size());
+
+	// Run the first iteration on this thread: it warms the lazily
+	// compiled expression state along iteration 0's path, so the workers
+	// mostly read shared data. Branches first reached inside a worker
+	// compile there; Expression::compile() serializes those writes.
+	{
+		Context c(ctx);
+		c.set_variable(it_name, values[0]);
+		results[0] = inst.instantiateChildren(&c);
+	}
+
+	WorkerPool::TaskGroup tasks;
+	size_t chunksize = (values.size() - 1 + numthreads - 1) / numthreads;
+	for (size_t first = 1; first < values.size(); first += chunksize) {
+		size_t last = std::min(first + chunksize, values.size());
+		tasks.run(boost::bind(for_instantiate_range, &inst, &it_name,
+							  &values, first, last, ctx, &results));
+	}
+	tasks.wait();
+
+	for (size_t i = 0; i < results.size(); i++) {
+		node.children.insert(node.children.end(), results[i].begin(), results[i].end());
+	}
+	return true;
+}
+
+void ControlModule::for_eval(AbstractNode &node, const ModuleInstantiation &inst, size_t l,
 							const Context *ctx, const EvalContext *evalctx)
 {
 	if (evalctx->numArgs() > l) {
 		const std::string &it_name = evalctx->getArgName(l);
 		const Value &it_values = evalctx->getArgValue(l, ctx);
+		if (Feature::ExperimentalParallelFor.is_enabled() &&
+				evalctx->numArgs() == l+1 &&
+				for_eval_parallel(node, inst, it_name, it_values, ctx)) {
+			return;
+		}
 		Context c(ctx);
 		if (it_values.type() == Value::RANGE) {
-			Value::RangeType range = it_values.toRange();
+			const Value::RangeType &range = it_values.toRange();
                         boost::uint32_t steps = range.nbsteps();
                         if (steps >= 10000) {
                                 PRINTB("WARNING: Bad range parameter in for statement: too many elements (%lu).", steps);
@@ -229,7 +318,7 @@ AbstractNode *ControlModule::instantiate(const Context* /*ctx*/, const ModuleIns
 			}
 			else if (value.type() == Value::RANGE) {
 				AbstractNode* node = new AbstractNode(inst);
-				Value::RangeType range = value.toRange();
+				const Value::RangeType &range = value.toRange();
                                 boost::uint32_t steps = range.nbsteps();
 				if (steps >= 10000) {
 					PRINTB("WARNING: Bad range parameter for children: too many elements (%lu).", steps);
@@ -8,10 +8,13 @@ class CsgNode : public AbstractNode
 {
 public:
 	OpenSCADOperator type;
-	CsgNode(const ModuleInstantiation *mi, OpenSCADOperator type) : AbstractNode(mi), type(type) { }
+	// Evaluation budget in seconds from $timeout; 0 = unlimited
+	double timeout;
+	CsgNode(const ModuleInstantiation *mi, OpenSCADOperator type) : AbstractNode(mi), type(type), timeout(0) { }
   virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const;
+	virtual AbstractNode *cloneNode() const { return new CsgNode(*this); }
 };
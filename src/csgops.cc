@@ -41,15 +41,21 @@ public:
 	virtual AbstractNode *instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const;
 };
 
-AbstractNode *CsgModule::instantiate(const Context*, const ModuleInstantiation *inst, const EvalContext *evalctx) const
+AbstractNode *CsgModule::instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const
 {
 	CsgNode *node = new CsgNode(inst, type);
+	// $timeout is dynamically scoped like the $fn family and budgets the
+	// evaluation of this whole subtree; see GeometryEvaluator
+	Context c(ctx);
+	c.setVariables(AssignmentList(), evalctx);
+	const Value &timeout = c.lookup_variable("$timeout", true);
+	if (timeout.type() == Value::NUMBER) node->timeout = timeout.toDouble();
 	std::vector<AbstractNode *> instantiatednodes = inst->instantiateChildren(evalctx);
 	node->children.insert(node->children.end(), instantiatednodes.begin(), instantiatednodes.end());
 	return node;
 }
 
-std::string CsgNode::toString() const
+std::string CsgNode::computeString() const
 {
 	return this->name() + "()";
 }
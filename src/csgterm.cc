@@ -99,20 +99,20 @@ shared_ptr<CSGTerm> CSGTerm::createCSGTerm(type_e type, CSGTerm *left, CSGTerm *
 }
 
 CSGTerm::CSGTerm(const shared_ptr<const Geometry> &geom, const Transform3d &matrix, const Color4f &color, const std::string &label)
-	: type(TYPE_PRIMITIVE), label(label), flag(CSGTerm::FLAG_NONE), m(matrix), color(color)
+	: type(TYPE_PRIMITIVE), label(label), flag(CSGTerm::FLAG_NONE), normalized(true), m(matrix), color(color)
 {
 	if (geom && !geom->isEmpty()) this->geom = geom;
 	initBoundingBox();
 }
 
 CSGTerm::CSGTerm(type_e type, shared_ptr<CSGTerm> left, shared_ptr<CSGTerm> right)
-	: type(type), left(left), right(right), flag(CSGTerm::FLAG_NONE), m(Transform3d::Identity())
+	: type(type), left(left), right(right), flag(CSGTerm::FLAG_NONE), normalized(false), m(Transform3d::Identity())
 {
 	initBoundingBox();
 }
 
 CSGTerm::CSGTerm(type_e type, CSGTerm *left, CSGTerm *right)
-	: type(type), left(left), right(right), flag(CSGTerm::FLAG_NONE), m(Transform3d::Identity())
+	: type(type), left(left), right(right), flag(CSGTerm::FLAG_NONE), normalized(false), m(Transform3d::Identity())
 {
 	initBoundingBox();
 }
@@ -153,32 +153,109 @@ void CSGTerm::initBoundingBox()
 	}
 }
 
-std::string CSGTerm::dump()
+CSGChainObject::CSGChainObject(shared_ptr<const Geometry> geom,
+															 const Transform3d &matrix,
+															 const Color4f &color,
+															 CSGTerm::type_e type,
+															 const std::string &label,
+															 CSGTerm::Flag flag)
+	: geom(geom), matrix(matrix), color(color), type(type), label(label), flag(flag)
 {
-	std::stringstream dump;
+	if (geom && !geom->getBoundingBox().isNull()) {
+		this->bbox = matrix * geom->getBoundingBox();
+	}
+}
 
-	if (type == TYPE_UNION)
-		dump << "(" << left->dump() << " + " << right->dump() << ")";
-	else if (type == TYPE_INTERSECTION)
-		dump << "(" << left->dump() << " * " << right->dump() << ")";
-	else if (type == TYPE_DIFFERENCE)
-		dump << "(" << left->dump() << " - " << right->dump() << ")";
-	else 
-		dump << this->label;
+/*!
+	Streams the term into the given stream. All levels of the recursion
+	share the one stream, so deep trees no longer rebuild every subtree
+	string once per ancestor.
+*/
+void CSGTerm::dump(std::ostream &stream)
+{
+	if (type == TYPE_UNION || type == TYPE_INTERSECTION || type == TYPE_DIFFERENCE) {
+		stream << "(";
+		left->dump(stream);
+		if (type == TYPE_UNION) stream << " + ";
+		else if (type == TYPE_INTERSECTION) stream << " * ";
+		else stream << " - ";
+		right->dump(stream);
+		stream << ")";
+	}
+	else
+		stream << this->label;
+}
 
+std::string CSGTerm::dump()
+{
+	std::stringstream dump;
+	this->dump(dump);
 	return dump.str();
 }
 
 void CSGChain::import(shared_ptr<CSGTerm> term, CSGTerm::type_e type, CSGTerm::Flag flag)
+{
+	size_t start = this->objects.size();
+	importTerm(term, type, flag);
+	compactProducts(start);
+}
+
+void CSGChain::importTerm(shared_ptr<CSGTerm> term, CSGTerm::type_e type, CSGTerm::Flag flag)
 {
 	CSGTerm::Flag newflag = (CSGTerm::Flag)(term->flag | flag);
 	if (term->type == CSGTerm::TYPE_PRIMITIVE) {
 		this->objects.push_back(CSGChainObject(term->geom, term->m, term->color, type, term->label, newflag));
 	} else {
 		assert(term->left && term->right);
-		import(term->left, type, newflag);
-		import(term->right, term->type, newflag);
+		importTerm(term->left, type, newflag);
+		importTerm(term->right, term->type, newflag);
+	}
+}
+
+static std::string chain_object_signature(const CSGChainObject &obj)
+{
+	std::string sig = obj.label;
+	sig += char(obj.type);
+	sig += char(obj.flag);
+	const Geometry *geom = obj.geom.get();
+	sig.append(reinterpret_cast<const char *>(&geom), sizeof(geom));
+	sig.append(reinterpret_cast<const char *>(obj.matrix.data()), 16 * sizeof(double));
+	sig.append(reinterpret_cast<const char *>(obj.color.data()), 4 * sizeof(float));
+	return sig;
+}
+
+/*!
+	Identical repeated subtrees share one CSGTerm DAG node, but importing
+	the tree still emits one copy of the corresponding union product per
+	reference. Unioning in the same product twice cannot change the
+	result, so drop every repetition of a product already in the chain;
+	this keeps the chain length proportional to the number of distinct
+	parts. Only objects appended by the current import, from start
+	onwards, are candidates.
+*/
+void CSGChain::compactProducts(size_t start)
+{
+	std::vector<CSGChainObject> kept;
+	size_t i = start;
+	while (i < this->objects.size()) {
+		// A product spans from one positive (union) object to the next
+		size_t end = i + 1;
+		while (end < this->objects.size() && this->objects[end].type != CSGTerm::TYPE_UNION) end++;
+		if (this->objects[i].type == CSGTerm::TYPE_UNION) {
+			std::string sig;
+			for (size_t j = i; j < end; j++) sig += chain_object_signature(this->objects[j]);
+			if (this->emitted_products.insert(sig).second) {
+				kept.insert(kept.end(), this->objects.begin() + i, this->objects.begin() + end);
+			}
+		}
+		else {
+			// Continuation of a product from an earlier import; leave it alone
+			kept.insert(kept.end(), this->objects.begin() + i, this->objects.begin() + end);
+		}
+		i = end;
 	}
+	this->objects.erase(this->objects.begin() + start, this->objects.end());
+	this->objects.insert(this->objects.end(), kept.begin(), kept.end());
 }
 
 std::string CSGChain::dump(bool full)
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <set>
 #include <string>
 #include <vector>
 #include "memory.h"
@@ -33,6 +34,9 @@ public:
 	shared_ptr<CSGTerm> right;
 	BoundingBox bbox;
 	Flag flag;
+	// Set by CSGTermNormalizer once this subtree is known to be in normal
+	// form, so subsequent passes can skip it without re-walking it.
+	bool normalized;
 
 	CSGTerm(const shared_ptr<const Geometry> &geom, const Transform3d &matrix, const Color4f &color, const std::string &label);
 	~CSGTerm();
@@ -40,6 +44,7 @@ public:
 	const BoundingBox &getBoundingBox() const { return this->bbox; }
 
 	std::string dump();
+	void dump(std::ostream &stream);
 private:
 	CSGTerm(type_e type, shared_ptr<CSGTerm> left, shared_ptr<CSGTerm> right);
 	CSGTerm(type_e type, CSGTerm *left, CSGTerm *right);
@@ -60,8 +65,9 @@ public:
 								 const Color4f &color,
 								 CSGTerm::type_e type,
 								 const std::string &label,
-								 CSGTerm::Flag flag = CSGTerm::FLAG_NONE)
-		: geom(geom), matrix(matrix), color(color), type(type), label(label), flag(flag) {}
+								 CSGTerm::Flag flag = CSGTerm::FLAG_NONE);
+
+	const BoundingBox &getBoundingBox() const { return this->bbox; }
 
 	shared_ptr<const Geometry> geom;
 	Transform3d matrix;
@@ -69,6 +75,9 @@ public:
 	CSGTerm::type_e type;
 	std::string label;
 	CSGTerm::Flag flag;
+
+private:
+	BoundingBox bbox; // in world coordinates, used for view frustum culling
 };
 
 class CSGChain
@@ -83,4 +92,13 @@ public:
 	std::string dump(bool full = false);
 
 	BoundingBox getBoundingBox() const;
+
+private:
+	void importTerm(shared_ptr<CSGTerm> term, CSGTerm::type_e type, CSGTerm::Flag flag);
+	void compactProducts(size_t start);
+
+	// Signatures of the union products already in the chain. Shared term
+	// DAG nodes are imported once per reference; identical repeated
+	// products are dropped here (see compactProducts()).
+	std::set<std::string> emitted_products;
 };
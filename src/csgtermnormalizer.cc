@@ -1,6 +1,7 @@
 #include "csgtermnormalizer.h"
 #include "csgterm.h"
 #include "printutils.h"
+#include <vector>
 
 // Helper function to debug normalization bugs
 #if 0
@@ -19,13 +20,25 @@ static bool validate_tree(const shared_ptr<CSGTerm> &term)
 */
 shared_ptr<CSGTerm> CSGTermNormalizer::normalize(const shared_ptr<CSGTerm> &root)
 {
+	// A term already normalized through this normalizer - typically a
+	// highlight or background entry whose subtree the main chain (or an
+	// earlier identical entry) handed us before - is done; normalizing a
+	// modifier-heavy scene is paid for once, not once per chain.
+	std::map<shared_ptr<CSGTerm>, shared_ptr<CSGTerm> >::const_iterator cached =
+		this->normalized_terms.find(root);
+	if (cached != this->normalized_terms.end()) return cached->second;
+
 	this->aborted = false;
+	this->rewritecount = 0;
 	shared_ptr<CSGTerm> temp = root;
 	while (1) {
 		this->rootnode = temp;
 		this->nodecount = 0;
 		shared_ptr<CSGTerm> n = normalizePass(temp);
-		if (!n) return n; // If normalized to nothing
+		if (!n) { // If normalized to nothing
+			this->normalized_terms[root] = n;
+			return n;
+		}
 		if (temp == n) break;
 		temp = n;
 
@@ -38,10 +51,15 @@ shared_ptr<CSGTerm> CSGTermNormalizer::normalize(const shared_ptr<CSGTerm> &root
 				newroot = collapse_null_terms(tmproot);
 			}
 			newroot = cleanup_term(newroot);
+			PRINTDB("CSG normalization aborted: %d rewrites, budget %d", this->rewritecount % this->limit);
+			this->normalized_terms[root] = newroot;
 			return newroot;
 		}
 	}
 	this->rootnode.reset();
+	PRINTDB("CSG normalization: %d rewrites, %d nodes in final pass, budget %d",
+					this->rewritecount % this->nodecount % this->limit);
+	this->normalized_terms[root] = temp;
 	return temp;
 }
 
@@ -61,6 +79,22 @@ shared_ptr<CSGTerm> CSGTermNormalizer::cleanup_term(shared_ptr<CSGTerm> &t)
 	else return t;
 }
 
+/*!
+	One stack frame of the iterative normalization below. state tracks how
+	far the frame has come: 0 = about to rewrite this term, 1 = waiting for
+	the left subtree's result, 2 = waiting for the right subtree's result.
+	changed records whether anything in the subtree was rewritten; subtrees
+	which complete a pass unchanged are flagged as normalized and skipped
+	wholesale by later passes and by re-normalization of shared terms.
+*/
+struct NormalizeFrame
+{
+	NormalizeFrame(const shared_ptr<CSGTerm> &term) : term(term), state(0), changed(false) {}
+	shared_ptr<CSGTerm> term;
+	int state;
+	bool changed;
+};
+
 shared_ptr<CSGTerm> CSGTermNormalizer::normalizePass(shared_ptr<CSGTerm> term)
 {
 	// This function implements the CSG normalization
@@ -71,33 +105,104 @@ shared_ptr<CSGTerm> CSGTermNormalizer::normalizePass(shared_ptr<CSGTerm> term)
 	// 1989.
   // http://www.cc.gatech.edu/~turk/my_papers/pxpl_csg.pdf
 
-	if (term->type == CSGTerm::TYPE_PRIMITIVE) {
-		return term;
-	}
+	// The rewrite rules duplicate operands, so difference-heavy trees can
+	// grow exponentially. Instead of recursing (and only noticing the
+	// blowup on the way back up), we keep an explicit worklist and charge
+	// every rewrite against the node budget as it happens, so we stop the
+	// moment the budget is exceeded.
+	std::vector<NormalizeFrame> stack;
+	stack.push_back(NormalizeFrame(term));
+	shared_ptr<CSGTerm> result;
+	bool childchanged = false;
 
-	do {
-		while (term && match_and_replace(term)) {	}
-		this->nodecount++;
-		if (nodecount > this->limit) {
-			PRINTB("WARNING: Normalized tree is growing past %d elements. Aborting normalization.\n", this->limit);
-			this->aborted = true;
-			return shared_ptr<CSGTerm>();
+	while (!stack.empty()) {
+		NormalizeFrame &frame = stack.back();
+		switch (frame.state) {
+		case 0:
+			if (!frame.term || frame.term->type == CSGTerm::TYPE_PRIMITIVE ||
+					frame.term->normalized) {
+				result = frame.term;
+				childchanged = frame.changed;
+				stack.pop_back();
+				continue;
+			}
+			while (frame.term && match_and_replace(frame.term)) {
+				frame.changed = true;
+				this->rewritecount++;
+				if (++this->nodecount > this->limit) break;
+			}
+			this->nodecount++;
+			if (this->nodecount > this->limit) {
+				PRINTB("WARNING: Normalized tree is growing past %d elements. Aborting normalization.\n", this->limit);
+				this->aborted = true;
+				result.reset();
+				childchanged = frame.changed;
+				stack.pop_back();
+				continue;
+			}
+			if (!frame.term || frame.term->type == CSGTerm::TYPE_PRIMITIVE) {
+				result = frame.term;
+				childchanged = frame.changed;
+				stack.pop_back();
+				continue;
+			}
+			frame.state = 1;
+			if (frame.term->left) {
+				stack.push_back(NormalizeFrame(frame.term->left));
+			}
+			else {
+				result = frame.term->left;
+				childchanged = false;
+			}
+			continue;
+		case 1:
+			if (frame.term->left != result) {
+				frame.term->left = result;
+				frame.changed = true;
+			}
+			frame.changed |= childchanged;
+			if (!this->aborted && frame.term->type != CSGTerm::TYPE_UNION &&
+					((frame.term->right && frame.term->right->type != CSGTerm::TYPE_PRIMITIVE) ||
+					 (frame.term->left && frame.term->left->type == CSGTerm::TYPE_UNION))) {
+				frame.state = 0;
+				continue;
+			}
+			frame.state = 2;
+			if (!this->aborted) {
+				stack.push_back(NormalizeFrame(frame.term->right));
+			}
+			else {
+				result = frame.term->right;
+				childchanged = false;
+			}
+			continue;
+		case 2:
+			if (frame.term->right != result) {
+				frame.term->right = result;
+				frame.changed = true;
+			}
+			frame.changed |= childchanged;
+			{
+				// FIXME: Do we need to take into account any transformation of item here?
+				shared_ptr<CSGTerm> t = collapse_null_terms(frame.term);
+				if (this->aborted) {
+					if (t) t = cleanup_term(t);
+				}
+				else if (t == frame.term && !frame.changed) {
+					// The pass neither rewrote this term nor touched its
+					// children: the subtree is in normal form and can be
+					// skipped from now on.
+					t->normalized = true;
+				}
+				childchanged = frame.changed || t != frame.term;
+				result = t;
+			}
+			stack.pop_back();
+			continue;
 		}
-		if (!term || term->type == CSGTerm::TYPE_PRIMITIVE) return term;
-		if (term->left) term->left = normalizePass(term->left);
-	} while (!this->aborted && term->type != CSGTerm::TYPE_UNION &&
-					 ((term->right && term->right->type != CSGTerm::TYPE_PRIMITIVE) ||
-						(term->left && term->left->type == CSGTerm::TYPE_UNION)));
-	if (!this->aborted) term->right = normalizePass(term->right);
-
-	// FIXME: Do we need to take into account any transformation of item here?
-	shared_ptr<CSGTerm> t = collapse_null_terms(term);
-
-	if (this->aborted) {
-		if (t) t = cleanup_term(t);
 	}
 
-	return t;
+	return result;
 }
 
 shared_ptr<CSGTerm> CSGTermNormalizer::collapse_null_terms(const shared_ptr<CSGTerm> &term)
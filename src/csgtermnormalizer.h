@@ -1,6 +1,7 @@
 #pragma once
 
 #include "memory.h"
+#include <map>
 
 class CSGTermNormalizer
 {
@@ -17,8 +18,14 @@ private:
 	shared_ptr<CSGTerm> cleanup_term(shared_ptr<CSGTerm> &t);
 	unsigned int count(const shared_ptr<CSGTerm> &term) const;
 
+	// Normalized results by input term identity; one normalizer handles
+	// the main, highlight and background chains in turn, and hash-consing
+	// makes repeated %/# subtrees arrive as the very same term
+	std::map<shared_ptr<CSGTerm>, shared_ptr<CSGTerm> > normalized_terms;
+
 	bool aborted;
 	size_t limit;
 	size_t nodecount;
+	size_t rewritecount;
 	shared_ptr<class CSGTerm> rootnode;
 };
@@ -0,0 +1,41 @@
+#include "csgworker.h"
+#include <QThread>
+
+#include "MainWindow.h"
+#include "progress.h"
+#include "printutils.h"
+
+/*!
+	Runs root instantiation and CSG term generation off the GUI thread,
+	the same way CGALWorker offloads the full render. The GUI stays
+	responsive during a preview compile and can abort a stale one via
+	progress_request_cancel().
+*/
+CSGWorker::CSGWorker(MainWindow *mainwindow) : mainwindow(mainwindow), csgterms(true)
+{
+	this->thread = new QThread();
+	if (this->thread->stackSize() < 1024*1024) this->thread->setStackSize(1024*1024);
+	connect(this->thread, SIGNAL(started()), this, SLOT(work()));
+	moveToThread(this->thread);
+}
+
+CSGWorker::~CSGWorker()
+{
+	delete this->thread;
+}
+
+void CSGWorker::start(bool csgterms)
+{
+	this->csgterms = csgterms;
+	this->thread->start();
+}
+
+void CSGWorker::work()
+{
+	// Cancellation surfaces as ProgressCancelException from
+	// progress_update() and is caught around the CSG evaluation inside
+	this->mainwindow->instantiateAndCompileCSG(this->csgterms);
+
+	emit done();
+	thread->quit();
+}
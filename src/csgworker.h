@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QObject>
+
+class CSGWorker : public QObject
+{
+	Q_OBJECT;
+public:
+	CSGWorker(class MainWindow *mainwindow);
+	virtual ~CSGWorker();
+
+public slots:
+	void start(bool csgterms);
+
+protected slots:
+	void work();
+
+signals:
+	void done();
+
+protected:
+
+	class QThread *thread;
+	class MainWindow *mainwindow;
+	bool csgterms;
+};
@@ -33,6 +33,9 @@
 #include <fstream>
 #include "mathc99.h"
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <boost/unordered_map.hpp>
 #include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
@@ -66,6 +69,56 @@ struct Line {
 	Line(int i1 = -1, int i2 = -1) { idx[0] = i1; idx[1] = i2; disabled = false; }
 };
 
+/*!
+	Returns the next line of the buffer as a trimmed, NUL-terminated
+	string and advances the cursor past it. The terminator is written
+	into the buffer itself so values can be parsed in place, without a
+	string allocation per line.
+*/
+static char *dxf_next_line(char *&cursor, char *bufend)
+{
+	if (cursor >= bufend) return NULL;
+	char *line = cursor;
+	char *eol = (char *)memchr(cursor, '\n', bufend - cursor);
+	if (eol) cursor = eol + 1;
+	else { eol = bufend; cursor = bufend; }
+	while (eol > line && isspace((unsigned char)eol[-1])) eol--;
+	*eol = '\0';
+	while (*line && isspace((unsigned char)*line)) line++;
+	return line;
+}
+
+// In-place replacements for lexical_cast on group values. They throw
+// the same exception, so the warning paths below stay unchanged.
+static double dxf_to_double(const char *str)
+{
+	char *endptr;
+	double d = strtod(str, &endptr);
+	if (endptr == str || *endptr) throw boost::bad_lexical_cast();
+	return d;
+}
+
+static int dxf_to_int(const char *str)
+{
+	char *endptr;
+	long l = strtol(str, &endptr, 10);
+	if (endptr == str || *endptr) throw boost::bad_lexical_cast();
+	return (int)l;
+}
+
+// Index of another enabled line registered at the given endpoint cell,
+// or -1 when the endpoint is free. A cell only holds the few lines
+// meeting at one snapped point, so the scan is cheap.
+static int dxf_other_enabled_line(const std::vector<int> &cell, const std::vector<Line> &lines, int self)
+{
+	for (size_t ki = 0; ki < cell.size(); ki++) {
+		int k = cell[ki];
+		if ((size_t)k >= lines.size()) continue;
+		if (k != self && !lines[k].disabled) return k;
+	}
+	return -1;
+}
+
 DxfData::DxfData()
 {
 }
@@ -131,20 +184,29 @@ DxfData::DxfData(double fn, double fs, double fa,
 	//
 	// Parse DXF file. Will populate this->points, this->dims, lines and blockdata
 	//
-	while (!stream.eof())
+	// The whole file is pulled into one buffer and the group code/value
+	// pairs are scanned in place; per-line stream reads and string
+	// conversions dominated the load time of large drawings.
+	stream.seekg(0, std::ios::end);
+	std::ifstream::pos_type filelen = stream.tellg();
+	stream.seekg(0, std::ios::beg);
+	std::vector<char> buffer((size_t)filelen + 1);
+	stream.read(&buffer[0], filelen);
+	char *cursor = &buffer[0];
+	char *bufend = &buffer[0] + stream.gcount();
+
+	while (cursor < bufend)
 	{
-		std::string id_str, data;
-		std::getline(stream, id_str);
-		boost::trim(id_str);
-		std::getline(stream, data);
-		boost::trim(data);
+		const char *id_str = dxf_next_line(cursor, bufend);
+		const char *data = dxf_next_line(cursor, bufend);
+		if (!data) data = "";
 
 		int id;
     try {
-		  id = boost::lexical_cast<int>(id_str);
+		  id = dxf_to_int(id_str);
     }
     catch (const boost::bad_lexical_cast &blc) {
-			if (!stream.eof()) {
+			if (*id_str || cursor < bufend) {
 				PRINTB("WARNING: Illegal ID '%s' in `%s'", id_str % filename);
 			}
 			break;
@@ -152,20 +214,20 @@ DxfData::DxfData(double fn, double fs, double fa,
     try {
 		if (id >= 10 && id <= 16) {
 			if (in_blocks_section)
-				coords[id-10][0] = boost::lexical_cast<double>(data);
+				coords[id-10][0] = dxf_to_double(data);
 			else if (id == 11 || id == 12 || id == 16)
-				coords[id-10][0] = boost::lexical_cast<double>(data) * scale;
+				coords[id-10][0] = dxf_to_double(data) * scale;
 			else
-				coords[id-10][0] = (boost::lexical_cast<double>(data) - xorigin) * scale;
+				coords[id-10][0] = (dxf_to_double(data) - xorigin) * scale;
 		}
 
 		if (id >= 20 && id <= 26) {
 			if (in_blocks_section)
-				coords[id-20][1] = boost::lexical_cast<double>(data);
+				coords[id-20][1] = dxf_to_double(data);
 			else if (id == 21 || id == 22 || id == 26)
-				coords[id-20][1] = boost::lexical_cast<double>(data) * scale;
+				coords[id-20][1] = dxf_to_double(data) * scale;
 			else
-				coords[id-20][1] = (boost::lexical_cast<double>(data) - yorigin) * scale;
+				coords[id-20][1] = (dxf_to_double(data) - yorigin) * scale;
 		}
 
 		switch (id)
@@ -329,58 +391,58 @@ DxfData::DxfData(double fn, double fs, double fa,
 			break;
 		case 10:
 			if (in_blocks_section)
-				xverts.push_back((boost::lexical_cast<double>(data)));
+				xverts.push_back((dxf_to_double(data)));
 			else
-				xverts.push_back((boost::lexical_cast<double>(data) - xorigin) * scale);
+				xverts.push_back((dxf_to_double(data) - xorigin) * scale);
 			break;
 		case 11:
 			if (in_blocks_section)
-				xverts.push_back((boost::lexical_cast<double>(data)));
+				xverts.push_back((dxf_to_double(data)));
 			else
-				xverts.push_back((boost::lexical_cast<double>(data) - xorigin) * scale);
+				xverts.push_back((dxf_to_double(data) - xorigin) * scale);
 			break;
 		case 20:
 			if (in_blocks_section)
-				yverts.push_back((boost::lexical_cast<double>(data)));
+				yverts.push_back((dxf_to_double(data)));
 			else
-				yverts.push_back((boost::lexical_cast<double>(data) - yorigin) * scale);
+				yverts.push_back((dxf_to_double(data) - yorigin) * scale);
 			break;
 		case 21:
 			if (in_blocks_section)
-				yverts.push_back((boost::lexical_cast<double>(data)));
+				yverts.push_back((dxf_to_double(data)));
 			else
-				yverts.push_back((boost::lexical_cast<double>(data) - yorigin) * scale);
+				yverts.push_back((dxf_to_double(data) - yorigin) * scale);
 			break;
 		case 40:
 			// CIRCLE, ARC: radius
 			// ELLIPSE: minor to major ratio
 			// DIMENSION (radial, diameter): Leader length
-			radius = boost::lexical_cast<double>(data);
+			radius = dxf_to_double(data);
 			if (!in_blocks_section) radius *= scale;
 			break;
 		case 41:
 			// ELLIPSE: start_angle
 			// INSERT: X scale
-			ellipse_start_angle = boost::lexical_cast<double>(data);
+			ellipse_start_angle = dxf_to_double(data);
 			break;
 		case 50:
 			// ARC: start_angle
 			// INSERT: rot angle
       // DIMENSION: linear and rotated: angle
-			arc_start_angle = boost::lexical_cast<double>(data);
+			arc_start_angle = dxf_to_double(data);
 			break;
 		case 42:
 			// ELLIPSE: stop_angle
 			// INSERT: Y scale
-			ellipse_stop_angle = boost::lexical_cast<double>(data);
+			ellipse_stop_angle = dxf_to_double(data);
 			break;
 		case 51: // ARC
-			arc_stop_angle = boost::lexical_cast<double>(data);
+			arc_stop_angle = dxf_to_double(data);
 			break;
 		case 70:
 			// LWPOLYLINE: polyline flag
 			// DIMENSION: dimension type
-			dimtype = boost::lexical_cast<int>(data);
+			dimtype = dxf_to_int(data);
 			break;
 		}
     }
@@ -410,31 +472,28 @@ DxfData::DxfData(double fn, double fs, double fa,
 		enabled_lines[i] = i;
 	}
 
-	// extract all open paths
-	while (enabled_lines.size() > 0)
-	{
-		int current_line, current_point;
-
-		BOOST_FOREACH(const LineMap::value_type &l, enabled_lines) {
-			int idx = l.second;
-			for (int j = 0; j < 2; j++) {
-				std::vector<int> *lv = &grid.data(this->points[lines[idx].idx[j]][0], this->points[lines[idx].idx[j]][1]);
-				for (size_t ki = 0; ki < lv->size(); ki++) {
-					int k = lv->at(ki);
-					if (k == idx || lines[k].disabled)
-						continue;
-					goto next_open_path_j;
-				}
-				current_line = idx;
-				current_point = j;
-				goto create_open_path;
-			next_open_path_j:;
+	// extract all open paths. Lines with a free endpoint are collected
+	// in one pass up front instead of rescanning every remaining line
+	// once per extracted path; consuming a path can leave new lines with
+	// a free endpoint at junctions, and those are appended as they
+	// appear.
+	std::vector<std::pair<int, int> > open_ends; // line index, free endpoint
+	for (size_t i = 0; i < lines.size(); i++) {
+		for (int j = 0; j < 2; j++) {
+			const Vector2d &p = this->points[lines[i].idx[j]];
+			if (dxf_other_enabled_line(grid.data(p[0], p[1]), lines, i) < 0) {
+				open_ends.push_back(std::make_pair((int)i, j));
+				break;
 			}
 		}
+	}
 
-		break;
+	for (size_t oi = 0; oi < open_ends.size(); oi++)
+	{
+		int current_line = open_ends[oi].first;
+		int current_point = open_ends[oi].second;
+		if (lines[current_line].disabled) continue;
 
-	create_open_path:
 		this->paths.push_back(Path());
 		Path *this_path = &this->paths.back();
 
@@ -444,6 +503,22 @@ DxfData::DxfData(double fn, double fs, double fa,
 			const Vector2d &ref_point = this->points[lines[current_line].idx[!current_point]];
 			lines[current_line].disabled = true;
 			enabled_lines.erase(current_line);
+			// Retiring this line may leave a single enabled line at either
+			// of its endpoints; that line now has a free endpoint and can
+			// seed a later open path
+			for (int j = 0; j < 2; j++) {
+				const Vector2d &q = this->points[lines[current_line].idx[j]];
+				const std::vector<int> &cell = grid.data(q[0], q[1]);
+				for (size_t ki = 0; ki < cell.size(); ki++) {
+					int k = cell[ki];
+					if ((size_t)k >= lines.size() || lines[k].disabled)
+						continue;
+					if (dxf_other_enabled_line(cell, lines, k) >= 0)
+						continue;
+					int ep = grid.eq(q[0], q[1], this->points[lines[k].idx[0]][0], this->points[lines[k].idx[0]][1]) ? 0 : 1;
+					open_ends.push_back(std::make_pair(k, ep));
+				}
+			}
 			std::vector<int> *lv = &grid.data(ref_point[0], ref_point[1]);
 			for (size_t ki = 0; ki < lv->size(); ki++) {
 				int k = lv->at(ki);
@@ -597,6 +672,7 @@ Polygon2d *DxfData::toPolygon2d() const
 		size_t endidx = path.indices.size();
 		// We don't support open paths; closing them to be compatible with existing behavior
 		if (!path.is_closed) endidx++;
+		outline.vertices.reserve(endidx - 1);
 		for (size_t j = 1; j < endidx; j++) {
 			outline.vertices.push_back(Vector2d(this->points[path.indices[path.indices.size()-j]]));
 		}
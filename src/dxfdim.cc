@@ -39,10 +39,50 @@
 #include <stdint.h>
 
 #include <boost/filesystem.hpp>
+#include "memory.h"
 boost::unordered_map<std::string,Value> dxf_dim_cache;
 boost::unordered_map<std::string,Value> dxf_cross_cache;
 namespace fs = boost::filesystem;
 
+/*!
+	Parsed DXF files shared between dxf_dim()/dxf_cross() calls, so
+	querying 50 dimensions from one file parses it once instead of 50
+	times. Dimensions are additionally indexed by name. The key
+	includes mtime and size, so edited files re-parse naturally.
+*/
+struct DxfCacheEntry {
+	shared_ptr<DxfData> dxf;
+	boost::unordered_map<std::string, size_t> dims_by_name;
+};
+static boost::unordered_map<std::string, DxfCacheEntry> dxf_data_cache;
+
+static const DxfCacheEntry &get_dxf_data(const std::string &filename, const std::string &layername,
+																				 double xorigin, double yorigin, double scale,
+																				 time_t lastwritetime, uintmax_t filesize)
+{
+	std::stringstream keystream;
+	keystream << filename << "|" << layername << "|" << xorigin << "|" << yorigin
+						<< "|" << scale << "|" << lastwritetime << "|" << filesize;
+	std::string key = keystream.str();
+
+	boost::unordered_map<std::string, DxfCacheEntry>::iterator it = dxf_data_cache.find(key);
+	if (it != dxf_data_cache.end()) return it->second;
+
+	// Keep the cache from accumulating many large parsed files
+	if (dxf_data_cache.size() >= 8) dxf_data_cache.clear();
+
+	DxfCacheEntry &entry = dxf_data_cache[key];
+	entry.dxf.reset(new DxfData(36, 0, 0, filename, layername, xorigin, yorigin, scale));
+	for (size_t i = 0; i < entry.dxf->dims.size(); i++) {
+		const std::string &dimname = entry.dxf->dims[i].name;
+		// First match wins, as in the old linear scan
+		if (entry.dims_by_name.find(dimname) == entry.dims_by_name.end()) {
+			entry.dims_by_name[dimname] = i;
+		}
+	}
+	return entry;
+}
+
 Value builtin_dxf_dim(const Context *ctx, const EvalContext *evalctx)
 {
 	std::string filename;
@@ -84,14 +124,23 @@ Value builtin_dxf_dim(const Context *ctx, const EvalContext *evalctx)
 	if (dxf_dim_cache.find(key) != dxf_dim_cache.end())
 		return dxf_dim_cache.find(key)->second;
 
-	DxfData dxf(36, 0, 0, filename, layername, xorigin, yorigin, scale);
+	const DxfCacheEntry &entry = get_dxf_data(filename, layername, xorigin, yorigin, scale,
+																						lastwritetime, filesize);
+	const DxfData &dxf = *entry.dxf;
 
-	for (size_t i = 0; i < dxf.dims.size(); i++)
-	{
-		if (!name.empty() && dxf.dims[i].name != name)
-			continue;
+	size_t dimidx = dxf.dims.size();
+	if (name.empty()) {
+		// No name given: use the first dimension, like the old scan did
+		if (!dxf.dims.empty()) dimidx = 0;
+	}
+	else {
+		boost::unordered_map<std::string, size_t>::const_iterator it = entry.dims_by_name.find(name);
+		if (it != entry.dims_by_name.end()) dimidx = it->second;
+	}
 
-		DxfData::Dim *d = &dxf.dims[i];
+	if (dimidx < dxf.dims.size())
+	{
+		const DxfData::Dim *d = &dxf.dims[dimidx];
 		int type = d->type & 7;
 
 		if (type == 0) {
@@ -177,7 +226,8 @@ Value builtin_dxf_cross(const Context *ctx, const EvalContext *evalctx)
 	if (dxf_cross_cache.find(key) != dxf_cross_cache.end())
 		return dxf_cross_cache.find(key)->second;
 
-	DxfData dxf(36, 0, 0, filename, layername, xorigin, yorigin, scale);
+	const DxfData &dxf = *get_dxf_data(filename, layername, xorigin, yorigin, scale,
+																		 lastwritetime, filesize).dxf;
 
 	double coords[4][2];
 
@@ -0,0 +1,56 @@
+#include "evalarena.h"
+
+#include <cassert>
+
+static boost::thread_specific_ptr<EvalArena> thread_arena;
+
+EvalArena::EvalArena() : chunk(0), offset(0), depth(0)
+{
+	this->chunks.push_back(static_cast<char *>(malloc(CHUNK_SIZE)));
+}
+
+EvalArena::~EvalArena()
+{
+	for (size_t i = 0; i < this->chunks.size(); i++) free(this->chunks[i]);
+}
+
+EvalArena *EvalArena::current()
+{
+	EvalArena *arena = thread_arena.get();
+	return (arena && arena->depth > 0) ? arena : NULL;
+}
+
+void *EvalArena::alloc(size_t size)
+{
+	size = (size + ALIGNMENT-1) & ~(ALIGNMENT-1);
+	// Oversized requests (e.g. the bucket array of a huge variable
+	// table) don't fit the bump scheme; the caller falls back to the heap.
+	if (size > CHUNK_SIZE) return NULL;
+	if (this->offset + size > CHUNK_SIZE) {
+		if (++this->chunk == this->chunks.size()) {
+			this->chunks.push_back(static_cast<char *>(malloc(CHUNK_SIZE)));
+		}
+		this->offset = 0;
+	}
+	void *p = this->chunks[this->chunk] + this->offset;
+	this->offset += size;
+	return p;
+}
+
+EvalArena::Scope::Scope()
+{
+	EvalArena *arena = thread_arena.get();
+	if (!arena) thread_arena.reset(arena = new EvalArena());
+	this->arena = arena;
+	this->chunk = arena->chunk;
+	this->offset = arena->offset;
+	arena->depth++;
+}
+
+EvalArena::Scope::~Scope()
+{
+	assert(this->arena->depth > 0);
+	this->arena->chunk = this->chunk;
+	this->arena->offset = this->offset;
+	this->arena->depth--;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <boost/thread/tss.hpp>
+
+/*!
+	Bump allocator backing the short-lived Context/EvalContext objects
+	created during tree evaluation. Recursive module designs create
+	millions of contexts whose variable tables otherwise hammer
+	malloc/free; the arena hands out memory by bumping a pointer and
+	releases it wholesale when the evaluation scope unwinds.
+
+	Context lifetimes are strictly stack-like (a child context never
+	outlives its parent's scope), so rewinding the arena at the end of
+	each ModuleInstantiation::evaluate() is safe.
+
+	The arena is per-thread and its chunks are kept around for reuse by
+	subsequent evaluation passes. Use it through ArenaAlloc below.
+*/
+class EvalArena
+{
+public:
+	/*!
+		RAII helper: opens an allocation scope on the calling thread's
+		arena and rewinds the arena again on destruction. Scopes may nest.
+	*/
+	class Scope
+	{
+	public:
+		Scope();
+		~Scope();
+	private:
+		EvalArena *arena;
+		size_t chunk;
+		size_t offset;
+	};
+
+	//! Returns the calling thread's arena, or NULL if no Scope is active
+	static EvalArena *current();
+
+	//! Returns size bytes, or NULL if the request is too large for a chunk
+	void *alloc(size_t size);
+
+private:
+	EvalArena();
+	~EvalArena();
+
+	static const size_t CHUNK_SIZE = 64*1024;
+	static const size_t ALIGNMENT = 2*sizeof(void*);
+
+	std::vector<char *> chunks;
+	size_t chunk; // index of the chunk currently allocated from
+	size_t offset; // first free byte in that chunk
+	int depth; // number of active Scopes on this thread
+
+	friend class Scope;
+	friend class boost::thread_specific_ptr<EvalArena>;
+};
+
+/*!
+	STL allocator which takes its memory from the calling thread's
+	EvalArena when an allocation scope is active, and falls back to the
+	heap otherwise. Each block carries a one-word header recording its
+	origin, so deallocate() frees heap blocks and leaves arena blocks to
+	be reclaimed wholesale when the enclosing EvalArena::Scope closes.
+*/
+template<typename T>
+class ArenaAlloc
+{
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+
+	template<typename U> struct rebind { typedef ArenaAlloc<U> other; };
+
+	ArenaAlloc() {}
+	template<typename U> ArenaAlloc(const ArenaAlloc<U> &) {}
+
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+
+	pointer allocate(size_type n, const void * /*hint*/ = 0) {
+		size_type bytes = sizeof(Header) + n*sizeof(T);
+		Header *h = NULL;
+		EvalArena *arena = EvalArena::current();
+		if (arena) h = static_cast<Header *>(arena->alloc(bytes));
+		if (h) {
+			h->from_arena = true;
+		}
+		else {
+			h = static_cast<Header *>(malloc(bytes));
+			if (!h) throw std::bad_alloc();
+			h->from_arena = false;
+		}
+		return reinterpret_cast<pointer>(h + 1);
+	}
+
+	void deallocate(pointer p, size_type /*n*/) {
+		Header *h = reinterpret_cast<Header *>(p) - 1;
+		if (!h->from_arena) free(h);
+	}
+
+	size_type max_size() const { return size_type(-1) / sizeof(T); }
+
+	void construct(pointer p, const T &val) { new(static_cast<void *>(p)) T(val); }
+	void destroy(pointer p) { p->~T(); }
+
+private:
+	// One-word origin tag, padded so the payload stays aligned for
+	// doubles and pointers
+	union Header {
+		bool from_arena;
+		double align_d;
+		void *align_p;
+	};
+};
+
+template<typename T, typename U>
+inline bool operator==(const ArenaAlloc<T> &, const ArenaAlloc<U> &) { return true; }
+
+template<typename T, typename U>
+inline bool operator!=(const ArenaAlloc<T> &, const ArenaAlloc<U> &) { return false; }
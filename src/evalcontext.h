@@ -20,6 +20,8 @@ public:
 	const std::string &getArgName(size_t i) const;
 	Value getArgValue(size_t i, const Context *ctx = NULL) const;
 
+	//! The children passed to this call, still unevaluated; consumers
+	//! (the children()/child() builtins) evaluate only what they select
 	size_t numChildren() const;
 	ModuleInstantiation *getChild(size_t i) const;
 
@@ -27,24 +27,68 @@
 #include "export.h"
 #include "printutils.h"
 #include "polyset.h"
+#include "filebacked.h"
+#include "lodepng.h"
 #include "polyset-utils.h"
+#include "Reindexer.h"
 #include "dxfdata.h"
+#include "feature.h"
 
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <map>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/detail/endian.hpp>
+#include <boost/format.hpp>
+#include <boost/uuid/sha1.hpp>
 
 #define QUOTE(x__) # x__
 #define QUOTED(x__) QUOTE(x__)
 
+/*!
+	Shared buffered formatting for the text exporters. Everything is
+	appended to one large in-memory buffer which is flushed with a single
+	stream write, and numbers are formatted with snprintf instead of the
+	much slower ostream insertion operators. "%g" produces the same six
+	significant digits the exporters have always written.
+*/
+static void append_text(std::vector<char> &buffer, const char *text)
+{
+	buffer.insert(buffer.end(), text, text + strlen(text));
+}
+
+static void append_double(std::vector<char> &buffer, double d)
+{
+	char tmp[32];
+	int len = snprintf(tmp, sizeof(tmp), "%g", d);
+	buffer.insert(buffer.end(), tmp, tmp + len);
+}
+
+static void append_unsigned(std::vector<char> &buffer, size_t u)
+{
+	char tmp[32];
+	int len = snprintf(tmp, sizeof(tmp), "%lu", (unsigned long)u);
+	buffer.insert(buffer.end(), tmp, tmp + len);
+}
+
+static void flush_buffer(std::vector<char> &buffer, std::ostream &output)
+{
+	if (!buffer.empty()) output.write(&buffer[0], buffer.size());
+	buffer.clear();
+}
+
 #ifdef ENABLE_CGAL
 #include "CGAL_Nef_polyhedron.h"
 #include "cgal.h"
 #include "cgalutils.h"
 
 struct triangle {
-    std::string vs1;
-    std::string vs2;
-    std::string vs3;
+    size_t vs1;
+    size_t vs2;
+    size_t vs3;
 };
 
 void exportFile(const class Geometry *root_geom, std::ostream &output, FileFormat format)
@@ -64,6 +108,9 @@ void exportFile(const class Geometry *root_geom, std::ostream &output, FileForma
 		case OPENSCAD_DXF:
 			assert(false && "Export Nef polyhedron as DXF not supported");
 			break;
+		case OPENSCAD_NEF3:
+			export_nef3(N, output);
+			break;
 		default:
 			assert(false && "Unknown file format");
 		}
@@ -80,6 +127,9 @@ void exportFile(const class Geometry *root_geom, std::ostream &output, FileForma
 			case OPENSCAD_AMF:
 				export_amf(*ps, output);
 				break;
+			case OPENSCAD_NEF3:
+				export_nef3(*ps, output);
+				break;
 			default:
 				assert(false && "Unsupported file format");
 			}
@@ -101,17 +151,165 @@ void exportFile(const class Geometry *root_geom, std::ostream &output, FileForma
 	}
 }
 
+/*!
+	Hex SHA1 condensing a cache id string, same as the CGAL disk cache
+	applies to its keys (see CGALCache::diskCacheFile()).
+*/
+static std::string content_hash(const std::string &contentid)
+{
+	boost::uuids::detail::sha1 sha;
+	sha.process_bytes(contentid.data(), contentid.size());
+	unsigned int digest[5];
+	sha.get_digest(digest);
+	std::string hash;
+	for (int i=0;i<5;i++) hash += str(boost::format("%08x") % digest[i]);
+	return hash;
+}
+
+/*
+	Streaming gzip filter for export outputs. Facet data is collected in
+	~4MB chunks and pushed through lodepng's deflate as one continuous
+	stream (each chunk ends on a sync flush, the same trick the parallel
+	PNG encoder uses), so compression is interleaved with the geometry
+	traversal and the uncompressed output never exists on disk or in
+	memory as a whole. Activated by a trailing .gz on the output
+	filename; see exportFileByName().
+*/
+#define GZIP_CHUNK_BYTES (4*1024*1024)
+
+static unsigned crc32_update(unsigned crc, const unsigned char *data, size_t len)
+{
+	static unsigned table[256];
+	static bool table_built = false;
+	if (!table_built) {
+		for (unsigned n = 0; n < 256; n++) {
+			unsigned c = n;
+			for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		table_built = true;
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+class GzipStreamBuf : public std::streambuf
+{
+public:
+	GzipStreamBuf(std::ostream &sink) : sink(sink), crc(0), rawsize(0), failed(false)
+	{
+		this->buffer.resize(GZIP_CHUNK_BYTES);
+		setp(&this->buffer[0], &this->buffer[0] + this->buffer.size());
+		// gzip header: magic, deflate, no flags/mtime/extra, unknown OS
+		static const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255 };
+		this->sink.write(reinterpret_cast<const char *>(header), sizeof(header));
+	}
+
+	//! Emits the final deflate block and the gzip trailer
+	bool finish()
+	{
+		compressChunk(true);
+		if (!this->failed) {
+			unsigned char trailer[8];
+			for (int i = 0; i < 4; i++) trailer[i] = (unsigned char)((this->crc >> (8*i)) & 255);
+			for (int i = 0; i < 4; i++) trailer[4+i] = (unsigned char)((this->rawsize >> (8*i)) & 255);
+			this->sink.write(reinterpret_cast<const char *>(trailer), sizeof(trailer));
+		}
+		return !this->failed;
+	}
+
+protected:
+	virtual int overflow(int c)
+	{
+		compressChunk(false);
+		if (this->failed) return EOF;
+		if (c != EOF) {
+			*pptr() = (char)c;
+			pbump(1);
+		}
+		return c;
+	}
+
+	virtual int sync()
+	{
+		// Chunks may only end on deflate_part boundaries, so a flush just
+		// compresses what's buffered so far
+		compressChunk(false);
+		return this->failed ? -1 : 0;
+	}
+
+private:
+	void compressChunk(bool final)
+	{
+		size_t n = pptr() - pbase();
+		if (n == 0 && !final) return;
+		const unsigned char *in = reinterpret_cast<const unsigned char *>(pbase());
+		LodePNGCompressSettings settings = lodepng_default_compress_settings;
+		settings.windowsize = 32768; // full deflate window for bulk data
+		unsigned char *out = NULL;
+		size_t outsize = 0;
+		unsigned err = lodepng_deflate_part(&out, &outsize, in, n, &settings, final ? 1 : 0);
+		if (err) this->failed = true;
+		else {
+			this->sink.write(reinterpret_cast<const char *>(out), outsize);
+			this->crc = crc32_update(this->crc, in, n);
+			this->rawsize += n;
+		}
+		free(out);
+		setp(&this->buffer[0], &this->buffer[0] + this->buffer.size());
+	}
+
+	std::ostream &sink;
+	std::vector<char> buffer;
+	unsigned crc;
+	size_t rawsize;
+	bool failed;
+};
+
 void exportFileByName(const class Geometry *root_geom, FileFormat format,
-	const char *name2open, const char *name2display)
+	const char *name2open, const char *name2display,
+	const std::string &contentid)
 {
-	std::ofstream fstream(name2open);
+	std::string sidecarfile;
+	std::string hash;
+	if (!contentid.empty()) {
+		sidecarfile = std::string(name2open) + ".hash";
+		// The exporter version matters as much as the geometry: a new
+		// release - or toggling binary-stl - may format the same mesh
+		// differently
+		hash = content_hash(str(boost::format("%s|%d|%d|%s")
+														% QUOTED(OPENSCAD_VERSION) % (int)format
+														% (int)Feature::ExperimentalBinaryStl.is_enabled() % contentid));
+		std::string recorded;
+		std::ifstream sidecar(sidecarfile.c_str());
+		if (sidecar.is_open() && std::getline(sidecar, recorded) && recorded == hash) {
+			std::ifstream existing(name2open, std::ios::in | std::ios::binary);
+			if (existing.is_open()) {
+				PRINTB("\"%s\" is unchanged, skipping write", name2display);
+				return;
+			}
+		}
+	}
+
+	std::ofstream fstream(name2open, std::ios::out | std::ios::binary);
 	if (!fstream.is_open()) {
 		PRINTB("Can't open file \"%s\" for export", name2display);
 	} else {
 		bool onerror = false;
 		fstream.exceptions(std::ios::badbit|std::ios::failbit);
 		try {
-			exportFile(root_geom, fstream, format);
+			// A trailing .gz streams the output through the deflate filter;
+			// the exporters are none the wiser
+			if (boost::algorithm::iends_with(name2open, ".gz")) {
+				GzipStreamBuf gzbuf(fstream);
+				std::ostream gzstream(&gzbuf);
+				exportFile(root_geom, gzstream, format);
+				if (!gzbuf.finish()) onerror = true;
+			}
+			else {
+				exportFile(root_geom, fstream, format);
+			}
 		} catch (std::ios::failure x) {
 			onerror = true;
 		}
@@ -123,100 +321,219 @@ void exportFileByName(const class Geometry *root_geom, FileFormat format,
 		if (onerror) {
 			PRINTB("ERROR: \"%s\" write error. (Disk full?)", name2display);
 		}
+		else if (!hash.empty()) {
+			std::ofstream sidecar(sidecarfile.c_str(), std::ios::out | std::ios::trunc);
+			if (sidecar.is_open()) sidecar << hash << "\n";
+		}
 	}
 }
 
-void export_stl(const PolySet &ps, std::ostream &output)
+static void append_stl_uint32(std::vector<char> &buffer, uint32_t u)
+{
+#ifdef BOOST_BIG_ENDIAN
+	u = (u >> 24) | ((u >> 8) & 0xff00) | ((u << 8) & 0xff0000) | (u << 24);
+#endif
+	const char *bytes = reinterpret_cast<const char *>(&u);
+	buffer.insert(buffer.end(), bytes, bytes + 4);
+}
+
+static void append_stl_float32(std::vector<char> &buffer, double d)
+{
+	union { float f; uint32_t u; } conv;
+	conv.f = (float)d;
+	append_stl_uint32(buffer, conv.u);
+}
+
+/*!
+	Saves the given PolySet as binary STL. The facet records are assembled
+	in one large in-memory buffer and flushed with a single stream write,
+	so exports are bound by I/O rather than per-facet formatting.
+*/
+/*!
+	Streaming ASCII facet writer fed by CGALUtils::streamNefTriangles().
+	The buffer is flushed whenever it fills up, so the export runs at a
+	small constant memory footprint no matter how many facets the model
+	has. Mirrors the degenerate-triangle and normal handling of the old
+	Polyhedron-based writer: triangles whose formatted vertices collapse
+	are skipped, and collinear triangles get the "1 0 0" dummy normal.
+*/
+struct StreamingStl {
+	std::vector<char> *buffer;
+	std::ostream *output;
+};
+
+#define STREAMING_STL_FLUSH_BYTES (256*1024)
+
+static void export_stl_triangle(const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, void *userdata)
+{
+	StreamingStl *ctx = static_cast<StreamingStl *>(userdata);
+	std::vector<char> &buffer = *ctx->buffer;
+
+	char vs1[100], vs2[100], vs3[100];
+	snprintf(vs1, sizeof(vs1), "%g %g %g", p0[0], p0[1], p0[2]);
+	snprintf(vs2, sizeof(vs2), "%g %g %g", p1[0], p1[1], p1[2]);
+	snprintf(vs3, sizeof(vs3), "%g %g %g", p2[0], p2[1], p2[2]);
+	if (!strcmp(vs1, vs2) || !strcmp(vs1, vs3) || !strcmp(vs2, vs3)) return;
+
+	Vector3d normal = (p1 - p0).cross(p2 - p0);
+	if (normal.norm() > 0) {
+		normal.normalize();
+		append_text(buffer, "  facet normal ");
+		append_double(buffer, normal[0]);
+		buffer.push_back(' ');
+		append_double(buffer, normal[1]);
+		buffer.push_back(' ');
+		append_double(buffer, normal[2]);
+		buffer.push_back('\n');
+	}
+	else append_text(buffer, "  facet normal 1 0 0\n");
+	append_text(buffer, "    outer loop\n");
+	append_text(buffer, "      vertex ");
+	append_text(buffer, vs1);
+	append_text(buffer, "\n      vertex ");
+	append_text(buffer, vs2);
+	append_text(buffer, "\n      vertex ");
+	append_text(buffer, vs3);
+	append_text(buffer, "\n    endloop\n  endfacet\n");
+
+	if (buffer.size() >= STREAMING_STL_FLUSH_BYTES) flush_buffer(buffer, *ctx->output);
+}
+
+// Triangles per read window when exporting a spilled PolySet (~4.5MB)
+#define STL_SPILL_WINDOW_TRIANGLES (64*1024)
+
+static void append_stl_binary_triangle(std::vector<char> &buffer, const Vector3d &p0, const Vector3d &p1, const Vector3d &p2)
 {
+	Vector3d normal = (p1 - p0).cross(p2 - p0);
+	if (normal.norm() > 0) normal.normalize();
+	else normal << 0, 0, 0;
+	for (int i=0;i<3;i++) append_stl_float32(buffer, normal[i]);
+	for (int i=0;i<3;i++) append_stl_float32(buffer, p0[i]);
+	for (int i=0;i<3;i++) append_stl_float32(buffer, p1[i]);
+	for (int i=0;i<3;i++) append_stl_float32(buffer, p2[i]);
+	// attribute byte count
+	buffer.push_back(0);
+	buffer.push_back(0);
+}
+
+static void export_stl_binary(const PolySet &ps, std::ostream &output)
+{
+	char header[80];
+	memset(header, 0, sizeof(header));
+	strncpy(header, "OpenSCAD Model", sizeof(header)-1);
+
+	// A spilled PolySet is already pure triangles; stream it through a
+	// bounded window instead of reloading it onto the heap
+	if (ps.isSpilled()) {
+		const FileBackedTriangleStore *store = ps.spilledStore();
+		output.write(header, sizeof(header));
+		std::vector<char> buffer;
+		buffer.reserve(4 + 50 * STL_SPILL_WINDOW_TRIANGLES);
+		size_t numtri = store->numTriangles();
+		append_stl_uint32(buffer, numtri);
+		std::vector<double> window(STL_SPILL_WINDOW_TRIANGLES * 9);
+		size_t index = 0;
+		while (index < numtri) {
+			size_t got = store->readWindow(index, &window[0], window.size());
+			if (!got) break;
+			for (size_t i = 0; i < got; i++) {
+				const double *t = &window[i * 9];
+				append_stl_binary_triangle(buffer,
+																	 Vector3d(t[0], t[1], t[2]),
+																	 Vector3d(t[3], t[4], t[5]),
+																	 Vector3d(t[6], t[7], t[8]));
+			}
+			output.write(&buffer[0], buffer.size());
+			buffer.clear();
+			index += got;
+		}
+		return;
+	}
+
 	PolySet triangulated(3);
 	PolysetUtils::tessellate_faces(ps, triangulated);
 
-	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
-	output << "solid OpenSCAD_Model\n";
+	output.write(header, sizeof(header));
+
+	std::vector<char> buffer;
+	buffer.reserve(4 + 50 * triangulated.polygons.size());
+	append_stl_uint32(buffer, triangulated.polygons.size());
 	BOOST_FOREACH(const PolySet::Polygon &p, triangulated.polygons) {
-		output << "  facet normal 0 0 0\n";
-		output << "    outer loop\n";
 		assert(p.size() == 3); // STL only allows triangles
+		Vector3d normal = (p[1] - p[0]).cross(p[2] - p[0]);
+		if (normal.norm() > 0) normal.normalize();
+		else normal << 0, 0, 0;
+		for (int i=0;i<3;i++) append_stl_float32(buffer, normal[i]);
 		BOOST_FOREACH(const Vector3d &v, p) {
-			output << "vertex " << v[0] << " " << v[1] << " " << v[2] << "\n";
+			for (int i=0;i<3;i++) append_stl_float32(buffer, v[i]);
 		}
-		output << "    endloop\n";
-		output << "  endfacet\n";
+		// attribute byte count
+		buffer.push_back(0);
+		buffer.push_back(0);
 	}
-	output << "endsolid OpenSCAD_Model\n";
-	setlocale(LC_NUMERIC, "");      // Set default locale
+	output.write(&buffer[0], buffer.size());
 }
 
-/*!
-	Saves the given CGAL Polyhedon2 as STL to the given file.
-	The file must be open.
- */
-static void export_stl(const CGAL_Polyhedron &P, std::ostream &output)
+void export_stl(const PolySet &ps, std::ostream &output)
 {
-	typedef CGAL_Polyhedron::Vertex                                 Vertex;
-	typedef CGAL_Polyhedron::Vertex_const_iterator                  VCI;
-	typedef CGAL_Polyhedron::Facet_const_iterator                   FCI;
-	typedef CGAL_Polyhedron::Halfedge_around_facet_const_circulator HFCC;
-
-	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
-
-	output << "solid OpenSCAD_Model\n";
+	if (Feature::ExperimentalBinaryStl.is_enabled()) {
+		export_stl_binary(ps, output);
+		return;
+	}
 
-	for (FCI fi = P.facets_begin(); fi != P.facets_end(); ++fi) {
-		HFCC hc = fi->facet_begin();
-		HFCC hc_end = hc;
-		Vertex v1, v2, v3;
-		v1 = *VCI((hc++)->vertex());
-		v3 = *VCI((hc++)->vertex());
-		do {
-			v2 = v3;
-			v3 = *VCI((hc++)->vertex());
-			double x1 = CGAL::to_double(v1.point().x());
-			double y1 = CGAL::to_double(v1.point().y());
-			double z1 = CGAL::to_double(v1.point().z());
-			double x2 = CGAL::to_double(v2.point().x());
-			double y2 = CGAL::to_double(v2.point().y());
-			double z2 = CGAL::to_double(v2.point().z());
-			double x3 = CGAL::to_double(v3.point().x());
-			double y3 = CGAL::to_double(v3.point().y());
-			double z3 = CGAL::to_double(v3.point().z());
-			std::stringstream stream;
-			stream << x1 << " " << y1 << " " << z1;
-			std::string vs1 = stream.str();
-			stream.str("");
-			stream << x2 << " " << y2 << " " << z2;
-			std::string vs2 = stream.str();
-			stream.str("");
-			stream << x3 << " " << y3 << " " << z3;
-			std::string vs3 = stream.str();
-			if (vs1 != vs2 && vs1 != vs3 && vs2 != vs3) {
-				// The above condition ensures that there are 3 distinct vertices, but
-				// they may be collinear. If they are, the unit normal is meaningless
-				// so the default value of "1 0 0" can be used. If the vertices are not
-				// collinear then the unit normal must be calculated from the
-				// components.
-				if (!CGAL::collinear(v1.point(),v2.point(),v3.point())) {
-					CGAL_Polyhedron::Traits::Vector_3 normal = CGAL::normal(v1.point(),v2.point(),v3.point());
-					output << "  facet normal "
-								 << CGAL::sign(normal.x()) * sqrt(CGAL::to_double(normal.x()*normal.x()/normal.squared_length()))
-								 << " "
-								 << CGAL::sign(normal.y()) * sqrt(CGAL::to_double(normal.y()*normal.y()/normal.squared_length()))
-								 << " "
-								 << CGAL::sign(normal.z()) * sqrt(CGAL::to_double(normal.z()*normal.z()/normal.squared_length()))
-								 << "\n";
-				}
-				else output << "  facet normal 1 0 0\n";
-				output << "    outer loop\n";
-				output << "      vertex " << vs1 << "\n";
-				output << "      vertex " << vs2 << "\n";
-				output << "      vertex " << vs3 << "\n";
-				output << "    endloop\n";
-				output << "  endfacet\n";
+	// Same windowed streaming as the binary writer for spilled sets
+	if (ps.isSpilled()) {
+		const FileBackedTriangleStore *store = ps.spilledStore();
+		setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+		std::vector<char> buffer;
+		buffer.reserve(STREAMING_STL_FLUSH_BYTES + 1024);
+		append_text(buffer, "solid OpenSCAD_Model\n");
+		StreamingStl ctx = { &buffer, &output };
+		std::vector<double> window(STL_SPILL_WINDOW_TRIANGLES * 9);
+		size_t numtri = store->numTriangles();
+		size_t index = 0;
+		while (index < numtri) {
+			size_t got = store->readWindow(index, &window[0], window.size());
+			if (!got) break;
+			for (size_t i = 0; i < got; i++) {
+				const double *t = &window[i * 9];
+				export_stl_triangle(Vector3d(t[0], t[1], t[2]),
+														Vector3d(t[3], t[4], t[5]),
+														Vector3d(t[6], t[7], t[8]), &ctx);
 			}
-		} while (hc != hc_end);
+			index += got;
+		}
+		append_text(buffer, "endsolid OpenSCAD_Model\n");
+		flush_buffer(buffer, output);
+		setlocale(LC_NUMERIC, "");      // Set default locale
+		return;
 	}
 
-	output << "endsolid OpenSCAD_Model\n";
+	PolySet triangulated(3);
+	PolysetUtils::tessellate_faces(ps, triangulated);
+
+	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+	std::vector<char> buffer;
+	buffer.reserve(120 * triangulated.polygons.size());
+	append_text(buffer, "solid OpenSCAD_Model\n");
+	BOOST_FOREACH(const PolySet::Polygon &p, triangulated.polygons) {
+		append_text(buffer, "  facet normal 0 0 0\n");
+		append_text(buffer, "    outer loop\n");
+		assert(p.size() == 3); // STL only allows triangles
+		BOOST_FOREACH(const Vector3d &v, p) {
+			append_text(buffer, "vertex ");
+			append_double(buffer, v[0]);
+			buffer.push_back(' ');
+			append_double(buffer, v[1]);
+			buffer.push_back(' ');
+			append_double(buffer, v[2]);
+			buffer.push_back('\n');
+		}
+		append_text(buffer, "    endloop\n");
+		append_text(buffer, "  endfacet\n");
+	}
+	append_text(buffer, "endsolid OpenSCAD_Model\n");
+	flush_buffer(buffer, output);
 	setlocale(LC_NUMERIC, "");      // Set default locale
 }
 
@@ -230,43 +547,122 @@ void export_stl(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
 		PRINT("Object isn't a valid 2-manifold! Modify your design.\n");
 	}
 
-	bool usePolySet = false;
+	// The binary writer works on triangulated PolySets, so take the
+	// PolySet route when it's enabled. The memoized view means a preceding
+	// render or export already paid for the triangulation.
+	bool usePolySet = Feature::ExperimentalBinaryStl.is_enabled();
 	if (usePolySet) {
-		PolySet ps(3);
-		bool err = createPolySetFromNefPolyhedron3(*(root_N->p3), ps);
-		if (err) { PRINT("ERROR: Nef->PolySet failed"); }
+		shared_ptr<const PolySet> ps = root_N->polySet();
+		if (!ps) { PRINT("ERROR: Nef->PolySet failed"); }
 		else {
-			export_stl(ps, output);
+			export_stl(*ps, output);
 		}
 	}
 	else {
+		// Stream triangles straight off the Nef halffacets; the old route
+		// through convert_to_Polyhedron built a second full copy of the
+		// model before writing a single byte.
 		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
 		try {
-			CGAL_Polyhedron P;
-			//root_N->p3->convert_to_Polyhedron(P);
-			bool err = nefworkaround::convert_to_Polyhedron<CGAL_Kernel3>( *(root_N->p3), P );
-			if (err) {
-				PRINT("ERROR: CGAL NefPolyhedron->Polyhedron conversion failed");
-				return;
-			}
-			export_stl(P, output);
+			setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+			std::vector<char> buffer;
+			buffer.reserve(STREAMING_STL_FLUSH_BYTES + 1024);
+			append_text(buffer, "solid OpenSCAD_Model\n");
+			StreamingStl ctx = { &buffer, &output };
+			CGALUtils::streamNefTriangles(*root_N->p3, &export_stl_triangle, &ctx);
+			append_text(buffer, "endsolid OpenSCAD_Model\n");
+			flush_buffer(buffer, output);
+			setlocale(LC_NUMERIC, "");      // Set default locale
 		}
 		catch (const CGAL::Assertion_exception &e) {
-			PRINTB("CGAL error in CGAL_Nef_polyhedron3::convert_to_Polyhedron(): %s", e.what());
+			PRINTB("CGAL error in export_stl: %s", e.what());
 		}
 		catch (...) {
-			PRINT("CGAL unknown error in CGAL_Nef_polyhedron3::convert_to_Polyhedron()");
+			PRINT("CGAL unknown error in export_stl");
 		}
 		CGAL::set_error_behaviour(old_behaviour);
 	}
 }
 
+/*!
+	Collects the mesh's faces as index lists over welded vertices.
+	Exact duplicates are merged through the Reindexer, the same welding
+	polyset.cc uses; a spilled PolySet is read back through a bounded
+	window like the STL path does.
+*/
+static void reindex_polyset(const PolySet &ps, Reindexer<Vector3d> &vertices,
+	std::vector<std::vector<size_t> > &faces)
+{
+	if (ps.isSpilled()) {
+		const FileBackedTriangleStore *store = ps.spilledStore();
+		size_t numtri = store->numTriangles();
+		faces.reserve(numtri);
+		std::vector<double> window(STL_SPILL_WINDOW_TRIANGLES * 9);
+		size_t index = 0;
+		while (index < numtri) {
+			size_t got = store->readWindow(index, &window[0], window.size());
+			if (!got) break;
+			for (size_t i = 0; i < got; i++) {
+				const double *t = &window[i * 9];
+				std::vector<size_t> face(3);
+				face[0] = vertices.lookup(Vector3d(t[0], t[1], t[2]));
+				face[1] = vertices.lookup(Vector3d(t[3], t[4], t[5]));
+				face[2] = vertices.lookup(Vector3d(t[6], t[7], t[8]));
+				faces.push_back(face);
+			}
+			index += got;
+		}
+		return;
+	}
+
+	faces.reserve(ps.polygons.size());
+	BOOST_FOREACH(const PolySet::Polygon &p, ps.polygons) {
+		std::vector<size_t> face;
+		face.reserve(p.size());
+		BOOST_FOREACH(const Vector3d &v, p) {
+			face.push_back(vertices.lookup(v));
+		}
+		faces.push_back(face);
+	}
+}
+
 void export_off(const class PolySet &ps, std::ostream &output)
 {
-	// FIXME: Implement this without creating a Nef polyhedron
-	CGAL_Nef_polyhedron *N = createNefPolyhedronFromGeometry(ps);
-	export_off(N, output);
-	delete N;
+	// Weld the duplicated per-face vertices and write a true indexed
+	// mesh directly; the old route built a full Nef polyhedron just to
+	// reach CGAL's indexed writer.
+	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+
+	Reindexer<Vector3d> vertices;
+	std::vector<std::vector<size_t> > faces;
+	reindex_polyset(ps, vertices, faces);
+	const Vector3d *varray = vertices.getArray();
+
+	std::vector<char> buffer;
+	buffer.reserve(40 * vertices.size() + 20 * faces.size());
+	append_text(buffer, "OFF ");
+	append_unsigned(buffer, vertices.size());
+	append_text(buffer, " ");
+	append_unsigned(buffer, faces.size());
+	append_text(buffer, " 0\n");
+	for (size_t i = 0; i < vertices.size(); i++) {
+		for (int c = 0; c < 3; c++) {
+			if (c) append_text(buffer, " ");
+			append_double(buffer, varray[i][c]);
+		}
+		append_text(buffer, "\n");
+	}
+	for (size_t i = 0; i < faces.size(); i++) {
+		append_unsigned(buffer, faces[i].size());
+		for (size_t j = 0; j < faces[i].size(); j++) {
+			append_text(buffer, " ");
+			append_unsigned(buffer, faces[i][j]);
+		}
+		append_text(buffer, "\n");
+	}
+	flush_buffer(buffer, output);
+
+	setlocale(LC_NUMERIC, ""); // Set default locale
 }
 
 void export_off(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
@@ -289,12 +685,103 @@ void export_off(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
 
 void export_amf(const class PolySet &ps, std::ostream &output)
 {
-	// FIXME: Implement this without creating a Nef polyhedron
+	// Weld the duplicated per-face vertices and emit indexed vertex and
+	// triangle sections directly, matching the Nef path's output; the
+	// old route built a full Nef polyhedron first.
+	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+
+	Reindexer<Vector3d> vertices;
+	std::vector<std::vector<size_t> > faces;
+	if (ps.isSpilled()) {
+		reindex_polyset(ps, vertices, faces);
+	} else {
+		PolySet triangulated(3);
+		PolysetUtils::tessellate_faces(ps, triangulated);
+		reindex_polyset(triangulated, vertices, faces);
+	}
+	const Vector3d *varray = vertices.getArray();
+
+	std::vector<triangle> triangles;
+	triangles.reserve(faces.size());
+	for (size_t i = 0; i < faces.size(); i++) {
+		const std::vector<size_t> &f = faces[i];
+		if (f.size() != 3) continue;
+		if (f[0] == f[1] || f[0] == f[2] || f[1] == f[2]) continue; // welded degenerate
+		triangle tri = {f[0], f[1], f[2]};
+		triangles.push_back(tri);
+	}
+
+	std::vector<char> buffer;
+	buffer.reserve(70 * vertices.size() + 90 * triangles.size());
+	append_text(buffer, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+		"<amf unit=\"millimeter\">\r\n"
+		" <metadata type=\"producer\">OpenSCAD " QUOTED(OPENSCAD_VERSION));
+#ifdef OPENSCAD_COMMIT
+	append_text(buffer, " (git " QUOTED(OPENSCAD_COMMIT) ")");
+#endif
+	append_text(buffer, "</metadata>\r\n"
+		" <object id=\"0\">\r\n"
+		"  <mesh>\r\n"
+		"   <vertices>\r\n");
+	for (size_t i = 0; i < vertices.size(); i++) {
+		append_text(buffer, "    <vertex><coordinates>\r\n     <x>");
+		append_double(buffer, varray[i][0]);
+		append_text(buffer, "</x>\r\n     <y>");
+		append_double(buffer, varray[i][1]);
+		append_text(buffer, "</y>\r\n     <z>");
+		append_double(buffer, varray[i][2]);
+		append_text(buffer, "</z>\r\n    </coordinates></vertex>\r\n");
+	}
+	append_text(buffer, "   </vertices>\r\n   <volume>\r\n");
+	for (size_t i = 0; i < triangles.size(); i++) {
+		const triangle &t = triangles[i];
+		append_text(buffer, "    <triangle>\r\n     <v1>");
+		append_unsigned(buffer, t.vs1);
+		append_text(buffer, "</v1>\r\n     <v2>");
+		append_unsigned(buffer, t.vs2);
+		append_text(buffer, "</v2>\r\n     <v3>");
+		append_unsigned(buffer, t.vs3);
+		append_text(buffer, "</v3>\r\n    </triangle>\r\n");
+	}
+	append_text(buffer, "   </volume>\r\n"
+		"  </mesh>\r\n"
+		" </object>\r\n"
+		"</amf>\r\n");
+	flush_buffer(buffer, output);
+
+	setlocale(LC_NUMERIC, ""); // Set default locale
+}
+
+void export_nef3(const class PolySet &ps, std::ostream &output)
+{
+	// Mesh roots are Nef'ed first so the frame stays exact downstream
 	CGAL_Nef_polyhedron *N = createNefPolyhedronFromGeometry(ps);
-	export_amf(N, output);
+	export_nef3(N, output);
 	delete N;
 }
 
+void export_nef3(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
+{
+	if (!CGALUtils::serializeNefPolyhedron(*root_N, output)) {
+		PRINT("WARNING: Error writing serialized Nef polyhedron");
+	}
+}
+
+/*!
+	Returns the index of the formatted vertex, appending it to the list on
+	first sight. The map mirrors the list so lookups don't scan it linearly.
+*/
+static size_t amf_vertex_index(std::vector<std::string> &vertices,
+	std::map<std::string, size_t> &index, const char *vs)
+{
+	std::map<std::string, size_t>::iterator it = index.find(vs);
+	if (it != index.end()) return it->second;
+	size_t idx = vertices.size();
+	vertices.push_back(vs);
+	index[vs] = idx;
+	return idx;
+}
+
 /*!
     Saves the current 3D CGAL Nef polyhedron as AMF to the given file.
     The file must be open.
@@ -318,6 +805,7 @@ void export_amf(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
 		setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
 
 		std::vector<std::string> vertices;
+		std::map<std::string, size_t> vertex_index;
 		std::vector<triangle> triangles;
 
 		for (FCI fi = P.facets_begin(); fi != P.facets_end(); ++fi) {
@@ -338,75 +826,66 @@ void export_amf(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
 				double x3 = CGAL::to_double(v3.point().x());
 				double y3 = CGAL::to_double(v3.point().y());
 				double z3 = CGAL::to_double(v3.point().z());
-				std::stringstream stream;
-				stream << x1 << " " << y1 << " " << z1;
-				std::string vs1 = stream.str();
-				stream.str("");
-				stream << x2 << " " << y2 << " " << z2;
-				std::string vs2 = stream.str();
-				stream.str("");
-				stream << x3 << " " << y3 << " " << z3;
-				std::string vs3 = stream.str();
-				if (std::find(vertices.begin(), vertices.end(), vs1) == vertices.end())
-					vertices.push_back(vs1);
-				if (std::find(vertices.begin(), vertices.end(), vs2) == vertices.end())
-					vertices.push_back(vs2);
-				if (std::find(vertices.begin(), vertices.end(), vs3) == vertices.end())
-					vertices.push_back(vs3);
-
-				if (vs1 != vs2 && vs1 != vs3 && vs2 != vs3) {
+				char vs1[100], vs2[100], vs3[100];
+				snprintf(vs1, sizeof(vs1), "%g %g %g", x1, y1, z1);
+				snprintf(vs2, sizeof(vs2), "%g %g %g", x2, y2, z2);
+				snprintf(vs3, sizeof(vs3), "%g %g %g", x3, y3, z3);
+				size_t i1 = amf_vertex_index(vertices, vertex_index, vs1);
+				size_t i2 = amf_vertex_index(vertices, vertex_index, vs2);
+				size_t i3 = amf_vertex_index(vertices, vertex_index, vs3);
+
+				if (i1 != i2 && i1 != i3 && i2 != i3) {
 					// The above condition ensures that there are 3 distinct vertices, but
 					// they may be collinear. If they are, the unit normal is meaningless
 					// so the default value of "1 0 0" can be used. If the vertices are not
 					// collinear then the unit normal must be calculated from the
 					// components.
-					triangle tri = {vs1, vs2, vs3};
+					triangle tri = {i1, i2, i3};
 					triangles.push_back(tri);
 				}
 			} while (hc != hc_end);
 		}
 
-		output << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
-			<< "<amf unit=\"millimeter\">\r\n"
-			<< " <metadata type=\"producer\">OpenSCAD " << QUOTED(OPENSCAD_VERSION)
+		std::vector<char> buffer;
+		buffer.reserve(70 * vertices.size() + 90 * triangles.size());
+		append_text(buffer, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+			"<amf unit=\"millimeter\">\r\n"
+			" <metadata type=\"producer\">OpenSCAD " QUOTED(OPENSCAD_VERSION));
 #ifdef OPENSCAD_COMMIT
-			<< " (git " << QUOTED(OPENSCAD_COMMIT) << ")"
+		append_text(buffer, " (git " QUOTED(OPENSCAD_COMMIT) ")");
 #endif
-			<< "</metadata>\r\n"
-			<< " <object id=\"0\">\r\n"
-			<< "  <mesh>\r\n";
-		output << "   <vertices>\r\n";
+		append_text(buffer, "</metadata>\r\n"
+			" <object id=\"0\">\r\n"
+			"  <mesh>\r\n"
+			"   <vertices>\r\n");
 		for (size_t i = 0; i < vertices.size(); i++) {
-			std::string s = vertices[i];
-			output << "    <vertex><coordinates>\r\n";
-			char* chrs = new char[s.length() + 1];
-			strcpy(chrs, s.c_str());
-			std::string coords = strtok(chrs, " ");
-			output << "     <x>" << coords << "</x>\r\n";
-			coords = strtok(NULL, " ");
-			output << "     <y>" << coords << "</y>\r\n";
-			coords = strtok(NULL, " ");
-			output << "     <z>" << coords << "</z>\r\n";
-			output << "    </coordinates></vertex>\r\n";
+			const std::string &s = vertices[i];
+			size_t e1 = s.find(' ');
+			size_t e2 = s.find(' ', e1 + 1);
+			append_text(buffer, "    <vertex><coordinates>\r\n     <x>");
+			buffer.insert(buffer.end(), s.begin(), s.begin() + e1);
+			append_text(buffer, "</x>\r\n     <y>");
+			buffer.insert(buffer.end(), s.begin() + e1 + 1, s.begin() + e2);
+			append_text(buffer, "</y>\r\n     <z>");
+			buffer.insert(buffer.end(), s.begin() + e2 + 1, s.end());
+			append_text(buffer, "</z>\r\n    </coordinates></vertex>\r\n");
 		}
-		output << "   </vertices>\r\n";
-		output << "   <volume>\r\n";
+		append_text(buffer, "   </vertices>\r\n   <volume>\r\n");
 		for (size_t i = 0; i < triangles.size(); i++) {
-			triangle t = triangles[i];
-			output << "    <triangle>\r\n";
-			size_t index;
-			index = std::distance(vertices.begin(), std::find(vertices.begin(), vertices.end(), t.vs1));
-			output << "     <v1>" << index << "</v1>\r\n";
-			index = std::distance(vertices.begin(), std::find(vertices.begin(), vertices.end(), t.vs2));
-			output << "     <v2>" << index << "</v2>\r\n";
-			index = std::distance(vertices.begin(), std::find(vertices.begin(), vertices.end(), t.vs3));
-			output << "     <v3>" << index << "</v3>\r\n";
-			output << "    </triangle>\r\n";
+			const triangle &t = triangles[i];
+			append_text(buffer, "    <triangle>\r\n     <v1>");
+			append_unsigned(buffer, t.vs1);
+			append_text(buffer, "</v1>\r\n     <v2>");
+			append_unsigned(buffer, t.vs2);
+			append_text(buffer, "</v2>\r\n     <v3>");
+			append_unsigned(buffer, t.vs3);
+			append_text(buffer, "</v3>\r\n    </triangle>\r\n");
 		}
-		output << "   </volume>\r\n";
-		output << "  </mesh>\r\n"
-			<< " </object>\r\n"
-			<< "</amf>\r\n";
+		append_text(buffer, "   </volume>\r\n"
+			"  </mesh>\r\n"
+			" </object>\r\n"
+			"</amf>\r\n");
+		flush_buffer(buffer, output);
 	} catch (CGAL::Assertion_exception e) {
 		PRINTB("CGAL error in CGAL_Nef_polyhedron3::convert_to_Polyhedron(): %s", e.what());
 	}
@@ -422,58 +901,61 @@ void export_amf(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
 void export_dxf(const Polygon2d &poly, std::ostream &output)
 {
 	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+	std::vector<char> buffer;
 	// Some importers (e.g. Inkscape) needs a BLOCKS section to be present
-	output << "  0\n"
-				 <<	"SECTION\n"
-				 <<	"  2\n"
-				 <<	"BLOCKS\n"
-				 <<	"  0\n"
-				 << "ENDSEC\n"
-				 << "  0\n"
-				 << "SECTION\n"
-				 << "  2\n"
-				 << "ENTITIES\n";
-
+	append_text(buffer, "  0\n"
+		"SECTION\n"
+		"  2\n"
+		"BLOCKS\n"
+		"  0\n"
+		"ENDSEC\n"
+		"  0\n"
+		"SECTION\n"
+		"  2\n"
+		"ENTITIES\n");
+
+	// One closed LWPOLYLINE per outline instead of an individual LINE
+	// entity per edge: an n-vertex outline costs n coordinate pairs
+	// instead of 2n, and downstream CAM tools get connected contours
+	// rather than an unordered segment soup they'd have to re-chain.
 	BOOST_FOREACH(const Outline2d &o, poly.outlines()) {
-		for (unsigned int i=0;i<o.vertices.size();i++) {
-			const Vector2d &p1 = o.vertices[i];
-			const Vector2d &p2 = o.vertices[(i+1)%o.vertices.size()];
-			double x1 = p1[0];
-			double y1 = p1[1];
-			double x2 = p2[0];
-			double y2 = p2[1];
-			output << "  0\n"
-						 << "LINE\n";
-			// Some importers (e.g. Inkscape) needs a layer to be specified
-			output << "  8\n"
-						 << "0\n"
-						 << " 10\n"
-						 << x1 << "\n"
-						 << " 11\n"
-						 << x2 << "\n"
-						 << " 20\n"
-						 << y1 << "\n"
-						 << " 21\n"
-						 << y2 << "\n";
+		if (o.vertices.empty()) continue;
+		append_text(buffer, "  0\n"
+			"LWPOLYLINE\n");
+		// Some importers (e.g. Inkscape) needs a layer to be specified
+		append_text(buffer, "  8\n"
+			"0\n"
+			" 90\n");
+		append_unsigned(buffer, o.vertices.size());
+		// closed polyline flag
+		append_text(buffer, "\n 70\n"
+			"1\n");
+		BOOST_FOREACH(const Vector2d &p, o.vertices) {
+			append_text(buffer, " 10\n");
+			append_double(buffer, p[0]);
+			append_text(buffer, "\n 20\n");
+			append_double(buffer, p[1]);
+			buffer.push_back('\n');
 		}
 	}
 
-	output << "  0\n"
-				 << "ENDSEC\n";
+	append_text(buffer, "  0\n"
+		"ENDSEC\n");
 
 	// Some importers (e.g. Inkscape) needs an OBJECTS section with a DICTIONARY entry
-	output << "  0\n"
-				 << "SECTION\n"
-				 << "  2\n"
-				 << "OBJECTS\n"
-				 << "  0\n"
-				 << "DICTIONARY\n"
-				 << "  0\n"
-				 << "ENDSEC\n";
-
-	output << "  0\n"
-				 <<"EOF\n";
-
+	append_text(buffer, "  0\n"
+		"SECTION\n"
+		"  2\n"
+		"OBJECTS\n"
+		"  0\n"
+		"DICTIONARY\n"
+		"  0\n"
+		"ENDSEC\n");
+
+	append_text(buffer, "  0\n"
+		"EOF\n");
+
+	flush_buffer(buffer, output);
 	setlocale(LC_NUMERIC, "");      // Set default locale
 }
 
@@ -487,33 +969,44 @@ void export_svg(const Polygon2d &poly, std::ostream &output)
 	int maxx = ceil(bbox.max().x());
 	int maxy = ceil(-bbox.min().y());
 	
-	output
-		<< "<?xml version=\"1.0\" standalone=\"no\"?>\n"
-		<< "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n"
-		<< "<svg width=\"" << (maxx - minx) << "\" height=\"" << (maxy - miny) << "\" viewBox=\"" << (minx - 1) << " " << (miny - 1) << " " << (maxx - minx + 2) << " " << (maxy - miny + 2) << "\" xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"
-		<< "<title>OpenSCAD Model</title>\n";
-
-	output << "<path d=\"\n";
+	std::vector<char> buffer;
+	char header[256];
+	snprintf(header, sizeof(header),
+		"<?xml version=\"1.0\" standalone=\"no\"?>\n"
+		"<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n"
+		"<svg width=\"%d\" height=\"%d\" viewBox=\"%d %d %d %d\" xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"
+		"<title>OpenSCAD Model</title>\n",
+		maxx - minx, maxy - miny, minx - 1, miny - 1, maxx - minx + 2, maxy - miny + 2);
+	append_text(buffer, header);
+
+	append_text(buffer, "<path d=\"\n");
 	BOOST_FOREACH(const Outline2d &o, poly.outlines()) {
 		if (o.vertices.empty()) {
 			continue;
 		}
-		
+
 		const Eigen::Vector2d& p0 = o.vertices[0];
-		output << "M " << p0.x() << "," << -p0.y();
+		append_text(buffer, "M ");
+		append_double(buffer, p0.x());
+		buffer.push_back(',');
+		append_double(buffer, -p0.y());
 		for (unsigned int idx = 1;idx < o.vertices.size();idx++) {
 			const Eigen::Vector2d& p = o.vertices[idx];
-			output << " L " << p.x() << "," << -p.y();
+			append_text(buffer, " L ");
+			append_double(buffer, p.x());
+			buffer.push_back(',');
+			append_double(buffer, -p.y());
 			if ((idx % 6) == 5) {
-				output << "\n";
+				buffer.push_back('\n');
 			}
 		}
-		output << " z\n";
+		append_text(buffer, " z\n");
 	}
-	output << "\" stroke=\"black\" fill=\"lightgray\" stroke-width=\"0.5\"/>";
+	append_text(buffer, "\" stroke=\"black\" fill=\"lightgray\" stroke-width=\"0.5\"/>");
 
-	output << "</svg>\n";	
+	append_text(buffer, "</svg>\n");
 
+	flush_buffer(buffer, output);
 	setlocale(LC_NUMERIC, "");      // Set default locale
 }
 
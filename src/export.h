@@ -3,6 +3,7 @@
 #include <iostream>
 #include "Tree.h"
 #include "Camera.h"
+#include "memory.h"
 
 #ifdef ENABLE_CGAL
 
@@ -11,13 +12,22 @@ enum FileFormat {
 	OPENSCAD_OFF,
 	OPENSCAD_AMF,
 	OPENSCAD_DXF,
-	OPENSCAD_SVG
+	OPENSCAD_SVG,
+	OPENSCAD_NEF3
 };
 
 // void exportFile(const class Geometry *root_geom, std::ostream &output, FileFormat format);
+/*!
+	Writes root_geom to name2open in the given format. When contentid is
+	non-empty (see --hash-outputs) the write is skipped - preserving the
+	output's mtime - if a <name2open>.hash sidecar records the same
+	content hash from an earlier run; after a successful write the
+	sidecar is (re)recorded.
+*/
 void exportFileByName(const class Geometry *root_geom, FileFormat format,
-	const char *name2open, const char *name2display);
-void export_png(const class Geometry *root_geom, Camera &c, std::ostream &output);
+	const char *name2open, const char *name2display,
+	const std::string &contentid = std::string());
+void export_png(shared_ptr<const class Geometry> root_geom, Camera &c, std::ostream &output);
 
 void export_stl(const class CGAL_Nef_polyhedron *root_N, std::ostream &output);
 void export_stl(const class PolySet &ps, std::ostream &output);
@@ -27,10 +37,20 @@ void export_amf(const class CGAL_Nef_polyhedron *root_N, std::ostream &output);
 void export_amf(const class PolySet &ps, std::ostream &output);
 void export_dxf(const class Polygon2d &poly, std::ostream &output);
 void export_svg(const class Polygon2d &poly, std::ostream &output);
+void export_nef3(const CGAL_Nef_polyhedron *root_N, std::ostream &output);
+void export_nef3(const class PolySet &ps, std::ostream &output);
 void export_png(const CGAL_Nef_polyhedron *root_N, Camera &c, std::ostream &output);
 void export_png_with_opencsg(Tree &tree, Camera &c, std::ostream &output);
 void export_png_with_throwntogether(Tree &tree, Camera &c, std::ostream &output);
 
+// Asynchronous variants for animation export: the frame is rendered and
+// captured on the caller's (GL) thread, then encoded and written to
+// filename on a background pool. Call finish_png_exports() before exit.
+void export_png_async(shared_ptr<const class Geometry> root_geom, Camera &c, const std::string &filename);
+void export_png_with_opencsg_async(Tree &tree, Camera &c, const std::string &filename);
+void export_png_with_throwntogether_async(Tree &tree, Camera &c, const std::string &filename);
+void finish_png_exports();
+
 #endif // ENABLE_CGAL
 
 #ifdef DEBUG
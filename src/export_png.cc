@@ -1,11 +1,166 @@
 #include "export.h"
 #include "printutils.h"
+#include "imageutils.h"
 #include "OffscreenView.h"
 #include "CsgInfo.h"
 #include <stdio.h>
 #include "polyset.h"
 #include "rendersettings.h"
 
+#include <deque>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+/*
+	Asynchronous PNG frame sink for animation export. Frames render one
+	after another on the single GL context (the GPU serializes them
+	anyway), but the CPU-side work - PNG filtering, deflate, file write -
+	runs on a small worker pool, so rendering frame N overlaps encoding
+	frames N-1, N-2, ... The queue is bounded since each pending frame
+	holds a full RGBA framebuffer.
+*/
+namespace {
+	struct FrameJob {
+		std::vector<unsigned char> pixels;
+		int width, height;
+		std::string filename;
+	};
+
+	class FrameEncoderPool {
+	public:
+		FrameEncoderPool() : started(false), active(0) {}
+
+		void submit(FrameJob *job) {
+			boost::mutex::scoped_lock lock(this->mutex);
+			if (!this->started) {
+				// The per-image deflate is itself parallel, so a modest pool
+				// is enough to keep up with the renderer
+				size_t numthreads = std::max((size_t)1, (size_t)boost::thread::hardware_concurrency() / 2);
+				for (size_t t = 0; t < numthreads; t++) {
+					boost::thread(boost::bind(&FrameEncoderPool::worker, this));
+				}
+				this->started = true;
+			}
+			while (this->queue.size() >= 4) this->cond_done.wait(lock);
+			this->queue.push_back(job);
+			this->cond_work.notify_one();
+		}
+
+		//! Blocks until every submitted frame is on disk
+		void drain() {
+			boost::mutex::scoped_lock lock(this->mutex);
+			while (!this->queue.empty() || this->active > 0) this->cond_done.wait(lock);
+		}
+
+	private:
+		void worker() {
+			while (1) {
+				FrameJob *job;
+				{
+					boost::mutex::scoped_lock lock(this->mutex);
+					while (this->queue.empty()) this->cond_work.wait(lock);
+					job = this->queue.front();
+					this->queue.pop_front();
+					this->active++;
+				}
+				if (!write_png(job->filename.c_str(), &job->pixels[0], job->width, job->height)) {
+					PRINTB("ERROR: Can't write PNG file \"%s\"", job->filename);
+				}
+				delete job;
+				{
+					boost::mutex::scoped_lock lock(this->mutex);
+					this->active--;
+					this->cond_done.notify_all();
+				}
+			}
+		}
+
+		bool started;
+		size_t active;
+		std::deque<FrameJob *> queue;
+		boost::mutex mutex;
+		boost::condition_variable cond_work;
+		boost::condition_variable cond_done;
+	};
+
+	FrameEncoderPool frame_encoders;
+
+	//! A framebuffer readback started with OffscreenView::captureAsync()
+	//! whose pixels haven't been collected yet
+	struct PendingCapture {
+		OffscreenView *glview;
+		int width, height;
+		std::string filename;
+	};
+
+	std::deque<PendingCapture> pending_captures;
+
+	//! Collects the oldest in-flight readback and queues its encode
+	void retire_capture()
+	{
+		PendingCapture cap = pending_captures.front();
+		pending_captures.pop_front();
+		FrameJob *job = new FrameJob;
+		job->width = cap.width;
+		job->height = cap.height;
+		job->filename = cap.filename;
+		if (cap.glview->retrieveCapture(job->pixels)) {
+			frame_encoders.submit(job);
+		}
+		else {
+			PRINTB("ERROR: Framebuffer readback failed for \"%s\"", cap.filename);
+			delete job;
+		}
+	}
+
+	//! Retires every readback still in flight on the given view (or on
+	//! any view when NULL), e.g. before the view is destroyed
+	void flush_captures(OffscreenView *glview)
+	{
+		for (size_t i = pending_captures.size(); i > 0; i--) {
+			if (glview && pending_captures.front().glview != glview) {
+				pending_captures.push_back(pending_captures.front());
+				pending_captures.pop_front();
+				continue;
+			}
+			retire_capture();
+		}
+	}
+
+	//! Writes synchronously to output when given, otherwise reads the
+	//! framebuffer back and queues the encode under async_filename
+	void emit_frame(OffscreenView *glview, std::ostream *output, const std::string &async_filename)
+	{
+		if (output) {
+			glview->save(*output);
+			return;
+		}
+		FrameJob *job = new FrameJob;
+		job->width = glview->width;
+		job->height = glview->height;
+		job->filename = async_filename;
+		// Double-buffered PBO readback: start this frame's transfer
+		// without stalling, and only map a readback once a whole frame's
+		// render time has passed over it. Encoding therefore runs a frame
+		// behind the renderer instead of serializing after it.
+		if (glview->captureAsync()) {
+			PendingCapture cap = {glview, job->width, job->height, job->filename};
+			pending_captures.push_back(cap);
+			delete job;
+			if (pending_captures.size() >= 2) retire_capture();
+			return;
+		}
+		glview->capture(job->pixels);
+		frame_encoders.submit(job);
+	}
+}
+
+void finish_png_exports()
+{
+	flush_captures(NULL);
+	frame_encoders.drain();
+}
+
 #ifdef ENABLE_CGAL
 #include "CGALRenderer.h"
 #include "CGAL_renderer.h"
@@ -13,17 +168,32 @@
 #include "cgalutils.h"
 #include "CGAL_Nef_polyhedron.h"
 
-void export_png(const Geometry *root_geom, Camera &cam, std::ostream &output)
+/*!
+	Animation exports render many frames from one process. Keep a single
+	GL context alive between frames instead of recreating it per image.
+*/
+static OffscreenView *offscreen_view(size_t width, size_t height)
+{
+	static OffscreenView *view = NULL;
+	if (view && (view->width != width || view->height != height)) {
+		flush_captures(view); // readbacks die with the context
+		delete view;
+		view = NULL;
+	}
+	if (!view) view = new OffscreenView(width, height);
+	return view;
+}
+
+static void export_png_common(shared_ptr<const Geometry> root_geom, Camera &cam, std::ostream *output, const std::string &async_filename)
 {
 	OffscreenView *glview;
 	try {
-		glview = new OffscreenView( cam.pixel_width, cam.pixel_height );
+		glview = offscreen_view( cam.pixel_width, cam.pixel_height );
 	} catch (int error) {
 		fprintf(stderr,"Can't create OpenGL OffscreenView. Code: %i.\n", error);
 		return;
 	}
-	shared_ptr<const Geometry> ptr(root_geom);
-	CGALRenderer cgalRenderer(ptr);
+	CGALRenderer cgalRenderer(root_geom);
 
 	BoundingBox bbox;
 	if (cgalRenderer.polyhedron) {
@@ -47,7 +217,17 @@ void export_png(const Geometry *root_geom, Camera &cam, std::ostream &output)
 	glview->setCamera( cam );
 	glview->setRenderer(&cgalRenderer);
 	glview->paintGL();
-	glview->save(output);
+	emit_frame(glview, output, async_filename);
+}
+
+void export_png(shared_ptr<const Geometry> root_geom, Camera &cam, std::ostream &output)
+{
+	export_png_common(root_geom, cam, &output, std::string());
+}
+
+void export_png_async(shared_ptr<const Geometry> root_geom, Camera &cam, const std::string &filename)
+{
+	export_png_common(root_geom, cam, NULL, filename);
 }
 
 enum Previewer { OPENCSG, THROWN } previewer;
@@ -58,7 +238,7 @@ enum Previewer { OPENCSG, THROWN } previewer;
 #endif
 #include "ThrownTogetherRenderer.h"
 
-void export_png_preview_common( Tree &tree, Camera &cam, std::ostream &output, Previewer previewer = OPENCSG )
+static void export_png_preview_common( Tree &tree, Camera &cam, std::ostream *output, const std::string &async_filename, Previewer previewer = OPENCSG )
 {
 	CsgInfo csgInfo = CsgInfo();
 	if ( !csgInfo.compile_chains( tree ) ) {
@@ -67,7 +247,7 @@ void export_png_preview_common( Tree &tree, Camera &cam, std::ostream &output, P
 	}
 
 	try {
-		csgInfo.glview = new OffscreenView( cam.pixel_width, cam.pixel_height );
+		csgInfo.glview = offscreen_view( cam.pixel_width, cam.pixel_height );
 	} catch (int error) {
 		fprintf(stderr,"Can't create OpenGL OffscreenView. Code: %i.\n", error);
 		return;
@@ -102,13 +282,22 @@ void export_png_preview_common( Tree &tree, Camera &cam, std::ostream &output, P
 	OpenCSG::setOption( OpenCSG::OffscreenSetting, OpenCSG::FrameBufferObject );
 #endif
 	csgInfo.glview->paintGL();
-	csgInfo.glview->save( output );
+	emit_frame(csgInfo.glview, output, async_filename);
 }
 
 void export_png_with_opencsg(Tree &tree, Camera &cam, std::ostream &output)
 {
 #ifdef ENABLE_OPENCSG
-	export_png_preview_common( tree, cam, output, OPENCSG );
+	export_png_preview_common( tree, cam, &output, std::string(), OPENCSG );
+#else
+	fprintf(stderr,"This openscad was built without OpenCSG support\n");
+#endif
+}
+
+void export_png_with_opencsg_async(Tree &tree, Camera &cam, const std::string &filename)
+{
+#ifdef ENABLE_OPENCSG
+	export_png_preview_common( tree, cam, NULL, filename, OPENCSG );
 #else
 	fprintf(stderr,"This openscad was built without OpenCSG support\n");
 #endif
@@ -116,7 +305,12 @@ void export_png_with_opencsg(Tree &tree, Camera &cam, std::ostream &output)
 
 void export_png_with_throwntogether(Tree &tree, Camera &cam, std::ostream &output)
 {
-	export_png_preview_common( tree, cam, output, THROWN );
+	export_png_preview_common( tree, cam, &output, std::string(), THROWN );
+}
+
+void export_png_with_throwntogether_async(Tree &tree, Camera &cam, const std::string &filename)
+{
+	export_png_preview_common( tree, cam, NULL, filename, THROWN );
 }
 
 
@@ -27,32 +27,39 @@
 #include "expression.h"
 #include "value.h"
 #include "evalcontext.h"
+#include "function.h"
 #include <assert.h>
 #include <sstream>
 #include <algorithm>
 #include "stl-utils.h"
 #include "printutils.h"
 #include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+
+// Serializes lazy compilation and constant folding on the shared AST;
+// see Expression::compile()
+static boost::mutex expression_compile_mutex;
 #include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
 
-Expression::Expression() : recursioncount(0)
+Expression::Expression() : recursioncount(0), optype(0), funcname_hash(0)
 {
 }
 
 Expression::Expression(const std::string &type, Expression *left, Expression *right)
-	: type(type), recursioncount(0)
+	: type(type), recursioncount(0), optype(0), funcname_hash(0)
 {
 	this->children.push_back(left);
 	this->children.push_back(right);
 }
 
 Expression::Expression(const std::string &type, Expression *expr)
-	: type(type), recursioncount(0)
+	: type(type), recursioncount(0), optype(0), funcname_hash(0)
 {
 	this->children.push_back(expr);
 }
 
-Expression::Expression(const Value &val) : const_value(val), type("C"), recursioncount(0)
+Expression::Expression(const Value &val) : const_value(val), type("C"), recursioncount(0), optype(0), funcname_hash(0)
 {
 }
 
@@ -82,6 +89,27 @@ Value Expression::sub_evaluate_range(const Context *context) const
 	return Value();
 }
 
+/*!
+	Bracket indexing. When the base is a plain variable lookup the bound
+	Value is indexed in place through lookup_variable_ref(), skipping the
+	copy that evaluate() would return - for points[i] in a tight loop the
+	access touches only the shared vector storage. Values are immutable
+	once bound, so the reference cannot be invalidated by the index
+	expression, which runs before the base is resolved.
+*/
+Value Expression::sub_evaluate_bracket(const Context *context) const
+{
+	Value idx = this->children[1]->evaluate(context);
+	const Expression *base = this->children[0];
+	if (!base->optype) base->compile();
+	if (base->optype == 'L' || base->optype == 'H') {
+		const Value *v = context->lookup_variable_ref(base->var_name);
+		if (v) return (*v)[idx];
+		// Unbound: fall through so the lookup warning is still printed
+	}
+	return base->evaluate(context)[idx];
+}
+
 Value Expression::sub_evaluate_member(const Context *context) const
 {
 	Value v = this->children[0]->evaluate(context);
@@ -116,8 +144,37 @@ Value Expression::sub_evaluate_function(const Context *context) const
 	}
 	this->recursioncount += 1;
 	EvalContext c(context, this->call_arguments);
-	const Value &result = context->evaluate_function(this->call_funcname, &c);
+	// The parser fills in call_funcname after construction, so the hash
+	// is interned on the first call (cf. compile() for this->type).
+	if (!this->funcname_hash) {
+		this->funcname_hash = boost::hash<std::string>()(this->call_funcname);
+	}
+	const Value &result = context->evaluate_function(HashedName(this->call_funcname, this->funcname_hash), &c);
 	this->recursioncount -= 1;
+
+	// A pure builtin applied only to constants always yields this result,
+	// so fold the call site. Resolution went through the real context, so
+	// a pure user-defined function shadowing the builtin name folds to
+	// its correct value; the static-purity caveat documented at
+	// is_pure_builtin_function() applies to impure shadows. File-reading
+	// builtins (dxf_dim/dxf_cross) are excluded by the purity check:
+	// folding them onto the module-cached AST would freeze stale values
+	// across file edits.
+	if (is_pure_builtin_function(this->call_funcname)) {
+		bool const_args = true;
+		BOOST_FOREACH(const Assignment &arg, this->call_arguments) {
+			if (!arg.second) { const_args = false; break; }
+			if (!arg.second->optype) arg.second->compile();
+			if (arg.second->optype != 'C') { const_args = false; break; }
+		}
+		if (const_args) {
+			// This runs during evaluation, possibly on several threads;
+			// publish the fold under the compile lock like compile() does
+			boost::mutex::scoped_lock lock(expression_compile_mutex);
+			this->const_value = result;
+			this->optype = 'C';
+		}
+	}
 	return result;
 }
 
@@ -141,19 +198,6 @@ static inline int type2int(register const char *typestr)
 
 // unnamed namespace
 namespace {
-	Value::VectorType flatten(Value::VectorType const& vec) {
-		int n = 0;
-		for (int i = 0; i < vec.size(); i++) {
-			assert(vec[i].type() == Value::VECTOR);
-			n += vec[i].toVector().size();
-		}
-		Value::VectorType ret; ret.reserve(n);
-		for (int i = 0; i < vec.size(); i++) {
-			std::copy(vec[i].toVector().begin(),vec[i].toVector().end(),std::back_inserter(ret));
-		}
-		return ret;
-	}
-
 	void evaluate_sequential_assignment(const AssignmentList & assignment_list, Context *context) {
 		EvalContext let_context(context, assignment_list);
 
@@ -181,12 +225,23 @@ Value Expression::sub_evaluate_let_expression(const Context *context) const
 Value Expression::sub_evaluate_list_comprehension(const Context *context) const
 {
 	Value::VectorType vec;
+	sub_evaluate_list_comprehension_into(context, vec);
+	return vec;
+}
 
+/*!
+	Evaluates a chain of comprehension elements by appending results
+	straight into the caller's output vector. Nested for/let elements
+	recurse with the same vector, so a deep generator produces its final
+	list in one buffer with no intermediate per-level vectors and no
+	flattening copies afterwards.
+*/
+void Expression::sub_evaluate_list_comprehension_into(const Context *context, Value::VectorType &vec) const
+{
 	if (this->call_funcname == "if") {
 		if (this->children[0]->evaluate(context)) {
 			vec.push_back(this->children[1]->evaluate(context));
 		}
-		return vec;
 	} else if (this->call_funcname == "for") {
 		EvalContext for_context(context, this->call_arguments);
 
@@ -198,47 +253,131 @@ Value Expression::sub_evaluate_list_comprehension(const Context *context) const
 
 		Context c(context);
 
+		// Subexpressions hoisted out of the body by hoistLoopInvariants()
+		// are evaluated once per run instead of once per iteration. They
+		// must not observe the iterator, so the outer context is used.
+		BOOST_FOREACH(const Assignment &inv, this->hoisted_invariants) {
+			c.set_variable(inv.first, inv.second->evaluate(context));
+		}
+
+		// Nested comprehension elements splice their results in place;
+		// plain body expressions contribute one element per iteration
+		const bool nested = (this->children[0]->type == "c");
+
 		if (it_values.type() == Value::RANGE) {
-			Value::RangeType range = it_values.toRange();
+			const Value::RangeType &range = it_values.toRange();
 			boost::uint32_t steps = range.nbsteps();
 			if (steps >= 1000000) {
 				PRINTB("WARNING: Bad range parameter in for statement: too many elements (%lu).", steps);
 			} else {
+				if (!nested) vec.reserve(vec.size() + steps);
 				for (Value::RangeType::iterator it = range.begin();it != range.end();it++) {
 					c.set_variable(it_name, Value(*it));
-					vec.push_back(this->children[0]->evaluate(&c));
+					if (nested) this->children[0]->sub_evaluate_list_comprehension_into(&c, vec);
+					else vec.push_back(this->children[0]->evaluate(&c));
 				}
 			}
 		}
 		else if (it_values.type() == Value::VECTOR) {
+			if (!nested) vec.reserve(vec.size() + it_values.toVector().size());
 			for (size_t i = 0; i < it_values.toVector().size(); i++) {
 				c.set_variable(it_name, it_values.toVector()[i]);
-				vec.push_back(this->children[0]->evaluate(&c));
+				if (nested) this->children[0]->sub_evaluate_list_comprehension_into(&c, vec);
+				else vec.push_back(this->children[0]->evaluate(&c));
 			}
 		}
 		else if (it_values.type() != Value::UNDEFINED) {
 			c.set_variable(it_name, it_values);
-			vec.push_back(this->children[0]->evaluate(&c));
-		}
-		if (this->children[0]->type == "c") {
-			return flatten(vec);
-		} else {
-			return vec;
+			if (nested) this->children[0]->sub_evaluate_list_comprehension_into(&c, vec);
+			else vec.push_back(this->children[0]->evaluate(&c));
 		}
 	} else if (this->call_funcname == "let") {
 		Context c(context);
 		evaluate_sequential_assignment(this->call_arguments, &c);
 
-		return this->children[0]->evaluate(&c);
+		// The grammar guarantees a let element is followed by another
+		// comprehension element
+		this->children[0]->sub_evaluate_list_comprehension_into(&c, vec);
 	} else {
 		abort();
 	}
 }
 
 
+/*!
+	Compiles the type string down to the opcode used by evaluate()'s
+	switch, and folds subtrees built purely from constants and
+	side-effect-free operators down to a single constant. This happens
+	once per Expression; since expressions are owned by their Module,
+	the compiled form is shared by every evaluation for as long as
+	ModuleCache keeps the module alive.
+
+	Evaluation can run on several threads at once (parallel for(),
+	parallel union), each of which may be the first to reach a given
+	subexpression, so the compile step is serialized like
+	VectorStorage::boxed(): one process-wide lock, re-checked under it,
+	with optype published last so the lock-free fast path in evaluate()
+	never sees a folded opcode before its constant.
+*/
+void Expression::compile() const
+{
+	boost::mutex::scoped_lock lock(expression_compile_mutex);
+	if (!this->optype) this->compile_locked();
+}
+
+//! The compile step proper; expression_compile_mutex must be held
+void Expression::compile_locked() const
+{
+	this->optype = type2int(this->type.c_str());
+
+	switch (this->optype) {
+	case '!':
+	case TYPE2INT('&','&'):
+	case TYPE2INT('|','|'):
+	case '*':
+	case '/':
+	case '%':
+	case '+':
+	case '-':
+	case '<':
+	case TYPE2INT('<','='):
+	case TYPE2INT('=','='):
+	case TYPE2INT('!','='):
+	case TYPE2INT('>','='):
+	case '>':
+	case TYPE2INT('?',':'):
+	case TYPE2INT('[',']'):
+	case 'I':
+	case 'R':
+	case 'V':
+		break;
+	default:
+		// Variable lookups, function calls and comprehensions depend on
+		// the evaluation context and cannot be folded
+		return;
+	}
+
+	BOOST_FOREACH(const Expression *e, this->children) {
+		if (!e->optype) e->compile_locked();
+		if (e->optype != 'C') return;
+	}
+
+	// All children are constants and we're a pure operator: evaluate
+	// once now. The context is never touched on this path.
+	this->const_value = this->evaluate(NULL);
+	this->optype = 'C';
+}
+
+const Value *Expression::constValue() const
+{
+	if (!this->optype) this->compile();
+	return this->optype == 'C' ? &this->const_value : NULL;
+}
+
 Value Expression::evaluate(const Context *context) const
 {
-	switch (type2int(this->type.c_str())) {
+	if (!this->optype) this->compile();
+	switch (this->optype) {
 	case '!':
 		return ! this->children[0]->evaluate(context);
 	case TYPE2INT('&','&'):
@@ -270,7 +409,7 @@ Value Expression::evaluate(const Context *context) const
 	case TYPE2INT('?',':'):
 		return this->children[this->children[0]->evaluate(context) ? 1 : 2]->evaluate(context);
 	case TYPE2INT('[',']'):
-		return this->children[0]->evaluate(context)[this->children[1]->evaluate(context)];
+		return sub_evaluate_bracket(context);
 	case 'I':
 		return -this->children[0]->evaluate(context);
 	case 'C':
@@ -280,6 +419,7 @@ Value Expression::evaluate(const Context *context) const
 	case 'V':
 		return sub_evaluate_vector(context);
 	case 'L':
+	case 'H':
 		return context->lookup_variable(this->var_name);
 	case 'N':
 		return sub_evaluate_member(context);
@@ -295,6 +435,157 @@ Value Expression::evaluate(const Context *context) const
 	abort();
 }
 
+/*!
+	Returns true if this expression can only depend on the given set of
+	variable names: every variable lookup hits the bound set (or a name
+	introduced by an inner let/for), and every function call targets
+	either a pure builtin or self_funcname. Used by Function::evaluate()
+	to decide whether a user-defined function is memoizable.
+*/
+/*!
+	Returns true if evaluating this subtree cannot observe varname and
+	always yields the same value within one comprehension run: no lookup
+	of varname, no impure or user-defined function call, and no inner
+	binding construct (let/for/comprehensions introduce names this check
+	does not model, so they are conservatively rejected).
+*/
+bool Expression::isLoopInvariant(const std::string &varname) const
+{
+	if (this->type == "L" || this->type == "H") return this->var_name != varname;
+	if (this->type == "l" || this->type == "c" || this->type == "i") return false;
+	if (this->type == "F") {
+		if (!is_pure_builtin_function(this->call_funcname)) return false;
+		BOOST_FOREACH(const Assignment &arg, this->call_arguments) {
+			if (arg.second && !arg.second->isLoopInvariant(varname)) return false;
+		}
+	}
+	BOOST_FOREACH(const Expression *e, this->children) {
+		if (!e->isLoopInvariant(varname)) return false;
+	}
+	return true;
+}
+
+/*!
+	Returns true if the subtree contains a variable lookup or function
+	call, i.e. it is not a pure literal that compile()-time constant
+	folding reduces on its own.
+*/
+bool Expression::referencesContext() const
+{
+	if (this->type == "L" || this->type == "H" || this->type == "N" ||
+			this->type == "F" || this->type == "l" || this->type == "c" ||
+			this->type == "i") {
+		return true;
+	}
+	BOOST_FOREACH(const Expression *e, this->children) {
+		if (e->referencesContext()) return true;
+	}
+	return false;
+}
+
+/*!
+	Walks expr, moving maximal subtrees that are invariant with respect
+	to varname into this->hoisted_invariants and replacing them with 'H'
+	references. Binding constructs are treated as opaque; each inner for
+	element runs its own hoisting pass against its own iterator.
+*/
+void Expression::hoistInvariantsFrom(Expression *expr, const std::string &varname)
+{
+	for (size_t i = 0; i < expr->children.size(); i++) {
+		Expression *child = expr->children[i];
+		if (child->type == "l" || child->type == "c" || child->type == "i") continue;
+		if (child->isLoopInvariant(varname) && child->referencesContext()) {
+			std::stringstream name;
+			// The leading tab cannot appear in a parsed identifier, so the
+			// synthetic name can never collide with a user variable
+			name << "\tinvariant" << this->hoisted_invariants.size();
+			Expression *ref = new Expression();
+			ref->type = "H";
+			ref->var_name = name.str();
+			// The 'H' node keeps a shared reference to the original for
+			// toString(), so dumps stay byte-identical to the source
+			ref->call_arguments.push_back(Assignment(name.str(), shared_ptr<Expression>(child)));
+			this->hoisted_invariants.push_back(ref->call_arguments.back());
+			expr->children[i] = ref;
+		}
+		else {
+			hoistInvariantsFrom(child, varname);
+		}
+	}
+	// Function call arguments are expressions too, held apart from the
+	// children vector and already shared_ptr-owned
+	if (expr->type != "F") return;
+	BOOST_FOREACH(Assignment &arg, expr->call_arguments) {
+		if (!arg.second) continue;
+		Expression *child = arg.second.get();
+		if (child->type == "l" || child->type == "c" || child->type == "i") continue;
+		if (child->isLoopInvariant(varname) && child->referencesContext()) {
+			std::stringstream name;
+			name << "\tinvariant" << this->hoisted_invariants.size();
+			Expression *ref = new Expression();
+			ref->type = "H";
+			ref->var_name = name.str();
+			ref->call_arguments.push_back(Assignment(name.str(), arg.second));
+			this->hoisted_invariants.push_back(ref->call_arguments.back());
+			arg.second.reset(ref);
+		}
+		else {
+			hoistInvariantsFrom(child, varname);
+		}
+	}
+}
+
+/*!
+	Hoists subexpressions of a comprehension-for body that provably do
+	not involve the iterator out of the loop. The parser calls this once
+	per for element; sub_evaluate_list_comprehension() then evaluates the
+	hoisted assignments once per comprehension run.
+*/
+void Expression::hoistLoopInvariants()
+{
+	if (this->type != "c" || this->call_funcname != "for") return;
+	if (this->call_arguments.size() != 1) return;
+	const std::string &it_name = this->call_arguments[0].first;
+	// Config variables are dynamically scoped and visible to functions
+	// called from the body; leave those loops alone
+	if (it_name.empty() || it_name[0] == '$') return;
+	hoistInvariantsFrom(this, it_name);
+}
+
+bool Expression::dependsOnlyOn(std::set<std::string> bound, const std::string &self_funcname) const
+{
+	if (this->type == "L") {
+		return bound.find(this->var_name) != bound.end();
+	}
+	if (this->type == "F") {
+		if (this->call_funcname != self_funcname &&
+				!is_pure_builtin_function(this->call_funcname)) {
+			return false;
+		}
+		BOOST_FOREACH(const Assignment &arg, this->call_arguments) {
+			if (arg.second && !arg.second->dependsOnlyOn(bound, self_funcname)) return false;
+		}
+		return true;
+	}
+	if (this->type == "l" || (this->type == "c" && (this->call_funcname == "let" ||
+																									this->call_funcname == "for"))) {
+		// let and comprehension-for bind new names, sequentially
+		BOOST_FOREACH(const Assignment &arg, this->call_arguments) {
+			if (arg.second && !arg.second->dependsOnlyOn(bound, self_funcname)) return false;
+			bound.insert(arg.first);
+		}
+		// Hoisted subtrees are part of the body, just stored aside
+		BOOST_FOREACH(const Assignment &inv, this->hoisted_invariants) {
+			if (inv.second && !inv.second->dependsOnlyOn(bound, self_funcname)) return false;
+			bound.insert(inv.first);
+		}
+	}
+	BOOST_FOREACH(const Expression *e, this->children) {
+		if (!e->dependsOnlyOn(bound, self_funcname)) return false;
+	}
+	return true;
+}
+
 namespace /* anonymous*/ {
 
 	std::ostream &operator << (std::ostream &o, AssignmentList const& l) {
@@ -352,6 +643,10 @@ std::string Expression::toString() const
 	else if (this->type == "L") {
 		stream << this->var_name;
 	}
+	else if (this->type == "H") {
+		// Print the hoisted original so dumps stay identical to the source
+		stream << *this->call_arguments[0].second;
+	}
 	else if (this->type == "N") {
 		stream << *this->children[0] << "." << this->var_name;
 	}
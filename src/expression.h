@@ -1,5 +1,6 @@
 #pragma once
 
+#include <set>
 #include <string>
 #include <vector>
 #include "value.h"
@@ -10,12 +11,17 @@ class Expression
 public:
 	std::vector<Expression*> children;
 
-	const Value const_value;
+	mutable Value const_value;
 	std::string var_name;
 
 	std::string call_funcname;
 	AssignmentList call_arguments;
 
+	// Subexpressions hoisted out of a comprehension-for body by
+	// hoistLoopInvariants(); evaluated once per comprehension run
+	// instead of once per iteration
+	AssignmentList hoisted_invariants;
+
 	// Boolean: ! && ||
 	// Operators: * / % + -
 	// Relations: < <= == != >= >
@@ -32,6 +38,7 @@ public:
 	// Let expression: l
   // List comprehension expression: i
   // List comprehension: c
+  // Hoisted loop-invariant reference: H
   std::string type;
 
 	Expression();
@@ -42,18 +49,47 @@ public:
 
 	Value evaluate(const class Context *context) const;
 
+	//! The folded constant for context-free subtrees (see compile()), or
+	//! NULL when evaluation needs a context; compiles on first use
+	const Value *constValue() const;
+
+	//! Hoists loop-invariant subexpressions out of a comprehension-for
+	//! body; called by the parser once the for element is complete
+	void hoistLoopInvariants();
+
+	bool dependsOnlyOn(std::set<std::string> bound, const std::string &self_funcname) const;
+
 	std::string toString() const;
 
 private:
 	mutable int recursioncount;
 
+	// Opcode compiled from the type string on first evaluation; 0 means
+	// not yet compiled. Since the parser may set this->type after
+	// construction, compilation cannot happen in the constructors.
+	mutable int optype;
+
+	// Hash of call_funcname, interned on first call for the same
+	// reason; 0 means not yet computed (a genuine zero hash merely
+	// recomputes).
+	mutable std::size_t funcname_hash;
+
+	void compile() const;
+	void compile_locked() const;
+
+	bool isLoopInvariant(const std::string &varname) const;
+	bool referencesContext() const;
+	void hoistInvariantsFrom(Expression *expr, const std::string &varname);
+
 	// The following sub_* methods are needed to minimize stack usage only.
 	Value sub_evaluate_function(const class Context *context) const;
+	Value sub_evaluate_bracket(const class Context *context) const;
 	Value sub_evaluate_member(const class Context *context) const;
 	Value sub_evaluate_range(const class Context *context) const;
 	Value sub_evaluate_vector(const class Context *context) const;
 	Value sub_evaluate_let_expression(const class Context *context) const;
 	Value sub_evaluate_list_comprehension(const class Context *context) const;
+	void sub_evaluate_list_comprehension_into(const class Context *context, Value::VectorType &vec) const;
 };
 
 std::ostream &operator<<(std::ostream &stream, const Expression &expr);
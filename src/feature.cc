@@ -19,7 +19,27 @@ Feature::list_t Feature::feature_list;
  * context.
  */
 const Feature Feature::ExperimentalConcatFunction("concat", "Enable the <code>concat()</code> function.");
+const Feature Feature::ExperimentalAggregateFunctions("vector-aggregates", "Enable the vector aggregate functions <code>sum()</code>, <code>product()</code>, <code>vmin()</code>, <code>vmax()</code>, <code>avg()</code> and <code>dot()</code>.");
 const Feature Feature::ExperimentalTextModule("text", "Enable the <code>text()</code> module.");
+const Feature Feature::ExperimentalParallelUnion("parallel-union", "Evaluate unions of many children as a multi-threaded pairwise reduction.");
+const Feature Feature::ExperimentalParallelCSG("parallel-csg", "Convert sibling operands of CSG operations to Nef polyhedra on worker threads.");
+const Feature Feature::ExperimentalBinaryStl("binary-stl", "Write STL exports in the binary format through a single buffered write.");
+const Feature Feature::ExperimentalParallelFor("parallel-for", "Instantiate independent for() loop iterations on worker threads.");
+const Feature Feature::ExperimentalVboRendering("vbo-rendering", "Draw rendered surfaces from vertex buffer objects instead of immediate mode.");
+const Feature Feature::ExperimentalFrustumCulling("frustum-culling", "Skip geometry outside the view frustum when drawing previews.");
+const Feature Feature::ExperimentalOcclusionCulling("occlusion-culling", "Skip preview products whose bounding box passed no depth samples last frame.");
+const Feature Feature::ExperimentalGeometryInstancing("geometry-instancing", "Share one mesh between repeated transformed copies of the same object.");
+const Feature Feature::ExperimentalFastMinkowski("fast-minkowski", "Evaluate minkowski() as parallel pairwise sums of convex decompositions.");
+const Feature Feature::ExperimentalModuleCache("module-cache", "Cache compiled libraries on disk and reuse them across program runs.");
+const Feature Feature::ExperimentalImportRepair("import-repair", "Weld, reorient and diagnose imported meshes before CGAL evaluation.");
+const Feature Feature::ExperimentalLodPreview("lod-preview", "Preview curved primitives at coarser tessellation when they are small on screen.");
+const Feature Feature::ExperimentalLazyUnion("lazy-union", "Export provably disjoint top-level parts as separate shells without a CGAL union.");
+const Feature Feature::ExperimentalImportPrefetch("import-prefetch", "Load and parse all import() files on worker threads overlapped with evaluation.");
+const Feature Feature::ExperimentalAsyncImport("async-import", "Preview with placeholder boxes for import() files still loading in the background.");
+const Feature Feature::ExperimentalModuleMemo("module-memo", "Instantiate the body of repeated childless module calls with identical arguments and special variables once, then reuse it by cloning the resulting subtree.");
+const Feature Feature::ExperimentalProgressiveRender("progressive-render", "Show completed subtree geometries in the viewport while a full render is still running.");
+const Feature Feature::ExperimentalVoxelRender("voxel-render", "Enable the <code>voxel_render()</code> module for draft-quality approximate booleans.");
+const Feature Feature::ExperimentalDraftPreview("draft-preview", "Preview 2D boolean chains under linear_extrude image-space instead of running Clipper, trading exactness for time to first pixel.");
 
 Feature::Feature(const std::string &name, const std::string &description)
 	: enabled(false), name(name), description(description)
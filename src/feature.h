@@ -13,7 +13,27 @@ public:
 	typedef list_t::iterator iterator;
 
 	static const Feature ExperimentalConcatFunction;
+	static const Feature ExperimentalAggregateFunctions;
 	static const Feature ExperimentalTextModule;
+	static const Feature ExperimentalParallelUnion;
+	static const Feature ExperimentalParallelCSG;
+	static const Feature ExperimentalBinaryStl;
+	static const Feature ExperimentalParallelFor;
+	static const Feature ExperimentalVboRendering;
+	static const Feature ExperimentalFrustumCulling;
+	static const Feature ExperimentalOcclusionCulling;
+	static const Feature ExperimentalGeometryInstancing;
+	static const Feature ExperimentalFastMinkowski;
+	static const Feature ExperimentalModuleCache;
+	static const Feature ExperimentalImportRepair;
+	static const Feature ExperimentalLodPreview;
+	static const Feature ExperimentalLazyUnion;
+	static const Feature ExperimentalImportPrefetch;
+	static const Feature ExperimentalAsyncImport;
+	static const Feature ExperimentalDraftPreview;
+	static const Feature ExperimentalModuleMemo;
+	static const Feature ExperimentalProgressiveRender;
+	static const Feature ExperimentalVoxelRender;
     
 	const std::string& get_name() const;
 	const std::string& get_description() const;
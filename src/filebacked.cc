@@ -0,0 +1,58 @@
+#include "filebacked.h"
+#include "printutils.h"
+#include <string.h>
+
+// Flush appended triangles to the temp file in ~4MB batches
+#define FILEBACKED_WRITEBUF_DOUBLES (512*1024)
+
+FileBackedTriangleStore::FileBackedTriangleStore() : count(0)
+{
+	this->file = tmpfile();
+	if (!this->file) {
+		PRINT("WARNING: Can't create temporary file for spilled geometry");
+	}
+	this->writebuf.reserve(FILEBACKED_WRITEBUF_DOUBLES);
+}
+
+FileBackedTriangleStore::~FileBackedTriangleStore()
+{
+	if (this->file) fclose(this->file);
+}
+
+bool FileBackedTriangleStore::append(const Vector3d &p0, const Vector3d &p1, const Vector3d &p2)
+{
+	if (!this->file) return false;
+	const Vector3d *points[3] = { &p0, &p1, &p2 };
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) this->writebuf.push_back((*points[i])[j]);
+	}
+	this->count++;
+	if (this->writebuf.size() >= FILEBACKED_WRITEBUF_DOUBLES) return finalize();
+	return true;
+}
+
+bool FileBackedTriangleStore::finalize()
+{
+	if (!this->file) return false;
+	if (!this->writebuf.empty()) {
+		if (fwrite(&this->writebuf[0], sizeof(double), this->writebuf.size(), this->file) != this->writebuf.size()) {
+			PRINT("WARNING: Write to spilled geometry file failed (disk full?)");
+			return false;
+		}
+		this->writebuf.clear();
+	}
+	return true;
+}
+
+size_t FileBackedTriangleStore::readWindow(size_t index, double *dest, size_t destsize) const
+{
+	if (!this->file || index >= this->count) return 0;
+	size_t triangles = destsize / 9;
+	if (triangles > this->count - index) triangles = this->count - index;
+	// Concurrent readers share one file position; an interleaved
+	// seek/read pair would hand each the other's window
+	boost::mutex::scoped_lock lock(this->read_mutex);
+	if (fseeko(this->file, (off_t)(index * 9 * sizeof(double)), SEEK_SET) != 0) return 0;
+	if (fread(dest, 9 * sizeof(double), triangles, this->file) != triangles) return 0;
+	return triangles;
+}
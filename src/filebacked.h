@@ -0,0 +1,50 @@
+#pragma once
+
+#include "linalg.h"
+#include <stdio.h>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+/*!
+	Triangle soup spilled to an anonymous temporary file, so oversized
+	meshes occupy disk instead of heap. Writes are buffered and appended;
+	reads go through a small reused window (see readWindow()), which keeps
+	the resident working set bounded no matter how many triangles the
+	store holds. The backing file is created with tmpfile() and therefore
+	disappears automatically when the store is destroyed or the process
+	dies.
+
+	Used by PolySet::spillToDisk() for imports above the spill threshold;
+	see polyset.cc.
+*/
+class FileBackedTriangleStore
+{
+public:
+	FileBackedTriangleStore();
+	~FileBackedTriangleStore();
+
+	//! Appends one triangle; returns false if the temp file can't be written
+	bool append(const Vector3d &p0, const Vector3d &p1, const Vector3d &p2);
+	//! Flushes buffered writes; call once when appending is done
+	bool finalize();
+
+	size_t numTriangles() const { return this->count; }
+
+	/*!
+		Reads triangles [index, index + destsize/9) into dest as 9 doubles
+		each (three vertices), returning the number of triangles read.
+		Sequential windows over the whole store visit every triangle with
+		only destsize doubles resident. Safe to call from several threads:
+		stores are shared between PolySet copies and cached sets are read
+		concurrently (GUI paint vs. render worker), so the seek+read pair
+		is serialized per store.
+	*/
+	size_t readWindow(size_t index, double *dest, size_t destsize) const;
+
+private:
+	FileBackedTriangleStore(const FileBackedTriangleStore &); // not copyable
+	FILE *file;
+	size_t count;
+	std::vector<double> writebuf;
+	mutable boost::mutex read_mutex;
+};
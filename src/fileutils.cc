@@ -1,6 +1,10 @@
 #include "fileutils.h"
 #include "printutils.h"
 
+#include <fstream>
+#include <boost/uuid/sha1.hpp>
+#include <boost/format.hpp>
+
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
 #include "boosty.h"
@@ -33,3 +37,27 @@ std::string lookup_file(const std::string &filename,
 	}
 	return resultfile;
 }
+
+/*!
+	Content hash of the file, used by the caches to tell a real edit
+	apart from a touch: build systems and git routinely bump timestamps
+	without changing a byte. Hashing reads the whole file, so callers
+	should pre-filter on the cheap mtime/size identity and only hash on
+	a mismatch.
+*/
+std::string hash_file_contents(const std::string &filename)
+{
+	std::ifstream f(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!f.good()) return std::string();
+	boost::uuids::detail::sha1 sha;
+	char buf[65536];
+	while (f.good()) {
+		f.read(buf, sizeof(buf));
+		sha.process_bytes(buf, f.gcount());
+	}
+	unsigned int digest[5];
+	sha.get_digest(digest);
+	std::string hash;
+	for (int i=0;i<5;i++) hash += str(boost::format("%08x") % digest[i]);
+	return hash;
+}
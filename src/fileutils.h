@@ -4,3 +4,6 @@
 
 std::string lookup_file(const std::string &filename, 
                         const std::string &path, const std::string &fallbackpath);
+
+// SHA1 of the file's bytes as a hex string, or "" if it can't be read
+std::string hash_file_contents(const std::string &filename);
@@ -36,6 +36,9 @@
 #include "stl-utils.h"
 #include "printutils.h"
 #include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <boost/math/special_functions/fpclassify.hpp>
 using boost::math::isnan;
@@ -87,12 +90,117 @@ Function::~Function()
 	delete expr;
 }
 
+// Cap on memoized results per function, so degenerate argument spaces
+// can't grow the tables without bound
+#define FUNCTION_MEMO_MAX_ENTRIES 100000
+
+/*!
+	Whether any branch reachable through a chain of ternaries is a
+	direct call to funcname, i.e. whether the body is of the
+	accumulator-style form f(i, acc) = i <= 0 ? acc : f(i-1, acc+i)
+	that Function::evaluate() can run as a loop.
+*/
+static bool has_tail_self_call(const Expression *e, const std::string &funcname)
+{
+	if (e->type == "?:") {
+		return has_tail_self_call(e->children[1], funcname) ||
+			has_tail_self_call(e->children[2], funcname);
+	}
+	return e->type == "F" && e->call_funcname == funcname;
+}
+
+/*!
+	The body only sees the arguments, so their values make a complete
+	cache key. Values are encoded with Value::memoString() - exact and
+	type tagged - so arguments differing in type or beyond print
+	precision never share an entry.
+*/
+std::string Function::memo_key(const Context &c) const
+{
+	std::string key;
+	BOOST_FOREACH(const Assignment &arg, definition_arguments) {
+		c.lookup_variable(arg.first, true).memoAppend(key);
+	}
+	return key;
+}
+
 Value Function::evaluate(const Context *ctx, const EvalContext *evalctx) const
 {
 	if (!expr) return Value();
-	Context c(ctx);
-	c.setVariables(definition_arguments, evalctx);
-	return expr->evaluate(&c);
+
+	if (this->memoizable < 0) {
+		std::set<std::string> bound;
+		BOOST_FOREACH(const Assignment &arg, definition_arguments) bound.insert(arg.first);
+		this->memoizable = expr->dependsOnlyOn(bound, this->name) ? 1 : 0;
+	}
+	if (this->tailcalls < 0) {
+		this->tailcalls = (!this->name.empty() && has_tail_self_call(expr, this->name)) ? 1 : 0;
+	}
+
+	Context *c = new Context(ctx);
+	c->setVariables(definition_arguments, evalctx);
+
+	std::string key;
+	if (this->memoizable) {
+		key = memo_key(*c);
+		boost::mutex::scoped_lock lock(this->memo_mutex);
+		boost::unordered_map<std::string, Value>::const_iterator it = this->memo.find(key);
+		if (it != this->memo.end()) {
+			delete c;
+			return it->second;
+		}
+	}
+
+	Value result;
+	if (!this->tailcalls) {
+		result = expr->evaluate(c);
+	}
+	else {
+		for (;;) {
+			// Descend the ternary chain in the current frame
+			const Expression *e = expr;
+			while (e->type == "?:") {
+				e = e->children[e->children[0]->evaluate(c) ? 1 : 2];
+			}
+			if (!(e->type == "F" && e->call_funcname == this->name)) {
+				result = e->evaluate(c);
+				break;
+			}
+
+			// Tail self-call: evaluate its arguments in the current frame,
+			// then rebind them in a fresh frame instead of recursing. This
+			// keeps both C++ stack use and context count constant.
+			std::vector<std::pair<std::string, Value> > argvalues;
+			BOOST_FOREACH(const Assignment &arg, e->call_arguments) {
+				argvalues.push_back(std::make_pair(arg.first,
+																					 arg.second ? arg.second->evaluate(c) : Value()));
+			}
+			delete c;
+			c = new Context(ctx);
+			// Mirror Context::setVariables(): defaults first, then
+			// positional and named actuals
+			BOOST_FOREACH(const Assignment &arg, definition_arguments) {
+				c->set_variable(arg.first, arg.second ? arg.second->evaluate(ctx) : Value());
+			}
+			size_t posarg = 0;
+			for (size_t i = 0; i < argvalues.size(); i++) {
+				if (argvalues[i].first.empty()) {
+					if (posarg < definition_arguments.size()) {
+						c->set_variable(definition_arguments[posarg++].first, argvalues[i].second);
+					}
+				} else {
+					c->set_variable(argvalues[i].first, argvalues[i].second);
+				}
+			}
+		}
+	}
+	delete c;
+
+	if (this->memoizable) {
+		boost::mutex::scoped_lock lock(this->memo_mutex);
+		if (this->memo.size() < FUNCTION_MEMO_MAX_ENTRIES) this->memo[key] = result;
+	}
+	return result;
 }
 
 std::string Function::dump(const std::string &indent, const std::string &name) const
@@ -273,87 +381,133 @@ quit:
 // comment/undefine it to disable domain check
 #define TRIG_HUGE_VAL ((1L<<26)*360.0*(1L<<26))
 
-Value builtin_sin(const Context *, const EvalContext *evalctx)
+static double sin_degrees(register double x)
 {
-	if (evalctx->numArgs() == 1) {
-		const Value &v = evalctx->getArgValue(0);
-		if (v.type() == Value::NUMBER) {
-			register double x = v.toDouble();
-			// use positive tests because of possible Inf/NaN
-			if (x < 360.0 && x >= 0.0) {
-				// Ok for now
-			} else
+	// use positive tests because of possible Inf/NaN
+	if (x < 360.0 && x >= 0.0) {
+		// Ok for now
+	} else
 #ifdef TRIG_HUGE_VAL
-			if (x < TRIG_HUGE_VAL && x > -TRIG_HUGE_VAL)
+	if (x < TRIG_HUGE_VAL && x > -TRIG_HUGE_VAL)
 #endif
-			{
-				register double revolutions = floor(x/360.0);
-				x -= 360.0*revolutions;
-			}
+	{
+		register double revolutions = floor(x/360.0);
+		x -= 360.0*revolutions;
+	}
 #ifdef TRIG_HUGE_VAL
-			else {
-				// total loss of computational accuracy
-				// the result would be meaningless
-				return Value(std::numeric_limits<double>::quiet_NaN());
-			}
+	else {
+		// total loss of computational accuracy
+		// the result would be meaningless
+		return std::numeric_limits<double>::quiet_NaN();
+	}
 #endif
-			bool oppose = x >= 180.0;
-			if (oppose) x -= 180.0;
-			if (x > 90.0) x = 180.0 - x;
-			if (x < 45.0) {
-				if (x == 30.0) x = 0.5;
-				else x = sin(deg2rad(x));
-			} else if (x == 45.0)
-				x = M_SQRT1_2;
-			else // Inf/Nan would fall here
-				x = cos(deg2rad(90.0-x));
+	bool oppose = x >= 180.0;
+	if (oppose) x -= 180.0;
+	if (x > 90.0) x = 180.0 - x;
+	if (x < 45.0) {
+		if (x == 30.0) x = 0.5;
+		else x = sin(deg2rad(x));
+	} else if (x == 45.0)
+		x = M_SQRT1_2;
+	else // Inf/Nan would fall here
+		x = cos(deg2rad(90.0-x));
+
+	return oppose ? -x : x;
+}
+
+static double tan_degrees(double x)
+{
+	return tan(deg2rad(x));
+}
 
-			return Value(oppose ? -x : x);
+/*!
+	Applies a scalar math function elementwise over a vector or range
+	argument. The whole table is computed inside one builtin call into a
+	result vector sized up front, instead of paying an interpreter
+	round-trip per element as [for (a=r) sin(a)] does.
+*/
+static Value batch_apply(const Value &v, double (*f)(double))
+{
+	if (v.type() == Value::VECTOR) {
+		const Value::VectorType &vec = v.toVector();
+		Value::VectorType result;
+		result.reserve(vec.size());
+		for (size_t i = 0; i < vec.size(); i++) {
+			if (vec[i].type() == Value::NUMBER) result.push_back(Value(f(vec[i].toDouble())));
+			else result.push_back(Value());
 		}
+		return Value(result);
+	}
+	if (v.type() == Value::RANGE) {
+		const Value::RangeType &range = v.toRange();
+		boost::uint32_t steps = range.nbsteps();
+		if (steps >= 1000000) {
+			PRINTB("WARNING: Bad range parameter: too many elements (%lu).", steps);
+			return Value();
+		}
+		Value::VectorType result;
+		result.reserve(steps + 1);
+		for (Value::RangeType::iterator it = range.begin(); it != range.end(); it++) {
+			result.push_back(Value(f(*it)));
+		}
+		return Value(result);
 	}
 	return Value();
 }
 
-Value builtin_cos(const Context *, const EvalContext *evalctx)
+Value builtin_sin(const Context *, const EvalContext *evalctx)
 {
 	if (evalctx->numArgs() == 1) {
 		const Value &v = evalctx->getArgValue(0);
-		if (v.type() == Value::NUMBER) {
-			register double x = v.toDouble();
-			// use positive tests because of possible Inf/NaN
-			if (x < 360.0 && x >= 0.0) {
-				// Ok for now
-			} else
+		if (v.type() == Value::NUMBER) return Value(sin_degrees(v.toDouble()));
+		return batch_apply(v, sin_degrees);
+	}
+	return Value();
+}
+
+static double cos_degrees(register double x)
+{
+	// use positive tests because of possible Inf/NaN
+	if (x < 360.0 && x >= 0.0) {
+		// Ok for now
+	} else
 #ifdef TRIG_HUGE_VAL
-			if (x < TRIG_HUGE_VAL && x > -TRIG_HUGE_VAL)
+	if (x < TRIG_HUGE_VAL && x > -TRIG_HUGE_VAL)
 #endif
-			{
-				register double revolutions = floor(x/360.0);
-				x -= 360.0*revolutions;
-			}
+	{
+		register double revolutions = floor(x/360.0);
+		x -= 360.0*revolutions;
+	}
 #ifdef TRIG_HUGE_VAL
-			else {
-				// total loss of computational accuracy
-				// the result would be meaningless
-				return Value(std::numeric_limits<double>::quiet_NaN());
-			}
+	else {
+		// total loss of computational accuracy
+		// the result would be meaningless
+		return std::numeric_limits<double>::quiet_NaN();
+	}
 #endif
-			bool oppose = x >= 180.0;
-			if (oppose) x -= 180.0;
-			if (x > 90.0) {
-				x = 180.0 - x;
-				oppose = !oppose;
-			}
-			if (x > 45.0) {
-				if (x == 60.0) x = 0.5;
-				else x = sin(deg2rad(90.0-x));
-			} else if (x == 45.0)
-				x = M_SQRT1_2;
-			else // Inf/Nan would fall here
-				x = cos(deg2rad(x));
+	bool oppose = x >= 180.0;
+	if (oppose) x -= 180.0;
+	if (x > 90.0) {
+		x = 180.0 - x;
+		oppose = !oppose;
+	}
+	if (x > 45.0) {
+		if (x == 60.0) x = 0.5;
+		else x = sin(deg2rad(90.0-x));
+	} else if (x == 45.0)
+		x = M_SQRT1_2;
+	else // Inf/Nan would fall here
+		x = cos(deg2rad(x));
+
+	return oppose ? -x : x;
+}
 
-			return Value(oppose ? -x : x);
-		}
+Value builtin_cos(const Context *, const EvalContext *evalctx)
+{
+	if (evalctx->numArgs() == 1) {
+		const Value &v = evalctx->getArgValue(0);
+		if (v.type() == Value::NUMBER) return Value(cos_degrees(v.toDouble()));
+		return batch_apply(v, cos_degrees);
 	}
 	return Value();
 }
@@ -383,7 +537,8 @@ Value builtin_tan(const Context *, const EvalContext *evalctx)
 	if (evalctx->numArgs() == 1) {
 		const Value &v = evalctx->getArgValue(0);
 		if (v.type() == Value::NUMBER)
-			return Value(tan(deg2rad(v.toDouble())));
+			return Value(tan_degrees(v.toDouble()));
+		return batch_apply(v, tan_degrees);
 	}
 	return Value();
 }
@@ -513,12 +668,19 @@ Value builtin_ln(const Context *, const EvalContext *evalctx)
 
 Value builtin_str(const Context *, const EvalContext *evalctx)
 {
-	std::stringstream stream;
+	// Chain the arguments into a rope instead of streaming them into a
+	// fresh copy; scripts that grow a string in a loop stay linear
+	Value::StringType result;
 
 	for (size_t i = 0; i < evalctx->numArgs(); i++) {
-		stream << evalctx->getArgValue(i).toString();
+		const Value v = evalctx->getArgValue(i);
+		if (v.type() == Value::STRING) {
+			result = Value::StringType(result, v.toStringType());
+		} else {
+			result = Value::StringType(result, Value::StringType(v.toString()));
+		}
 	}
-	return Value(stream.str());
+	return Value(result);
 }
 
 Value builtin_concat(const Context *, const EvalContext *evalctx)
@@ -539,6 +701,129 @@ Value builtin_concat(const Context *, const EvalContext *evalctx)
 	return Value(result);
 }
 
+/*
+	Tables passed to lookup() and search() tend to be queried many times
+	(interpolation tables in particular), so both builtins index a table
+	the first time it is queried and reuse the index for later calls.
+	Indices are keyed by the shared vector body of the table Value, which
+	is never mutated after construction; the weak_ptr detects when that
+	address has been reused by a later table, and dead entries are swept
+	out as the cache grows.
+*/
+struct TableIndex {
+	boost::weak_ptr<Value::VectorStorage> table;
+	// lookup(): key/value rows stably sorted by key
+	bool lookup_built;
+	std::vector<std::pair<double, double> > sorted;
+	// search(): row numbers per value of the searched column
+	bool search_built;
+	unsigned int search_col;
+	boost::unordered_map<double, std::vector<double> > numrows;
+	boost::unordered_map<std::string, std::vector<double> > strrows;
+	TableIndex() : lookup_built(false), search_built(false), search_col(0) {}
+};
+
+// Indexing costs one pass over the table; below this size the plain
+// scans win
+#define TABLE_INDEX_MIN_ROWS 16
+
+static boost::mutex table_index_mutex;
+static boost::unordered_map<const Value::VectorStorage *, shared_ptr<TableIndex> > table_indices;
+static const std::vector<double> table_no_rows;
+
+// Returns the index entry for the given table, creating it if the
+// table is new or its address has been reused. Caller must hold
+// table_index_mutex.
+static shared_ptr<TableIndex> &table_index_entry(const Value::VectorPtr &table)
+{
+	if (table_indices.size() > 64) {
+		boost::unordered_map<const Value::VectorStorage *, shared_ptr<TableIndex> >::iterator it = table_indices.begin();
+		while (it != table_indices.end()) {
+			if (it->second->table.expired()) it = table_indices.erase(it);
+			else it++;
+		}
+	}
+	shared_ptr<TableIndex> &entry = table_indices[table.get()];
+	if (!entry || entry->table.expired()) {
+		entry.reset(new TableIndex());
+		entry->table = table;
+	}
+	return entry;
+}
+
+static bool table_key_less(const std::pair<double, double> &a, const std::pair<double, double> &b)
+{
+	return a.first < b.first;
+}
+
+// Index entry with the sorted key/value rows built. Built entries are
+// never mutated, so the result can be read without holding the lock.
+static shared_ptr<TableIndex> lookup_table_index(const Value::VectorPtr &table)
+{
+	boost::unique_lock<boost::mutex> lock(table_index_mutex);
+	shared_ptr<TableIndex> entry = table_index_entry(table);
+	if (!entry->lookup_built) {
+		const Value::VectorType &vec = table->boxed();
+		entry->sorted.reserve(vec.size());
+		for (size_t i = 0; i < vec.size(); i++) {
+			double key, value;
+			if (vec[i].getVec2(key, value)) entry->sorted.push_back(std::make_pair(key, value));
+		}
+		// Stable so that duplicated keys resolve to their first row,
+		// like the scan did
+		std::stable_sort(entry->sorted.begin(), entry->sorted.end(), table_key_less);
+		entry->lookup_built = true;
+	}
+	return entry;
+}
+
+// Index entry with the per-column-value row lists built. A search on a
+// different column replaces the entry; current readers keep their
+// reference.
+static shared_ptr<TableIndex> search_table_index(const Value::VectorPtr &table, unsigned int col)
+{
+	boost::unique_lock<boost::mutex> lock(table_index_mutex);
+	shared_ptr<TableIndex> &slot = table_index_entry(table);
+	if (slot->search_built && slot->search_col != col) {
+		slot.reset(new TableIndex());
+		slot->table = table;
+	}
+	shared_ptr<TableIndex> entry = slot;
+	if (!entry->search_built) {
+		const Value::VectorType &vec = table->boxed();
+		for (size_t j = 0; j < vec.size(); j++) {
+			const Value *key = &vec[j];
+			if (key->type() == Value::VECTOR) {
+				const Value::VectorType &row = key->toVector();
+				if (col >= row.size()) continue;
+				key = &row[col];
+			}
+			else if (col != 0) continue;
+			if (key->type() == Value::NUMBER) entry->numrows[key->toDouble()].push_back(double(j));
+			else if (key->type() == Value::STRING) entry->strrows[key->toString()].push_back(double(j));
+			// other types can never equal a number or string search term
+		}
+		entry->search_col = col;
+		entry->search_built = true;
+	}
+	return entry;
+}
+
+// Rows matching the given scalar, or NULL when the term is of a type
+// the index does not cover and the caller must scan
+static const std::vector<double> *table_search_rows(const TableIndex &index, const Value &find)
+{
+	if (find.type() == Value::NUMBER) {
+		boost::unordered_map<double, std::vector<double> >::const_iterator it = index.numrows.find(find.toDouble());
+		return it != index.numrows.end() ? &it->second : &table_no_rows;
+	}
+	if (find.type() == Value::STRING) {
+		boost::unordered_map<std::string, std::vector<double> >::const_iterator it = index.strrows.find(find.toString());
+		return it != index.strrows.end() ? &it->second : &table_no_rows;
+	}
+	return NULL;
+}
+
 Value builtin_lookup(const Context *, const EvalContext *evalctx)
 {
 	double p, low_p, low_v, high_p, high_v;
@@ -546,11 +831,29 @@ Value builtin_lookup(const Context *, const EvalContext *evalctx)
 			!evalctx->getArgValue(0).getDouble(p) ||                  // First must be a number
 			evalctx->getArgValue(1).toVector()[0].toVector().size() < 2) // Second must be a vector of vectors
 		return Value();
-	if (!evalctx->getArgValue(1).toVector()[0].getVec2(low_p, low_v) || !evalctx->getArgValue(1).toVector()[0].getVec2(high_p, high_v))
+	const Value &table = evalctx->getArgValue(1);
+	const Value::VectorType &vec = table.toVector();
+	if (!vec[0].getVec2(low_p, low_v) || !vec[0].getVec2(high_p, high_v))
 		return Value();
-	for (size_t i = 1; i < evalctx->getArgValue(1).toVector().size(); i++) {
+	if (vec.size() >= TABLE_INDEX_MIN_ROWS) {
+		shared_ptr<TableIndex> index = lookup_table_index(table.toVectorPtr());
+		const std::vector<std::pair<double, double> > &sorted = index->sorted;
+		if (p <= sorted.front().first) return Value(sorted.front().second);
+		if (p >= sorted.back().first) return Value(sorted.back().second);
+		std::vector<std::pair<double, double> >::const_iterator it =
+			std::lower_bound(sorted.begin(), sorted.end(), std::make_pair(p, 0.0), table_key_less);
+		// Only a NaN key falls through both clamps onto begin(); the
+		// scan interpolated it to NaN as well
+		if (it == sorted.begin()) return Value(std::numeric_limits<double>::quiet_NaN());
+		if (it->first == p) return Value(it->second);
+		low_p = (it-1)->first; low_v = (it-1)->second;
+		high_p = it->first; high_v = it->second;
+		double f = (p-low_p) / (high_p-low_p);
+		return Value(high_v * f + low_v * (1-f));
+	}
+	for (size_t i = 1; i < vec.size(); i++) {
 		double this_p, this_v;
-		if (evalctx->getArgValue(1).toVector()[i].getVec2(this_p, this_v)) {
+		if (vec[i].getVec2(this_p, this_v)) {
 			if (this_p <= p && (this_p > low_p || low_p > p)) {
 				low_p = this_p;
 				low_v = this_v;
@@ -710,10 +1013,28 @@ Value builtin_search(const Context *, const EvalContext *evalctx)
 
 	Value::VectorType returnvec;
 
+	// Number and exact-string terms over large tables go through the
+	// hash index; the glyph-wise string search below has different
+	// semantics and keeps scanning.
+	shared_ptr<TableIndex> index;
+	if (searchTable.type() == Value::VECTOR &&
+			searchTable.toVector().size() >= TABLE_INDEX_MIN_ROWS &&
+			(findThis.type() == Value::NUMBER || findThis.type() == Value::VECTOR)) {
+		index = search_table_index(searchTable.toVectorPtr(), index_col_num);
+	}
+
 	if (findThis.type() == Value::NUMBER) {
 		unsigned int matchCount = 0;
 
-		for (size_t j = 0; j < searchTable.toVector().size(); j++) {
+		if (index) {
+			const std::vector<double> *rows = table_search_rows(*index, findThis);
+			for (size_t k = 0; rows && k < rows->size(); k++) {
+				returnvec.push_back(Value((*rows)[k]));
+				matchCount++;
+				if (num_returns_per_match != 0 && matchCount >= num_returns_per_match) break;
+			}
+		}
+		else for (size_t j = 0; j < searchTable.toVector().size(); j++) {
 			const Value& search_element = searchTable.toVector()[j];
 
 			if (index_col_num == 0 && findThis == search_element ||
@@ -738,7 +1059,22 @@ Value builtin_search(const Context *, const EvalContext *evalctx)
 
 			Value const& find_value = findThis.toVector()[i];
 
-			for (size_t j = 0; j < searchTable.toVector().size(); j++) {
+			// Terms the index can't answer (vectors, bools) scan as before
+			const std::vector<double> *rows = index ? table_search_rows(*index, find_value) : NULL;
+			if (rows) {
+				for (size_t k = 0; k < rows->size(); k++) {
+					Value resultValue((*rows)[k]);
+					matchCount++;
+					if (num_returns_per_match == 1) {
+						returnvec.push_back(resultValue);
+						break;
+					} else {
+						resultvec.push_back(resultValue);
+					}
+					if (num_returns_per_match > 1 && matchCount >= num_returns_per_match) break;
+				}
+			}
+			else for (size_t j = 0; j < searchTable.toVector().size(); j++) {
 
 				Value const& search_element = searchTable.toVector()[j];
 
@@ -901,6 +1237,193 @@ Value builtin_cross(const Context *, const EvalContext *evalctx)
 	return Value(result);
 }
 
+
+/*!
+	Shared argument handling of the aggregate builtins below: one vector
+	argument in, reduced in a single loop. Flat-typed storage (see
+	Value::VectorStorage) is read in place; boxed vectors fall back to
+	per-element checks, warning and returning undef on a non-number the
+	way norm() does.
+*/
+static bool aggregate_arg(const EvalContext *evalctx, const char *fname, Value &arg)
+{
+	if (evalctx->numArgs() != 1) {
+		PRINTB("WARNING: Invalid number of parameters for %s()", fname);
+		return false;
+	}
+	arg = evalctx->getArgValue(0);
+	if (arg.type() != Value::VECTOR) {
+		PRINTB("WARNING: Invalid type of parameter for %s()", fname);
+		return false;
+	}
+	return true;
+}
+
+static bool aggregate_doubles(const Value &arg, const char *fname, std::vector<double> &out)
+{
+	const Value::VectorType &v = arg.toVector();
+	out.reserve(v.size());
+	for (size_t i = 0; i < v.size(); i++) {
+		if (v[i].type() != Value::NUMBER) {
+			PRINTB("WARNING: Incorrect arguments to %s()", fname);
+			return false;
+		}
+		out.push_back(v[i].toDouble());
+	}
+	return true;
+}
+
+Value builtin_sum(const Context *, const EvalContext *evalctx)
+{
+	Value arg;
+	if (!aggregate_arg(evalctx, "sum", arg)) return Value();
+	Value::VectorPtr vec = arg.toVectorPtr();
+	double sum = 0;
+	if (vec->isFlat() && vec->flatStride() == 0) {
+		const std::vector<double> &data = vec->flatData();
+		for (size_t i = 0; i < data.size(); i++) sum += data[i];
+	} else {
+		std::vector<double> data;
+		if (!aggregate_doubles(arg, "sum", data)) return Value();
+		for (size_t i = 0; i < data.size(); i++) sum += data[i];
+	}
+	return Value(sum);
+}
+
+Value builtin_product(const Context *, const EvalContext *evalctx)
+{
+	Value arg;
+	if (!aggregate_arg(evalctx, "product", arg)) return Value();
+	Value::VectorPtr vec = arg.toVectorPtr();
+	double product = 1;
+	if (vec->isFlat() && vec->flatStride() == 0) {
+		const std::vector<double> &data = vec->flatData();
+		for (size_t i = 0; i < data.size(); i++) product *= data[i];
+	} else {
+		std::vector<double> data;
+		if (!aggregate_doubles(arg, "product", data)) return Value();
+		for (size_t i = 0; i < data.size(); i++) product *= data[i];
+	}
+	return Value(product);
+}
+
+Value builtin_vmin(const Context *, const EvalContext *evalctx)
+{
+	Value arg;
+	if (!aggregate_arg(evalctx, "vmin", arg)) return Value();
+	Value::VectorPtr vec = arg.toVectorPtr();
+	double val;
+	if (vec->isFlat() && vec->flatStride() == 0) {
+		const std::vector<double> &data = vec->flatData();
+		if (data.empty()) return Value();
+		val = data[0];
+		for (size_t i = 1; i < data.size(); i++) if (data[i] < val) val = data[i];
+	} else {
+		std::vector<double> data;
+		if (!aggregate_doubles(arg, "vmin", data)) return Value();
+		if (data.empty()) return Value();
+		val = data[0];
+		for (size_t i = 1; i < data.size(); i++) if (data[i] < val) val = data[i];
+	}
+	return Value(val);
+}
+
+Value builtin_vmax(const Context *, const EvalContext *evalctx)
+{
+	Value arg;
+	if (!aggregate_arg(evalctx, "vmax", arg)) return Value();
+	Value::VectorPtr vec = arg.toVectorPtr();
+	double val;
+	if (vec->isFlat() && vec->flatStride() == 0) {
+		const std::vector<double> &data = vec->flatData();
+		if (data.empty()) return Value();
+		val = data[0];
+		for (size_t i = 1; i < data.size(); i++) if (data[i] > val) val = data[i];
+	} else {
+		std::vector<double> data;
+		if (!aggregate_doubles(arg, "vmax", data)) return Value();
+		if (data.empty()) return Value();
+		val = data[0];
+		for (size_t i = 1; i < data.size(); i++) if (data[i] > val) val = data[i];
+	}
+	return Value(val);
+}
+
+Value builtin_avg(const Context *, const EvalContext *evalctx)
+{
+	Value arg;
+	if (!aggregate_arg(evalctx, "avg", arg)) return Value();
+	Value::VectorPtr vec = arg.toVectorPtr();
+	double sum = 0;
+	size_t n;
+	if (vec->isFlat() && vec->flatStride() == 0) {
+		const std::vector<double> &data = vec->flatData();
+		n = data.size();
+		for (size_t i = 0; i < n; i++) sum += data[i];
+	} else {
+		std::vector<double> data;
+		if (!aggregate_doubles(arg, "avg", data)) return Value();
+		n = data.size();
+		for (size_t i = 0; i < n; i++) sum += data[i];
+	}
+	if (n == 0) return Value();
+	return Value(sum / n);
+}
+
+Value builtin_dot(const Context *, const EvalContext *evalctx)
+{
+	if (evalctx->numArgs() != 2) {
+		PRINT("WARNING: Invalid number of parameters for dot()");
+		return Value();
+	}
+	Value arg0 = evalctx->getArgValue(0);
+	Value arg1 = evalctx->getArgValue(1);
+	if (arg0.type() != Value::VECTOR || arg1.type() != Value::VECTOR) {
+		PRINT("WARNING: Invalid type of parameters for dot()");
+		return Value();
+	}
+	Value::VectorPtr v0 = arg0.toVectorPtr();
+	Value::VectorPtr v1 = arg1.toVectorPtr();
+	if (v0->size() != v1->size()) {
+		PRINT("WARNING: Invalid vector size of parameters for dot()");
+		return Value();
+	}
+	double sum = 0;
+	if (v0->isFlat() && v0->flatStride() == 0 && v1->isFlat() && v1->flatStride() == 0) {
+		const std::vector<double> &d0 = v0->flatData();
+		const std::vector<double> &d1 = v1->flatData();
+		for (size_t i = 0; i < d0.size(); i++) sum += d0[i] * d1[i];
+	} else {
+		std::vector<double> d0, d1;
+		if (!aggregate_doubles(arg0, "dot", d0)) return Value();
+		if (!aggregate_doubles(arg1, "dot", d1)) return Value();
+		for (size_t i = 0; i < d0.size(); i++) sum += d0[i] * d1[i];
+	}
+	return Value(sum);
+}
+
+/*!
+	Everything registered below is pure except rands() (random),
+	parent_module() (reads the module stack) and the dxf_dim()/
+	dxf_cross() pair from dxfdim.cc, which read files: their own cache
+	is keyed on mtime+size exactly so that edited files re-read
+	naturally, and memoizing or folding them on the long-lived AST
+	would freeze stale dimensions across recompiles.
+	version()/version_num() are constant for the lifetime of the
+	process, which is good enough.
+
+	Note that this is a static check: a user-defined function shadowing
+	a builtin name will be treated as pure by callers, which only
+	matters if the shadowing definition is itself impure.
+*/
+bool is_pure_builtin_function(const std::string &name)
+{
+	if (name == "rands" || name == "parent_module" ||
+			name == "dxf_dim" || name == "dxf_cross") return false;
+	const LocalScope &scope = Builtins::instance()->getGlobalScope();
+	return scope.functions.find(name) != scope.functions.end();
+}
+
 void register_builtin_functions()
 {
 	Builtins::init("abs", new BuiltinFunction(&builtin_abs));
@@ -932,5 +1455,11 @@ void register_builtin_functions()
 	Builtins::init("version_num", new BuiltinFunction(&builtin_version_num));
 	Builtins::init("norm", new BuiltinFunction(&builtin_norm));
 	Builtins::init("cross", new BuiltinFunction(&builtin_cross));
+	Builtins::init("sum", new BuiltinFunction(&builtin_sum, Feature::ExperimentalAggregateFunctions));
+	Builtins::init("product", new BuiltinFunction(&builtin_product, Feature::ExperimentalAggregateFunctions));
+	Builtins::init("vmin", new BuiltinFunction(&builtin_vmin, Feature::ExperimentalAggregateFunctions));
+	Builtins::init("vmax", new BuiltinFunction(&builtin_vmax, Feature::ExperimentalAggregateFunctions));
+	Builtins::init("avg", new BuiltinFunction(&builtin_avg, Feature::ExperimentalAggregateFunctions));
+	Builtins::init("dot", new BuiltinFunction(&builtin_dot, Feature::ExperimentalAggregateFunctions));
 	Builtins::init("parent_module", new BuiltinFunction(&builtin_parent_module));
 }
@@ -6,6 +6,8 @@
 
 #include <string>
 #include <vector>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
 
 
 class AbstractFunction
@@ -36,6 +38,9 @@ public:
 	virtual std::string dump(const std::string &indent, const std::string &name) const;
 };
 
+//! Whether name is a builtin whose result depends only on its arguments
+bool is_pure_builtin_function(const std::string &name);
+
 class Function : public AbstractFunction
 {
 public:
@@ -43,9 +48,25 @@ public:
 
 	Expression *expr;
 
-	Function() { }
+	std::string name;
+
+	Function() : memoizable(-1), tailcalls(-1) { }
 	virtual ~Function();
 
 	virtual Value evaluate(const Context *ctx, const EvalContext *evalctx) const;
 	virtual std::string dump(const std::string &indent, const std::string &name) const;
+
+private:
+	// OpenSCAD functions whose bodies depend only on their arguments
+	// are pure, so results can be cached keyed by argument values.
+	// -1 = not yet analyzed, see Expression::dependsOnlyOn()
+	mutable int memoizable;
+	mutable boost::unordered_map<std::string, Value> memo;
+	mutable boost::mutex memo_mutex;
+
+	// Whether the body has ternary-tailed self-recursion which
+	// evaluate() runs as a loop; -1 = not yet analyzed
+	mutable int tailcalls;
+
+	std::string memo_key(const Context &c) const;
 };
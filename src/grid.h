@@ -3,46 +3,101 @@
 #include "mathc99.h"
 #ifdef WIN32
 typedef __int64 int64_t;
+typedef unsigned __int64 uint64_t;
 #else
 #include <stdint.h>
 #endif
 #include <stdlib.h>
-#include <boost/unordered_map.hpp>
-#include <utility>
+#include <deque>
+#include <vector>
 
 //const double GRID_COARSE = 0.001;
 //const double GRID_FINE   = 0.000001;
-/* Using decimals that are exactly convertible to binary floating point 
-(and then converted exactly to a GMPQ Rational that uses a small amount 
-of bytes aka "limbs" in CGAL's engine) provides at least a 5% speedup 
-for ctest -R CGAL. We choose 1/1024 and 1/(1024*1024) In python: print 
+/* Using decimals that are exactly convertible to binary floating point
+(and then converted exactly to a GMPQ Rational that uses a small amount
+of bytes aka "limbs" in CGAL's engine) provides at least a 5% speedup
+for ctest -R CGAL. We choose 1/1024 and 1/(1024*1024) In python: print
 '%.64f' % float(fractions.Fraction(1,1024)) */
 const double GRID_COARSE = 0.0009765625;
 const double GRID_FINE   = 0.00000095367431640625;
 
+/*
+	The grids below snap millions of vertices during DXF tessellation and
+	polyset construction, so the backing store is a flat open-addressing
+	hash table (linear probing, power-of-two capacity, grown at 50% load)
+	instead of a node-based map: one contiguous array of cells means a
+	probe usually touches a single cache line. Cell keys are hashed by
+	morton-interleaving the low coordinate bits - neighbouring cells, which
+	align() probes as a block, get similar codes - folded with the high
+	bits and scrambled with a multiplicative mix. The values themselves
+	live in a deque so references returned by align() stay valid across
+	later insertions, like they did with the old map.
+*/
+
+inline uint64_t grid_spread32(uint64_t v) {
+	v &= 0xffffffffull;
+	v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+	v = (v | (v << 8))  & 0x00ff00ff00ff00ffull;
+	v = (v | (v << 4))  & 0x0f0f0f0f0f0f0f0full;
+	v = (v | (v << 2))  & 0x3333333333333333ull;
+	v = (v | (v << 1))  & 0x5555555555555555ull;
+	return v;
+}
+
+inline uint64_t grid_spread21(uint64_t v) {
+	v &= 0x1fffffull;
+	v = (v | (v << 32)) & 0x001f00000000ffffull;
+	v = (v | (v << 16)) & 0x001f0000ff0000ffull;
+	v = (v | (v << 8))  & 0x100f00f00f00f00full;
+	v = (v | (v << 4))  & 0x10c30c30c30c30c3ull;
+	v = (v | (v << 2))  & 0x1249249249249249ull;
+	return v;
+}
+
+inline uint64_t grid_mix(uint64_t h) {
+	h *= 0x9e3779b97f4a7c15ull;
+	return h ^ (h >> 32);
+}
+
+inline uint64_t grid_hash(int64_t x, int64_t y) {
+	uint64_t h = grid_spread32((uint64_t)x) | (grid_spread32((uint64_t)y) << 1);
+	h ^= ((uint64_t)x >> 32) * 0x85ebca6bull;
+	h ^= ((uint64_t)y >> 32) * 0xc2b2ae35ull;
+	return grid_mix(h);
+}
+
+inline uint64_t grid_hash(int64_t x, int64_t y, int64_t z) {
+	uint64_t h = grid_spread21((uint64_t)x) |
+		(grid_spread21((uint64_t)y) << 1) |
+		(grid_spread21((uint64_t)z) << 2);
+	h ^= ((uint64_t)x >> 21) * 0x85ebca6bull;
+	h ^= ((uint64_t)y >> 21) * 0xc2b2ae35ull;
+	h ^= ((uint64_t)z >> 21) * 0x27d4eb2full;
+	return grid_mix(h);
+}
+
 template <typename T>
 class Grid2d
 {
 public:
 	double res;
-	boost::unordered_map<std::pair<int64_t,int64_t>, T> db;
 
-	Grid2d(double resolution) {
-		res = resolution;
+	Grid2d(double resolution) : res(resolution), table(64), count(0) {
 	}
+
 	/*!
 		Aligns x,y to the grid or to existing point if one close enough exists.
 		Returns the value stored if a point already existing or an uninitialized new value
 		if not.
-	*/ 
+	*/
 	T &align(double &x, double &y) {
 		int64_t ix = (int64_t)round(x / res);
 		int64_t iy = (int64_t)round(y / res);
-		if (db.find(std::make_pair(ix, iy)) == db.end()) {
+		if (!table[findslot(ix, iy)].idx) {
 			int dist = 10;
 			for (int64_t jx = ix - 1; jx <= ix + 1; jx++) {
 				for (int64_t jy = iy - 1; jy <= iy + 1; jy++) {
-					if (db.find(std::make_pair(jx, jy)) == db.end())
+					if (!table[findslot(jx, jy)].idx)
 						continue;
 					int d = abs(int(ix-jx)) + abs(int(iy-jy));
 					if (d < dist) {
@@ -54,17 +109,17 @@ public:
 			}
 		}
 		x = ix * res, y = iy * res;
-		return db[std::make_pair(ix, iy)];
+		return insert(ix, iy);
 	}
 
 	bool has(double x, double y) const {
 		int64_t ix = (int64_t)round(x / res);
 		int64_t iy = (int64_t)round(y / res);
-		if (db.find(std::make_pair(ix, iy)) != db.end())
+		if (table[findslot(ix, iy)].idx)
 			return true;
 		for (int64_t jx = ix - 1; jx <= ix + 1; jx++)
 		for (int64_t jy = iy - 1; jy <= iy + 1; jy++) {
-			if (db.find(std::make_pair(jx, jy)) != db.end())
+			if (table[findslot(jx, jy)].idx)
 				return true;
 		}
 		return false;
@@ -83,6 +138,53 @@ public:
 	T &operator()(double x, double y) {
 		return align(x, y);
 	}
+
+private:
+	struct Cell {
+		int64_t x, y;
+		size_t idx; // value index + 1; 0 marks a free slot
+	};
+
+	std::vector<Cell> table;
+	std::deque<T> values;
+	size_t count;
+
+	size_t findslot(int64_t x, int64_t y) const {
+		size_t mask = table.size() - 1;
+		size_t i = (size_t)grid_hash(x, y) & mask;
+		while (table[i].idx && (table[i].x != x || table[i].y != y))
+			i = (i + 1) & mask;
+		return i;
+	}
+
+	T &insert(int64_t x, int64_t y) {
+		size_t i = findslot(x, y);
+		if (!table[i].idx) {
+			if ((count + 1) * 2 > table.size()) {
+				grow();
+				i = findslot(x, y);
+			}
+			values.push_back(T());
+			table[i].x = x;
+			table[i].y = y;
+			table[i].idx = values.size();
+			count++;
+		}
+		return values[table[i].idx - 1];
+	}
+
+	void grow() {
+		std::vector<Cell> old;
+		old.swap(table);
+		table.resize(old.size() * 2);
+		size_t mask = table.size() - 1;
+		for (size_t i = 0; i < old.size(); i++) {
+			if (!old[i].idx) continue;
+			size_t j = (size_t)grid_hash(old[i].x, old[i].y) & mask;
+			while (table[j].idx) j = (j + 1) & mask;
+			table[j] = old[i];
+		}
+	}
 };
 
 template <typename T>
@@ -90,22 +192,20 @@ class Grid3d
 {
 public:
 	double res;
-	boost::unordered_map<std::pair<std::pair<int64_t,int64_t>,int64_t>, T> db;
 
-	Grid3d(double resolution) {
-		res = resolution;
+	Grid3d(double resolution) : res(resolution), table(64), count(0) {
 	}
 
 	T &align(double &x, double &y, double &z) {
 		int64_t ix = (int64_t)round(x / res);
 		int64_t iy = (int64_t)round(y / res);
 		int64_t iz = (int64_t)round(z / res);
-		if (db.find(std::make_pair(std::make_pair(ix, iy), iz)) == db.end()) {
+		if (!table[findslot(ix, iy, iz)].idx) {
 			int dist = 10;
 			for (int64_t jx = ix - 1; jx <= ix + 1; jx++) {
 				for (int64_t jy = iy - 1; jy <= iy + 1; jy++) {
 					for (int64_t jz = iz - 1; jz <= iz + 1; jz++) {
-						if (db.find(std::make_pair(std::make_pair(jx, jy), jz)) == db.end())
+						if (!table[findslot(jx, jy, jz)].idx)
 							continue;
 						int d = abs(int(ix-jx)) + abs(int(iy-jy)) + abs(int(iz-jz));
 						if (d < dist) {
@@ -119,19 +219,19 @@ public:
 			}
 		}
 		x = ix * res, y = iy * res, z = iz * res;
-		return db[std::make_pair(std::make_pair(ix, iy), iz)];
+		return insert(ix, iy, iz);
 	}
 
 	bool has(double x, double y, double z) {
 		int64_t ix = (int64_t)round(x / res);
 		int64_t iy = (int64_t)round(y / res);
 		int64_t iz = (int64_t)round(z / res);
-		if (db.find(std::make_pair(std::make_pair(ix, iy), iz)) != db.end())
+		if (table[findslot(ix, iy, iz)].idx)
 			return true;
 		for (int64_t jx = ix - 1; jx <= ix + 1; jx++)
 		for (int64_t jy = iy - 1; jy <= iy + 1; jy++)
 		for (int64_t jz = iz - 1; jz <= iz + 1; jz++) {
-			if (db.find(std::make_pair(std::make_pair(jx, jy), jz)) != db.end())
+			if (table[findslot(jx, jy, jz)].idx)
 				return true;
 		}
 		return false;
@@ -152,4 +252,52 @@ public:
 	T &operator()(double x, double y, double z) {
 		return align(x, y, z);
 	}
+
+private:
+	struct Cell {
+		int64_t x, y, z;
+		size_t idx; // value index + 1; 0 marks a free slot
+	};
+
+	std::vector<Cell> table;
+	std::deque<T> values;
+	size_t count;
+
+	size_t findslot(int64_t x, int64_t y, int64_t z) const {
+		size_t mask = table.size() - 1;
+		size_t i = (size_t)grid_hash(x, y, z) & mask;
+		while (table[i].idx && (table[i].x != x || table[i].y != y || table[i].z != z))
+			i = (i + 1) & mask;
+		return i;
+	}
+
+	T &insert(int64_t x, int64_t y, int64_t z) {
+		size_t i = findslot(x, y, z);
+		if (!table[i].idx) {
+			if ((count + 1) * 2 > table.size()) {
+				grow();
+				i = findslot(x, y, z);
+			}
+			values.push_back(T());
+			table[i].x = x;
+			table[i].y = y;
+			table[i].z = z;
+			table[i].idx = values.size();
+			count++;
+		}
+		return values[table[i].idx - 1];
+	}
+
+	void grow() {
+		std::vector<Cell> old;
+		old.swap(table);
+		table.resize(old.size() * 2);
+		size_t mask = table.size() - 1;
+		for (size_t i = 0; i < old.size(); i++) {
+			if (!old[i].idx) continue;
+			size_t j = (size_t)grid_hash(old[i].x, old[i].y, old[i].z) & mask;
+			while (table[j].idx) j = (j + 1) & mask;
+			table[j] = old[i];
+		}
+	}
 };
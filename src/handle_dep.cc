@@ -1,25 +1,36 @@
 #include "handle_dep.h"
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <stdio.h>
 #include <stdlib.h> // for system()
 #include <boost/unordered_set.hpp>
 #include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/regex.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
 namespace fs = boost::filesystem;
 #include "boosty.h"
 
 boost::unordered_set<std::string> dependencies;
+// Imports may register dependencies from prefetch worker threads
+static boost::mutex dep_mutex;
 const char *make_command = NULL;
 
 void handle_dep(const std::string &filename)
 {
 	fs::path filepath(filename);
-	if ( boosty::is_absolute( filepath )) {
-		dependencies.insert(filename);
-	}
-	else {
-		dependencies.insert((fs::current_path() / filepath).string());
+	{
+		boost::mutex::scoped_lock lock(dep_mutex);
+		if ( boosty::is_absolute( filepath )) {
+			dependencies.insert(filename);
+		}
+		else {
+			dependencies.insert((fs::current_path() / filepath).string());
+		}
 	}
 	if (!fs::exists(filepath) && make_command) {
 		std::stringstream buf;
@@ -28,6 +39,11 @@ void handle_dep(const std::string &filename)
 	}
 }
 
+const boost::unordered_set<std::string> &dependency_files()
+{
+	return dependencies;
+}
+
 bool write_deps(const std::string &filename, const std::string &output_file)
 {
 	FILE *fp = fopen(filename.c_str(), "wt");
@@ -44,3 +60,74 @@ bool write_deps(const std::string &filename, const std::string &output_file)
 	fclose(fp);
 	return true;
 }
+
+static bool hash_file_contents(const std::string &filename, size_t &hash)
+{
+	std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!ifs.is_open()) return false;
+	std::string contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	hash = boost::hash<std::string>()(contents);
+	return true;
+}
+
+/*!
+	Writes a stamp file for the current dependency set: one line with a
+	hash of the -D command-line overrides, then one "<hash> <filename>"
+	line per file registered through handle_dep(). Must be called after
+	parsing, when the dependency closure is complete.
+*/
+bool write_dep_stamp(const std::string &filename, const std::string &cmdline_commands)
+{
+	std::vector<std::string> sorted(dependencies.begin(), dependencies.end());
+	std::sort(sorted.begin(), sorted.end());
+
+	FILE *fp = fopen(filename.c_str(), "wt");
+	if (!fp) {
+		fprintf(stderr, "Can't open stamp file `%s' for writing!\n", filename.c_str());
+		return false;
+	}
+	fprintf(fp, "-D %lx\n", (unsigned long)boost::hash<std::string>()(cmdline_commands));
+	BOOST_FOREACH(const std::string &str, sorted) {
+		size_t hash;
+		if (!hash_file_contents(str, hash)) {
+			// A vanished dependency means the stamp can't vouch for the next
+			// run; leave no stamp rather than a misleading one
+			fclose(fp);
+			fs::remove(fs::path(filename));
+			return false;
+		}
+		fprintf(fp, "%lx %s\n", (unsigned long)hash, str.c_str());
+	}
+	fclose(fp);
+	return true;
+}
+
+/*!
+	Returns true if the stamp file exists and every dependency it lists
+	still hashes to the recorded value, with unchanged -D overrides. The
+	file list comes from the stamp itself, so this runs before any
+	parsing; a dependency added since the stamp was written changed the
+	file that includes it, which the hashes catch.
+*/
+bool dep_stamp_matches(const std::string &filename, const std::string &cmdline_commands)
+{
+	std::ifstream ifs(filename.c_str());
+	if (!ifs.is_open()) return false;
+
+	std::string line;
+	if (!std::getline(ifs, line)) return false;
+	std::stringstream cmdhash;
+	cmdhash << "-D " << std::hex << (unsigned long)boost::hash<std::string>()(cmdline_commands);
+	if (line != cmdhash.str()) return false;
+
+	while (std::getline(ifs, line)) {
+		if (line.empty()) continue;
+		size_t sep = line.find(' ');
+		if (sep == std::string::npos) return false;
+		unsigned long recorded = strtoul(line.substr(0, sep).c_str(), NULL, 16);
+		size_t hash;
+		if (!hash_file_contents(line.substr(sep + 1), hash)) return false;
+		if ((unsigned long)hash != recorded) return false;
+	}
+	return true;
+}
@@ -1,7 +1,18 @@
 #pragma once
 
 #include <string>
+#include <boost/unordered_set.hpp>
 
 extern const char *make_command;
 void handle_dep(const std::string &filename);
 bool write_deps(const std::string &filename, const std::string &output_file);
+// Every file registered through handle_dep() so far (input, includes,
+// uses, imports); --watch polls this set for changes.
+const boost::unordered_set<std::string> &dependency_files();
+
+// Stamp files record a content hash per dependency plus a hash of the
+// -D command-line overrides, so --skip-if-unchanged can tell whether a
+// re-render would produce the same outputs. Output mtimes can't carry
+// that information.
+bool write_dep_stamp(const std::string &filename, const std::string &cmdline_commands);
+bool dep_stamp_matches(const std::string &filename, const std::string &cmdline_commands);
@@ -318,37 +318,44 @@ void Highlighter::highlightBlock(const QString &text)
 	QTextCharFormat &commentFormat = tokenFormats["_$comment"];
 	QTextCharFormat &numberFormat = tokenFormats["_$number"];
 
-	// Split the block into chunks (tokens), based on whitespace,
-	// and then highlight each token as appropriate
-	QString newtext = text;
-	QStringList splitHelpers;
-	QStringList::iterator sh, token;
-	// splitHelpers - so "{[a+b]}" is treated as " { [ a + b ] } "
-	splitHelpers << tokentypes["operator"] << tokentypes["bracket"]
-	  << tokentypes["curlies"] << ":" << ",";
-	for ( sh = splitHelpers.begin(); sh!=splitHelpers.end(); ++sh ) {
-		newtext = newtext.replace( *sh, " " + *sh + " ");
-	}
-	//PRINTB("\nnewtext: %s", newtext.toStdString() );
-	QStringList tokens = newtext.split(QRegExp("\\s"));
-	int tokindex = 0; // tokindex helps w duplicate tokens in a single block
-	bool numtest;
-	for ( token = tokens.begin(); token!=tokens.end(); ++token ){
-		if ( tokenFormats.contains( *token ) ) {
-			tokindex = text.indexOf( *token, tokindex );
-			setFormat( tokindex, token->size(), tokenFormats[ *token ]);
-			std::string tokprint = (*token).toStdString();
-			//PRINTB("found tok '%s' at %i", tokprint % tokindex );
-			tokindex += token->size();
+	// Scan the block in a single pass, picking words, numbers and operator
+	// characters out of the text in place. The old code built a padded copy
+	// of every block and re-split it with a regexp, which allocated enough
+	// to make large files stutter on every keystroke.
+	const int len = text.size();
+	int n = 0;
+	while (n < len) {
+		const QChar c = text[n];
+		if (c.isLetter() || c == '$' || c == '_') {
+			int start = n;
+			while (n < len && (text[n].isLetterOrNumber() || text[n] == '$' || text[n] == '_')) n++;
+			QHash<QString, QTextCharFormat>::const_iterator found =
+				tokenFormats.find(text.mid(start, n - start));
+			if (found != tokenFormats.end()) setFormat(start, n - start, found.value());
+		} else if (c.isDigit() || (c == '.' && n+1 < len && text[n+1].isDigit())) {
+			int start = n;
+			while (n < len && (text[n].isDigit() || text[n] == '.')) n++;
+			if (n < len && (text[n] == 'e' || text[n] == 'E')) {
+				n++;
+				if (n < len && (text[n] == '+' || text[n] == '-')) n++;
+				while (n < len && text[n].isDigit()) n++;
+			}
+			// trailing word characters mean this wasn't a number after all
+			if (n == len || !(text[n].isLetter() || text[n] == '_')) {
+				setFormat(start, n - start, numberFormat);
+			}
 		} else {
-			(*token).toDouble( &numtest );
-			if ( numtest ) {
-				tokindex = text.indexOf( *token, tokindex );
-				setFormat( tokindex, token->size(), numberFormat );
-				std::string tokprint = (*token).toStdString();
-				//PRINTB("found num '%s' at %i", tokprint % tokindex );
-				tokindex += token->size();
+			if ((c == '&' || c == '|') && n+1 < len && text[n+1] == c) {
+				QHash<QString, QTextCharFormat>::const_iterator found =
+					tokenFormats.find(text.mid(n, 2));
+				if (found != tokenFormats.end()) setFormat(n, 2, found.value());
+				n += 2;
+				continue;
 			}
+			QHash<QString, QTextCharFormat>::const_iterator found =
+				tokenFormats.find(QString(c));
+			if (found != tokenFormats.end()) setFormat(n, 1, found.value());
+			n++;
 		}
 	}
 
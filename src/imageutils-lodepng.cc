@@ -1,11 +1,116 @@
 #include "imageutils.h"
 #include "lodepng.h"
+#include "workerpool.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 #include <iterator>
 #include <algorithm>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+// Below this many bytes of filtered image data, thread startup costs more
+// than the compression itself
+#define PARALLEL_PNG_MIN_BYTES (1024*1024)
+
+static unsigned adler32_of(const unsigned char *data, size_t len)
+{
+	unsigned s1 = 1, s2 = 0;
+	while (len > 0) {
+		// Enough iterations before the sums can overflow 32 bits
+		size_t amount = std::min(len, (size_t)5550);
+		len -= amount;
+		while (amount > 0) {
+			s1 += *data++;
+			s2 += s1;
+			amount--;
+		}
+		s1 %= 65521;
+		s2 %= 65521;
+	}
+	return (s2 << 16) | s1;
+}
+
+struct DeflatePart
+{
+	unsigned char *data;
+	size_t size;
+	unsigned error;
+};
+
+static void deflate_part(const unsigned char *in, size_t insize, const LodePNGCompressSettings *settings,
+												 unsigned is_final, DeflatePart *part)
+{
+	part->data = NULL;
+	part->size = 0;
+	part->error = lodepng_deflate_part(&part->data, &part->size, in, insize, settings, is_final);
+}
+
+/*!
+	Drop-in replacement for lodepng's zlib compressor which deflates
+	independent slices of the input on worker threads. Each slice except
+	the last ends with a sync flush (see lodepng_deflate_part), so the
+	compressed slices concatenate into one valid deflate stream, wrapped
+	in the standard zlib header and adler32 trailer.
+*/
+static unsigned parallel_zlib_compress(unsigned char **out, size_t *outsize,
+																			 const unsigned char *in, size_t insize,
+																			 const LodePNGCompressSettings *settings)
+{
+	size_t numthreads = WorkerPool::numThreads();
+	if (numthreads < 2 || insize < PARALLEL_PNG_MIN_BYTES) {
+		return lodepng_zlib_compress(out, outsize, in, insize, settings);
+	}
+
+	size_t slicesize = (insize + numthreads - 1) / numthreads;
+	size_t numslices = (insize + slicesize - 1) / slicesize;
+	std::vector<DeflatePart> parts(numslices);
+	WorkerPool::TaskGroup tasks;
+	for (size_t i = 0; i < numslices; i++) {
+		size_t start = i * slicesize;
+		size_t len = std::min(slicesize, insize - start);
+		tasks.run(boost::bind(deflate_part, in + start, len, settings,
+													(unsigned)(i == numslices - 1), &parts[i]));
+	}
+	tasks.wait();
+
+	unsigned error = 0;
+	size_t deflatesize = 0;
+	for (size_t i = 0; i < numslices; i++) {
+		if (parts[i].error) error = parts[i].error;
+		deflatesize += parts[i].size;
+	}
+
+	if (!error) {
+		// zlib: 2 byte header, deflate data, 4 byte adler32 of the input
+		unsigned char *buf = (unsigned char *)malloc(deflatesize + 6);
+		if (!buf) error = 83; // lodepng's alloc failure code
+		else {
+			unsigned cmfflg = 256*120; // CM/CINFO 0x78, FDICT 0, FLEVEL 0
+			cmfflg += 31 - cmfflg % 31;
+			buf[0] = (unsigned char)(cmfflg / 256);
+			buf[1] = (unsigned char)(cmfflg % 256);
+			size_t pos = 2;
+			for (size_t i = 0; i < numslices; i++) {
+				memcpy(buf + pos, parts[i].data, parts[i].size);
+				pos += parts[i].size;
+			}
+			unsigned adler = adler32_of(in, insize);
+			buf[pos++] = (unsigned char)((adler >> 24) & 255);
+			buf[pos++] = (unsigned char)((adler >> 16) & 255);
+			buf[pos++] = (unsigned char)((adler >> 8) & 255);
+			buf[pos++] = (unsigned char)(adler & 255);
+			*out = buf;
+			*outsize = pos;
+		}
+	}
+
+	for (size_t i = 0; i < numslices; i++) free(parts[i].data);
+	return error;
+}
+
 bool write_png(std::ostream &output, unsigned char *pixels, int width, int height)
 {
 	std::vector<unsigned char> dataout;
@@ -14,6 +119,28 @@ bool write_png(std::ostream &output, unsigned char *pixels, int width, int heigh
 	// some png renderers have different interpretations of alpha, so don't use it
 	state.info_png.color.colortype = LCT_RGB;
 	state.info_png.color.bitdepth = 8;
+
+	// Speed knob for batch exports (e.g. CI grabbing thousands of test
+	// renders): "fast" trades some file size for encode speed, "none"
+	// stores the image data uncompressed.
+	const char *compression = getenv("OPENSCAD_PNG_COMPRESSION");
+	if (compression && !strcmp(compression, "fast")) {
+		state.encoder.zlibsettings.windowsize = 256;
+		state.encoder.zlibsettings.lazymatching = 0;
+		state.encoder.filter_strategy = LFS_ZERO;
+	}
+	else if (compression && !strcmp(compression, "none")) {
+		state.encoder.zlibsettings.btype = 0;
+		state.encoder.filter_strategy = LFS_ZERO;
+	}
+	else if (compression) {
+		fprintf(stderr, "Unknown OPENSCAD_PNG_COMPRESSION '%s' (use \"fast\" or \"none\")\n", compression);
+	}
+
+	if (boost::thread::hardware_concurrency() > 1) {
+		state.encoder.zlibsettings.custom_zlib = parallel_zlib_compress;
+	}
+
 	unsigned err = lodepng::encode(dataout, pixels, width, height, state);
 	if ( err ) return false;
 	output.write( reinterpret_cast<const char *>(&dataout[0]), dataout.size());
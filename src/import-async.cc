@@ -0,0 +1,290 @@
+#include "import-async.h"
+#include "importnode.h"
+#include "GeometryCache.h"
+#include "Geometry.h"
+#include "polyset.h"
+#include "Polygon2d.h"
+#include "clipper-utils.h"
+#include "printutils.h"
+
+#include <fstream>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <boost/bind.hpp>
+#include <boost/uuid/sha1.hpp>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+AsyncImportLoader *AsyncImportLoader::instance()
+{
+	static AsyncImportLoader *loader = new AsyncImportLoader();
+	return loader;
+}
+
+/*!
+	The bounding-box sidecar is keyed on the file path, not the content
+	hash the mesh cache uses: hashing would read the whole file, which is
+	exactly the cost the placeholder exists to avoid. mtime and size are
+	stored inside the entry and checked on load, so a changed file just
+	misses.
+*/
+static std::string bbox_sidecar_file(const std::string &filename)
+{
+	const char *cachedir = getenv("OPENSCAD_CACHE_DIR");
+	if (!cachedir || !cachedir[0]) return std::string();
+
+	boost::uuids::detail::sha1 sha;
+	sha.process_bytes(filename.data(), filename.size());
+	unsigned int digest[5];
+	sha.get_digest(digest);
+	std::string hash;
+	for (int i=0;i<5;i++) hash += str(boost::format("%08x") % digest[i]);
+	return std::string(cachedir) + "/" + hash + ".bbox";
+}
+
+static const char bbox_sidecar_magic[8] = "OSBBOX1";
+
+static bool file_identity(const std::string &filename, int64_t &mtime, uint64_t &size)
+{
+	boost::system::error_code ec;
+	mtime = fs::last_write_time(fs::path(filename), ec);
+	if (ec) return false;
+	size = fs::file_size(fs::path(filename), ec);
+	return !ec;
+}
+
+static bool load_bbox_sidecar(const std::string &filename, BoundingBox &bbox)
+{
+	const std::string sidecar = bbox_sidecar_file(filename);
+	if (sidecar.empty()) return false;
+	int64_t mtime;
+	uint64_t size;
+	if (!file_identity(filename, mtime, size)) return false;
+
+	std::ifstream f(sidecar.c_str(), std::ios::in | std::ios::binary);
+	if (!f.good()) return false;
+	char magic[8];
+	int64_t stored_mtime;
+	uint64_t stored_size;
+	double v[6];
+	f.read(magic, sizeof(magic));
+	f.read(reinterpret_cast<char *>(&stored_mtime), sizeof(stored_mtime));
+	f.read(reinterpret_cast<char *>(&stored_size), sizeof(stored_size));
+	f.read(reinterpret_cast<char *>(v), sizeof(v));
+	if (!f.good() || memcmp(magic, bbox_sidecar_magic, sizeof(magic))) return false;
+	if (stored_mtime != mtime || stored_size != size) return false;
+	bbox = BoundingBox(Vector3d(v[0], v[1], v[2]), Vector3d(v[3], v[4], v[5]));
+	return !bbox.isNull();
+}
+
+static void save_bbox_sidecar(const std::string &filename, const BoundingBox &bbox)
+{
+	const std::string sidecar = bbox_sidecar_file(filename);
+	if (sidecar.empty() || bbox.isNull()) return;
+	int64_t mtime;
+	uint64_t size;
+	if (!file_identity(filename, mtime, size)) return;
+
+	boost::system::error_code ec;
+	fs::create_directories(fs::path(sidecar).parent_path(), ec);
+	const std::string tmpfile = sidecar + "." + fs::unique_path("%%%%%%%%").string() + ".tmp";
+	std::ofstream f(tmpfile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!f.good()) return;
+	double v[6] = { bbox.min()[0], bbox.min()[1], bbox.min()[2],
+									bbox.max()[0], bbox.max()[1], bbox.max()[2] };
+	f.write(bbox_sidecar_magic, sizeof(bbox_sidecar_magic));
+	f.write(reinterpret_cast<const char *>(&mtime), sizeof(mtime));
+	f.write(reinterpret_cast<const char *>(&size), sizeof(size));
+	f.write(reinterpret_cast<const char *>(v), sizeof(v));
+	const bool ok = f.good();
+	f.close();
+	if (ok) fs::rename(fs::path(tmpfile), fs::path(sidecar), ec);
+	if (!ok || ec) fs::remove(fs::path(tmpfile), ec);
+}
+
+/*!
+	Bounded scan of the first facets of a binary STL, for files never
+	seen before: a few hundred KB of reads usually brackets most of the
+	model. An estimate is fine - the placeholder only has to occupy
+	roughly the right space until the real mesh lands.
+*/
+#define PROXY_SCAN_MAX_FACETS 20000
+
+static bool scan_stl_bbox(const std::string &filename, BoundingBox &bbox)
+{
+#ifdef BOOST_BIG_ENDIAN
+	// The facet data below is read raw as little-endian floats
+	return false;
+#else
+	std::ifstream f(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!f.good()) return false;
+	std::streampos file_size = f.tellg();
+	f.seekg(80);
+	uint32_t facenum = 0;
+	f.read(reinterpret_cast<char *>(&facenum), sizeof(facenum));
+	if (!f.good() || file_size != static_cast<std::streamoff>(80 + 4 + 50*facenum)) {
+		return false; // ASCII or truncated; no cheap box to be had
+	}
+
+	uint32_t numscan = std::min(facenum, (uint32_t)PROXY_SCAN_MAX_FACETS);
+	for (uint32_t i = 0; i < numscan; i++) {
+		float data[12]; // normal + 3 vertices
+		f.read(reinterpret_cast<char *>(data), sizeof(data));
+		f.ignore(2); // attribute byte count
+		if (!f.good()) break;
+		for (int v = 0; v < 3; v++) {
+			bbox.extend(Vector3d(data[3 + 3*v], data[4 + 3*v], data[5 + 3*v]));
+		}
+	}
+	return !bbox.isNull();
+#endif
+}
+
+static shared_ptr<const Geometry> make_proxy(const ImportNode &node)
+{
+	BoundingBox bbox;
+	if (!load_bbox_sidecar(node.filename, bbox) && node.type == TYPE_STL) {
+		scan_stl_bbox(node.filename, bbox);
+	}
+
+	PolySet *p = new PolySet(3);
+	if (!bbox.isNull()) {
+		double x1 = bbox.min()[0], y1 = bbox.min()[1], z1 = bbox.min()[2];
+		double x2 = bbox.max()[0], y2 = bbox.max()[1], z2 = bbox.max()[2];
+
+		p->append_poly(); // top
+		p->append_vertex(x1, y1, z2);
+		p->append_vertex(x2, y1, z2);
+		p->append_vertex(x2, y2, z2);
+		p->append_vertex(x1, y2, z2);
+
+		p->append_poly(); // bottom
+		p->append_vertex(x1, y2, z1);
+		p->append_vertex(x2, y2, z1);
+		p->append_vertex(x2, y1, z1);
+		p->append_vertex(x1, y1, z1);
+
+		p->append_poly(); // side1
+		p->append_vertex(x1, y1, z1);
+		p->append_vertex(x2, y1, z1);
+		p->append_vertex(x2, y1, z2);
+		p->append_vertex(x1, y1, z2);
+
+		p->append_poly(); // side2
+		p->append_vertex(x2, y1, z1);
+		p->append_vertex(x2, y2, z1);
+		p->append_vertex(x2, y2, z2);
+		p->append_vertex(x2, y1, z2);
+
+		p->append_poly(); // side3
+		p->append_vertex(x2, y2, z1);
+		p->append_vertex(x1, y2, z1);
+		p->append_vertex(x1, y2, z2);
+		p->append_vertex(x2, y2, z2);
+
+		p->append_poly(); // side4
+		p->append_vertex(x1, y2, z1);
+		p->append_vertex(x1, y1, z1);
+		p->append_vertex(x1, y1, z2);
+		p->append_vertex(x1, y2, z2);
+	}
+	p->setConvexity(1);
+	return shared_ptr<const Geometry>(p);
+}
+
+shared_ptr<const Geometry> AsyncImportLoader::proxyFor(const ImportNode &node,
+																											 const std::string &key)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	if (!this->inflight.count(key)) {
+		// The load may have finished but been evicted from the
+		// GeometryCache before the evaluator got back to it; reschedule
+		Load load;
+		// The clone outlives the design tree it came from, but its
+		// ModuleInstantiation won't; createGeometry() never consults it
+		ImportNode *clone = static_cast<ImportNode *>(node.cloneNode());
+		clone->modinst = NULL;
+		load.node = clone;
+		load.key = key;
+		this->queue.push_back(load);
+		this->inflight.insert(key);
+		if (this->idleworkers == 0 &&
+				this->numworkers < (size_t)boost::thread::hardware_concurrency()) {
+			this->numworkers++;
+			this->workers.create_thread(boost::bind(&AsyncImportLoader::worker, this));
+		}
+		this->work_cond.notify_one();
+	}
+
+	shared_ptr<const Geometry> &proxy = this->proxies[key];
+	if (!proxy) {
+		proxy = make_proxy(node);
+		this->proxy_ptrs.insert(proxy.get());
+	}
+	return proxy;
+}
+
+void AsyncImportLoader::worker()
+{
+	while (1) {
+		Load load;
+		{
+			boost::mutex::scoped_lock lock(this->mutex);
+			while (this->queue.empty()) {
+				this->idleworkers++;
+				this->work_cond.wait(lock);
+				this->idleworkers--;
+			}
+			load = this->queue.front();
+			this->queue.erase(this->queue.begin());
+		}
+
+		shared_ptr<const Geometry> geom(load.node->createGeometry());
+		// 2D imports get the same cleanup the evaluator would apply
+		if (const Polygon2d *polygon = dynamic_cast<const Polygon2d *>(geom.get())) {
+			if (!polygon->isSanitized()) geom.reset(ClipperUtils::sanitize(*polygon));
+		}
+		GeometryCache::instance()->insert(load.key, geom);
+		if (geom && !geom->isEmpty()) {
+			save_bbox_sidecar(load.node->filename, geom->getBoundingBox());
+		}
+		delete load.node;
+
+		{
+			boost::mutex::scoped_lock lock(this->mutex);
+			std::map<std::string, shared_ptr<const Geometry> >::iterator it =
+				this->proxies.find(load.key);
+			if (it != this->proxies.end()) {
+				// Keep the placeholder alive so its address can't be reused
+				// by a later real geometry and confuse isProxy()
+				this->retired.push_back(it->second);
+				this->proxies.erase(it);
+			}
+			this->inflight.erase(load.key);
+			this->gen++;
+		}
+	}
+}
+
+bool AsyncImportLoader::hasPending()
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return !this->inflight.empty();
+}
+
+size_t AsyncImportLoader::generation()
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return this->gen;
+}
+
+bool AsyncImportLoader::isProxy(const Geometry *geom)
+{
+	if (!geom) return false;
+	AsyncImportLoader *loader = instance();
+	boost::mutex::scoped_lock lock(loader->mutex);
+	return loader->proxy_ptrs.count(geom) != 0;
+}
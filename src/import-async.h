@@ -0,0 +1,75 @@
+#pragma once
+
+#include "memory.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+/*!
+	Loads import() files on background threads so a preview compile
+	returns immediately instead of blocking first paint on every large
+	mesh. While a file is in flight the evaluator substitutes a
+	bounding-box placeholder (proxyFor()); the finished mesh lands in the
+	GeometryCache under the node's id hash, where the next compile picks
+	it up like any other cached result, and generation() ticks so the GUI
+	knows to schedule that compile (see checkImportArrivals() in
+	mainwin.cc).
+
+	The placeholder box comes from a tiny bounding-box sidecar written
+	into OPENSCAD_CACHE_DIR after each background load, or from a bounded
+	scan of the first facets of a binary STL; failing both, it is empty
+	and the part simply pops in when the load finishes. Placeholders
+	never enter the caches - smartCacheInsert() asks isProxy() - and the
+	full render path doesn't consult the loader at all, so exports always
+	see exact geometry.
+
+	Enabled by the async-import feature. Process-lifetime singleton like
+	the geometry caches; worker threads are created lazily and kept.
+*/
+class AsyncImportLoader
+{
+public:
+	static AsyncImportLoader *instance();
+
+	/*!
+		Returns a placeholder for the node, scheduling its background load
+		if it isn't running yet. Returns the real geometry instead when the
+		load finished but the cache entry was already evicted.
+	*/
+	shared_ptr<const class Geometry> proxyFor(const class ImportNode &node,
+																						const std::string &key);
+	//! True while scheduled loads haven't landed yet
+	bool hasPending();
+	//! Bumped once per finished load
+	size_t generation();
+
+	//! True if geom is a placeholder handed out by proxyFor()
+	static bool isProxy(const class Geometry *geom);
+
+private:
+	AsyncImportLoader() : gen(0), numworkers(0), idleworkers(0) {}
+	void worker();
+
+	struct Load {
+		const class ImportNode *node; //!< privately owned clone
+		std::string key;
+	};
+
+	std::vector<Load> queue;
+	//! Keys scheduled but not yet landed
+	std::set<std::string> inflight;
+	//! Placeholder handed out per in-flight key
+	std::map<std::string, shared_ptr<const class Geometry> > proxies;
+	//! Every placeholder ever handed out; retired ones are kept so their
+	//! addresses stay unambiguous for isProxy()
+	std::set<const class Geometry *> proxy_ptrs;
+	std::vector<shared_ptr<const class Geometry> > retired;
+	size_t gen;
+	size_t numworkers, idleworkers;
+	boost::mutex mutex;
+	boost::condition_variable work_cond;
+	boost::thread_group workers;
+};
@@ -0,0 +1,85 @@
+#include "import-prefetch.h"
+#include "importnode.h"
+#include "Tree.h"
+#include "GeometryCache.h"
+#include "Geometry.h"
+#include "Polygon2d.h"
+#include "clipper-utils.h"
+
+#include <algorithm>
+#include <boost/foreach.hpp>
+
+/*!
+	Claims every ImportNode below node that isn't already cached. The
+	same file imported in several places shares one id hash and is
+	claimed - and imported - only once.
+*/
+void ImportPrefetcher::collect(const AbstractNode &node)
+{
+	if (const ImportNode *import = dynamic_cast<const ImportNode *>(&node)) {
+		const std::string &key = this->tree.getIdHash(*import);
+		if (!GeometryCache::instance()->contains(key) && !this->results.count(key)) {
+			this->results[key] = shared_ptr<const Geometry>();
+			this->tasks.push_back(std::make_pair(import, key));
+		}
+		return;
+	}
+	BOOST_FOREACH(const AbstractNode *child, node.getChildren()) {
+		collect(*child);
+	}
+}
+
+void ImportPrefetcher::start(const AbstractNode &root)
+{
+	collect(root);
+	if (this->tasks.empty()) return;
+	size_t numthreads = std::min((size_t)boost::thread::hardware_concurrency(),
+															 this->tasks.size());
+	for (size_t t = 0; t < numthreads; t++) {
+		this->workers.create_thread(boost::bind(&ImportPrefetcher::worker, this));
+	}
+}
+
+void ImportPrefetcher::worker()
+{
+	while (1) {
+		size_t idx;
+		{
+			boost::mutex::scoped_lock lock(this->mutex);
+			if (this->next_task >= this->tasks.size()) return;
+			idx = this->next_task++;
+		}
+		const ImportNode *node = this->tasks[idx].first;
+		const std::string &key = this->tasks[idx].second;
+
+		shared_ptr<const Geometry> geom(node->createGeometry());
+		// 2D imports get the same cleanup the evaluator would apply
+		if (const Polygon2d *polygon = dynamic_cast<const Polygon2d *>(geom.get())) {
+			if (!polygon->isSanitized()) geom.reset(ClipperUtils::sanitize(*polygon));
+		}
+		GeometryCache::instance()->insert(key, geom);
+		{
+			boost::mutex::scoped_lock lock(this->mutex);
+			this->results[key] = geom;
+		}
+		this->done_cond.notify_all();
+	}
+}
+
+shared_ptr<const Geometry> ImportPrefetcher::fetch(const AbstractNode &node)
+{
+	shared_ptr<const Geometry> geom;
+	if (!dynamic_cast<const ImportNode *>(&node)) return geom;
+	const std::string &key = this->tree.getIdHash(node);
+	boost::mutex::scoped_lock lock(this->mutex);
+	std::map<std::string, shared_ptr<const Geometry> >::iterator it =
+		this->results.find(key);
+	if (it == this->results.end()) return geom;
+	while (!it->second) this->done_cond.wait(lock);
+	return it->second;
+}
+
+void ImportPrefetcher::finish()
+{
+	this->workers.join_all();
+}
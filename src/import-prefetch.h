@@ -0,0 +1,54 @@
+#pragma once
+
+#include "memory.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/thread.hpp>
+
+/*!
+	Evaluates all ImportNodes of a tree on a worker pool so file I/O and
+	parsing overlap with the CSG evaluation of everything else. Import
+	results don't depend on evaluation order, so they can be computed as
+	soon as the tree is instantiated; finished geometries are parked in
+	the GeometryCache under the node's id hash, where the evaluator picks
+	them up through its normal cache lookup. fetch() bridges the race
+	where the evaluator reaches an import before its worker is done.
+
+	Enabled by the import-prefetch feature.
+*/
+class ImportPrefetcher
+{
+public:
+	ImportPrefetcher(const class Tree &tree) : tree(tree), next_task(0) {}
+	~ImportPrefetcher() { finish(); }
+
+	//! Collects the uncached ImportNodes below root and starts the workers
+	void start(const class AbstractNode &root);
+	//! Waits for the remaining workers; also run by the destructor
+	void finish();
+	/*!
+		Returns the node's imported geometry, waiting for its worker if the
+		import is still in flight. Returns NULL if this prefetcher didn't
+		claim the node (not an import, already cached at start(), or the
+		feature is off) - the caller then evaluates it as usual.
+	*/
+	shared_ptr<const class Geometry> fetch(const class AbstractNode &node);
+
+private:
+	void collect(const class AbstractNode &node);
+	void worker();
+
+	const class Tree &tree;
+	//! (node, id hash) per claim; hashes are precomputed on the main
+	//! thread since Tree's hash cache isn't safe to fill concurrently
+	std::vector<std::pair<const class ImportNode *, std::string> > tasks;
+	size_t next_task;
+	//! One entry per claimed id hash; NULL until the import finishes
+	std::map<std::string, shared_ptr<const class Geometry> > results;
+	boost::mutex mutex;
+	boost::condition_variable done_cond;
+	boost::thread_group workers;
+};
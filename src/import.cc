@@ -33,8 +33,12 @@
 #include "builtin.h"
 #include "dxfdata.h"
 #include "printutils.h"
+#include "polyset-utils.h"
+#include "feature.h"
 #include "fileutils.h"
+#include "scan-utils.h"
 #include "handle_dep.h" // handle_dep()
+#include "lodepng.h" // raw inflate for 3MF zip entries
 
 #ifdef ENABLE_CGAL
 #include "cgalutils.h"
@@ -44,7 +48,10 @@
 #include <fstream>
 #include <sstream>
 #include <assert.h>
+#include <stdlib.h>
+#include <boost/uuid/sha1.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
@@ -56,6 +63,14 @@ using namespace boost::assign; // bring 'operator+=()' into scope
 #include <boost/detail/endian.hpp>
 #include <boost/cstdint.hpp>
 
+#if !defined(_WIN32) && !defined(WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_MMAP_IMPORT
+#endif
+
 class ImportModule : public AbstractModule
 {
 public:
@@ -105,6 +120,8 @@ AbstractNode *ImportModule::instantiate(const Context *ctx, const ModuleInstanti
 		std::string ext = boost::algorithm::to_lower_copy( extraw );
 		if (ext == ".stl") actualtype = TYPE_STL;
 		else if (ext == ".off") actualtype = TYPE_OFF;
+		else if (ext == ".ply") actualtype = TYPE_PLY;
+		else if (ext == ".3mf") actualtype = TYPE_3MF;
 		else if (ext == ".dxf") actualtype = TYPE_DXF;
 	}
 
@@ -182,6 +199,861 @@ void read_stl_facet( std::ifstream &f, stl_facet &facet )
 #endif
 }
 
+/*!
+	Appends the given in-memory 50-byte facet records to the PolySet.
+	The records are unaligned within the mapping, so each one is copied
+	into a properly aligned facet before its floats are read.
+*/
+static void append_stl_facets(const uint8_t *records, uint32_t facenum, PolySet &ps)
+{
+	ps.polygons.reserve(ps.polygons.size() + facenum);
+	stl_facet facet;
+	for (uint32_t i = 0; i < facenum; i++) {
+		memcpy(facet.data8, records + 50*i, STL_FACET_NUMBYTES);
+#ifdef BOOST_BIG_ENDIAN
+		for (int v = 0; v < 12; v++) uint32_byte_swap(facet.data32[v]);
+#endif
+		ps.append_poly(3);
+		ps.append_vertex(facet.data.x1, facet.data.y1, facet.data.z1);
+		ps.append_vertex(facet.data.x2, facet.data.y2, facet.data.z2);
+		ps.append_vertex(facet.data.x3, facet.data.y3, facet.data.z3);
+	}
+}
+
+/*!
+	Imports a binary STL by mapping the whole file and parsing the facet
+	records in place, avoiding the per-facet read calls of the stream path.
+	Returns false if the file couldn't be mapped, in which case the caller
+	falls back to stream reads.
+*/
+static bool import_stl_binary_mmap(const std::string &filename, uint32_t facenum, PolySet &ps)
+{
+#ifdef HAVE_MMAP_IMPORT
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	const size_t length = 80 + 4 + 50*(size_t)facenum;
+	void *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return false;
+
+	append_stl_facets((const uint8_t *)data + 80 + 4, facenum, ps);
+	munmap(data, length);
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+/*!
+	Imports an ascii STL by mapping the whole file and scanning the vertex
+	lines in place with ScanUtils, avoiding the per-line regex matches and
+	lexical_casts of the stream path. Returns false if the file couldn't
+	be mapped, in which case the caller falls back to stream reads.
+*/
+static bool import_stl_ascii_mmap(const std::string &filename, PolySet &ps)
+{
+#ifdef HAVE_MMAP_IMPORT
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+	const size_t length = st.st_size;
+	void *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return false;
+
+	const char *p = (const char *)data;
+	const char *end = p + length;
+	int i = 0;
+	double vdata[3][3];
+	p = ScanUtils::next_line(p, end); // the "solid ..." header
+	while (p != end) {
+		const char *line = p;
+		p = ScanUtils::next_line(p, end);
+		ScanUtils::skip_space(line, p);
+		if (p - line >= 10 && !memcmp(line, "outer loop", 10)) {
+			i = 0;
+			continue;
+		}
+		if (p - line >= 6 && !memcmp(line, "vertex", 6)) {
+			const char *cursor = line + 6;
+			double tmp[3];
+			bool ok = true;
+			for (int v = 0; v < 3; v++) {
+				if (!ScanUtils::scan_double(cursor, p, tmp[v])) {
+					ok = false;
+					break;
+				}
+			}
+			if (!ok) {
+				size_t linelen = p - line;
+				while (linelen > 0 && (line[linelen-1] == '\n' || line[linelen-1] == '\r')) linelen--;
+				PRINTB("WARNING: Can't parse vertex line '%s'.", std::string(line, linelen));
+				i = 10;
+				continue;
+			}
+			if (i < 3) {
+				vdata[i][0] = tmp[0];
+				vdata[i][1] = tmp[1];
+				vdata[i][2] = tmp[2];
+			}
+			if (++i == 3) {
+				ps.append_poly(3);
+				ps.append_vertex(vdata[0][0], vdata[0][1], vdata[0][2]);
+				ps.append_vertex(vdata[1][0], vdata[1][1], vdata[1][2]);
+				ps.append_vertex(vdata[2][0], vdata[2][1], vdata[2][2]);
+			}
+		}
+	}
+	munmap(data, length);
+	// The facet count wasn't known up front, so give back the slack
+	// left by the doubling growth
+	ps.compact();
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+/*
+ * PLY import
+ */
+
+// PLY scalar type codes, indexing ply_type_sizes
+enum {
+	PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16,
+	PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64
+};
+
+static const size_t ply_type_sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+static int ply_type(const std::string &name)
+{
+	if (name == "char" || name == "int8") return PLY_INT8;
+	if (name == "uchar" || name == "uint8") return PLY_UINT8;
+	if (name == "short" || name == "int16") return PLY_INT16;
+	if (name == "ushort" || name == "uint16") return PLY_UINT16;
+	if (name == "int" || name == "int32") return PLY_INT32;
+	if (name == "uint" || name == "uint32") return PLY_UINT32;
+	if (name == "float" || name == "float32") return PLY_FLOAT32;
+	if (name == "double" || name == "float64") return PLY_FLOAT64;
+	return -1;
+}
+
+// One property of a PLY element; counttype is -1 for scalars, else the
+// type of the list length prefix
+struct ply_property {
+	std::string name;
+	int type;
+	int counttype;
+};
+
+struct ply_element {
+	std::string name;
+	size_t count;
+	std::vector<ply_property> properties;
+};
+
+static void uint64_byte_swap(uint64_t &x)
+{
+#if __GNUC__ >= 4 && __GNUC_MINOR__ >= 3
+	x = __builtin_bswap64(x);
+#elif defined(__clang__)
+	x = __builtin_bswap64(x);
+#elif defined(_MSC_VER)
+	x = _byteswap_uint64(x);
+#else
+	uint32_t hi = (uint32_t)(x >> 32), lo = (uint32_t)x;
+	uint32_byte_swap(hi);
+	uint32_byte_swap(lo);
+	x = ((uint64_t)lo << 32) | hi;
+#endif
+}
+
+/*!
+	Pulls successive property values out of a PLY body, hiding whether
+	the body is ascii text or packed binary records. The binary reader
+	walks a pointer over the (possibly mapped) file in place; nothing is
+	copied besides the value being decoded.
+*/
+class PlyValueReader
+{
+public:
+	PlyValueReader(std::istream &stream)
+		: f(&stream), data(NULL), end(NULL), bigendian(false), ok(true) { }
+	PlyValueReader(const uint8_t *data, const uint8_t *end, bool bigendian)
+		: f(NULL), data(data), end(end), bigendian(bigendian), ok(true) { }
+
+	bool good() const { return this->ok; }
+
+	double next(int type)
+	{
+		if (!this->ok) return 0;
+		if (this->f) {
+			double d = 0;
+			if (!(*this->f >> d)) this->ok = false;
+			return d;
+		}
+		size_t size = ply_type_sizes[type];
+		if (this->data + size > this->end) {
+			this->ok = false;
+			return 0;
+		}
+		double d = 0;
+		switch (type) {
+		case PLY_INT8: d = *(const int8_t *)this->data; break;
+		case PLY_UINT8: d = *this->data; break;
+		case PLY_INT16: case PLY_UINT16: {
+			uint16_t u;
+			memcpy(&u, this->data, 2);
+			if (this->bigendian) u = (u >> 8) | (u << 8);
+			d = type == PLY_INT16 ? (double)(int16_t)u : (double)u;
+			break;
+		}
+		case PLY_INT32: case PLY_UINT32: case PLY_FLOAT32: {
+			uint32_t u;
+			memcpy(&u, this->data, 4);
+			if (this->bigendian) uint32_byte_swap(u);
+			if (type == PLY_FLOAT32) {
+				float fl;
+				memcpy(&fl, &u, 4);
+				d = fl;
+			}
+			else d = type == PLY_INT32 ? (double)(int32_t)u : (double)u;
+			break;
+		}
+		case PLY_FLOAT64: {
+			uint64_t u;
+			memcpy(&u, this->data, 8);
+			if (this->bigendian) uint64_byte_swap(u);
+			memcpy(&d, &u, 8);
+			break;
+		}
+		}
+		this->data += size;
+		return d;
+	}
+
+private:
+	std::istream *f;
+	const uint8_t *data;
+	const uint8_t *end;
+	bool bigendian;
+	bool ok;
+};
+
+/*!
+	Imports an ascii or binary PLY file. The vertex element is read once
+	into an index array which the faces reference, so a vertex shared by
+	many faces is decoded and stored a single time - unlike STL, which
+	repeats it per facet. Binary bodies are mapped and decoded in place
+	where mmap is available. Unknown elements and properties are skipped
+	by walking their declared layout. Returns false on malformed input;
+	whatever was appended to ps before the error is kept.
+*/
+static bool import_ply(const std::string &filename, PolySet &ps)
+{
+	std::ifstream f(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!f.good()) {
+		PRINTB("WARNING: Can't open import file '%s'.", filename);
+		return false;
+	}
+
+	std::string line;
+	std::getline(f, line);
+	boost::trim(line);
+	if (line != "ply") {
+		PRINTB("WARNING: '%s' is not a PLY file.", filename);
+		return false;
+	}
+
+	bool ascii = false, bigendian = false, have_format = false;
+	std::vector<ply_element> elements;
+	while (std::getline(f, line)) {
+		boost::trim(line);
+		std::istringstream ls(line);
+		std::string keyword;
+		ls >> keyword;
+		if (keyword == "comment" || keyword == "obj_info" || keyword.empty()) continue;
+		if (keyword == "end_header") break;
+		if (keyword == "format") {
+			std::string fmt;
+			ls >> fmt;
+			if (fmt == "ascii") ascii = true;
+			else if (fmt == "binary_little_endian") bigendian = false;
+			else if (fmt == "binary_big_endian") bigendian = true;
+			else {
+				PRINTB("WARNING: Unsupported PLY format '%s' in '%s'.", fmt % filename);
+				return false;
+			}
+			have_format = true;
+		}
+		else if (keyword == "element") {
+			ply_element element;
+			element.count = 0;
+			ls >> element.name >> element.count;
+			elements.push_back(element);
+		}
+		else if (keyword == "property") {
+			if (elements.empty()) continue;
+			ply_property property;
+			property.counttype = -1;
+			std::string type;
+			ls >> type;
+			if (type == "list") {
+				std::string counttype, membertype;
+				ls >> counttype >> membertype;
+				property.counttype = ply_type(counttype);
+				property.type = ply_type(membertype);
+				if (property.counttype < 0) property.type = -1;
+			}
+			else {
+				property.type = ply_type(type);
+			}
+			ls >> property.name;
+			if (property.type < 0) {
+				PRINTB("WARNING: Unknown PLY property type in '%s': %s", filename % line);
+				return false;
+			}
+			elements.back().properties.push_back(property);
+		}
+	}
+	if (!have_format || !f.good()) {
+		PRINTB("WARNING: Malformed PLY header in '%s'.", filename);
+		return false;
+	}
+
+	// Map or slurp the body for the binary formats; ascii keeps reading
+	// the stream
+	const uint8_t *body = NULL, *bodyend = NULL;
+	std::vector<uint8_t> bodybuffer;
+	void *mapping = NULL;
+	size_t mappinglength = 0;
+	size_t bodyoffset = f.tellg();
+	if (!ascii) {
+#ifdef HAVE_MMAP_IMPORT
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd >= 0) {
+			struct stat st;
+			if (fstat(fd, &st) == 0 && (size_t)st.st_size > bodyoffset) {
+				mappinglength = st.st_size;
+				mapping = mmap(NULL, mappinglength, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (mapping == MAP_FAILED) mapping = NULL;
+			}
+			close(fd);
+		}
+#endif
+		if (mapping) {
+			body = (const uint8_t *)mapping + bodyoffset;
+			bodyend = (const uint8_t *)mapping + mappinglength;
+		}
+		else {
+			f.seekg(0, std::ios::end);
+			size_t bodysize = (size_t)f.tellg() - bodyoffset;
+			f.seekg(bodyoffset);
+			bodybuffer.resize(bodysize);
+			if (bodysize) f.read((char *)&bodybuffer[0], bodysize);
+			body = bodybuffer.empty() ? NULL : &bodybuffer[0];
+			bodyend = body + bodybuffer.size();
+		}
+	}
+	PlyValueReader reader = ascii ? PlyValueReader(f) : PlyValueReader(body, bodyend, bigendian);
+
+	std::vector<Vector3d> vertices;
+	bool result = true;
+	BOOST_FOREACH(const ply_element &element, elements) {
+		int xprop = -1, yprop = -1, zprop = -1;
+		if (element.name == "vertex") {
+			for (size_t i = 0; i < element.properties.size(); i++) {
+				if (element.properties[i].name == "x") xprop = i;
+				else if (element.properties[i].name == "y") yprop = i;
+				else if (element.properties[i].name == "z") zprop = i;
+			}
+			if (xprop < 0 || yprop < 0 || zprop < 0) {
+				PRINTB("WARNING: PLY vertex element in '%s' lacks x/y/z properties.", filename);
+				return false;
+			}
+			vertices.reserve(element.count);
+		}
+		else if (element.name == "face") {
+			ps.polygons.reserve(ps.polygons.size() + element.count);
+		}
+
+		for (size_t i = 0; i < element.count && reader.good(); i++) {
+			Vector3d v(0, 0, 0);
+			for (size_t j = 0; j < element.properties.size(); j++) {
+				const ply_property &property = element.properties[j];
+				if (property.counttype >= 0) {
+					size_t listlen = (size_t)reader.next(property.counttype);
+					bool isindices = element.name == "face" &&
+						(property.name == "vertex_indices" || property.name == "vertex_index");
+					bool valid = isindices && listlen >= 3;
+					if (valid) ps.append_poly(listlen);
+					for (size_t k = 0; k < listlen; k++) {
+						// Always decoded, even when discarded, to stay aligned
+						// with the record layout
+						size_t idx = (size_t)reader.next(property.type);
+						if (!isindices || listlen < 3) continue;
+						if (idx >= vertices.size()) {
+							if (valid) {
+								PRINTB("WARNING: PLY face in '%s' references missing vertex %d.", filename % idx);
+								result = false;
+							}
+							valid = false;
+							continue;
+						}
+						if (valid) ps.polygons.back().push_back(vertices[idx]);
+					}
+					if (isindices && listlen >= 3 && !valid) ps.polygons.pop_back();
+				}
+				else {
+					double value = reader.next(property.type);
+					if ((int)j == xprop) v[0] = value;
+					else if ((int)j == yprop) v[1] = value;
+					else if ((int)j == zprop) v[2] = value;
+				}
+			}
+			if (element.name == "vertex") vertices.push_back(v);
+		}
+	}
+	if (!reader.good()) {
+		PRINTB("WARNING: Premature end of PLY data in '%s'.", filename);
+		result = false;
+	}
+
+#ifdef HAVE_MMAP_IMPORT
+	if (mapping) munmap(mapping, mappinglength);
+#endif
+	return result;
+}
+
+
+#ifdef HAVE_MMAP_IMPORT
+// Advances p past whitespace (including newlines) and '#' comments
+static void off_skip(const char *&p, const char *end)
+{
+	while (p != end) {
+		if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+		else if (*p == '#') p = ScanUtils::next_line(p, end);
+		else break;
+	}
+}
+
+static bool off_scan_double(const char *&p, const char *end, double &result)
+{
+	off_skip(p, end);
+	return ScanUtils::scan_double(p, end, result);
+}
+#endif
+
+/*!
+	Imports an OFF file by mapping it and scanning the numbers in place
+	with ScanUtils, replacing the CGAL_Polyhedron stream extraction that
+	made multi-hundred-MB exchange files take minutes. The header counts
+	size the reservations up front, and like PLY the vertices are decoded
+	once into an index array which the faces reference. Per-vertex and
+	per-face extras (normals, colors) are skipped by line. Returns false
+	when the file can't be mapped or doesn't parse, in which case the
+	caller falls back to the stream reader.
+*/
+static bool import_off_mmap(const std::string &filename, PolySet &ps)
+{
+#ifdef HAVE_MMAP_IMPORT
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+	const size_t length = st.st_size;
+	void *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return false;
+
+	const char *p = (const char *)data;
+	const char *end = p + length;
+
+	// The signature line is optional; dimension and attribute variants
+	// (nOFF, COFF, ...) change the record layout, so only plain OFF is
+	// scanned here and everything else is left to the fallback
+	off_skip(p, end);
+	if (p != end && ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'))) {
+		const char *keyword = p;
+		while (p != end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+		if (p - keyword != 3 || memcmp(keyword, "OFF", 3) != 0) {
+			munmap(data, length);
+			return false;
+		}
+	}
+
+	double counts[3]; // vertices, faces, edges (ignored)
+	for (int i = 0; i < 3; i++) {
+		if (!off_scan_double(p, end, counts[i])) {
+			munmap(data, length);
+			return false;
+		}
+	}
+	if (counts[0] < 0 || counts[1] < 0 ||
+			counts[0] > (double)length || counts[1] > (double)length) {
+		munmap(data, length);
+		return false;
+	}
+	const size_t numvertices = (size_t)counts[0];
+	const size_t numfaces = (size_t)counts[1];
+
+	std::vector<Vector3d> vertices;
+	vertices.reserve(numvertices);
+	for (size_t i = 0; i < numvertices; i++) {
+		double c[3];
+		for (int j = 0; j < 3; j++) {
+			if (!off_scan_double(p, end, c[j])) {
+				PRINTB("WARNING: Premature end of OFF data in '%s'.", filename);
+				munmap(data, length);
+				return false;
+			}
+		}
+		vertices.push_back(Vector3d(c[0], c[1], c[2]));
+		p = ScanUtils::next_line(p, end); // possible color/normal extras
+	}
+
+	bool result = true;
+	ps.polygons.reserve(ps.polygons.size() + numfaces);
+	for (size_t i = 0; i < numfaces; i++) {
+		double d;
+		if (!off_scan_double(p, end, d)) {
+			PRINTB("WARNING: Premature end of OFF data in '%s'.", filename);
+			result = false;
+			break;
+		}
+		const size_t n = (size_t)d;
+		bool valid = n >= 3;
+		if (valid) ps.append_poly(n);
+		for (size_t k = 0; k < n; k++) {
+			if (!off_scan_double(p, end, d)) {
+				PRINTB("WARNING: Premature end of OFF data in '%s'.", filename);
+				result = false;
+				valid = false;
+				break;
+			}
+			const size_t idx = (size_t)d;
+			if (d < 0 || idx >= vertices.size()) {
+				if (valid) {
+					PRINTB("WARNING: OFF face in '%s' references missing vertex %d.", filename % idx);
+				}
+				valid = false;
+				continue;
+			}
+			if (valid) ps.polygons.back().push_back(vertices[idx]);
+		}
+		if (!valid && n >= 3) ps.polygons.pop_back();
+		if (!result) break;
+		p = ScanUtils::next_line(p, end); // possible color extras
+	}
+
+	munmap(data, length);
+	return result;
+#else
+	return false;
+#endif
+}
+
+/*
+ * 3MF import
+ */
+
+// Zip structures are little-endian; these read unaligned fields portably
+static uint16_t zip_read_u16(const uint8_t *p)
+{
+	return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t zip_read_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*!
+	Locates the model document inside a 3MF package (a zip archive) and
+	returns its uncompressed payload, or an empty vector on failure. The
+	entry is found through the central directory and inflated in one go
+	with the in-tree lodepng inflater, so no external zip library is
+	needed.
+*/
+static std::vector<uint8_t> read_3mf_model_entry(const std::vector<uint8_t> &zip, const std::string &filename)
+{
+	std::vector<uint8_t> payload;
+
+	// End-of-central-directory record: near the file end, behind a
+	// variable-length comment
+	size_t eocd = std::string::npos;
+	if (zip.size() >= 22) {
+		size_t scanlimit = zip.size() > 22 + 65535 ? zip.size() - (22 + 65535) : 0;
+		for (size_t i = zip.size() - 22; ; i--) {
+			if (zip_read_u32(&zip[i]) == 0x06054b50) {
+				eocd = i;
+				break;
+			}
+			if (i == scanlimit) break;
+		}
+	}
+	if (eocd == std::string::npos) {
+		PRINTB("WARNING: '%s' is not a zip archive.", filename);
+		return payload;
+	}
+
+	size_t entries = zip_read_u16(&zip[eocd + 10]);
+	size_t offset = zip_read_u32(&zip[eocd + 16]);
+	for (size_t i = 0; i < entries; i++) {
+		if (offset + 46 > zip.size() || zip_read_u32(&zip[offset]) != 0x02014b50) break;
+		uint16_t method = zip_read_u16(&zip[offset + 10]);
+		size_t csize = zip_read_u32(&zip[offset + 20]);
+		size_t usize = zip_read_u32(&zip[offset + 24]);
+		size_t namelen = zip_read_u16(&zip[offset + 28]);
+		size_t extralen = zip_read_u16(&zip[offset + 30]);
+		size_t commentlen = zip_read_u16(&zip[offset + 32]);
+		size_t localoffset = zip_read_u32(&zip[offset + 42]);
+		if (offset + 46 + namelen > zip.size()) break;
+		std::string name((const char *)&zip[offset + 46], namelen);
+		offset += 46 + namelen + extralen + commentlen;
+
+		// The payload is conventionally 3D/3dmodel.model, but only the
+		// extension is mandated
+		if (name.size() < 6 || name.substr(name.size() - 6) != ".model") continue;
+
+		if (localoffset + 30 > zip.size() || zip_read_u32(&zip[localoffset]) != 0x04034b50) break;
+		size_t datastart = localoffset + 30 +
+			zip_read_u16(&zip[localoffset + 26]) + zip_read_u16(&zip[localoffset + 28]);
+		if (datastart + csize > zip.size()) break;
+
+		if (method == 0) {
+			payload.assign(zip.begin() + datastart, zip.begin() + datastart + csize);
+		}
+		else if (method == 8) {
+			unsigned char *inflated = NULL;
+			size_t inflatedsize = 0;
+			unsigned error = lodepng_inflate(&inflated, &inflatedsize,
+																			 &zip[datastart], csize,
+																			 &lodepng_default_decompress_settings);
+			if (!error && inflatedsize == usize) {
+				payload.assign(inflated, inflated + inflatedsize);
+			}
+			free(inflated);
+		}
+		else {
+			PRINTB("WARNING: Unsupported zip compression method %d in '%s'.", method % filename);
+		}
+		return payload;
+	}
+	PRINTB("WARNING: No model document found in '%s'.", filename);
+	return payload;
+}
+
+/*!
+	Returns the numeric value of the given attribute within the tag
+	[tag, tagend), or 0 with found = false when absent.
+*/
+static double xml_attr_double(const char *tag, const char *tagend, const char *name, bool &found)
+{
+	size_t namelen = strlen(name);
+	for (const char *p = tag; p + namelen + 2 < tagend; p++) {
+		if (memcmp(p, name, namelen) != 0) continue;
+		if (p > tag && !isspace(p[-1])) continue;
+		const char *q = p + namelen;
+		while (q < tagend && isspace(*q)) q++;
+		if (q >= tagend || *q != '=') continue;
+		q++;
+		while (q < tagend && isspace(*q)) q++;
+		if (q >= tagend || (*q != '"' && *q != '\'')) continue;
+		found = true;
+		return strtod(q + 1, NULL);
+	}
+	found = false;
+	return 0;
+}
+
+/*!
+	Imports the meshes of a 3MF model. The package's model document is
+	extracted in memory and scanned tag by tag; a mesh's vertex list is
+	decoded once into an index array which its triangles reference, like
+	the PLY path. Build-item and component transforms are not applied -
+	every mesh is imported in its own coordinates. Returns false on
+	malformed input.
+*/
+static bool import_3mf(const std::string &filename, PolySet &ps)
+{
+	std::ifstream f(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!f.good()) {
+		PRINTB("WARNING: Can't open import file '%s'.", filename);
+		return false;
+	}
+	std::vector<uint8_t> zip((size_t)f.tellg());
+	f.seekg(0);
+	if (!zip.empty()) f.read((char *)&zip[0], zip.size());
+
+	std::vector<uint8_t> model = read_3mf_model_entry(zip, filename);
+	if (model.empty()) return false;
+
+	const char *p = (const char *)&model[0];
+	const char *end = p + model.size();
+	std::vector<Vector3d> vertices;
+	bool result = true;
+	while (p < end) {
+		const char *tag = (const char *)memchr(p, '<', end - p);
+		if (!tag) break;
+		const char *tagend = (const char *)memchr(tag, '>', end - tag);
+		if (!tagend) break;
+		p = tagend + 1;
+
+		if (tagend - tag >= 5 && memcmp(tag, "<mesh", 5) == 0 &&
+				(isspace(tag[5]) || tag[5] == '>' || tag[5] == '/')) {
+			// Triangle indices are local to their mesh
+			vertices.clear();
+		}
+		else if (tagend - tag >= 7 && memcmp(tag, "<vertex", 7) == 0 &&
+						 (isspace(tag[7]) || tag[7] == '/')) {
+			bool fx, fy, fz;
+			Vector3d v(xml_attr_double(tag, tagend, "x", fx),
+								 xml_attr_double(tag, tagend, "y", fy),
+								 xml_attr_double(tag, tagend, "z", fz));
+			if (!fx || !fy || !fz) {
+				PRINTB("WARNING: Malformed vertex in '%s'.", filename);
+				return false;
+			}
+			vertices.push_back(v);
+		}
+		else if (tagend - tag >= 9 && memcmp(tag, "<triangle", 9) == 0 &&
+						 (isspace(tag[9]) || tag[9] == '/')) {
+			bool f1, f2, f3;
+			size_t v1 = (size_t)xml_attr_double(tag, tagend, "v1", f1);
+			size_t v2 = (size_t)xml_attr_double(tag, tagend, "v2", f2);
+			size_t v3 = (size_t)xml_attr_double(tag, tagend, "v3", f3);
+			if (!f1 || !f2 || !f3 ||
+					v1 >= vertices.size() || v2 >= vertices.size() || v3 >= vertices.size()) {
+				PRINTB("WARNING: Malformed triangle in '%s'.", filename);
+				result = false;
+				continue;
+			}
+			ps.append_poly(3);
+			ps.polygons.back().push_back(vertices[v1]);
+			ps.polygons.back().push_back(vertices[v2]);
+			ps.polygons.back().push_back(vertices[v3]);
+		}
+	}
+	ps.compact();
+	return result;
+}
+
+/*!
+	Persistent import cache. The regular GeometryCache keys on the node
+	dump, which bakes in the file timestamp - a touch without a content
+	change invalidates it, and a fresh process always starts cold. Mesh
+	imports are additionally cached on disk keyed by a hash of the file
+	bytes plus the parameters that shape the result (convexity and the
+	repair feature flag), so unchanged vendor meshes parse once per
+	content, not once per process. The directory is shared with the CGAL
+	disk cache via OPENSCAD_CACHE_DIR and is likewise opt-in. DXF is
+	excluded: its result depends on $fn/$fs/$fa, layer and origin, and
+	2D parsing is cheap anyway.
+
+	Returns the cache filename for the given import, or an empty string
+	when the cache is disabled or the file is unreadable.
+*/
+static std::string import_cache_file(const std::string &filename, int convexity)
+{
+	const char *cachedir = getenv("OPENSCAD_CACHE_DIR");
+	if (!cachedir || !cachedir[0]) return std::string();
+
+	std::ifstream f(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!f.good()) return std::string();
+	boost::uuids::detail::sha1 sha;
+	char buf[65536];
+	while (f.good()) {
+		f.read(buf, sizeof(buf));
+		sha.process_bytes(buf, f.gcount());
+	}
+	unsigned int digest[5];
+	sha.get_digest(digest);
+	std::string hash;
+	for (int i=0;i<5;i++) hash += str(boost::format("%08x") % digest[i]);
+	return std::string(cachedir) + "/" + hash +
+		str(boost::format("-c%d%s") % convexity
+				% (Feature::ExperimentalImportRepair.is_enabled() ? "-r" : "")) + ".pset";
+}
+
+static const char import_cache_magic[8] = "OSPSET1";
+
+static bool load_cached_polyset(const std::string &cachefile, PolySet &ps)
+{
+	std::ifstream f(cachefile.c_str(), std::ios::in | std::ios::binary);
+	if (!f.good()) return false;
+
+	char magic[8];
+	f.read(magic, sizeof(magic));
+	if (!f.good() || memcmp(magic, import_cache_magic, sizeof(magic))) return false;
+	uint32_t numpoly = 0;
+	f.read(reinterpret_cast<char *>(&numpoly), sizeof(numpoly));
+	if (!f.good()) return false;
+
+	ps.polygons.reserve(numpoly);
+	for (uint32_t i = 0; i < numpoly; i++) {
+		uint32_t numv = 0;
+		f.read(reinterpret_cast<char *>(&numv), sizeof(numv));
+		if (!f.good() || numv > 0xffffff) {
+			// Truncated or corrupt entry; leave no partial polygons behind
+			ps.polygons.clear();
+			return false;
+		}
+		ps.append_poly(numv);
+		for (uint32_t j = 0; j < numv; j++) {
+			double v[3];
+			f.read(reinterpret_cast<char *>(v), sizeof(v));
+			if (!f.good()) {
+				ps.polygons.clear();
+				return false;
+			}
+			ps.append_vertex(v[0], v[1], v[2]);
+		}
+	}
+	return true;
+}
+
+/*!
+	Writes via a temporary file and rename so concurrent farm jobs never
+	see a partially written entry, like CGALCache::writeDiskEntry().
+*/
+static void save_cached_polyset(const std::string &cachefile, const PolySet &ps)
+{
+	boost::system::error_code ec;
+	fs::create_directories(fs::path(cachefile).parent_path(), ec);
+	if (fs::exists(fs::path(cachefile), ec)) return;
+
+	const std::string tmpfile = cachefile + "." + fs::unique_path("%%%%%%%%").string() + ".tmp";
+	std::ofstream f(tmpfile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!f.good()) return;
+	f.write(import_cache_magic, sizeof(import_cache_magic));
+	uint32_t numpoly = ps.polygons.size();
+	f.write(reinterpret_cast<const char *>(&numpoly), sizeof(numpoly));
+	for (size_t i = 0; i < ps.polygons.size(); i++) {
+		uint32_t numv = ps.polygons[i].size();
+		f.write(reinterpret_cast<const char *>(&numv), sizeof(numv));
+		for (size_t j = 0; j < numv; j++) {
+			double v[3] = { ps.polygons[i][j][0], ps.polygons[i][j][1], ps.polygons[i][j][2] };
+			f.write(reinterpret_cast<const char *>(v), sizeof(v));
+		}
+	}
+	const bool ok = f.good();
+	f.close();
+	if (ok) fs::rename(fs::path(tmpfile), fs::path(cachefile), ec);
+	if (!ok || ec) fs::remove(fs::path(tmpfile), ec);
+}
+
 /*!
 	Will return an empty geometry if the import failed, but not NULL
 */
@@ -195,6 +1067,12 @@ Geometry *ImportNode::createGeometry() const
 		g = p;
 
 		handle_dep((std::string)this->filename);
+		const std::string cachefile = import_cache_file(this->filename, this->convexity);
+		if (!cachefile.empty() && load_cached_polyset(cachefile, *p)) {
+			g->setConvexity(this->convexity);
+			p->maybeSpillToDisk();
+			return g;
+		}
 		// Open file and position at the end
 		std::ifstream f(this->filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
 		if (!f.good()) {
@@ -208,10 +1086,10 @@ Geometry *ImportNode::createGeometry() const
 		boost::regex ex_vertices("\\s*vertex\\s+([^\\s]+)\\s+([^\\s]+)\\s+([^\\s]+)");
 
 		bool binary = false;
+		uint32_t facenum = 0;
 		std::streampos file_size = f.tellg();
 		f.seekg(80);
 		if (f.good() && !f.eof()) {
-			uint32_t facenum = 0;
 			f.read((char *)&facenum, sizeof(uint32_t));
 #ifdef BOOST_BIG_ENDIAN
 			uint32_byte_swap( facenum );
@@ -225,73 +1103,138 @@ Geometry *ImportNode::createGeometry() const
 		char data[5];
 		f.read(data, 5);
 		if (!binary && !f.eof() && f.good() && !memcmp(data, "solid", 5)) {
-			int i = 0;
-			double vdata[3][3];
-			std::string line;
-			std::getline(f, line);
-			while (!f.eof()) {
+			if (!import_stl_ascii_mmap(this->filename, *p)) {
+				int i = 0;
+				double vdata[3][3];
+				std::string line;
 				std::getline(f, line);
-				boost::trim(line);
-				if (boost::regex_search(line, ex_sfe)) {
-					continue;
-				}
-				if (boost::regex_search(line, ex_outer)) {
-					i = 0;
-					continue;
-				}
-				boost::smatch results;
-				if (boost::regex_search(line, results, ex_vertices)) {
-					try {
-						for (int v=0;v<3;v++) {
-							vdata[i][v] = boost::lexical_cast<double>(results[v+1]);
-						}
+				while (!f.eof()) {
+					std::getline(f, line);
+					boost::trim(line);
+					if (boost::regex_search(line, ex_sfe)) {
+						continue;
 					}
-					catch (const boost::bad_lexical_cast &blc) {
-						PRINTB("WARNING: Can't parse vertex line '%s'.", line);
-						i = 10;
+					if (boost::regex_search(line, ex_outer)) {
+						i = 0;
 						continue;
 					}
-					if (++i == 3) {
-						p->append_poly();
-						p->append_vertex(vdata[0][0], vdata[0][1], vdata[0][2]);
-						p->append_vertex(vdata[1][0], vdata[1][1], vdata[1][2]);
-						p->append_vertex(vdata[2][0], vdata[2][1], vdata[2][2]);
+					boost::smatch results;
+					if (boost::regex_search(line, results, ex_vertices)) {
+						try {
+							for (int v=0;v<3;v++) {
+								vdata[i][v] = boost::lexical_cast<double>(results[v+1]);
+							}
+						}
+						catch (const boost::bad_lexical_cast &blc) {
+							PRINTB("WARNING: Can't parse vertex line '%s'.", line);
+							i = 10;
+							continue;
+						}
+						if (++i == 3) {
+							p->append_poly(3);
+							p->append_vertex(vdata[0][0], vdata[0][1], vdata[0][2]);
+							p->append_vertex(vdata[1][0], vdata[1][1], vdata[1][2]);
+							p->append_vertex(vdata[2][0], vdata[2][1], vdata[2][2]);
+						}
 					}
 				}
+				// The facet count wasn't known up front, so give back the slack
+				// left by the doubling growth
+				p->compact();
 			}
 		}
 		else if (binary && !f.eof() && f.good())
 		{
-			f.ignore(80-5+4);
-			while (1) {
-				stl_facet facet;
-				read_stl_facet( f, facet );
-				if (f.eof()) break;
-				p->append_poly();
-				p->append_vertex(facet.data.x1, facet.data.y1, facet.data.z1);
-				p->append_vertex(facet.data.x2, facet.data.y2, facet.data.z2);
-				p->append_vertex(facet.data.x3, facet.data.y3, facet.data.z3);
+			if (!import_stl_binary_mmap(this->filename, facenum, *p)) {
+				f.ignore(80-5+4);
+				p->polygons.reserve(facenum);
+				while (1) {
+					stl_facet facet;
+					read_stl_facet( f, facet );
+					if (f.eof()) break;
+					p->append_poly(3);
+					p->append_vertex(facet.data.x1, facet.data.y1, facet.data.z1);
+					p->append_vertex(facet.data.x2, facet.data.y2, facet.data.z2);
+					p->append_vertex(facet.data.x3, facet.data.y3, facet.data.z3);
+				}
 			}
 		}
+		// Scanner output often fails CGAL evaluation on cheap-to-fix
+		// defects; weld/reorient the mesh here while it is still a PolySet
+		if (Feature::ExperimentalImportRepair.is_enabled()) {
+			PolysetUtils::repair_mesh(*p);
+		}
+		if (!cachefile.empty()) save_cached_polyset(cachefile, *p);
+		// Metrology-grade scans can exceed RAM as boxed polygons; push
+		// them to file-backed storage and let consumers stream windows
+		p->maybeSpillToDisk();
 	}
 		break;
 	case TYPE_OFF: {
 		PolySet *p = new PolySet(3);
 		g = p;
-#ifdef ENABLE_CGAL
-		CGAL_Polyhedron poly;
-		std::ifstream file(this->filename.c_str(), std::ios::in | std::ios::binary);
-		if (!file.good()) {
-			PRINTB("WARNING: Can't open import file '%s'.", this->filename);
+		const std::string cachefile = import_cache_file(this->filename, this->convexity);
+		if (!cachefile.empty() && load_cached_polyset(cachefile, *p)) {
+			g->setConvexity(this->convexity);
+			return g;
 		}
-		else {
-			file >> poly;
-			file.close();
-			bool err = createPolySetFromPolyhedron(poly, *p);
+		// Single-pass scan of the mapped file; the stream reader below is
+		// the fallback when the file can't be mapped or parsed
+		if (import_off_mmap(this->filename, *p)) {
+			if (!cachefile.empty()) save_cached_polyset(cachefile, *p);
 		}
+		else {
+			p->polygons.clear();
+#ifdef ENABLE_CGAL
+			CGAL_Polyhedron poly;
+			std::ifstream file(this->filename.c_str(), std::ios::in | std::ios::binary);
+			if (!file.good()) {
+				PRINTB("WARNING: Can't open import file '%s'.", this->filename);
+			}
+			else {
+				file >> poly;
+				file.close();
+				bool err = createPolySetFromPolyhedron(poly, *p);
+				if (!err && !cachefile.empty()) save_cached_polyset(cachefile, *p);
+			}
 #else
-  PRINT("WARNING: OFF import requires CGAL.");
+			PRINT("WARNING: OFF import requires CGAL.");
 #endif
+		}
+	}
+		break;
+	case TYPE_PLY: {
+		PolySet *p = new PolySet(3);
+		g = p;
+		handle_dep((std::string)this->filename);
+		const std::string cachefile = import_cache_file(this->filename, this->convexity);
+		if (!cachefile.empty() && load_cached_polyset(cachefile, *p)) {
+			g->setConvexity(this->convexity);
+			return g;
+		}
+		if (import_ply(this->filename, *p)) {
+			if (Feature::ExperimentalImportRepair.is_enabled()) {
+				PolysetUtils::repair_mesh(*p);
+			}
+			if (!cachefile.empty()) save_cached_polyset(cachefile, *p);
+		}
+	}
+		break;
+	case TYPE_3MF: {
+		PolySet *p = new PolySet(3);
+		g = p;
+		handle_dep((std::string)this->filename);
+		const std::string cachefile = import_cache_file(this->filename, this->convexity);
+		if (!cachefile.empty() && load_cached_polyset(cachefile, *p)) {
+			g->setConvexity(this->convexity);
+			return g;
+		}
+		if (import_3mf(this->filename, *p)) {
+			if (Feature::ExperimentalImportRepair.is_enabled()) {
+				PolysetUtils::repair_mesh(*p);
+			}
+			if (!cachefile.empty()) save_cached_polyset(cachefile, *p);
+		}
 	}
 		break;
 	case TYPE_DXF: {
@@ -308,7 +1251,7 @@ Geometry *ImportNode::createGeometry() const
 	return g;
 }
 
-std::string ImportNode::toString() const
+std::string ImportNode::computeString() const
 {
 	std::stringstream stream;
 	fs::path path((std::string)this->filename);
@@ -8,6 +8,8 @@ enum import_type_e {
 	TYPE_UNKNOWN,
 	TYPE_STL,
 	TYPE_OFF,
+	TYPE_PLY,
+	TYPE_3MF,
 	TYPE_DXF
 };
 
@@ -18,8 +20,9 @@ public:
   virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const;
+	virtual AbstractNode *cloneNode() const { return new ImportNode(*this); }
 
 	import_type_e type;
 	Filename filename;
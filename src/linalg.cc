@@ -1,5 +1,6 @@
 #include "linalg.h"
 #include <boost/math/special_functions/fpclassify.hpp>
+#include <boost/functional/hash.hpp>
 
 // FIXME: We can achieve better pruning by either:
 // o Recalculate the box based on the transformed object
@@ -61,3 +62,12 @@ Vector3d getBoundingCenter(BoundingBox bbox)
   return center; // Vector3d(0,0,0);
 }
 
+
+namespace Eigen {
+	size_t hash_value(Vector3d const &v)
+	{
+		size_t seed = 0;
+		for (int i=0;i<3;i++) boost::hash_combine(seed, v[i]);
+		return seed;
+	}
+}
@@ -20,6 +20,11 @@ using Eigen::Matrix4d;
 bool matrix_contains_infinity( const Transform3d &m );
 bool matrix_contains_nan( const Transform3d &m );
 
+// Enables Vector3d to be used as key in boost::unordered_map et.al.
+namespace Eigen {
+	size_t hash_value(Vector3d const &v);
+}
+
 BoundingBox operator*(const Transform3d &m, const BoundingBox &box);
 Vector3d getBoundingCenter(BoundingBox bbox);
 double getBoundingRadius(BoundingBox bbox);
@@ -129,7 +129,7 @@ AbstractNode *LinearExtrudeModule::instantiate(const Context *ctx, const ModuleI
 	return node;
 }
 
-std::string LinearExtrudeNode::toString() const
+std::string LinearExtrudeNode::computeString() const
 {
 	std::stringstream stream;
 
@@ -17,8 +17,9 @@ public:
   virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const { return "linear_extrude"; }
+	virtual AbstractNode *cloneNode() const { return new LinearExtrudeNode(*this); }
 
 	int convexity, slices;
 	double fn, fs, fa, height, twist;
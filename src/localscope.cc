@@ -43,6 +43,17 @@ std::string LocalScope::dump(const std::string &indent) const
 }
 
 // FIXME: Two parameters here is a hack. Rather have separate types of scopes, or check the type of the first parameter. Note const vs. non-const
+/*!
+	Evaluates every child of this scope. Note that this runs for scopes
+	whose children are unconditionally consumed - builtin module bodies,
+	loop/if bodies, the body of a user module definition. The children
+	*passed to* a user module call are never instantiated here: they stay
+	as unevaluated ModuleInstantiations in the call's EvalContext, and
+	only the ones the module body actually references through children()
+	or child() get evaluated (see ControlModule::instantiate()). A
+	wrapper selecting one of N variant children therefore only pays for
+	the variant it picks.
+*/
 std::vector<AbstractNode*> LocalScope::instantiateChildren(const Context *evalctx, FileContext *filectx) const
 {
 	Context *c = filectx;
@@ -1594,7 +1594,8 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 
 /* /////////////////////////////////////////////////////////////////////////// */
 
-static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize)
+static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize,
+                                     unsigned is_final)
 {
   /*non compressed deflate block data: 1 bit BFINAL,2 bits BTYPE,(5 bits): it jumps to start of next byte,
   2 bytes LEN, 2 bytes NLEN, LEN bytes literal DATA*/
@@ -1606,7 +1607,7 @@ static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, s
     unsigned BFINAL, BTYPE, LEN, NLEN;
     unsigned char firstbyte;
 
-    BFINAL = (i == numdeflateblocks - 1);
+    BFINAL = (i == numdeflateblocks - 1) && is_final;
     BTYPE = 0;
 
     firstbyte = (unsigned char)(BFINAL + ((BTYPE & 1) << 1) + ((BTYPE & 2) << 1));
@@ -1959,7 +1960,7 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
 }
 
 static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings)
+                                 const LodePNGCompressSettings* settings, unsigned is_final)
 {
   unsigned error = 0;
   size_t i, blocksize, numdeflateblocks;
@@ -1967,7 +1968,7 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   Hash hash;
 
   if(settings->btype > 2) return 61;
-  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
+  else if(settings->btype == 0) return deflateNoCompression(out, in, insize, is_final);
   else if(settings->btype == 1) blocksize = insize;
   else /*if(settings->btype == 2)*/
   {
@@ -1983,7 +1984,7 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
 
   for(i = 0; i < numdeflateblocks && !error; i++)
   {
-    int final = i == numdeflateblocks - 1;
+    int final = (i == numdeflateblocks - 1) && is_final;
     size_t start = i * blocksize;
     size_t end = start + blocksize;
     if(end > insize) end = insize;
@@ -1992,6 +1993,20 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
     else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
   }
 
+  if(!error && !is_final)
+  {
+    /*byte-align with an empty stored block ("sync flush"), so the output of
+    the next part can simply be appended*/
+    addBitToStream(&bp, out, 0); /*BFINAL*/
+    addBitToStream(&bp, out, 0); /*BTYPE, first bit*/
+    addBitToStream(&bp, out, 0); /*BTYPE, second bit*/
+    while(bp & 7) addBitToStream(&bp, out, 0);
+    ucvector_push_back(out, 0); /*LEN*/
+    ucvector_push_back(out, 0);
+    ucvector_push_back(out, 255); /*NLEN*/
+    ucvector_push_back(out, 255);
+  }
+
   hash_cleanup(&hash);
 
   return error;
@@ -2004,7 +2019,21 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
   unsigned error;
   ucvector v;
   ucvector_init_buffer(&v, *out, *outsize);
-  error = lodepng_deflatev(&v, in, insize, settings);
+  error = lodepng_deflatev(&v, in, insize, settings, 1);
+  *out = v.data;
+  *outsize = v.size;
+  return error;
+}
+
+unsigned lodepng_deflate_part(unsigned char** out, size_t* outsize,
+                              const unsigned char* in, size_t insize,
+                              const LodePNGCompressSettings* settings,
+                              unsigned is_final)
+{
+  unsigned error;
+  ucvector v;
+  ucvector_init_buffer(&v, *out, *outsize);
+  error = lodepng_deflatev(&v, in, insize, settings, is_final);
   *out = v.data;
   *outsize = v.size;
   return error;
@@ -764,6 +764,17 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings);
 
+/*
+Same as lodepng_deflate, but for compressing one part of a larger stream. If
+is_final is 0, no block gets the BFINAL bit and the output is padded to a byte
+boundary with an empty stored block (a zlib "sync flush"), so the outputs of
+consecutive parts can simply be concatenated. The last part must set is_final.
+*/
+unsigned lodepng_deflate_part(unsigned char** out, size_t* outsize,
+                              const unsigned char* in, size_t insize,
+                              const LodePNGCompressSettings* settings,
+                              unsigned is_final);
+
 #endif /*LODEPNG_COMPILE_ENCODER*/
 #endif /*LODEPNG_COMPILE_ZLIB*/
 
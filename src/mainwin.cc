@@ -26,10 +26,16 @@
 
 #include "GeometryCache.h"
 #include "ModuleCache.h"
+#include "import-async.h"
+#include "cacheadvisor.h"
+#include "memorypressure.h"
+#include "fileutils.h"
 #include "MainWindow.h"
 #include "parsersettings.h"
 #include "Preferences.h"
 #include "printutils.h"
+#include "profiler.h"
+#include "nodearena.h"
 #include "node.h"
 #include "polyset.h"
 #include "csgterm.h"
@@ -85,6 +91,7 @@
 #include <boost/version.hpp>
 #include <boost/foreach.hpp>
 #include <sys/stat.h>
+#include <string.h>
 
 #ifdef ENABLE_CGAL
 
@@ -94,6 +101,7 @@
 #include "CGAL_Nef_polyhedron.h"
 #include "cgal.h"
 #include "cgalworker.h"
+#include "csgworker.h"
 #include "cgalutils.h"
 
 #else
@@ -177,23 +185,40 @@ MainWindow::MainWindow(const QString &filename)
 	if (!MainWindow::windows) MainWindow::windows = new QSet<MainWindow*>;
 	MainWindow::windows->insert(this);
 
+	// Keep per-module cost attribution on in the GUI so a slow compile
+	// names its costly modules in the console instead of needing a
+	// bisection session (see compileEnded())
+	Profiler::enableModuleAttribution();
+	CacheAdvisor::enable();
+
 #ifdef ENABLE_CGAL
 	this->cgalworker = new CGALWorker();
 	connect(this->cgalworker, SIGNAL(done(shared_ptr<const Geometry>)), 
 					this, SLOT(actionRenderDone(shared_ptr<const Geometry>)));
 #endif
 
+	this->csgworker = new CSGWorker(this);
+	connect(this->csgworker, SIGNAL(done()), this, SLOT(csgWorkerDone()));
+
 	top_ctx.registerBuiltin();
 
 	this->openglbox = NULL;
 	root_module = NULL;
 	absolute_root_node = NULL;
+	prev_absolute_root_node = NULL;
+	prev_root_node = NULL;
+	treeUnchanged = false;
 	this->root_chain = NULL;
 #ifdef ENABLE_CGAL
 	this->cgalRenderer = NULL;
+	this->stagedRenderer = NULL;
+	this->stagingTimer = new QTimer(this);
+	this->stagingTimer->setInterval(500);
+	connect(this->stagingTimer, SIGNAL(timeout()), this, SLOT(updateStagedRender()));
 #endif
 #ifdef ENABLE_OPENCSG
 	this->opencsgRenderer = NULL;
+	this->retainedCSGLists = NULL;
 #endif
 	this->thrownTogetherRenderer = NULL;
 
@@ -232,12 +257,26 @@ MainWindow::MainWindow(const QString &filename)
 	autoReloadTimer->setSingleShot(false);
 	autoReloadTimer->setInterval(200);
 	connect(autoReloadTimer, SIGNAL(timeout()), this, SLOT(checkAutoReload()));
+	compileTimingActive = false;
+
+	importArrivalTimer = new QTimer(this);
+	importArrivalTimer->setSingleShot(false);
+	importArrivalTimer->setInterval(500);
+	connect(importArrivalTimer, SIGNAL(timeout()), this, SLOT(checkImportArrivals()));
+	this->import_generation = 0;
 
 	waitAfterReloadTimer = new QTimer(this);
 	waitAfterReloadTimer->setSingleShot(true);
 	waitAfterReloadTimer->setInterval(200);
 	connect(waitAfterReloadTimer, SIGNAL(timeout()), this, SLOT(waitAfterReload()));
 
+	consoleDropped = 0;
+	consoleFlushScheduled = false;
+	consoleFlushTimer = new QTimer(this);
+	consoleFlushTimer->setSingleShot(true);
+	consoleFlushTimer->setInterval(50);
+	connect(consoleFlushTimer, SIGNAL(timeout()), this, SLOT(flushConsole()));
+
 	connect(this->e_tval, SIGNAL(textChanged(QString)), this, SLOT(actionRenderPreview()));
 	connect(this->e_fps, SIGNAL(textChanged(QString)), this, SLOT(updatedFps()));
 
@@ -360,6 +399,7 @@ MainWindow::MainWindow(const QString &filename)
 	connect(this->viewActionShowEdges, SIGNAL(triggered()), this, SLOT(viewModeShowEdges()));
 	connect(this->viewActionShowAxes, SIGNAL(triggered()), this, SLOT(viewModeShowAxes()));
 	connect(this->viewActionShowCrosshairs, SIGNAL(triggered()), this, SLOT(viewModeShowCrosshairs()));
+	connect(this->viewActionShowHud, SIGNAL(triggered()), this, SLOT(viewModeShowHud()));
 	connect(this->viewActionAnimate, SIGNAL(triggered()), this, SLOT(viewModeAnimate()));
 	connect(this->viewActionTop, SIGNAL(triggered()), this, SLOT(viewAngleTop()));
 	connect(this->viewActionBottom, SIGNAL(triggered()), this, SLOT(viewAngleBottom()));
@@ -480,6 +520,10 @@ MainWindow::loadViewSettings(){
 		viewActionShowCrosshairs->setChecked(true);
 		viewModeShowCrosshairs();
 	}
+	if (settings.value("view/showHud").toBool()) {
+		viewActionShowHud->setChecked(true);
+		viewModeShowHud();
+	}
 	if (settings.value("view/orthogonalProjection").toBool()) {
 		viewOrthogonal();
 	} else {
@@ -533,13 +577,16 @@ MainWindow::~MainWindow()
 {
 	if (root_module) delete root_module;
 	if (root_node) delete root_node;
+	if (prev_absolute_root_node) delete prev_absolute_root_node;
 	if (root_chain) delete root_chain;
 #ifdef ENABLE_CGAL
 	this->root_geom.reset();
 	delete this->cgalRenderer;
+	delete this->stagedRenderer;
 #endif
 #ifdef ENABLE_OPENCSG
 	delete this->opencsgRenderer;
+	delete this->retainedCSGLists;
 #endif
 	delete this->thrownTogetherRenderer;
 	MainWindow::windows->remove(this);
@@ -553,11 +600,15 @@ void MainWindow::showProgress()
 void MainWindow::report_func(const class AbstractNode*, void *vp, int mark)
 {
 	MainWindow *thisp = static_cast<MainWindow*>(vp);
-	int v = (int)((mark*1000.0) / progress_report_count);
+	// Weighted by the per-node-type cost history so one expensive tail
+	// union advances the bar proportionally to its predicted time
+	int v = progress_weighted_permille(mark);
 	int permille = v < 1000 ? v : 999;
 	if (permille > thisp->progresswidget->value()) {
 		QMetaObject::invokeMethod(thisp->progresswidget, "setValue", Qt::QueuedConnection,
 															Q_ARG(int, permille));
+		QMetaObject::invokeMethod(thisp->progresswidget, "setEta", Qt::QueuedConnection,
+															Q_ARG(int, (int)progress_eta_seconds(mark)));
 		QApplication::processEvents();
 	}
 
@@ -718,6 +769,7 @@ void MainWindow::refreshDocument()
 */
 void MainWindow::compile(bool reload, bool forcedone)
 {
+	this->compileElapsed.start();
 	bool shouldcompiletoplevel = false;
 	bool didcompile = false;
 
@@ -746,6 +798,13 @@ void MainWindow::compile(bool reload, bool forcedone)
 	}
 
 	if (shouldcompiletoplevel) {
+		// Batched messages from the previous run belong to the output
+		// being cleared, so drop them along with it
+		{
+			QMutexLocker lock(&this->consoleMutex);
+			this->consolePending.clear();
+			this->consoleDropped = 0;
+		}
 		console->clear();
 		if (editor->isContentModified()) saveBackup();
 		compileTopLevelDocument();
@@ -794,69 +853,177 @@ void MainWindow::waitAfterReload()
 
 void MainWindow::compileDone(bool didchange)
 {
-	const char *callslot;
+	this->procevents = false;
 	if (didchange) {
-		instantiateRoot();
-		callslot = afterCompileSlot;
+		// Real work is happening; compileEnded() records its duration
+		this->compileTimingActive = true;
+		// The old tree, CSG products and renderers stay up while the
+		// worker instantiates the new tree: a design whose instantiated
+		// tree hashes identically to the previous compile's keeps all of
+		// them (see restoreUnchangedTree()), anything else is torn down
+		// on this thread before the products are rebuilt.
+		stashPreviousTree();
+
+		this->progresswidget = new ProgressWidget(this);
+		connect(this->progresswidget, SIGNAL(requestShow()), this, SLOT(showProgress()));
+
+		// The full render path evaluates geometry itself, so the worker
+		// only needs CSG terms for the preview continuations
+		this->csgworker->start(strcmp(this->afterCompileSlot, "cgalRender") != 0);
 	}
 	else {
-		callslot = "compileEnded";
+		QMetaObject::invokeMethod(this, "compileEnded");
 	}
+}
 
-	this->procevents = false;
-	QMetaObject::invokeMethod(this, callslot);
+/*!
+	Resumes a compile on the GUI thread once CSGWorker has finished
+	instantiation and CSG term generation (or was cancelled).
+*/
+void MainWindow::csgWorkerDone()
+{
+	if (this->progresswidget) {
+		this->statusBar()->removeWidget(this->progresswidget);
+		delete this->progresswidget;
+		this->progresswidget = NULL;
+	}
+	QMetaObject::invokeMethod(this, this->afterCompileSlot);
 }
 
 void MainWindow::compileEnded()
 {
+	if (Profiler::moduleAttributionEnabled()) {
+		// Report and reset the per-module costs gathered since the last
+		// compile; recompiles that did no work have nothing to report
+		std::string modulereport = Profiler::moduleReport(20);
+		if (!modulereport.empty()) PRINT(modulereport);
+		Profiler::clearModules();
+	}
+	if (this->compileTimingActive) {
+		this->compileTimingActive = false;
+		this->compileDurations.push_back(this->compileElapsed.elapsed());
+		while (this->compileDurations.size() > 5) this->compileDurations.pop_front();
+		adjustAutoReloadInterval();
+	}
 	clearCurrentOutput();
 	GuiLocker::unlock();
 	if (designActionAutoReload->isChecked()) autoReloadTimer->start();
 }
 
-void MainWindow::instantiateRoot()
+/*!
+	Scales the auto-reload idle threshold to the measured cost of recent
+	compiles. With the fixed 200 ms tick, a model that compiles for 20
+	seconds was recompiled at every pause in typing and the editor spent
+	most of its time locked out. The threshold is a quarter of the recent
+	average compile time, so at most ~20% of wall time can go to compiles
+	the user immediately invalidates; cheap models keep the 200 ms floor
+	and the 5 s ceiling keeps even huge models reloading eventually.
+*/
+void MainWindow::adjustAutoReloadInterval()
+{
+	if (this->compileDurations.empty()) return;
+	qint64 sum = 0;
+	for (size_t i = 0; i < this->compileDurations.size(); i++) sum += this->compileDurations[i];
+	qint64 avg = sum / this->compileDurations.size();
+	int interval = (int)std::min((qint64)5000, std::max((qint64)200, avg / 4));
+	autoReloadTimer->setInterval(interval);
+}
+
+/*!
+	Detaches the previous compile's tree so the worker can instantiate
+	the new one next to it. Runs on the GUI thread before CSGWorker
+	starts; the renderers and CSG products stay alive and on screen,
+	since an unchanged design will keep them and a changed one tears
+	them down in discardPreviousCompile() afterwards.
+*/
+void MainWindow::stashPreviousTree()
 {
-	// Go on and instantiate root_node, then call the continuation slot
+	this->prev_absolute_root_node = this->absolute_root_node;
+	this->prev_root_node = this->root_node;
+	this->absolute_root_node = NULL;
+	this->root_node = NULL;
+	this->tree.setRoot(NULL);
+}
 
+/*!
+	Drops the previous compile's renderers, chains and tree once the
+	worker has confirmed the new tree differs. Runs on the GUI thread
+	before compileCSG() or the CGAL render rebuild their replacements.
+*/
+void MainWindow::discardPreviousCompile()
+{
   // Invalidate renderers before we kill the CSG tree
 	this->qglview->setRenderer(NULL);
+	this->qglview->setInteractionRenderer(NULL);
+	if (this->opencsgRenderer) {
+		// Carry the compiled display lists across the recompile so
+		// unchanged products re-attach to them instead of re-submitting
+		// their geometry (see OpenCSGRenderer::adoptLists())
+		delete this->retainedCSGLists;
+		this->retainedCSGLists = this->opencsgRenderer->retainLists();
+	}
 	delete this->opencsgRenderer;
 	this->opencsgRenderer = NULL;
 	delete this->thrownTogetherRenderer;
 	this->thrownTogetherRenderer = NULL;
 
-	// Remove previous CSG tree
-	delete this->absolute_root_node;
-	this->absolute_root_node = NULL;
-
-	this->root_raw_term.reset();
+	// The worker already replaced the raw terms; the rest of the
+	// previous compile's products goes here
 	this->root_norm_term.reset();
 
 	delete this->root_chain;
 	this->root_chain = NULL;
-
-	this->highlight_terms.clear();
 	delete this->highlights_chain;
 	this->highlights_chain = NULL;
-
-	this->background_terms.clear();
 	delete this->background_chain;
 	this->background_chain = NULL;
 
-	this->root_node = NULL;
-	this->tree.setRoot(NULL);
+	delete this->prev_absolute_root_node;
+	this->prev_absolute_root_node = NULL;
+	this->prev_root_node = NULL;
+}
+
+/*!
+	Reinstates the previous compile's tree after the worker found the
+	new one identical. The freshly instantiated duplicate is discarded;
+	the renderers were never detached, so the scene simply stays up and
+	every downstream stage is skipped.
+*/
+void MainWindow::restoreUnchangedTree()
+{
+	PRINT("Design unchanged; reusing the previous compile.");
+	delete this->absolute_root_node;
+	this->absolute_root_node = this->prev_absolute_root_node;
+	this->root_node = this->prev_root_node;
+	this->prev_absolute_root_node = NULL;
+	this->prev_root_node = NULL;
+	this->tree.setRoot(this->root_node);
+}
 
+/*!
+	Instantiates root_node from the parsed module. Runs on the CSG worker
+	thread; everything it touches was detached from the GUI by
+	stashPreviousTree() beforehand.
+*/
+void MainWindow::instantiateRootNode()
+{
 	if (this->root_module) {
 		// Evaluate CSG tree
 		PRINT("Compiling design (CSG Tree generation)...");
 		if (this->procevents) QApplication::processEvents();
 
 		AbstractNode::resetIndexCounter();
+		Module::clearInstantiationMemo();
+		CacheAdvisor::instance()->startCompile();
+		MemoryPressure::reset();
 
 		// split these two lines - gcc 4.7 bug
 		ModuleInstantiation mi = ModuleInstantiation( "group" );
 		this->root_inst = mi;
 
+		// The tree's nodes come out of one arena, which frees itself in a
+		// few block frees once the tree is torn down on the next recompile
+		NodeArena::Scope node_arena(new NodeArena());
 		this->absolute_root_node = this->root_module->instantiate(&top_ctx, &this->root_inst, NULL);
 
 		if (this->absolute_root_node) {
@@ -883,31 +1050,28 @@ void MainWindow::instantiateRoot()
 }
 
 /*!
-	Generates CSG tree for OpenCSG evaluation.
-	Assumes that the design has been parsed and evaluated (this->root_node is set)
+	Generates the CSG terms for OpenCSG evaluation. Runs on the CSG
+	worker thread; report_func already marshals progress updates to the
+	GUI over a queued connection, exactly as for the CGAL render.
 */
-void MainWindow::compileCSG(bool procevents)
+void MainWindow::compileCSGTerms()
 {
-	assert(this->root_node);
 	PRINT("Compiling design (CSG Products generation)...");
-	if (procevents) QApplication::processEvents();
-
-	// Main CSG evaluation
-	QTime t;
-	t.start();
-
-	this->progresswidget = new ProgressWidget(this);
-	connect(this->progresswidget, SIGNAL(requestShow()), this, SLOT(showProgress()));
 
 	progress_report_prep(this->root_node, report_func, this);
 	try {
 #ifdef ENABLE_CGAL
 		GeometryEvaluator geomevaluator(this->tree);
+		if (Feature::ExperimentalAsyncImport.is_enabled()) {
+			// Loads landing after this snapshot trigger a recompile from
+			// checkImportArrivals() instead of being waited for
+			this->import_generation = AsyncImportLoader::instance()->generation();
+			geomevaluator.setImportProxies(true);
+		}
 #else
 		// FIXME: Will we support this?
 #endif
 		CSGTermEvaluator csgrenderer(this->tree, &geomevaluator);
-		if (procevents) QApplication::processEvents();
 		this->root_raw_term = csgrenderer.evaluateCSGTerm(*root_node, highlight_terms, background_terms);
 		if (!root_raw_term) {
 			PRINT("ERROR: CSG generation failed! (no top level object found)");
@@ -916,15 +1080,61 @@ void MainWindow::compileCSG(bool procevents)
 #ifdef ENABLE_CGAL
 		CGALCache::instance()->print();
 #endif
-		if (procevents) QApplication::processEvents();
 	}
 	catch (const ProgressCancelException &e) {
 		PRINT("CSG generation cancelled.");
 	}
 	progress_report_fin();
-	this->statusBar()->removeWidget(this->progresswidget);
-	delete this->progresswidget;
-	this->progresswidget = NULL;
+}
+
+void MainWindow::instantiateAndCompileCSG(bool csgterms)
+{
+	this->treeUnchanged = false;
+	instantiateRootNode();
+	if (this->root_node) {
+		// Whitespace and comment edits, and reruns with identical -D
+		// values, instantiate an identical tree; when its hash matches
+		// the previous compile's and that compile's products are still
+		// around, everything downstream is skipped and reused
+		std::string treehash = this->tree.getIdHash(*this->root_node);
+		if (treehash == this->lastCompiledTreeHash && this->prev_root_node) {
+			bool reusable;
+			if (csgterms) {
+				// Placeholder products can't be reused once a pending
+				// import has landed - the recompile is what swaps it in
+				reusable = this->root_chain != NULL &&
+					(!Feature::ExperimentalAsyncImport.is_enabled() ||
+					 AsyncImportLoader::instance()->generation() == this->import_generation);
+			}
+			else {
+#ifdef ENABLE_CGAL
+				reusable = this->root_geom && this->cgalRenderer;
+#else
+				reusable = false;
+#endif
+			}
+			if (reusable) {
+				this->treeUnchanged = true;
+				return;
+			}
+		}
+		this->lastCompiledTreeHash = treehash;
+	}
+	else {
+		this->lastCompiledTreeHash.clear();
+	}
+	if (csgterms && this->root_node) compileCSGTerms();
+}
+
+/*!
+	Normalizes the CSG terms produced by the worker and builds the
+	preview renderers. Assumes instantiateAndCompileCSG() has run.
+*/
+void MainWindow::compileCSG(bool procevents)
+{
+	assert(this->root_node);
+	QTime t;
+	t.start();
 
 	if (root_raw_term) {
 		PRINT("Compiling design (CSG Products normalization)...");
@@ -981,9 +1191,21 @@ void MainWindow::compileCSG(bool procevents)
 																									this->background_chain,
 																									this->qglview->shaderinfo);
 		}
+		if (this->retainedCSGLists) {
+			if (this->opencsgRenderer) this->opencsgRenderer->adoptLists(this->retainedCSGLists);
+			delete this->retainedCSGLists;
+			this->retainedCSGLists = NULL;
+		}
 		this->thrownTogetherRenderer = new ThrownTogetherRenderer(this->root_chain,
 																															this->highlights_chain,
 																															this->background_chain);
+		// async-import: placeholder boxes may be on screen; poll for
+		// their loads landing and recompile to swap in the real meshes
+		if (Feature::ExperimentalAsyncImport.is_enabled() &&
+				(AsyncImportLoader::instance()->hasPending() ||
+				 AsyncImportLoader::instance()->generation() != this->import_generation)) {
+			this->importArrivalTimer->start();
+		}
 		PRINT("CSG generation finished.");
 		int s = t.elapsed() / 1000;
 		PRINTB("Total rendering time: %d hours, %d minutes, %d seconds", (s / (60*60)) % ((s / 60) % 60) % (s % 60));
@@ -1385,6 +1607,12 @@ bool MainWindow::fileChangedOnDisk()
 
 		if (newid != this->autoReloadId) {
 			this->autoReloadId = newid;
+			// mtime/size is only a pre-filter: git and build tools touch
+			// files without changing bytes, and a no-op touch shouldn't
+			// recompile the design
+			std::string newhash = hash_file_contents(this->fileName.toLocal8Bit().constData());
+			if (!newhash.empty() && newhash == this->autoReloadHash) return false;
+			this->autoReloadHash = newhash;
 			return true;
 		}
 	}
@@ -1399,7 +1627,18 @@ void MainWindow::compileTopLevelDocument()
 	updateTemporalVariables();
 	resetPrintedDeprecations();
 
-	this->last_compiled_doc = editor->toPlainText();
+	// An unchanged document parses to an unchanged module, so skip the
+	// flex/bison run and keep the existing root module, in the spirit
+	// of ModuleCache. Changed used/included files still force a
+	// recompile, and re-renders of a reused module hit the geometry
+	// caches for untouched subtrees.
+	QString current_doc = editor->toPlainText();
+	if (this->root_module && current_doc == this->last_compiled_doc &&
+			!this->root_module->includesChanged()) {
+		return;
+	}
+
+	this->last_compiled_doc = current_doc;
 	std::string fulltext =
 		std::string(this->last_compiled_doc.toLocal8Bit().constData()) +
 		"\n" + commandline_commands;
@@ -1427,7 +1666,7 @@ void MainWindow::autoReloadSet(bool on)
 	QSettings settings;
 	settings.setValue("design/autoReload",designActionAutoReload->isChecked());
 	if (on) {
-		autoReloadTimer->start(200);
+		autoReloadTimer->start(); // at the adaptive interval
 	} else {
 		autoReloadTimer->stop();
 	}
@@ -1451,7 +1690,12 @@ bool MainWindow::checkEditorModified()
 
 void MainWindow::actionReloadRenderPreview()
 {
-	if (GuiLocker::isLocked()) return;
+	if (GuiLocker::isLocked()) {
+		// A stale compile is still running on the worker; ask it to stop
+		// so the queued reload gets through without waiting for it
+		progress_request_cancel();
+		return;
+	}
 	GuiLocker::lock();
 	autoReloadTimer->stop();
 	setCurrentOutput();
@@ -1465,7 +1709,11 @@ void MainWindow::actionReloadRenderPreview()
 
 void MainWindow::csgReloadRender()
 {
-	if (this->root_node) compileCSG(true);
+	if (this->treeUnchanged) restoreUnchangedTree();
+	else {
+		discardPreviousCompile();
+		if (this->root_node) compileCSG(true);
+	}
 
 	// Go to non-CGAL view mode
 	if (viewActionThrownTogether->isChecked()) {
@@ -1483,7 +1731,12 @@ void MainWindow::csgReloadRender()
 
 void MainWindow::actionRenderPreview()
 {
-	if (GuiLocker::isLocked()) return;
+	if (GuiLocker::isLocked()) {
+		// A stale compile is still running on the worker; ask it to stop
+		// so the next auto-reload tick gets through without waiting
+		progress_request_cancel();
+		return;
+	}
 	GuiLocker::lock();
 	autoReloadTimer->stop();
 	setCurrentOutput();
@@ -1497,7 +1750,11 @@ void MainWindow::actionRenderPreview()
 
 void MainWindow::csgRender()
 {
-	if (this->root_node) compileCSG(!viewActionAnimate->isChecked());
+	if (this->treeUnchanged) restoreUnchangedTree();
+	else {
+		discardPreviousCompile();
+		if (this->root_node) compileCSG(!viewActionAnimate->isChecked());
+	}
 
 	// Go to non-CGAL view mode
 	if (viewActionThrownTogether->isChecked()) {
@@ -1523,6 +1780,25 @@ void MainWindow::csgRender()
 	compileEnded();
 }
 
+/*!
+	async-import: placeholder boxes are on screen while their files load
+	in the background. Each arrival lands in the GeometryCache and bumps
+	the loader generation; recompiling the preview swaps the real meshes
+	in for their placeholders. Runs on a timer so a burst of arrivals
+	within one interval costs a single recompile.
+*/
+void MainWindow::checkImportArrivals()
+{
+	AsyncImportLoader *loader = AsyncImportLoader::instance();
+	if (loader->generation() != this->import_generation) {
+		if (GuiLocker::isLocked()) return; // compile running; retry next tick
+		this->importArrivalTimer->stop(); // compileCSG() restarts it if needed
+		actionRenderPreview();
+		return;
+	}
+	if (!loader->hasPending()) this->importArrivalTimer->stop();
+}
+
 #ifdef ENABLE_CGAL
 
 void MainWindow::actionRender()
@@ -1541,12 +1817,22 @@ void MainWindow::actionRender()
 
 void MainWindow::cgalRender()
 {
+	if (this->treeUnchanged) {
+		restoreUnchangedTree();
+		// The existing CGALRenderer was never torn down; just show it
+		if (viewActionWireframe->isChecked()) viewModeWireframe();
+		else viewModeSurface();
+		compileEnded();
+		return;
+	}
+	discardPreviousCompile();
 	if (!this->root_module || !this->root_node) {
         compileEnded();
 		return;
 	}
 
 	this->qglview->setRenderer(NULL);
+	this->qglview->setInteractionRenderer(NULL);
 	delete this->cgalRenderer;
 	this->cgalRenderer = NULL;
 	this->root_geom.reset();
@@ -1558,13 +1844,40 @@ void MainWindow::cgalRender()
 
 	progress_report_prep(this->root_node, report_func, this);
 
+	if (Feature::ExperimentalProgressiveRender.is_enabled()) {
+		delete this->stagedRenderer;
+		this->stagedRenderer = new StagedCGALRenderer();
+		this->stagingTimer->start();
+	}
+
 	this->cgalworker->start(this->tree);
 }
 
+/*!
+	Timer tick during a full render: if new subtree geometries were staged
+	(see renderstaging.h), show them. The final viewModeSurface() switch
+	in actionRenderDone() replaces this renderer with the real one.
+*/
+void MainWindow::updateStagedRender()
+{
+	if (!this->stagedRenderer) return;
+	if (this->stagedRenderer->update()) {
+		this->qglview->setRenderer(this->stagedRenderer);
+		this->qglview->updateGL();
+	}
+}
+
 void MainWindow::actionRenderDone(shared_ptr<const Geometry> root_geom)
 {
 	progress_report_fin();
 
+	this->stagingTimer->stop();
+	if (this->stagedRenderer) {
+		this->qglview->setRenderer(NULL);
+		delete this->stagedRenderer;
+		this->stagedRenderer = NULL;
+	}
+
 	if (root_geom) {
 		GeometryCache::instance()->print();
 #ifdef ENABLE_CGAL
@@ -1600,6 +1913,9 @@ void MainWindow::actionRenderDone(shared_ptr<const Geometry> root_geom)
 		}
 		PRINT("Rendering finished.");
 
+		std::string advice = CacheAdvisor::instance()->finishCompile(this->tree);
+		if (!advice.empty()) PRINT(advice);
+
 		this->root_geom = root_geom;
 		this->cgalRenderer = new CGALRenderer(root_geom);
 		// Go to CGAL view mode
@@ -1911,6 +2227,9 @@ void MainWindow::viewModePreview()
 		viewModeActionsUncheck();
 		viewActionPreview->setChecked(true);
 		this->qglview->setRenderer(this->opencsgRenderer ? (Renderer *)this->opencsgRenderer : (Renderer *)this->thrownTogetherRenderer);
+		// Orbiting falls back to the single-pass throwntogether drawing
+		// while the mouse is down; full OpenCSG quality returns on release
+		this->qglview->setInteractionRenderer(this->opencsgRenderer ? (Renderer *)this->thrownTogetherRenderer : NULL);
 		this->qglview->updateGL();
 	} else {
 		viewModeThrownTogether();
@@ -1927,6 +2246,7 @@ void MainWindow::viewModeSurface()
 	viewActionSurfaces->setChecked(true);
 	this->qglview->setShowFaces(true);
 	this->qglview->setRenderer(this->cgalRenderer);
+	this->qglview->setInteractionRenderer(NULL);
 	this->qglview->updateGL();
 }
 
@@ -1936,6 +2256,7 @@ void MainWindow::viewModeWireframe()
 	viewActionWireframe->setChecked(true);
 	this->qglview->setShowFaces(false);
 	this->qglview->setRenderer(this->cgalRenderer);
+	this->qglview->setInteractionRenderer(NULL);
 	this->qglview->updateGL();
 }
 
@@ -1946,6 +2267,7 @@ void MainWindow::viewModeThrownTogether()
 	viewModeActionsUncheck();
 	viewActionThrownTogether->setChecked(true);
 	this->qglview->setRenderer(this->thrownTogetherRenderer);
+	this->qglview->setInteractionRenderer(NULL);
 	this->qglview->updateGL();
 }
 
@@ -1973,6 +2295,14 @@ void MainWindow::viewModeShowCrosshairs()
 	this->qglview->updateGL();
 }
 
+void MainWindow::viewModeShowHud()
+{
+	QSettings settings;
+	settings.setValue("view/showHud",viewActionShowHud->isChecked());
+	this->qglview->setShowHud(viewActionShowHud->isChecked());
+	this->qglview->updateGL();
+}
+
 void MainWindow::viewModeAnimate()
 {
 	if (viewActionAnimate->isChecked()) {
@@ -2292,16 +2622,59 @@ void MainWindow::quit()
 #endif
 }
 
+// Pending console messages beyond this count are dropped and summarized;
+// a flooding echo() loop shouldn't be able to pin the GUI.
+static const int MAX_PENDING_CONSOLE_MESSAGES = 10000;
+
 void MainWindow::consoleOutput(const std::string &msg, void *userdata)
 {
-	// Invoke the append function in the main thread in case the output
-  // originates in a worker thread.
+	// Messages may originate in worker threads, so they are collected
+	// under a lock and appended to the console widget in timed batches
+	// from the main thread. One widget update per batch keeps models
+	// that echo() thousands of lines from becoming repaint-bound.
 	MainWindow *thisp = static_cast<MainWindow*>(userdata);
-	QMetaObject::invokeMethod(thisp->console, "append", Qt::QueuedConnection,
-														Q_ARG(QString, QString::fromLocal8Bit(msg.c_str())));
+	bool schedule = false;
+	{
+		QMutexLocker lock(&thisp->consoleMutex);
+		if (thisp->consolePending.size() >= MAX_PENDING_CONSOLE_MESSAGES) {
+			thisp->consoleDropped++;
+		}
+		else {
+			thisp->consolePending.append(QString::fromLocal8Bit(msg.c_str()));
+		}
+		schedule = !thisp->consoleFlushScheduled;
+		thisp->consoleFlushScheduled = true;
+	}
+	if (schedule) {
+		QMetaObject::invokeMethod(thisp, "scheduleConsoleFlush", Qt::QueuedConnection);
+	}
 	if (thisp->procevents) QApplication::processEvents();
 }
 
+void MainWindow::scheduleConsoleFlush()
+{
+	if (!this->consoleFlushTimer->isActive()) this->consoleFlushTimer->start();
+}
+
+void MainWindow::flushConsole()
+{
+	QStringList pending;
+	unsigned int dropped;
+	{
+		QMutexLocker lock(&this->consoleMutex);
+		pending = this->consolePending;
+		this->consolePending.clear();
+		dropped = this->consoleDropped;
+		this->consoleDropped = 0;
+		this->consoleFlushScheduled = false;
+	}
+	if (pending.isEmpty() && !dropped) return;
+	if (dropped) {
+		pending.append(QString("... %1 message(s) dropped - console flooded ...").arg(dropped));
+	}
+	this->console->append(pending.join("\n"));
+}
+
 void MainWindow::setCurrentOutput()
 {
 	set_output_handler(&MainWindow::consoleOutput, this);
@@ -4,3 +4,4 @@
 using boost::shared_ptr;
 using boost::dynamic_pointer_cast;
 using boost::static_pointer_cast;
+using boost::const_pointer_cast;
@@ -0,0 +1,136 @@
+#include "memorypressure.h"
+#include "PlatformUtils.h"
+#include "GeometryCache.h"
+#ifdef ENABLE_CGAL
+#include "CGALCache.h"
+#endif
+#include "printutils.h"
+
+#include <stdlib.h>
+#include <boost/format.hpp>
+#include <boost/thread/mutex.hpp>
+
+// Fractions of the budget at which each response engages
+#define PRESSURE_TRIM_FRACTION 0.80
+#define PRESSURE_DEGRADE_FRACTION 0.90
+#define PRESSURE_FAIL_FRACTION 0.97
+// Sample RSS once per this many check() calls - reading it is a syscall
+#define PRESSURE_SAMPLE_INTERVAL 64
+// Tessellation never degrades below this fraction of the requested fragments
+#define PRESSURE_MIN_FRAGMENT_SCALE 0.25
+// Caches smaller than this are not worth shedding further
+#define PRESSURE_CACHE_FLOOR_BYTES (4*1024*1024)
+
+namespace {
+
+	size_t budgetbytes = 0;
+	bool budget_initialized = false;
+	// Read without the lock from the evaluator's hot path; writes are rare
+	volatile double fragment_scale = 1.0;
+	/*!
+		RSS high-water mark at the last subtree failure. Freed memory stays
+		mapped in the process but gets reused by the allocator, so RSS alone
+		would keep failing every subsequent subtree; requiring growth beyond
+		the last failure lets evaluation continue in the reclaimed space.
+	*/
+	size_t fail_floor = 0;
+	unsigned int calls = 0;
+	boost::mutex pressure_mutex;
+
+	void shed_caches(size_t rss, size_t budget)
+	{
+		size_t cachesize = GeometryCache::instance()->totalSize();
+		if (cachesize > PRESSURE_CACHE_FLOOR_BYTES) {
+			PRINTB("WARNING: Memory budget: resident size %d MB of %d MB, shedding geometry caches.",
+						 (rss >> 20) % (budget >> 20));
+			GeometryCache::instance()->shrinkTo(cachesize / 4);
+		}
+#ifdef ENABLE_CGAL
+		cachesize = CGALCache::instance()->totalSize();
+		if (cachesize > PRESSURE_CACHE_FLOOR_BYTES) {
+			CGALCache::instance()->shrinkTo(cachesize / 4);
+		}
+#endif
+	}
+}
+
+void MemoryPressure::setBudget(size_t bytes)
+{
+	budgetbytes = bytes;
+	budget_initialized = true;
+}
+
+size_t MemoryPressure::budget()
+{
+	if (!budget_initialized) {
+		budget_initialized = true;
+		const char *env = getenv("OPENSCAD_MEMORY_BUDGET_MB");
+		if (env && env[0]) {
+			budgetbytes = strtoul(env, NULL, 10) * 1024UL * 1024UL;
+		}
+	}
+	return budgetbytes;
+}
+
+bool MemoryPressure::enabled()
+{
+	return budget() > 0;
+}
+
+void MemoryPressure::reset()
+{
+	boost::mutex::scoped_lock lock(pressure_mutex);
+	fragment_scale = 1.0;
+	fail_floor = 0;
+	calls = 0;
+}
+
+double MemoryPressure::fragmentScale()
+{
+	return fragment_scale;
+}
+
+bool MemoryPressure::degraded()
+{
+	return fragment_scale < 1.0;
+}
+
+void MemoryPressure::check()
+{
+	if (!enabled()) return;
+	{
+		boost::mutex::scoped_lock lock(pressure_mutex);
+		if (++calls % PRESSURE_SAMPLE_INTERVAL) return;
+	}
+	const size_t rss = PlatformUtils::residentMemory();
+	if (!rss) return; // platform can't report it
+
+	const size_t budgetb = budget();
+	if (rss < (size_t)(budgetb * PRESSURE_TRIM_FRACTION)) return;
+
+	shed_caches(rss, budgetb);
+
+	if (rss >= (size_t)(budgetb * PRESSURE_DEGRADE_FRACTION)) {
+		boost::mutex::scoped_lock lock(pressure_mutex);
+		if (fragment_scale > PRESSURE_MIN_FRAGMENT_SCALE) {
+			fragment_scale = fmax(fragment_scale / 2, PRESSURE_MIN_FRAGMENT_SCALE);
+			PRINTB("WARNING: Memory budget: tessellating remaining curved surfaces at %d%% of the requested fragments.",
+						 (int)(fragment_scale * 100));
+		}
+	}
+
+	if (rss >= (size_t)(budgetb * PRESSURE_FAIL_FRACTION)) {
+		bool fail = false;
+		{
+			boost::mutex::scoped_lock lock(pressure_mutex);
+			if (rss >= fail_floor) {
+				fail_floor = rss;
+				fail = true;
+			}
+		}
+		if (fail) {
+			throw MemoryPressureException(str(boost::format(
+				"resident size %d MB of %d MB budget") % (rss >> 20) % (budgetb >> 20)));
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <stdexcept>
+
+/*!
+	Thrown by MemoryPressure::check() when the process has grown past the
+	failure threshold; the evaluator catches it at subtree boundaries and
+	substitutes empty geometry, so one oversized subtree fails instead of
+	the whole render. Everything evaluated before the failure stays in the
+	caches, making a rerun with a larger budget resume where this one
+	gave up.
+*/
+class MemoryPressureException : public std::runtime_error
+{
+public:
+	MemoryPressureException(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+/*!
+	RSS watchdog for geometry evaluation. A render that exceeds physical
+	memory dies to the OOM killer and loses everything; with a budget set
+	this class degrades the evaluation progressively instead. check() is
+	sampled from the evaluator's per-node paths and, as resident memory
+	approaches the budget, first sheds the geometry caches, then lowers
+	the fragment counts of the remaining curved primitives (see
+	Calc::get_fragments_from_r), and finally fails the offending subtree
+	by throwing MemoryPressureException.
+
+	The budget comes from setBudget() (--memory-budget on the command
+	line) or the OPENSCAD_MEMORY_BUDGET_MB environment variable; 0 (the
+	default) disables the watchdog. All state is process-global like the
+	caches it manages.
+*/
+class MemoryPressure
+{
+public:
+	static void setBudget(size_t bytes);
+	static size_t budget();
+	static bool enabled();
+
+	//! Call at the start of a compile: restores full tessellation and re-arms failure
+	static void reset();
+	/*!
+		Samples resident memory (rate limited) and escalates the response on
+		threshold crossings. Throws MemoryPressureException past the failure
+		threshold, so only call it from regions the evaluator guards.
+	*/
+	static void check();
+	//! 1.0 normally; halved per degradation step, multiplied into circle fragment counts
+	static double fragmentScale();
+	//! True once tessellation degradation is active; degraded geometry is not cached
+	static bool degraded();
+};
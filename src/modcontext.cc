@@ -92,12 +92,16 @@ void ModuleContext::registerBuiltin()
 	this->set_constant("PI",Value(M_PI));
 }
 
-const AbstractFunction *ModuleContext::findLocalFunction(const std::string &name) const
+const AbstractFunction *ModuleContext::findLocalFunction(const HashedName &name) const
 {
-	if (this->functions_p && this->functions_p->find(name) != this->functions_p->end()) {
-		AbstractFunction *f = this->functions_p->find(name)->second;
+	if (!this->functions_p) return NULL;
+	// Compatible-key find: reuses the hash interned in the AST node
+	LocalScope::FunctionContainer::const_iterator it =
+		this->functions_p->find(name, HashedNameHash(), HashedNameEqual());
+	if (it != this->functions_p->end()) {
+		AbstractFunction *f = it->second;
 		if (!f->is_enabled()) {
-			PRINTB("WARNING: Experimental builtin function '%s' is not enabled.", name);
+			PRINTB("WARNING: Experimental builtin function '%s' is not enabled.", name.name());
 			return NULL;
 		}
 		return f;
@@ -105,24 +109,27 @@ const AbstractFunction *ModuleContext::findLocalFunction(const std::string &name
 	return NULL;
 }
 
-const AbstractModule *ModuleContext::findLocalModule(const std::string &name) const
+const AbstractModule *ModuleContext::findLocalModule(const HashedName &name) const
 {
-	if (this->modules_p && this->modules_p->find(name) != this->modules_p->end()) {
-		AbstractModule *m = this->modules_p->find(name)->second;
+	if (!this->modules_p) return NULL;
+	LocalScope::AbstractModuleContainer::const_iterator it =
+		this->modules_p->find(name, HashedNameHash(), HashedNameEqual());
+	if (it != this->modules_p->end()) {
+		AbstractModule *m = it->second;
 		if (!m->is_enabled()) {
-			PRINTB("WARNING: Experimental builtin module '%s' is not enabled.", name);
+			PRINTB("WARNING: Experimental builtin module '%s' is not enabled.", name.name());
 			return NULL;
 		}
-		std::string replacement = Builtins::instance()->isDeprecated(name);
+		std::string replacement = Builtins::instance()->isDeprecated(name.name());
 		if (!replacement.empty()) {
-			PRINT_DEPRECATION("DEPRECATED: The %s() module will be removed in future releases. Use %s() instead.", name % replacement);
+			PRINT_DEPRECATION("DEPRECATED: The %s() module will be removed in future releases. Use %s() instead.", name.name() % replacement);
 		}
 		return m;
 	}
 	return NULL;
 }
 
-Value ModuleContext::evaluate_function(const std::string &name, const EvalContext *evalctx) const
+Value ModuleContext::evaluate_function(const HashedName &name, const EvalContext *evalctx) const
 {
 	const AbstractFunction *foundf = findLocalFunction(name);
 	if (foundf) return foundf->evaluate(this, evalctx);
@@ -132,7 +139,7 @@ Value ModuleContext::evaluate_function(const std::string &name, const EvalContex
 
 AbstractNode *ModuleContext::instantiate_module(const ModuleInstantiation &inst, const EvalContext *evalctx) const
 {
-	const AbstractModule *foundm = this->findLocalModule(inst.name());
+	const AbstractModule *foundm = this->findLocalModule(HashedName(inst.name(), inst.nameHash()));
 	if (foundm) return foundm->instantiate(this, &inst, evalctx);
 
 	return Context::instantiate_module(inst, evalctx);
@@ -177,7 +184,7 @@ FileContext::FileContext(const class FileModule &module, const Context *parent)
 	if (!module.modulePath().empty()) this->document_path = module.modulePath();
 }
 
-Value FileContext::sub_evaluate_function(const std::string &name, const EvalContext *evalctx,
+Value FileContext::sub_evaluate_function(const HashedName &name, const EvalContext *evalctx,
 
 	FileModule *usedmod) const
 
@@ -186,13 +193,13 @@ Value FileContext::sub_evaluate_function(const std::string &name, const EvalCont
 	ctx.initializeModule(*usedmod);
 	// FIXME: Set document path
 #ifdef DEBUG
-	PRINTDB("New lib Context for %s func:", name);
+	PRINTDB("New lib Context for %s func:", name.name());
 	PRINTDB("%s",ctx.dump(NULL, NULL));
 #endif
-	return usedmod->scope.functions[name]->evaluate(&ctx, evalctx);
+	return usedmod->scope.functions.find(name, HashedNameHash(), HashedNameEqual())->second->evaluate(&ctx, evalctx);
 }
 
-Value FileContext::evaluate_function(const std::string &name, const EvalContext *evalctx) const
+Value FileContext::evaluate_function(const HashedName &name, const EvalContext *evalctx) const
 {
 	const AbstractFunction *foundf = findLocalFunction(name);
 	if (foundf) return foundf->evaluate(this, evalctx);
@@ -200,7 +207,8 @@ Value FileContext::evaluate_function(const std::string &name, const EvalContext
 	BOOST_FOREACH(const FileModule::ModuleContainer::value_type &m, this->usedlibs) {
 		// usedmod is NULL if the library wasn't be compiled (error or file-not-found)
 		FileModule *usedmod = ModuleCache::instance()->lookup(m);
-		if (usedmod && usedmod->scope.functions.find(name) != usedmod->scope.functions.end())
+		if (usedmod &&
+				usedmod->scope.functions.find(name, HashedNameHash(), HashedNameEqual()) != usedmod->scope.functions.end())
 			return sub_evaluate_function(name, evalctx, usedmod);
 	}
 
@@ -209,14 +217,17 @@ Value FileContext::evaluate_function(const std::string &name, const EvalContext
 
 AbstractNode *FileContext::instantiate_module(const ModuleInstantiation &inst, const EvalContext *evalctx) const
 {
-	const AbstractModule *foundm = this->findLocalModule(inst.name());
+	const HashedName name(inst.name(), inst.nameHash());
+	const AbstractModule *foundm = this->findLocalModule(name);
 	if (foundm) return foundm->instantiate(this, &inst, evalctx);
 
 	BOOST_FOREACH(const FileModule::ModuleContainer::value_type &m, this->usedlibs) {
 		FileModule *usedmod = ModuleCache::instance()->lookup(m);
 		// usedmod is NULL if the library wasn't be compiled (error or file-not-found)
-		if (usedmod &&
-				usedmod->scope.modules.find(inst.name()) != usedmod->scope.modules.end()) {
+		if (!usedmod) continue;
+		LocalScope::AbstractModuleContainer::const_iterator it =
+			usedmod->scope.modules.find(name, HashedNameHash(), HashedNameEqual());
+		if (it != usedmod->scope.modules.end()) {
 			FileContext ctx(*usedmod, this->parent);
 			ctx.initializeModule(*usedmod);
 			// FIXME: Set document path
@@ -224,7 +235,7 @@ AbstractNode *FileContext::instantiate_module(const ModuleInstantiation &inst, c
 			PRINTD("New file Context:");
 			PRINTDB("%s",ctx.dump(NULL, &inst));
 #endif
-			return usedmod->scope.modules[inst.name()]->instantiate(&ctx, &inst, evalctx);
+			return it->second->instantiate(&ctx, &inst, evalctx);
 		}
 	}
 
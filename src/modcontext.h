@@ -18,13 +18,13 @@ public:
 
 	void initializeModule(const Module &m);
 	void registerBuiltin();
-	virtual Value evaluate_function(const std::string &name, 
+	virtual Value evaluate_function(const HashedName &name,
 																	const EvalContext *evalctx) const;
-	virtual AbstractNode *instantiate_module(const ModuleInstantiation &inst, 
+	virtual AbstractNode *instantiate_module(const ModuleInstantiation &inst,
 																					 const EvalContext *evalctx) const;
 
-	const AbstractModule *findLocalModule(const std::string &name) const;
-	const AbstractFunction *findLocalFunction(const std::string &name) const;
+	const AbstractModule *findLocalModule(const HashedName &name) const;
+	const AbstractFunction *findLocalFunction(const HashedName &name) const;
 
 	const LocalScope::FunctionContainer *functions_p;
 	const LocalScope::AbstractModuleContainer *modules_p;
@@ -45,13 +45,13 @@ class FileContext : public ModuleContext
 public:
 	FileContext(const class FileModule &module, const Context *parent);
 	virtual ~FileContext() {}
-	virtual Value evaluate_function(const std::string &name, const EvalContext *evalctx) const;
-	virtual AbstractNode *instantiate_module(const ModuleInstantiation &inst, 
+	virtual Value evaluate_function(const HashedName &name, const EvalContext *evalctx) const;
+	virtual AbstractNode *instantiate_module(const ModuleInstantiation &inst,
 																					 const EvalContext *evalctx) const;
 
 private:
 	const FileModule::ModuleContainer &usedlibs;
 
 	// This sub_* method is needed to minimize stack usage only.
-	Value sub_evaluate_function(const std::string &name, const EvalContext *evalctx, FileModule *usedmod) const;
+	Value sub_evaluate_function(const HashedName &name, const EvalContext *evalctx, FileModule *usedmod) const;
 };
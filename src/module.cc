@@ -33,10 +33,16 @@
 #include "function.h"
 #include "printutils.h"
 #include "parsersettings.h"
+#include "statcache.h"
+#include "profiler.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
 namespace fs = boost::filesystem;
 #include "boosty.h"
+#include "fileutils.h"
 #include "FontCache.h"
 #include <boost/foreach.hpp>
 #include <sstream>
@@ -145,6 +151,10 @@ std::string IfElseModuleInstantiation::dump(const std::string &indent) const
 
 AbstractNode *ModuleInstantiation::evaluate(const Context *ctx) const
 {
+	ModuleTimer timer(Profiler::moduleAttributionEnabled() ? this->modname : std::string(), false);
+	// All contexts created below us are released wholesale when this
+	// scope unwinds; see evalarena.h
+	EvalArena::Scope arena_scope;
 	EvalContext c(ctx, this->arguments, &this->scope);
 
 #if 0 && DEBUG
@@ -165,12 +175,33 @@ std::vector<AbstractNode*> IfElseModuleInstantiation::instantiateElseChildren(co
 	return this->else_scope.instantiateChildren(evalctx);
 }
 
-std::deque<std::string> Module::module_stack;
+std::deque<std::string> &Module::module_stack()
+{
+	static boost::thread_specific_ptr<std::deque<std::string> > stack;
+	if (!stack.get()) stack.reset(new std::deque<std::string>());
+	return *stack.get();
+}
 
 Module::~Module()
 {
 }
 
+namespace {
+	// Memoized results of childless user-module calls, keyed by module
+	// identity, evaluated arguments and visible special variables. The
+	// mutex matters because subtrees are instantiated on worker threads
+	// (see parallel-for in control.cc). Entries point into the tree being
+	// built, so the memo must be cleared before every compile.
+	boost::mutex memo_mutex;
+	boost::unordered_map<std::string, const AbstractNode *> instantiation_memo;
+}
+
+void Module::clearInstantiationMemo()
+{
+	boost::lock_guard<boost::mutex> lock(memo_mutex);
+	instantiation_memo.clear();
+}
+
 class ModRecursionGuard
 {
 public:
@@ -196,18 +227,69 @@ AbstractNode *Module::instantiate(const Context *ctx, const ModuleInstantiation
 	ModuleContext c(ctx, evalctx);
 	// set $children first since we might have variables depending on it
 	c.set_variable("$children", Value(double(inst->scope.children.size())));
-	module_stack.push_back(inst->name());
-	c.set_variable("$parent_modules", Value(double(module_stack.size())));
+	module_stack().push_back(inst->name());
+	c.set_variable("$parent_modules", Value(double(module_stack().size())));
 	c.initializeModule(*this);
 	// FIXME: Set document path to the path of the module
 #if 0 && DEBUG
 	c.dump(this, inst);
 #endif
 
+	// Identical childless calls - same module, same evaluated arguments,
+	// same visible $-variables - produce identical subtrees, so the body
+	// is instantiated once and later calls get clones of the result. A
+	// library part called hundreds of times with a handful of argument
+	// sets then costs a few body evaluations plus cheap node copies.
+	// Opt-in while experimental: a body with side effects (echo()) runs
+	// once instead of per call, rands() without a seed repeats its
+	// samples, and a body reading a non-argument variable from the
+	// calling scope may be shared too broadly.
+	std::string memokey;
+	if (Feature::ExperimentalModuleMemo.is_enabled() && inst->scope.children.empty()) {
+		// Values are keyed with Value::memoAppend() - exact and type
+		// tagged - so argument sets differing in type or beyond print
+		// precision never share a subtree
+		std::stringstream keybuf;
+		keybuf << this;
+		memokey = keybuf.str();
+		BOOST_FOREACH(const Assignment &arg, this->definition_arguments) {
+			memokey += "|" + arg.first + "=";
+			c.lookup_variable(arg.first, true).memoAppend(memokey);
+		}
+		std::map<std::string, Value> confvars;
+		c.collectConfigVariables(confvars);
+		for (std::map<std::string, Value>::const_iterator it = confvars.begin(); it != confvars.end(); ++it) {
+			memokey += "|" + it->first + "=";
+			it->second.memoAppend(memokey);
+		}
+		const AbstractNode *memoized = NULL;
+		{
+			boost::lock_guard<boost::mutex> lock(memo_mutex);
+			boost::unordered_map<std::string, const AbstractNode *>::const_iterator found = instantiation_memo.find(memokey);
+			if (found != instantiation_memo.end()) memoized = found->second;
+		}
+		if (memoized) {
+			AbstractNode *copy = memoized->cloneSubtree();
+			if (copy) {
+				// The memoized root carries the first call site's
+				// instantiation; the clone must answer for its own
+				// (modifier tags, highlight/background)
+				copy->modinst = inst;
+				module_stack().pop_back();
+				return copy;
+			}
+		}
+	}
+
 	AbstractNode *node = new AbstractNode(inst);
 	std::vector<AbstractNode *> instantiatednodes = this->scope.instantiateChildren(&c);
 	node->children.insert(node->children.end(), instantiatednodes.begin(), instantiatednodes.end());
-	module_stack.pop_back();
+	module_stack().pop_back();
+
+	if (!memokey.empty()) {
+		boost::lock_guard<boost::mutex> lock(memo_mutex);
+		instantiation_memo.insert(std::make_pair(memokey, node));
+	}
 
 	return node;
 }
@@ -255,7 +337,10 @@ void FileModule::registerInclude(const std::string &localpath,
 	struct stat st;
 	memset(&st, 0, sizeof(struct stat));
 	bool valid = stat(fullpath.c_str(), &st) == 0;
-	IncludeFile inc = {fullpath, valid, st.st_mtime};
+	// The hash tells later touches without content changes apart from
+	// real edits; the file was just lexed, so it's warm in the OS cache
+	IncludeFile inc = {fullpath, valid, st.st_mtime,
+										 valid ? hash_file_contents(fullpath) : std::string()};
 	this->includes[localpath] = inc;
 }
 
@@ -273,10 +358,18 @@ bool FileModule::include_modified(const IncludeFile &inc) const
 	memset(&st, 0, sizeof(struct stat));
 
 	fs::path fullpath = find_valid_path(this->path, inc.filename);
-	bool valid = !fullpath.empty() ? (stat(boosty::stringy(fullpath).c_str(), &st) == 0) : false;
+	bool valid = !fullpath.empty() ? (StatCache::stat(boosty::stringy(fullpath), st) == 0) : false;
 	
 	if (valid && !inc.valid) return true; // Detect appearance of file but not removal
-	if (valid && st.st_mtime > inc.mtime) return true;
+	if (valid && st.st_mtime > inc.mtime) {
+		// Touched; only report a change when the bytes moved too
+		const std::string hash = hash_file_contents(boosty::stringy(fullpath));
+		if (!inc.hash.empty() && hash == inc.hash) {
+			inc.mtime = st.st_mtime;
+			return false;
+		}
+		return true;
+	}
 	
 	return false;
 }
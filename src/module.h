@@ -6,6 +6,7 @@
 #include <deque>
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
+#include <boost/functional/hash.hpp>
 #include <time.h>
 #include <sys/stat.h>
 
@@ -18,7 +19,8 @@ class ModuleInstantiation
 {
 public:
 	ModuleInstantiation(const std::string &name = "")
-		: tag_root(false), tag_highlight(false), tag_background(false), recursioncount(0), modname(name) { }
+		: tag_root(false), tag_highlight(false), tag_background(false), recursioncount(0), modname(name),
+			modname_hash(boost::hash<std::string>()(name)), modline(0) { }
 	virtual ~ModuleInstantiation();
 
 	virtual std::string dump(const std::string &indent) const;
@@ -27,9 +29,14 @@ public:
 
 	void setPath(const std::string &path) { this->modpath = path; }
 	const std::string &path() const { return this->modpath; }
+	void setLine(int line) { this->modline = line; }
+	//! 1-based source line of the instantiation, 0 when unknown
+	int line() const { return this->modline; }
 	std::string getAbsolutePath(const std::string &filename) const;
 
 	const std::string &name() const { return this->modname; }
+	// Hash interned at construction; lets resolution skip rehashing
+	std::size_t nameHash() const { return this->modname_hash; }
 	bool isBackground() const { return this->tag_background; }
 	bool isHighlight() const { return this->tag_highlight; }
 	bool isRoot() const { return this->tag_root; }
@@ -43,7 +50,9 @@ public:
 	mutable int recursioncount;
 protected:
 	std::string modname;
+	std::size_t modname_hash;
 	std::string modpath;
+	int modline;
 
 	friend class Module;
 };
@@ -83,15 +92,24 @@ public:
 
 	virtual AbstractNode *instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx = NULL) const;
 	virtual std::string dump(const std::string &indent, const std::string &name) const;
-	static const std::string& stack_element(int n) { return module_stack[n]; };
-	static int stack_size() { return module_stack.size(); };
+	static const std::string& stack_element(int n) { return module_stack()[n]; };
+	static int stack_size() { return module_stack().size(); };
+	/*!
+		Forgets memoized instantiation results (see Module::instantiate).
+		Must be called before every compile: the memo points into the
+		previous compile's node tree.
+	*/
+	static void clearInstantiationMemo();
 
 	AssignmentList definition_arguments;
 
 	LocalScope scope;
 
 private:
-	static std::deque<std::string> module_stack;
+	// The stack is kept per thread so parallel instantiation (see
+	// parallel-for in control.cc) doesn't race; worker threads only see
+	// modules entered on their own thread.
+	static std::deque<std::string> &module_stack();
 };
 
 // FIXME: A FileModule doesn't have definition arguments, so we shouldn't really
@@ -119,7 +137,10 @@ private:
 	struct IncludeFile {
 		std::string filename;
 		bool valid;
-		time_t mtime;
+		//! Advanced when a newer timestamp turns out to hash equal, so
+		//! no-op touches are hashed once instead of on every check
+		mutable time_t mtime;
+		std::string hash;
 	};
 
 	bool include_modified(const IncludeFile &inc) const;
@@ -128,4 +149,6 @@ private:
 	IncludeContainer includes;
 	bool is_handling_dependencies;
 	std::string path;
+
+	friend class ModuleSerializer;
 };
@@ -26,19 +26,73 @@
 
 #include "node.h"
 #include "module.h"
+#include "nodearena.h"
 #include "progress.h"
 #include "visitor.h"
 #include "stl-utils.h"
 
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <typeinfo>
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/unordered_map.hpp>
 
 size_t AbstractNode::idx_counter;
 
+namespace {
+	// Origin tag in front of every node allocation: the arena it came
+	// from, or NULL for the heap. Sized to keep Eigen members aligned.
+	union NodeHeader {
+		NodeArena *arena;
+		char pad[16];
+	};
+
+	// Guards idx_counter: subtrees are instantiated on worker threads
+	// (see parallel-for in control.cc)
+	boost::mutex idx_mutex;
+}
+
+void *AbstractNode::operator new(size_t size)
+{
+	NodeHeader *h = NULL;
+	NodeArena *arena = NodeArena::current();
+	if (arena) {
+		h = static_cast<NodeHeader *>(arena->alloc(sizeof(NodeHeader) + size));
+		arena->addref();
+	}
+	else {
+		h = static_cast<NodeHeader *>(malloc(sizeof(NodeHeader) + size));
+		if (!h) throw std::bad_alloc();
+		arena = NULL;
+	}
+	h->arena = arena;
+	return h + 1;
+}
+
+void AbstractNode::operator delete(void *ptr)
+{
+	if (!ptr) return;
+	NodeHeader *h = static_cast<NodeHeader *>(ptr) - 1;
+	if (h->arena) h->arena->release();
+	else free(h);
+}
+
 AbstractNode::AbstractNode(const ModuleInstantiation *mi)
 {
 	modinst = mi;
+	boost::lock_guard<boost::mutex> lock(idx_mutex);
+	idx = idx_counter++;
+}
+
+AbstractNode::AbstractNode(const AbstractNode &other)
+	: children(), modinst(other.modinst), progress_mark(0),
+		cached_string(other.cached_string)
+{
+	boost::lock_guard<boost::mutex> lock(idx_mutex);
 	idx = idx_counter++;
 }
 
@@ -47,6 +101,29 @@ AbstractNode::~AbstractNode()
 	std::for_each(this->children.begin(), this->children.end(), del_fun<AbstractNode>());
 }
 
+AbstractNode *AbstractNode::cloneNode() const
+{
+	// Copying a subclass through the base copy constructor would slice
+	// off its parameters, so only plain group nodes clone here
+	if (typeid(*this) != typeid(AbstractNode)) return NULL;
+	return new AbstractNode(*this);
+}
+
+AbstractNode *AbstractNode::cloneSubtree() const
+{
+	AbstractNode *copy = this->cloneNode();
+	if (!copy) return NULL;
+	BOOST_FOREACH(const AbstractNode *child, this->children) {
+		AbstractNode *childcopy = child->cloneSubtree();
+		if (!childcopy) {
+			delete copy;
+			return NULL;
+		}
+		copy->children.push_back(childcopy);
+	}
+	return copy;
+}
+
 Response AbstractNode::accept(class State &state, Visitor &visitor) const
 {
 	return visitor.visit(state, *this);
@@ -67,7 +144,46 @@ Response LeafNode::accept(class State &state, Visitor &visitor) const
 	return visitor.visit(state, *this);
 }
 
+namespace {
+
+	// Shared pool of formatted node strings. The entries are weakly held,
+	// so deleting a tree releases its strings; expired slots are swept
+	// when the pool has grown noticeably since the last sweep. The mutex
+	// matters because subtrees are instantiated on worker threads (see
+	// parallel-for in control.cc).
+	boost::mutex string_pool_mutex;
+	boost::unordered_map<std::string, boost::weak_ptr<const std::string> > string_pool;
+	size_t string_pool_sweep_size = 1000;
+
+	shared_ptr<const std::string> intern_node_string(const std::string &str)
+	{
+		boost::lock_guard<boost::mutex> lock(string_pool_mutex);
+		boost::weak_ptr<const std::string> &entry = string_pool[str];
+		shared_ptr<const std::string> result = entry.lock();
+		if (!result) {
+			result.reset(new std::string(str));
+			entry = result;
+			if (string_pool.size() > string_pool_sweep_size) {
+				for (boost::unordered_map<std::string, boost::weak_ptr<const std::string> >::iterator it = string_pool.begin(); it != string_pool.end();) {
+					if (it->second.expired()) it = string_pool.erase(it);
+					else ++it;
+				}
+				string_pool_sweep_size = 2 * (string_pool.size() + 500);
+			}
+		}
+		return result;
+	}
+}
+
 std::string AbstractNode::toString() const
+{
+	if (!this->cached_string) {
+		this->cached_string = intern_node_string(this->computeString());
+	}
+	return *this->cached_string;
+}
+
+std::string AbstractNode::computeString() const
 {
 	return this->name() + "()";
 }
@@ -77,7 +193,7 @@ std::string AbstractNode::name() const
 	return "group";
 }
 
-std::string AbstractIntersectionNode::toString() const
+std::string AbstractIntersectionNode::computeString() const
 {
 	return this->name() + "()";
 }
@@ -91,8 +207,21 @@ std::string AbstractIntersectionNode::name() const
 
 void AbstractNode::progress_prepare()
 {
-	std::for_each(this->children.begin(), this->children.end(), std::mem_fun(&AbstractNode::progress_prepare));
-	this->progress_mark = ++progress_report_count;
+	// Post-order numbering via an explicit stack: one recursive call per
+	// node adds up on 100k-node trees and risks exhausting the thread
+	// stack on deeply nested ones.
+	std::vector<std::pair<AbstractNode *, size_t> > stack;
+	stack.push_back(std::make_pair(this, 0));
+	while (!stack.empty()) {
+		std::pair<AbstractNode *, size_t> &frame = stack.back();
+		if (frame.second < frame.first->children.size()) {
+			AbstractNode *child = frame.first->children[frame.second++];
+			stack.push_back(std::make_pair(child, 0));
+		} else {
+			frame.first->progress_mark = ++progress_report_count;
+			stack.pop_back();
+		}
+	}
 }
 
 void AbstractNode::progress_report() const
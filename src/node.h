@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include "traverser.h"
+#include "memory.h"
 
 extern int progress_report_count;
 extern void (*progress_report_f)(const class AbstractNode*, void*, int);
@@ -28,9 +29,20 @@ class AbstractNode
 public:
 	AbstractNode(const class ModuleInstantiation *mi);
 	virtual ~AbstractNode();
+	/*! Nodes allocate from the active NodeArena when one is in scope, so
+	    a per-compile tree comes out of a few large chunks and its
+	    teardown costs no per-node frees; see nodearena.h */
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr);
   virtual Response accept(class State &state, class Visitor &visitor) const;
-	virtual std::string toString() const;
-	/*! The 'OpenSCAD name' of this node, defaults to classname, but can be 
+	/*! Nodes are immutable after instantiation, so the formatted string is
+	    computed once and interned in a shared pool: the thousands of
+	    identical stamps a for loop produces share one allocation. */
+	std::string toString() const;
+	/*! Formats this node (excluding children). Overridden per node type;
+	    callers go through toString(), which caches the result. */
+	virtual std::string computeString() const;
+	/*! The 'OpenSCAD name' of this node, defaults to classname, but can be
 	    overloaded to provide specialization for e.g. CSG nodes, primitive nodes etc.
 	    Used for human-readable output. */
 	virtual std::string name() const;
@@ -46,6 +58,18 @@ public:
 
 	static void resetIndexCounter() { idx_counter = 1; }
 
+	/*!
+		Deep-copies this subtree, giving every copy a fresh index, so a
+		memoized module instantiation can be reused without sharing node
+		instances between tree positions (see Module::instantiate).
+		Returns NULL if some node type in the subtree lacks cloneNode().
+	*/
+	AbstractNode *cloneSubtree() const;
+	/*! Copies this node without its children. Overridden per concrete
+	    node type; the base implementation refuses (returns NULL) for
+	    subclasses so a missing override can't silently slice one. */
+	virtual AbstractNode *cloneNode() const;
+
 	// FIXME: Make protected
 	std::vector<AbstractNode*> children;
 	const ModuleInstantiation *modinst;
@@ -57,6 +81,13 @@ public:
 	void progress_report() const;
 
 	int idx; // Node index (unique per tree)
+
+protected:
+	//! Copies everything but children and index; only reachable via cloneNode()
+	AbstractNode(const AbstractNode &other);
+
+private:
+	mutable shared_ptr<const std::string> cached_string;
 };
 
 class AbstractIntersectionNode : public AbstractNode
@@ -65,8 +96,9 @@ public:
 	AbstractIntersectionNode(const ModuleInstantiation *mi) : AbstractNode(mi) { };
 	virtual ~AbstractIntersectionNode() { };
   virtual Response accept(class State &state, class Visitor &visitor) const;
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const;
+	virtual AbstractNode *cloneNode() const { return new AbstractIntersectionNode(*this); }
 };
 
 class AbstractPolyNode : public AbstractNode
@@ -0,0 +1,63 @@
+#include "nodearena.h"
+
+#include <cstdlib>
+#include <new>
+
+#include <boost/foreach.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace {
+	// The arena the calling thread's AbstractNode allocations go to; only
+	// the thread holding the Scope bump-allocates, other threads fall
+	// back to the heap. The cleanup function is a no-op since arenas own
+	// themselves (see release()).
+	void no_cleanup(NodeArena *) {}
+	boost::thread_specific_ptr<NodeArena> current_arena(no_cleanup);
+}
+
+NodeArena::NodeArena()
+	: offset(0), lastchunksize(0), live(1) // the creating Scope's reference
+{
+}
+
+NodeArena::~NodeArena()
+{
+	BOOST_FOREACH(char *chunk, this->chunks) free(chunk);
+}
+
+NodeArena *NodeArena::current()
+{
+	return current_arena.get();
+}
+
+void *NodeArena::alloc(size_t size)
+{
+	size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	if (this->chunks.empty() || this->offset + size > this->lastchunksize) {
+		this->lastchunksize = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+		char *chunk = static_cast<char *>(malloc(this->lastchunksize));
+		if (!chunk) throw std::bad_alloc();
+		this->chunks.push_back(chunk);
+		this->offset = 0;
+	}
+	void *p = this->chunks.back() + this->offset;
+	this->offset += size;
+	return p;
+}
+
+void NodeArena::release()
+{
+	if (--this->live == 0) delete this;
+}
+
+NodeArena::Scope::Scope(NodeArena *arena)
+	: arena(arena), previous(current_arena.get())
+{
+	current_arena.reset(arena);
+}
+
+NodeArena::Scope::~Scope()
+{
+	current_arena.reset(this->previous);
+	this->arena->release();
+}
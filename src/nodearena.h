@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/detail/atomic_count.hpp>
+
+/*!
+	Bump allocator backing AbstractNode instances. A recompile of a large
+	design instantiates and later destroys hundreds of thousands of nodes;
+	allocating them from per-compile chunks turns instantiation-time
+	malloc calls into pointer bumps and tree teardown into a destructor
+	sweep whose memory comes back as a handful of block frees instead of
+	one free per node.
+
+	The arena is activated with a Scope around tree instantiation and
+	releases itself once it is closed and the last node allocated from it
+	has been destroyed, so no owner needs to track which tree came from
+	which arena. AbstractNode::operator new tags each allocation with its
+	origin (see node.cc); nodes instantiated outside any Scope - e.g. on
+	parallel-for worker threads - fall back to the heap and coexist in the
+	same tree.
+*/
+class NodeArena
+{
+public:
+	NodeArena();
+
+	/*!
+		RAII helper: routes AbstractNode allocations on the calling thread
+		into the arena, and closes the arena on destruction. Closing hands
+		ownership to the allocated nodes: the arena frees itself when the
+		last of them is deleted.
+	*/
+	class Scope
+	{
+	public:
+		Scope(NodeArena *arena);
+		~Scope();
+	private:
+		NodeArena *arena;
+		NodeArena *previous;
+	};
+
+	//! Returns the arena the calling thread allocates nodes from, or NULL
+	static NodeArena *current();
+
+	//! Returns size bytes from the current chunk, growing as needed
+	void *alloc(size_t size);
+
+	void addref() { ++this->live; }
+	//! Drops one reference; the last one (nodes plus the Scope's own) frees the arena
+	void release();
+
+private:
+	~NodeArena();
+
+	static const size_t CHUNK_SIZE = 256*1024;
+	static const size_t ALIGNMENT = 16; // nodes contain Eigen members
+
+	std::vector<char *> chunks;
+	size_t offset; // first free byte in the last chunk
+	size_t lastchunksize;
+	// One reference per allocated node, plus one held by the Scope until
+	// it closes; self-deletion this way needs no closed flag and no
+	// ordering subtleties between closing and late node deletions
+	boost::detail::atomic_count live;
+
+	friend class Scope;
+};
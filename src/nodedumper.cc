@@ -2,8 +2,8 @@
 #include "state.h"
 #include "module.h"
 
+#include <stdio.h>
 #include <string>
-#include <sstream>
 #include <assert.h>
 
 /*!
@@ -38,27 +38,37 @@ void NodeDumper::handleIndent(const State &state)
 	including braces and indentation.
 	All children are assumed to be cached already.
  */
-std::string NodeDumper::dumpChildren(const AbstractNode &node)
+void NodeDumper::dumpChildren(const AbstractNode &node, std::string &dump)
 {
-	std::stringstream dump;
-	if (!this->visitedchildren[node.index()].empty()) {
-		dump << " {\n";
-		
-		for (ChildList::const_iterator iter = this->visitedchildren[node.index()].begin();
-				 iter != this->visitedchildren[node.index()].end();
+	const ChildList &children = this->visitedchildren[node.index()];
+	if (!children.empty()) {
+		// Size the target once; the child strings below are the bulk of it
+		size_t size = dump.size() + this->currindent.size() + 4;
+		for (ChildList::const_iterator iter = children.begin();
+				 iter != children.end();
+				 iter++) {
+			size += this->cache[**iter].size() + 3;
+		}
+		dump.reserve(size);
+
+		dump += " {\n";
+
+		for (ChildList::const_iterator iter = children.begin();
+				 iter != children.end();
 				 iter++) {
 			assert(isCached(**iter));
-			if ((*iter)->modinst->isBackground()) dump << "%";
-			if ((*iter)->modinst->isHighlight()) dump << "#";
-			dump << this->cache[**iter] << "\n";
+			if ((*iter)->modinst->isBackground()) dump += "%";
+			if ((*iter)->modinst->isHighlight()) dump += "#";
+			dump += this->cache[**iter];
+			dump += "\n";
 		}
-		
-		dump << this->currindent << "}";
+
+		dump += this->currindent;
+		dump += "}";
 	}
 	else {
-		dump << ";";
+		dump += ";";
 	}
-	return dump.str();
 }
 
 /*!
@@ -71,12 +81,17 @@ Response NodeDumper::visit(State &state, const AbstractNode &node)
 
 	handleIndent(state);
 	if (state.isPostfix()) {
-		std::stringstream dump;
-		dump << this->currindent;
-		if (this->idprefix) dump << "n" << node.index() << ":";
-		dump << node;
-		dump << dumpChildren(node);
-		this->cache.insert(node, dump.str());
+		// Append into one string instead of funneling every piece through
+		// a stringstream; the child strings are only copied once
+		std::string dump = this->currindent;
+		if (this->idprefix) {
+			char idbuf[32];
+			snprintf(idbuf, sizeof(idbuf), "n%lu:", (unsigned long)node.index());
+			dump += idbuf;
+		}
+		dump += node.toString();
+		dumpChildren(node, dump);
+		this->cache.insert(node, dump);
 	}
 
 	handleVisitedChildren(state, node);
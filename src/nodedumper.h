@@ -21,7 +21,7 @@ private:
         void handleVisitedChildren(const State &state, const AbstractNode &node);
         bool isCached(const AbstractNode &node) const;
         void handleIndent(const State &state);
-        std::string dumpChildren(const AbstractNode &node);
+        void dumpChildren(const AbstractNode &node, std::string &dump);
 
         NodeCache &cache;
         bool idprefix;
@@ -0,0 +1,69 @@
+#include "nodehasher.h"
+#include "state.h"
+#include "module.h"
+
+#include <string>
+#include <assert.h>
+#include <boost/format.hpp>
+#include <boost/uuid/sha1.hpp>
+
+/*!
+	\class NodeHasher
+
+	Computes a SHA1 per node over the node's toString() representation,
+	its modifier flags and the (already computed) hashes of its children.
+	The hex digest is stored in a NodeCache indexed by node.index(), just
+	like the NodeDumper string caches.
+*/
+
+bool NodeHasher::isCached(const AbstractNode &node) const
+{
+	return !this->cache[node].empty();
+}
+
+Response NodeHasher::visit(State &state, const AbstractNode &node)
+{
+	if (isCached(node)) return PruneTraversal;
+
+	if (state.isPostfix()) {
+		boost::uuids::detail::sha1 sha;
+		const std::string nodestr = node.toString();
+		sha.process_bytes(nodestr.data(), nodestr.size());
+		sha.process_bytes("{", 1);
+		for (ChildList::const_iterator iter = this->visitedchildren[node.index()].begin();
+				 iter != this->visitedchildren[node.index()].end();
+				 iter++) {
+			assert(isCached(**iter));
+			// Modifier flags change how a child contributes to its parent,
+			// so they're part of the parent's identity, like in NodeDumper
+			if ((*iter)->modinst->isBackground()) sha.process_bytes("%", 1);
+			if ((*iter)->modinst->isHighlight()) sha.process_bytes("#", 1);
+			const std::string &childhash = this->cache[**iter];
+			sha.process_bytes(childhash.data(), childhash.size());
+		}
+		sha.process_bytes("}", 1);
+
+		unsigned int digest[5];
+		sha.get_digest(digest);
+		std::string hash;
+		for (int i=0;i<5;i++) hash += str(boost::format("%08x") % digest[i]);
+		this->cache.insert(node, hash);
+	}
+
+	handleVisitedChildren(state, node);
+	return ContinueTraversal;
+}
+
+/*!
+	Adds this given node to its parent's child list.
+	Should be called for all nodes, including leaf nodes.
+*/
+void NodeHasher::handleVisitedChildren(const State &state, const AbstractNode &node)
+{
+	if (state.isPostfix()) {
+		this->visitedchildren.erase(node.index());
+		if (state.parent()) {
+			this->visitedchildren[state.parent()->index()].push_back(&node);
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <list>
+#include "visitor.h"
+#include "nodecache.h"
+
+/*!
+	A visitor computing a fixed-size content hash per node, bottom-up from
+	the child hashes and the node's own parameters. Equivalent subtrees get
+	equal hashes, so the hashes can be used as cache keys in place of full
+	NodeDumper strings, without ever materializing a textual dump of the tree.
+*/
+class NodeHasher : public Visitor
+{
+public:
+        NodeHasher(NodeCache &cache) : cache(cache) { }
+        virtual ~NodeHasher() {}
+
+        virtual Response visit(State &state, const AbstractNode &node);
+
+private:
+        void handleVisitedChildren(const State &state, const AbstractNode &node);
+        bool isCached(const AbstractNode &node) const;
+
+        NodeCache &cache;
+
+        typedef std::list<const AbstractNode *> ChildList;
+        std::map<int, ChildList> visitedchildren;
+};
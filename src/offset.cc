@@ -95,7 +95,7 @@ AbstractNode *OffsetModule::instantiate(const Context *ctx, const ModuleInstanti
 	return node;
 }
 
-std::string OffsetNode::toString() const
+std::string OffsetNode::computeString() const
 {
 	std::stringstream stream;
 
@@ -12,8 +12,9 @@ public:
         virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const { return "offset"; }
+	virtual AbstractNode *cloneNode() const { return new OffsetNode(*this); }
 
 	double fn, fs, fa, delta, miter_limit;
         ClipperLib::JoinType join_type;
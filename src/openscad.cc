@@ -32,11 +32,17 @@
 #include "export.h"
 #include "builtin.h"
 #include "printutils.h"
+#include "workerpool.h"
+#include "profiler.h"
+#include "cacheadvisor.h"
+#include "memorypressure.h"
+#include "nodearena.h"
 #include "handle_dep.h"
 #include "feature.h"
 #include "parsersettings.h"
 #include "rendersettings.h"
 #include "PlatformUtils.h"
+#include "progress.h"
 #include "nodedumper.h"
 #include "CocoaUtils.h"
 
@@ -46,6 +52,7 @@
 
 #ifdef ENABLE_CGAL
 #include "CGAL_Nef_polyhedron.h"
+#include "CGALCache.h"
 #endif
 
 #include "csgterm.h"
@@ -66,6 +73,9 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <sys/stat.h>
 #include "boosty.h"
 
 #ifdef _MSC_VER
@@ -104,14 +114,18 @@ static void help(const char *progname)
   for (int i=0;i<tablen;i++) tabstr[i] = ' ';
   tabstr[tablen] = '\0';
 
-	PRINTB("Usage: %1% [ -o output_file [ -d deps_file ] ]\\\n"
+	PRINTB("Usage: %1% [ -o output_file [ -o output_file .. ] [ -d deps_file ] ]\\\n"
          "%2%[ -m make_command ] [ -D var=val [..] ] \\\n"
          "%2%[ --version ] [ --info ] \\\n"
          "%2%[ --camera=translatex,y,z,rotx,y,z,dist | \\\n"
          "%2%  --camera=eyex,y,z,centerx,y,z ] \\\n"
          "%2%[ --imgsize=width,height ] [ --projection=(o)rtho|(p)ersp] \\\n"
+         "%2%[ --animate=num_frames ] [ --watch ] \\\n"
          "%2%[ --render | --preview[=throwntogether] ] \\\n"
-         "%2%[ --csglimit=num ]"
+         "%2%[ --csglimit=num ] [ --profile ] [ --profile-mem ] [ --advise-render ] \\\n"
+         "%2%[ --memory-budget=mb ] \\\n"
+         "%2%[ --jobs=N ] [ --threads=N ] [ --timeout=sec ] \\\n"
+         "%2%[ --stamp=file [ --skip-if-unchanged ] ] [ --hash-outputs ]"
 #ifdef ENABLE_EXPERIMENTAL
          " [ --enable=<feature> ]"
 #endif
@@ -119,11 +133,119 @@ static void help(const char *progname)
 #ifdef DEBUG
 				 "%2%[ --debug=module ] \\\n"
 #endif
-         "%2%filename\n",
+         "%2%filename [ filename .. (batch mode, one -o per file) ]\n",
  				 progname % (const char *)tabstr);
 	exit(1);
 }
 
+/*!
+	Returns an id summarizing the on-disk state of everything rendered so
+	far: one mtime.size token per file registered through handle_dep()
+	(like the GUI's autoReloadId, extended over the whole dependency
+	closure). The set covers the input file itself plus every include,
+	use and import seen during parsing, so after the first render a
+	change to any of them alters the id.
+*/
+static std::string watch_state()
+{
+	std::stringstream state;
+	BOOST_FOREACH(const std::string &filename, dependency_files()) {
+		struct stat st;
+		memset(&st, 0, sizeof(struct stat));
+		// A file that momentarily disappears (editors writing via rename)
+		// contributes the zeroed stat until it's back
+		stat(filename.c_str(), &st);
+		state << boost::format("%s:%x.%x\n") % filename % st.st_mtime % st.st_size;
+	}
+	return state.str();
+}
+
+#ifdef ENABLE_CGAL
+namespace {
+	//! Work queue shared by the --jobs prewarm workers
+	struct PrewarmQueue {
+		std::vector<std::string> inputs;
+		size_t next;
+		boost::mutex queue_mutex;
+		// The parser, ModuleCache and the node index counter are all
+		// process-global, so everything up to tree construction is
+		// serialized; only geometry evaluation runs concurrently
+		boost::mutex compile_mutex;
+		PrewarmQueue() : next(0) { }
+	};
+}
+
+/*!
+	One --jobs worker: pulls input files off the queue and evaluates
+	their geometry into GeometryCache/CGALCache. The sequential batch
+	loop afterwards re-renders every case against warm caches, so shared
+	library parts are computed once per batch no matter which input gets
+	there first. Paths are resolved against the document path only (as
+	the GUI does), since the working directory can't be changed per
+	thread.
+*/
+static void prewarm_worker(PrewarmQueue *queue)
+{
+	for (;;) {
+		std::string filename;
+		{
+			boost::mutex::scoped_lock lock(queue->queue_mutex);
+			if (queue->next >= queue->inputs.size()) return;
+			filename = queue->inputs[queue->next++];
+		}
+
+		Tree tree;
+		AbstractNode *absolute_root_node = NULL;
+		{
+			boost::mutex::scoped_lock lock(queue->compile_mutex);
+
+			std::ifstream ifs(filename.c_str());
+			if (!ifs.is_open()) continue; // the batch loop will report it
+			std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+			text += "\n" + commandline_commands;
+			fs::path abspath = boosty::absolute(filename);
+			std::string parentpath = boosty::stringy(abspath.parent_path());
+			FileModule *root_module = parse(text.c_str(), parentpath.c_str(), false);
+			if (!root_module) continue;
+			root_module->handleDependencies();
+
+			ModuleContext top_ctx;
+			top_ctx.registerBuiltin();
+			top_ctx.setDocumentPath(parentpath);
+			ModuleInstantiation root_inst("group");
+			absolute_root_node = root_module->instantiate(&top_ctx, &root_inst, NULL);
+			if (!absolute_root_node) continue;
+
+			AbstractNode *root_node = find_root_tag(absolute_root_node);
+			if (!root_node) root_node = absolute_root_node;
+			tree.setRoot(root_node);
+		}
+
+		GeometryEvaluator geomevaluator(tree);
+		geomevaluator.evaluateGeometry(*tree.root(), true);
+		delete absolute_root_node;
+	}
+}
+
+/*!
+	Evaluates the batch cases needing a full CGAL render over an
+	in-process worker pool before the sequential render loop runs. Only
+	the caches carry the results out of here.
+*/
+static void prewarm_batch(const std::vector<std::string> &inputs, unsigned jobs)
+{
+	PrewarmQueue queue;
+	queue.inputs = inputs;
+
+	size_t numthreads = std::min((size_t)jobs, queue.inputs.size());
+	WorkerPool::TaskGroup tasks;
+	for (size_t t = 0; t < numthreads; t++) {
+		tasks.run(boost::bind(prewarm_worker, &queue));
+	}
+	tasks.wait();
+}
+#endif // ENABLE_CGAL
+
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
 static void version()
@@ -203,7 +325,8 @@ Camera get_camera( po::variables_map vm )
 	return camera;
 }
 
-#ifdef OPENSCAD_TESTING
+// Test binaries and the headless (NULLGL) build run without any GUI
+#if defined(OPENSCAD_TESTING) || defined(NULLGL)
 #undef OPENSCAD_QTGUI
 #else
 #define OPENSCAD_QTGUI 1
@@ -211,17 +334,19 @@ Camera get_camera( po::variables_map vm )
 #endif
 
 static bool checkAndExport(shared_ptr<const Geometry> root_geom, unsigned nd,
-	enum FileFormat format, const char *filename)
+	enum FileFormat format, const char *filename, const std::string &contentid)
 {
 	if (root_geom->getDimension() != nd) {
 		PRINTB("Current top level object is not a %dD object.", nd);
 		return false;
 	}
-	exportFileByName(root_geom.get(), format, filename, filename);
+	ProfileScope profile("export");
+	if (Profiler::enabled()) profile.setBytes(root_geom->memsize());
+	exportFileByName(root_geom.get(), format, filename, filename, contentid);
 	return true;
 }
 
-int cmdline(const char *deps_output_file, const std::string &filename, Camera &camera, const char *output_file, const fs::path &original_path, Render::type renderer, int argc, char ** argv )
+int cmdline(const char *deps_output_file, const char *stamp_output_file, bool skip_if_unchanged, bool hash_outputs, const std::string &filename, Camera &camera, const std::vector<std::string> &output_files, const fs::path &original_path, Render::type renderer, unsigned animate_frames, int argc, char ** argv )
 {
 #ifdef OPENSCAD_QTGUI
 	QCoreApplication app(argc, argv);
@@ -234,34 +359,97 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 #ifdef ENABLE_CGAL
 	GeometryEvaluator geomevaluator(tree);
 #endif
-	const char *stl_output_file = NULL;
-	const char *off_output_file = NULL;
-	const char *amf_output_file = NULL;
-	const char *dxf_output_file = NULL;
-	const char *svg_output_file = NULL;
-	const char *csg_output_file = NULL;
-	const char *png_output_file = NULL;
-	const char *ast_output_file = NULL;
-	const char *term_output_file = NULL;
+	// -o may be repeated; the tree is parsed, instantiated and evaluated
+	// once and every requested format is exported from the shared result.
+	std::vector<std::string> stl_output_files;
+	std::vector<std::string> off_output_files;
+	std::vector<std::string> amf_output_files;
+	std::vector<std::string> nef3_output_files;
+	std::vector<std::string> dxf_output_files;
+	std::vector<std::string> svg_output_files;
+	std::vector<std::string> csg_output_files;
+	std::vector<std::string> png_output_files;
+	std::vector<std::string> ast_output_files;
+	std::vector<std::string> term_output_files;
 	const char *echo_output_file = NULL;
 
-	std::string suffix = boosty::extension_str( output_file );
-	boost::algorithm::to_lower( suffix );
-
-	if (suffix == ".stl") stl_output_file = output_file;
-	else if (suffix == ".off") off_output_file = output_file;
-	else if (suffix == ".amf") amf_output_file = output_file;
-	else if (suffix == ".dxf") dxf_output_file = output_file;
-	else if (suffix == ".svg") svg_output_file = output_file;
-	else if (suffix == ".csg") csg_output_file = output_file;
-	else if (suffix == ".png") png_output_file = output_file;
-	else if (suffix == ".ast") ast_output_file = output_file;
-	else if (suffix == ".term") term_output_file = output_file;
-	else if (suffix == ".echo") echo_output_file = output_file;
-	else {
-		PRINTB("Unknown suffix for output file %s\n", output_file);
+	BOOST_FOREACH(const std::string &output_file, output_files) {
+		std::string suffix = boosty::extension_str( output_file );
+		boost::algorithm::to_lower( suffix );
+		// A trailing .gz asks for transparent compression (see
+		// exportFileByName()); classify by the real format suffix
+		if (suffix == ".gz") {
+			suffix = boosty::extension_str(fs::path(output_file).stem());
+			boost::algorithm::to_lower( suffix );
+			if (suffix != ".stl" && suffix != ".off" && suffix != ".amf" &&
+					suffix != ".dxf" && suffix != ".svg") {
+				PRINTB("Unknown suffix for output file %s\n", output_file);
+				return 1;
+			}
+		}
+
+		if (suffix == ".stl") stl_output_files.push_back(output_file);
+		else if (suffix == ".off") off_output_files.push_back(output_file);
+		else if (suffix == ".amf") amf_output_files.push_back(output_file);
+		else if (suffix == ".nef3") nef3_output_files.push_back(output_file);
+		else if (suffix == ".dxf") dxf_output_files.push_back(output_file);
+		else if (suffix == ".svg") svg_output_files.push_back(output_file);
+		else if (suffix == ".csg") csg_output_files.push_back(output_file);
+		else if (suffix == ".png") png_output_files.push_back(output_file);
+		else if (suffix == ".ast") ast_output_files.push_back(output_file);
+		else if (suffix == ".term") term_output_files.push_back(output_file);
+		else if (suffix == ".echo") {
+			// All message output goes through one handler, so only a single
+			// echo file can be served per invocation
+			if (echo_output_file) PRINTB("WARNING: Ignoring additional echo output file %s\n", output_file);
+			else echo_output_file = output_file.c_str();
+		}
+		else {
+			PRINTB("Unknown suffix for output file %s\n", output_file);
+			return 1;
+		}
+	}
+
+	if (animate_frames) {
+		if (png_output_files.empty()) {
+			PRINT("--animate requires a .png output file\n");
+			return 1;
+		}
+		if (!stl_output_files.empty() || !off_output_files.empty() ||
+				!amf_output_files.empty() || !nef3_output_files.empty() ||
+				!dxf_output_files.empty() ||
+				!svg_output_files.empty() || !csg_output_files.empty() ||
+				!ast_output_files.empty() || !term_output_files.empty()) {
+			PRINT("--animate can only be combined with .png and .echo outputs\n");
+			return 1;
+		}
+	}
+
+#ifdef NULLGL
+	// This build has no rasterizer at all; fail up front instead of
+	// writing empty images
+	if (!png_output_files.empty()) {
+		PRINT("ERROR: png output is not available in a headless (NULLGL) build.");
 		return 1;
 	}
+#endif
+
+	// The stamp lists its own dependency closure, so the decision to
+	// skip is made before any parsing. Output mtimes can't capture -D
+	// overrides, which is why make alone can't make this call.
+	if (stamp_output_file && skip_if_unchanged) {
+		bool outputs_exist = true;
+		BOOST_FOREACH(const std::string &output_file, output_files) {
+			if (!fs::exists(fs::path(output_file))) {
+				outputs_exist = false;
+				break;
+			}
+		}
+		if (outputs_exist && dep_stamp_matches(stamp_output_file, commandline_commands)) {
+			PRINTB("%s: dependencies unchanged, skipping render", filename);
+			return 0;
+		}
+	}
 
 	// Top context - this context only holds builtins
 	ModuleContext top_ctx;
@@ -290,7 +478,11 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 	text += "\n" + commandline_commands;
 	fs::path abspath = boosty::absolute(filename);
 	std::string parentpath = boosty::stringy(abspath.parent_path());
-	root_module = parse(text.c_str(), parentpath.c_str(), false);
+	{
+		ProfileScope profile("parse");
+		root_module = parse(text.c_str(), parentpath.c_str(), false);
+	}
+	if (Profiler::memProfileEnabled()) Profiler::sampleMemory("parse");
 	if (!root_module) {
 		PRINTB("Can't parse file '%s'!\n", filename.c_str());
 		return 1;
@@ -302,144 +494,245 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 	fs::current_path(fparent);
 	top_ctx.setDocumentPath(fparent.string());
 
-	AbstractNode::resetIndexCounter();
-	absolute_root_node = root_module->instantiate(&top_ctx, &root_inst, NULL);
-
-	// Do we have an explicit root node (! modifier)?
-	if (!(root_node = find_root_tag(absolute_root_node)))
-		root_node = absolute_root_node;
-
-	tree.setRoot(root_node);
-
-	if (csg_output_file) {
-		fs::current_path(original_path);
-		std::ofstream fstream(csg_output_file);
-		if (!fstream.is_open()) {
-			PRINTB("Can't open file \"%s\" for export", csg_output_file);
+	// In animation mode every frame is rendered by this one process: the
+	// parsed module is re-instantiated per frame with an updated $t, and
+	// the geometry caches carry $t-independent subtrees between frames.
+	unsigned frame_count = animate_frames ? animate_frames : 1;
+	std::string prev_frame_hash;
+	for (unsigned frame = 0; frame < frame_count; frame++) {
+		if (animate_frames) {
+			top_ctx.set_variable("$t", Value((double)frame / animate_frames));
 		}
-		else {
-			fs::current_path(fparent); // Force exported filenames to be relative to document path
-			fstream << tree.getString(*root_node) << "\n";
-			fstream.close();
+		AbstractNode::resetIndexCounter();
+		Module::clearInstantiationMemo();
+		if (CacheAdvisor::enabled()) CacheAdvisor::instance()->startCompile();
+		MemoryPressure::reset();
+		{
+			ProfileScope profile("instantiate");
+			NodeArena::Scope node_arena(new NodeArena());
+			absolute_root_node = root_module->instantiate(&top_ctx, &root_inst, NULL);
 		}
-	}
-	else if (ast_output_file) {
-		fs::current_path(original_path);
-		std::ofstream fstream(ast_output_file);
-		if (!fstream.is_open()) {
-			PRINTB("Can't open file \"%s\" for export", ast_output_file);
-		}
-		else {
-			fs::current_path(fparent); // Force exported filenames to be relative to document path
-			fstream << root_module->dump("", "") << "\n";
-			fstream.close();
-		}
-	}
-	else if (term_output_file) {
-		std::vector<shared_ptr<CSGTerm> > highlight_terms;
-		std::vector<shared_ptr<CSGTerm> > background_terms;
+		if (Profiler::memProfileEnabled()) Profiler::sampleMemory("instantiate");
 
-		CSGTermEvaluator csgRenderer(tree);
-		shared_ptr<CSGTerm> root_raw_term = csgRenderer.evaluateCSGTerm(*root_node, highlight_terms, background_terms);
+		// Do we have an explicit root node (! modifier)?
+		if (!(root_node = find_root_tag(absolute_root_node)))
+			root_node = absolute_root_node;
 
-		fs::current_path(original_path);
-		std::ofstream fstream(term_output_file);
-		if (!fstream.is_open()) {
-			PRINTB("Can't open file \"%s\" for export", term_output_file);
+		tree.setRoot(root_node);
+
+		BOOST_FOREACH(const std::string &csg_output_file, csg_output_files) {
+			fs::current_path(original_path);
+			std::ofstream fstream(csg_output_file.c_str());
+			if (!fstream.is_open()) {
+				PRINTB("Can't open file \"%s\" for export", csg_output_file);
+			}
+			else {
+				fs::current_path(fparent); // Force exported filenames to be relative to document path
+				fstream << tree.getString(*root_node) << "\n";
+				fstream.close();
+			}
 		}
-		else {
-			if (!root_raw_term)
-				fstream << "No top-level CSG object\n";
+		BOOST_FOREACH(const std::string &ast_output_file, ast_output_files) {
+			fs::current_path(original_path);
+			std::ofstream fstream(ast_output_file.c_str());
+			if (!fstream.is_open()) {
+				PRINTB("Can't open file \"%s\" for export", ast_output_file);
+			}
 			else {
-				fstream << root_raw_term->dump() << "\n";
+				fs::current_path(fparent); // Force exported filenames to be relative to document path
+				fstream << root_module->dump("", "") << "\n";
+				fstream.close();
 			}
-			fstream.close();
 		}
-	}
-	else {
-#ifdef ENABLE_CGAL
-		if ((echo_output_file || png_output_file) && !(renderer==Render::CGAL)) {
-			// echo or OpenCSG png -> don't necessarily need CGALMesh evaluation
-		} else {
-			root_geom = geomevaluator.evaluateGeometry(*tree.root(), true);
-			if (!root_geom) {
-				PRINT("No top-level object found.");
-				return 1;
+		if (!term_output_files.empty()) {
+			std::vector<shared_ptr<CSGTerm> > highlight_terms;
+			std::vector<shared_ptr<CSGTerm> > background_terms;
+
+			CSGTermEvaluator csgRenderer(tree);
+			shared_ptr<CSGTerm> root_raw_term = csgRenderer.evaluateCSGTerm(*root_node, highlight_terms, background_terms);
+
+			fs::current_path(original_path);
+			BOOST_FOREACH(const std::string &term_output_file, term_output_files) {
+				std::ofstream fstream(term_output_file.c_str());
+				if (!fstream.is_open()) {
+					PRINTB("Can't open file \"%s\" for export", term_output_file);
+				}
+				else {
+					if (!root_raw_term)
+						fstream << "No top-level CSG object\n";
+					else {
+						// Stream the term instead of materializing the dump string
+						root_raw_term->dump(fstream);
+						fstream << "\n";
+					}
+					fstream.close();
+				}
 			}
-			const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron*>(root_geom.get());
 		}
 
-		fs::current_path(original_path);
+		bool geometry_outputs =
+			!stl_output_files.empty() || !off_output_files.empty() ||
+			!amf_output_files.empty() || !nef3_output_files.empty() ||
+			!dxf_output_files.empty() ||
+			!svg_output_files.empty() || !png_output_files.empty();
+
+		if (geometry_outputs || echo_output_file) {
+	#ifdef ENABLE_CGAL
+			bool mesh_outputs =
+				!stl_output_files.empty() || !off_output_files.empty() ||
+				!amf_output_files.empty() || !nef3_output_files.empty() ||
+				!dxf_output_files.empty() ||
+				!svg_output_files.empty();
+			if (!mesh_outputs && !(renderer==Render::CGAL)) {
+				// echo or OpenCSG png -> don't necessarily need CGALMesh evaluation
+			} else {
+				// A frame whose instantiated tree hashes like the previous
+				// one ($t unused, or quantized away at this frame count)
+				// reuses its geometry outright
+				std::string frame_hash = tree.getIdHash(*tree.root());
+				if (!animate_frames || !root_geom || frame_hash != prev_frame_hash) {
+					try {
+						root_geom = geomevaluator.evaluateGeometry(*tree.root(), true);
+					}
+					catch (const ProgressCancelException &e) {
+						// Everything evaluated before the deadline is in the caches -
+						// and on disk with OPENSCAD_CACHE_DIR set - so a rerun with a
+						// fresh budget picks up where this one stopped
+						PRINT("ERROR: Geometry evaluation aborted by timeout.");
+						return 1;
+					}
+					if (!root_geom) {
+						PRINT("No top-level object found.");
+						return 1;
+					}
+					if (Profiler::memProfileEnabled()) Profiler::sampleMemory("geometry evaluation");
+					if (CacheAdvisor::enabled()) {
+						std::string advice = CacheAdvisor::instance()->finishCompile(tree);
+						if (!advice.empty()) PRINT(advice);
+					}
+				}
+				prev_frame_hash = frame_hash;
+			}
 
-		if (deps_output_file) {
-			std::string deps_out( deps_output_file );
-			std::string geom_out;
-			if ( stl_output_file ) geom_out = std::string(stl_output_file);
-			else if ( off_output_file ) geom_out = std::string(off_output_file);
-			else if ( amf_output_file ) geom_out = std::string(amf_output_file);
-			else if ( dxf_output_file ) geom_out = std::string(dxf_output_file);
-			else if ( svg_output_file ) geom_out = std::string(svg_output_file);
-			else if ( png_output_file ) geom_out = std::string(png_output_file);
-			else {
-				PRINTB("Output file:%s\n",output_file);
-				PRINT("Sorry, don't know how to write deps for that file type. Exiting\n");
-				return 1;
+			fs::current_path(original_path);
+
+			if (deps_output_file) {
+				std::string deps_out( deps_output_file );
+				std::string geom_out;
+				if ( !stl_output_files.empty() ) geom_out = stl_output_files.front();
+				else if ( !off_output_files.empty() ) geom_out = off_output_files.front();
+				else if ( !amf_output_files.empty() ) geom_out = amf_output_files.front();
+				else if ( !nef3_output_files.empty() ) geom_out = nef3_output_files.front();
+				else if ( !dxf_output_files.empty() ) geom_out = dxf_output_files.front();
+				else if ( !svg_output_files.empty() ) geom_out = svg_output_files.front();
+				else if ( !png_output_files.empty() ) geom_out = png_output_files.front();
+				else {
+					PRINTB("Output file:%s\n", output_files.front());
+					PRINT("Sorry, don't know how to write deps for that file type. Exiting\n");
+					return 1;
+				}
+				int result = write_deps( deps_out, geom_out );
+				if ( !result ) {
+					PRINT("error writing deps");
+					return 1;
+				}
 			}
-			int result = write_deps( deps_out, geom_out );
-			if ( !result ) {
-				PRINT("error writing deps");
-				return 1;
+
+			// Identity of the geometry behind every output of this run; the
+			// id hash covers the instantiated tree including -D overrides
+			std::string contentid;
+			if (hash_outputs) contentid = tree.getIdHash(*tree.root());
+
+			BOOST_FOREACH(const std::string &stl_output_file, stl_output_files) {
+				if (!checkAndExport(root_geom, 3, OPENSCAD_STL, stl_output_file.c_str(), contentid))
+					return 1;
 			}
-		}
 
-		if (stl_output_file) {
-			if (!checkAndExport(root_geom, 3, OPENSCAD_STL, stl_output_file))
-				return 1;
-		}
+			BOOST_FOREACH(const std::string &off_output_file, off_output_files) {
+				if (!checkAndExport(root_geom, 3, OPENSCAD_OFF, off_output_file.c_str(), contentid))
+					return 1;
+			}
 
-		if (off_output_file) {
-			if (!checkAndExport(root_geom, 3, OPENSCAD_OFF, off_output_file))
-				return 1;
-		}
+			BOOST_FOREACH(const std::string &amf_output_file, amf_output_files) {
+				if (!checkAndExport(root_geom, 3, OPENSCAD_AMF, amf_output_file.c_str(), contentid))
+					return 1;
+			}
 
-		if (amf_output_file) {
-			if (!checkAndExport(root_geom, 3, OPENSCAD_AMF, amf_output_file))
-				return 1;
-		}
+			BOOST_FOREACH(const std::string &nef3_output_file, nef3_output_files) {
+				if (!checkAndExport(root_geom, 3, OPENSCAD_NEF3, nef3_output_file.c_str(), contentid))
+					return 1;
+			}
 
-		if (dxf_output_file) {
-			if (!checkAndExport(root_geom, 2, OPENSCAD_DXF, dxf_output_file))
-				return 1;
-		}
-		
-		if (svg_output_file) {
-			if (!checkAndExport(root_geom, 2, OPENSCAD_SVG, svg_output_file))
-				return 1;
-		}
+			BOOST_FOREACH(const std::string &dxf_output_file, dxf_output_files) {
+				if (!checkAndExport(root_geom, 2, OPENSCAD_DXF, dxf_output_file.c_str(), contentid))
+					return 1;
+			}
 
-		if (png_output_file) {
-			std::ofstream fstream(png_output_file,std::ios::out|std::ios::binary);
-			if (!fstream.is_open()) {
-				PRINTB("Can't open file \"%s\" for export", png_output_file);
+			BOOST_FOREACH(const std::string &svg_output_file, svg_output_files) {
+				if (!checkAndExport(root_geom, 2, OPENSCAD_SVG, svg_output_file.c_str(), contentid))
+					return 1;
 			}
-			else {
-				if (renderer==Render::CGAL) {
-					export_png(root_geom.get(), camera, fstream);
-				} else if (renderer==Render::THROWNTOGETHER) {
-					export_png_with_throwntogether(tree, camera, fstream);
-				} else {
-					export_png_with_opencsg(tree, camera, fstream);
+
+			BOOST_FOREACH(const std::string &png_output_file, png_output_files) {
+				std::string png_name = png_output_file;
+				if (animate_frames) {
+					// The frame number goes between the name and the .png suffix
+					png_name = str(boost::format("%s%05u.png") % png_name.substr(0, png_name.size()-4) % frame);
+					// Frames hand their pixels to the background encoder pool so
+					// the next frame can start rendering while this one compresses
+					if (renderer==Render::CGAL) {
+						export_png_async(root_geom, camera, png_name);
+					} else if (renderer==Render::THROWNTOGETHER) {
+						export_png_with_throwntogether_async(tree, camera, png_name);
+					} else {
+						export_png_with_opencsg_async(tree, camera, png_name);
+					}
+					PRINTB("Camera eye: %f %f %f\n", camera.eye[0] % camera.eye[1] % camera.eye[2]);
+					continue;
+				}
+				std::ofstream fstream(png_name.c_str(),std::ios::out|std::ios::binary);
+				if (!fstream.is_open()) {
+					PRINTB("Can't open file \"%s\" for export", png_name);
+				}
+				else {
+					if (renderer==Render::CGAL) {
+						export_png(root_geom, camera, fstream);
+					} else if (renderer==Render::THROWNTOGETHER) {
+						export_png_with_throwntogether(tree, camera, fstream);
+					} else {
+						export_png_with_opencsg(tree, camera, fstream);
+					}
+					PRINTB("Camera eye: %f %f %f\n", camera.eye[0] % camera.eye[1] % camera.eye[2]);
+					fstream.close();
 				}
-				PRINTB("Camera eye: %f %f %f\n", camera.eye[0] % camera.eye[1] % camera.eye[2]);
-				fstream.close();
 			}
+	#else
+			PRINT("OpenSCAD has been compiled without CGAL support!\n");
+			return 1;
+	#endif
 		}
-#else
-		PRINT("OpenSCAD has been compiled without CGAL support!\n");
-		return 1;
+		if (Profiler::memProfileEnabled()) Profiler::sampleMemory("export");
+		delete root_node;
+	}
+#ifdef ENABLE_CGAL
+	if (animate_frames) finish_png_exports();
 #endif
+	if (stamp_output_file) {
+		fs::current_path(original_path);
+		if (!write_dep_stamp(stamp_output_file, commandline_commands)) {
+			PRINT("error writing dependency stamp");
+			return 1;
+		}
+	}
+	if (Profiler::enabled()) {
+		PRINT(Profiler::report());
+		std::string modulereport = Profiler::moduleReport(20);
+		if (!modulereport.empty()) PRINT(modulereport);
+	}
+	if (Profiler::memProfileEnabled()) {
+		std::string memreport = Profiler::memReport();
+		if (!memreport.empty()) PRINT(memreport);
 	}
-	delete root_node;
 	return 0;
 }
 
@@ -595,8 +888,12 @@ int main(int argc, char **argv)
 
 	fs::path original_path = fs::current_path();
 
-	const char *output_file = NULL;
+	vector<string> output_files;
 	const char *deps_output_file = NULL;
+	const char *stamp_output_file = NULL;
+	bool skip_if_unchanged = false;
+	bool hash_outputs = false;
+	unsigned animate_frames = 0;
 
 	po::options_description desc("Allowed options");
 	desc.add_options()
@@ -606,14 +903,27 @@ int main(int argc, char **argv)
 		("render", "if exporting a png image, do a full CGAL render")
 		("preview", po::value<string>(), "if exporting a png image, do an OpenCSG(default) or ThrownTogether preview")
 		("csglimit", po::value<unsigned int>(), "if exporting a png image, stop rendering at the given number of CSG elements")
+		("profile", "print a per-phase timing breakdown after rendering")
+		("advise-render", "suggest render() placements from measured subtree costs")
+		("memory-budget", po::value<unsigned int>(), "degrade evaluation (shed caches, coarsen tessellation, drop subtrees) when resident memory exceeds this many megabytes, instead of running out")
+		("profile-mem", "track memory watermarks per phase and report which subtree was active at the peak")
+		("timeout", po::value<double>(), "abort geometry evaluation after the given number of seconds; completed subtrees stay cached")
+		("jobs", po::value<unsigned>(), "evaluate up to N batch inputs in parallel; all jobs share the in-process caches")
+		("threads", po::value<unsigned>(), "number of worker threads for the parallel features (default: all cores; also OPENSCAD_NUM_THREADS)")
+		("checkpoint", po::value<string>(), "persist completed render state to the given directory; rerunning with the same directory resumes an interrupted render from there")
 		("camera", po::value<string>(), "parameters for camera when exporting png")
 		("imgsize", po::value<string>(), "=width,height for exporting png")
 		("projection", po::value<string>(), "(o)rtho or (p)erspective when exporting png")
+		("animate", po::value<unsigned>(), "export N animation frames spanning $t=[0,1) to numbered png files")
+		("watch", "stay alive after rendering and re-render whenever the input file or anything it includes changes")
 		("debug", po::value<string>(), "special debug info")
-		("o,o", po::value<string>(), "out-file")
+		("o,o", po::value<vector<string> >(), "out-file (may be given multiple times; all formats are exported from one evaluation)")
 		("s,s", po::value<string>(), "stl-file")
 		("x,x", po::value<string>(), "dxf-file")
 		("d,d", po::value<string>(), "deps-file")
+		("stamp", po::value<string>(), "after rendering, write content hashes of all dependencies and the -D overrides to this file")
+		("skip-if-unchanged", "exit immediately when the --stamp file still matches; use where make can't see -D changes")
+		("hash-outputs", "skip rewriting geometry output files whose content is unchanged, preserving their mtime; the hash is recorded in a <output>.hash sidecar")
 		("m,m", po::value<string>(), "makefile")
 		("D,D", po::value<vector<string> >(), "var=val")
 #ifdef ENABLE_EXPERIMENTAL
@@ -660,20 +970,61 @@ int main(int argc, char **argv)
 		RenderSettings::inst()->openCSGTermLimit = vm["csglimit"].as<unsigned int>();
 	}
 
+	if (vm.count("profile")) {
+		Profiler::enable();
+		Profiler::enableModuleAttribution();
+	}
+
+	if (vm.count("advise-render")) {
+		CacheAdvisor::enable();
+	}
+	if (vm.count("memory-budget")) {
+		MemoryPressure::setBudget((size_t)vm["memory-budget"].as<unsigned int>() * 1024UL * 1024UL);
+	}
+	if (vm.count("profile-mem")) {
+		Profiler::enableMemProfile();
+	}
+
+	if (vm.count("timeout")) {
+		progress_set_deadline(vm["timeout"].as<double>());
+	}
+
+	if (vm.count("checkpoint")) {
+#ifdef ENABLE_CGAL
+		// Completed Nefs stream to the directory as evaluation goes; after
+		// OOM or preemption the next run resumes from them via disk cache
+		// hits, since the cache keys fully encode the traversal position
+		CGALCache::instance()->setDiskCachePath(vm["checkpoint"].as<string>());
+#else
+		PRINT("WARNING: --checkpoint requires CGAL support");
+#endif
+	}
+
+	if (vm.count("threads")) {
+		WorkerPool::setNumThreads(vm["threads"].as<unsigned>());
+	}
+
+	unsigned jobs = 1;
+	if (vm.count("jobs")) {
+		jobs = vm["jobs"].as<unsigned>();
+		if (jobs < 1) jobs = 1;
+	}
+
 	if (vm.count("o")) {
-		// FIXME: Allow for multiple output files?
-		if (output_file) help(argv[0]);
-		output_file = vm["o"].as<string>().c_str();
+		output_files = vm["o"].as<vector<string> >();
 	}
 	if (vm.count("s")) {
 		printDeprecation("DEPRECATED: The -s option is deprecated. Use -o instead.\n");
-		if (output_file) help(argv[0]);
-		output_file = vm["s"].as<string>().c_str();
+		if (!output_files.empty()) help(argv[0]);
+		output_files.push_back(vm["s"].as<string>());
 	}
-	if (vm.count("x")) { 
+	if (vm.count("x")) {
 		printDeprecation("DEPRECATED: The -x option is deprecated. Use -o instead.\n");
-		if (output_file) help(argv[0]);
-		output_file = vm["x"].as<string>().c_str();
+		if (!output_files.empty()) help(argv[0]);
+		output_files.push_back(vm["x"].as<string>());
+	}
+	if (vm.count("animate")) {
+		animate_frames = vm["animate"].as<unsigned>();
 	}
 	if (vm.count("d")) {
 		if (deps_output_file)
@@ -685,6 +1036,19 @@ int main(int argc, char **argv)
 			help(argv[0]);
 		make_command = vm["m"].as<string>().c_str();
 	}
+	if (vm.count("stamp")) {
+		stamp_output_file = vm["stamp"].as<string>().c_str();
+	}
+	if (vm.count("skip-if-unchanged")) {
+		if (!stamp_output_file) {
+			PRINT("--skip-if-unchanged needs a --stamp file\n");
+			help(argv[0]);
+		}
+		skip_if_unchanged = true;
+	}
+	if (vm.count("hash-outputs")) {
+		hash_outputs = true;
+	}
 
 	if (vm.count("D")) {
 		BOOST_FOREACH(const string &cmd, vm["D"].as<vector<string> >()) {
@@ -704,7 +1068,9 @@ int main(int argc, char **argv)
 		inputFiles = vm["input-file"].as<vector<string> >();
 	}
 #ifndef ENABLE_MDI
-	if (inputFiles.size() > 1) {
+	// Multiple inputs are fine in cmd-line batch mode, where every input
+	// is rendered to its matching output file by this one process
+	if (inputFiles.size() > 1 && inputFiles.size() != output_files.size()) {
 		help(argv[0]);
 	}
 #endif
@@ -718,13 +1084,76 @@ int main(int argc, char **argv)
 	NodeDumper dumper(nodecache);
 
 	bool cmdlinemode = false;
-	if (output_file) { // cmd-line mode
+	if (!output_files.empty()) { // cmd-line mode
 		cmdlinemode = true;
 		if (!inputFiles.size()) help(argv[0]);
 	}
 
 	if (cmdlinemode) {
-		rc = cmdline(deps_output_file, inputFiles[0], camera, output_file, original_path, renderer, argc, argv);
+		bool watchmode = vm.count("watch") != 0;
+		do {
+			if (inputFiles.size() > 1) {
+				// Batch mode: render every input to its matching output without
+				// restarting the process, so the offscreen GL context and the
+				// geometry caches stay warm from case to case.
+				if (output_files.size() != inputFiles.size()) {
+					PRINT("Batch mode needs exactly one output file per input file\n");
+					rc = 1;
+					break;
+				}
+#ifdef ENABLE_CGAL
+				if (jobs > 1 && !animate_frames) {
+					// Parallel prewarm: evaluate the CGAL-rendered cases over a
+					// worker pool first; the loop below then exports from warm
+					// caches. Exports, the parser and the GL context stay on
+					// this thread. Cases whose output doesn't need a full
+					// render gain nothing from prewarming and are skipped.
+					fs::current_path(original_path);
+					std::vector<std::string> cgal_inputs;
+					for (size_t i = 0; i < inputFiles.size(); i++) {
+						std::string suffix = boosty::extension_str(output_files[i]);
+						boost::algorithm::to_lower(suffix);
+						if (suffix == ".stl" || suffix == ".off" || suffix == ".amf" ||
+								suffix == ".nef3" || suffix == ".dxf" || suffix == ".svg" ||
+								(suffix == ".png" && renderer == Render::CGAL)) {
+							cgal_inputs.push_back(inputFiles[i]);
+						}
+					}
+					if (cgal_inputs.size() > 1) {
+						parser_init(boosty::stringy(boosty::absolute(fs::path(argv[0]).parent_path())));
+						prewarm_batch(cgal_inputs, jobs);
+					}
+				}
+#endif
+				for (size_t i = 0; i < inputFiles.size(); i++) {
+					fs::current_path(original_path);
+					// cmdline() may recenter an unset camera on the scene;
+					// give every case the same starting camera
+					Camera case_camera = camera;
+					vector<string> case_output(1, output_files[i]);
+					if (cmdline(deps_output_file, stamp_output_file, skip_if_unchanged, hash_outputs, inputFiles[i], case_camera, case_output, original_path, renderer, animate_frames, argc, argv)) rc = 1;
+				}
+			}
+			else {
+				fs::current_path(original_path);
+				Camera case_camera = camera;
+				rc = cmdline(deps_output_file, stamp_output_file, skip_if_unchanged, hash_outputs, inputFiles[0], case_camera, output_files, original_path, renderer, animate_frames, argc, argv);
+			}
+			if (watchmode) {
+				// Long-lived headless loop in the spirit of the GUI's
+				// autoReloadTimer: this one process keeps the parsed library
+				// modules (ModuleCache), the geometry caches and the font
+				// scan warm, so re-rendering after an edit skips all startup
+				// cost. A failed render stays in the loop so a fixed source
+				// file is picked up on the next change.
+				if (dependency_files().empty()) break;
+				PRINT("Watching for changes; press Ctrl-C to stop.");
+				const std::string id = watch_state();
+				while (watch_state() == id) {
+					boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+				}
+			}
+		} while (watchmode);
 	}
 	else if (QtUseGUI()) {
 		rc = gui(inputFiles, original_path, argc, argv);
@@ -165,6 +165,7 @@ statement:
         | TOK_FUNCTION TOK_ID '(' arguments_decl optional_commas ')' '=' expr
             {
                 Function *func = new Function();
+                func->name = $2;
                 func->definition_arguments = *$4;
                 func->expr = $8;
                 scope_stack.top()->functions[$2] = func;
@@ -298,6 +299,7 @@ single_module_instantiation:
                 $$ = new ModuleInstantiation($1);
                 $$->arguments = *$3;
                 $$->setPath(parser_source_path);
+                $$->setLine(lexerget_lineno());
                 free($1);
                 delete $3;
             }
@@ -485,6 +487,7 @@ list_comprehension_elements:
                     Expression *e = new Expression("c", $$);
                     e->call_funcname = "for";
                     e->call_arguments.push_back((*$3)[i]);
+                    e->hoistLoopInvariants();
                     $$ = e;
                 }
                 delete $3;
@@ -4,6 +4,7 @@
 #include "boosty.h"
 #include <boost/algorithm/string.hpp>
 #include "PlatformUtils.h"
+#include "statcache.h"
 
 namespace fs = boost::filesystem;
 
@@ -22,7 +23,9 @@ fs::path search_libs(const fs::path &localpath)
 {
 	BOOST_FOREACH(const std::string &dir, librarypath) {
 		fs::path usepath = fs::path(dir) / localpath;
-		if (fs::exists(usepath) && !fs::is_directory(usepath)) {
+		// Cached stats: these probes dominate compile startup on network
+		// filesystems, and a miss in one library dir is retried every compile
+		if (StatCache::exists(usepath) && !StatCache::is_directory(usepath)) {
 			return usepath.string();
 		}
 	}
@@ -42,11 +45,11 @@ static bool check_valid(const fs::path &p, const std::vector<std::string> *openf
 		//PRINTB("WARNING: No parent path: %s",p);
 		return false;
 	}
-	if (!fs::exists(p)) {
+	if (!StatCache::exists(p)) {
 		//PRINTB("WARNING: File not found: %s",p);
 		return false;
 	}
-	if (fs::is_directory(p)) {
+	if (StatCache::is_directory(p)) {
 		//PRINTB("WARNING: %s invalid - points to a directory",p);
 		return false;
 	}
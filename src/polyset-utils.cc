@@ -2,7 +2,15 @@
 #include "polyset.h"
 #include "Polygon2d.h"
 #include "printutils.h"
+#include "workerpool.h"
+#include "feature.h"
 #include "cgal.h"
+#include "Reindexer.h"
+
+#include <algorithm>
+#include <map>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 #ifdef NDEBUG
 #define PREV_NDEBUG NDEBUG
@@ -149,8 +157,10 @@ namespace PolysetUtils {
 	 properly oriented. output is a sequence of 3d triangles. */
 	bool triangulate_polygon( const PolySet::Polygon &pgon, std::vector<PolySet::Polygon> &triangles, projection_t projection )
 	{
+		// Note: the caller is responsible for setting the CGAL error
+		// behaviour to THROW_EXCEPTION; tessellate_faces() does this once
+		// for the whole run since the setting is global.
 		bool err = false;
-		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
 		try {
 			CDT cdt;
 			std::vector<Vertex_handle> vhandles;
@@ -203,37 +213,711 @@ namespace PolysetUtils {
 			PRINTB("CGAL error in dxftess triangulate_polygon: %s", e.what());
 			err = true;
 		}
-		CGAL::set_error_behaviour(old_behaviour);
 		return err;
 	}
 
+/* Cheap convexity test on the projected polygon: returns true when all
+	 turns have the same sign. Strictly convex faces - the overwhelming
+	 majority after CSG - can be fan-triangulated without invoking CGAL.
+	 Collinear points fail the test, so the Delaunay path keeps handling
+	 anything questionable. */
+	bool is_convex_projected( const PolySet::Polygon &pgon, projection_t projection )
+	{
+		size_t n = pgon.size();
+		double sign = 0;
+		for (size_t i = 0; i < n; i++) {
+			Vector2d a = get_projected_point( pgon[i], projection );
+			Vector2d b = get_projected_point( pgon[(i+1)%n], projection );
+			Vector2d c = get_projected_point( pgon[(i+2)%n], projection );
+			double cross = (b.x()-a.x())*(c.y()-a.y()) - (b.y()-a.y())*(c.x()-a.x());
+			if (cross == 0) return false;
+			if (sign == 0) sign = cross;
+			else if ((cross > 0) != (sign > 0)) return false;
+		}
+		return true;
+	}
+
+/* Tessellate a single face into triangles. Convex faces are fanned
+	 from the first vertex, anything else goes through the Constrained
+	 Delaunay path. Safe to call from worker threads. */
+	static void tessellate_face( const PolySet::Polygon &pgon, std::vector<PolySet::Polygon> &triangles )
+	{
+		if (pgon.size()<3) {
+			PRINT("WARNING: PolySet has polygon with <3 points");
+			return;
+		}
+		projection_t goodproj = find_good_projection( pgon );
+		if (goodproj==NONE) {
+			PRINT("WARNING: PolySet has degenerate polygon");
+			return;
+		}
+		if (is_convex_projected( pgon, goodproj )) {
+			for (size_t i = 1; i+1 < pgon.size(); i++) {
+				PolySet::Polygon t;
+				t.push_back(pgon[0]);
+				t.push_back(pgon[i]);
+				t.push_back(pgon[i+1]);
+				triangles.push_back(t);
+			}
+			return;
+		}
+		triangulate_polygon( pgon, triangles, goodproj );
+	}
+
+	// Tessellates faces [first, last) into per-face triangle lists
+	static void tessellate_range( const PolySet *inps, size_t first, size_t last,
+																std::vector<std::vector<PolySet::Polygon> > *results )
+	{
+		for (size_t i = first; i < last; i++) {
+			tessellate_face( inps->polygons[i], (*results)[i] );
+		}
+	}
+
+// Minimum number of faces before spawning worker threads pays off
+#define PARALLEL_TESSELLATE_MIN_FACES 256
+
 /* Given a 3d PolySet with 'near planar' polygonal faces, Tessellate the
 	 faces. As of writing, our only tessellation method is Triangulation
 	 using CGAL's Constrained Delaunay algorithm. This code assumes the input
 	 polyset has simple polygon faces with no holes, no self intersections, no
 	 duplicate points, and proper orientation. */
 	void tessellate_faces(const PolySet &inps, PolySet &outps) {
-		for (size_t i = 0; i < inps.polygons.size(); i++) {
-			const PolySet::Polygon pgon = inps.polygons[i];
-			if (pgon.size()<3) {
-				PRINT("WARNING: PolySet has polygon with <3 points");
-				continue;
-			}
-			projection_t goodproj = find_good_projection( pgon );
-			if (goodproj==NONE) {
-				PRINT("WARNING: PolySet has degenerate polygon");
-				continue;
-			}
-			std::vector<PolySet::Polygon> triangles;
-			bool err = triangulate_polygon( pgon, triangles, goodproj );
-			if (!err) for (size_t j=0;j<triangles.size();j++) {
-					PolySet::Polygon t = triangles[j];
-					outps.append_poly();
-					outps.append_vertex(t[0].x(),t[0].y(),t[0].z());
-					outps.append_vertex(t[1].x(),t[1].y(),t[1].z());
-					outps.append_vertex(t[2].x(),t[2].y(),t[2].z());
+		inps.ensureLoaded();
+		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+
+		// Faces are independent, so with the parallel-csg flag enabled the
+		// work is chunked across worker threads into per-face slots and
+		// merged in order afterwards.
+		std::vector<std::vector<PolySet::Polygon> > results(inps.polygons.size());
+		size_t numthreads = WorkerPool::numThreads();
+		if (Feature::ExperimentalParallelCSG.is_enabled() &&
+				numthreads >= 2 && inps.polygons.size() >= PARALLEL_TESSELLATE_MIN_FACES) {
+			WorkerPool::TaskGroup tasks;
+			size_t chunksize = (inps.polygons.size() + numthreads - 1) / numthreads;
+			for (size_t first = 0; first < inps.polygons.size(); first += chunksize) {
+				size_t last = std::min(first + chunksize, inps.polygons.size());
+				tasks.run(boost::bind(tessellate_range, &inps, first, last, &results));
+			}
+			tasks.wait();
+		}
+		else {
+			tessellate_range(&inps, 0, inps.polygons.size(), &results);
+		}
+
+		CGAL::set_error_behaviour(old_behaviour);
+
+		for (size_t i = 0; i < results.size(); i++) {
+			for (size_t j = 0; j < results[i].size(); j++) {
+				const PolySet::Polygon &t = results[i][j];
+				outps.append_poly();
+				outps.append_vertex(t[0].x(),t[0].y(),t[0].z());
+				outps.append_vertex(t[1].x(),t[1].y(),t[1].z());
+				outps.append_vertex(t[2].x(),t[2].y(),t[2].z());
+			}
+		}
+	}
+
+/* Subdivision surfaces (the subdiv() module)
+
+	 Each refinement level rebuilds the mesh from its indexed form: a new
+	 point per face, per edge and per original vertex, connected into
+	 quads (Catmull-Clark) or triangles (Loop). The point classes only
+	 read the input mesh and the already finished face points, so each is
+	 an independent loop over its elements, chunked across worker threads
+	 the same way as tessellate_faces() above. Boundary and non-manifold
+	 edges fall back to midpoint/crease rules so imperfect input still
+	 refines instead of failing. */
+
+	typedef std::pair<int, int> MeshEdge;
+
+	// Indexed mesh plus the adjacency needed by one subdivision level;
+	// built sequentially, read concurrently by the point passes
+	struct SubdivTopology {
+		std::vector<Vector3d> vertices;
+		std::vector<PolySet::IndexedFace> faces;
+		std::vector<MeshEdge> edges;                  // endpoints, smaller index first
+		std::vector<std::vector<int> > edge_faces;    // faces sharing each edge
+		std::vector<PolySet::IndexedFace> face_edges; // per face corner i: edge v_i..v_i+1
+		std::vector<std::vector<int> > vert_faces;    // faces around each vertex
+		std::vector<std::vector<int> > vert_edges;    // edges around each vertex
+	};
+
+	static void build_subdiv_topology(SubdivTopology &topo)
+	{
+		std::map<MeshEdge, int> edge_ids;
+		topo.face_edges.resize(topo.faces.size());
+		topo.vert_faces.resize(topo.vertices.size());
+		topo.vert_edges.resize(topo.vertices.size());
+		for (size_t f = 0; f < topo.faces.size(); f++) {
+			const PolySet::IndexedFace &face = topo.faces[f];
+			topo.face_edges[f].resize(face.size());
+			for (size_t i = 0; i < face.size(); i++) {
+				int a = face[i], b = face[(i+1) % face.size()];
+				topo.vert_faces[a].push_back(f);
+				MeshEdge key(std::min(a,b), std::max(a,b));
+				std::map<MeshEdge, int>::const_iterator it = edge_ids.find(key);
+				int e;
+				if (it == edge_ids.end()) {
+					e = topo.edges.size();
+					edge_ids[key] = e;
+					topo.edges.push_back(key);
+					topo.edge_faces.push_back(std::vector<int>());
+					topo.vert_edges[a].push_back(e);
+					topo.vert_edges[b].push_back(e);
+				}
+				else e = it->second;
+				topo.edge_faces[e].push_back(f);
+				topo.face_edges[f][i] = e;
+			}
+		}
+	}
+
+	// The point passes share one signature so run_point_pass() can chunk
+	// any of them; facepoints is NULL for the passes that don't need it
+	typedef void (*subdiv_point_fn)(const SubdivTopology *, const std::vector<Vector3d> *,
+																	size_t, size_t, std::vector<Vector3d> *);
+
+	static void facepoint_range(const SubdivTopology *topo, const std::vector<Vector3d> *,
+															size_t first, size_t last, std::vector<Vector3d> *facepoints)
+	{
+		for (size_t f = first; f < last; f++) {
+			const PolySet::IndexedFace &face = topo->faces[f];
+			Vector3d sum(0, 0, 0);
+			for (size_t i = 0; i < face.size(); i++) sum += topo->vertices[face[i]];
+			(*facepoints)[f] = sum / face.size();
+		}
+	}
+
+	static void cc_edgepoint_range(const SubdivTopology *topo, const std::vector<Vector3d> *facepoints,
+																 size_t first, size_t last, std::vector<Vector3d> *edgepoints)
+	{
+		for (size_t e = first; e < last; e++) {
+			const Vector3d &a = topo->vertices[topo->edges[e].first];
+			const Vector3d &b = topo->vertices[topo->edges[e].second];
+			const std::vector<int> &adj = topo->edge_faces[e];
+			if (adj.size() == 2) {
+				(*edgepoints)[e] = (a + b + (*facepoints)[adj[0]] + (*facepoints)[adj[1]]) / 4;
+			}
+			else {
+				(*edgepoints)[e] = (a + b) / 2;
+			}
+		}
+	}
+
+	static void cc_vertexpoint_range(const SubdivTopology *topo, const std::vector<Vector3d> *facepoints,
+																	 size_t first, size_t last, std::vector<Vector3d> *vertexpoints)
+	{
+		for (size_t v = first; v < last; v++) {
+			const Vector3d &p = topo->vertices[v];
+			const std::vector<int> &vfaces = topo->vert_faces[v];
+			const std::vector<int> &vedges = topo->vert_edges[v];
+			size_t n = vfaces.size();
+			if (n >= 3 && vedges.size() == n) {
+				// Interior vertex: (Q + 2R + (n-3)P) / n with Q the average
+				// adjacent face point and R the average incident edge midpoint
+				Vector3d q(0, 0, 0), r(0, 0, 0);
+				for (size_t i = 0; i < n; i++) q += (*facepoints)[vfaces[i]];
+				q /= n;
+				for (size_t i = 0; i < vedges.size(); i++) {
+					r += (topo->vertices[topo->edges[vedges[i]].first] +
+								topo->vertices[topo->edges[vedges[i]].second]) / 2;
+				}
+				r /= vedges.size();
+				(*vertexpoints)[v] = (q + 2*r + (n-3)*p) / n;
+			}
+			else {
+				// Boundary vertex: crease rule over the two boundary edges;
+				// anything stranger keeps its position
+				Vector3d m(0, 0, 0);
+				size_t boundary = 0;
+				for (size_t i = 0; i < vedges.size(); i++) {
+					if (topo->edge_faces[vedges[i]].size() == 1) {
+						m += (topo->vertices[topo->edges[vedges[i]].first] +
+									topo->vertices[topo->edges[vedges[i]].second]) / 2;
+						boundary++;
+					}
+				}
+				if (boundary == 2) (*vertexpoints)[v] = (m + 6*p) / 8;
+				else (*vertexpoints)[v] = p;
+			}
+		}
+	}
+
+	static void loop_edgepoint_range(const SubdivTopology *topo, const std::vector<Vector3d> *,
+																	 size_t first, size_t last, std::vector<Vector3d> *edgepoints)
+	{
+		for (size_t e = first; e < last; e++) {
+			int ia = topo->edges[e].first, ib = topo->edges[e].second;
+			const Vector3d &a = topo->vertices[ia];
+			const Vector3d &b = topo->vertices[ib];
+			const std::vector<int> &adj = topo->edge_faces[e];
+			if (adj.size() == 2) {
+				// 3/8 of the endpoints plus 1/8 of the two opposite corners
+				Vector3d opp(0, 0, 0);
+				for (size_t k = 0; k < 2; k++) {
+					const PolySet::IndexedFace &face = topo->faces[adj[k]];
+					for (size_t i = 0; i < face.size(); i++) {
+						if (face[i] != ia && face[i] != ib) opp += topo->vertices[face[i]];
+					}
+				}
+				(*edgepoints)[e] = 0.375*(a + b) + 0.125*opp;
+			}
+			else {
+				(*edgepoints)[e] = (a + b) / 2;
+			}
+		}
+	}
+
+	static void loop_vertexpoint_range(const SubdivTopology *topo, const std::vector<Vector3d> *,
+																		 size_t first, size_t last, std::vector<Vector3d> *vertexpoints)
+	{
+		for (size_t v = first; v < last; v++) {
+			const Vector3d &p = topo->vertices[v];
+			const std::vector<int> &vedges = topo->vert_edges[v];
+			Vector3d ringsum(0, 0, 0), boundarysum(0, 0, 0);
+			size_t boundary = 0;
+			for (size_t i = 0; i < vedges.size(); i++) {
+				const MeshEdge &edge = topo->edges[vedges[i]];
+				const Vector3d &other = topo->vertices[edge.first == (int)v ? edge.second : edge.first];
+				ringsum += other;
+				if (topo->edge_faces[vedges[i]].size() == 1) {
+					boundarysum += other;
+					boundary++;
+				}
+			}
+			size_t n = vedges.size();
+			if (boundary == 2) {
+				(*vertexpoints)[v] = 0.75*p + 0.125*boundarysum;
+			}
+			else if (n >= 3) {
+				double beta = (n == 3) ? 3.0/16 : 3.0/(8*n);
+				(*vertexpoints)[v] = (1 - n*beta)*p + beta*ringsum;
+			}
+			else {
+				(*vertexpoints)[v] = p;
+			}
+		}
+	}
+
+// Minimum number of elements in a point pass before threads pay off
+#define PARALLEL_SUBDIV_MIN_ELEMENTS 1024
+
+	static void run_point_pass(subdiv_point_fn fn, const SubdivTopology &topo,
+														 const std::vector<Vector3d> *facepoints,
+														 size_t count, std::vector<Vector3d> &out)
+	{
+		out.resize(count);
+		size_t numthreads = WorkerPool::numThreads();
+		if (Feature::ExperimentalParallelCSG.is_enabled() &&
+				numthreads >= 2 && count >= PARALLEL_SUBDIV_MIN_ELEMENTS) {
+			WorkerPool::TaskGroup tasks;
+			size_t chunksize = (count + numthreads - 1) / numthreads;
+			for (size_t first = 0; first < count; first += chunksize) {
+				size_t last = std::min(first + chunksize, count);
+				tasks.run(boost::bind(fn, &topo, facepoints, first, last, &out));
+			}
+			tasks.wait();
+		}
+		else {
+			fn(&topo, facepoints, 0, count, &out);
+		}
+	}
+
+	// Replaces the mesh in topo with the next refinement level
+	static void subdivide_level(SubdivTopology &topo, bool loop_scheme)
+	{
+		build_subdiv_topology(topo);
+
+		std::vector<Vector3d> facepoints, edgepoints, vertexpoints;
+		if (!loop_scheme) {
+			run_point_pass(facepoint_range, topo, NULL, topo.faces.size(), facepoints);
+		}
+		run_point_pass(loop_scheme ? loop_edgepoint_range : cc_edgepoint_range,
+									 topo, &facepoints, topo.edges.size(), edgepoints);
+		run_point_pass(loop_scheme ? loop_vertexpoint_range : cc_vertexpoint_range,
+									 topo, &facepoints, topo.vertices.size(), vertexpoints);
+
+		// New vertex table: repositioned originals, then (Catmull-Clark
+		// only) face points, then edge points
+		size_t nv = topo.vertices.size(), nf = topo.faces.size();
+		std::vector<Vector3d> newverts;
+		std::vector<PolySet::IndexedFace> newfaces;
+		newverts.swap(vertexpoints);
+		if (!loop_scheme) newverts.insert(newverts.end(), facepoints.begin(), facepoints.end());
+		newverts.insert(newverts.end(), edgepoints.begin(), edgepoints.end());
+		size_t edgebase = loop_scheme ? nv : nv + nf;
+
+		if (loop_scheme) {
+			newfaces.reserve(nf * 4);
+			for (size_t f = 0; f < nf; f++) {
+				const PolySet::IndexedFace &face = topo.faces[f];
+				int e01 = edgebase + topo.face_edges[f][0];
+				int e12 = edgebase + topo.face_edges[f][1];
+				int e20 = edgebase + topo.face_edges[f][2];
+				PolySet::IndexedFace tri(3);
+				tri[0] = face[0]; tri[1] = e01; tri[2] = e20; newfaces.push_back(tri);
+				tri[0] = face[1]; tri[1] = e12; tri[2] = e01; newfaces.push_back(tri);
+				tri[0] = face[2]; tri[1] = e20; tri[2] = e12; newfaces.push_back(tri);
+				tri[0] = e01; tri[1] = e12; tri[2] = e20; newfaces.push_back(tri);
+			}
+		}
+		else {
+			// One quad per face corner: corner, outgoing edge point, face
+			// point, incoming edge point keeps the original winding
+			for (size_t f = 0; f < nf; f++) {
+				const PolySet::IndexedFace &face = topo.faces[f];
+				size_t k = face.size();
+				for (size_t i = 0; i < k; i++) {
+					PolySet::IndexedFace quad(4);
+					quad[0] = face[i];
+					quad[1] = edgebase + topo.face_edges[f][i];
+					quad[2] = nv + f;
+					quad[3] = edgebase + topo.face_edges[f][(i + k - 1) % k];
+					newfaces.push_back(quad);
 				}
+			}
+		}
+
+		topo.vertices.swap(newverts);
+		topo.faces.swap(newfaces);
+		topo.edges.clear();
+		topo.edge_faces.clear();
+		topo.face_edges.clear();
+		topo.vert_faces.clear();
+		topo.vert_edges.clear();
+	}
+
+/* Refine a 3d PolySet with the given number of subdivision levels.
+	 scheme selects the rules: "loop" runs Loop subdivision (defined on
+	 triangle meshes; other input is triangulated first), anything else
+	 runs Catmull-Clark. Face count grows geometrically per level, so
+	 callers should keep levels small. */
+	void subdivide(const PolySet &inps, PolySet &outps, const std::string &scheme, int levels)
+	{
+		bool loop_scheme = (scheme == "loop");
+		if (!loop_scheme && !scheme.empty() &&
+				scheme != "catmull-clark" && scheme != "catmullclark") {
+			PRINTB("WARNING: Unknown subdivision type '%s', using catmull-clark.", scheme);
+		}
+
+		SubdivTopology topo;
+		inps.getIndexedMesh(topo.vertices, topo.faces);
+
+		if (loop_scheme) {
+			bool alltriangles = true;
+			for (size_t f = 0; f < topo.faces.size(); f++) {
+				if (topo.faces[f].size() != 3) { alltriangles = false; break; }
+			}
+			if (!alltriangles) {
+				PolySet triangulated(3);
+				tessellate_faces(inps, triangulated);
+				topo.vertices.clear();
+				topo.faces.clear();
+				triangulated.getIndexedMesh(topo.vertices, topo.faces);
+			}
+		}
+
+		for (int l = 0; l < levels; l++) subdivide_level(topo, loop_scheme);
+
+		outps.reserve(topo.faces.size());
+		BOOST_FOREACH(const PolySet::IndexedFace &face, topo.faces) {
+			outps.append_poly(face.size());
+			BOOST_FOREACH(int idx, face) {
+				outps.append_vertex(topo.vertices[idx]);
+			}
+		}
+	}
+
+/* Display-quality mesh decimation
+
+	 Collapses the mesh onto a uniform grid: all vertices falling into
+	 the same cell merge into one representative, and triangles whose
+	 corners end up in fewer than three distinct cells vanish. The
+	 representative minimizes the summed squared distance to the faces
+	 incident on the cell - the quadric error metric of edge-collapse
+	 simplifiers - so flat regions keep their planes and creases pull
+	 the representative onto the feature instead of the cell centroid.
+	 Cells are independent, so the reduction parallelizes cleanly where
+	 a collapse queue would order every edge globally.
+
+	 The output is only accurate to within a cell and may contain
+	 non-manifold contacts or duplicated triangles, so it is display
+	 material: lod-preview hangs it behind exact render results (see
+	 cgalworker.cc) and exports never see it. */
+
+#define PARALLEL_DECIMATE_MIN_FACES 4096
+
+	// Accumulated error form E(v) = v^T A v + 2 b.v + c of the face
+	// planes incident on one grid cell, plus the incidence-weighted
+	// vertex centroid used when minimizing E is ill-conditioned
+	struct CellQuadric {
+		double a[6]; // upper triangle of A: xx xy xz yy yz zz
+		double b[3];
+		double c;
+		Vector3d sum;
+		size_t count;
+
+		CellQuadric() : c(0), sum(0, 0, 0), count(0) {
+			for (int i = 0; i < 6; i++) this->a[i] = 0;
+			for (int i = 0; i < 3; i++) this->b[i] = 0;
+		}
+
+		void addCorner(const Vector3d &n, double d, double w, const Vector3d &v) {
+			this->a[0] += w*n[0]*n[0]; this->a[1] += w*n[0]*n[1]; this->a[2] += w*n[0]*n[2];
+			this->a[3] += w*n[1]*n[1]; this->a[4] += w*n[1]*n[2]; this->a[5] += w*n[2]*n[2];
+			this->b[0] += w*d*n[0]; this->b[1] += w*d*n[1]; this->b[2] += w*d*n[2];
+			this->c += w*d*d;
+			this->sum += v;
+			this->count++;
+		}
+
+		void merge(const CellQuadric &other) {
+			for (int i = 0; i < 6; i++) this->a[i] += other.a[i];
+			for (int i = 0; i < 3; i++) this->b[i] += other.b[i];
+			this->c += other.c;
+			this->sum += other.sum;
+			this->count += other.count;
+		}
+
+		// Position minimizing E, clamped back to the centroid when the
+		// quadric is singular (coplanar faces) or the minimum runs away
+		// along a near-singular direction
+		Vector3d position(double cell_size) const {
+			Vector3d centroid = this->sum / this->count;
+			Matrix3d A;
+			A << this->a[0], this->a[1], this->a[2],
+				this->a[1], this->a[3], this->a[4],
+				this->a[2], this->a[4], this->a[5];
+			Vector3d rhs(-this->b[0], -this->b[1], -this->b[2]);
+			Eigen::FullPivLU<Matrix3d> lu(A);
+			lu.setThreshold(1e-6);
+			if (!lu.isInvertible()) return centroid;
+			Vector3d pos = lu.solve(rhs);
+			if ((pos - centroid).norm() > 2 * cell_size) return centroid;
+			return pos;
+		}
+	};
+
+	typedef boost::unordered_map<size_t, CellQuadric> cell_quadric_map;
+
+	static void accumulate_quadric_range(const std::vector<Vector3d> *vertices,
+																			 const std::vector<PolySet::IndexedFace> *faces,
+																			 const std::vector<size_t> *vertex_cells,
+																			 size_t first, size_t last,
+																			 cell_quadric_map *result)
+	{
+		for (size_t f = first; f < last; f++) {
+			const PolySet::IndexedFace &face = (*faces)[f];
+			const Vector3d &v0 = (*vertices)[face[0]];
+			const Vector3d &v1 = (*vertices)[face[1]];
+			const Vector3d &v2 = (*vertices)[face[2]];
+			Vector3d n = (v1 - v0).cross(v2 - v0);
+			double area2 = n.norm();
+			if (area2 <= 0) continue; // degenerate; adds no plane
+			n /= area2;
+			double d = -n.dot(v0);
+			for (int i = 0; i < 3; i++) {
+				const Vector3d &v = (*vertices)[face[i]];
+				(*result)[(*vertex_cells)[face[i]]].addCorner(n, d, area2 / 2, v);
+			}
+		}
+	}
+
+	void decimate(const PolySet &inps, PolySet &outps, double cell_size)
+	{
+		if (cell_size <= 0) return;
+
+		std::vector<Vector3d> vertices;
+		std::vector<PolySet::IndexedFace> faces;
+		inps.getIndexedMesh(vertices, faces);
+
+		bool alltriangles = true;
+		for (size_t f = 0; f < faces.size(); f++) {
+			if (faces[f].size() != 3) { alltriangles = false; break; }
+		}
+		if (!alltriangles) {
+			PolySet triangulated(3);
+			tessellate_faces(inps, triangulated);
+			vertices.clear();
+			faces.clear();
+			triangulated.getIndexedMesh(vertices, faces);
+		}
+		if (vertices.empty() || faces.empty()) return;
+
+		// Grid anchored at the bounding box corner
+		Vector3d minpt = vertices[0];
+		for (size_t i = 1; i < vertices.size(); i++) {
+			minpt = minpt.cwiseMin(vertices[i]);
+		}
+		Vector3d maxpt = vertices[0];
+		for (size_t i = 1; i < vertices.size(); i++) {
+			maxpt = maxpt.cwiseMax(vertices[i]);
+		}
+		size_t nx = (size_t)((maxpt[0] - minpt[0]) / cell_size) + 1;
+		size_t ny = (size_t)((maxpt[1] - minpt[1]) / cell_size) + 1;
+		std::vector<size_t> vertex_cells(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++) {
+			const Vector3d &v = vertices[i];
+			size_t ix = (size_t)((v[0] - minpt[0]) / cell_size);
+			size_t iy = (size_t)((v[1] - minpt[1]) / cell_size);
+			size_t iz = (size_t)((v[2] - minpt[2]) / cell_size);
+			vertex_cells[i] = (iz * ny + iy) * nx + ix;
+		}
+
+		// Per-cell quadrics: cells are independent, so the face sweep is
+		// chunked across worker threads into private maps and merged,
+		// like the tessellation above
+		cell_quadric_map cells;
+		size_t numthreads = WorkerPool::numThreads();
+		if (numthreads >= 2 && faces.size() >= PARALLEL_DECIMATE_MIN_FACES) {
+			std::vector<cell_quadric_map> partials(numthreads);
+			WorkerPool::TaskGroup tasks;
+			size_t chunksize = (faces.size() + numthreads - 1) / numthreads;
+			for (size_t t = 0; t < numthreads; t++) {
+				size_t first = t * chunksize;
+				size_t last = std::min(first + chunksize, faces.size());
+				if (first >= last) break;
+				tasks.run(boost::bind(accumulate_quadric_range, &vertices, &faces,
+															&vertex_cells, first, last, &partials[t]));
+			}
+			tasks.wait();
+			for (size_t t = 0; t < numthreads; t++) {
+				BOOST_FOREACH(cell_quadric_map::value_type &entry, partials[t]) {
+					cell_quadric_map::iterator it = cells.find(entry.first);
+					if (it == cells.end()) cells.insert(entry);
+					else it->second.merge(entry.second);
+				}
+			}
+		}
+		else {
+			accumulate_quadric_range(&vertices, &faces, &vertex_cells, 0, faces.size(), &cells);
+		}
+
+		boost::unordered_map<size_t, Vector3d> representatives;
+		BOOST_FOREACH(const cell_quadric_map::value_type &entry, cells) {
+			if (entry.second.count == 0) continue;
+			representatives[entry.first] = entry.second.position(cell_size);
+		}
+
+		// Original windings survive the collapse, so orientation is kept
+		BOOST_FOREACH(const PolySet::IndexedFace &face, faces) {
+			size_t c0 = vertex_cells[face[0]];
+			size_t c1 = vertex_cells[face[1]];
+			size_t c2 = vertex_cells[face[2]];
+			if (c0 == c1 || c1 == c2 || c0 == c2) continue;
+			outps.append_poly(3);
+			outps.append_vertex(representatives[c0]);
+			outps.append_vertex(representatives[c1]);
+			outps.append_vertex(representatives[c2]);
+		}
+	}
+
+	// Returns true if the face traverses the directed edge a->b
+	static bool face_has_directed_edge(const std::vector<int> &face, int a, int b)
+	{
+		for (size_t i = 0; i < face.size(); i++) {
+			if (face[i] == a && face[(i+1) % face.size()] == b) return true;
+		}
+		return false;
+	}
+
+/* Diagnose and (within bounds) repair a freshly imported mesh: weld
+	 exactly duplicated vertices, drop degenerate faces, flip faces until
+	 neighbouring facets agree on their winding, and warn about open and
+	 non-manifold edges. Scanner output and hand-written STL frequently
+	 fail only on these cheap-to-fix defects; cleaning them up here lets
+	 createNefPolyhedronFromPolySet() take the fast Polyhedron_3 path
+	 instead of failing into an empty result. Hole filling is deliberately
+	 out of scope - open meshes are reported, not patched.
+
+	 Returns true if the polygon data was modified. */
+	bool repair_mesh(PolySet &ps)
+	{
+		// Weld duplicated vertices into indexed faces, dropping faces
+		// that collapse below three distinct corners
+		Reindexer<Vector3d> reindexer;
+		std::vector<std::vector<int> > faces;
+		faces.reserve(ps.polygons.size());
+		size_t degenerate = 0;
+		BOOST_FOREACH(const PolySet::Polygon &pgon, ps.polygons) {
+			std::vector<int> face;
+			face.reserve(pgon.size());
+			BOOST_FOREACH(const Vector3d &v, pgon) {
+				int idx = reindexer.lookup(v);
+				if (face.empty() || face.back() != idx) face.push_back(idx);
+			}
+			while (face.size() > 1 && face.front() == face.back()) face.pop_back();
+			if (face.size() < 3) degenerate++;
+			else faces.push_back(face);
+		}
+
+		// Map each undirected edge to its adjacent faces
+		typedef std::pair<int, int> Edge;
+		typedef std::map<Edge, std::vector<int> > EdgeMap;
+		EdgeMap edge_faces;
+		for (size_t i = 0; i < faces.size(); i++) {
+			const std::vector<int> &face = faces[i];
+			for (size_t j = 0; j < face.size(); j++) {
+				int a = face[j], b = face[(j+1) % face.size()];
+				edge_faces[Edge(std::min(a,b), std::max(a,b))].push_back(i);
+			}
+		}
+
+		size_t open_edges = 0, nonmanifold_edges = 0;
+		for (EdgeMap::const_iterator it = edge_faces.begin(); it != edge_faces.end(); it++) {
+			if (it->second.size() == 1) open_edges++;
+			else if (it->second.size() > 2) nonmanifold_edges++;
+		}
+		if (open_edges) PRINTB("WARNING: Imported mesh is not closed: %d open edge(s).", open_edges);
+		if (nonmanifold_edges) PRINTB("WARNING: Imported mesh has %d non-manifold edge(s).", nonmanifold_edges);
+
+		// Walk the face adjacency and flip any face whose winding
+		// disagrees with an already visited neighbour. Non-manifold
+		// edges are skipped since orientation across them is undefined.
+		size_t flipped = 0;
+		std::vector<char> visited(faces.size(), 0);
+		std::vector<int> pending;
+		for (size_t seed = 0; seed < faces.size(); seed++) {
+			if (visited[seed]) continue;
+			visited[seed] = 1;
+			pending.push_back(seed);
+			while (!pending.empty()) {
+				int fi = pending.back();
+				pending.pop_back();
+				const std::vector<int> &face = faces[fi];
+				for (size_t j = 0; j < face.size(); j++) {
+					int a = face[j], b = face[(j+1) % face.size()];
+					const std::vector<int> &adj = edge_faces[Edge(std::min(a,b), std::max(a,b))];
+					if (adj.size() != 2) continue;
+					int ni = (adj[0] == fi) ? adj[1] : adj[0];
+					if (visited[ni]) continue;
+					visited[ni] = 1;
+					// A consistently wound neighbour traverses the shared
+					// edge in the opposite direction
+					if (face_has_directed_edge(faces[ni], a, b)) {
+						std::reverse(faces[ni].begin(), faces[ni].end());
+						flipped++;
+					}
+					pending.push_back(ni);
+				}
+			}
+		}
+
+		if (!degenerate && !flipped) return false;
+
+		if (degenerate) PRINTB("Removed %d degenerate face(s) from imported mesh.", degenerate);
+		if (flipped) PRINTB("Flipped %d inconsistently wound face(s) in imported mesh.", flipped);
+
+		std::vector<Vector3d> verts;
+		reindexer.copy(verts);
+		ps.polygons.clear();
+		BOOST_FOREACH(const std::vector<int> &face, faces) {
+			ps.append_poly();
+			BOOST_FOREACH(int idx, face) {
+				ps.append_vertex(verts[idx][0], verts[idx][1], verts[idx][2]);
+			}
 		}
+		return true;
 	}
 }
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 class Polygon2d;
 class PolySet;
 
@@ -7,5 +9,12 @@ namespace PolysetUtils {
 
 	Polygon2d *project(const PolySet &ps);
 	void tessellate_faces(const PolySet &inps, PolySet &outps);
+	// Refines the mesh by the given number of subdivision levels.
+	// scheme selects "catmull-clark" (default) or "loop"; see subdiv()
+	void subdivide(const PolySet &inps, PolySet &outps, const std::string &scheme, int levels);
+	// Coarsens the mesh by clustering vertices on a grid of the given
+	// cell size. Display-only quality; see decimate()
+	void decimate(const PolySet &inps, PolySet &outps, double cell_size);
+	bool repair_mesh(PolySet &ps);
 
 };
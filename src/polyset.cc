@@ -25,10 +25,18 @@
  */
 
 #include "polyset.h"
+#include "filebacked.h"
 #include "linalg.h"
 #include "printutils.h"
+#include "feature.h"
+#include "Reindexer.h"
+#include <stdlib.h>
 #include <Eigen/LU>
+#include <iterator>
 #include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/format.hpp>
+#include <boost/uuid/sha1.hpp>
 
 /*! /class PolySet
 
@@ -44,20 +52,169 @@
 
  */
 
-PolySet::PolySet(unsigned int dim) : dim(dim)
+PolySet::PolySet(unsigned int dim) : dim(dim),
+	surface_vbo(0), surface_vbo_count(0), surface_vbo_mirrored(false), surface_vbo_dirty(true), surface_vbo_origin(Vector3d::Zero())
 {
 }
 
-PolySet::PolySet(const Polygon2d &origin) : polygon(origin), dim(2)
+PolySet::PolySet(const Polygon2d &origin) : polygon(origin), dim(2),
+	surface_vbo(0), surface_vbo_count(0), surface_vbo_mirrored(false), surface_vbo_dirty(true), surface_vbo_origin(Vector3d::Zero())
+{
+}
+
+/*!
+	NB! The GL buffer handle is per-object and must not be shared between
+	copies, so the copy starts out with an empty buffer cache.
+*/
+PolySet::PolySet(const PolySet &ps) : Geometry(ps),
+	polygons(ps.polygons), polygon(ps.polygon), dim(ps.dim),
+	surface_vbo(0), surface_vbo_count(0), surface_vbo_mirrored(false), surface_vbo_dirty(true), surface_vbo_origin(Vector3d::Zero()),
+	spilled_store(ps.spilled_store)
 {
 }
 
 PolySet::~PolySet()
 {
+#ifndef NULLGL
+	if (this->surface_vbo) glDeleteBuffers(1, &this->surface_vbo);
+#endif
+}
+
+size_t PolySet::numPolygons() const
+{
+	if (this->spilled_store) return this->spilled_store->numTriangles();
+	return this->polygons.size();
+}
+
+// Sequential read windows over a spilled store, in triangles (~4.5MB)
+#define SPILL_WINDOW_TRIANGLES (64*1024)
+
+/*!
+	Spills when the triangle count crosses the threshold; see
+	spillThreshold(). Safe to call on any set - non-triangle or small
+	sets are left alone.
+*/
+void PolySet::maybeSpillToDisk()
+{
+	size_t threshold = spillThreshold();
+	if (threshold && this->polygons.size() >= threshold) spillToDisk();
+}
+
+size_t PolySet::spillThreshold()
+{
+	const char *env = getenv("OPENSCAD_SPILL_TRIANGLES");
+	if (env) return strtoul(env, NULL, 10);
+	// ~1GB of boxed Polygon storage
+	return 8*1000*1000;
+}
+
+void PolySet::spillToDisk()
+{
+	if (this->spilled_store || this->dim != 3) return;
+	BOOST_FOREACH(const Polygon &p, this->polygons) {
+		if (p.size() != 3) return; // only triangle soup spills
+	}
+	shared_ptr<FileBackedTriangleStore> store(new FileBackedTriangleStore());
+	BOOST_FOREACH(const Polygon &p, this->polygons) {
+		if (!store->append(p[0], p[1], p[2])) return;
+	}
+	if (!store->finalize()) return;
+	this->spilled_store = store;
+	std::vector<Polygon>().swap(this->polygons);
+	this->surface_vbo_dirty = true;
+}
+
+static boost::mutex spill_reload_mutex;
+
+/*!
+	Reads a spilled set back into polygons. Kept const (the storage
+	members are mutable) so consumers holding the usual const reference
+	can call it before touching polygons directly. Cached sets are shared
+	between threads (parallel CSG workers, GUI paint vs. render worker),
+	so the reload is serialized like VectorStorage::boxed(): polygons is
+	filled before spilled_store is dropped, and late arrivals re-check
+	under the lock.
+*/
+void PolySet::ensureLoaded() const
+{
+	if (!this->spilled_store) return;
+	boost::mutex::scoped_lock lock(spill_reload_mutex);
+	if (!this->spilled_store) return;
+	size_t numtri = this->spilled_store->numTriangles();
+	std::vector<Polygon> loaded;
+	loaded.reserve(numtri);
+	std::vector<double> window(SPILL_WINDOW_TRIANGLES * 9);
+	size_t index = 0;
+	while (index < numtri) {
+		size_t got = this->spilled_store->readWindow(index, &window[0], window.size());
+		if (!got) break;
+		for (size_t i = 0; i < got; i++) {
+			const double *t = &window[i * 9];
+			loaded.push_back(Polygon());
+			Polygon &poly = loaded.back();
+			poly.reserve(3);
+			poly.push_back(Vector3d(t[0], t[1], t[2]));
+			poly.push_back(Vector3d(t[3], t[4], t[5]));
+			poly.push_back(Vector3d(t[6], t[7], t[8]));
+		}
+		index += got;
+	}
+	this->polygons.swap(loaded);
+	this->surface_vbo_dirty = true;
+	this->spilled_store.reset();
+}
+
+/*!
+	Builds an indexed mesh view of this PolySet: a deduplicated vertex pool
+	plus one index list per polygon. The polygon storage keeps fully
+	duplicated per-face vertices, so consumers that want shared vertices
+	(indexed exports, VBOs) should go through this instead of rebuilding
+	their own lookup tables.
+*/
+void PolySet::getIndexedMesh(std::vector<Vector3d> &vertices, std::vector<IndexedFace> &faces) const
+{
+	ensureLoaded();
+	Reindexer<Vector3d> reindexer;
+	faces.clear();
+	faces.reserve(this->polygons.size());
+	BOOST_FOREACH(const Polygon &p, this->polygons) {
+		faces.push_back(IndexedFace());
+		IndexedFace &face = faces.back();
+		face.reserve(p.size());
+		BOOST_FOREACH(const Vector3d &v, p) {
+			face.push_back(reindexer.lookup(v));
+		}
+	}
+	reindexer.copy(vertices);
+}
+
+/*!
+	SHA1 over the raw vertex doubles plus the polygon structure, so
+	bit-identical meshes from different subtrees hash equal. Spilled sets
+	opt out (empty hash) rather than re-reading gigabytes from disk.
+*/
+std::string PolySet::contentHash() const
+{
+	// 2D sets also carry outline data and the spilled kind would need a
+	// full re-read; neither is worth hashing
+	if (this->spilled_store || this->dim != 3) return std::string();
+	boost::uuids::detail::sha1 sha;
+	sha.process_bytes(&this->convexity, sizeof(this->convexity));
+	BOOST_FOREACH(const Polygon &p, this->polygons) {
+		size_t n = p.size();
+		sha.process_bytes(&n, sizeof(n));
+		if (n) sha.process_bytes(&p[0], n * sizeof(Vector3d));
+	}
+	unsigned int digest[5];
+	sha.get_digest(digest);
+	std::string hash = "ps-";
+	for (int i=0;i<5;i++) hash += str(boost::format("%08x") % digest[i]);
+	return hash;
 }
 
 std::string PolySet::dump() const
 {
+	ensureLoaded();
 	std::stringstream out;
 	out << "PolySet:"
 	  << "\n dimensions:" << this->dim
@@ -84,6 +241,16 @@ void PolySet::append_poly()
 	polygons.push_back(Polygon());
 }
 
+/*!
+	As append_poly(), but reserves room for the known vertex count so the
+	polygon doesn't regrow while it is filled in.
+*/
+void PolySet::append_poly(size_t numvertices)
+{
+	polygons.push_back(Polygon());
+	polygons.back().reserve(numvertices);
+}
+
 void PolySet::append_vertex(double x, double y, double z)
 {
 	append_vertex(Vector3d(x, y, z));
@@ -92,6 +259,9 @@ void PolySet::append_vertex(double x, double y, double z)
 void PolySet::append_vertex(Vector3d v)
 {
 	polygons.back().push_back(v);
+	this->surface_vbo_dirty = true;
+	this->face_normals.clear();
+	this->invalidateBoundingBox();
 }
 
 void PolySet::insert_vertex(double x, double y, double z)
@@ -102,23 +272,64 @@ void PolySet::insert_vertex(double x, double y, double z)
 void PolySet::insert_vertex(Vector3d v)
 {
 	polygons.back().insert(polygons.back().begin(), v);
+	this->surface_vbo_dirty = true;
+	this->face_normals.clear();
+	this->invalidateBoundingBox();
 }
 
-BoundingBox PolySet::getBoundingBox() const
+BoundingBox PolySet::computeBoundingBox() const
 {
 	BoundingBox bbox;
+	// Track the extremes in two vectors and merge once at the end;
+	// cwiseMin/cwiseMax compile down to branch-free vector kernels,
+	// unlike extend() which tests emptiness per call
+	Vector3d min(0,0,0), max(0,0,0);
+	bool seen = false;
+	if (this->spilled_store) {
+		std::vector<double> window(SPILL_WINDOW_TRIANGLES * 9);
+		size_t numtri = this->spilled_store->numTriangles();
+		size_t index = 0;
+		while (index < numtri) {
+			size_t got = this->spilled_store->readWindow(index, &window[0], window.size());
+			if (!got) break;
+			for (size_t i = 0; i < got * 3; i++) {
+				Vector3d p(window[i*3], window[i*3+1], window[i*3+2]);
+				if (!seen) {
+					min = max = p;
+					seen = true;
+				}
+				else {
+					min = min.cwiseMin(p);
+					max = max.cwiseMax(p);
+				}
+			}
+			index += got;
+		}
+		if (seen) bbox.extend(min).extend(max);
+		return bbox;
+	}
 	for (size_t i = 0; i < polygons.size(); i++) {
 		const Polygon &poly = polygons[i];
 		for (size_t j = 0; j < poly.size(); j++) {
 			const Vector3d &p = poly[j];
-			bbox.extend(p);
+			if (!seen) {
+				min = max = p;
+				seen = true;
+			}
+			else {
+				min = min.cwiseMin(p);
+				max = max.cwiseMax(p);
+			}
 		}
 	}
+	if (seen) bbox.extend(min).extend(max);
 	return bbox;
 }
 
 size_t PolySet::memsize() const
 {
+	// A spilled set's triangles live in the temp file, not on the heap,
+	// so only the resident parts count against cache budgets
 	size_t mem = 0;
 	BOOST_FOREACH(const Polygon &p, this->polygons) mem += p.size() * sizeof(Vector3d);
 	mem += this->polygon.memsize() - sizeof(this->polygon);
@@ -128,16 +339,72 @@ size_t PolySet::memsize() const
 
 void PolySet::append(const PolySet &ps)
 {
+	ensureLoaded();
+	ps.ensureLoaded();
 	this->polygons.insert(this->polygons.end(), ps.polygons.begin(), ps.polygons.end());
+	this->surface_vbo_dirty = true;
+	this->face_normals.clear();
+	this->invalidateBoundingBox();
+}
+
+/*!
+	Moves the polygons of \a ps to the end of this PolySet and leaves
+	\a ps empty. Use instead of append() when the source is discarded
+	afterwards: the vertex buffers change owner instead of being copied,
+	which halves the transient memory of assembling a large result from
+	partial sets.
+*/
+void PolySet::splice(PolySet &ps)
+{
+	ensureLoaded();
+	ps.ensureLoaded();
+	if (this->polygons.empty()) {
+		this->polygons.swap(ps.polygons);
+	}
+	else {
+		this->polygons.insert(this->polygons.end(),
+													std::make_move_iterator(ps.polygons.begin()),
+													std::make_move_iterator(ps.polygons.end()));
+		std::vector<Polygon>().swap(ps.polygons);
+	}
+	this->surface_vbo_dirty = true;
+	this->face_normals.clear();
+	this->invalidateBoundingBox();
+}
+
+/*!
+	Trims the excess capacity left behind by incremental building. Worth
+	calling once a PolySet of unknown final size (e.g. an ASCII STL
+	import) is complete and will be kept around.
+*/
+void PolySet::compact()
+{
+	BOOST_FOREACH(Polygon &p, this->polygons) {
+		if (p.size() < p.capacity()) Polygon(p).swap(p);
+	}
+	if (this->polygons.size() < this->polygons.capacity()) {
+		std::vector<Polygon> trimmed(std::make_move_iterator(this->polygons.begin()),
+																 std::make_move_iterator(this->polygons.end()));
+		trimmed.swap(this->polygons);
+	}
 }
 
 void PolySet::transform(const Transform3d &mat)
 {
+	ensureLoaded();
+	// Apply the affine map to all vertices of a polygon in one batched
+	// product. The vertices are stored contiguously, so Eigen gets to use
+	// its vectorized matrix kernels instead of a scalar multiply per vertex.
+	Eigen::Matrix3d rot = mat.matrix().topLeftCorner<3,3>();
+	Vector3d trans = mat.matrix().topRightCorner<3,1>();
 	BOOST_FOREACH(Polygon &p, this->polygons) {
-		BOOST_FOREACH(Vector3d &v, p) {
-			v = mat * v;
-		}
+		if (p.empty()) continue;
+		Eigen::Map<Eigen::Matrix<double,3,Eigen::Dynamic> > verts(p[0].data(), 3, p.size());
+		verts = ((rot * verts).colwise() + trans).eval();
 	}
+	this->surface_vbo_dirty = true;
+	this->face_normals.clear();
+	this->invalidateBoundingBox();
 }
 
 void PolySet::resize(Vector3d newsize, const Eigen::Matrix<bool,3,1> &autosize)
@@ -167,18 +434,49 @@ void PolySet::resize(Vector3d newsize, const Eigen::Matrix<bool,3,1> &autosize)
 	this->transform(t);
 }
 
+/*!
+	Returns one unit normal per polygon, computed once and reused by the
+	per-frame draw loop instead of redoing the cross product per
+	triangle. Uses the same first-three-vertices cross product as
+	gl_draw_triangle(), so the shading is unchanged. Invalidated
+	together with the vertex buffer whenever the vertex data changes.
+*/
+const std::vector<Vector3d> &PolySet::faceNormals() const
+{
+	ensureLoaded();
+	if (this->face_normals.size() != this->polygons.size()) {
+		this->face_normals.resize(this->polygons.size());
+		for (size_t i = 0; i < this->polygons.size(); i++) {
+			const Polygon &poly = this->polygons[i];
+			Vector3d n = Vector3d::Zero();
+			if (poly.size() >= 3) {
+				n = (poly[1] - poly[0]).cross(poly[1] - poly[2]);
+				double nl = n.norm();
+				if (nl > 0) n /= nl;
+			}
+			this->face_normals[i] = n;
+		}
+	}
+	return this->face_normals;
+}
+
 // all GL functions grouped together here
 #ifndef NULLGL
-static void gl_draw_triangle(GLint *shaderinfo, const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, bool e0, bool e1, bool e2, double z, bool mirrored)
+static void gl_draw_triangle(GLint *shaderinfo, const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, bool e0, bool e1, bool e2, double z, bool mirrored, const Vector3d *normal = NULL)
 {
-	double ax = p1[0] - p0[0], bx = p1[0] - p2[0];
-	double ay = p1[1] - p0[1], by = p1[1] - p2[1];
-	double az = p1[2] - p0[2], bz = p1[2] - p2[2];
-	double nx = ay*bz - az*by;
-	double ny = az*bx - ax*bz;
-	double nz = ax*by - ay*bx;
-	double nl = sqrt(nx*nx + ny*ny + nz*nz);
-	glNormal3d(nx / nl, ny / nl, nz / nl);
+	if (normal) {
+		glNormal3d((*normal)[0], (*normal)[1], (*normal)[2]);
+	}
+	else {
+		double ax = p1[0] - p0[0], bx = p1[0] - p2[0];
+		double ay = p1[1] - p0[1], by = p1[1] - p2[1];
+		double az = p1[2] - p0[2], bz = p1[2] - p2[2];
+		double nx = ay*bz - az*by;
+		double ny = az*bx - ax*bz;
+		double nz = ax*by - ay*bx;
+		double nl = sqrt(nx*nx + ny*ny + nz*nz);
+		glNormal3d(nx / nl, ny / nl, nz / nl);
+	}
 #ifdef ENABLE_OPENCSG
 	if (shaderinfo) {
 		double e0f = e0 ? 2.0 : -1.0;
@@ -221,6 +519,127 @@ static void gl_draw_triangle(GLint *shaderinfo, const Vector3d &p0, const Vector
 	}
 }
 
+static void vbo_append_triangle(std::vector<GLfloat> &buf, const Vector3d &origin, const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, bool mirrored)
+{
+	double ax = p1[0] - p0[0], bx = p1[0] - p2[0];
+	double ay = p1[1] - p0[1], by = p1[1] - p2[1];
+	double az = p1[2] - p0[2], bz = p1[2] - p2[2];
+	double nx = ay*bz - az*by;
+	double ny = az*bx - ax*bz;
+	double nz = ax*by - ay*bx;
+	double nl = sqrt(nx*nx + ny*ny + nz*nz);
+	const Vector3d *order[3] = { &p0, &p1, &p2 };
+	// Same winding as the non-shader path of gl_draw_triangle()
+	if (mirrored) {
+		order[1] = &p2;
+		order[2] = &p1;
+	}
+	for (int i = 0; i < 3; i++) {
+		// Rebase in double before narrowing to float: raw float32 has ~7
+		// significant digits, too coarse for parts modeled far from the
+		// world origin, but plenty relative to the geometry's own center
+		Vector3d p = *order[i] - origin;
+		buf.push_back(p[0]);
+		buf.push_back(p[1]);
+		buf.push_back(p[2]);
+		buf.push_back(nx / nl);
+		buf.push_back(ny / nl);
+		buf.push_back(nz / nl);
+	}
+}
+
+/*!
+	Draws the 3D surface from an interleaved vertex/normal buffer object,
+	tessellated once per geometry instead of once per frame. Only covers
+	the fixed-function path; the OpenCSG shader needs per-vertex edge
+	attributes and keeps using immediate mode. Returns false if no buffer
+	could be allocated, so render_surface() can fall back.
+*/
+bool PolySet::render_surface_vbo(bool mirrored) const
+{
+	if (!this->surface_vbo) {
+		glGenBuffers(1, &this->surface_vbo);
+		if (!this->surface_vbo) return false;
+		this->surface_vbo_dirty = true;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, this->surface_vbo);
+
+	if (this->surface_vbo_dirty || this->surface_vbo_mirrored != mirrored) {
+		this->surface_vbo_origin = this->getBoundingBox().center();
+		const Vector3d &origin = this->surface_vbo_origin;
+		if (this->spilled_store) {
+			// Stream the spilled triangles into the buffer window by window,
+			// so the upload never materializes the mesh on the heap
+			size_t numtri = this->spilled_store->numTriangles();
+			glBufferData(GL_ARRAY_BUFFER, numtri * 3 * 6 * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
+			std::vector<double> window(SPILL_WINDOW_TRIANGLES * 9);
+			std::vector<GLfloat> interleaved;
+			interleaved.reserve(SPILL_WINDOW_TRIANGLES * 3 * 6);
+			size_t index = 0;
+			while (index < numtri) {
+				size_t got = this->spilled_store->readWindow(index, &window[0], window.size());
+				if (!got) break;
+				interleaved.clear();
+				for (size_t i = 0; i < got; i++) {
+					const double *t = &window[i * 9];
+					vbo_append_triangle(interleaved, origin,
+															Vector3d(t[0], t[1], t[2]),
+															Vector3d(t[3], t[4], t[5]),
+															Vector3d(t[6], t[7], t[8]), mirrored);
+				}
+				glBufferSubData(GL_ARRAY_BUFFER, index * 3 * 6 * sizeof(GLfloat),
+												interleaved.size() * sizeof(GLfloat), &interleaved[0]);
+				index += got;
+			}
+			this->surface_vbo_count = index * 3;
+			this->surface_vbo_mirrored = mirrored;
+			this->surface_vbo_dirty = false;
+		}
+		else {
+		std::vector<GLfloat> interleaved;
+		interleaved.reserve(this->polygons.size() * 3 * 6);
+		for (size_t i = 0; i < polygons.size(); i++) {
+			const Polygon *poly = &polygons[i];
+			if (poly->size() == 3) {
+				vbo_append_triangle(interleaved, origin, poly->at(0), poly->at(1), poly->at(2), mirrored);
+			}
+			else if (poly->size() == 4) {
+				vbo_append_triangle(interleaved, origin, poly->at(0), poly->at(1), poly->at(3), mirrored);
+				vbo_append_triangle(interleaved, origin, poly->at(2), poly->at(3), poly->at(1), mirrored);
+			}
+			else {
+				Vector3d center = Vector3d::Zero();
+				for (size_t j = 0; j < poly->size(); j++) {
+					center += poly->at(j);
+				}
+				center /= poly->size();
+				for (size_t j = 1; j <= poly->size(); j++) {
+					vbo_append_triangle(interleaved, origin, center, poly->at(j - 1), poly->at(j % poly->size()), mirrored);
+				}
+			}
+		}
+		glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(GLfloat),
+								 interleaved.empty() ? NULL : &interleaved[0], GL_STATIC_DRAW);
+		this->surface_vbo_count = interleaved.size() / 6;
+		this->surface_vbo_mirrored = mirrored;
+		this->surface_vbo_dirty = false;
+		}
+	}
+
+	glPushMatrix();
+	glTranslated(this->surface_vbo_origin[0], this->surface_vbo_origin[1], this->surface_vbo_origin[2]);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 6 * sizeof(GLfloat), 0);
+	glNormalPointer(GL_FLOAT, 6 * sizeof(GLfloat), (const GLvoid *)(3 * sizeof(GLfloat)));
+	glDrawArrays(GL_TRIANGLES, 0, this->surface_vbo_count);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glPopMatrix();
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
 void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo) const
 {
 	bool mirrored = m.matrix().determinant() < 0;
@@ -307,15 +726,23 @@ void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m,
 		}
 		glEnd();
 	} else if (this->dim == 3) {
+		if (!shaderinfo && Feature::ExperimentalVboRendering.is_enabled() && GLEW_VERSION_1_5 &&
+				this->render_surface_vbo(mirrored)) {
+			return;
+		}
+		ensureLoaded();
+		// Each polygon is planar, so every triangle it decomposes into
+		// shares the precomputed face normal
+		const std::vector<Vector3d> &normals = this->faceNormals();
 		for (size_t i = 0; i < polygons.size(); i++) {
 			const Polygon *poly = &polygons[i];
 			glBegin(GL_TRIANGLES);
 			if (poly->size() == 3) {
-				gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(2), true, true, true, 0, mirrored);
+				gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(2), true, true, true, 0, mirrored, &normals[i]);
 			}
 			else if (poly->size() == 4) {
-				gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(3), true, false, true, 0, mirrored);
-				gl_draw_triangle(shaderinfo, poly->at(2), poly->at(3), poly->at(1), true, false, true, 0, mirrored);
+				gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(3), true, false, true, 0, mirrored, &normals[i]);
+				gl_draw_triangle(shaderinfo, poly->at(2), poly->at(3), poly->at(1), true, false, true, 0, mirrored, &normals[i]);
 			}
 			else {
 				Vector3d center = Vector3d::Zero();
@@ -328,7 +755,7 @@ void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m,
 				center[1] /= poly->size();
 				center[2] /= poly->size();
 				for (size_t j = 1; j <= poly->size(); j++) {
-					gl_draw_triangle(shaderinfo, center, poly->at(j - 1), poly->at(j % poly->size()), false, true, false, 0, mirrored);
+					gl_draw_triangle(shaderinfo, center, poly->at(j - 1), poly->at(j % poly->size()), false, true, false, 0, mirrored, &normals[i]);
 				}
 			}
 			glEnd();
@@ -347,6 +774,7 @@ void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m,
 */
 void PolySet::render_edges(Renderer::csgmode_e csgmode) const
 {
+	ensureLoaded();
 	glDisable(GL_LIGHTING);
 	if (this->dim == 2) {
 		if (csgmode == Renderer::CSGMODE_NONE) {
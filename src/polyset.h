@@ -5,6 +5,7 @@
 #include "linalg.h"
 #include "renderer.h"
 #include "Polygon2d.h"
+#include "memory.h"
 #include <vector>
 #include <string>
 
@@ -12,25 +13,55 @@ class PolySet : public Geometry
 {
 public:
 	typedef std::vector<Vector3d> Polygon;
-	std::vector<Polygon> polygons;
+	typedef std::vector<int> IndexedFace;
+	// mutable so a spilled set can be reloaded through a const reference;
+	// see ensureLoaded()
+	mutable std::vector<Polygon> polygons;
 
 	PolySet(unsigned int dim);
 	PolySet(const Polygon2d &origin);
+	PolySet(const PolySet &ps);
 	virtual ~PolySet();
 
 	virtual size_t memsize() const;
-	virtual BoundingBox getBoundingBox() const;
+	virtual BoundingBox computeBoundingBox() const;
 	virtual std::string dump() const;
+	virtual std::string contentHash() const;
 	virtual unsigned int getDimension() const { return this->dim; }
-	virtual bool isEmpty() const { return polygons.size() == 0; }
+	virtual bool isEmpty() const { return polygons.empty() && !spilled_store; }
+	virtual PolySet *copy() const { return new PolySet(*this); }
 
-	size_t numPolygons() const { return polygons.size(); }
+	size_t numPolygons() const;
+	void getIndexedMesh(std::vector<Vector3d> &vertices, std::vector<IndexedFace> &faces) const;
+	void reserve(size_t numpolygons) { polygons.reserve(numpolygons); }
 	void append_poly();
+	void append_poly(size_t numvertices);
 	void append_vertex(double x, double y, double z = 0.0);
 	void append_vertex(Vector3d v);
 	void insert_vertex(double x, double y, double z = 0.0);
 	void insert_vertex(Vector3d v);
 	void append(const PolySet &ps);
+	void splice(PolySet &ps);
+	void compact();
+
+	const std::vector<Vector3d> &faceNormals() const;
+
+	/*!
+		File-backed storage for oversized triangle meshes: spillToDisk()
+		moves the vertex data of an all-triangle 3D set into a temporary
+		file (see FileBackedTriangleStore) and empties polygons, so the set
+		costs almost no heap while it sits in a cache or streams through an
+		export. Consumers that need the boxed polygons call ensureLoaded(),
+		which reads everything back; spill-aware paths (STL export, the VBO
+		upload) iterate the store in bounded windows instead.
+	*/
+	void maybeSpillToDisk();
+	void spillToDisk();
+	void ensureLoaded() const;
+	bool isSpilled() const { return (bool)spilled_store; }
+	const class FileBackedTriangleStore *spilledStore() const { return spilled_store.get(); }
+	//! Triangle count above which maybeSpillToDisk() spills; 0 disables
+	static size_t spillThreshold();
 
 	void render_surface(Renderer::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo = NULL) const;
 	void render_edges(Renderer::csgmode_e csgmode) const;
@@ -39,6 +70,21 @@ public:
 	void resize(Vector3d newsize, const Eigen::Matrix<bool,3,1> &autosize);
 
 private:
+	bool render_surface_vbo(bool mirrored) const;
+
   Polygon2d polygon;
 	unsigned int dim;
+
+	// Cached vertex buffer for the fixed-function 3D surface; see render_surface()
+	mutable GLuint surface_vbo;
+	mutable size_t surface_vbo_count;
+	mutable bool surface_vbo_mirrored;
+	mutable bool surface_vbo_dirty;
+	// Double-precision origin subtracted before the float32 cast; the
+	// draw re-applies it on the modelview stack (see render_surface_vbo())
+	mutable Vector3d surface_vbo_origin;
+	// One unit normal per polygon; see faceNormals()
+	mutable std::vector<Vector3d> face_normals;
+	// Set while the triangle data lives on disk; see spillToDisk()
+	mutable shared_ptr<FileBackedTriangleStore> spilled_store;
 };
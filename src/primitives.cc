@@ -34,6 +34,7 @@
 #include "visitor.h"
 #include "context.h"
 #include "calc.h"
+#include "feature.h"
 #include "mathc99.h"
 #include <sstream>
 #include <assert.h>
@@ -46,6 +47,10 @@ using namespace boost::assign; // bring 'operator+=()' into scope
 
 #define F_MINIMUM 0.01
 
+// Coarsest tessellation worth chaining for lod-preview; below this the
+// silhouette of a sphere or cylinder visibly breaks even when tiny.
+#define LOD_MIN_FRAGMENTS 12
+
 enum primitive_type_e {
 	CUBE,
 	SPHERE,
@@ -73,7 +78,7 @@ public:
   virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const {
 		switch (this->type) {
 		case CUBE:
@@ -102,6 +107,7 @@ public:
 			return AbstractPolyNode::name();
 		}
 	}
+	virtual AbstractNode *cloneNode() const { return new PrimitiveNode(*this); }
 
 	bool center;
 	double x, y, z, h, r1, r2;
@@ -288,10 +294,10 @@ struct point2d {
 
 static void generate_circle(point2d *circle, double r, int fragments)
 {
+	const Calc::TrigRing &ring = Calc::trig_ring(fragments);
 	for (int i=0; i<fragments; i++) {
-		double phi = (M_PI*2*i) / fragments;
-		circle[i].x = r*cos(phi);
-		circle[i].y = r*sin(phi);
+		circle[i].x = r*ring[i].first;
+		circle[i].y = r*ring[i].second;
 	}
 }
 
@@ -505,16 +511,30 @@ Geometry *PrimitiveNode::createGeometry() const
 		PolySet *p = new PolySet(3);
 		g = p;
 		p->setConvexity(this->convexity);
+		// Point tables are usually homogeneous and stored flat; read the
+		// coordinates in place instead of boxing the whole table
+		const Value::VectorPtr pts = this->points.toVectorPtr();
+		const bool flatpts = (pts && pts->isFlat() && pts->flatStride() == 3);
+		const size_t numpoints = pts ? pts->size() : 0;
 		for (size_t i=0; i<this->faces.toVector().size(); i++)
 		{
 			p->append_poly();
 			const Value::VectorType &vec = this->faces.toVector()[i].toVector();
 			for (size_t j=0; j<vec.size(); j++) {
 				size_t pt = vec[j].toDouble();
-				if (pt < this->points.toVector().size()) {
+				if (pt < numpoints) {
 					double px, py, pz;
-					if (!this->points.toVector()[pt].getVec3(px, py, pz) ||
-							isinf(px) || isinf(py) || isinf(pz)) {
+					bool ok;
+					if (flatpts) {
+						px = pts->flatData()[pt*3];
+						py = pts->flatData()[pt*3 + 1];
+						pz = pts->flatData()[pt*3 + 2];
+						ok = true;
+					}
+					else {
+						ok = pts->boxed()[pt].getVec3(px, py, pz);
+					}
+					if (!ok || isinf(px) || isinf(py) || isinf(pz)) {
 						PRINTB("ERROR: Unable to convert point at index %d to a vec3 of numbers", j);
 						delete p;
 						return NULL;
@@ -555,9 +575,9 @@ Geometry *PrimitiveNode::createGeometry() const
 
 			Outline2d o;
 			o.vertices.resize(fragments);
+			const Calc::TrigRing &tring = Calc::trig_ring(fragments);
 			for (int i=0; i < fragments; i++) {
-				double phi = (M_PI*2*i) / fragments;
-				o.vertices[i] = Vector2d(this->r1*cos(phi), this->r1*sin(phi));
+				o.vertices[i] = Vector2d(this->r1*tring[i].first, this->r1*tring[i].second);
 			}
 			p->addOutline(o);
 			p->setSanitized(true);
@@ -610,10 +630,39 @@ Geometry *PrimitiveNode::createGeometry() const
 	}
 	}
 
+	// lod-preview: chain coarser tessellations behind the curved solids
+	// so the preview renderers can shed detail for objects that are
+	// small on screen. Each level quarters the fragment count; the clone
+	// pins its count through $fn, and the recursion through the clone's
+	// createGeometry() ends once quartering would drop below the floor.
+	if (g && Feature::ExperimentalLodPreview.is_enabled() &&
+			(this->type == SPHERE || this->type == CYLINDER)) {
+		double r = this->type == SPHERE ? this->r1 : fmax(this->r1, this->r2);
+		if (!isinf(r)) {
+			int fragments = Calc::get_fragments_from_r(r, this->fn, this->fs, this->fa);
+			if (fragments / 4 >= LOD_MIN_FRAGMENTS) {
+				PrimitiveNode coarse(this->modinst, this->type);
+				coarse.center = this->center;
+				coarse.x = this->x;
+				coarse.y = this->y;
+				coarse.z = this->z;
+				coarse.h = this->h;
+				coarse.r1 = this->r1;
+				coarse.r2 = this->r2;
+				coarse.convexity = this->convexity;
+				coarse.fn = fragments / 4;
+				coarse.fs = this->fs;
+				coarse.fa = this->fa;
+				Geometry *coarse_geom = coarse.createGeometry();
+				if (coarse_geom) g->setCoarserLOD(shared_ptr<const Geometry>(coarse_geom));
+			}
+		}
+	}
+
 	return g;
 }
 
-std::string PrimitiveNode::toString() const
+std::string PrimitiveNode::computeString() const
 {
 	std::stringstream stream;
 
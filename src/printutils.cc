@@ -2,12 +2,33 @@
 #include <sstream>
 #include <stdio.h>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 
-std::list<std::string> print_messages_stack;
 OutputHandlerFunc *outputhandler = NULL;
 void *outputhandler_data = NULL;
 std::string OpenSCAD::debug("");
 
+namespace {
+	// One capture stack per thread (see printutils.h); created on first
+	// use so threads that never print pay nothing
+	boost::thread_specific_ptr<std::list<std::string> > messages_tss;
+
+	// Serializes emission: concurrent evaluator threads hand complete
+	// lines to the handler one at a time instead of interleaving
+	boost::mutex output_mutex;
+}
+
+std::list<std::string> &print_messages_stack()
+{
+	std::list<std::string> *stack = messages_tss.get();
+	if (!stack) {
+		stack = new std::list<std::string>();
+		messages_tss.reset(stack);
+	}
+	return *stack;
+}
+
 void set_output_handler(OutputHandlerFunc *newhandler, void *userdata)
 {
 	outputhandler = newhandler;
@@ -16,29 +37,31 @@ void set_output_handler(OutputHandlerFunc *newhandler, void *userdata)
 
 void print_messages_push()
 {
-	print_messages_stack.push_back(std::string());
+	print_messages_stack().push_back(std::string());
 }
 
 void print_messages_pop()
 {
-	std::string msg = print_messages_stack.back();
-	print_messages_stack.pop_back();
-	if (print_messages_stack.size() > 0 && !msg.empty()) {
-		if (!print_messages_stack.back().empty()) {
-			print_messages_stack.back() += "\n";
+	std::list<std::string> &stack = print_messages_stack();
+	std::string msg = stack.back();
+	stack.pop_back();
+	if (stack.size() > 0 && !msg.empty()) {
+		if (!stack.back().empty()) {
+			stack.back() += "\n";
 		}
-		print_messages_stack.back() += msg;
+		stack.back() += msg;
 	}
 }
 
 void PRINT(const std::string &msg)
 {
 	if (msg.empty()) return;
-	if (print_messages_stack.size() > 0) {
-		if (!print_messages_stack.back().empty()) {
-			print_messages_stack.back() += "\n";
+	std::list<std::string> &stack = print_messages_stack();
+	if (stack.size() > 0) {
+		if (!stack.back().empty()) {
+			stack.back() += "\n";
 		}
-		print_messages_stack.back() += msg;
+		stack.back() += msg;
 	}
 	PRINT_NOCACHE(msg);
 }
@@ -46,6 +69,7 @@ void PRINT(const std::string &msg)
 void PRINT_NOCACHE(const std::string &msg)
 {
 	if (msg.empty()) return;
+	boost::mutex::scoped_lock lock(output_mutex);
 	if (!outputhandler) {
 		fprintf(stderr, "%s\n", msg.c_str());
 	} else {
@@ -97,15 +121,23 @@ std::string two_digit_exp_format( double x )
 
 std::set<std::string> printedDeprecations;
 
+namespace {
+	// The deduplication set is shared by all threads
+	boost::mutex deprecations_mutex;
+}
+
 void printDeprecation(const std::string &str)
 {
-	if (printedDeprecations.find(str) == printedDeprecations.end()) {
-		PRINT(str);
+	{
+		boost::mutex::scoped_lock lock(deprecations_mutex);
+		if (printedDeprecations.find(str) != printedDeprecations.end()) return;
 		printedDeprecations.insert(str);
 	}
+	PRINT(str);
 }
 
 void resetPrintedDeprecations()
 {
+	boost::mutex::scoped_lock lock(deprecations_mutex);
 	printedDeprecations.clear();
 }
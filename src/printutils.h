@@ -12,7 +12,14 @@ namespace OpenSCAD { extern std::string debug; }
 
 void set_output_handler(OutputHandlerFunc *newhandler, void *userdata);
 
-extern std::list<std::string> print_messages_stack;
+/*!
+	Per-thread message capture stack: evaluation pushes a frame around a
+	cacheable unit of work and the cache entry keeps whatever was printed,
+	so a later cache hit can replay the warnings. Each thread gets its own
+	stack, which both keeps parallel evaluators from corrupting a shared
+	list and attributes captured messages to the work that produced them.
+*/
+std::list<std::string> &print_messages_stack();
 void print_messages_push();
 void print_messages_pop();
 void printDeprecation(const std::string &str);
@@ -39,14 +46,15 @@ void PRINT_CONTEXT(const class Context *ctx, const class Module *mod, const clas
   openscad x.scad --debug=<srcfile> # prints only debug msgs from srcfile.*.cc
   (example: openscad --debug=export # prints only debug msgs from export.cc )
 
-  For a debug with heavy computation cost, you can guard so that the computation
-  only occurs when debugging is turned on. For example:
-  if (OpenSCAD::debug!="") PRINTDB("PolySet dump: %s",ps->dump());
+  The arguments are only evaluated when --debug is on, so expensive
+  dumps (SVG serialization of whole Nefs, PolySet::dump() etc.) may be
+  passed directly without an extra guard; production runs never build
+  the strings.
 */
 
 void PRINTDEBUG(const std::string &filename,const std::string &msg);
-#define PRINTD(_arg) do { PRINTDEBUG(std::string(__FILE__),_arg); } while (0)
-#define PRINTDB(_fmt, _arg) do { try { PRINTDEBUG(std::string(__FILE__),str(boost::format(_fmt) % _arg)); } catch(const boost::io::format_error &e) { PRINTDEBUG(std::string(__FILE__),"bad PRINTDB usage"); } } while (0)
+#define PRINTD(_arg) do { if (OpenSCAD::debug != "") PRINTDEBUG(std::string(__FILE__),_arg); } while (0)
+#define PRINTDB(_fmt, _arg) do { if (OpenSCAD::debug != "") { try { PRINTDEBUG(std::string(__FILE__),str(boost::format(_fmt) % _arg)); } catch(const boost::io::format_error &e) { PRINTDEBUG(std::string(__FILE__),"bad PRINTDB usage"); } } } while (0)
 
 std::string two_digit_exp_format( std::string doublestr );
 std::string two_digit_exp_format( double x );
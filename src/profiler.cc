@@ -0,0 +1,235 @@
+#include "profiler.h"
+#include "PlatformUtils.h"
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+#include <boost/format.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+bool Profiler::is_enabled = false;
+bool Profiler::module_attribution = false;
+bool Profiler::mem_profile = false;
+
+namespace {
+
+	struct Section {
+		Section() : calls(0), seconds(0.0), bytes(0) {}
+		size_t calls;
+		double seconds;
+		size_t bytes;
+	};
+
+	typedef std::map<std::string, Section> section_map_t;
+	section_map_t sections;
+	boost::mutex sections_mutex;
+
+	double now()
+	{
+		static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+		return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() / 1e6;
+	}
+
+	bool orderBySeconds(const std::pair<std::string, Section> &a,
+											const std::pair<std::string, Section> &b)
+	{
+		return a.second.seconds > b.second.seconds;
+	}
+
+	struct ModuleCost {
+		ModuleCost() : calls(0), instantiate_seconds(0.0), geometry_seconds(0.0) {}
+		size_t calls;
+		double instantiate_seconds;
+		double geometry_seconds;
+	};
+
+	typedef std::map<std::string, ModuleCost> module_map_t;
+	module_map_t modules;
+	boost::mutex modules_mutex;
+
+	bool orderByModuleSeconds(const std::pair<std::string, ModuleCost> &a,
+														const std::pair<std::string, ModuleCost> &b)
+	{
+		return a.second.instantiate_seconds + a.second.geometry_seconds >
+			b.second.instantiate_seconds + b.second.geometry_seconds;
+	}
+
+	struct MemMark {
+		MemMark() : samples(0), peak_rss(0) {}
+		size_t samples;
+		size_t peak_rss;
+	};
+
+	typedef std::map<std::string, MemMark> mem_map_t;
+	mem_map_t memmarks;
+	std::vector<std::string> memmark_order; // labels in first-seen order
+	size_t mem_peak_rss = 0;
+	std::string mem_peak_label;
+	std::string mem_peak_context;
+	boost::mutex mem_mutex;
+}
+
+void Profiler::record(const std::string &section, double seconds, size_t bytes)
+{
+	boost::mutex::scoped_lock lock(sections_mutex);
+	Section &s = sections[section];
+	s.calls++;
+	s.seconds += seconds;
+	s.bytes += bytes;
+}
+
+/*!
+	Renders the accumulated sections as a table sorted by total time.
+	Nested sections each count their own full duration, so the column does
+	not sum to the wall time of the run.
+*/
+std::string Profiler::report()
+{
+	std::vector<std::pair<std::string, Section> > sorted;
+	{
+		boost::mutex::scoped_lock lock(sections_mutex);
+		sorted.assign(sections.begin(), sections.end());
+	}
+	std::sort(sorted.begin(), sorted.end(), orderBySeconds);
+
+	std::stringstream out;
+	out << "Profile report:\n";
+	out << str(boost::format("%-40s %8s %12s %14s\n") % "section" % "calls" % "time" % "bytes");
+	typedef std::pair<std::string, Section> entry_t;
+	BOOST_FOREACH(const entry_t &entry, sorted) {
+		out << str(boost::format("%-40s %8d %11.3fs %14d\n")
+							 % entry.first % entry.second.calls % entry.second.seconds % entry.second.bytes);
+	}
+	return out.str();
+}
+
+void Profiler::recordModule(const std::string &module, double seconds, bool geometry)
+{
+	boost::mutex::scoped_lock lock(modules_mutex);
+	ModuleCost &cost = modules[module];
+	cost.calls++;
+	if (geometry) cost.geometry_seconds += seconds;
+	else cost.instantiate_seconds += seconds;
+}
+
+/*!
+	Renders the costliest modules sorted by total time. Instantiation of a
+	module includes the modules it instantiates in turn, so a parent shows
+	up at least as expensive as its children.
+*/
+std::string Profiler::moduleReport(size_t limit)
+{
+	std::vector<std::pair<std::string, ModuleCost> > sorted;
+	{
+		boost::mutex::scoped_lock lock(modules_mutex);
+		sorted.assign(modules.begin(), modules.end());
+	}
+	if (sorted.empty()) return std::string();
+	std::sort(sorted.begin(), sorted.end(), orderByModuleSeconds);
+	if (sorted.size() > limit) sorted.resize(limit);
+
+	std::stringstream out;
+	out << "Costliest modules (instantiation includes nested module calls):\n";
+	out << str(boost::format("%-32s %8s %13s %11s\n") % "module" % "calls" % "instantiate" % "geometry");
+	typedef std::pair<std::string, ModuleCost> entry_t;
+	BOOST_FOREACH(const entry_t &entry, sorted) {
+		out << str(boost::format("%-32s %8d %12.3fs %10.3fs\n")
+							 % entry.first % entry.second.calls
+							 % entry.second.instantiate_seconds % entry.second.geometry_seconds);
+	}
+	return out.str();
+}
+
+bool Profiler::sampleMemory(const std::string &label)
+{
+	const size_t rss = PlatformUtils::residentMemory();
+	if (!rss) return false;
+
+	boost::mutex::scoped_lock lock(mem_mutex);
+	mem_map_t::iterator it = memmarks.find(label);
+	if (it == memmarks.end()) {
+		memmark_order.push_back(label);
+		it = memmarks.insert(std::make_pair(label, MemMark())).first;
+	}
+	it->second.samples++;
+	if (rss > it->second.peak_rss) it->second.peak_rss = rss;
+	if (rss > mem_peak_rss) {
+		mem_peak_rss = rss;
+		mem_peak_label = label;
+		mem_peak_context.clear();
+		return true;
+	}
+	return false;
+}
+
+void Profiler::setPeakContext(const std::string &description)
+{
+	boost::mutex::scoped_lock lock(mem_mutex);
+	mem_peak_context = description;
+}
+
+/*!
+	Renders the watermarks in sampling order plus the overall peak and
+	what was active when it was reached. Figures are resident set sizes;
+	on platforms which only report the peak RSS, later phases inherit the
+	high-water mark of earlier ones.
+*/
+std::string Profiler::memReport()
+{
+	boost::mutex::scoped_lock lock(mem_mutex);
+	if (memmark_order.empty()) return std::string();
+
+	std::stringstream out;
+	out << "Memory watermarks:\n";
+	out << str(boost::format("%-48s %8s %12s\n") % "phase" % "samples" % "peak RSS");
+	BOOST_FOREACH(const std::string &label, memmark_order) {
+		const MemMark &mark = memmarks[label];
+		out << str(boost::format("%-48s %8d %9d MB\n")
+							 % label % mark.samples % (mark.peak_rss / (1024*1024)));
+	}
+	out << str(boost::format("Peak: %d MB during '%s'\n")
+						 % (mem_peak_rss / (1024*1024)) % mem_peak_label);
+	if (!mem_peak_context.empty()) {
+		// The subtree active at the peak; long dumps are cut short since
+		// the head (outermost operations) is the actionable part
+		std::string context = mem_peak_context;
+		if (context.size() > 300) context = context.substr(0, 300) + "...";
+		out << "Active subtree at peak: " << context << "\n";
+	}
+	return out.str();
+}
+
+void Profiler::clearModules()
+{
+	boost::mutex::scoped_lock lock(modules_mutex);
+	modules.clear();
+}
+
+ProfileScope::ProfileScope(const std::string &section)
+	: section(section), starttime(-1.0), bytes(0)
+{
+	if (Profiler::enabled()) this->starttime = now();
+}
+
+ProfileScope::~ProfileScope()
+{
+	if (this->starttime >= 0) {
+		Profiler::record(this->section, now() - this->starttime, this->bytes);
+	}
+}
+
+ModuleTimer::ModuleTimer(const std::string &module, bool geometry)
+	: module(module), geometry(geometry), starttime(-1.0)
+{
+	if (Profiler::moduleAttributionEnabled() && !module.empty()) this->starttime = now();
+}
+
+ModuleTimer::~ModuleTimer()
+{
+	if (this->starttime >= 0) Profiler::recordModule(this->module, now() - this->starttime, this->geometry);
+}
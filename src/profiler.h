@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+
+/*!
+	Lightweight wall-clock instrumentation for the compile/render pipeline.
+
+	Sections are identified by name and aggregated across all threads:
+	call count, total time and the bytes of geometry handled. Profiling is
+	off by default; the --profile command line switch enables it, and a
+	scope costs little more than a boolean test when disabled.
+*/
+class Profiler
+{
+public:
+	static void enable() { is_enabled = true; }
+	static bool enabled() { return is_enabled; }
+
+	static void record(const std::string &section, double seconds, size_t bytes);
+	static std::string report();
+
+	/*
+		Module cost attribution: time aggregated per module name rather
+		than per pipeline phase, split into instantiation and geometry
+		evaluation. Cheap enough to leave on in the GUI, where the console
+		shows the costliest modules after each compile; --profile turns it
+		on for command line runs as well.
+	*/
+	static void enableModuleAttribution() { module_attribution = true; }
+	static bool moduleAttributionEnabled() { return module_attribution; }
+
+	static void recordModule(const std::string &module, double seconds, bool geometry);
+	/*! Renders the top modules by total time; empty when nothing was recorded */
+	static std::string moduleReport(size_t limit);
+	static void clearModules();
+
+	/*
+		Memory telemetry: process RSS watermarks sampled at pipeline phase
+		boundaries and around each CGAL boolean, so a run that gets killed
+		by the OOM killer at least leaves behind which phase - and which
+		subtree - drove the peak. --profile-mem switches it on.
+	*/
+	static void enableMemProfile() { mem_profile = true; }
+	static bool memProfileEnabled() { return mem_profile; }
+
+	/*! Samples the current RSS under the given label; returns true when
+	    this sample set a new process-wide watermark */
+	static bool sampleMemory(const std::string &label);
+	/*! Names what was active at the watermark; call when sampleMemory()
+	    returned true, so the cost of producing the description (e.g. a
+	    subtree dump) is only paid on new peaks */
+	static void setPeakContext(const std::string &description);
+	/*! Renders the per-label watermarks and the overall peak; empty when
+	    nothing was sampled */
+	static std::string memReport();
+
+private:
+	static bool is_enabled;
+	static bool module_attribution;
+	static bool mem_profile;
+};
+
+/*!
+	RAII token timing one section: construction samples the clock, the
+	destructor files the elapsed time with the Profiler.
+*/
+class ProfileScope
+{
+public:
+	ProfileScope(const std::string &section);
+	~ProfileScope();
+
+	/*! Attributes a data volume (e.g. operand or result bytes) to this measurement */
+	void setBytes(size_t bytes) { this->bytes = bytes; }
+
+private:
+	std::string section;
+	double starttime; // < 0 when profiling is disabled
+	size_t bytes;
+};
+
+/*!
+	RAII token attributing one timed stretch to a module by name; pass an
+	empty name to disable (mirrors ProfileScope).
+*/
+class ModuleTimer
+{
+public:
+	ModuleTimer(const std::string &module, bool geometry);
+	~ModuleTimer();
+
+private:
+	std::string module;
+	bool geometry;
+	double starttime; // < 0 when attribution is disabled
+};
@@ -1,16 +1,214 @@
 #include "progress.h"
 #include "node.h"
+#include "printutils.h"
+#include "PlatformUtils.h"
+
+#include <stdio.h>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/mutex.hpp>
 
 int progress_report_count;
 void (*progress_report_f)(const class AbstractNode*, void*, int);
 void *progress_report_userdata;
 
+namespace {
+
+	// Invoking the report callback pumps the GUI event loop, which on trees
+	// with 100k+ nodes costs more than the work being reported on. Updates
+	// are therefore rate limited; the final mark always goes through so the
+	// indicator completes, and cancellation is still checked once per
+	// interval.
+	const double PROGRESS_REPORT_INTERVAL = 1.0 / 30; // seconds
+
+	double progress_last_report_time;
+
+	// Written by progress_request_cancel() from another thread, read at
+	// every progress mark; a plain flag is enough for a level-triggered
+	// stop signal
+	volatile bool progress_cancel_requested;
+
+	// Absolute time after which progress marks abort the evaluation;
+	// 0 means no budget
+	double progress_deadline;
+
+	double now()
+	{
+		static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+		return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() / 1e6;
+	}
+
+	/*
+		Per-node-type cost model. Nodes are marked post-order, so the time
+		between two successive marks is the marked node's own work; each
+		such sample feeds a bounded-window mean per node type, persisted
+		next to the module cache. On the next run the model predicts a
+		cost for every node up front, giving a bar weighted by expected
+		time and an extrapolated ETA. The mutex covers samples arriving
+		from parallel evaluator threads.
+	*/
+	struct cost_entry {
+		double avg;
+		double samples;
+		cost_entry() : avg(0.0), samples(0.0) {}
+	};
+	std::map<std::string, cost_entry> progress_cost_model;
+	boost::mutex progress_model_mutex;
+	bool progress_model_loaded;
+	bool progress_model_dirty;
+
+	// Cumulative predicted cost up to each mark for the current tree;
+	// empty when no progress run is prepared
+	std::vector<double> progress_cumcost;
+	double progress_total_cost;
+	double progress_start_time;
+	double progress_last_mark_time;
+
+	std::string progress_history_file()
+	{
+		std::string path = PlatformUtils::moduleCachePath();
+		if (path.empty()) return path;
+		return path + "/progress-history.txt";
+	}
+
+	void load_cost_model()
+	{
+		if (progress_model_loaded) return;
+		progress_model_loaded = true;
+		const std::string filename = progress_history_file();
+		if (filename.empty()) return;
+		std::ifstream f(filename.c_str());
+		cost_entry entry;
+		std::string name;
+		while (f >> entry.avg >> entry.samples && std::getline(f, name)) {
+			const size_t start = name.find_first_not_of(" \t");
+			if (start == std::string::npos) continue;
+			progress_cost_model[name.substr(start)] = entry;
+		}
+	}
+
+	void save_cost_model()
+	{
+		if (!progress_model_dirty) return;
+		const std::string filename = progress_history_file();
+		if (filename.empty() || !PlatformUtils::createModuleCachePath()) return;
+		// Write-and-rename so a farm job killed mid-save cannot leave a
+		// truncated history for the next run
+		const std::string tmpfile = filename + ".tmp";
+		std::ofstream f(tmpfile.c_str(), std::ios::trunc);
+		if (!f.good()) return;
+		for (std::map<std::string, cost_entry>::const_iterator it = progress_cost_model.begin();
+				 it != progress_cost_model.end(); ++it) {
+			f << it->second.avg << " " << it->second.samples << " " << it->first << "\n";
+		}
+		f.close();
+		if (f.good() && rename(tmpfile.c_str(), filename.c_str()) == 0) {
+			progress_model_dirty = false;
+		}
+		else {
+			remove(tmpfile.c_str());
+		}
+	}
+
+	void record_sample(const std::string &name, double seconds)
+	{
+		boost::mutex::scoped_lock lock(progress_model_mutex);
+		cost_entry &entry = progress_cost_model[name];
+		// Bounded window so the mean tracks hardware and model changes
+		// instead of averaging over the whole history
+		if (entry.samples < 256) entry.samples += 1;
+		entry.avg += (seconds - entry.avg) / entry.samples;
+		progress_model_dirty = true;
+	}
+
+	double predicted_cost(const std::string &name)
+	{
+		std::map<std::string, cost_entry>::const_iterator it = progress_cost_model.find(name);
+		if (it != progress_cost_model.end() && it->second.samples > 0) {
+			// Never predict zero: a free node type would otherwise make no
+			// visible progress at all
+			return it->second.avg > 1e-6 ? it->second.avg : 1e-6;
+		}
+		// Unseen node types count as an average known node, or equal
+		// weight on a completely cold model
+		return progress_total_cost > 0 ? progress_total_cost : 1.0;
+	}
+}
+
 void progress_report_prep(AbstractNode *root, void (*f)(const class AbstractNode *node, void *userdata, int mark), void *userdata)
 {
 	progress_report_count = 0;
 	progress_report_f = f;
 	progress_report_userdata = userdata;
+	progress_last_report_time = 0.0;
+	progress_cancel_requested = false;
 	root->progress_prepare();
+
+	// Predict a cost per mark from the persisted model; marks are dense
+	// in [1, progress_report_count] so a prefix-sum vector serves both
+	// the weighted bar and the ETA
+	load_cost_model();
+	{
+		boost::mutex::scoped_lock lock(progress_model_mutex);
+		double unseen = 0.0;
+		{
+			// Average known cost as the placeholder for unseen types
+			double sum = 0.0;
+			size_t n = 0;
+			for (std::map<std::string, cost_entry>::const_iterator it = progress_cost_model.begin();
+					 it != progress_cost_model.end(); ++it) {
+				if (it->second.samples > 0) { sum += it->second.avg; n++; }
+			}
+			unseen = n ? sum / n : 1.0;
+		}
+		progress_total_cost = unseen; // placeholder consumed by predicted_cost()
+		progress_cumcost.assign(progress_report_count + 1, 0.0);
+		std::vector<const AbstractNode *> pending;
+		pending.push_back(root);
+		while (!pending.empty()) {
+			const AbstractNode *node = pending.back();
+			pending.pop_back();
+			if (node->progress_mark > 0 && (size_t)node->progress_mark < progress_cumcost.size()) {
+				progress_cumcost[node->progress_mark] = predicted_cost(node->name());
+			}
+			for (size_t i = 0; i < node->children.size(); i++) pending.push_back(node->children[i]);
+		}
+		for (size_t i = 1; i < progress_cumcost.size(); i++) {
+			progress_cumcost[i] += progress_cumcost[i-1];
+		}
+		progress_total_cost = progress_cumcost.empty() ? 0.0 : progress_cumcost.back();
+	}
+	progress_start_time = now();
+	progress_last_mark_time = progress_start_time;
+}
+
+void progress_request_cancel()
+{
+	progress_cancel_requested = true;
+}
+
+void progress_set_deadline(double seconds_from_now)
+{
+	progress_deadline = seconds_from_now > 0 ? now() + seconds_from_now : 0.0;
+}
+
+double progress_tighten_deadline(double seconds_from_now)
+{
+	double previous = progress_deadline;
+	if (seconds_from_now > 0) {
+		double candidate = now() + seconds_from_now;
+		if (progress_deadline == 0.0 || candidate < progress_deadline) {
+			progress_deadline = candidate;
+		}
+	}
+	return previous;
+}
+
+void progress_restore_deadline(double absolute)
+{
+	progress_deadline = absolute;
 }
 
 void progress_report_fin()
@@ -18,11 +216,55 @@ void progress_report_fin()
 	progress_report_count = 0;
 	progress_report_f = NULL;
 	progress_report_userdata = NULL;
+	progress_cumcost.clear();
+	progress_total_cost = 0.0;
+	boost::mutex::scoped_lock lock(progress_model_mutex);
+	save_cost_model();
 }
 
-void progress_update(const AbstractNode *node, int mark)
+int progress_weighted_permille(int mark)
+{
+	if (progress_total_cost > 0 && mark >= 0 && (size_t)mark < progress_cumcost.size()) {
+		return (int)(progress_cumcost[mark] * 1000.0 / progress_total_cost);
+	}
+	return progress_report_count ? (int)((mark * 1000.0) / progress_report_count) : 0;
+}
+
+double progress_eta_seconds(int mark)
 {
-	if (progress_report_f)
-		progress_report_f(node, progress_report_userdata, mark);
+	if (progress_total_cost <= 0 || mark <= 0 || (size_t)mark >= progress_cumcost.size()) return -1.0;
+	const double done = progress_cumcost[mark];
+	if (done <= 0) return -1.0;
+	const double elapsed = now() - progress_start_time;
+	if (elapsed <= 0) return -1.0;
+	// Extrapolate at the observed rate so a machine slower or faster
+	// than the recorded history still converges on a usable estimate
+	return elapsed * (progress_total_cost - done) / done;
 }
 
+void progress_update(const AbstractNode *node, int mark)
+{
+	if (progress_cancel_requested) throw ProgressCancelException();
+	if (!progress_cumcost.empty()) {
+		// Post-order marking makes the interval since the previous mark
+		// this node's own evaluation time
+		const double t = now();
+		record_sample(node->name(), t - progress_last_mark_time);
+		progress_last_mark_time = t;
+	}
+	if (progress_deadline > 0 && now() > progress_deadline) {
+		// Everything evaluated before this point is already in the caches
+		// (and on disk when the disk cache is enabled), so the next run
+		// resumes from here instead of starting over
+		PRINTB("WARNING: Render budget exceeded while evaluating %s node (index %d), aborting",
+					 node->name() % node->index());
+		throw ProgressCancelException();
+	}
+	if (!progress_report_f) return;
+	if (mark < progress_report_count) {
+		double t = now();
+		if (t - progress_last_report_time < PROGRESS_REPORT_INTERVAL) return;
+		progress_last_report_time = t;
+	}
+	progress_report_f(node, progress_report_userdata, mark);
+}
@@ -10,4 +10,26 @@ void progress_report_prep(AbstractNode *root, void (*f)(const class AbstractNode
 void progress_report_fin();
 void progress_update(const AbstractNode *node, int mark);
 
+// Cooperative cancellation: may be called from any thread (typically the
+// GUI while a worker compiles); progress_update() then throws
+// ProgressCancelException at the next mark. Cleared by progress_report_prep().
+void progress_request_cancel();
+
+// Cooperative deadline: once it passes, progress_update() names the node
+// that was in flight and throws ProgressCancelException, so a runaway
+// subtree costs at most the budget instead of hanging the render. The
+// tighten/restore pair lets a nested $timeout scope impose a stricter
+// deadline and put the enclosing one back afterwards.
+void progress_set_deadline(double seconds_from_now); // 0 clears
+double progress_tighten_deadline(double seconds_from_now); // returns previous absolute deadline
+void progress_restore_deadline(double absolute);
+
+// Predictive progress: the time spent per node type is recorded at each
+// progress mark and persisted across runs, so the bar can be weighted by
+// predicted cost instead of node count - a tree ending in one big union
+// no longer sits at 99% for its entire duration. Both fall back to plain
+// node counting while the model is still empty (the first ever run).
+int progress_weighted_permille(int mark);
+double progress_eta_seconds(int mark); // negative when no estimate is available
+
 class ProgressCancelException { };
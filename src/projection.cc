@@ -68,7 +68,7 @@ AbstractNode *ProjectionModule::instantiate(const Context *ctx, const ModuleInst
 	return node;
 }
 
-std::string ProjectionNode::toString() const
+std::string ProjectionNode::computeString() const
 {
 	std::stringstream stream;
 
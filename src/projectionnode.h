@@ -13,8 +13,9 @@ public:
   virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const { return "projection"; }
+	virtual AbstractNode *cloneNode() const { return new ProjectionNode(*this); }
 
 	int convexity;
 	bool cut_mode;
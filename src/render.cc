@@ -41,12 +41,19 @@ public:
 	virtual AbstractNode *instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const;
 };
 
+class VoxelRenderModule : public AbstractModule
+{
+public:
+	VoxelRenderModule() : AbstractModule(Feature::ExperimentalVoxelRender) { }
+	virtual AbstractNode *instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const;
+};
+
 AbstractNode *RenderModule::instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const
 {
 	RenderNode *node = new RenderNode(inst);
 
 	AssignmentList args;
-	args += Assignment("convexity");
+	args += Assignment("convexity"), Assignment("pin");
 
 	Context c(ctx);
 	c.setVariables(args, evalctx);
@@ -55,22 +62,57 @@ AbstractNode *RenderModule::instantiate(const Context *ctx, const ModuleInstanti
 	if (v.type() == Value::NUMBER)
 		node->convexity = (int)v.toDouble();
 
+	Value pin = c.lookup_variable("pin");
+	if (pin.type() == Value::BOOL)
+		node->pin = pin.toBool();
+
 	std::vector<AbstractNode *> instantiatednodes = inst->instantiateChildren(evalctx);
 	node->children.insert(node->children.end(), instantiatednodes.begin(), instantiatednodes.end());
 
 	return node;
 }
 
-std::string RenderNode::toString() const
+AbstractNode *VoxelRenderModule::instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const
+{
+	VoxelRenderNode *node = new VoxelRenderNode(inst);
+
+	AssignmentList args;
+	args += Assignment("resolution");
+
+	Context c(ctx);
+	c.setVariables(args, evalctx);
+
+	Value v = c.lookup_variable("resolution");
+	if (v.type() == Value::NUMBER && v.toDouble() > 0) {
+		node->resolution = v.toDouble();
+	}
+
+	std::vector<AbstractNode *> instantiatednodes = inst->instantiateChildren(evalctx);
+	node->children.insert(node->children.end(), instantiatednodes.begin(), instantiatednodes.end());
+
+	return node;
+}
+
+std::string RenderNode::computeString() const
 {
 	std::stringstream stream;
 
-	stream << this->name() << "(convexity = " << convexity << ")";
+	stream << this->name() << "(convexity = " << convexity;
+	if (!this->pin) stream << ", pin = false";
+	stream << ")";
+
+	return stream.str();
+}
 
+std::string VoxelRenderNode::computeString() const
+{
+	std::stringstream stream;
+	stream << this->name() << "(resolution = " << resolution << ")";
 	return stream.str();
 }
 
 void register_builtin_render()
 {
 	Builtins::init("render", new RenderModule());
+	Builtins::init("voxel_render", new VoxelRenderModule());
 }
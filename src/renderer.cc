@@ -1,5 +1,6 @@
 #include "renderer.h"
 #include "rendersettings.h"
+#include <limits>
 #include "Geometry.h"
 #include "polyset.h"
 #include "Polygon2d.h"
@@ -41,6 +42,11 @@ bool Renderer::getColor(Renderer::ColorMode colormode, Color4f &col) const
 	return true;
 }
 
+void Renderer::resetColorState() const
+{
+	this->color_state_valid = false;
+}
+
 void Renderer::setColor(const float color[4], GLint *shaderinfo) const
 {
 	Color4f col = RenderSettings::inst()->color(RenderSettings::OPENCSG_FACE_FRONT_COLOR);
@@ -49,6 +55,15 @@ void Renderer::setColor(const float color[4], GLint *shaderinfo) const
 	if (c[1] < 0) c[1] = col[1];
 	if (c[2] < 0) c[2] = col[2];
 	if (c[3] < 0) c[3] = col[3];
+	GLint shader = shaderinfo ? shaderinfo[0] : 0;
+	if (this->color_state_valid && shader == this->current_color_shader &&
+			c[0] == this->current_color[0] && c[1] == this->current_color[1] &&
+			c[2] == this->current_color[2] && c[3] == this->current_color[3]) {
+		return;
+	}
+	this->color_state_valid = true;
+	this->current_color_shader = shader;
+	for (int i = 0; i < 4; i++) this->current_color[i] = c[i];
 	glColor4fv(c);
 #ifdef ENABLE_OPENCSG
 	if (shaderinfo) {
@@ -89,7 +104,7 @@ void Renderer::render_surface(shared_ptr<const Geometry> geom, csgmode_e csgmode
 	shared_ptr<const PolySet> ps;
 	shared_ptr<const Polygon2d> p2d = dynamic_pointer_cast<const Polygon2d>(geom);
 	if (p2d) {
-		ps.reset(p2d->tessellate());
+		ps = p2d->tessellated();
 	}
 	else {
 		ps = dynamic_pointer_cast<const PolySet>(geom);
@@ -99,12 +114,36 @@ void Renderer::render_surface(shared_ptr<const Geometry> geom, csgmode_e csgmode
 	}
 }
 
+/*!
+	Returns the number of triangles the given geometry tessellates into
+	when drawn. Fans each N-gon into N-2 triangles, matching what
+	PolySet::render_surface submits.
+*/
+size_t Renderer::countTriangles(const shared_ptr<const Geometry> &geom)
+{
+	shared_ptr<const PolySet> ps;
+	shared_ptr<const Polygon2d> p2d = dynamic_pointer_cast<const Polygon2d>(geom);
+	if (p2d) {
+		ps = p2d->tessellated();
+	}
+	else {
+		ps = dynamic_pointer_cast<const PolySet>(geom);
+	}
+	if (!ps) return 0;
+	if (ps->isSpilled()) return ps->numPolygons(); // spilled sets are pure triangles
+	size_t triangles = 0;
+	for (size_t i = 0; i < ps->polygons.size(); i++) {
+		if (ps->polygons[i].size() >= 3) triangles += ps->polygons[i].size() - 2;
+	}
+	return triangles;
+}
+
 void Renderer::render_edges(shared_ptr<const Geometry> geom, csgmode_e csgmode)
 {
 	shared_ptr<const PolySet> ps;
 	shared_ptr<const Polygon2d> p2d = dynamic_pointer_cast<const Polygon2d>(geom);
 	if (p2d) {
-		ps.reset(p2d->tessellate());
+		ps = p2d->tessellated();
 	}
 	else {
 		ps = dynamic_pointer_cast<const PolySet>(geom);
@@ -114,3 +153,101 @@ void Renderer::render_edges(shared_ptr<const Geometry> geom, csgmode_e csgmode)
 	}
 }
 
+// Projected diameter below which the first coarser level is drawn; the
+// fragment count quarters per chained level, so each further step down
+// is only taken at a quarter of this threshold.
+#define LOD_FULL_DETAIL_PIXELS 400.0
+
+shared_ptr<const Geometry> Renderer::selectLOD(const shared_ptr<const Geometry> &geom, double pixels)
+{
+	shared_ptr<const Geometry> level = geom;
+	double limit = LOD_FULL_DETAIL_PIXELS;
+	while (level && level->getCoarserLOD() && pixels < limit) {
+		level = level->getCoarserLOD();
+		limit /= 4;
+	}
+	return level;
+}
+
+
+/*!
+	Extracts the six clip planes from the product of the current GL
+	projection and modelview matrices, so bounding boxes in world
+	coordinates can be tested without knowing which camera set them up.
+*/
+void Frustum::load()
+{
+#ifndef NULLGL
+	double proj[16], model[16];
+	glGetDoublev(GL_PROJECTION_MATRIX, proj);
+	glGetDoublev(GL_MODELVIEW_MATRIX, model);
+
+	// m = proj * model, both column-major
+	double m[16];
+	for (int col = 0; col < 4; col++) {
+		for (int row = 0; row < 4; row++) {
+			m[col*4 + row] = 0;
+			for (int k = 0; k < 4; k++) {
+				m[col*4 + row] += proj[k*4 + row] * model[col*4 + k];
+			}
+		}
+	}
+
+	// Left/right, bottom/top, near/far: row 4 of m plus/minus rows 1-3
+	for (int i = 0; i < 3; i++) {
+		for (int col = 0; col < 4; col++) {
+			this->planes[2*i][col]   = m[col*4 + 3] + m[col*4 + i];
+			this->planes[2*i+1][col] = m[col*4 + 3] - m[col*4 + i];
+		}
+	}
+	this->valid = true;
+#endif
+}
+
+bool Frustum::intersects(const BoundingBox &bbox) const
+{
+	if (!this->valid || bbox.isNull()) return true;
+	for (int i = 0; i < 6; i++) {
+		const double *p = this->planes[i];
+		// The box corner furthest along the plane normal
+		double x = p[0] > 0 ? bbox.max()[0] : bbox.min()[0];
+		double y = p[1] > 0 ? bbox.max()[1] : bbox.min()[1];
+		double z = p[2] > 0 ? bbox.max()[2] : bbox.min()[2];
+		if (p[0]*x + p[1]*y + p[2]*z + p[3] < 0) return false;
+	}
+	return true;
+}
+
+void ScreenProjection::load()
+{
+#ifndef NULLGL
+	glGetDoublev(GL_PROJECTION_MATRIX, this->proj);
+	glGetDoublev(GL_MODELVIEW_MATRIX, this->model);
+	glGetIntegerv(GL_VIEWPORT, this->viewport);
+	this->valid = true;
+#endif
+}
+
+double ScreenProjection::diameter(const BoundingBox &bbox) const
+{
+	if (!this->valid || bbox.isNull()) return std::numeric_limits<double>::infinity();
+
+	const Vector3d center = (bbox.min() + bbox.max()) / 2;
+	const double radius = (bbox.max() - bbox.min()).norm() / 2;
+
+	// Eye-space position of the box center (matrices are column-major)
+	double eye[4];
+	for (int row = 0; row < 4; row++) {
+		eye[row] = model[0*4 + row] * center[0] + model[1*4 + row] * center[1] +
+			model[2*4 + row] * center[2] + model[3*4 + row];
+	}
+	// Clip-space w: distance scaling under perspective, 1 under ortho
+	double w = proj[0*4 + 3] * eye[0] + proj[1*4 + 3] * eye[1] +
+		proj[2*4 + 3] * eye[2] + proj[3*4 + 3] * eye[3];
+	// At or behind the eye plane; keep full detail
+	if (w < 1e-6) return std::numeric_limits<double>::infinity();
+
+	// proj[1][1] is the vertical focal scale, mapping an eye-space
+	// extent to the [-1,1] NDC range covered by viewport[3] pixels
+	return radius * proj[1*4 + 1] / w * viewport[3];
+}
@@ -11,9 +11,24 @@
 class Renderer
 {
 public:
+	Renderer() : color_state_valid(false) {}
 	virtual ~Renderer() {}
 	virtual void draw(bool showfaces, bool showedges) const = 0;
 
+	/*!
+		Per-frame draw statistics, refilled by each draw() call and read
+		back by the performance HUD (see QGLView::paintGL). Fields a
+		renderer does not track stay zero.
+	*/
+	struct DrawStatistics {
+		DrawStatistics() : triangles(0), drawcalls(0), opencsg_passes(0), occluded_products(0) {}
+		size_t triangles;      // triangles submitted, after culling, at the drawn LOD
+		size_t drawcalls;      // surfaces issued (a display list replay counts once)
+		size_t opencsg_passes; // OpenCSG depth-composition passes this frame
+		size_t occluded_products; // products skipped by occlusion queries
+	};
+	const DrawStatistics &getDrawStatistics() const { return this->drawstats; }
+
 #define CSGMODE_DIFFERENCE_FLAG 0x10
 	enum csgmode_e {
 		CSGMODE_NONE                  = 0x00,
@@ -44,4 +59,69 @@ public:
 
 	static void render_surface(shared_ptr<const class Geometry> geom, csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo = NULL);
 	static void render_edges(shared_ptr<const Geometry> geom, csgmode_e csgmode);
+
+	// Walks a geometry's coarser-tessellation chain (see lod-preview in
+	// primitives.cc) and returns the level appropriate for an object
+	// drawn approximately pixels wide on screen.
+	static shared_ptr<const class Geometry> selectLOD(const shared_ptr<const class Geometry> &geom, double pixels);
+
+protected:
+	// Triangles needed to draw the given geometry; used by the renderers
+	// to maintain drawstats
+	static size_t countTriangles(const shared_ptr<const class Geometry> &geom);
+
+	/*!
+		setColor() keeps the last submitted color and skips resubmitting
+		it: on state-sorted chains (see ThrownTogetherRenderer) almost
+		every object repeats its group's color, and the repeated
+		glColor/glUniform calls are pure driver overhead. Other code
+		touches GL between frames, so draw() implementations must
+		invalidate the cache once per frame.
+	*/
+	void resetColorState() const;
+
+	mutable DrawStatistics drawstats;
+
+private:
+	mutable bool color_state_valid;
+	mutable float current_color[4];
+	mutable GLint current_color_shader;
+};
+
+/*!
+	View frustum read back from the current GL projection and modelview
+	matrices, used by the renderers to skip geometry which cannot appear
+	on screen. Errs on the side of drawing: a null bounding box, or a
+	frustum which could not be loaded (e.g. NULLGL), intersects everything.
+*/
+class Frustum
+{
+public:
+	Frustum() : valid(false) { }
+	void load();
+	bool intersects(const BoundingBox &bbox) const;
+private:
+	double planes[6][4];
+	bool valid;
+};
+
+/*!
+	Projection state read back from the current GL matrices and viewport,
+	used by the renderers to estimate how large an object appears on
+	screen when picking a tessellation level for lod-preview. Errs on
+	the side of detail: if the state could not be loaded (e.g. NULLGL),
+	every object measures as infinitely large.
+*/
+class ScreenProjection
+{
+public:
+	ScreenProjection() : valid(false) { }
+	void load();
+	// Approximate on-screen diameter in pixels of a world-space bounding box
+	double diameter(const BoundingBox &bbox) const;
+private:
+	double model[16];
+	double proj[16];
+	GLint viewport[4];
+	bool valid;
 };
@@ -7,12 +7,36 @@
 class RenderNode : public AbstractNode
 {
 public:
-	RenderNode(const ModuleInstantiation *mi) : AbstractNode(mi), convexity(1) { }
+	RenderNode(const ModuleInstantiation *mi) : AbstractNode(mi), convexity(1), pin(true) { }
   virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const { return "render"; }
+	virtual AbstractNode *cloneNode() const { return new RenderNode(*this); }
 
 	int convexity;
+	// Pin the result in the geometry caches so preview churn can't evict
+	// it; render(pin = false) opts out
+	bool pin;
+};
+
+/*!
+	Draft-quality evaluation barrier: the subtree below is re-evaluated
+	on an occupancy grid at the given cell size instead of exact CGAL
+	arithmetic; see voxelizer.h. Behind the voxel-render experimental
+	feature.
+*/
+class VoxelRenderNode : public AbstractNode
+{
+public:
+	VoxelRenderNode(const ModuleInstantiation *mi) : AbstractNode(mi), resolution(1.0) { }
+  virtual Response accept(class State &state, Visitor &visitor) const {
+		return visitor.visit(state, *this);
+	}
+	virtual std::string computeString() const;
+	virtual std::string name() const { return "voxel_render"; }
+	virtual AbstractNode *cloneNode() const { return new VoxelRenderNode(*this); }
+
+	double resolution;
 };
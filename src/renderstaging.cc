@@ -0,0 +1,50 @@
+#include "renderstaging.h"
+#include "Geometry.h"
+
+#include <boost/foreach.hpp>
+
+RenderStagingList *RenderStagingList::inst = NULL;
+
+void RenderStagingList::begin()
+{
+	boost::lock_guard<boost::mutex> lock(this->this_mutex);
+	this->staged.clear();
+	this->active = true;
+	this->gen++;
+}
+
+void RenderStagingList::end()
+{
+	boost::lock_guard<boost::mutex> lock(this->this_mutex);
+	this->staged.clear();
+	this->active = false;
+	this->gen++;
+}
+
+bool RenderStagingList::isActive() const
+{
+	boost::lock_guard<boost::mutex> lock(this->this_mutex);
+	return this->active;
+}
+
+void RenderStagingList::publish(const std::string &key, const std::vector<std::string> &replaces,
+																const shared_ptr<const Geometry> &geom)
+{
+	boost::lock_guard<boost::mutex> lock(this->this_mutex);
+	if (!this->active) return;
+	BOOST_FOREACH(const std::string &replaced, replaces) this->staged.erase(replaced);
+	this->staged[key] = geom;
+	this->gen++;
+}
+
+size_t RenderStagingList::generation() const
+{
+	boost::lock_guard<boost::mutex> lock(this->this_mutex);
+	return this->gen;
+}
+
+void RenderStagingList::snapshot(std::map<std::string, shared_ptr<const Geometry> > &dest) const
+{
+	boost::lock_guard<boost::mutex> lock(this->this_mutex);
+	dest = this->staged;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "memory.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+/*!
+	Staging area for subtree geometries finished during a long full
+	render. The GeometryEvaluator running on the CGAL worker thread
+	publishes each completed 3D result here together with the keys of the
+	children it supersedes, so the list always holds the frontier of
+	finished-but-not-yet-merged pieces. The GUI polls generation() and
+	draws a snapshot through StagedCGALRenderer (see CGALRenderer.h),
+	letting the user watch the model assemble and abort a doomed render
+	early instead of waiting for the final union.
+
+	Publishing is only active between begin() and end(), bracketing a
+	CGALWorker run; preview-time geometry evaluation (e.g. render() nodes
+	under OpenCSG) stays out of the list.
+*/
+class RenderStagingList
+{
+public:
+	static RenderStagingList *instance() { if (!inst) inst = new RenderStagingList; return inst; }
+
+	void begin();
+	void end();
+	bool isActive() const;
+
+	/*!
+		Stages geom under key, dropping the entries named in replaces -
+		normally the keys of the node's children, whose geometry is now
+		contained in this one.
+	*/
+	void publish(const std::string &key, const std::vector<std::string> &replaces,
+							 const shared_ptr<const class Geometry> &geom);
+
+	//! Bumped on every change; cheap to poll from a GUI timer
+	size_t generation() const;
+	void snapshot(std::map<std::string, shared_ptr<const class Geometry> > &dest) const;
+
+private:
+	RenderStagingList() : active(false), gen(0) {}
+
+	mutable boost::mutex this_mutex;
+	bool active;
+	size_t gen;
+	std::map<std::string, shared_ptr<const class Geometry> > staged;
+
+	static RenderStagingList *inst;
+};
@@ -91,7 +91,7 @@ AbstractNode *RotateExtrudeModule::instantiate(const Context *ctx, const ModuleI
 	return node;
 }
 
-std::string RotateExtrudeNode::toString() const
+std::string RotateExtrudeNode::computeString() const
 {
 	std::stringstream stream;
 
@@ -15,8 +15,9 @@ public:
   virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const { return "rotate_extrude"; }
+	virtual AbstractNode *cloneNode() const { return new RotateExtrudeNode(*this); }
 
 	int convexity;
 	double fn, fs, fa;
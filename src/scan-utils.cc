@@ -0,0 +1,86 @@
+#include "scan-utils.h"
+
+#include <stdlib.h>
+#include <string>
+#include <boost/cstdint.hpp>
+
+namespace ScanUtils {
+
+	const char *next_line(const char *p, const char *end)
+	{
+		while (p != end && *p != '\n') p++;
+		if (p != end) p++;
+		return p;
+	}
+
+	// Exactly representable powers of ten for the fast path below
+	static const double pow10_table[23] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+		1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+/* Hand-rolled decimal conversion. The mantissa is accumulated in one
+	 64-bit register a digit at a time; when it stays within 15
+	 significant digits and the scale within 10^22 - which covers every
+	 number a mesh exporter emits - both factors of mantissa * 10^k are
+	 exact in a double and the single multiply rounds correctly. Longer
+	 or wilder inputs fall back to strtod, so nothing is lost, only the
+	 per-token stream and locale machinery of lexical_cast. */
+	bool scan_double(const char *&p, const char *end, double &result)
+	{
+		const char *s = p;
+		while (s != end && (*s == ' ' || *s == '\t' || *s == '\r')) s++;
+		const char *numstart = s;
+
+		bool negative = false;
+		if (s != end && (*s == '+' || *s == '-')) negative = (*s++ == '-');
+
+		boost::uint64_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool any = false;
+		while (s != end && *s >= '0' && *s <= '9') {
+			if (digits < 19) { mantissa = mantissa*10 + (*s - '0'); digits++; }
+			else exponent++;
+			any = true;
+			s++;
+		}
+		if (s != end && *s == '.') {
+			s++;
+			while (s != end && *s >= '0' && *s <= '9') {
+				if (digits < 19) { mantissa = mantissa*10 + (*s - '0'); digits++; exponent--; }
+				any = true;
+				s++;
+			}
+		}
+		if (!any) return false;
+		if (s != end && (*s == 'e' || *s == 'E')) {
+			const char *expstart = s++;
+			bool expneg = false;
+			if (s != end && (*s == '+' || *s == '-')) expneg = (*s++ == '-');
+			int e = 0;
+			bool anyexp = false;
+			while (s != end && *s >= '0' && *s <= '9') {
+				if (e < 100000) e = e*10 + (*s - '0');
+				anyexp = true;
+				s++;
+			}
+			// A bare "e" is not part of the number ("1e" parses as 1)
+			if (!anyexp) s = expstart;
+			else exponent += expneg ? -e : e;
+		}
+
+		if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+			double v = (double)mantissa;
+			v = exponent < 0 ? v / pow10_table[-exponent] : v * pow10_table[exponent];
+			result = negative ? -v : v;
+		}
+		else {
+			// Rare: more than 15 significant digits or a huge scale
+			std::string copy(numstart, s - numstart);
+			result = strtod(copy.c_str(), NULL);
+		}
+		p = s;
+		return true;
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+/*!
+	Minimal scanner for whitespace-separated ASCII numbers in memory
+	buffers. The text importers (ascii STL, surface .dat) used to run a
+	regex match or tokenizer plus lexical_cast per line, which is an
+	order of magnitude slower than the I/O itself; these helpers parse
+	straight out of the mapped or loaded buffer instead.
+*/
+namespace ScanUtils {
+
+	// Advances p past blanks (spaces, tabs, carriage returns)
+	inline void skip_space(const char *&p, const char *end) {
+		while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	}
+
+	// Returns the start of the line following p
+	const char *next_line(const char *p, const char *end);
+
+	// Parses one double starting at p (leading blanks allowed) and
+	// advances p past it. Returns false when no number starts there.
+	bool scan_double(const char *&p, const char *end, double &result);
+}
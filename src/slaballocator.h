@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+#include <boost/thread/tss.hpp>
+
+/*!
+	Fixed-size slab allocator behind CGAL_ALLOCATOR (see cgal.h). A Nef
+	polyhedron is millions of tiny vertex/halfedge/facet records, each
+	allocated individually through the container allocator; routing them
+	through global new serializes the parallel CSG workers on the heap
+	lock and fragments long GUI sessions.
+
+	Each thread carves objects of one size class out of private 256KB
+	slabs and keeps a local free list, so allocation is a pointer pop
+	with no locking. Records freed on a different thread than they were
+	allocated on simply join the freeing thread's list - a byte is not
+	owed back to any particular slab. Slabs are retained for the
+	lifetime of the process and recycled through the free lists rather
+	than returned to the OS, which is what makes cross-thread lifetimes
+	(a worker-built Nef cached and later destroyed by the GUI thread)
+	safe.
+
+	There is deliberately no operation-scoped bulk free: the result of a
+	boolean operation allocates from the same containers, interleaved
+	with the transient operands, so a wholesale arena release would tear
+	down live geometry. The free lists recover the transient records at
+	normal destruction cost instead.
+
+	Block allocations (n != 1) pass straight through to operator new;
+	only the per-object traffic of CGAL's in-place lists and compact
+	containers takes the slab path.
+*/
+template<typename T>
+class SlabAllocator
+{
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+
+	template<typename U> struct rebind { typedef SlabAllocator<U> other; };
+
+	SlabAllocator() {}
+	SlabAllocator(const SlabAllocator &) {}
+	template<typename U> SlabAllocator(const SlabAllocator<U> &) {}
+
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+
+	pointer allocate(size_type n, const void * /*hint*/ = 0) {
+		if (n != 1) return static_cast<pointer>(::operator new(n * sizeof(T)));
+		return static_cast<pointer>(Pool::instance()->alloc());
+	}
+
+	void deallocate(pointer p, size_type n) {
+		if (!p) return;
+		if (n != 1) {
+			::operator delete(p);
+			return;
+		}
+		Pool::instance()->release(p);
+	}
+
+	size_type max_size() const { return size_type(-1) / sizeof(T); }
+
+	void construct(pointer p, const T &val) { new (static_cast<void *>(p)) T(val); }
+	void destroy(pointer p) { p->~T(); }
+
+private:
+	struct FreeNode { FreeNode *next; };
+
+	// Per-thread pool for this size class
+	class Pool
+	{
+	public:
+		static Pool *instance() {
+			Pool *pool = tls.get();
+			if (!pool) {
+				pool = new Pool();
+				tls.reset(pool);
+			}
+			return pool;
+		}
+
+		void *alloc() {
+			if (this->freelist) {
+				FreeNode *node = this->freelist;
+				this->freelist = node->next;
+				return node;
+			}
+			if (this->remaining < OBJECT_SIZE) {
+				this->bump = static_cast<char *>(::operator new(SLAB_SIZE));
+				this->remaining = SLAB_SIZE;
+			}
+			void *result = this->bump;
+			this->bump += OBJECT_SIZE;
+			this->remaining -= OBJECT_SIZE;
+			return result;
+		}
+
+		void release(void *p) {
+			FreeNode *node = static_cast<FreeNode *>(p);
+			node->next = this->freelist;
+			this->freelist = node;
+		}
+
+	private:
+		Pool() : freelist(0), bump(0), remaining(0) {}
+
+		// Objects must hold a free-list link and stay max-aligned
+		static const std::size_t ALIGNMENT = 2 * sizeof(void *);
+		static const std::size_t OBJECT_SIZE =
+			((sizeof(T) < sizeof(FreeNode *) ? sizeof(FreeNode *) : sizeof(T))
+			 + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+		static const std::size_t SLAB_SIZE = 256 * 1024;
+
+		FreeNode *freelist;
+		char *bump;
+		std::size_t remaining;
+
+		static boost::thread_specific_ptr<Pool> tls;
+
+		friend class boost::thread_specific_ptr<Pool>;
+	};
+};
+
+template<typename T>
+boost::thread_specific_ptr<typename SlabAllocator<T>::Pool> SlabAllocator<T>::Pool::tls;
+
+// All instances are interchangeable
+template<typename T, typename U>
+inline bool operator==(const SlabAllocator<T> &, const SlabAllocator<U> &) { return true; }
+template<typename T, typename U>
+inline bool operator!=(const SlabAllocator<T> &, const SlabAllocator<U> &) { return false; }
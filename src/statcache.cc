@@ -0,0 +1,114 @@
+#include "statcache.h"
+
+#include <fstream>
+#include <deque>
+#include <stdlib.h>
+#include <string.h>
+#include <boost/unordered_map.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+	struct StatEntry {
+		int result;
+		struct stat st;
+		boost::posix_time::ptime when;
+	};
+
+	boost::unordered_map<std::string, StatEntry> stat_entries;
+	boost::mutex stat_mutex;
+
+	// Read once, guarded by stat_mutex
+	double cache_ttl()
+	{
+		static double ttl = -1;
+		if (ttl < 0) {
+			const char *env = getenv("OPENSCAD_STAT_CACHE_TTL");
+			ttl = (env && env[0]) ? atof(env) : 1.0;
+			if (ttl < 0) ttl = 0;
+		}
+		return ttl;
+	}
+}
+
+int StatCache::stat(const std::string &path, struct stat &st)
+{
+	boost::mutex::scoped_lock lock(stat_mutex);
+	const double ttl = cache_ttl();
+	boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+	if (ttl > 0) {
+		boost::unordered_map<std::string, StatEntry>::iterator it = stat_entries.find(path);
+		if (it != stat_entries.end() &&
+				(now - it->second.when).total_milliseconds() <= ttl * 1000) {
+			st = it->second.st;
+			return it->second.result;
+		}
+	}
+	StatEntry entry;
+	memset(&entry.st, 0, sizeof(struct stat));
+	entry.result = ::stat(path.c_str(), &entry.st);
+	entry.when = now;
+	if (ttl > 0) stat_entries[path] = entry;
+	st = entry.st;
+	return entry.result;
+}
+
+bool StatCache::exists(const fs::path &p)
+{
+	struct stat st;
+	return StatCache::stat(boosty::stringy(p), st) == 0;
+}
+
+bool StatCache::is_directory(const fs::path &p)
+{
+	struct stat st;
+	if (StatCache::stat(boosty::stringy(p), st) != 0) return false;
+	return S_ISDIR(st.st_mode);
+}
+
+namespace {
+
+	std::deque<std::string> prefetch_queue;
+	boost::mutex prefetch_mutex;
+	boost::condition_variable prefetch_cond;
+	boost::thread *prefetch_thread = NULL;
+
+	/*!
+		Reads the file once and throws the data away, pulling it into the
+		OS cache; the compile re-opens it through warm caches moments
+		later. Warms the stat cache as a side effect.
+	*/
+	void prefetch_read(const std::string &path)
+	{
+		struct stat st;
+		StatCache::stat(path, st);
+		std::ifstream stream(path.c_str(), std::ios::binary);
+		if (!stream.good()) return;
+		char buf[65536];
+		while (stream.read(buf, sizeof(buf))) { }
+	}
+
+	void prefetch_loop()
+	{
+		for (;;) {
+			std::string path;
+			{
+				boost::mutex::scoped_lock lock(prefetch_mutex);
+				while (prefetch_queue.empty()) prefetch_cond.wait(lock);
+				path = prefetch_queue.front();
+				prefetch_queue.pop_front();
+			}
+			prefetch_read(path);
+		}
+	}
+}
+
+void StatCache::prefetch(const std::string &path)
+{
+	boost::mutex::scoped_lock lock(prefetch_mutex);
+	// Started lazily and never joined; it idles between prefetches and
+	// the OS reclaims it at exit
+	if (!prefetch_thread) prefetch_thread = new boost::thread(prefetch_loop);
+	prefetch_queue.push_back(path);
+	prefetch_cond.notify_one();
+}
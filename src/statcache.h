@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <sys/stat.h>
+#include "boosty.h"
+
+/*!
+	Short-lived stat() cache plus asynchronous file prefetch.
+
+	Every compile re-resolves include/use paths by probing the library
+	path entries, and ModuleCache re-stats each cached module; on
+	network filesystems that synchronous metadata traffic dominates
+	compile startup. Results are reused for OPENSCAD_STAT_CACHE_TTL
+	seconds (default 1; 0 turns the cache off), so one compile pays for
+	each path at most once while edits are still picked up promptly.
+*/
+namespace StatCache {
+	//! Drop-in for stat(); returns 0 on success like the syscall
+	int stat(const std::string &path, struct stat &st);
+	bool exists(const fs::path &p);
+	bool is_directory(const fs::path &p);
+
+	//! Queues the file for a background read so its contents are in the
+	//! OS cache by the time the compile gets around to opening it
+	void prefetch(const std::string &path);
+};
@@ -30,6 +30,7 @@
 #include "evalcontext.h"
 #include "builtin.h"
 #include "printutils.h"
+#include "scan-utils.h"
 #include "fileutils.h"
 #include "handle_dep.h" // handle_dep()
 #include "visitor.h"
@@ -37,10 +38,9 @@
 
 #include <sstream>
 #include <fstream>
+#include <limits>
+#include <vector>
 #include <boost/foreach.hpp>
-#include <boost/unordered_map.hpp>
-#include <boost/tokenizer.hpp>
-#include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/assign/std/vector.hpp>
 using namespace boost::assign; // bring 'operator+=()' into scope
@@ -55,7 +55,25 @@ public:
 	virtual AbstractNode *instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const;
 };
 
-typedef boost::unordered_map<std::pair<int,int>,double> img_data_t;
+/*!
+	Flat row-major height grid. A 4096x4096 DEM is 128MB of doubles here,
+	where the hash map this replaces spent an order of magnitude more on
+	node and bucket overhead. Cells which a ragged DAT row doesn't cover
+	read as 0, matching the old map's default value.
+*/
+struct img_data_t
+{
+	img_data_t() : lines(0), columns(0),
+								 min_value(std::numeric_limits<double>::max()) {}
+
+	double operator()(int line, int col) const {
+		return this->values[(size_t)line * this->columns + col];
+	}
+
+	int lines, columns;
+	double min_value; // smallest real sample minus one; padding cells don't count
+	std::vector<double> values;
+};
 
 class SurfaceNode : public LeafNode
 {
@@ -64,8 +82,9 @@ public:
   virtual Response accept(class State &state, Visitor &visitor) const {
 		return visitor.visit(state, *this);
 	}
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const { return "surface"; }
+	virtual AbstractNode *cloneNode() const { return new SurfaceNode(*this); }
 
 	Filename filename;
 	bool center;
@@ -131,6 +150,11 @@ void SurfaceNode::convert_image(img_data_t &data, std::vector<unsigned char> &im
 
 	double h = 100;
 	double scale = h / (z_max - z_min);
+	// Line 0 stays all zero: the old map never got an entry for it and
+	// read back its default value, which the grid keeps reproducing
+	data.lines = height + 1;
+	data.columns = width;
+	data.values.assign((size_t)data.lines * data.columns, 0.0);
 	for (unsigned int y = 0;y < height;y++) {
 		for (unsigned int x = 0;x < width;x++) {
 			long idx = 4 * (y * width + x);
@@ -139,8 +163,8 @@ void SurfaceNode::convert_image(img_data_t &data, std::vector<unsigned char> &im
 			if (invert) {
 				z = h - z;
 			}
-			data[std::make_pair(height - y, x)] = z;
-			
+			data.values[(size_t)(height - y) * width + x] = z;
+			data.min_value = std::min(z - 1, data.min_value);
 		}
 	}
 }
@@ -173,14 +197,16 @@ img_data_t SurfaceNode::read_png_or_dat(std::string filename) const
 	unsigned int width, height;
 	std::vector<unsigned char> img;
 	unsigned error = lodepng::decode(img, width, height, png);
+	// Drop the compressed file as soon as it's decoded so the peak is the
+	// RGBA image plus the height grid, not all three at once
+	std::vector<unsigned char>().swap(png);
 	if (error) {
 		PRINTB("ERROR: Can't read PNG image '%s'", filename);
-		data.clear();
 		return data;
 	}
-	
+
 	convert_image(data, img, width, height);
-	
+
 	return data;
 }
 
@@ -194,12 +220,8 @@ img_data_t SurfaceNode::read_dat(std::string filename) const
 		return data;
 	}
 
-	int lines = 0, columns = 0;
-	double min_val = 0;
-
-	typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
-	boost::char_separator<char> sep(" \t");
-
+	// Rows are streamed in one at a time; only when a longer row shows up
+	// does the grid have to be restrided to the new column count
 	while (!stream.eof()) {
 		std::string line;
 		while (!stream.eof() && (line.size() == 0 || line[0] == '#')) {
@@ -208,25 +230,44 @@ img_data_t SurfaceNode::read_dat(std::string filename) const
 		}
 		if (line.size() == 0 && stream.eof()) break;
 
-		int col = 0;
-		tokenizer tokens(line, sep);
-		try {
-			BOOST_FOREACH(const std::string &token, tokens) {
-				double v = boost::lexical_cast<double>(token);
-				data[std::make_pair(lines, col++)] = v;
-				if (col > columns) columns = col;
-				min_val = std::min(v-1, min_val);
-			}
+		std::vector<double> row;
+		bool ok = true;
+		// Cells are scanned straight out of the line buffer; the old
+		// tokenizer + lexical_cast pair cost more than reading the file
+		const char *cursor = line.c_str();
+		const char *lineend = cursor + line.size();
+		double v;
+		while (ScanUtils::scan_double(cursor, lineend, v)) {
+			row.push_back(v);
+			data.min_value = std::min(v-1, data.min_value);
 		}
-		catch (const boost::bad_lexical_cast &blc) {
+		ScanUtils::skip_space(cursor, lineend);
+		if (cursor != lineend) {
 			if (!stream.eof()) {
-				PRINTB("WARNING: Illegal value in '%s': %s", filename % blc.what());
+				PRINTB("WARNING: Illegal value in '%s': %s", filename % std::string(cursor, lineend - cursor));
 			}
-			break;
+			ok = false;
   	}
-		lines++;
+		if (!row.empty()) {
+			if ((int)row.size() > data.columns) {
+				int newcolumns = row.size();
+				std::vector<double> restrided((size_t)data.lines * newcolumns, 0.0);
+				for (int l = 0; l < data.lines; l++) {
+					for (int c = 0; c < data.columns; c++) {
+						restrided[(size_t)l * newcolumns + c] = data.values[(size_t)l * data.columns + c];
+					}
+				}
+				data.values.swap(restrided);
+				data.columns = newcolumns;
+			}
+			data.values.resize((size_t)(data.lines + 1) * data.columns, 0.0);
+			std::copy(row.begin(), row.end(),
+								data.values.begin() + (size_t)data.lines * data.columns);
+			data.lines++;
+		}
+		if (!ok) break;
 	}
-	
+
 	return data;
 }
 
@@ -237,13 +278,15 @@ Geometry *SurfaceNode::createGeometry() const
 	PolySet *p = new PolySet(3);
 	p->setConvexity(convexity);
 	
-	int lines = 0;
-	int columns = 0;
-	double min_val = std::numeric_limits<double>::max();
-	for (img_data_t::iterator it = data.begin();it != data.end();it++) {
-		lines = std::max(lines, (*it).first.first + 1);
-		columns = std::max(columns, (*it).first.second + 1);
-		min_val = std::min((*it).second - 1, min_val);
+	int lines = data.lines;
+	int columns = data.columns;
+	double min_val = data.min_value;
+
+	// A quad's worth of triangles per grid cell plus the skirt and bottom:
+	// reserve it all up front so the polygon vector doesn't regrow
+	if (lines > 1 && columns > 1) {
+		p->polygons.reserve((size_t)4 * (lines-1) * (columns-1) +
+												2 * (lines-1) + 2 * (columns-1) + 1);
 	}
 
 	double ox = center ? -(columns-1)/2.0 : 0;
@@ -252,10 +295,10 @@ Geometry *SurfaceNode::createGeometry() const
 	for (int i = 1; i < lines; i++)
 	for (int j = 1; j < columns; j++)
 	{
-		double v1 = data[std::make_pair(i-1, j-1)];
-		double v2 = data[std::make_pair(i-1, j)];
-		double v3 = data[std::make_pair(i, j-1)];
-		double v4 = data[std::make_pair(i, j)];
+		double v1 = data(i-1, j-1);
+		double v2 = data(i-1, j);
+		double v3 = data(i, j-1);
+		double v4 = data(i, j);
 		double vx = (v1 + v2 + v3 + v4) / 4;
 
 		p->append_poly();
@@ -283,14 +326,14 @@ Geometry *SurfaceNode::createGeometry() const
 	{
 		p->append_poly();
 		p->append_vertex(ox + 0, oy + i-1, min_val);
-		p->append_vertex(ox + 0, oy + i-1, data[std::make_pair(i-1, 0)]);
-		p->append_vertex(ox + 0, oy + i, data[std::make_pair(i, 0)]);
+		p->append_vertex(ox + 0, oy + i-1, data(i-1, 0));
+		p->append_vertex(ox + 0, oy + i, data(i, 0));
 		p->append_vertex(ox + 0, oy + i, min_val);
 
 		p->append_poly();
 		p->insert_vertex(ox + columns-1, oy + i-1, min_val);
-		p->insert_vertex(ox + columns-1, oy + i-1, data[std::make_pair(i-1, columns-1)]);
-		p->insert_vertex(ox + columns-1, oy + i, data[std::make_pair(i, columns-1)]);
+		p->insert_vertex(ox + columns-1, oy + i-1, data(i-1, columns-1));
+		p->insert_vertex(ox + columns-1, oy + i, data(i, columns-1));
 		p->insert_vertex(ox + columns-1, oy + i, min_val);
 	}
 
@@ -298,14 +341,14 @@ Geometry *SurfaceNode::createGeometry() const
 	{
 		p->append_poly();
 		p->insert_vertex(ox + i-1, oy + 0, min_val);
-		p->insert_vertex(ox + i-1, oy + 0, data[std::make_pair(0, i-1)]);
-		p->insert_vertex(ox + i, oy + 0, data[std::make_pair(0, i)]);
+		p->insert_vertex(ox + i-1, oy + 0, data(0, i-1));
+		p->insert_vertex(ox + i, oy + 0, data(0, i));
 		p->insert_vertex(ox + i, oy + 0, min_val);
 
 		p->append_poly();
 		p->append_vertex(ox + i-1, oy + lines-1, min_val);
-		p->append_vertex(ox + i-1, oy + lines-1, data[std::make_pair(lines-1, i-1)]);
-		p->append_vertex(ox + i, oy + lines-1, data[std::make_pair(lines-1, i)]);
+		p->append_vertex(ox + i-1, oy + lines-1, data(lines-1, i-1));
+		p->append_vertex(ox + i, oy + lines-1, data(lines-1, i));
 		p->append_vertex(ox + i, oy + lines-1, min_val);
 	}
 
@@ -322,7 +365,7 @@ Geometry *SurfaceNode::createGeometry() const
 	return p;
 }
 
-std::string SurfaceNode::toString() const
+std::string SurfaceNode::computeString() const
 {
 	std::stringstream stream;
 	fs::path path((std::string)this->filename);
@@ -167,6 +167,10 @@ std::string dump_svg( const CGAL_Nef_polyhedron2 &N )
 	out << svg_header() << "\n" << svg_styleblock( linewidth ) << "\n";
 
 	for ( i = explorer.faces_begin(); i!= explorer.faces_end(); ++i ) {
+		if ( (size_t)out.tellp() > SVG_DUMP_MAX_BYTES ) {
+			out << "<!-- dump truncated: size budget exhausted -->\n";
+			break;
+		}
 		out << "  <!-- face begin. mark: " << i->mark() << "  -->\n";
 		out << "   <!-- body begin -->\n";
 		CGAL_Nef_polyhedron2::Explorer::Halfedge_around_face_const_circulator c1
@@ -207,6 +211,7 @@ public:
 	void visit(CGAL_Nef_polyhedron3::SFace_const_handle ) {}
 	void visit( CGAL_Nef_polyhedron3::Halffacet_const_handle hfacet )
 	{
+		if ( (size_t)out.tellp() > SVG_DUMP_MAX_BYTES ) return;
 		int contour_count = 0;
 		out << "  <!-- Halffacet visit. Mark: " << (*hfacet).mark() << " -->\n";
 		std::string color = "gold";
@@ -256,7 +261,12 @@ std::string dump_svg( const CGAL_Nef_polyhedron3 &N )
 	out << svg_styleblock( linewidth ) << "\n" << svg_axes() << "\n";
 
 	CGAL_Nef_polyhedron3::Volume_const_iterator c;
+	bool truncated = false;
 	CGAL_forall_volumes(c,N) {
+		if ( (size_t)out.tellp() > SVG_DUMP_MAX_BYTES ) {
+			truncated = true;
+			break;
+		}
 		out << " <!--Volume begin-->\n";
 		out << "  <!--Mark: " << (*c).mark() << "-->\n";
 		CGAL_Nef_polyhedron3::Shell_entry_const_iterator it;
@@ -269,6 +279,7 @@ std::string dump_svg( const CGAL_Nef_polyhedron3 &N )
 		}
 		out << " <!--Volume end-->\n";
 	}
+	if (truncated) out << "<!-- dump truncated: size budget exhausted -->\n";
 	out << "<!--CGAL_Nef_polyhedron3 dump end-->\n";
 	out << "</svg>";
 	std::string tmp = out.str();
@@ -10,6 +10,8 @@ namespace OpenSCAD {
 
 #define SVG_PXW 480
 #define SVG_PXH 480
+// Byte budget per dump_svg() string; huge Nefs are truncated past this
+#define SVG_DUMP_MAX_BYTES (2*1024*1024)
 extern int svg_cursor_py;
 extern int svg_px_width;
 extern int svg_px_height;
@@ -90,7 +90,7 @@ FreetypeRenderer::Params TextNode::get_params() const
 	return params;
 }
 
-std::string TextNode::toString() const
+std::string TextNode::computeString() const
 {
 	std::stringstream stream;
 	stream << "(" << this->params << ")";
@@ -17,9 +17,10 @@ public:
 		return visitor.visit(state, *this);
 	}
 	
-	virtual std::string toString() const;
+	virtual std::string computeString() const;
 	virtual std::string name() const { return "text"; }
 	
+	virtual AbstractNode *cloneNode() const { return new TextNode(*this); }
 	virtual std::vector<const class Geometry *> createGeometryList() const;
   
 	virtual FreetypeRenderer::Params get_params() const;
@@ -181,7 +181,7 @@ AbstractNode *TransformModule::instantiate(const Context *ctx, const ModuleInsta
 	return node;
 }
 
-std::string TransformNode::toString() const
+std::string TransformNode::computeString() const
 {
 	std::stringstream stream;
 
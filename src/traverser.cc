@@ -5,10 +5,116 @@
 #include <algorithm>
 #include <boost/foreach.hpp>
 
-void Traverser::execute() 
+namespace {
+	// DFS work stack frame for NodeFlattening::build(). A frame is
+	// expanded once - emitting its prefix entry and pushing its children
+	// - and finalized when it surfaces again, emitting its postfix entry.
+	struct BuildFrame {
+		BuildFrame(const AbstractNode *node, const AbstractNode *parent)
+			: node(node), parent(parent), prefix_index(0), expanded(false) {}
+		const AbstractNode *node;
+		const AbstractNode *parent;
+		size_t prefix_index;
+		bool expanded;
+	};
+}
+
+void NodeFlattening::build(const AbstractNode &root)
+{
+	this->entries.clear();
+	this->flatroot = &root;
+
+	std::vector<BuildFrame> stack;
+	stack.push_back(BuildFrame(&root, NULL));
+	while (!stack.empty()) {
+		BuildFrame frame = stack.back(); // by value; push_back below invalidates references
+		if (!frame.expanded) {
+			stack.back().expanded = true;
+			stack.back().prefix_index = this->entries.size();
+			const std::vector<AbstractNode*> &children = frame.node->getChildren();
+			Entry e;
+			e.node = frame.node;
+			e.parent = frame.parent;
+			e.numchildren = children.size();
+			e.postfix = false;
+			e.skip = 0;
+			this->entries.push_back(e);
+			// Reversed so the first child is expanded first
+			for (size_t i = children.size(); i > 0; i--) {
+				stack.push_back(BuildFrame(children[i-1], frame.node));
+			}
+		}
+		else {
+			this->entries[frame.prefix_index].skip = this->entries.size();
+			Entry e;
+			e.node = frame.node;
+			e.parent = frame.parent;
+			e.numchildren = frame.node->getChildren().size();
+			e.postfix = true;
+			e.skip = 0;
+			this->entries.push_back(e);
+			stack.pop_back();
+		}
+	}
+}
+
+/*!
+	Iterative equivalent of the recursive traverse() below: one pass over
+	the flattened entries, with an explicit stack of States replacing the
+	call stack. The top of the stack always carries the state children
+	inherit, including any mutations the visitor made in the parent's
+	prefix visit (transforms, colors).
+*/
+void Traverser::execute(const NodeFlattening *flat)
 {
-	State state(NULL);
-	traverse(this->root, state);
+	NodeFlattening local;
+	if (!flat || flat->root() != &this->root) {
+		local.build(this->root);
+		flat = &local;
+	}
+
+	const bool doprefix = traversaltype == PREFIX || traversaltype == PRE_AND_POSTFIX;
+	const bool dopostfix = traversaltype == POSTFIX || traversaltype == PRE_AND_POSTFIX;
+
+	std::vector<State> statestack;
+	statestack.push_back(State(NULL));
+
+	size_t i = 0;
+	while (i < flat->entries.size()) {
+		const NodeFlattening::Entry &e = flat->entries[i];
+		if (!e.postfix) {
+			State newstate = statestack.back();
+			newstate.setNumChildren(e.numchildren);
+			Response response = ContinueTraversal;
+			if (doprefix) {
+				newstate.setPrefix(true);
+				newstate.setParent(e.parent);
+				response = e.node->accept(newstate, this->visitor);
+			}
+			if (response == AbortTraversal) return;
+			if (response == PruneTraversal) {
+				// Skip straight to this node's postfix entry; children in
+				// between are never visited
+				i = e.skip;
+			}
+			else {
+				newstate.setParent(e.node);
+				i++;
+			}
+			statestack.push_back(newstate);
+		}
+		else {
+			if (dopostfix) {
+				State &newstate = statestack.back();
+				newstate.setParent(e.parent);
+				newstate.setPrefix(false);
+				newstate.setPostfix(true);
+				if (e.node->accept(newstate, this->visitor) == AbortTraversal) return;
+			}
+			statestack.pop_back();
+			i++;
+		}
+	}
 }
 
 Response Traverser::traverse(const AbstractNode &node, const State &state)
@@ -1,7 +1,44 @@
 #pragma once
 
+#include <vector>
+#include <cstddef>
+
 enum Response {ContinueTraversal, AbortTraversal, PruneTraversal};
 
+/*!
+	A node tree linearized into a flat array of prefix/postfix events in
+	depth-first order. Built once per tree and replayed by every visitor
+	pass (dumping, hashing, CSG term evaluation, geometry evaluation)
+	through Traverser::execute(), which turns the recursive double
+	dispatch walk into a tight loop over contiguous entries: no traversal
+	recursion (deep trees can't overflow the stack) and the per-node
+	child bookkeeping is paid once instead of once per pass.
+*/
+class NodeFlattening
+{
+public:
+	NodeFlattening() : flatroot(NULL) {}
+
+	//! One prefix or postfix event of the walk
+	struct Entry {
+		const class AbstractNode *node;
+		const AbstractNode *parent;  //!< NULL for the root
+		unsigned int numchildren;
+		bool postfix;                //!< false: prefix event, true: postfix event
+		//! On prefix entries, the index of this node's postfix entry;
+		//! pruning jumps here, skipping the children in between
+		size_t skip;
+	};
+
+	void build(const AbstractNode &root);
+	const AbstractNode *root() const { return this->flatroot; }
+
+	std::vector<Entry> entries;
+
+private:
+	const AbstractNode *flatroot;
+};
+
 class Traverser
 {
 public:
@@ -12,7 +49,13 @@ public:
   }
   virtual ~Traverser() { }
   
-  void execute();
+	/*!
+		Runs the traversal as an iterative replay of a flattening. Pass a
+		prebuilt flattening (see Tree::getFlattening()) to share the
+		linearization between passes; when none is given, or the given one
+		was built for a different root, a local one is built first.
+	*/
+	void execute(const NodeFlattening *flat = NULL);
   // FIXME: reverse parameters
   Response traverse(const AbstractNode &node, const class State &state);
 private:
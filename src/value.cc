@@ -31,15 +31,17 @@
 #include <assert.h>
 #include <sstream>
 #include <boost/foreach.hpp>
-#include <boost/variant/apply_visitor.hpp>
-#include <boost/variant/static_visitor.hpp>
 #include <boost/format.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/weak_ptr.hpp>
 #include "boost-utils.h"
 #include "boosty.h"
 /*Unicode support for string lengths and array accesses*/
 #include <glib.h>
 
 #include <boost/math/special_functions/fpclassify.hpp>
+#include <Eigen/Core>
 
 std::ostream &operator<<(std::ostream &stream, const Filename &filename)
 {
@@ -76,54 +78,284 @@ std::ostream &operator<<(std::ostream &stream, const QuotedString &s)
 
 Value Value::undefined;
 
-Value::Value() : value(boost::blank())
+Value::Value()
 {
-  //  std::cout << "creating undef\n";
+  this->value_type = UNDEFINED;
+  this->payload.number = 0;
 }
 
-Value::Value(bool v) : value(v)
+Value::Value(bool v)
 {
-  //  std::cout << "creating bool\n";
+  this->value_type = BOOL;
+  this->payload.boolean = v;
 }
 
-Value::Value(int v) : value(double(v))
+Value::Value(int v)
 {
-  //  std::cout << "creating int\n";
+  this->value_type = NUMBER;
+  this->payload.number = v;
 }
 
-Value::Value(double v) : value(v)
+Value::Value(double v)
 {
-  //  std::cout << "creating double " << v << "\n";
+  this->value_type = NUMBER;
+  this->payload.number = v;
 }
 
-Value::Value(const std::string &v) : value(v)
+/*!
+	Concatenation shares both operand bodies in a new rope node instead
+	of copying the text. An empty operand just shares the other body, so
+	growing a string from empty never builds degenerate nodes.
+*/
+Value::StringType::StringType(const StringType &left, const StringType &right)
 {
-  //  std::cout << "creating string\n";
+  if (left.empty()) { this->body = right.body; return; }
+  if (right.empty()) { this->body = left.body; return; }
+  this->body.reset(new Body());
+  this->body->left = left.body;
+  this->body->right = right.body;
+  this->body->length = left.body->length + right.body->length;
 }
 
-Value::Value(const char *v) : value(std::string(v))
+static boost::mutex string_flatten_mutex;
+static boost::mutex string_intern_mutex;
+
+/*!
+	Returns a shared body for the given text. Short strings are pooled:
+	every Value built from the same part-name literal points at one
+	refcounted buffer, so copies are free and comparisons usually
+	resolve on body identity. Long texts skip the pool, where hashing
+	would cost more than the sharing saves. Entries are weakly held and
+	expired slots are swept once the pool has grown noticeably, like the
+	node string pool in node.cc.
+*/
+shared_ptr<Value::StringType::Body> Value::StringType::intern(const std::string &s)
 {
-  //  std::cout << "creating string from char *\n";
+  const size_t max_intern_length = 64;
+  if (s.size() > max_intern_length) return shared_ptr<Body>(new Body(s));
+
+  boost::mutex::scoped_lock lock(string_intern_mutex);
+  static boost::unordered_map<std::string, boost::weak_ptr<Body> > pool;
+  static size_t sweep_size = 1000;
+  boost::weak_ptr<Body> &entry = pool[s];
+  shared_ptr<Body> result = entry.lock();
+  if (!result) {
+    result.reset(new Body(s));
+    entry = result;
+    if (pool.size() > sweep_size) {
+      for (boost::unordered_map<std::string, boost::weak_ptr<Body> >::iterator it = pool.begin(); it != pool.end();) {
+        if (it->second.expired()) it = pool.erase(it);
+        else ++it;
+      }
+      sweep_size = 2 * (pool.size() + 500);
+    }
+  }
+  return result;
 }
 
-Value::Value(char v) : value(std::string(1, v))
+/*!
+	Returns the flat text. Rope nodes are collapsed on first use and the
+	result cached in the shared body; the mutex covers concurrent reads
+	from worker threads. The walk is iterative so the left-leaning ropes
+	built by repeated concatenation cannot overflow the stack.
+*/
+const std::string &Value::StringType::flatten() const
 {
-  //  std::cout << "creating string from char\n";
+  if (!this->body->left) return this->body->flat;
+
+  boost::unique_lock<boost::mutex> lock(string_flatten_mutex);
+  Body &body = *this->body;
+  if (!body.left) return body.flat;
+
+  std::string flat;
+  flat.reserve(body.length);
+  std::vector<const Body *> pending;
+  pending.push_back(&body);
+  while (!pending.empty()) {
+    const Body *node = pending.back();
+    pending.pop_back();
+    if (node->left) {
+      // right below left so the left segment is appended first
+      pending.push_back(node->right.get());
+      pending.push_back(node->left.get());
+    }
+    else {
+      flat += node->flat;
+    }
+  }
+  body.flat.swap(flat);
+  body.left.reset();
+  body.right.reset();
+  return body.flat;
 }
 
-Value::Value(const VectorType &v) : value(v)
+Value::Value(const std::string &v)
 {
-  //  std::cout << "creating vector\n";
+  this->value_type = STRING;
+  this->payload.string = new BoxedString(StringType(v));
 }
 
-Value::Value(const RangeType &v) : value(v)
+Value::Value(const char *v)
 {
-  //  std::cout << "creating range\n";
+  this->value_type = STRING;
+  this->payload.string = new BoxedString(StringType(std::string(v)));
+}
+
+Value::Value(char v)
+{
+  this->value_type = STRING;
+  this->payload.string = new BoxedString(StringType(std::string(1, v)));
+}
+
+Value::Value(const StringType &v)
+{
+  this->value_type = STRING;
+  this->payload.string = new BoxedString(v);
+}
+
+Value::Value(const VectorType &v)
+{
+  this->value_type = VECTOR;
+  this->payload.vector = new BoxedVector(VectorPtr(new VectorStorage(v)));
+}
+
+/*!
+	Auto-detects homogeneous numeric content. A list of plain numbers
+	becomes a flat scalar array; a list of equal-length flat scalar rows
+	becomes one flat array with a row stride. Since inner rows pass
+	through this constructor before the outer list does, a point table
+	collapses bottom-up into a single double array. Anything mixed keeps
+	the boxed representation.
+*/
+Value::VectorStorage::VectorStorage(const VectorType &v) : flat_stride(0), elements_built(false)
+{
+  if (!v.empty()) {
+    bool allnumbers = true;
+    bool allrows = true;
+    size_t stride = 0;
+    for (size_t i = 0; i < v.size(); i++) {
+      if (v[i].type() != NUMBER) allnumbers = false;
+      bool rowok = false;
+      if (v[i].type() == VECTOR) {
+        const VectorPtr &row = v[i].payload.vector->vec;
+        if (row->isFlat() && row->flatStride() == 0) {
+          if (i == 0) stride = row->flatData().size();
+          rowok = (row->flatData().size() == stride);
+        }
+      }
+      if (!rowok) allrows = false;
+      if (!allnumbers && !allrows) break;
+    }
+    if (allnumbers) {
+      this->flat_data.reserve(v.size());
+      for (size_t i = 0; i < v.size(); i++) {
+        this->flat_data.push_back(v[i].payload.number);
+      }
+      return;
+    }
+    if (allrows && stride > 0) {
+      this->flat_stride = stride;
+      this->flat_data.reserve(v.size() * stride);
+      for (size_t i = 0; i < v.size(); i++) {
+        const VectorPtr &row = v[i].payload.vector->vec;
+        this->flat_data.insert(this->flat_data.end(),
+                               row->flatData().begin(), row->flatData().end());
+      }
+      return;
+    }
+  }
+  this->elements = v;
+}
+
+Value::VectorStorage::VectorStorage(const std::vector<double> &data, size_t stride)
+  : flat_data(data), flat_stride(stride), elements_built(false)
+{
+}
+
+static boost::mutex vector_boxing_mutex;
+
+const Value::VectorType &Value::VectorStorage::boxed() const
+{
+  if (!isFlat() || this->elements_built) return this->elements;
+  boost::mutex::scoped_lock lock(vector_boxing_mutex);
+  if (this->elements_built) return this->elements;
+  VectorType boxed;
+  boxed.reserve(size());
+  if (this->flat_stride == 0) {
+    for (size_t i = 0; i < this->flat_data.size(); i++) {
+      boxed.push_back(Value(this->flat_data[i]));
+    }
+  }
+  else {
+    for (size_t i = 0; i < this->flat_data.size(); i += this->flat_stride) {
+      VectorType row(this->flat_data.begin() + i,
+                     this->flat_data.begin() + i + this->flat_stride);
+      boxed.push_back(Value(row));
+    }
+  }
+  this->elements.swap(boxed);
+  this->elements_built = true;
+  return this->elements;
+}
+
+Value::Value(const RangeType &v)
+{
+  this->value_type = RANGE;
+  this->payload.range = new BoxedRange(v);
+}
+
+/*!
+	Copying shares the out-of-line payload box; only the boxed kinds
+	carry a refcount, bool and number copies are a plain 16-byte copy.
+	See the union layout notes in value.h.
+*/
+Value::Value(const Value &v) : value_type(v.value_type), payload(v.payload)
+{
+  retain();
+}
+
+Value::~Value()
+{
+  release();
+}
+
+void Value::retain() const
+{
+  switch (this->value_type) {
+  case STRING:
+    ++this->payload.string->refs;
+    break;
+  case VECTOR:
+    ++this->payload.vector->refs;
+    break;
+  case RANGE:
+    ++this->payload.range->refs;
+    break;
+  default:
+    break;
+  }
+}
+
+void Value::release()
+{
+  switch (this->value_type) {
+  case STRING:
+    if (--this->payload.string->refs == 0) delete this->payload.string;
+    break;
+  case VECTOR:
+    if (--this->payload.vector->refs == 0) delete this->payload.vector;
+    break;
+  case RANGE:
+    if (--this->payload.range->refs == 0) delete this->payload.range;
+    break;
+  default:
+    break;
+  }
 }
 
 Value::ValueType Value::type() const
 {
-  return static_cast<ValueType>(this->value.which());
+  return static_cast<ValueType>(this->value_type);
 }
 
 bool Value::isUndefined() const
@@ -135,16 +367,16 @@ bool Value::toBool() const
 {
   switch (this->type()) {
   case BOOL:
-    return boost::get<bool>(this->value);
+    return this->payload.boolean;
     break;
   case NUMBER:
-    return boost::get<double>(this->value)!= 0;
+    return this->payload.number != 0;
     break;
   case STRING:
-    return boost::get<std::string>(this->value).size() > 0;
+    return this->payload.string->str.size() > 0;
     break;
   case VECTOR:
-    return boost::get<VectorType >(this->value).size() > 0;
+    return this->payload.vector->vec->size() > 0;
     break;
   case RANGE:
     return true;
@@ -164,102 +396,211 @@ double Value::toDouble() const
 
 bool Value::getDouble(double &v) const
 {
-  const double *d = boost::get<double>(&this->value);
-  if (d) {
-    v = *d;
+  if (this->type() == NUMBER) {
+    v = this->payload.number;
     return true;
   }
   return false;
 }
 
-class tostring_visitor : public boost::static_visitor<std::string>
+static std::string tostring_double(double op1)
 {
-public:
-  template <typename T> std::string operator()(const T &op1) const {
-    //    std::cout << "[generic tostring_visitor]\n";
-    return boost::lexical_cast<std::string>(op1);	
+  if (op1 != op1) { // Fix for avoiding nan vs. -nan across platforms
+    return "nan";
+  }
+  if (op1 == 0) {
+    return "0"; // Don't return -0 (exactly -0 and 0 equal 0)
   }
-
-  std::string operator()(const double &op1) const {
-    if (op1 != op1) { // Fix for avoiding nan vs. -nan across platforms
-      return "nan";
-    }
-    if (op1 == 0) {
-      return "0"; // Don't return -0 (exactly -0 and 0 equal 0)
-    }
 #ifdef OPENSCAD_TESTING
-    // Quick and dirty hack to work around floating point rounding differences
-    // across platforms for testing purposes.
-    std::stringstream tmp;
-    tmp.precision(12);
-    tmp.setf(std::ios_base::fixed);
-    tmp << op1;
-    std::string tmpstr = tmp.str();
-    size_t endpos = tmpstr.find_last_not_of('0');
-    if (endpos >= 0 && tmpstr[endpos] == '.') endpos--;
-    tmpstr = tmpstr.substr(0, endpos+1);
-    size_t dotpos = tmpstr.find('.');
-    if (dotpos != std::string::npos) {
-      if (tmpstr.size() - dotpos > 12) tmpstr.erase(dotpos + 12);
-      while (tmpstr[tmpstr.size()-1] == '0') tmpstr.erase(tmpstr.size()-1);
-    }
-    if ( tmpstr.compare("-0") == 0 ) tmpstr = "0";
-    tmpstr = two_digit_exp_format( tmpstr );
-    return tmpstr;
+  // Quick and dirty hack to work around floating point rounding differences
+  // across platforms for testing purposes.
+  std::stringstream tmp;
+  tmp.precision(12);
+  tmp.setf(std::ios_base::fixed);
+  tmp << op1;
+  std::string tmpstr = tmp.str();
+  size_t endpos = tmpstr.find_last_not_of('0');
+  if (endpos >= 0 && tmpstr[endpos] == '.') endpos--;
+  tmpstr = tmpstr.substr(0, endpos+1);
+  size_t dotpos = tmpstr.find('.');
+  if (dotpos != std::string::npos) {
+    if (tmpstr.size() - dotpos > 12) tmpstr.erase(dotpos + 12);
+    while (tmpstr[tmpstr.size()-1] == '0') tmpstr.erase(tmpstr.size()-1);
+  }
+  if ( tmpstr.compare("-0") == 0 ) tmpstr = "0";
+  tmpstr = two_digit_exp_format( tmpstr );
+  return tmpstr;
 #else
-    // attempt to emulate Qt's QString.sprintf("%g"); from old OpenSCAD.
-    // see https://github.com/openscad/openscad/issues/158
-    std::stringstream tmp;
-    tmp.unsetf(std::ios::floatfield);
-    tmp << op1;
-    return tmp.str();
+  // attempt to emulate Qt's QString.sprintf("%g"); from old OpenSCAD.
+  // see https://github.com/openscad/openscad/issues/158
+  std::stringstream tmp;
+  tmp.unsetf(std::ios::floatfield);
+  tmp << op1;
+  return tmp.str();
 #endif
-  }
-
-  std::string operator()(const boost::blank &) const {
-    return "undef";
-  }
-
-  std::string operator()(const bool &v) const {
-    return v ? "true" : "false";
-  }
+}
 
-  std::string operator()(const Value::VectorType &v) const {
+std::string Value::toString() const
+{
+  switch (this->type()) {
+  case BOOL:
+    return this->payload.boolean ? "true" : "false";
+  case NUMBER:
+    return tostring_double(this->payload.number);
+  case STRING:
+    return this->payload.string->str.flatten();
+  case VECTOR: {
+    const VectorPtr &v = this->payload.vector->vec;
     std::stringstream stream;
     stream << '[';
-    for (size_t i = 0; i < v.size(); i++) {
-      if (i > 0) stream << ", ";
-      stream << v[i];
+    if (v->isFlat() && v->flatStride() == 0) {
+      // Formatted in place so printing a flat list doesn't force boxing
+      const std::vector<double> &data = v->flatData();
+      for (size_t i = 0; i < data.size(); i++) {
+        if (i > 0) stream << ", ";
+        stream << tostring_double(data[i]);
+      }
+    }
+    else {
+      const VectorType &vec = v->boxed();
+      for (size_t i = 0; i < vec.size(); i++) {
+        if (i > 0) stream << ", ";
+        stream << vec[i];
+      }
     }
     stream << ']';
     return stream.str();
   }
+  case RANGE: {
+    const RangeType &r = this->payload.range->range;
+    return (boost::format("[%1% : %2% : %3%]") % r.begin_value() % r.step_value() % r.end_value()).str();
+  }
+  default:
+    return "undef";
+  }
+}
 
-  std::string operator()(const Value::RangeType &v) const {
-    return (boost::format("[%1% : %2% : %3%]") % v.begin_val % v.step_val % v.end_val).str();
+/*!
+  Exact, type-tagged serialization used for memoization keys. toString()
+  is unusable for keying: it drops the type (1, "1" and true all print
+  alike) and rounds numbers through %g, so distinct values share a
+  string. Here every value carries a type tag, numbers and range bounds
+  are stored as their raw bytes, and strings and vectors are length
+  prefixed, which makes the concatenated encoding unambiguous. Flat and
+  boxed vectors with equal content encode identically.
+*/
+void Value::memoAppend(std::string &out) const
+{
+  switch (this->type()) {
+  case BOOL:
+    out += this->payload.boolean ? 'T' : 'F';
+    break;
+  case NUMBER:
+    out += 'n';
+    out.append(reinterpret_cast<const char *>(&this->payload.number), sizeof(double));
+    break;
+  case STRING: {
+    const std::string &s = this->payload.string->str.flatten();
+    out += str(boost::format("s%d:") % s.size());
+    out += s;
+    break;
   }
-};
+  case VECTOR: {
+    const VectorPtr &v = this->payload.vector->vec;
+    if (v->isFlat()) {
+      const std::vector<double> &data = v->flatData();
+      const size_t stride = v->flatStride();
+      if (stride == 0) {
+        out += str(boost::format("v%d:") % data.size());
+        for (size_t i = 0; i < data.size(); i++) {
+          out += 'n';
+          out.append(reinterpret_cast<const char *>(&data[i]), sizeof(double));
+        }
+      }
+      else {
+        // Rows encode like the boxed nested vectors they stand for
+        out += str(boost::format("v%d:") % (data.size() / stride));
+        for (size_t i = 0; i < data.size(); i += stride) {
+          out += str(boost::format("v%d:") % stride);
+          for (size_t j = 0; j < stride; j++) {
+            out += 'n';
+            out.append(reinterpret_cast<const char *>(&data[i + j]), sizeof(double));
+          }
+        }
+      }
+    }
+    else {
+      const VectorType &vec = v->boxed();
+      out += str(boost::format("v%d:") % vec.size());
+      for (size_t i = 0; i < vec.size(); i++) vec[i].memoAppend(out);
+    }
+    break;
+  }
+  case RANGE: {
+    const RangeType &r = this->payload.range->range;
+    const double bounds[3] = { r.begin_value(), r.step_value(), r.end_value() };
+    out += 'r';
+    out.append(reinterpret_cast<const char *>(bounds), sizeof(bounds));
+    break;
+  }
+  default:
+    out += 'u';
+  }
+}
 
-std::string Value::toString() const
+std::string Value::memoString() const
 {
-  return boost::apply_visitor(tostring_visitor(), this->value);
+  std::string out;
+  this->memoAppend(out);
+  return out;
 }
 
 const Value::VectorType &Value::toVector() const
 {
   static VectorType empty;
-  
-  const VectorType *v = boost::get<VectorType>(&this->value);
-  if (v) return *v;
+
+  if (this->type() == VECTOR) return this->payload.vector->vec->boxed();
   else return empty;
 }
 
+/*!
+	Returns the shared string body of a STRING value, or an empty string
+	for other types. Concatenating through StringType shares the bodies
+	instead of copying the text.
+*/
+const Value::StringType &Value::toStringType() const
+{
+  static const StringType empty;
+
+  if (this->type() == STRING) return this->payload.string->str;
+  else return empty;
+}
+
+/*!
+	Returns the shared body of a VECTOR value, or an empty pointer for
+	other types. Lets callers key caches on table identity - the body is
+	never mutated after construction.
+*/
+Value::VectorPtr Value::toVectorPtr() const
+{
+  if (this->type() == VECTOR) return this->payload.vector->vec;
+  else return VectorPtr();
+}
+
 bool Value::getVec2(double &x, double &y) const
 {
   if (this->type() != VECTOR) return false;
 
-  const VectorType &v = toVector();
-  
+  const VectorPtr &vec = this->payload.vector->vec;
+  if (vec->isFlat() && vec->flatStride() == 0) {
+    const std::vector<double> &data = vec->flatData();
+    if (data.size() != 2) return false;
+    x = data[0]; y = data[1];
+    return true;
+  }
+
+  const VectorType &v = vec->boxed();
+
   if (v.size() != 2) return false;
   return (v[0].getDouble(x) && v[1].getDouble(y));
 }
@@ -268,7 +609,19 @@ bool Value::getVec3(double &x, double &y, double &z, double defaultval) const
 {
   if (this->type() != VECTOR) return false;
 
-  const VectorType &v = toVector();
+  const VectorPtr &vec = this->payload.vector->vec;
+  if (vec->isFlat() && vec->flatStride() == 0) {
+    const std::vector<double> &data = vec->flatData();
+    if (data.size() == 2) {
+      x = data[0]; y = data[1]; z = defaultval;
+      return true;
+    }
+    if (data.size() != 3) return false;
+    x = data[0]; y = data[1]; z = data[2];
+    return true;
+  }
+
+  const VectorType &v = vec->boxed();
 
   if (v.size() == 2) {
     getVec2(x, y);
@@ -282,38 +635,57 @@ bool Value::getVec3(double &x, double &y, double &z, double defaultval) const
   return (v[0].getDouble(x) && v[1].getDouble(y) && v[2].getDouble(z));
 }
 
-Value::RangeType Value::toRange() const
+const Value::RangeType &Value::toRange() const
 {
-  const RangeType *val = boost::get<RangeType>(&this->value);
-  if (val) {
-    return *val;
+  if (this->type() == RANGE) {
+    return this->payload.range->range;
+  }
+  else {
+    static const RangeType empty(0,0,0);
+    return empty;
   }
-  else return RangeType(0,0,0);
 }
 
 Value &Value::operator=(const Value &v)
 {
   if (this != &v) {
-    this->value = v.value;
+    // Retain the source box before releasing our own so assignment from
+    // a value inside our own payload stays safe
+    v.retain();
+    release();
+    this->value_type = v.value_type;
+    this->payload = v.payload;
   }
   return *this;
 }
 
-class equals_visitor : public boost::static_visitor<bool>
+bool Value::operator==(const Value &v) const
 {
-public:
-  template <typename T, typename U> bool operator()(const T &, const U &) const {
-    return false;
+  if (this->value_type != v.value_type) return false;
+  switch (this->type()) {
+  case UNDEFINED:
+    return true;
+  case BOOL:
+    return this->payload.boolean == v.payload.boolean;
+  case NUMBER:
+    return this->payload.number == v.payload.number;
+  case STRING:
+    return this->payload.string->str == v.payload.string->str;
+  case VECTOR: {
+    // Vectors compare by content, not by their shared storage pointer
+    const VectorPtr &op1 = this->payload.vector->vec;
+    const VectorPtr &op2 = v.payload.vector->vec;
+    if (op1 == op2) return true;
+    if (op1->size() != op2->size()) return false;
+    if (op1->isFlat() && op2->isFlat() && op1->flatStride() == op2->flatStride()) {
+      return op1->flatData() == op2->flatData();
+    }
+    return op1->boxed() == op2->boxed();
   }
-
-  template <typename T> bool operator()(const T &op1, const T &op2) const {
-    return op1 == op2;
+  case RANGE:
+    return this->payload.range->range == v.payload.range->range;
   }
-};
-
-bool Value::operator==(const Value &v) const
-{
-  return boost::apply_visitor(equals_visitor(), this->value, v.value);
+  return false;
 }
 
 bool Value::operator!=(const Value &v) const
@@ -321,100 +693,94 @@ bool Value::operator!=(const Value &v) const
   return !(*this == v);
 }
 
-#define DEFINE_VISITOR(name,op)\
-class name : public boost::static_visitor<bool> \
-{ \
-public:\
-  template <typename T, typename U> bool operator()(const T &, const U &) const {\
-    return false;\
-  }\
-\
-  bool operator()(const double &op1, const double &op2) const {\
-    return op1 op op2;\
-  }\
-\
-  bool operator()(const std::string &op1, const std::string &op2) const {\
-    return op1 op op2;\
-  }\
-}
-
-DEFINE_VISITOR(less_visitor, <);
-DEFINE_VISITOR(greater_visitor, >);
-DEFINE_VISITOR(lessequal_visitor, <=);
-DEFINE_VISITOR(greaterequal_visitor, >=);
+// Ordering is only defined between two numbers or two strings; any
+// other combination is false, matching the old visitor fallback
+#define DEFINE_COMPARISON(op) \
+  do { \
+    if (this->value_type != v.value_type) return false; \
+    if (this->type() == NUMBER) return this->payload.number op v.payload.number; \
+    if (this->type() == STRING) return this->payload.string->str op v.payload.string->str; \
+    return false; \
+  } while (0)
 
 bool Value::operator<(const Value &v) const
 {
-  return boost::apply_visitor(less_visitor(), this->value, v.value);
+  DEFINE_COMPARISON(<);
 }
 
 bool Value::operator>=(const Value &v) const
 {
-  return boost::apply_visitor(greaterequal_visitor(), this->value, v.value);
+  DEFINE_COMPARISON(>=);
 }
 
 bool Value::operator>(const Value &v) const
 {
-  return boost::apply_visitor(greater_visitor(), this->value, v.value);
+  DEFINE_COMPARISON(>);
 }
 
 bool Value::operator<=(const Value &v) const
 {
-  return boost::apply_visitor(lessequal_visitor(), this->value, v.value);
+  DEFINE_COMPARISON(<=);
 }
 
-class plus_visitor : public boost::static_visitor<Value>
+Value Value::operator+(const Value &v) const
 {
-public:
-  template <typename T, typename U> Value operator()(const T &, const U &) const {
-    return Value::undefined;
-  }
-
-  Value operator()(const double &op1, const double &op2) const {
-    return Value(op1 + op2);
+  if (this->type() == NUMBER && v.type() == NUMBER) {
+    return Value(this->payload.number + v.payload.number);
   }
-
-  Value operator()(const Value::VectorType &op1, const Value::VectorType &op2) const {
-    Value::VectorType sum;
-    for (size_t i = 0; i < op1.size() && i < op2.size(); i++) {
-      sum.push_back(op1[i] + op2[i]);
+  if (this->type() == VECTOR && v.type() == VECTOR) {
+    const VectorType &v1 = this->payload.vector->vec->boxed();
+    const VectorType &v2 = v.payload.vector->vec->boxed();
+    VectorType sum;
+    for (size_t i = 0; i < v1.size() && i < v2.size(); i++) {
+      sum.push_back(v1[i] + v2[i]);
     }
     return Value(sum);
   }
-};
-
-Value Value::operator+(const Value &v) const
-{
-  return boost::apply_visitor(plus_visitor(), this->value, v.value);
+  return Value::undefined;
 }
 
-class minus_visitor : public boost::static_visitor<Value>
+Value Value::operator-(const Value &v) const
 {
-public:
-  template <typename T, typename U> Value operator()(const T &, const U &) const {
-    return Value::undefined;
-  }
-
-  Value operator()(const double &op1, const double &op2) const {
-    return Value(op1 - op2);
+  if (this->type() == NUMBER && v.type() == NUMBER) {
+    return Value(this->payload.number - v.payload.number);
   }
-
-  Value operator()(const Value::VectorType &op1, const Value::VectorType &op2) const {
-    Value::VectorType sum;
-    for (size_t i = 0; i < op1.size() && i < op2.size(); i++) {
-      sum.push_back(op1[i] - op2[i]);
+  if (this->type() == VECTOR && v.type() == VECTOR) {
+    const VectorType &v1 = this->payload.vector->vec->boxed();
+    const VectorType &v2 = v.payload.vector->vec->boxed();
+    VectorType sum;
+    for (size_t i = 0; i < v1.size() && i < v2.size(); i++) {
+      sum.push_back(v1[i] - v2[i]);
     }
     return Value(sum);
   }
-};
+  return Value::undefined;
+}
 
-Value Value::operator-(const Value &v) const
+Value Value::fromFlatData(const std::vector<double> &data, size_t stride)
 {
-  return boost::apply_visitor(minus_visitor(), this->value, v.value);
+  Value v;
+  v.value_type = VECTOR;
+  v.payload.vector = new BoxedVector(VectorPtr(new VectorStorage(data, stride)));
+  return v;
 }
 
+// Eigen views of flat vector storage (see VectorStorage): matrices are
+// stored row-major, one row per stride
+typedef Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> > FlatMatrixMap;
+typedef Eigen::Map<const Eigen::VectorXd> FlatVectorMap;
+
 Value Value::multvecnum(const Value &vecval, const Value &numval)
 {
+  // Scalars and matrices alike scale in one vectorized pass when the
+  // operand is stored flat
+  const VectorPtr &vec = vecval.payload.vector->vec;
+  if (vec->isFlat() && !vec->flatData().empty()) {
+    std::vector<double> scaled(vec->flatData());
+    Eigen::VectorXd::Map(&scaled[0], scaled.size()) *= numval.toDouble();
+    return fromFlatData(scaled, vec->flatStride());
+  }
+
   // Vector * Number
   VectorType dstv;
   BOOST_FOREACH(const Value &val, vecval.toVector()) {
@@ -431,7 +797,7 @@ Value Value::multmatvec(const Value &matrixval, const Value &vectorval)
   // Matrix * Vector
   VectorType dstv;
   for (size_t i=0;i<matrixvec.size();i++) {
-    if (matrixvec[i].type() != VECTOR || 
+    if (matrixvec[i].type() != VECTOR ||
         matrixvec[i].toVector().size() != vectorvec.size()) {
       return Value();
     }
@@ -458,7 +824,7 @@ Value Value::multvecmat(const Value &vectorval, const Value &matrixval)
     double r_e = 0.0;
     for (size_t j=0;j<vectorvec.size();j++) {
       if (matrixvec[j].type() != VECTOR ||
-          matrixvec[j].toVector()[i].type() != NUMBER || 
+          matrixvec[j].toVector()[i].type() != NUMBER ||
           vectorvec[j].type() != NUMBER) {
         return Value::undefined;
       }
@@ -481,10 +847,43 @@ Value Value::operator*(const Value &v) const
     return multvecnum(v, *this);
   }
   else if (this->type() == VECTOR && v.type() == VECTOR) {
+    // Homogeneous numeric operands are kept as flat double arrays;
+    // shapes that line up run as one Eigen product instead of a
+    // variant visit per element. Shapes that don't line up fall
+    // through to the boxed code below and end up undef as before.
+    const VectorPtr &s1 = this->payload.vector->vec;
+    const VectorPtr &s2 = v.payload.vector->vec;
+    if (s1->isFlat() && s2->isFlat() &&
+        !s1->flatData().empty() && !s2->flatData().empty()) {
+      const std::vector<double> &d1 = s1->flatData();
+      const std::vector<double> &d2 = s2->flatData();
+      size_t st1 = s1->flatStride(), st2 = s2->flatStride();
+      if (st1 == 0 && st2 == 0 && d1.size() == d2.size()) {
+        // Vector dot product
+        return Value(FlatVectorMap(&d1[0], d1.size()).dot(FlatVectorMap(&d2[0], d2.size())));
+      }
+      if (st1 > 0 && st2 == 0 && st1 == d2.size()) {
+        // Matrix * Vector
+        Eigen::VectorXd r = FlatMatrixMap(&d1[0], d1.size()/st1, st1) * FlatVectorMap(&d2[0], d2.size());
+        return fromFlatData(std::vector<double>(r.data(), r.data() + r.size()), 0);
+      }
+      if (st1 == 0 && st2 > 0 && d1.size() == d2.size()/st2) {
+        // Vector * Matrix
+        Eigen::RowVectorXd r = Eigen::RowVectorXd::Map(&d1[0], d1.size()) * FlatMatrixMap(&d2[0], d2.size()/st2, st2);
+        return fromFlatData(std::vector<double>(r.data(), r.data() + r.size()), 0);
+      }
+      if (st1 > 0 && st2 > 0 && st1 == d2.size()/st2) {
+        // Matrix * Matrix
+        Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> r =
+          FlatMatrixMap(&d1[0], d1.size()/st1, st1) * FlatMatrixMap(&d2[0], d2.size()/st2, st2);
+        return fromFlatData(std::vector<double>(r.data(), r.data() + r.size()), r.cols());
+      }
+    }
+
     const VectorType &vec1 = this->toVector();
     const VectorType &vec2 = v.toVector();
     if (vec1[0].type() == NUMBER && vec2[0].type() == NUMBER &&
-        vec1.size() == vec2.size()) { 
+        vec1.size() == vec2.size()) {
         // Vector dot product.
         double r = 0.0;
         for (size_t i=0;i<vec1.size();i++) {
@@ -540,7 +939,7 @@ Value Value::operator/(const Value &v) const
 Value Value::operator%(const Value &v) const
 {
   if (this->type() == NUMBER && v.type() == NUMBER) {
-    return Value(fmod(boost::get<double>(this->value), boost::get<double>(v.value)));
+    return Value(fmod(this->payload.number, v.payload.number));
   }
   return Value::undefined;
 }
@@ -578,12 +977,15 @@ Value Value::operator-() const
  * If the string is multi-byte unicode then the index will offset to the character (2 or 4 byte) and not to the byte.
  * A 'normal' string with byte chars are a subset of unicode and still work.
  */
-class bracket_visitor : public boost::static_visitor<Value>
+Value Value::operator[](const Value &v) const
 {
-public:
-  Value operator()(const std::string &str, const double &idx) const {
+  if (v.type() != NUMBER) return Value::undefined;
+  const double idx = v.payload.number;
+  switch (this->type()) {
+  case STRING: {
+    const std::string &str = this->payload.string->str.flatten();
     int i = int(idx);
-    Value v;
+    Value result;
     //Check that the index is positive and less than the size in bytes
     if ((i >= 0) && (i < (int)str.size())) {
 	  //Ensure character (not byte) index is inside the character/glyph array
@@ -593,37 +995,32 @@ public:
 		  if(ptr) {
 		    g_utf8_strncpy(utf8_of_cp, ptr, 1);
 		  }
-		  v = std::string(utf8_of_cp);
+		  result = std::string(utf8_of_cp);
 	  }
-      //      std::cout << "bracket_visitor: " <<  v << "\n";
     }
-    return v;
+    return result;
   }
-
-  Value operator()(const Value::VectorType &vec, const double &idx) const {
+  case VECTOR: {
+    const VectorPtr &vec = this->payload.vector->vec;
     int i = int(idx);
-    if ((i >= 0) && (i < (int)vec.size())) return vec[int(idx)];
+    if ((i >= 0) && (i < (int)vec->size())) {
+      if (vec->isFlat() && vec->flatStride() == 0) return Value(vec->flatData()[i]);
+      return vec->boxed()[i];
+    }
     return Value::undefined;
   }
-
-  Value operator()(const Value::RangeType &range, const double &idx) const {
+  case RANGE: {
+    const RangeType &range = this->payload.range->range;
     switch(int(idx)) {
-    case 0: return Value(range.begin_val);
-    case 1: return Value(range.step_val);
-    case 2: return Value(range.end_val);
+    case 0: return Value(range.begin_value());
+    case 1: return Value(range.step_value());
+    case 2: return Value(range.end_value());
     }
     return Value::undefined;
   }
-
-  template <typename T, typename U> Value operator()(const T &, const U &) const {
-    //    std::cout << "generic bracket_visitor\n";
+  default:
     return Value::undefined;
   }
-};
-
-Value Value::operator[](const Value &v)
-{
-  return boost::apply_visitor(bracket_visitor(), this->value, v.value);
 }
 
 void Value::RangeType::normalize() {
@@ -641,8 +1038,8 @@ boost::uint32_t Value::RangeType::nbsteps() const {
   if ((begin_val == end_val) || boost::math::isinf(step_val)) {
     return 0;
   }
-  
-  if (step_val == 0) { 
+
+  if (step_val == 0) {
     return std::numeric_limits<boost::uint32_t>::max();
   }
 
@@ -658,11 +1055,11 @@ boost::uint32_t Value::RangeType::nbsteps() const {
     }
     steps = (end_val - begin_val) / step_val;
   }
-  
+
   return steps;
 }
 
-Value::RangeType::iterator::iterator(Value::RangeType &range, type_t type) : range(range), val(range.begin_val)
+Value::RangeType::iterator::iterator(const Value::RangeType &range, type_t type) : range(range), val(range.begin_val)
 {
     this->type = type;
     update_type();
@@ -5,12 +5,14 @@
 #include <algorithm>
 #include <limits>
 
+#include "memory.h"
+
 // Workaround for https://bugreports.qt-project.org/browse/QTBUG-22829
 #ifndef Q_MOC_RUN
-#include <boost/variant.hpp>
 #include <boost/lexical_cast.hpp>
 #endif
 #include <boost/cstdint.hpp>
+#include <boost/detail/atomic_count.hpp>
 
 class QuotedString : public std::string
 {
@@ -51,7 +53,7 @@ public:
         typedef double* pointer;
         typedef std::forward_iterator_tag iterator_category;
         typedef double difference_type;
-        iterator(RangeType &range, type_t type);
+        iterator(const RangeType &range, type_t type);
         self_type operator++();
         self_type operator++(int junk);
         reference operator*();
@@ -59,7 +61,7 @@ public:
         bool operator==(const self_type& other) const;
         bool operator!=(const self_type& other) const;
     private:
-      RangeType &range;
+      const RangeType &range;
       double val;
       type_t type;
       
@@ -81,18 +83,113 @@ public:
         this->end_val == other.end_val;
     }
 
-    iterator begin() { return iterator(*this, RANGE_TYPE_BEGIN); }
-    iterator end() { return iterator(*this, RANGE_TYPE_END); }
+    // begin()/end() are const so consumers can iterate the range stored
+    // inside a Value in place; elements are generated on the fly and
+    // never materialized as a vector
+    iterator begin() const { return iterator(*this, RANGE_TYPE_BEGIN); }
+    iterator end() const { return iterator(*this, RANGE_TYPE_END); }
+
+    double begin_value() const { return begin_val; }
+    double step_value() const { return step_val; }
+    double end_value() const { return end_val; }
 
     /// return number of steps, max uint32_t value if step is 0
     boost::uint32_t nbsteps() const;
-    
-    friend class tostring_visitor;
-    friend class bracket_visitor;
+  };
+
+  /*
+	String values are stored shared with O(1) amortized concatenation:
+	str() chains its operands into a rope of shared segments, which is
+	flattened - once, caching the result in the shared body - when the
+	text is actually consumed. Like vectors, string bodies are never
+	mutated after construction apart from that one-time flattening.
+	Short strings are additionally interned, so every Value built from
+	the same literal shares one immutable buffer and equality starts
+	with a pointer comparison - string-dispatch code compares the same
+	part names millions of times.
+  */
+  class StringType {
+  public:
+    StringType() : body(new Body()) {}
+    StringType(const std::string &s) : body(intern(s)) {}
+    StringType(const StringType &left, const StringType &right);
+
+    /// byte length, available without flattening
+    size_t size() const { return body->length; }
+    bool empty() const { return body->length == 0; }
+    /// the flat text; built and cached on first use
+    const std::string &flatten() const;
+
+    bool operator==(const StringType &other) const {
+      // Interned and copied strings share their body - equal by
+      // identity - and ropes know their length without flattening
+      if (body == other.body) return true;
+      if (body->length != other.body->length) return false;
+      return flatten() == other.flatten();
+    }
+    bool operator!=(const StringType &other) const { return !(*this == other); }
+    bool operator<(const StringType &other) const { return flatten() < other.flatten(); }
+    bool operator>(const StringType &other) const { return flatten() > other.flatten(); }
+    bool operator<=(const StringType &other) const { return flatten() <= other.flatten(); }
+    bool operator>=(const StringType &other) const { return flatten() >= other.flatten(); }
+
+  private:
+    struct Body {
+      std::string flat;
+      shared_ptr<Body> left, right; // set while this is an unflattened rope node
+      size_t length;
+      Body() : length(0) {}
+      Body(const std::string &s) : flat(s), length(s.size()) {}
+    };
+    static shared_ptr<Body> intern(const std::string &s);
+    shared_ptr<Body> body;
   };
 
   typedef std::vector<Value> VectorType;
 
+  /*
+	Shared vector storage: copying a VECTOR Value only bumps a refcount
+	instead of deep-copying the elements, and the storage is never
+	mutated after construction, so sharing is safe.
+
+	A homogeneous numeric list - all scalars, or all equal-length rows
+	of scalars, the shape of polyhedron() point and face tables - is
+	detected on construction and kept as one flat double array plus a
+	stride instead of a vector of boxed Values, which is an order of
+	magnitude less memory and pointer chasing for large point lists.
+	Consumers that want the boxed form (toVector()) still get it; it's
+	built lazily, once, and cached in the shared storage. Flat-aware
+	consumers read the doubles in place.
+  */
+  class VectorStorage {
+  public:
+    VectorStorage() : flat_stride(0), elements_built(false) {}
+    VectorStorage(const VectorType &v);
+    /// flat storage straight from computed doubles; used by the
+    /// Eigen-backed math fast paths (see Value::fromFlatData())
+    VectorStorage(const std::vector<double> &data, size_t stride);
+
+    size_t size() const {
+      if (!flat_data.empty()) return flat_stride ? flat_data.size() / flat_stride : flat_data.size();
+      return elements.size();
+    }
+    /// true when stored as a flat double array
+    bool isFlat() const { return !flat_data.empty(); }
+    /// doubles per row; 0 for a flat list of scalars
+    size_t flatStride() const { return flat_stride; }
+    const std::vector<double> &flatData() const { return flat_data; }
+    /// the boxed elements; built and cached on first use for flat storage
+    const VectorType &boxed() const;
+
+  private:
+    mutable VectorType elements;
+    std::vector<double> flat_data;
+    size_t flat_stride;
+    // boxed() was already called on flat storage; see value.cc
+    mutable bool elements_built;
+  };
+  typedef shared_ptr<VectorStorage> VectorPtr;
+
   enum ValueType {
     UNDEFINED,
     BOOL,
@@ -112,7 +209,9 @@ public:
   Value(const char v);
   Value(const VectorType &v);
   Value(const RangeType &v);
-  ~Value() {}
+  Value(const StringType &v);
+  Value(const Value &v);
+  ~Value();
 
   ValueType type() const;
   bool isUndefined() const;
@@ -121,10 +220,15 @@ public:
   bool getDouble(double &v) const;
   bool toBool() const;
   std::string toString() const;
+  std::string memoString() const;
+  //! memoString() appended in place; used when building compound keys
+  void memoAppend(std::string &out) const;
   const VectorType &toVector() const;
+  VectorPtr toVectorPtr() const;
+  const StringType &toStringType() const;
   bool getVec2(double &x, double &y) const;
   bool getVec3(double &x, double &y, double &z, double defaultval = 0.0) const;
-  RangeType toRange() const;
+  const RangeType &toRange() const;
 
 	operator bool() const { return this->toBool(); }
 
@@ -136,7 +240,7 @@ public:
   bool operator>=(const Value &v) const;
   bool operator>(const Value &v) const;
   Value operator-() const;
-  Value operator[](const Value &v);
+  Value operator[](const Value &v) const;
   Value operator+(const Value &v) const;
   Value operator-(const Value &v) const;
   Value operator*(const Value &v) const;
@@ -149,12 +253,51 @@ public:
     return stream;
   }
 
-  typedef boost::variant< boost::blank, bool, double, std::string, VectorType, RangeType > Variant;
-
 private:
+  /*
+	Storage is a hand-rolled tagged union dispatched by switching on the
+	type tag. The boost::variant it replaces sized every Value for its
+	largest alternative (RangeType, three doubles) and compiled each
+	operation into layered visitor calls; here a Value is 16 bytes - tag
+	plus one 8-byte payload slot - which matters because vectors of boxed
+	Values are the interpreter's bulk data structure. bool and double
+	live inline in the slot; strings, vectors and ranges live out of line
+	in a refcounted box, so copying any Value is at most one atomic
+	increment. The boxes are never mutated after construction, making the
+	sharing thread-safe (the refcount is atomic).
+  */
+  struct BoxedString {
+    StringType str;
+    mutable boost::detail::atomic_count refs;
+    BoxedString(const StringType &s) : str(s), refs(1) {}
+  };
+  struct BoxedVector {
+    VectorPtr vec;
+    mutable boost::detail::atomic_count refs;
+    BoxedVector(const VectorPtr &v) : vec(v), refs(1) {}
+  };
+  struct BoxedRange {
+    RangeType range;
+    mutable boost::detail::atomic_count refs;
+    BoxedRange(const RangeType &r) : range(r), refs(1) {}
+  };
+  union Payload {
+    bool boolean;
+    double number;
+    BoxedString *string;
+    BoxedVector *vector;
+    BoxedRange *range;
+  };
+
+  void retain() const;
+  void release();
+
   static Value multvecnum(const Value &vecval, const Value &numval);
   static Value multmatvec(const Value &matrixval, const Value &vectorval);
   static Value multvecmat(const Value &vectorval, const Value &matrixval);
+  //! Wraps computed doubles as a VECTOR without boxing the elements
+  static Value fromFlatData(const std::vector<double> &data, size_t stride);
 
-  Variant value;
+  unsigned char value_type; // ValueType
+  Payload payload;
 };
@@ -45,6 +45,9 @@ public:
   virtual Response visit(class State &state, const class RenderNode &node) {
 		return visit(state, (const class AbstractNode &)node);
 	}
+  virtual Response visit(class State &state, const class VoxelRenderNode &node) {
+		return visit(state, (const class AbstractNode &)node);
+	}
   virtual Response visit(class State &state, const class SurfaceNode &node) {
 		return visit(state, (const class LeafNode &)node);
 	}
@@ -0,0 +1,314 @@
+#include "voxelizer.h"
+#include "polyset.h"
+#include "printutils.h"
+#include "node.h"
+#include "module.h"
+#include "csgnode.h"
+#include "transformnode.h"
+#include "colornode.h"
+#include "rendernode.h"
+#include "GeometryEvaluator.h"
+#include "GeometryInstances.h"
+#include "Tree.h"
+#include "workerpool.h"
+
+#include <algorithm>
+#include <math.h>
+#include <typeinfo>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+
+VoxelGrid::VoxelGrid(const BoundingBox &bounds, double resolution)
+{
+	this->res = resolution > 0 ? resolution : 1.0;
+	if (bounds.isEmpty()) {
+		this->nx = this->ny = this->nz = 0;
+		this->origin = Vector3d(0, 0, 0);
+		return;
+	}
+	Vector3d extent = bounds.max() - bounds.min();
+	for (;;) {
+		// One padding cell on every side so the boundary faces of cells
+		// touching the bounds are always emitted
+		this->nx = (int)ceil(extent[0] / this->res) + 2;
+		this->ny = (int)ceil(extent[1] / this->res) + 2;
+		this->nz = (int)ceil(extent[2] / this->res) + 2;
+		size_t ncells = (size_t)this->nx * this->ny * this->nz;
+		if (ncells <= MAX_NR_OF_CELLS) break;
+		this->res *= 2;
+		PRINTB("WARNING: voxel_render() grid too large, coarsening resolution to %g", this->res);
+	}
+	this->origin = bounds.min() - Vector3d(this->res, this->res, this->res);
+	this->cells.assign((size_t)this->nx * this->ny * this->nz, 0);
+}
+
+/*!
+	Sorts a row of columns' crossing lists and sets the cells between
+	successive crossing pairs; split out so the rows can run on the
+	worker pool.
+*/
+void VoxelGrid::fillColumnRange(const std::vector<std::vector<double> > *crossings,
+																int ybegin, int yend)
+{
+	for (int y = ybegin; y < yend; y++) {
+		for (int x = 0; x < this->nx; x++) {
+			std::vector<double> zs = (*crossings)[(size_t)y * this->nx + x];
+			if (zs.size() < 2) continue;
+			std::sort(zs.begin(), zs.end());
+			// Coincident crossings (the ray grazing a shared edge) come in
+			// pairs that would open and close a zero-width span; drop them
+			std::vector<double> dedup;
+			for (size_t i = 0; i < zs.size(); i++) {
+				if (i + 1 < zs.size() && zs[i + 1] - zs[i] < this->res * 1e-9) {
+					i++;
+					continue;
+				}
+				dedup.push_back(zs[i]);
+			}
+			for (size_t i = 0; i + 1 < dedup.size(); i += 2) {
+				int z0 = (int)ceil((dedup[i] - this->origin[2]) / this->res - 0.5);
+				int z1 = (int)floor((dedup[i + 1] - this->origin[2]) / this->res - 0.5);
+				if (z0 < 0) z0 = 0;
+				if (z1 >= this->nz) z1 = this->nz - 1;
+				for (int z = z0; z <= z1; z++) {
+					this->cells[(size_t)((z * this->ny + y) * this->nx + x)] = 1;
+				}
+			}
+		}
+	}
+}
+
+void VoxelGrid::fill(const PolySet &ps)
+{
+	if (empty()) return;
+	ps.ensureLoaded(); // spilled sets are read back for rasterization
+
+	// Collect the z crossings of every cell-center column with the mesh.
+	// Sample points are nudged off the exact cell centers so meshes with
+	// axis-aligned faces (every cube) don't land rays exactly on edges.
+	const double eps = this->res * 1e-4;
+	std::vector<std::vector<double> > crossings((size_t)this->nx * this->ny);
+	BOOST_FOREACH(const PolySet::Polygon &p, ps.polygons) {
+		for (size_t fan = 2; fan < p.size(); fan++) {
+			const Vector3d &a = p[0];
+			const Vector3d &b = p[fan - 1];
+			const Vector3d &c = p[fan];
+			double det = (b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]);
+			if (fabs(det) < 1e-12) continue; // vertical triangle: no z crossing
+			double minx = std::min(a[0], std::min(b[0], c[0]));
+			double maxx = std::max(a[0], std::max(b[0], c[0]));
+			double miny = std::min(a[1], std::min(b[1], c[1]));
+			double maxy = std::max(a[1], std::max(b[1], c[1]));
+			int x0 = std::max(0, (int)floor((minx - this->origin[0]) / this->res - 0.5));
+			int x1 = std::min(this->nx - 1, (int)ceil((maxx - this->origin[0]) / this->res - 0.5));
+			int y0 = std::max(0, (int)floor((miny - this->origin[1]) / this->res - 0.5));
+			int y1 = std::min(this->ny - 1, (int)ceil((maxy - this->origin[1]) / this->res - 0.5));
+			for (int y = y0; y <= y1; y++) {
+				double py = this->origin[1] + (y + 0.5) * this->res + eps;
+				for (int x = x0; x <= x1; x++) {
+					double px = this->origin[0] + (x + 0.5) * this->res + eps;
+					// Barycentric coordinates of the sample in the xy projection
+					double l1 = ((px - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (py - a[1])) / det;
+					double l2 = ((b[0] - a[0]) * (py - a[1]) - (px - a[0]) * (b[1] - a[1])) / det;
+					if (l1 < 0 || l2 < 0 || l1 + l2 > 1) continue;
+					double z = a[2] + l1 * (b[2] - a[2]) + l2 * (c[2] - a[2]);
+					crossings[(size_t)y * this->nx + x].push_back(z);
+				}
+			}
+		}
+	}
+
+	// The per-column sort and span fill is embarrassingly parallel
+	size_t numthreads = std::min((size_t)this->ny, WorkerPool::numThreads());
+	if (numthreads < 2) {
+		fillColumnRange(&crossings, 0, this->ny);
+		return;
+	}
+	WorkerPool::TaskGroup group;
+	int chunk = (this->ny + numthreads - 1) / numthreads;
+	for (int y = 0; y < this->ny; y += chunk) {
+		group.run(boost::bind(&VoxelGrid::fillColumnRange, this, &crossings,
+													y, std::min(y + chunk, this->ny)));
+	}
+	group.wait();
+}
+
+void VoxelGrid::combine(OpenSCADOperator op, const VoxelGrid &other)
+{
+	assert(this->cells.size() == other.cells.size());
+	for (size_t i = 0; i < this->cells.size(); i++) {
+		switch (op) {
+		case OPENSCAD_UNION:
+			this->cells[i] |= other.cells[i];
+			break;
+		case OPENSCAD_INTERSECTION:
+			this->cells[i] &= other.cells[i];
+			break;
+		case OPENSCAD_DIFFERENCE:
+			this->cells[i] &= !other.cells[i];
+			break;
+		default:
+			assert(false && "Unsupported voxel operation");
+		}
+	}
+}
+
+PolySet *VoxelGrid::extractMesh() const
+{
+	PolySet *ps = new PolySet(3);
+	ps->setConvexity(2);
+	for (int z = 0; z < this->nz; z++) {
+		for (int y = 0; y < this->ny; y++) {
+			for (int x = 0; x < this->nx; x++) {
+				if (!inside(x, y, z)) continue;
+				double x0 = this->origin[0] + x * this->res, x1 = x0 + this->res;
+				double y0 = this->origin[1] + y * this->res, y1 = y0 + this->res;
+				double z0 = this->origin[2] + z * this->res, z1 = z0 + this->res;
+				// Faces wound counterclockwise seen from outside, matching
+				// the cube primitive
+				if (!inside(x + 1, y, z)) {
+					ps->append_poly(4);
+					ps->append_vertex(x1, y0, z0);
+					ps->append_vertex(x1, y1, z0);
+					ps->append_vertex(x1, y1, z1);
+					ps->append_vertex(x1, y0, z1);
+				}
+				if (!inside(x - 1, y, z)) {
+					ps->append_poly(4);
+					ps->append_vertex(x0, y0, z0);
+					ps->append_vertex(x0, y0, z1);
+					ps->append_vertex(x0, y1, z1);
+					ps->append_vertex(x0, y1, z0);
+				}
+				if (!inside(x, y + 1, z)) {
+					ps->append_poly(4);
+					ps->append_vertex(x0, y1, z0);
+					ps->append_vertex(x0, y1, z1);
+					ps->append_vertex(x1, y1, z1);
+					ps->append_vertex(x1, y1, z0);
+				}
+				if (!inside(x, y - 1, z)) {
+					ps->append_poly(4);
+					ps->append_vertex(x0, y0, z0);
+					ps->append_vertex(x1, y0, z0);
+					ps->append_vertex(x1, y0, z1);
+					ps->append_vertex(x0, y0, z1);
+				}
+				if (!inside(x, y, z + 1)) {
+					ps->append_poly(4);
+					ps->append_vertex(x0, y0, z1);
+					ps->append_vertex(x1, y0, z1);
+					ps->append_vertex(x1, y1, z1);
+					ps->append_vertex(x0, y1, z1);
+				}
+				if (!inside(x, y, z - 1)) {
+					ps->append_poly(4);
+					ps->append_vertex(x0, y0, z0);
+					ps->append_vertex(x0, y1, z0);
+					ps->append_vertex(x1, y1, z0);
+					ps->append_vertex(x1, y0, z0);
+				}
+			}
+		}
+	}
+	return ps;
+}
+
+shared_ptr<const Geometry> VoxelEvaluator::evaluate(const AbstractNode &node)
+{
+	return combineChildren(node, OPENSCAD_UNION);
+}
+
+/*!
+	Structural dispatch: boolean and grouping nodes are evaluated on the
+	grid, transforms exactly on the operand meshes, everything else
+	through the exact evaluator.
+*/
+shared_ptr<const PolySet> VoxelEvaluator::evaluateNode(const AbstractNode &node)
+{
+	if (const CsgNode *csg = dynamic_cast<const CsgNode *>(&node)) {
+		return combineChildren(node, csg->type);
+	}
+	if (const TransformNode *transform = dynamic_cast<const TransformNode *>(&node)) {
+		shared_ptr<const PolySet> child = combineChildren(node, OPENSCAD_UNION);
+		if (!child) return child;
+		PolySet *transformed = new PolySet(*child);
+		transformed->transform(transform->matrix);
+		return shared_ptr<const PolySet>(transformed);
+	}
+	if (dynamic_cast<const AbstractIntersectionNode *>(&node)) {
+		return combineChildren(node, OPENSCAD_INTERSECTION);
+	}
+	if (dynamic_cast<const ColorNode *>(&node) ||
+			dynamic_cast<const RenderNode *>(&node) ||
+			typeid(node) == typeid(AbstractNode)) {
+		return combineChildren(node, OPENSCAD_UNION);
+	}
+	return evaluateFallback(node);
+}
+
+shared_ptr<const PolySet> VoxelEvaluator::combineChildren(const AbstractNode &node,
+																													OpenSCADOperator op)
+{
+	std::vector<shared_ptr<const PolySet> > meshes;
+	BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+		if (chnode->modinst->isBackground()) continue;
+		shared_ptr<const PolySet> mesh = evaluateNode(*chnode);
+		bool isempty = !mesh || mesh->isEmpty();
+		if (meshes.empty() && isempty &&
+				(op == OPENSCAD_DIFFERENCE || op == OPENSCAD_INTERSECTION)) {
+			// Empty first operand: nothing to subtract from / intersect with
+			return shared_ptr<const PolySet>(new PolySet(3));
+		}
+		if (op == OPENSCAD_INTERSECTION && isempty) {
+			return shared_ptr<const PolySet>(new PolySet(3));
+		}
+		if (!isempty) meshes.push_back(mesh);
+	}
+	if (meshes.empty()) return shared_ptr<const PolySet>();
+	if (meshes.size() == 1) return meshes[0]; // no approximation needed
+
+	// Common grid layout for all operands: the region the result can
+	// occupy, derived from the operand bounds per operation
+	BoundingBox bounds;
+	if (op == OPENSCAD_DIFFERENCE) {
+		bounds = meshes[0]->getBoundingBox();
+	} else if (op == OPENSCAD_INTERSECTION) {
+		bounds = meshes[0]->getBoundingBox();
+		for (size_t i = 1; i < meshes.size(); i++) {
+			bounds = bounds.intersection(meshes[i]->getBoundingBox());
+		}
+	} else {
+		for (size_t i = 0; i < meshes.size(); i++) {
+			bounds.extend(meshes[i]->getBoundingBox());
+		}
+	}
+	if (bounds.isEmpty()) return shared_ptr<const PolySet>(new PolySet(3));
+
+	VoxelGrid result(bounds, this->resolution);
+	result.fill(*meshes[0]);
+	for (size_t i = 1; i < meshes.size(); i++) {
+		VoxelGrid operand(bounds, this->resolution);
+		operand.fill(*meshes[i]);
+		result.combine(op, operand);
+	}
+	return shared_ptr<const PolySet>(result.extractMesh());
+}
+
+/*!
+	Evaluates a subtree the grid engine doesn't understand through the
+	normal exact evaluator and hands back its mesh for rasterization.
+*/
+shared_ptr<const PolySet> VoxelEvaluator::evaluateFallback(const AbstractNode &node)
+{
+	GeometryEvaluator evaluator(this->tree);
+	shared_ptr<const Geometry> geom = evaluator.evaluateGeometry(node, false);
+	shared_ptr<const GeometryInstances> instances =
+		dynamic_pointer_cast<const GeometryInstances>(geom);
+	if (instances) geom.reset(instances->expandToPolySet());
+	shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(geom);
+	if (geom && !ps) {
+		PRINTB("WARNING: Ignoring 2D child of voxel_render(): %s", node.name());
+	}
+	return ps;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "memory.h"
+#include "enums.h"
+#include "linalg.h"
+#include <vector>
+
+/*!
+	Draft-quality voxel evaluation engine behind voxel_render() (see
+	rendernode.h). The subtree's boolean structure is re-evaluated on an
+	occupancy grid instead of exact Nef arithmetic: each operand mesh is
+	rasterized into the grid by z-column ray parity, the booleans become
+	per-cell bit operations, and the result is remeshed as the boundary
+	faces between inside and outside cells.
+
+	Grid booleans are O(cells) regardless of how pathological the operand
+	topology is, so heavy operations collapse to seconds at the price of
+	a one-cell tolerance - good enough for fit-check prints. Transforms
+	are applied exactly on the operand meshes before rasterization;
+	subtrees the engine doesn't understand (minkowski, hull, leaves,
+	extrusions, ...) fall back to the normal exact evaluator and only
+	their results are voxelized.
+*/
+class VoxelGrid
+{
+public:
+	//! The grid covers bounds padded by one cell on every side; the
+	//! resolution is coarsened (with a warning) when the cell count
+	//! would exceed MAX_NR_OF_CELLS
+	VoxelGrid(const BoundingBox &bounds, double resolution);
+
+	//! Rasterizes the mesh into the grid by z-column ray parity; cells
+	//! already inside stay inside (i.e. fill() unions)
+	void fill(const class PolySet &ps);
+	//! Per-cell boolean against another grid of identical layout
+	void combine(OpenSCADOperator op, const VoxelGrid &other);
+	//! Boundary faces between inside and outside cells as a closed mesh
+	class PolySet *extractMesh() const;
+
+	bool empty() const { return nx == 0 || ny == 0 || nz == 0; }
+	double cellSize() const { return res; }
+
+	static const size_t MAX_NR_OF_CELLS = 100*1000*1000;
+
+private:
+	bool inside(int x, int y, int z) const {
+		if (x < 0 || y < 0 || z < 0 || x >= nx || y >= ny || z >= nz) return false;
+		return cells[(size_t)((z * ny + y) * nx + x)] != 0;
+	}
+	void fillColumnRange(const std::vector<std::vector<double> > *crossings,
+											 int ybegin, int yend);
+
+	Vector3d origin;
+	double res;
+	int nx, ny, nz;
+	std::vector<unsigned char> cells;
+};
+
+class VoxelEvaluator
+{
+public:
+	VoxelEvaluator(const class Tree &tree, double resolution)
+		: tree(tree), resolution(resolution) {}
+
+	//! Voxel-approximated union of the node's children, or NULL
+	shared_ptr<const class Geometry> evaluate(const class AbstractNode &node);
+
+private:
+	shared_ptr<const class PolySet> evaluateNode(const class AbstractNode &node);
+	shared_ptr<const class PolySet> combineChildren(const class AbstractNode &node,
+																									OpenSCADOperator op);
+	shared_ptr<const class PolySet> evaluateFallback(const class AbstractNode &node);
+
+	const class Tree &tree;
+	double resolution;
+};
@@ -0,0 +1,142 @@
+#include "workerpool.h"
+#include "progress.h"
+#include "printutils.h"
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cstdlib>
+
+WorkerPool *WorkerPool::inst = NULL;
+
+namespace {
+	// 0 = auto-detect; set once at startup from --threads or the
+	// environment, read per parallel section
+	size_t configured_threads = 0;
+}
+
+size_t WorkerPool::numThreads()
+{
+	if (configured_threads) return configured_threads;
+	const char *env = getenv("OPENSCAD_NUM_THREADS");
+	if (env) {
+		int n = atoi(env);
+		if (n > 0) return (size_t)n;
+	}
+	size_t n = boost::thread::hardware_concurrency();
+	return n ? n : 1;
+}
+
+void WorkerPool::setNumThreads(size_t n)
+{
+	configured_threads = n;
+}
+
+void WorkerPool::TaskGroup::run(const boost::function<void()> &f)
+{
+	if (WorkerPool::numThreads() < 2) {
+		// Single-threaded configuration: run in place; exceptions
+		// propagate directly as in the sequential code
+		f();
+		return;
+	}
+	WorkerPool::instance()->enqueue(this, f);
+}
+
+void WorkerPool::TaskGroup::wait()
+{
+	WorkerPool::instance()->waitGroup(this);
+	if (this->cancelled) throw ProgressCancelException();
+}
+
+WorkerPool::TaskGroup::~TaskGroup()
+{
+	// Unwind path: tasks hold pointers into the caller's frame, so they
+	// must be finished (or skipped, when cancelled) before it goes away
+	WorkerPool::instance()->waitGroup(this);
+}
+
+void WorkerPool::enqueue(TaskGroup *group, const boost::function<void()> &fn)
+{
+	Task task;
+	task.group = group;
+	task.fn = fn;
+	boost::lock_guard<boost::mutex> lock(this->pool_mutex);
+	group->pending++;
+	this->queue.push_back(task);
+	startWorkers();
+	this->work_available.notify_one();
+}
+
+/*!
+	Runs queued tasks until the group has none pending. Helping out
+	instead of blocking keeps nested groups deadlock-free: whatever task
+	the group is waiting on is either in the queue - and gets executed
+	here or by a worker - or already running somewhere.
+*/
+void WorkerPool::waitGroup(TaskGroup *group)
+{
+	boost::unique_lock<boost::mutex> lock(this->pool_mutex);
+	while (group->pending > 0) {
+		if (!this->queue.empty()) {
+			Task task = this->queue.front();
+			this->queue.pop_front();
+			lock.unlock();
+			execute(task);
+			lock.lock();
+		}
+		else {
+			this->task_done.wait(lock);
+		}
+	}
+}
+
+void WorkerPool::execute(const Task &task)
+{
+	bool skip;
+	{
+		boost::lock_guard<boost::mutex> lock(this->pool_mutex);
+		skip = task.group->cancelled;
+	}
+	if (!skip) {
+		try {
+			task.fn();
+		}
+		catch (const ProgressCancelException &) {
+			boost::lock_guard<boost::mutex> lock(this->pool_mutex);
+			task.group->cancelled = true;
+		}
+		catch (...) {
+			PRINT("WARNING: Worker task failed with an unexpected exception, aborting the parallel section");
+			boost::lock_guard<boost::mutex> lock(this->pool_mutex);
+			task.group->cancelled = true;
+		}
+	}
+	boost::lock_guard<boost::mutex> lock(this->pool_mutex);
+	task.group->pending--;
+	if (task.group->pending == 0) this->task_done.notify_all();
+}
+
+//! Called with pool_mutex held
+void WorkerPool::startWorkers()
+{
+	size_t target = numThreads() - 1;
+	while (this->started_workers < target) {
+		boost::thread(boost::bind(&WorkerPool::workerLoop, this));
+		this->started_workers++;
+	}
+}
+
+void WorkerPool::workerLoop()
+{
+	for (;;) {
+		Task task;
+		{
+			boost::unique_lock<boost::mutex> lock(this->pool_mutex);
+			while (this->queue.empty()) this->work_available.wait(lock);
+			task = this->queue.front();
+			this->queue.pop_front();
+		}
+		execute(task);
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
+
+/*!
+	Shared worker pool behind every parallel feature (parallel-union,
+	parallel-csg, parallel-for, the PNG deflate split, ...). The features
+	used to fork a private boost::thread_group per parallel section; here
+	the threads are started once and reused, and the count is controlled
+	in one place: --threads on the command line, the OPENSCAD_NUM_THREADS
+	environment variable, or the detected core count.
+
+	Work is submitted through a TaskGroup. wait() makes the calling
+	thread execute queued tasks instead of blocking, so a task may open
+	its own nested group (e.g. a parallel union inside a parallel for
+	iteration) without deadlocking the pool, and the submitting thread
+	contributes a full worker's worth of throughput - the pool therefore
+	runs numThreads()-1 background threads.
+
+	Cancellation rides on the progress machinery: a task aborted by
+	ProgressCancelException (see progress.h) marks its group cancelled,
+	the group's remaining queued tasks are skipped, and wait() rethrows
+	the exception on the submitting thread, which unwinds exactly like
+	the sequential code path.
+*/
+class WorkerPool
+{
+public:
+	static WorkerPool *instance() { if (!inst) inst = new WorkerPool; return inst; }
+
+	//! Threads working a parallel section, counting the submitting thread; never 0
+	static size_t numThreads();
+	//! Overrides the detected thread count (0 restores auto-detection).
+	//! Call before the first parallel section; running workers stay up.
+	static void setNumThreads(size_t n);
+
+	class TaskGroup
+	{
+	public:
+		TaskGroup() : pending(0), cancelled(false) {}
+		//! Drains outstanding tasks; normally wait() already has
+		~TaskGroup();
+
+		//! Schedules f on the pool; runs in place when numThreads() is 1
+		void run(const boost::function<void()> &f);
+		/*!
+			Blocks until every task of this group has finished, executing
+			queued tasks meanwhile. Throws ProgressCancelException when a
+			task of this group was cancelled or failed.
+		*/
+		void wait();
+
+	private:
+		friend class WorkerPool;
+		size_t pending;   // guarded by the pool mutex
+		bool cancelled;   // guarded by the pool mutex
+	};
+
+private:
+	WorkerPool() : started_workers(0) {}
+
+	struct Task {
+		TaskGroup *group;
+		boost::function<void()> fn;
+	};
+
+	void enqueue(TaskGroup *group, const boost::function<void()> &fn);
+	void waitGroup(TaskGroup *group);
+	void execute(const Task &task);
+	void startWorkers();
+	void workerLoop();
+
+	boost::mutex pool_mutex;
+	boost::condition_variable work_available; // workers sleep here
+	boost::condition_variable task_done;      // waiters sleep here
+	std::deque<Task> queue;
+	size_t started_workers;
+
+	static WorkerPool *inst;
+};
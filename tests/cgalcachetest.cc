@@ -37,8 +37,11 @@
 #include "Tree.h"
 #include "CGAL_Nef_polyhedron.h"
 #include "GeometryEvaluator.h"
+#include "GeometryCache.h"
 #include "CGALCache.h"
 
+#include <fstream>
+
 #ifndef _MSC_VER
 #include <getopt.h>
 #endif
@@ -63,7 +66,12 @@ po::variables_map parse_options(int argc, char *argv[])
 	po::options_description desc("Allowed options");
 	desc.add_options()
 		("help,h", "help message")
-		("cgalcachesize", po::value<size_t>(), "Set CGAL cache size in bytes");
+		("cgalcachesize", po::value<size_t>(), "Set CGAL cache size in bytes")
+		("geometrycachesize", po::value<size_t>(), "Set geometry cache size in bytes (trace mode)")
+		("trace", "Treat the input file as a recorded evaluation trace instead of a design")
+		("min-hit-rate", po::value<double>(), "Fail unless the trace hit rate reaches this fraction")
+		("min-byte-hit-rate", po::value<double>(), "Fail unless the byte-weighted hit rate reaches this fraction")
+		("min-cost-avoided", po::value<double>(), "Fail unless at least this many ms of recompute cost were avoided");
 	
 	po::options_description hidden("Hidden options");
 	hidden.add_options()
@@ -83,6 +91,115 @@ po::variables_map parse_options(int argc, char *argv[])
 	return vm;
 }
 
+/*!
+	Stand-in for cached geometry during trace replay: carries only the
+	recorded byte size, which is all the eviction policy looks at.
+*/
+class TraceGeometry : public Geometry
+{
+public:
+	TraceGeometry(size_t bytes) : bytes(bytes) {}
+	virtual size_t memsize() const { return this->bytes; }
+	virtual std::string dump() const { return "trace"; }
+	virtual unsigned int getDimension() const { return 3; }
+	virtual bool isEmpty() const { return false; }
+	virtual Geometry *copy() const { return new TraceGeometry(*this); }
+protected:
+	virtual BoundingBox computeBoundingBox() const { return BoundingBox(); }
+private:
+	size_t bytes;
+};
+
+/*!
+	Replays a recorded evaluation trace against the GeometryCache and
+	reports how effective the cache policy was on it. A trace is a text
+	file of one event per line:
+
+	  eval <node-id> <bytes> <cost-ms>   a node evaluation: a cache miss
+	                                     would recompute <bytes> of
+	                                     geometry in <cost-ms>
+	  clear                              a recompile flushing the caches
+	  # ...                              comment
+
+	Reported (and optionally asserted via --min-*): hit rate, the
+	byte-weighted hit rate, and the recompute cost avoided in ms. The
+	CGALCache shares the same sharded LRU machinery, so its policy is
+	covered by the same replay; its entries just cost more to fake up.
+*/
+static int replay_trace(const char *filename, const po::variables_map &vm)
+{
+	std::ifstream stream(filename);
+	if (!stream.good()) {
+		std::cerr << "Can't open trace file '" << filename << "'\n";
+		return 1;
+	}
+
+	size_t lookups = 0, hits = 0;
+	size_t bytes_requested = 0, bytes_hit = 0;
+	double cost_avoided = 0, cost_paid = 0;
+
+	std::string line;
+	while (std::getline(stream, line)) {
+		std::istringstream ss(line);
+		std::string op;
+		if (!(ss >> op) || op[0] == '#') continue;
+		if (op == "clear") {
+			GeometryCache::instance()->clear();
+			continue;
+		}
+		if (op != "eval") {
+			std::cerr << "Unknown trace op '" << op << "'\n";
+			return 1;
+		}
+		std::string id;
+		size_t bytes;
+		double cost;
+		if (!(ss >> id >> bytes >> cost)) {
+			std::cerr << "Malformed trace line: " << line << "\n";
+			return 1;
+		}
+		lookups++;
+		bytes_requested += bytes;
+		if (GeometryCache::instance()->contains(id)) {
+			hits++;
+			bytes_hit += bytes;
+			cost_avoided += cost;
+			GeometryCache::instance()->get(id); // touch for the LRU order
+		}
+		else {
+			cost_paid += cost;
+			GeometryCache::instance()->insert(id, shared_ptr<const Geometry>(new TraceGeometry(bytes)));
+		}
+	}
+
+	double hitrate = lookups ? (double)hits / lookups : 0;
+	double bytehitrate = bytes_requested ? (double)bytes_hit / bytes_requested : 0;
+	std::cout << "Lookups:             " << lookups << "\n";
+	std::cout << "Hit rate:            " << hitrate << " (" << hits << " hits)\n";
+	std::cout << "Byte-weighted:       " << bytehitrate
+						<< " (" << bytes_hit << " of " << bytes_requested << " bytes)\n";
+	std::cout << "Cost avoided:        " << cost_avoided << " ms\n";
+	std::cout << "Cost paid:           " << cost_paid << " ms\n";
+
+	int failures = 0;
+	if (vm.count("min-hit-rate") && hitrate < vm["min-hit-rate"].as<double>()) {
+		std::cerr << "FAIL: hit rate " << hitrate << " below threshold "
+							<< vm["min-hit-rate"].as<double>() << "\n";
+		failures++;
+	}
+	if (vm.count("min-byte-hit-rate") && bytehitrate < vm["min-byte-hit-rate"].as<double>()) {
+		std::cerr << "FAIL: byte-weighted hit rate " << bytehitrate << " below threshold "
+							<< vm["min-byte-hit-rate"].as<double>() << "\n";
+		failures++;
+	}
+	if (vm.count("min-cost-avoided") && cost_avoided < vm["min-cost-avoided"].as<double>()) {
+		std::cerr << "FAIL: cost avoided " << cost_avoided << " ms below threshold "
+							<< vm["min-cost-avoided"].as<double>() << " ms\n";
+		failures++;
+	}
+	return failures ? 1 : 0;
+}
+
 int main(int argc, char **argv)
 {
 	const char *filename, *outfilename = NULL;
@@ -103,6 +220,17 @@ int main(int argc, char **argv)
 		outfilename = vm["output-file"].as<string>().c_str();
 	}
 
+	if (vm.count("trace")) {
+		if (!filename) {
+			std::cerr << "Usage: " << argv[0] << " --trace [options] <file.trace>\n";
+			exit(1);
+		}
+		if (vm.count("geometrycachesize")) {
+			GeometryCache::instance()->setMaxSize(vm["geometrycachesize"].as<size_t>());
+		}
+		exit(replay_trace(filename, vm));
+	}
+
 	if ((!filename || !outfilename)) {
 		std::cerr << "Usage: " << argv[0] << " <file.scad> <output.txt>\n";
 		exit(1);
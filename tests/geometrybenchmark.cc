@@ -0,0 +1,336 @@
+/*
+ *  OpenSCAD (www.openscad.org)
+ *  Copyright (C) 2009-2011 Clifford Wolf <clifford@clifford.at> and
+ *                          Marius Kintel <marius@kintel.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  As a special exception, you have permission to link this program
+ *  with the CGAL library and distribute executables, as long as you
+ *  follow the requirements of the GNU GPL in regard to all of the
+ *  software in the executable aside from CGAL.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+	Benchmark binary for canonical geometry workloads. Each workload is run
+	with warmup iterations followed by timed repetitions with cleared
+	caches, and the per-repetition wall times are emitted as JSON so a farm
+	can track trends across commits. This binary measures speed, not
+	correctness - it is intentionally not registered with CTest.
+*/
+
+#include "tests-common.h"
+#include "openscad.h"
+#include "printutils.h"
+#include "parsersettings.h"
+#include "node.h"
+#include "module.h"
+#include "modcontext.h"
+#include "builtin.h"
+#include "Tree.h"
+#include "GeometryEvaluator.h"
+#include "GeometryCache.h"
+#include "CGALCache.h"
+#include "Polygon2d.h"
+#include "clipper-utils.h"
+#include "export.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cmath>
+
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/foreach.hpp>
+#include "boosty.h"
+
+std::string commandline_commands;
+std::string currentdir;
+
+using std::string;
+using std::vector;
+
+static double now()
+{
+	static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+	return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds() / 1e6;
+}
+
+static void clear_caches()
+{
+	GeometryCache::instance()->clear();
+	CGALCache::instance()->clear();
+}
+
+/*!
+	Parses and instantiates the given source text, returning the root node.
+	The caller owns the returned node tree; module is set to the parsed
+	FileModule which must stay alive as long as the tree is used.
+*/
+static AbstractNode *instantiate_source(const std::string &source, FileModule **module)
+{
+	*module = parse(source.c_str(), currentdir.c_str(), false);
+	if (!*module) return NULL;
+
+	ModuleContext top_ctx;
+	top_ctx.registerBuiltin();
+	ModuleInstantiation root_inst("group");
+	AbstractNode::resetIndexCounter();
+	return (*module)->instantiate(&top_ctx, &root_inst);
+}
+
+/*!
+	Times one full geometry evaluation of the given source. Parsing and
+	instantiation happen outside the timed section.
+*/
+static double time_geometry_evaluation(const std::string &source)
+{
+	FileModule *module = NULL;
+	AbstractNode *root_node = instantiate_source(source, &module);
+	if (!root_node) return -1;
+
+	clear_caches();
+	Tree tree(root_node);
+	GeometryEvaluator evaluator(tree);
+
+	double start = now();
+	shared_ptr<const Geometry> geom = evaluator.evaluateGeometry(*root_node, true);
+	double elapsed = now() - start;
+
+	delete root_node;
+	return geom ? elapsed : -1;
+}
+
+/*!
+	Union fold over many disjoint and overlapping solids; exercises
+	applyToChildren3D() and the CGAL union machinery.
+*/
+static double bench_union_fold()
+{
+	std::stringstream src;
+	src << "union() {\n";
+	for (int i = 0; i < 30; i++) {
+		src << "  translate([" << (i % 6) * 1.5 << ", " << (i / 6) * 1.5 << ", 0]) cube(2);\n";
+	}
+	src << "}\n";
+	return time_geometry_evaluation(src.str());
+}
+
+/*!
+	STL import of a generated ~10k-facet mesh. setup_import_stl() writes
+	the mesh once; the timed section covers parsing and indexing the file.
+*/
+static std::string import_stl_file;
+
+static bool setup_import_stl()
+{
+	FileModule *module = NULL;
+	AbstractNode *root_node = instantiate_source("sphere(r=10, $fn=100);\n", &module);
+	if (!root_node) return false;
+
+	Tree tree(root_node);
+	GeometryEvaluator evaluator(tree);
+	shared_ptr<const Geometry> geom = evaluator.evaluateGeometry(*root_node, true);
+	delete root_node;
+	if (!geom) return false;
+
+	import_stl_file = boosty::stringy(boosty::absolute(fs::path("geometrybenchmark_import.stl")));
+	exportFileByName(geom.get(), OPENSCAD_STL, import_stl_file.c_str(), import_stl_file.c_str());
+	return fs::exists(fs::path(import_stl_file));
+}
+
+static double bench_import_stl()
+{
+	return time_geometry_evaluation("import(\"" + import_stl_file + "\");\n");
+}
+
+/*!
+	2D union storm: many overlapping circle outlines through
+	ClipperUtils::apply(), mirroring heavy 2D offset/projection models.
+*/
+static double bench_clipper_union()
+{
+	std::vector<Polygon2d *> storage;
+	std::vector<const Polygon2d *> polygons;
+	for (int i = 0; i < 300; i++) {
+		Outline2d outline;
+		double cx = (i % 20) * 1.2;
+		double cy = (i / 20) * 1.2;
+		for (int j = 0; j < 32; j++) {
+			double a = 2 * M_PI * j / 32;
+			outline.vertices.push_back(Vector2d(cx + cos(a), cy + sin(a)));
+		}
+		Polygon2d *poly = new Polygon2d();
+		poly->addOutline(outline);
+		storage.push_back(poly);
+		polygons.push_back(poly);
+	}
+
+	double start = now();
+	Polygon2d *result = ClipperUtils::apply(polygons, ClipperLib::ctUnion);
+	double elapsed = now() - start;
+
+	delete result;
+	BOOST_FOREACH(Polygon2d *poly, storage) delete poly;
+	return elapsed;
+}
+
+/*!
+	Expression-heavy instantiation: recursive function calls and
+	trigonometry per loop iteration, no geometry evaluation at all.
+*/
+static double bench_expression_eval()
+{
+	std::string src =
+		"function acc(n, s) = n <= 0 ? s : acc(n - 1, s + sin(n) * cos(n) + sqrt(n));\n"
+		"for (i = [0 : 400]) cube(acc(40, i));\n";
+
+	FileModule *module = parse(src.c_str(), currentdir.c_str(), false);
+	if (!module) return -1;
+
+	ModuleContext top_ctx;
+	top_ctx.registerBuiltin();
+	ModuleInstantiation root_inst("group");
+	AbstractNode::resetIndexCounter();
+
+	double start = now();
+	AbstractNode *root_node = module->instantiate(&top_ctx, &root_inst);
+	double elapsed = now() - start;
+
+	if (!root_node) return -1;
+	delete root_node;
+	return elapsed;
+}
+
+struct Benchmark {
+	const char *name;
+	double (*run)();
+};
+
+int main(int argc, char **argv)
+{
+	int warmup = 1;
+	int runs = 3;
+	const char *output_file = NULL;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "help message")
+		("warmup", po::value<int>(), "untimed iterations per benchmark (default 1)")
+		("runs", po::value<int>(), "timed repetitions per benchmark (default 3)")
+		("output,o", po::value<string>(), "write the JSON report to this file instead of stdout");
+
+	po::variables_map vm;
+	try {
+		po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+		po::notify(vm);
+	} catch (const po::error &e) {
+		std::cerr << "error parsing options: " << e.what() << "\n";
+		exit(1);
+	}
+	if (vm.count("help")) {
+		std::cout << desc;
+		exit(0);
+	}
+	if (vm.count("warmup")) warmup = vm["warmup"].as<int>();
+	if (vm.count("runs")) runs = vm["runs"].as<int>();
+	if (vm.count("output")) output_file = vm["output"].as<string>().c_str();
+
+	Builtins::instance()->initialize();
+	currentdir = boosty::stringy(fs::current_path());
+	parser_init(boosty::stringy(fs::path(argv[0]).branch_path()));
+	add_librarydir(boosty::stringy(fs::path(argv[0]).branch_path() / "../libraries"));
+
+	if (!setup_import_stl()) {
+		std::cerr << "Unable to generate the STL import workload\n";
+		exit(1);
+	}
+
+	Benchmark benchmarks[] = {
+		{ "union-fold", bench_union_fold },
+		{ "import-stl", bench_import_stl },
+		{ "clipper-union", bench_clipper_union },
+		{ "expression-eval", bench_expression_eval },
+	};
+	const size_t numbenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+	std::stringstream json;
+	json << "{\n  \"benchmarks\": [";
+	bool failed = false;
+	size_t emitted = 0;
+	for (size_t i = 0; i < numbenchmarks; i++) {
+		const Benchmark &b = benchmarks[i];
+		std::cerr << "Running " << b.name << "...\n";
+		for (int j = 0; j < warmup; j++) b.run();
+
+		std::vector<double> times;
+		double min = 0, sum = 0;
+		for (int j = 0; j < runs; j++) {
+			double t = b.run();
+			if (t < 0) {
+				std::cerr << b.name << ": workload failed\n";
+				failed = true;
+				break;
+			}
+			times.push_back(t);
+			sum += t;
+			if (times.size() == 1 || t < min) min = t;
+		}
+		if (times.empty()) continue;
+
+		json << (emitted++ ? "," : "") << "\n";
+		json << "    {\n";
+		json << "      \"name\": \"" << b.name << "\",\n";
+		json << "      \"unit\": \"seconds\",\n";
+		json << "      \"warmup\": " << warmup << ",\n";
+		json << "      \"runs\": " << times.size() << ",\n";
+		json << "      \"times\": [";
+		for (size_t j = 0; j < times.size(); j++) {
+			if (j) json << ", ";
+			json << times[j];
+		}
+		json << "],\n";
+		json << "      \"min\": " << min << ",\n";
+		json << "      \"mean\": " << sum / times.size() << "\n";
+		json << "    }";
+	}
+	json << "\n  ]\n}\n";
+
+	if (output_file) {
+		std::ofstream fstream(output_file);
+		if (!fstream.is_open()) {
+			std::cerr << "Can't open output file " << output_file << "\n";
+			failed = true;
+		}
+		else fstream << json.str();
+	}
+	else {
+		std::cout << json.str();
+	}
+
+	if (!import_stl_file.empty()) {
+		boost::system::error_code ec;
+		fs::remove(fs::path(import_stl_file), ec);
+	}
+
+	Builtins::instance(true);
+	return failed ? 1 : 0;
+}